@@ -19,6 +19,8 @@
 #include "net/instaweb/http/public/async_fetch_with_lock.h"
 
 #include "base/logging.h"
+#include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/inflight_fetch_table.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -37,6 +39,46 @@ namespace {
 const int kDefaultLockTimoutMs = 2 * Timer::kMinuteMs;
 const int kLockTimeoutSlackMs = 2 * Timer::kMinuteMs;
 
+// Passes the response a leading fetch gets from its fetcher to its
+// followers, as well as to the fetch itself.
+class SharingFetch : public SharedAsyncFetch {
+ public:
+  SharingFetch(AsyncFetch* base_fetch, InflightFetchTable::Leader* leader)
+      : SharedAsyncFetch(base_fetch),
+        leader_(leader) {
+  }
+
+ protected:
+  virtual void HandleHeadersComplete() {
+    leader_->HeadersComplete(*response_headers());
+    SharedAsyncFetch::HandleHeadersComplete();
+  }
+
+  // Even if the base fetch can't use the rest of the body, carry on
+  // fetching it if followers may still want it.
+  virtual bool HandleWrite(const StringPiece& content,
+                           MessageHandler* handler) {
+    bool wanted = leader_->Write(content, handler);
+    return SharedAsyncFetch::HandleWrite(content, handler) || wanted;
+  }
+
+  virtual bool HandleFlush(MessageHandler* handler) {
+    leader_->Flush(handler);
+    return SharedAsyncFetch::HandleFlush(handler);
+  }
+
+  virtual void HandleDone(bool success) {
+    leader_->Done(success);
+    SharedAsyncFetch::HandleDone(success);
+    delete this;
+  }
+
+ private:
+  InflightFetchTable::Leader* leader_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharingFetch);
+};
+
 }  // namespace
 
 AsyncFetchWithLock::AsyncFetchWithLock(
@@ -51,7 +93,10 @@ AsyncFetchWithLock::AsyncFetchWithLock(
       lock_hasher_(hasher),
       url_(url),
       cache_key_(cache_key),
-      message_handler_(message_handler) {
+      message_handler_(message_handler),
+      inflight_fetch_table_(NULL),
+      leader_(NULL),
+      following_(false) {
 }
 
 AsyncFetchWithLock::~AsyncFetchWithLock() {
@@ -60,6 +105,19 @@ AsyncFetchWithLock::~AsyncFetchWithLock() {
 }
 
 void AsyncFetchWithLock::Start(UrlAsyncFetcher* fetcher) {
+  if (inflight_fetch_table_ != NULL) {
+    inflight_key_ = InflightKey();
+    // Once this is following, it may be finished, and deleted, at any time,
+    // so following_ has to be set beforehand.
+    following_ = true;
+    AsyncFetch* follower = NewFollowerFetch();
+    if (inflight_fetch_table_->Follow(inflight_key_, follower)) {
+      return;
+    }
+    following_ = false;
+    DeleteFollowerFetch(follower);
+  }
+
   lock_.reset(MakeInputLock(cache_key()));
 
   int64 lock_timeout = fetcher->timeout_ms();
@@ -94,15 +152,65 @@ void AsyncFetchWithLock::LockFailed(UrlAsyncFetcher* fetcher) {
     message_handler_->Message(
         kInfo, "%s is being re-fetched asynchronously "
         "(lock %s held elsewhere)", cache_key().c_str(), lock_name.c_str());
-    StartFetch(fetcher, message_handler_);
+    LeadOrFollow(fetcher);
   }
 }
 
 void AsyncFetchWithLock::LockAcquired(UrlAsyncFetcher* fetcher) {
+  LeadOrFollow(fetcher);
+}
+
+void AsyncFetchWithLock::LeadOrFollow(UrlAsyncFetcher* fetcher) {
+  if (inflight_fetch_table_ != NULL) {
+    // As in Start(), nothing in this may be touched once it's following, so
+    // take the lock out of it first.
+    scoped_ptr<NamedLock> lock(lock_.release());
+    following_ = true;
+    bool following = false;
+    AsyncFetch* follower = NewFollowerFetch();
+    InflightFetchTable::Leader* leader =
+        inflight_fetch_table_->Lead(inflight_key_, follower, &following);
+    if (following) {
+      if (lock.get() != NULL) {
+        lock->Unlock();
+      }
+      return;
+    }
+    following_ = false;
+    DeleteFollowerFetch(follower);
+    leader_ = leader;
+    lock_.reset(lock.release());
+  }
   StartFetch(fetcher, message_handler_);
 }
 
+GoogleString AsyncFetchWithLock::InflightKey() {
+  return cache_key_;
+}
+
+AsyncFetch* AsyncFetchWithLock::NewFollowerFetch() {
+  return this;
+}
+
+void AsyncFetchWithLock::DeleteFollowerFetch(AsyncFetch* fetch) {
+  DCHECK_EQ(this, fetch);
+}
+
+AsyncFetch* AsyncFetchWithLock::ShareResponse(AsyncFetch* fetch) {
+  if (leader_ == NULL) {
+    return fetch;
+  }
+  AsyncFetch* sharing_fetch = new SharingFetch(fetch, leader_);
+  leader_ = NULL;
+  return sharing_fetch;
+}
+
 void AsyncFetchWithLock::HandleDone(bool success) {
+  if (leader_ != NULL) {
+    // The response was never shared, so the followers get nothing but this.
+    leader_->Done(false);
+    leader_ = NULL;
+  }
   if (lock_.get() != NULL) {
     lock_->Unlock();
     lock_.reset(NULL);
@@ -33,6 +33,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/http/byte_range.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/http_options.h"
 #include "pagespeed/kernel/http/request_headers.h"
@@ -47,6 +48,10 @@ const int CacheUrlAsyncFetcher::kNotInCacheStatus = HttpStatus::kNotImplemented;
 
 namespace {
 
+// Prefix of the boundary between the parts of a multipart/byteranges
+// response; a number is appended to keep it out of the parts themselves.
+const char kByteRangesBoundary[] = "pagespeed_byteranges_";
+
 class CachePutFetch : public SharedAsyncFetch {
  public:
   CachePutFetch(const GoogleString& url, const GoogleString& fragment,
@@ -258,6 +263,8 @@ class CacheFindCallback : public HTTPCache::Callback {
         num_conditional_refreshes_(owner->num_conditional_refreshes()),
         num_proactively_freshen_user_facing_request_(
             owner->num_proactively_freshen_user_facing_request()),
+        byte_range_responses_served_(owner->byte_range_responses_served()),
+        byte_range_bytes_served_(owner->byte_range_bytes_served()),
         handler_(handler),
         http_options_(base_fetch->request_context()->options()),
         respect_vary_(ResponseHeaders::GetVaryOption(owner->respect_vary())),
@@ -266,6 +273,7 @@ class CacheFindCallback : public HTTPCache::Callback {
         default_cache_html_(owner->default_cache_html()),
         proactively_freshen_user_facing_request_(
             owner->proactively_freshen_user_facing_request()),
+        serve_byte_ranges_(owner->serve_byte_ranges()),
         serve_stale_while_revalidate_threshold_sec_(
             owner->serve_stale_while_revalidate_threshold_sec()) {
     // Note that this is a cache lookup: there are no request-headers.  At
@@ -303,16 +311,18 @@ class CacheFindCallback : public HTTPCache::Callback {
           // non-chunked responses.
           StringPiece contents;
           http_value()->ExtractContents(&contents);
-          base_fetch_->set_content_length(contents.size());
           response_headers()->ComputeCaching();
           is_imminently_expiring = IsImminentlyExpiring(*response_headers());
-          base_fetch_->HeadersComplete();
-
-          // TODO(sligocki): We are writing all the content in one shot, this
-          // fact might be useful to the HtmlParser if this is HTML. Perhaps
-          // we should add an API for conveying that information, which can
-          // be detected via AsyncFetch::content_length_known().
-          base_fetch_->Write(contents, handler_);
+          if (!serve_byte_ranges_ || !ServedByteRanges(contents)) {
+            base_fetch_->set_content_length(contents.size());
+            base_fetch_->HeadersComplete();
+
+            // TODO(sligocki): We are writing all the content in one shot,
+            // this fact might be useful to the HtmlParser if this is HTML.
+            // Perhaps we should add an API for conveying that information,
+            // which can be detected via AsyncFetch::content_length_known().
+            base_fetch_->Write(contents, handler_);
+          }
         } else {
           response_headers()->ComputeCaching();
           is_imminently_expiring = IsImminentlyExpiring(*response_headers());
@@ -474,6 +484,125 @@ class CacheFindCallback : public HTTPCache::Callback {
     fetch->Start(fetcher_);
   }
 
+  // Serves the parts of contents named in the request's Range header, if it
+  // has one that applies to this response.  Returns false if the whole
+  // response should be served instead.  The parts are written as slices of
+  // contents, which stays alive in http_value() until we're done.
+  bool ServedByteRanges(StringPiece contents) {
+    ResponseHeaders* headers = response_headers();
+    const char* range = request_headers()->Lookup1(HttpAttributes::kRange);
+    if ((range == NULL) || (headers->status_code() != HttpStatus::kOK) ||
+        headers->Has(HttpAttributes::kContentEncoding) ||
+        headers->IsHtmlLike() || !IfRangeMatches()) {
+      return false;
+    }
+    int64 content_length = contents.size();
+    ByteRangeVector ranges;
+    switch (ParseByteRanges(range, content_length, &ranges)) {
+      case kByteRangeIgnored:
+        return false;
+      case kByteRangeNotSatisfiable:
+        headers->SetStatusAndReason(HttpStatus::kRangeNotSatisfiable);
+        headers->Replace(HttpAttributes::kContentRange,
+                         UnsatisfiedContentRangeValue(content_length));
+        CompleteRangeHeaders(0);
+        return true;
+      case kByteRangeSatisfiable:
+        break;
+    }
+
+    headers->SetStatusAndReason(HttpStatus::kPartialContent);
+    int64 bytes_served = 0;
+    if (ranges.size() == 1) {
+      const ByteRange& only = ranges[0];
+      headers->Replace(HttpAttributes::kContentRange,
+                       ContentRangeValue(only, content_length));
+      CompleteRangeHeaders(only.size());
+      base_fetch_->Write(contents.substr(only.first, only.size()), handler_);
+      bytes_served = only.size();
+    } else {
+      GoogleString boundary = ByteRangesBoundary(contents, ranges);
+      const char* content_type =
+          headers->Lookup1(HttpAttributes::kContentType);
+      StringVector part_headers(ranges.size());
+      int64 total_length = 0;
+      for (int i = 0, n = ranges.size(); i < n; ++i) {
+        part_headers[i] = MultipartByteRangeHeader(
+            boundary, (content_type == NULL) ? "" : content_type, ranges[i],
+            content_length);
+        total_length += part_headers[i].size() + ranges[i].size();
+        bytes_served += ranges[i].size();
+      }
+      GoogleString trailer = MultipartByteRangesTrailer(boundary);
+      total_length += trailer.size();
+
+      headers->Replace(HttpAttributes::kContentType,
+                       StrCat("multipart/byteranges; boundary=", boundary));
+      CompleteRangeHeaders(total_length);
+      for (int i = 0, n = ranges.size(); i < n; ++i) {
+        base_fetch_->Write(part_headers[i], handler_);
+        base_fetch_->Write(contents.substr(ranges[i].first, ranges[i].size()),
+                           handler_);
+      }
+      base_fetch_->Write(trailer, handler_);
+    }
+    if (byte_range_responses_served_ != NULL) {
+      byte_range_responses_served_->Add(1);
+    }
+    if (byte_range_bytes_served_ != NULL) {
+      byte_range_bytes_served_->Add(bytes_served);
+    }
+    return true;
+  }
+
+  // An If-Range header asks for the ranges only if the cached response is
+  // the one the client already has part of.  Only strong validators count
+  // (RFC 7233 section 3.2), which rules out the weak ETags we generate.
+  bool IfRangeMatches() const {
+    const char* if_range = request_headers()->Lookup1(HttpAttributes::kIfRange);
+    if (if_range == NULL) {
+      return true;
+    }
+    StringPiece validator(if_range);
+    if (validator.starts_with("W/")) {
+      return false;
+    } else if (validator.starts_with("\"")) {
+      const char* etag = response_headers()->Lookup1(HttpAttributes::kEtag);
+      return (etag != NULL) && (validator == etag);
+    }
+    return ConditionalHeadersMatch(HttpAttributes::kIfRange,
+                                   HttpAttributes::kLastModified);
+  }
+
+  // Finds a boundary that doesn't occur in any of the parts of contents
+  // being served.
+  static GoogleString ByteRangesBoundary(StringPiece contents,
+                                         const ByteRangeVector& ranges) {
+    for (int suffix = 0; ; ++suffix) {
+      GoogleString boundary =
+          StrCat(kByteRangesBoundary, IntegerToString(suffix));
+      bool found = false;
+      for (int i = 0, n = ranges.size(); !found && (i < n); ++i) {
+        StringPiece part = contents.substr(ranges[i].first, ranges[i].size());
+        found = (part.find(boundary) != StringPiece::npos);
+      }
+      if (!found) {
+        return boundary;
+      }
+    }
+  }
+
+  void CompleteRangeHeaders(int64 content_length) {
+    ResponseHeaders* headers = response_headers();
+    base_fetch_->set_content_length(content_length);
+    if (headers->Has(HttpAttributes::kContentLength)) {
+      headers->Replace(HttpAttributes::kContentLength,
+                       Integer64ToString(content_length));
+    }
+    headers->ComputeCaching();
+    base_fetch_->HeadersComplete();
+  }
+
   bool ShouldReturn304() const {
     if (ConditionalHeadersMatch(HttpAttributes::kIfNoneMatch,
                                 HttpAttributes::kEtag)) {
@@ -550,6 +679,8 @@ class CacheFindCallback : public HTTPCache::Callback {
   Variable* fallback_responses_served_while_revalidate_;
   Variable* num_conditional_refreshes_;
   Variable* num_proactively_freshen_user_facing_request_;
+  Variable* byte_range_responses_served_;
+  Variable* byte_range_bytes_served_;
   MessageHandler* handler_;
 
   const HttpOptions http_options_;
@@ -559,6 +690,7 @@ class CacheFindCallback : public HTTPCache::Callback {
   bool serve_stale_if_fetch_error_;
   bool default_cache_html_;
   bool proactively_freshen_user_facing_request_;
+  bool serve_byte_ranges_;
   int64 serve_stale_while_revalidate_threshold_sec_;
 
   DISALLOW_COPY_AND_ASSIGN(CacheFindCallback);
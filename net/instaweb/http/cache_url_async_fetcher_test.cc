@@ -62,6 +62,7 @@ namespace {
 const char kStartFetchPrefix[] = "start_fetch";
 const char kFetchTriggeredPrefix[] = "fetch_triggered";
 const char kDelayedFetchFinishPrefix[] = "delayed_fetch_finish";
+const char kRangeEtag[] = "\"range-etag\"";
 
 class MockFetch : public AsyncFetch {
  public:
@@ -242,9 +243,11 @@ class CacheUrlAsyncFetcherTest : public ::testing::Test {
         conditional_etag_url_("http://www.example.com/cond_etag.jpg"),
         implicit_cache_url_("http://www.example.com/implicit_cache.jpg"),
         vary_url_("http://www.example.com/vary"),
+        range_url_("http://www.example.com/range.jpg"),
         fragment_("www.example.com"),
         cache_body_("good"), nocache_body_("bad"), bad_body_("ugly"),
         vary_body_("vary"),
+        range_body_("abcdefghijklmnopqrstuvwxyz"),
         etag_("123456790ABCDEF"),
         ttl_ms_(Timer::kHourMs),
         implicit_cache_ttl_ms_(500 * Timer::kSecondMs),
@@ -592,6 +595,43 @@ class CacheUrlAsyncFetcherTest : public ::testing::Test {
     headers->ComputeCaching();
   }
 
+  // Puts range_body_ into the cache as a cacheable image, and turns on
+  // byte-range serving.
+  void SetUpByteRanges() {
+    cache_fetcher_->set_serve_byte_ranges(true);
+    cache_fetcher_->set_byte_range_responses_served(
+        statistics_.AddVariable("byte_range_responses_served"));
+    cache_fetcher_->set_byte_range_bytes_served(
+        statistics_.AddVariable("byte_range_bytes_served"));
+    PutRangeResponse(range_url_, kContentTypeJpeg, range_body_);
+  }
+
+  void PutRangeResponse(const GoogleString& url,
+                        const ContentType& content_type,
+                        const StringPiece& body) {
+    ResponseHeaders headers;
+    DefaultResponseHeaders(content_type, 100, &headers);
+    headers.Add(HttpAttributes::kEtag, kRangeEtag);
+    headers.ComputeCaching();
+    http_cache_->Put(url, fragment_, empty_request_headers_.GetProperties(),
+                     ResponseHeaders::kRespectVaryOnResources,
+                     &headers, body, &handler_);
+  }
+
+  // Fetches url with the given Range header, plus whatever request headers
+  // are already in fetch.
+  void FetchRange(const GoogleString& url, const StringPiece& range,
+                  StringAsyncFetch* fetch) {
+    fetch->request_headers()->Replace(HttpAttributes::kRange, range);
+    cache_fetcher_->Fetch(url, &handler_, fetch);
+    EXPECT_TRUE(fetch->done());
+    EXPECT_TRUE(fetch->success());
+  }
+
+  int64 ByteRangeStat(const char* name) {
+    return statistics_.GetVariable(name)->Get();
+  }
+
   LRUCache lru_cache_;
   scoped_ptr<ThreadSystem> thread_system_;
   SimpleStats statistics_;
@@ -618,6 +658,7 @@ class CacheUrlAsyncFetcherTest : public ::testing::Test {
   const GoogleString conditional_etag_url_;
   const GoogleString implicit_cache_url_;
   const GoogleString vary_url_;
+  const GoogleString range_url_;
 
   const GoogleString fragment_;
 
@@ -627,6 +668,7 @@ class CacheUrlAsyncFetcherTest : public ::testing::Test {
   const GoogleString nocache_body_;
   const GoogleString bad_body_;
   const GoogleString vary_body_;
+  const GoogleString range_body_;
 
   const GoogleString etag_;
 
@@ -1872,6 +1914,175 @@ TEST_F(CacheUrlAsyncFetcherTest, TestParallelBackgroundFreshenCalls) {
   EXPECT_EQ(0, cache_fetcher_->fallback_responses_served()->Get());
 }
 
+TEST_F(CacheUrlAsyncFetcherTest, SingleByteRange) {
+  SetUpByteRanges();
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=2-5", &fetch);
+  const ResponseHeaders* headers = fetch.response_headers();
+  EXPECT_EQ(HttpStatus::kPartialContent, headers->status_code());
+  EXPECT_STREQ("bytes 2-5/26", headers->Lookup1(HttpAttributes::kContentRange));
+  EXPECT_STREQ(kContentTypeJpeg.mime_type(),
+               headers->Lookup1(HttpAttributes::kContentType));
+  EXPECT_STREQ(kRangeEtag, headers->Lookup1(HttpAttributes::kEtag));
+  EXPECT_EQ("cdef", fetch.buffer());
+  EXPECT_TRUE(fetch.content_length_known());
+  EXPECT_EQ(4, fetch.content_length());
+
+  StringAsyncFetch suffix(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=-3", &suffix);
+  EXPECT_EQ(HttpStatus::kPartialContent,
+            suffix.response_headers()->status_code());
+  EXPECT_STREQ("bytes 23-25/26",
+               suffix.response_headers()->Lookup1(
+                   HttpAttributes::kContentRange));
+  EXPECT_EQ("xyz", suffix.buffer());
+
+  StringAsyncFetch clamped(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=20-1000", &clamped);
+  EXPECT_EQ("uvwxyz", clamped.buffer());
+
+  EXPECT_EQ(3, ByteRangeStat("byte_range_responses_served"));
+  EXPECT_EQ(13, ByteRangeStat("byte_range_bytes_served"));
+  EXPECT_EQ(0, counting_fetcher_.fetch_count());
+}
+
+TEST_F(CacheUrlAsyncFetcherTest, MultipleByteRanges) {
+  SetUpByteRanges();
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=0-1,-2", &fetch);
+  const ResponseHeaders* headers = fetch.response_headers();
+  EXPECT_EQ(HttpStatus::kPartialContent, headers->status_code());
+  EXPECT_FALSE(headers->Has(HttpAttributes::kContentRange));
+  EXPECT_STREQ("multipart/byteranges; boundary=pagespeed_byteranges_0",
+               headers->Lookup1(HttpAttributes::kContentType));
+  EXPECT_EQ("\r\n--pagespeed_byteranges_0\r\n"
+            "Content-Type: image/jpeg\r\n"
+            "Content-Range: bytes 0-1/26\r\n"
+            "\r\n"
+            "ab"
+            "\r\n--pagespeed_byteranges_0\r\n"
+            "Content-Type: image/jpeg\r\n"
+            "Content-Range: bytes 24-25/26\r\n"
+            "\r\n"
+            "yz"
+            "\r\n--pagespeed_byteranges_0--\r\n",
+            fetch.buffer());
+  EXPECT_EQ(static_cast<int64>(fetch.buffer().size()), fetch.content_length());
+  EXPECT_EQ(1, ByteRangeStat("byte_range_responses_served"));
+  EXPECT_EQ(4, ByteRangeStat("byte_range_bytes_served"));
+
+  // Overlapping ranges are merged into one.
+  StringAsyncFetch merged(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=4-6,0-4", &merged);
+  EXPECT_STREQ("bytes 0-6/26",
+               merged.response_headers()->Lookup1(
+                   HttpAttributes::kContentRange));
+  EXPECT_EQ("abcdefg", merged.buffer());
+}
+
+TEST_F(CacheUrlAsyncFetcherTest, ByteRangesBoundaryAvoidsBody) {
+  SetUpByteRanges();
+  const char kUrl[] = "http://www.example.com/boundary.jpg";
+  PutRangeResponse(kUrl, kContentTypeJpeg, "--pagespeed_byteranges_0--");
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(kUrl, "bytes=0-0,2-", &fetch);
+  EXPECT_STREQ("multipart/byteranges; boundary=pagespeed_byteranges_1",
+               fetch.response_headers()->Lookup1(HttpAttributes::kContentType));
+}
+
+TEST_F(CacheUrlAsyncFetcherTest, UnsatisfiableByteRange) {
+  SetUpByteRanges();
+  StringAsyncFetch fetch(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=26-", &fetch);
+  EXPECT_EQ(HttpStatus::kRangeNotSatisfiable,
+            fetch.response_headers()->status_code());
+  EXPECT_STREQ("bytes */26",
+               fetch.response_headers()->Lookup1(
+                   HttpAttributes::kContentRange));
+  EXPECT_EQ("", fetch.buffer());
+  EXPECT_EQ(0, fetch.content_length());
+  EXPECT_EQ(0, ByteRangeStat("byte_range_responses_served"));
+}
+
+TEST_F(CacheUrlAsyncFetcherTest, IfRange) {
+  SetUpByteRanges();
+  ResponseHeaders cached;
+  DefaultResponseHeaders(kContentTypeJpeg, 100, &cached);
+  const char* last_modified = cached.Lookup1(HttpAttributes::kLastModified);
+  ASSERT_TRUE(last_modified != NULL);
+
+  // Validators of the cached response get just the range ...
+  const char* matching[] = { kRangeEtag, last_modified };
+  for (int i = 0; i < static_cast<int>(arraysize(matching)); ++i) {
+    StringAsyncFetch fetch(
+        RequestContext::NewTestRequestContext(thread_system_.get()));
+    fetch.request_headers()->Add(HttpAttributes::kIfRange, matching[i]);
+    FetchRange(range_url_, "bytes=0-2", &fetch);
+    EXPECT_EQ(HttpStatus::kPartialContent,
+              fetch.response_headers()->status_code()) << matching[i];
+    EXPECT_EQ("abc", fetch.buffer());
+  }
+
+  // ... while others, including weak ETags, get the whole response.
+  const char* mismatching[] = {
+    "\"other-etag\"", "W/\"range-etag\"", "Thu, 01 Jan 2009 00:00:00 GMT"
+  };
+  for (int i = 0; i < static_cast<int>(arraysize(mismatching)); ++i) {
+    StringAsyncFetch fetch(
+        RequestContext::NewTestRequestContext(thread_system_.get()));
+    fetch.request_headers()->Add(HttpAttributes::kIfRange, mismatching[i]);
+    FetchRange(range_url_, "bytes=0-2", &fetch);
+    EXPECT_EQ(HttpStatus::kOK, fetch.response_headers()->status_code())
+        << mismatching[i];
+    EXPECT_FALSE(fetch.response_headers()->Has(HttpAttributes::kContentRange));
+    EXPECT_EQ(range_body_, fetch.buffer());
+  }
+  EXPECT_EQ(2, ByteRangeStat("byte_range_responses_served"));
+}
+
+TEST_F(CacheUrlAsyncFetcherTest, ByteRangesNotServed) {
+  SetUpByteRanges();
+  const char kHtmlUrl[] = "http://www.example.com/range.html";
+  PutRangeResponse(kHtmlUrl, kContentTypeHtml, range_body_);
+
+  // Malformed ranges, and HTML, get the whole response.
+  StringAsyncFetch malformed(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=5-2", &malformed);
+  EXPECT_EQ(HttpStatus::kOK, malformed.response_headers()->status_code());
+  EXPECT_EQ(range_body_, malformed.buffer());
+
+  StringAsyncFetch html(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(kHtmlUrl, "bytes=0-2", &html);
+  EXPECT_EQ(HttpStatus::kOK, html.response_headers()->status_code());
+  EXPECT_EQ(range_body_, html.buffer());
+
+  // HEAD requests aren't affected.
+  StringAsyncFetch head(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  head.request_headers()->set_method(RequestHeaders::kHead);
+  FetchRange(range_url_, "bytes=0-2", &head);
+  EXPECT_EQ(HttpStatus::kOK, head.response_headers()->status_code());
+  EXPECT_EQ("", head.buffer());
+
+  // Nor is anything if byte-range serving is off.
+  cache_fetcher_->set_serve_byte_ranges(false);
+  StringAsyncFetch off(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+  FetchRange(range_url_, "bytes=0-2", &off);
+  EXPECT_EQ(HttpStatus::kOK, off.response_headers()->status_code());
+  EXPECT_EQ(range_body_, off.buffer());
+  EXPECT_EQ(0, ByteRangeStat("byte_range_responses_served"));
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -23,6 +23,7 @@
 #include <cstddef>                     // for size_t
 
 #include "net/instaweb/http/public/http_value.h"
+#include "net/instaweb/http/public/http_value_writer.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/google_message_handler.h"
 #include "pagespeed/kernel/base/gtest.h"
@@ -807,6 +808,40 @@ TEST_F(HTTPCacheTest, UpdateVersion) {
             Find(kUrl, kFragment, &value, &meta_data_out, &message_handler_));
 }
 
+// HTTPValueWriter sizes its buffer from Content-Length, even with the
+// default cache settings, which place no limit on response size.
+TEST_F(HTTPCacheTest, ValueWriterReservesContentLength) {
+  const int kContentLength = 100000;
+  ASSERT_EQ(-1, http_cache_->max_cacheable_response_content_length());
+  ResponseHeaders headers;
+  InitHeaders(&headers, "max-age=300");
+  headers.Add(HttpAttributes::kContentLength, IntegerToString(kContentLength));
+  headers.ComputeCaching();
+  HTTPValue value;
+  HTTPValueWriter writer(&value, http_cache_.get());
+  writer.SetHeaders(&headers);
+  EXPECT_TRUE(writer.has_buffered());
+  EXPECT_LE(static_cast<size_t>(kContentLength),
+            value.share()->StringValue()->capacity());
+}
+
+// Without a cache size limit, a bogus Content-Length does not make the
+// writer reserve an arbitrarily large buffer.
+TEST_F(HTTPCacheTest, ValueWriterReservationCapped) {
+  const int64 kBogusContentLength = 1LL << 40;
+  ResponseHeaders headers;
+  InitHeaders(&headers, "max-age=300");
+  headers.Add(HttpAttributes::kContentLength,
+              Integer64ToString(kBogusContentLength));
+  headers.ComputeCaching();
+  HTTPValue value;
+  HTTPValueWriter writer(&value, http_cache_.get());
+  writer.SetHeaders(&headers);
+  EXPECT_TRUE(writer.has_buffered());
+  EXPECT_GT(static_cast<size_t>(kBogusContentLength),
+            value.share()->StringValue()->capacity());
+}
+
 class HTTPCacheWriteThroughTest : public HTTPCacheTest {
  protected:
   // Unlike HTTPCacheTest::Callback this can produce different validity for
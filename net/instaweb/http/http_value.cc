@@ -94,6 +94,17 @@ bool HTTPValue::Write(const StringPiece& str, MessageHandler* handler) {
   return true;
 }
 
+void HTTPValue::ReserveContents(int64 size) {
+  CopyOnWrite();
+  int64 new_size = storage_.size() + size;
+  if (storage_.empty()) {
+    new_size += kStorageOverhead;
+  }
+  if (new_size <= kint32max) {
+    storage_.Reserve(new_size);
+  }
+}
+
 bool HTTPValue::Flush(MessageHandler* handler) {
   return true;
 }
@@ -108,6 +108,26 @@ TEST_F(HTTPValueTest, EmptyContentsFirst) {
   CheckResponseHeaders(check_headers);
 }
 
+TEST_F(HTTPValueTest, ReserveContents) {
+  HTTPValue value;
+  ResponseHeaders headers, check_headers;
+  FillResponseHeaders(&headers);
+  value.SetHeaders(&headers);
+  value.ReserveContents(kMaxSize);
+  const GoogleString* storage = value.share()->StringValue();
+  const char* data = storage->data();
+  for (int i = 0; i < kMaxSize; ++i) {
+    value.Write("x", &message_handler_);
+  }
+  EXPECT_EQ(data, storage->data()) << "body was written without reallocating";
+  StringPiece body;
+  ASSERT_TRUE(value.ExtractContents(&body));
+  EXPECT_EQ(GoogleString(kMaxSize, 'x'), body.as_string());
+  EXPECT_EQ(kMaxSize, ComputeContentsSize(&value));
+  ASSERT_TRUE(value.ExtractHeaders(&check_headers, &message_handler_));
+  CheckResponseHeaders(check_headers);
+}
+
 TEST_F(HTTPValueTest, TestCopyOnWrite) {
   HTTPValue v1;
   v1.Write("Hello", &message_handler_);
@@ -17,14 +17,39 @@
 
 #include "net/instaweb/http/public/http_value_writer.h"
 
+#include <algorithm>
+
 #include "net/instaweb/http/public/http_cache.h"
 #include "net/instaweb/http/public/http_value.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/http/response_headers.h"
 
 namespace net_instaweb {
 
+namespace {
+
+// Bound on the buffer reserved from Content-Length when the cache has no
+// size limit, in case an origin sends a bogus length.  Larger bodies still
+// work, growing the buffer as they stream in.
+const int64 kMaxContentLengthReservation = 64 * 1024 * 1024;
+
+}  // namespace
+
 void HTTPValueWriter::SetHeaders(ResponseHeaders* headers) {
   if (cache_->IsCacheableContentLength(headers)) {
     value_->SetHeaders(headers);
+    // Size the buffer from Content-Length before the body arrives.  That
+    // comes from the origin, so only trust it as far as the cache's size
+    // limit, or a fixed bound when the cache has none.
+    int64 max_length = cache_->max_cacheable_response_content_length();
+    if (max_length == -1) {
+      max_length = kMaxContentLengthReservation;
+    }
+    int64 content_length;
+    if (headers->FindContentLength(&content_length) &&
+        (content_length > 0)) {
+      value_->ReserveContents(std::min(content_length, max_length));
+    }
   } else {
     has_buffered_ = false;
     value_->Clear();
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures buffering a 20MB response into an HTTPValue the way a fetch
+// does, streaming it through an HTTPValueWriter in the chunks serf reads
+// off the socket.  One iteration is one whole response.  The ContentLength
+// benchmark's response has a Content-Length header, which lets the writer
+// size the buffer up front; the Chunked benchmark's does not, so the buffer
+// grows as the body arrives.  Each benchmark logs the peak memory held by
+// the buffer, counting both the old and new buffers while it is being
+// reallocated.
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/http/public/http_value.h"
+#include "net/instaweb/http/public/http_value_writer.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/mock_hasher.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int kBodySize = 20 * 1024 * 1024;
+const int kChunkSize = 8000;  // What serf typically hands us per read.
+
+void WriteLargeBody(int iters, bool content_length) {
+  StopBenchmarkTiming();
+  scoped_ptr<ThreadSystem> thread_system(Platform::CreateThreadSystem());
+  SimpleStats stats(thread_system.get());
+  HTTPCache::InitStats(&stats);
+  LRUCache lru_cache(1000);
+  MockTimer timer(new NullMutex, MockTimer::kApr_5_2010_ms);
+  MockHasher hasher;
+  HTTPCache http_cache(&lru_cache, &timer, &hasher, &stats);
+  // HTTPValueWriter only trusts Content-Length up to the cache's limit.
+  http_cache.set_max_cacheable_response_content_length(2 * kBodySize);
+  NullMessageHandler handler;
+  GoogleString chunk(kChunkSize, 'x');
+  size_t peak_bytes = 0;
+
+  for (int i = 0; i < iters; ++i) {
+    ResponseHeaders headers;
+    headers.SetStatusAndReason(HttpStatus::kOK);
+    headers.set_major_version(1);
+    headers.set_minor_version(1);
+    headers.Add(HttpAttributes::kContentType, kContentTypeJpeg.mime_type());
+    if (content_length) {
+      headers.Add(HttpAttributes::kContentLength,
+                  IntegerToString(kBodySize));
+    }
+    HTTPValue value;
+    HTTPValueWriter writer(&value, &http_cache);
+    StartBenchmarkTiming();
+    writer.SetHeaders(&headers);
+    size_t capacity = value.share()->StringValue()->capacity();
+    peak_bytes = std::max(peak_bytes, capacity);
+    for (int written = 0; written < kBodySize; written += kChunkSize) {
+      writer.Write(StringPiece(chunk.data(),
+                               std::min(kChunkSize, kBodySize - written)),
+                   &handler);
+      size_t new_capacity = value.share()->StringValue()->capacity();
+      if (new_capacity != capacity) {
+        peak_bytes = std::max(peak_bytes, capacity + new_capacity);
+        capacity = new_capacity;
+      }
+    }
+    StopBenchmarkTiming();
+    CHECK_EQ(kBodySize, value.contents_size());
+  }
+  LOG(INFO) << (content_length ? "Content-Length" : "Chunked")
+            << " peak buffer bytes for a " << kBodySize << " byte body: "
+            << peak_bytes;
+}
+
+static void BM_WriteLargeBodyContentLength(int iters) {
+  WriteLargeBody(iters, true);
+}
+
+static void BM_WriteLargeBodyChunked(int iters) {
+  WriteLargeBody(iters, false);
+}
+
+BENCHMARK(BM_WriteLargeBodyContentLength);
+BENCHMARK(BM_WriteLargeBodyChunked);
+
+}  // namespace
+
+}  // namespace net_instaweb
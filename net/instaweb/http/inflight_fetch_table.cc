@@ -0,0 +1,255 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/http/public/inflight_fetch_table.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "net/instaweb/http/public/async_fetch.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/thread_system.h"
+
+namespace net_instaweb {
+
+const char InflightFetchTable::kInflightFetchesIssued[] =
+    "inflight_fetches_issued";
+const char InflightFetchTable::kInflightFetchesCoalesced[] =
+    "inflight_fetches_coalesced";
+const char InflightFetchTable::kInflightFetchFollowersRejected[] =
+    "inflight_fetch_followers_rejected";
+
+const int InflightFetchTable::kDefaultMaxFollowers;
+const int InflightFetchTable::kDefaultMaxBufferedBytes;
+
+InflightFetchTable::Leader::Leader(const GoogleString& key,
+                                   InflightFetchTable* table)
+    : key_(key),
+      table_(table),
+      mutex_(table->thread_system_->NewMutex()),
+      events_base_(0),
+      buffered_bytes_(0),
+      joinable_(true),
+      delivering_(false),
+      done_(false),
+      success_(false) {
+}
+
+InflightFetchTable::Leader::~Leader() {
+  DCHECK(followers_.empty());
+}
+
+void InflightFetchTable::Leader::HeadersComplete(
+    const ResponseHeaders& headers) {
+  mutex_->Lock();
+  headers_.CopyFrom(headers);
+  events_.push_back(Event(Event::kHeaders));
+  DeliverAndUnlock();
+}
+
+bool InflightFetchTable::Leader::Write(const StringPiece& content,
+                                       MessageHandler* handler) {
+  mutex_->Lock();
+  if (joinable_) {
+    buffered_bytes_ += content.size();
+    if (buffered_bytes_ > table_->max_buffered_bytes_) {
+      // A late follower would miss the start of the body, so stop taking
+      // them.  The events are then dropped as soon as they're delivered.
+      joinable_ = false;
+    }
+  }
+  events_.push_back(Event(Event::kWrite, content));
+  bool wanted = joinable_ || !followers_.empty();
+  DeliverAndUnlock();
+  return wanted;
+}
+
+void InflightFetchTable::Leader::Flush(MessageHandler* handler) {
+  mutex_->Lock();
+  events_.push_back(Event(Event::kFlush));
+  DeliverAndUnlock();
+}
+
+void InflightFetchTable::Leader::Done(bool success) {
+  // Once we're out of the table nobody else can join, so whoever delivers
+  // the last events can finish the followers and delete this.
+  table_->Remove(this);
+  mutex_->Lock();
+  done_ = true;
+  success_ = success;
+  DeliverAndUnlock();
+}
+
+bool InflightFetchTable::Leader::AddFollower(AsyncFetch* fetch) {
+  if (!joinable_ ||
+      (static_cast<int>(followers_.size()) >= table_->max_followers_)) {
+    return false;
+  }
+  followers_.push_back(Follower(fetch));
+  return true;
+}
+
+void InflightFetchTable::Leader::DeliverAndUnlock() {
+  if (delivering_) {
+    mutex_->Unlock();
+    return;
+  }
+  delivering_ = true;
+  for (;;) {
+    // Work out who is missing what, and take a copy of the events they are
+    // missing; the chunks themselves are shared, not copied.
+    int end = events_base_ + events_.size();
+    int batch_base = end;
+    std::vector<Follower> deliveries;
+    for (int i = 0, n = followers_.size(); i < n; ++i) {
+      Follower& follower = followers_[i];
+      if (follower.next_event < end) {
+        deliveries.push_back(follower);
+        batch_base = std::min(batch_base, follower.next_event);
+        follower.next_event = end;
+      }
+    }
+    std::vector<Event> batch(events_.begin() + (batch_base - events_base_),
+                             events_.end());
+    if (!joinable_) {
+      events_base_ = end;
+      events_.clear();
+    }
+
+    if (deliveries.empty()) {
+      if (!done_) {
+        delivering_ = false;
+        mutex_->Unlock();
+        return;
+      }
+      std::vector<Follower> followers;
+      followers.swap(followers_);
+      bool success = success_;
+      mutex_->Unlock();
+      for (int i = 0, n = followers.size(); i < n; ++i) {
+        followers[i].fetch->Done(success);
+      }
+      delete this;
+      return;
+    }
+
+    mutex_->Unlock();
+    for (int i = 0, n = deliveries.size(); i < n; ++i) {
+      for (int j = deliveries[i].next_event - batch_base, m = batch.size();
+           j < m; ++j) {
+        Send(batch[j], deliveries[i].fetch);
+      }
+    }
+    mutex_->Lock();
+  }
+}
+
+void InflightFetchTable::Leader::Send(const Event& event, AsyncFetch* fetch) {
+  switch (event.type) {
+    case Event::kHeaders:
+      fetch->response_headers()->CopyFrom(headers_);
+      fetch->HeadersComplete();
+      break;
+    case Event::kWrite:
+      fetch->Write(event.chunk.Value(), table_->handler_);
+      break;
+    case Event::kFlush:
+      fetch->Flush(table_->handler_);
+      break;
+  }
+}
+
+InflightFetchTable::InflightFetchTable(int max_followers,
+                                       int max_buffered_bytes,
+                                       ThreadSystem* thread_system,
+                                       Statistics* stats,
+                                       MessageHandler* handler)
+    : max_followers_(max_followers),
+      max_buffered_bytes_(max_buffered_bytes),
+      thread_system_(thread_system),
+      handler_(handler),
+      mutex_(thread_system->NewMutex()),
+      fetches_issued_(stats->GetVariable(kInflightFetchesIssued)),
+      fetches_coalesced_(stats->GetVariable(kInflightFetchesCoalesced)),
+      followers_rejected_(stats->GetVariable(kInflightFetchFollowersRejected)) {
+}
+
+InflightFetchTable::~InflightFetchTable() {
+  DCHECK(leaders_.empty());
+}
+
+void InflightFetchTable::InitStats(Statistics* stats) {
+  stats->AddVariable(kInflightFetchesIssued);
+  stats->AddVariable(kInflightFetchesCoalesced);
+  stats->AddVariable(kInflightFetchFollowersRejected);
+}
+
+bool InflightFetchTable::Follow(const GoogleString& key, AsyncFetch* fetch) {
+  mutex_->Lock();
+  LeaderMap::iterator p = leaders_.find(key);
+  if (p == leaders_.end()) {
+    mutex_->Unlock();
+    return false;
+  }
+  return FollowAndUnlock(p->second, fetch);
+}
+
+InflightFetchTable::Leader* InflightFetchTable::Lead(const GoogleString& key,
+                                                     AsyncFetch* fetch,
+                                                     bool* following) {
+  mutex_->Lock();
+  std::pair<LeaderMap::iterator, bool> insertion =
+      leaders_.insert(LeaderMap::value_type(key, static_cast<Leader*>(NULL)));
+  if (!insertion.second) {
+    *following = FollowAndUnlock(insertion.first->second, fetch);
+    return NULL;
+  }
+  Leader* leader = new Leader(key, this);
+  insertion.first->second = leader;
+  mutex_->Unlock();
+  *following = false;
+  fetches_issued_->Add(1);
+  return leader;
+}
+
+bool InflightFetchTable::FollowAndUnlock(Leader* leader, AsyncFetch* fetch) {
+  // Take the leader's lock before letting go of ours, so that it can't
+  // finish in between.
+  leader->mutex_->Lock();
+  mutex_->Unlock();
+  bool followed = leader->AddFollower(fetch);
+  if (followed) {
+    fetches_coalesced_->Add(1);
+    // Catches fetch up with what the leader has received so far.  This
+    // may finish fetch, and the leader, so neither may be touched after.
+    leader->DeliverAndUnlock();
+  } else {
+    followers_rejected_->Add(1);
+    leader->mutex_->Unlock();
+  }
+  return followed;
+}
+
+void InflightFetchTable::Remove(Leader* leader) {
+  ScopedMutex lock(mutex_.get());
+  LeaderMap::iterator p = leaders_.find(leader->key_);
+  DCHECK(p != leaders_.end());
+  DCHECK_EQ(leader, p->second);
+  leaders_.erase(p);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/http/public/inflight_fetch_table.h"
+
+#include <vector>
+
+#include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/request_context.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kKey[] = "http://www.example.com/style.css";
+
+// Follows kKey with another fetch as soon as it gets headers, as a fetch
+// callback that starts a fetch of its own would.
+class ChainingFetch : public StringAsyncFetch {
+ public:
+  ChainingFetch(const RequestContextPtr& request_context,
+                InflightFetchTable* table)
+      : StringAsyncFetch(request_context),
+        table_(table),
+        next_(request_context),
+        followed_(false) {
+  }
+
+  virtual void HandleHeadersComplete() {
+    followed_ = table_->Follow(kKey, &next_);
+  }
+
+  StringAsyncFetch* next() { return &next_; }
+  bool followed() const { return followed_; }
+
+ private:
+  InflightFetchTable* table_;
+  StringAsyncFetch next_;
+  bool followed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChainingFetch);
+};
+
+// Follows kKey from a thread of its own.
+class FollowerThread : public ThreadSystem::Thread {
+ public:
+  FollowerThread(ThreadSystem* thread_system, InflightFetchTable* table,
+                 const RequestContextPtr& request_context)
+      : Thread(thread_system, "follower", ThreadSystem::kJoinable),
+        table_(table),
+        fetch_(request_context),
+        followed_(false) {
+  }
+
+  virtual void Run() {
+    followed_ = table_->Follow(kKey, &fetch_);
+  }
+
+  StringAsyncFetch* fetch() { return &fetch_; }
+  bool followed() const { return followed_; }
+
+ private:
+  InflightFetchTable* table_;
+  StringAsyncFetch fetch_;
+  bool followed_;
+
+  DISALLOW_COPY_AND_ASSIGN(FollowerThread);
+};
+
+class InflightFetchTableTest : public testing::Test {
+ protected:
+  InflightFetchTableTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        stats_(thread_system_.get()),
+        request_context_(RequestContext::NewTestRequestContext(
+            thread_system_.get())) {
+    InflightFetchTable::InitStats(&stats_);
+    InitTable(InflightFetchTable::kDefaultMaxFollowers,
+              InflightFetchTable::kDefaultMaxBufferedBytes);
+    headers_.set_status_code(HttpStatus::kOK);
+    headers_.Add(HttpAttributes::kContentType, "text/css");
+  }
+
+  void InitTable(int max_followers, int max_buffered_bytes) {
+    table_.reset(new InflightFetchTable(max_followers, max_buffered_bytes,
+                                        thread_system_.get(), &stats_,
+                                        &handler_));
+  }
+
+  InflightFetchTable::Leader* Lead() {
+    StringAsyncFetch fetch(request_context_);
+    bool following = true;
+    InflightFetchTable::Leader* leader =
+        table_->Lead(kKey, &fetch, &following);
+    EXPECT_TRUE(leader != NULL);
+    EXPECT_FALSE(following);
+    return leader;
+  }
+
+  int Stat(const char* name) {
+    return stats_.GetVariable(name)->Get();
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  SimpleStats stats_;
+  NullMessageHandler handler_;
+  RequestContextPtr request_context_;
+  scoped_ptr<InflightFetchTable> table_;
+  ResponseHeaders headers_;
+};
+
+TEST_F(InflightFetchTableTest, FollowersGetLeaderResponse) {
+  StringAsyncFetch early(request_context_);
+  StringAsyncFetch late(request_context_);
+  EXPECT_FALSE(table_->Follow(kKey, &early));
+
+  InflightFetchTable::Leader* leader = Lead();
+  EXPECT_TRUE(table_->Follow(kKey, &early));
+  leader->HeadersComplete(headers_);
+  EXPECT_TRUE(early.headers_complete());
+  leader->Write("hello ", &handler_);
+
+  // A late follower gets what has been written so far right away.
+  EXPECT_TRUE(table_->Follow(kKey, &late));
+  EXPECT_TRUE(late.headers_complete());
+  EXPECT_EQ("hello ", late.buffer());
+
+  leader->Write("world", &handler_);
+  EXPECT_FALSE(early.done());
+  leader->Done(true);
+
+  StringAsyncFetch* followers[] = {&early, &late};
+  for (int i = 0; i < static_cast<int>(arraysize(followers)); ++i) {
+    EXPECT_TRUE(followers[i]->done());
+    EXPECT_TRUE(followers[i]->success());
+    EXPECT_EQ("hello world", followers[i]->buffer());
+    EXPECT_EQ(HttpStatus::kOK, followers[i]->response_headers()->status_code());
+    EXPECT_STREQ("text/css", followers[i]->response_headers()->Lookup1(
+        HttpAttributes::kContentType));
+  }
+  EXPECT_EQ(1, Stat(InflightFetchTable::kInflightFetchesIssued));
+  EXPECT_EQ(2, Stat(InflightFetchTable::kInflightFetchesCoalesced));
+
+  // Once the fetch is done, there's nothing to follow.
+  StringAsyncFetch after(request_context_);
+  EXPECT_FALSE(table_->Follow(kKey, &after));
+}
+
+TEST_F(InflightFetchTableTest, LeadFollowsFetchInProgress) {
+  InflightFetchTable::Leader* leader = Lead();
+  StringAsyncFetch second(request_context_);
+  bool following = false;
+  EXPECT_TRUE(table_->Lead(kKey, &second, &following) == NULL);
+  EXPECT_TRUE(following);
+
+  // Other keys get leaders of their own.
+  StringAsyncFetch other(request_context_);
+  InflightFetchTable::Leader* other_leader =
+      table_->Lead("http://www.example.com/other.css", &other, &following);
+  ASSERT_TRUE(other_leader != NULL);
+  EXPECT_FALSE(following);
+  other_leader->HeadersComplete(headers_);
+  other_leader->Done(true);
+  EXPECT_FALSE(second.done());
+
+  leader->HeadersComplete(headers_);
+  leader->Done(false);
+  EXPECT_TRUE(second.done());
+  EXPECT_FALSE(second.success());
+  EXPECT_EQ(2, Stat(InflightFetchTable::kInflightFetchesIssued));
+  EXPECT_EQ(1, Stat(InflightFetchTable::kInflightFetchesCoalesced));
+}
+
+TEST_F(InflightFetchTableTest, FollowerLimit) {
+  InitTable(1, InflightFetchTable::kDefaultMaxBufferedBytes);
+  InflightFetchTable::Leader* leader = Lead();
+  StringAsyncFetch first(request_context_), second(request_context_);
+  EXPECT_TRUE(table_->Follow(kKey, &first));
+  EXPECT_FALSE(table_->Follow(kKey, &second));
+  bool following = true;
+  EXPECT_TRUE(table_->Lead(kKey, &second, &following) == NULL);
+  EXPECT_FALSE(following);
+  EXPECT_EQ(2, Stat(InflightFetchTable::kInflightFetchFollowersRejected));
+
+  leader->HeadersComplete(headers_);
+  leader->Done(true);
+  EXPECT_TRUE(first.done());
+  EXPECT_FALSE(second.done());
+}
+
+TEST_F(InflightFetchTableTest, BufferLimit) {
+  InitTable(InflightFetchTable::kDefaultMaxFollowers, 10);
+  InflightFetchTable::Leader* leader = Lead();
+  StringAsyncFetch early(request_context_), late(request_context_);
+  EXPECT_TRUE(table_->Follow(kKey, &early));
+  leader->HeadersComplete(headers_);
+  leader->Write("0123456789", &handler_);
+  leader->Write("abc", &handler_);
+
+  // The start of the body is no longer buffered, so a late follower
+  // can't be given the whole response.
+  EXPECT_FALSE(table_->Follow(kKey, &late));
+  leader->Flush(&handler_);
+  leader->Done(true);
+  EXPECT_TRUE(early.done());
+  EXPECT_EQ("0123456789abc", early.buffer());
+  EXPECT_EQ(1, Stat(InflightFetchTable::kInflightFetchFollowersRejected));
+}
+
+TEST_F(InflightFetchTableTest, WriteReportsWhetherBodyIsWanted) {
+  InitTable(InflightFetchTable::kDefaultMaxFollowers, 10);
+  InflightFetchTable::Leader* leader = Lead();
+  leader->HeadersComplete(headers_);
+
+  // While followers may still join, the body is wanted even if none has.
+  EXPECT_TRUE(leader->Write("01234", &handler_));
+
+  // Once no more can join, it is wanted only while someone is following.
+  StringAsyncFetch follower(request_context_);
+  EXPECT_TRUE(table_->Follow(kKey, &follower));
+  EXPECT_TRUE(leader->Write("56789abc", &handler_));
+  leader->Done(true);
+  EXPECT_EQ("0123456789abc", follower.buffer());
+
+  leader = Lead();
+  leader->HeadersComplete(headers_);
+  EXPECT_FALSE(leader->Write("0123456789abc", &handler_));
+  leader->Done(true);
+}
+
+TEST_F(InflightFetchTableTest, FollowFromFollowerCallback) {
+  // Followers are called without the leader's lock held, so one can follow
+  // the same fetch from its callback; it's caught up once the callback
+  // returns.
+  InflightFetchTable::Leader* leader = Lead();
+  ChainingFetch chaining(request_context_, table_.get());
+  EXPECT_TRUE(table_->Follow(kKey, &chaining));
+  leader->HeadersComplete(headers_);
+  EXPECT_TRUE(chaining.followed());
+  EXPECT_TRUE(chaining.next()->headers_complete());
+  leader->Write("body", &handler_);
+  leader->Done(true);
+  EXPECT_EQ("body", chaining.buffer());
+  EXPECT_TRUE(chaining.next()->done());
+  EXPECT_EQ("body", chaining.next()->buffer());
+}
+
+TEST_F(InflightFetchTableTest, ConcurrentFollowers) {
+  // Followers that join from other threads while the leader is writing
+  // each get the whole body, in order.
+  const int kNumThreads = 8;
+  const int kNumChunks = 1000;
+  InflightFetchTable::Leader* leader = Lead();
+  std::vector<FollowerThread*> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.push_back(new FollowerThread(thread_system_.get(), table_.get(),
+                                         request_context_));
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  GoogleString expected;
+  leader->HeadersComplete(headers_);
+  for (int i = 0; i < kNumChunks; ++i) {
+    GoogleString chunk = StrCat(IntegerToString(i), ",");
+    leader->Write(chunk, &handler_);
+    expected += chunk;
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i]->Join();
+  }
+  leader->Done(true);
+  for (int i = 0; i < kNumThreads; ++i) {
+    EXPECT_TRUE(threads[i]->followed());
+    EXPECT_TRUE(threads[i]->fetch()->done());
+    EXPECT_EQ(expected, threads[i]->fetch()->buffer());
+    delete threads[i];
+  }
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -21,6 +21,7 @@
 #define NET_INSTAWEB_HTTP_PUBLIC_ASYNC_FETCH_WITH_LOCK_H_
 
 #include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/inflight_fetch_table.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -58,6 +59,14 @@ class UrlAsyncFetcher;
 //    AsyncFetchWithLock::HandleXXX should also be called.
 // 5) Lastly AsyncFetchWithLock::Finalize() is called just before async_fetch
 //    delete itself.
+//
+// If an InflightFetchTable is set, a fetch for a cache key that's already
+// being fetched in this process follows that fetch rather than taking the
+// lock: the fetch returned by NewFollowerFetch() gets the response the other
+// fetch is handed by its fetcher, and StartFetch() is never called.  Fetches
+// only follow fetches with the same InflightKey(), which subclasses should
+// extend with whatever else affects what the fetch gets back.  A fetch that
+// leads others must hand its fetcher a fetch wrapped by ShareResponse().
 class AsyncFetchWithLock : public AsyncFetch {
  public:
   AsyncFetchWithLock(const Hasher* hasher,
@@ -79,6 +88,16 @@ class AsyncFetchWithLock : public AsyncFetch {
   // Cache key to be locked.
   const GoogleString& cache_key() const { return cache_key_; }
 
+  // Lets this fetch share its response with other fetches of the same
+  // cache key, or follow one of them.  Must be called before Start().
+  void set_inflight_fetch_table(InflightFetchTable* x) {
+    inflight_fetch_table_ = x;
+  }
+
+  // True if this fetch is receiving the response of another fetch of the
+  // same cache key, rather than fetching it itself.
+  bool following() const { return following_; }
+
  protected:
   // If someone is already fetching this resource, should we yield to them and
   // try again later?  If so, return true.  Otherwise, if we must fetch the
@@ -94,6 +113,27 @@ class AsyncFetchWithLock : public AsyncFetch {
   virtual void StartFetch(
      UrlAsyncFetcher* fetcher, MessageHandler* handler) = 0;
 
+  // Returns the key under which this fetch is shared with others in the
+  // InflightFetchTable.  The default is just cache_key(); subclasses whose
+  // fetches also depend on the options or request headers they're made with
+  // must add those.  Called once, from Start().
+  virtual GoogleString InflightKey();
+
+  // Returns the fetch to pass the response of a fetch this follows to.  The
+  // default is this; subclasses may wrap it as they would the fetch they
+  // hand the fetcher, so that the response is treated the same way.  If it
+  // turns out not to be needed, it is passed to DeleteFollowerFetch().
+  virtual AsyncFetch* NewFollowerFetch();
+  virtual void DeleteFollowerFetch(AsyncFetch* fetch);
+
+  // For use in StartFetch().  If other fetches may follow this one, returns
+  // a fetch that passes the response it gets to fetch and to them, and
+  // deletes itself when done; otherwise returns fetch.  Followers get the
+  // response as the fetcher delivers it, so anything wrapping the result
+  // sees what they see, while changes made by fetch, or by wrappers inside
+  // it, are this fetch's own.
+  AsyncFetch* ShareResponse(AsyncFetch* fetch);
+
   // Releases the lock.
   // If subclass overrides the function, then, it should also call
   // AsyncFetchWithLock::HandleDone()
@@ -114,12 +154,21 @@ class AsyncFetchWithLock : public AsyncFetch {
   void LockFailed(UrlAsyncFetcher* fetcher);
   void LockAcquired(UrlAsyncFetcher* fetcher);
 
+  // Calls StartFetch(), unless another fetch of the same cache key started
+  // while we were getting the lock, in which case this follows it.
+  void LeadOrFollow(UrlAsyncFetcher* fetcher);
+
   NamedLockManager* lock_manager_;  // Owned by server_context.
   scoped_ptr<NamedLock> lock_;
   const Hasher* lock_hasher_;  // Used to compute named lock names.
   GoogleString url_;
   GoogleString cache_key_;
   MessageHandler* message_handler_;
+  InflightFetchTable* inflight_fetch_table_;
+  GoogleString inflight_key_;
+  // Non-NULL if we are leading, until ShareResponse() hands it on.
+  InflightFetchTable::Leader* leader_;
+  bool following_;
 
   DISALLOW_COPY_AND_ASSIGN(AsyncFetchWithLock);
 };
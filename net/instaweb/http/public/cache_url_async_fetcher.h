@@ -89,11 +89,14 @@ class CacheUrlAsyncFetcher : public UrlAsyncFetcher {
         fallback_responses_served_while_revalidate_(NULL),
         num_conditional_refreshes_(NULL),
         num_proactively_freshen_user_facing_request_(NULL),
+        byte_range_responses_served_(NULL),
+        byte_range_bytes_served_(NULL),
         respect_vary_(false),
         ignore_recent_fetch_failed_(false),
         serve_stale_if_fetch_error_(false),
         default_cache_html_(false),
         proactively_freshen_user_facing_request_(false),
+        serve_byte_ranges_(false),
         own_fetcher_(false),
         serve_stale_while_revalidate_threshold_sec_(0) {
   }
@@ -152,6 +155,22 @@ class CacheUrlAsyncFetcher : public UrlAsyncFetcher {
     return num_proactively_freshen_user_facing_request_;
   }
 
+  void set_byte_range_responses_served(Variable* x) {
+    byte_range_responses_served_ = x;
+  }
+
+  Variable* byte_range_responses_served() const {
+    return byte_range_responses_served_;
+  }
+
+  void set_byte_range_bytes_served(Variable* x) {
+    byte_range_bytes_served_ = x;
+  }
+
+  Variable* byte_range_bytes_served() const {
+    return byte_range_bytes_served_;
+  }
+
   void set_respect_vary(bool x) { respect_vary_ = x; }
   bool respect_vary() const { return respect_vary_; }
 
@@ -188,6 +207,14 @@ class CacheUrlAsyncFetcher : public UrlAsyncFetcher {
     return proactively_freshen_user_facing_request_;
   }
 
+  // If set, GET requests with a Range header that hit a cached 200 are
+  // served a 206 holding just the requested parts of the body, or a 416 if
+  // none of them exist.  The parts are written straight out of the cached
+  // value without copying it.  Compressed and HTML responses, and requests
+  // whose If-Range doesn't match the cached response, get the whole body.
+  void set_serve_byte_ranges(bool x) { serve_byte_ranges_ = x; }
+  bool serve_byte_ranges() const { return serve_byte_ranges_; }
+
   void set_own_fetcher(bool x) { own_fetcher_ = x; }
 
  private:
@@ -204,12 +231,15 @@ class CacheUrlAsyncFetcher : public UrlAsyncFetcher {
   Variable* fallback_responses_served_while_revalidate_;  // may be NULL.
   Variable* num_conditional_refreshes_;  // may be NULL.
   Variable* num_proactively_freshen_user_facing_request_;  // may be NULL.
+  Variable* byte_range_responses_served_;  // may be NULL.
+  Variable* byte_range_bytes_served_;  // may be NULL.
 
   bool respect_vary_;
   bool ignore_recent_fetch_failed_;
   bool serve_stale_if_fetch_error_;
   bool default_cache_html_;
   bool proactively_freshen_user_facing_request_;
+  bool serve_byte_ranges_;
   bool own_fetcher_;  // set true to transfer ownership of fetcher to this.
   int64 serve_stale_while_revalidate_threshold_sec_;
 
@@ -365,7 +365,7 @@ class HTTPCache {
     }
   }
 
-  int max_cacheable_response_content_length() {
+  int64 max_cacheable_response_content_length() {
     return max_cacheable_response_content_length_;
   }
 
@@ -63,6 +63,12 @@ class HTTPValue : public Writer {
   virtual bool Write(const StringPiece& str, MessageHandler* handler);
   virtual bool Flush(MessageHandler* handler);
 
+  // Makes room for 'size' more bytes of contents, typically the
+  // Content-Length of a response being fetched, so that streaming a large
+  // body in through Write fills a single buffer rather than copying
+  // everything received so far each time the buffer grows.
+  void ReserveContents(int64 size);
+
   // Retrieves the headers, returning false if empty.
   bool ExtractHeaders(ResponseHeaders* headers, MessageHandler* handler) const;
 
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NET_INSTAWEB_HTTP_PUBLIC_INFLIGHT_FETCH_TABLE_H_
+#define NET_INSTAWEB_HTTP_PUBLIC_INFLIGHT_FETCH_TABLE_H_
+
+#include <map>
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/http/response_headers.h"
+
+namespace net_instaweb {
+
+class AsyncFetch;
+class MessageHandler;
+class Statistics;
+class ThreadSystem;
+class Variable;
+
+// Keeps track of the origin fetches in flight in this process, by cache key,
+// so that a fetch for a key that's already being fetched can follow the
+// existing one rather than issue a redundant fetch or give up.  Followers
+// receive the leader's response headers and body as the leader receives
+// them; a follower that arrives late first gets everything the leader has
+// received so far.  Body chunks are kept in SharedStrings, so all followers
+// share one copy.
+//
+// Followers are called back on whichever thread the leader's response
+// arrives on, or, for what a follower missed before it arrived, on the
+// thread that attached it.
+class InflightFetchTable {
+ public:
+  // Statistics names.
+  static const char kInflightFetchesIssued[];
+  static const char kInflightFetchesCoalesced[];
+  static const char kInflightFetchFollowersRejected[];
+
+  // Once a fetch has kDefaultMaxFollowers followers, or has received more
+  // than kDefaultMaxBufferedBytes of body, fetches for the same key no
+  // longer follow it.
+  static const int kDefaultMaxFollowers = 100;
+  static const int kDefaultMaxBufferedBytes = 8 * 1024 * 1024;
+
+  // Passes the response of a leading fetch along to its followers.  The
+  // leader must call HeadersComplete before its first Write, and must
+  // finish with Done, after which it must not touch the Leader again.
+  // Write returns whether followers may still want the rest of the body:
+  // false once none are attached and no more can join.
+  //
+  // Followers are never called with the Leader's lock held, so that they
+  // can start other fetches, or follow this one, from their callbacks.
+  // Instead, the response is recorded as a list of events under the lock,
+  // and whichever thread finds nobody else delivering them passes them
+  // along, in order, until every follower has caught up.
+  class Leader {
+   public:
+    void HeadersComplete(const ResponseHeaders& headers);
+    bool Write(const StringPiece& content, MessageHandler* handler);
+    void Flush(MessageHandler* handler);
+    void Done(bool success);
+
+   private:
+    friend class InflightFetchTable;
+
+    struct Event {
+      enum Type { kHeaders, kWrite, kFlush };
+
+      explicit Event(Type t) : type(t) {}
+      Event(Type t, const StringPiece& content) : type(t), chunk(content) {}
+
+      Type type;
+      SharedString chunk;  // For kWrite.
+    };
+
+    struct Follower {
+      explicit Follower(AsyncFetch* f) : fetch(f), next_event(0) {}
+
+      AsyncFetch* fetch;
+      // Index of the first event not yet delivered to fetch, counting from
+      // the first event the leader ever recorded.
+      int next_event;
+    };
+
+    Leader(const GoogleString& key, InflightFetchTable* table);
+    ~Leader();
+
+    // Attaches fetch, which will first be given everything received so
+    // far.  Returns false if this fetch can't take any more followers.
+    bool AddFollower(AsyncFetch* fetch) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+    // Delivers the events the followers have yet to receive, unless another
+    // thread is already doing so, in which case it will pick them up.  Once
+    // the leader is done, finishes the followers and deletes this.  Must be
+    // called with mutex_ held, and releases it.
+    void DeliverAndUnlock() UNLOCK_FUNCTION(mutex_);
+
+    void Send(const Event& event, AsyncFetch* fetch);
+
+    GoogleString key_;
+    InflightFetchTable* table_;
+    scoped_ptr<AbstractMutex> mutex_;
+    // Written once, under mutex_, before the kHeaders event is recorded, so
+    // it may be read without the lock by whoever delivers that event.
+    ResponseHeaders headers_;
+    // The events not yet delivered to every follower, or, while the fetch is
+    // joinable, all of them.  events_base_ is the index of events_[0].
+    std::vector<Event> events_ GUARDED_BY(mutex_);
+    int events_base_ GUARDED_BY(mutex_);
+    int buffered_bytes_ GUARDED_BY(mutex_);
+    // Cleared once events_ no longer holds the whole body.
+    bool joinable_ GUARDED_BY(mutex_);
+    bool delivering_ GUARDED_BY(mutex_);
+    bool done_ GUARDED_BY(mutex_);
+    bool success_ GUARDED_BY(mutex_);
+    std::vector<Follower> followers_ GUARDED_BY(mutex_);
+
+    DISALLOW_COPY_AND_ASSIGN(Leader);
+  };
+
+  InflightFetchTable(int max_followers, int max_buffered_bytes,
+                     ThreadSystem* thread_system, Statistics* stats,
+                     MessageHandler* handler);
+  ~InflightFetchTable();
+
+  static void InitStats(Statistics* stats);
+
+  // If key is being fetched and the fetch can take another follower,
+  // attaches fetch to it and returns true; fetch may be finished before
+  // this returns.  Otherwise returns false, and the caller remains
+  // responsible for fetch.
+  bool Follow(const GoogleString& key, AsyncFetch* fetch);
+
+  // Called just before fetching key from the origin.  If key is already
+  // being fetched, tries to Follow that fetch instead, returning NULL and
+  // setting *following to whether that worked; as with Follow, fetch may
+  // already be finished, so following must not point into it.  Otherwise,
+  // makes the caller the leader for key, and returns the Leader to which it
+  // must pass its response.
+  Leader* Lead(const GoogleString& key, AsyncFetch* fetch, bool* following);
+
+  int max_followers() const { return max_followers_; }
+  int max_buffered_bytes() const { return max_buffered_bytes_; }
+
+ private:
+  typedef std::map<GoogleString, Leader*> LeaderMap;
+
+  // Attaches fetch to leader, which mutex_ must be held to find.  Releases
+  // mutex_.  If this returns true, fetch may already have been finished.
+  bool FollowAndUnlock(Leader* leader, AsyncFetch* fetch)
+      UNLOCK_FUNCTION(mutex_);
+
+  void Remove(Leader* leader);
+
+  const int max_followers_;
+  const int max_buffered_bytes_;
+  ThreadSystem* thread_system_;
+  MessageHandler* handler_;
+  scoped_ptr<AbstractMutex> mutex_;
+  LeaderMap leaders_ GUARDED_BY(mutex_);
+
+  Variable* fetches_issued_;
+  Variable* fetches_coalesced_;
+  Variable* followers_rejected_;
+
+  DISALLOW_COPY_AND_ASSIGN(InflightFetchTable);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_HTTP_PUBLIC_INFLIGHT_FETCH_TABLE_H_
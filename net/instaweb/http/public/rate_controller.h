@@ -32,9 +32,11 @@ namespace net_instaweb {
 class AbstractMutex;
 class AsyncFetch;
 class MessageHandler;
+class SharedMemOriginHealth;
 class Statistics;
 class ThreadSystem;
 class TimedVariable;
+class Timer;
 class UpDownCounter;
 class UrlAsyncFetcher;
 
@@ -49,12 +51,25 @@ class UrlAsyncFetcher;
 // If a request is dropped, the response will have HttpAttributes::kXPsaLoadShed
 // set on the response headers.
 //
+// The per-host limit on outgoing fetches can also be made adaptive, so that a
+// slow origin is not given the same share of fetches as a fast one.  Each
+// completed fetch's latency is compared with the host's long-term average:
+// while it stays flat and the host is using its limit, the limit grows, and
+// when latency rises well above the average, or fetches fail, it shrinks.
+// This is the gradient algorithm of Netflix's concurrency-limits library.
+//
+// The controller can also consult a SharedMemOriginHealth, shared by all
+// server processes, that tracks which origins are failing.  Background
+// fetches from an origin it deems unhealthy are dropped at once, as above,
+// rather than waiting on an origin that is down.
+//
 // Note: this requires working statistics to work.
 class RateController {
  public:
   static const char kQueuedFetchCount[];
   static const char kDroppedFetchCount[];
   static const char kCurrentGlobalFetchQueueSize[];
+  static const char kUnhealthyOriginFetchCount[];
 
   RateController(int max_global_queue_size,
                  int per_host_outgoing_request_threshold,
@@ -75,6 +90,27 @@ class RateController {
              MessageHandler* message_handler,
              AsyncFetch* fetch);
 
+  // Lets the limit on outgoing fetches for each host adapt between 1 and
+  // max_per_host_outgoing_requests, starting from the
+  // per_host_outgoing_request_threshold passed to the constructor.  timer is
+  // used to measure fetch latency.  Must be called before any fetches.
+  void EnableAdaptiveLimits(int max_per_host_outgoing_requests, Timer* timer);
+  bool adaptive_limits() const { return max_per_host_outgoing_requests_ > 0; }
+
+  // Records the outcome of every fetch in origin_health, and drops
+  // background fetches from origins it finds unhealthy.  timer is used to
+  // measure fetch latency.  Does not take ownership of either.  Must be
+  // called before any fetches.
+  void TrackOriginHealth(SharedMemOriginHealth* origin_health, Timer* timer);
+
+  // Returns the current limit on outgoing background fetches for host, or
+  // -1 if the host is not being tracked.
+  int HostLimit(const GoogleString& host);
+
+  // Appends a line per tracked host describing its limit, outgoing and
+  // queued fetches, latency, and whether the origin is unhealthy.
+  void PrintHostLimits(GoogleString* out);
+
   // Initializes statistics variables associated with this class.
   static void InitStats(Statistics* statistics);
 
@@ -96,7 +132,11 @@ class RateController {
   const int per_host_outgoing_request_threshold_;
   // The maximum number of queued requests allowed per host.
   const int per_host_queued_request_threshold_;
+  // The most the per-host limit can adapt to, or 0 if it is fixed.
+  int max_per_host_outgoing_requests_;
   ThreadSystem* thread_system_;
+  Timer* timer_;
+  SharedMemOriginHealth* origin_health_;
 
   // Map containing per-host information tracking outgoing and queued fetches.
   HostFetchInfoMap fetch_info_map_;
@@ -104,6 +144,7 @@ class RateController {
 
   TimedVariable* queued_fetch_count_;
   TimedVariable* dropped_fetch_count_;
+  TimedVariable* unhealthy_origin_fetch_count_;
   // Using a variable here, since we want to be able to track this in the server
   // statistics.
   UpDownCounter* current_global_fetch_queue_size_;
@@ -18,6 +18,8 @@
 
 #include "net/instaweb/http/public/rate_controller.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <queue>
 #include <utility>
@@ -31,10 +33,13 @@
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
 
 namespace net_instaweb {
 
@@ -60,6 +65,23 @@ struct DeferredFetch {
   DISALLOW_COPY_AND_ASSIGN(DeferredFetch);
 };
 
+// Parameters of the adaptive per-host limit.  A host's latency is tracked
+// as a short-term and a long-term moving average, over about this many
+// fetches each.
+const double kShortLatencyWindow = 10;
+const double kLongLatencyWindow = 100;
+// Latency may rise this far above the long-term average before the limit
+// shrinks.
+const double kLatencyTolerance = 1.5;
+// The most the limit shrinks in one step is to this fraction, which is
+// also what a failed fetch does.
+const double kMinGradient = 0.5;
+// Each fetch moves the limit this fraction of the way to its new value.
+const double kLimitSmoothing = 0.2;
+// With adaptive limits, idle hosts are remembered, to keep what was learned
+// about them, unless more than this many hosts are being tracked.
+const size_t kMaxIdleAdaptiveHosts = 1000;
+
 }  // namespace
 
 const char RateController::kQueuedFetchCount[] =
@@ -68,21 +90,28 @@ const char RateController::kDroppedFetchCount[] =
     "dropped-fetch-count";
 const char RateController::kCurrentGlobalFetchQueueSize[] =
     "current-fetch-queue-size";
+const char RateController::kUnhealthyOriginFetchCount[] =
+    "unhealthy-origin-dropped-fetch-count";
 
 // Keeps track of all the pending and enqueued fetches for a given host.
 class RateController::HostFetchInfo
     : public RefCounted<RateController::HostFetchInfo> {
  public:
-  // Takes ownership of the mutex passed in.
+  // Takes ownership of the mutex passed in.  If max_outgoing_requests is
+  // positive, the outgoing request limit adapts to the host's latency up to
+  // that, starting at per_host_outgoing_request_threshold.
   HostFetchInfo(const GoogleString& host,
                 int per_host_outgoing_request_threshold,
                 int per_host_queued_request_threshold,
+                int max_outgoing_requests,
                 AbstractMutex* mutex)
       : host_(host),
         num_outbound_fetches_(0),
-        per_host_outgoing_request_threshold_(
-            per_host_outgoing_request_threshold),
+        outgoing_request_limit_(per_host_outgoing_request_threshold),
+        max_outgoing_requests_(max_outgoing_requests),
         per_host_queued_request_threshold_(per_host_queued_request_threshold),
+        short_latency_us_(0),
+        long_latency_us_(0),
         mutex_(mutex) {}
 
   ~HostFetchInfo() {}
@@ -98,17 +127,21 @@ class RateController::HostFetchInfo
   // otherwise.
   bool IncrementIfCanTriggerFetch() {
     ScopedMutex lock(mutex_.get());
-    if (num_outbound_fetches_ < per_host_outgoing_request_threshold_) {
+    if (num_outbound_fetches_ < outgoing_request_limit()) {
       ++num_outbound_fetches_;
       return true;
     }
     return false;
   }
 
-  // Decreases the number of outbound fetches by 1.
-  void decrement_num_outbound_fetches() {
+  // Decreases the number of outbound fetches by 1, first adapting the
+  // outgoing request limit to how the fetch went if that is enabled.
+  void FetchDone(bool success, int64 latency_us) {
     ScopedMutex lock(mutex_.get());
     DCHECK_GT(num_outbound_fetches_, 0);
+    if (max_outgoing_requests_ > 0) {
+      AdaptLimit(success, latency_us);
+    }
     --num_outbound_fetches_;
   }
 
@@ -136,7 +169,7 @@ class RateController::HostFetchInfo
   DeferredFetch* PopNextFetchAndIncrementCountIfWithinThreshold() {
     ScopedMutex lock(mutex_.get());
     if (fetch_queue_.empty() ||
-        num_outbound_fetches_ >= per_host_outgoing_request_threshold_) {
+        num_outbound_fetches_ >= outgoing_request_limit()) {
       return NULL;
     }
     DeferredFetch* fetch = fetch_queue_.front();
@@ -154,11 +187,86 @@ class RateController::HostFetchInfo
     return num_outbound_fetches_ > 0 || !fetch_queue_.empty();
   }
 
+  int limit() const {
+    ScopedMutex lock(mutex_.get());
+    return outgoing_request_limit();
+  }
+
+  void Print(SharedMemOriginHealth* origin_health, GoogleString* out) const {
+    ScopedMutex lock(mutex_.get());
+    StrAppend(out, host_, ": limit ",
+              IntegerToString(outgoing_request_limit()));
+    if (max_outgoing_requests_ > 0) {
+      StrAppend(out, " (max ", IntegerToString(max_outgoing_requests_), ")");
+    }
+    StrAppend(out, ", ", IntegerToString(num_outbound_fetches_), " outgoing, ",
+              IntegerToString(fetch_queue_.size()), " queued");
+    if (long_latency_us_ > 0) {
+      StrAppend(out, ", latency ",
+                IntegerToString(static_cast<int>(short_latency_us_ / 1000)),
+                "ms (average ",
+                IntegerToString(static_cast<int>(long_latency_us_ / 1000)),
+                "ms)");
+    }
+    if ((origin_health != NULL) &&
+        (origin_health->GetState(host_) != SharedMemOriginHealth::kHealthy)) {
+      StrAppend(out, ", origin unhealthy");
+    }
+    StrAppend(out, "\n");
+  }
+
  private:
+  int outgoing_request_limit() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return static_cast<int>(outgoing_request_limit_);
+  }
+
+  // Moves the limit towards limit * gradient + headroom, where the gradient
+  // is 1 while short-term latency is within tolerance of the long-term
+  // average and falls as it rises beyond that.  The headroom lets the limit
+  // grow, but only while the host is using at least half its limit, so that
+  // a quiet host's limit doesn't grow without having been tested.
+  void AdaptLimit(bool success, int64 latency_us)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    double gradient = kMinGradient;
+    if (success) {
+      double sample = static_cast<double>(std::max(latency_us,
+                                                   static_cast<int64>(1)));
+      if (long_latency_us_ == 0) {
+        short_latency_us_ = sample;
+        long_latency_us_ = sample;
+      } else {
+        short_latency_us_ += (sample - short_latency_us_) / kShortLatencyWindow;
+        long_latency_us_ += (sample - long_latency_us_) / kLongLatencyWindow;
+        // After a sustained slowdown the long-term average has caught up
+        // with it; let it settle back quickly once the host recovers.
+        if (long_latency_us_ > 2 * short_latency_us_) {
+          long_latency_us_ *= 0.95;
+        }
+      }
+      gradient = std::max(kMinGradient, std::min(
+          1.0, kLatencyTolerance * long_latency_us_ / short_latency_us_));
+    }
+    double headroom = 0;
+    if ((gradient == 1.0) &&
+        (num_outbound_fetches_ >= outgoing_request_limit_ / 2)) {
+      headroom = std::sqrt(outgoing_request_limit_);
+    }
+    double new_limit = outgoing_request_limit_ * gradient + headroom;
+    outgoing_request_limit_ += (new_limit - outgoing_request_limit_) *
+        kLimitSmoothing;
+    outgoing_request_limit_ = std::max(1.0, std::min(
+        static_cast<double>(max_outgoing_requests_), outgoing_request_limit_));
+  }
+
   GoogleString host_;
-  int num_outbound_fetches_;
-  const int per_host_outgoing_request_threshold_;
+  int num_outbound_fetches_ GUARDED_BY(mutex_);
+  // Fractional, so that it can adapt by less than a fetch at a time.
+  double outgoing_request_limit_ GUARDED_BY(mutex_);
+  const int max_outgoing_requests_;
   const int per_host_queued_request_threshold_;
+  // Moving averages of fetch latency, or 0 before the first fetch.
+  double short_latency_us_ GUARDED_BY(mutex_);
+  double long_latency_us_ GUARDED_BY(mutex_);
   scoped_ptr<AbstractMutex> mutex_;
   std::queue<DeferredFetch*> fetch_queue_;
 
@@ -175,16 +283,35 @@ class RateController::CustomFetch : public SharedAsyncFetch {
               RateController* controller)
       : SharedAsyncFetch(fetch),
         fetch_info_(fetch_info),
-        controller_(controller) {}
+        controller_(controller),
+        start_us_(controller->timer_ == NULL ? 0 :
+                  controller->timer_->NowUs()) {}
 
   virtual void HandleDone(bool success) {
+    int64 latency_us = 0;
+    if (controller_->timer_ != NULL) {
+      latency_us = controller_->timer_->NowUs() - start_us_;
+    }
+    if (controller_->origin_health_ != NULL) {
+      // An origin that answers with server errors is no more use than one
+      // that doesn't answer.  This must look at the response before the
+      // base fetch is done with it.
+      bool origin_ok = success && (response_headers()->status_code() <
+                                   HttpStatus::kInternalServerError);
+      controller_->origin_health_->RecordFetch(fetch_info_->host(), origin_ok,
+                                               latency_us);
+    }
     SharedAsyncFetch::HandleDone(success);
-    fetch_info_->decrement_num_outbound_fetches();
-    // Check if there is any fetch queued up for this host and the number of
-    // outstanding fetches for the host is less than the threshold.
+    fetch_info_->FetchDone(success, latency_us);
+    // Start any fetches queued up for this host that are now within its
+    // limit on outstanding fetches.  If the limit adapts, it may have grown
+    // by more than one.
     DeferredFetch* deferred_fetch =
         fetch_info_->PopNextFetchAndIncrementCountIfWithinThreshold();
-    if (deferred_fetch != NULL) {
+    if (deferred_fetch == NULL) {
+      controller_->DeleteFetchInfoIfPossible(fetch_info_);
+    }
+    while (deferred_fetch != NULL) {
       DCHECK_GT(controller_->current_global_fetch_queue_size_->Get(), 0);
       controller_->current_global_fetch_queue_size_->Add(-1);
       // Trigger a fetch for the queued up request.
@@ -202,8 +329,8 @@ class RateController::CustomFetch : public SharedAsyncFetch {
                                        wrapper_fetch);
       }
       delete deferred_fetch;
-    } else {
-      controller_->DeleteFetchInfoIfPossible(fetch_info_);
+      deferred_fetch =
+          fetch_info_->PopNextFetchAndIncrementCountIfWithinThreshold();
     }
     delete this;
   }
@@ -211,6 +338,7 @@ class RateController::CustomFetch : public SharedAsyncFetch {
  private:
   HostFetchInfoPtr fetch_info_;
   RateController* controller_;
+  int64 start_us_;
   DISALLOW_COPY_AND_ASSIGN(CustomFetch);
 };
 
@@ -224,7 +352,10 @@ RateController::RateController(
       per_host_outgoing_request_threshold_(
           per_host_outgoing_request_threshold),
       per_host_queued_request_threshold_(per_host_queued_request_threshold),
+      max_per_host_outgoing_requests_(0),
       thread_system_(thread_system),
+      timer_(NULL),
+      origin_health_(NULL),
       mutex_(thread_system->NewMutex()) {
   CHECK_GE(max_global_queue_size, 0);
   CHECK_GE(per_host_outgoing_request_threshold, 0);
@@ -232,11 +363,50 @@ RateController::RateController(
   CHECK_GE(max_global_queue_size, per_host_queued_request_threshold);
   queued_fetch_count_ = statistics->GetTimedVariable(kQueuedFetchCount);
   dropped_fetch_count_ = statistics->GetTimedVariable(kDroppedFetchCount);
+  unhealthy_origin_fetch_count_ =
+      statistics->GetTimedVariable(kUnhealthyOriginFetchCount);
   current_global_fetch_queue_size_ = statistics->GetUpDownCounter(
       kCurrentGlobalFetchQueueSize);
 }
 
 RateController::~RateController() {
+  // With adaptive limits, idle hosts are left in the map.  Any fetches still
+  // outstanding hold their own references to their hosts' info.
+  for (HostFetchInfoMap::iterator iter = fetch_info_map_.begin();
+       iter != fetch_info_map_.end(); ++iter) {
+    delete iter->second;
+  }
+}
+
+void RateController::EnableAdaptiveLimits(int max_per_host_outgoing_requests,
+                                          Timer* timer) {
+  CHECK_GE(max_per_host_outgoing_requests,
+           per_host_outgoing_request_threshold_);
+  max_per_host_outgoing_requests_ = max_per_host_outgoing_requests;
+  timer_ = timer;
+}
+
+void RateController::TrackOriginHealth(SharedMemOriginHealth* origin_health,
+                                       Timer* timer) {
+  origin_health_ = origin_health;
+  timer_ = timer;
+}
+
+int RateController::HostLimit(const GoogleString& host) {
+  ScopedMutex lock(mutex_.get());
+  HostFetchInfoMap::iterator iter = fetch_info_map_.find(host);
+  if (iter == fetch_info_map_.end()) {
+    return -1;
+  }
+  return (*iter->second)->limit();
+}
+
+void RateController::PrintHostLimits(GoogleString* out) {
+  ScopedMutex lock(mutex_.get());
+  for (HostFetchInfoMap::iterator iter = fetch_info_map_.begin();
+       iter != fetch_info_map_.end(); ++iter) {
+    (*iter->second)->Print(origin_health_, out);
+  }
 }
 
 void RateController::Fetch(UrlAsyncFetcher* fetcher,
@@ -262,6 +432,19 @@ void RateController::Fetch(UrlAsyncFetcher* fetcher,
     return fetcher->Fetch(url, message_handler, fetch);
   }
 
+  // Don't tie up a fetch slot, or the rewrite waiting on it, for an origin
+  // that other fetches, perhaps in other processes, have found to be down.
+  // User-facing fetches still go out, and tell us if it has come back.
+  if (fetch->IsBackgroundFetch() && (origin_health_ != NULL) &&
+      !origin_health_->AllowFetch(host)) {
+    unhealthy_origin_fetch_count_->IncBy(1);
+    message_handler->Message(kInfo, "Dropping request for %s: origin unhealthy",
+                             url.c_str());
+    fetch->response_headers()->Add(HttpAttributes::kXPsaLoadShed, "1");
+    fetch->Done(false);
+    return;
+  }
+
   HostFetchInfoPtr fetch_info_ptr;
   // Lookup the map for the fetch info associated with the given host. Note that
   // it would have been nice to avoid acquiring the mutex for user-facing
@@ -280,6 +463,7 @@ void RateController::Fetch(UrlAsyncFetcher* fetcher,
     HostFetchInfoPtr* new_fetch_info_ptr = new HostFetchInfoPtr(
         new HostFetchInfo(host, per_host_outgoing_request_threshold_,
                           per_host_queued_request_threshold_,
+                          max_per_host_outgoing_requests_,
                           thread_system_->NewMutex()));
     fetch_info_ptr = *new_fetch_info_ptr;
     fetch_info_map_[host] = new_fetch_info_ptr;
@@ -324,12 +508,16 @@ void RateController::InitStats(Statistics* statistics) {
                                UrlAsyncFetcher::kStatisticsGroup);
   statistics->AddTimedVariable(kDroppedFetchCount,
                                UrlAsyncFetcher::kStatisticsGroup);
+  statistics->AddTimedVariable(kUnhealthyOriginFetchCount,
+                               UrlAsyncFetcher::kStatisticsGroup);
 }
 
 void RateController::DeleteFetchInfoIfPossible(
     const HostFetchInfoPtr& fetch_info) {
   ScopedMutex lock(mutex_.get());
-  if (fetch_info->AnyInFlightOrQueuedFetches()) {
+  if (fetch_info->AnyInFlightOrQueuedFetches() ||
+      (adaptive_limits() &&
+       (fetch_info_map_.size() <= kMaxIdleAdaptiveHosts))) {
     return;
   }
 
@@ -25,8 +25,11 @@
 #include "net/instaweb/http/public/mock_url_fetcher.h"
 #include "net/instaweb/http/public/rate_controller.h"
 #include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/http/public/simulated_delay_fetcher.h"
 #include "net/instaweb/http/public/wait_url_async_fetcher.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/mem_file_system.h"
 #include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -37,6 +40,9 @@
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/http_names.h"
 #include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
+#include "pagespeed/kernel/thread/mock_scheduler.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
 
@@ -405,6 +411,206 @@ TEST_F(RateControllingUrlAsyncFetcherTest,
   STLDeleteContainerPointers(fetch_vector.begin(), fetch_vector.end());
 }
 
+TEST_F(RateControllingUrlAsyncFetcherTest, UnhealthyOriginDropsFetches) {
+  InProcessSharedMem shm_runtime(thread_system_.get());
+  MD5Hasher hasher;
+  SharedMemOriginHealth origin_health(&shm_runtime, "/prefix/", "suffix",
+                                      &timer_, &hasher);
+  ASSERT_TRUE(origin_health.InitSegment(true, &handler_));
+  rate_controlling_fetcher_->rate_controller()->TrackOriginHealth(
+      &origin_health, &timer_);
+  RequestContextPtr ctx(
+      RequestContext::NewTestRequestContext(thread_system_.get()));
+
+  // Background fetches from d1 fail until it is found unhealthy.
+  mock_fetcher_.SetResponseFailure(domain1_url1_);
+  for (int i = 0; i < SharedMemOriginHealth::kMinFetches; ++i) {
+    MockFetch fetch(ctx, true);
+    rate_controlling_fetcher_->Fetch(domain1_url1_, &handler_, &fetch);
+    wait_fetcher_->CallCallbacks();
+    EXPECT_TRUE(fetch.done());
+    EXPECT_FALSE(fetch.success());
+  }
+  EXPECT_EQ(SharedMemOriginHealth::kUnhealthy,
+            origin_health.GetState("www.d1.com"));
+  EXPECT_EQ(SharedMemOriginHealth::kMinFetches,
+            counting_fetcher_->fetch_count());
+
+  // Now background fetches from d1 are dropped without being sent.
+  MockFetch dropped_fetch(ctx, true);
+  rate_controlling_fetcher_->Fetch(domain1_url1_, &handler_, &dropped_fetch);
+  EXPECT_TRUE(dropped_fetch.done());
+  EXPECT_FALSE(dropped_fetch.success());
+  EXPECT_TRUE(dropped_fetch.response_headers()->Has(
+      HttpAttributes::kXPsaLoadShed));
+  EXPECT_EQ(SharedMemOriginHealth::kMinFetches,
+            counting_fetcher_->fetch_count());
+  EXPECT_EQ(1, stats_.GetTimedVariable(
+      RateController::kUnhealthyOriginFetchCount)->Get(
+          TimedVariable::START));
+
+  // Fetches from other origins are unaffected.
+  MockFetch d2_fetch(ctx, true);
+  rate_controlling_fetcher_->Fetch(domain2_url1_, &handler_, &d2_fetch);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_TRUE(d2_fetch.success());
+
+  // User-facing fetches from d1 still go out, and once d1 is back one of
+  // them finds it healthy again.
+  SetupResponse(domain1_url1_, body1_);
+  MockFetch user_fetch(ctx, false);
+  rate_controlling_fetcher_->Fetch(domain1_url1_, &handler_, &user_fetch);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_TRUE(user_fetch.success());
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy,
+            origin_health.GetState("www.d1.com"));
+
+  MockFetch background_fetch(ctx, true);
+  rate_controlling_fetcher_->Fetch(domain1_url1_, &handler_,
+                                   &background_fetch);
+  wait_fetcher_->CallCallbacks();
+  EXPECT_TRUE(background_fetch.success());
+  EXPECT_STREQ(body1_, background_fetch.content());
+
+  origin_health.GlobalCleanup(&handler_);
+}
+
+const char kFastDelaysPath[] = "fast_delays.txt";
+const char kSlowDelaysPath[] = "slow_delays.txt";
+const char kFastLogPath[] = "fast_log.txt";
+const char kSlowLogPath[] = "slow_log.txt";
+const char kOriginHost[] = "www.origin.com";
+const char kOriginUrl[] = "http://www.origin.com/url";
+const int kFastDelayMs = 10;
+const int kSlowDelayMs = 100;
+const int kInitialLimit = 2;
+const int kMaxLimit = 16;
+
+// Drives a RateController with adaptive limits against a simulated origin,
+// which can be fetched through either a fast or a slow SimulatedDelayFetcher
+// to make its latency rise.
+class AdaptiveRateControllerTest : public ::testing::Test {
+ protected:
+  AdaptiveRateControllerTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        stats_(thread_system_.get()),
+        timer_(thread_system_->NewMutex(), MockTimer::kApr_5_2010_ms),
+        scheduler_(thread_system_.get(), &timer_),
+        file_system_(thread_system_.get(), &timer_) {
+    RateController::InitStats(&stats_);
+    file_system_.WriteFile(
+        kFastDelaysPath,
+        StrCat(kOriginHost, "=", IntegerToString(kFastDelayMs), ";"),
+        &handler_);
+    file_system_.WriteFile(
+        kSlowDelaysPath,
+        StrCat(kOriginHost, "=", IntegerToString(kSlowDelayMs), ";"),
+        &handler_);
+    fast_fetcher_.reset(new SimulatedDelayFetcher(
+        thread_system_.get(), &timer_, &scheduler_, &handler_, &file_system_,
+        kFastDelaysPath, kFastLogPath, 1000));
+    slow_fetcher_.reset(new SimulatedDelayFetcher(
+        thread_system_.get(), &timer_, &scheduler_, &handler_, &file_system_,
+        kSlowDelaysPath, kSlowLogPath, 1000));
+    rate_controller_.reset(new RateController(
+        1000, kInitialLimit, 1000, thread_system_.get(), &stats_));
+    rate_controller_->EnableAdaptiveLimits(kMaxLimit, &timer_);
+  }
+
+  virtual ~AdaptiveRateControllerTest() {
+    STLDeleteContainerPointers(fetches_.begin(), fetches_.end());
+  }
+
+  // Starts or queues num_fetches background fetches from the origin.
+  void Fetch(int num_fetches, UrlAsyncFetcher* fetcher) {
+    for (int i = 0; i < num_fetches; ++i) {
+      MockFetch* fetch = new MockFetch(
+          RequestContext::NewTestRequestContext(thread_system_.get()), true);
+      fetches_.push_back(fetch);
+      rate_controller_->Fetch(fetcher, kOriginUrl, &handler_, fetch);
+    }
+  }
+
+  int NumDone() {
+    int num_done = 0;
+    for (int i = 0, n = fetches_.size(); i < n; ++i) {
+      if (fetches_[i]->done()) {
+        EXPECT_TRUE(fetches_[i]->success());
+        ++num_done;
+      }
+    }
+    return num_done;
+  }
+
+  int limit() { return rate_controller_->HostLimit(kOriginHost); }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  SimpleStats stats_;
+  MockTimer timer_;
+  MockScheduler scheduler_;
+  MemFileSystem file_system_;
+  NullMessageHandler handler_;
+  scoped_ptr<SimulatedDelayFetcher> fast_fetcher_;
+  scoped_ptr<SimulatedDelayFetcher> slow_fetcher_;
+  scoped_ptr<RateController> rate_controller_;
+  std::vector<MockFetch*> fetches_;
+};
+
+TEST_F(AdaptiveRateControllerTest, LimitGrowsWhileLatencyIsFlat) {
+  Fetch(200, fast_fetcher_.get());
+  EXPECT_EQ(kInitialLimit, limit());
+  EXPECT_EQ(0, NumDone());
+
+  // With the initial limit, 100ms would be enough for 20 fetches.
+  scheduler_.AdvanceTimeMs(10 * kFastDelayMs);
+  EXPECT_EQ(kMaxLimit, limit());
+  EXPECT_LT(10 * kInitialLimit, NumDone());
+
+  scheduler_.AdvanceTimeMs(10 * kFastDelayMs);
+  EXPECT_EQ(200, NumDone());
+
+  // The host is remembered once it is idle, with what was learned about it.
+  EXPECT_EQ(kMaxLimit, limit());
+  GoogleString host_limits;
+  rate_controller_->PrintHostLimits(&host_limits);
+  EXPECT_EQ(StrCat(kOriginHost, ": limit 16 (max 16), 0 outgoing, 0 queued, "
+                   "latency 10ms (average 10ms)\n"),
+            host_limits);
+}
+
+TEST_F(AdaptiveRateControllerTest, LimitShrinksWhenLatencyRises) {
+  Fetch(200, fast_fetcher_.get());
+  scheduler_.AdvanceTimeMs(20 * kFastDelayMs);
+  ASSERT_EQ(200, NumDone());
+  ASSERT_EQ(kMaxLimit, limit());
+
+  // The origin slows down by a factor of 10.  The fetches already allowed
+  // go out at once, but as they come back slowly the limit falls.
+  Fetch(100, slow_fetcher_.get());
+  scheduler_.AdvanceTimeMs(kSlowDelayMs);
+  EXPECT_EQ(200 + kMaxLimit, NumDone());
+  EXPECT_GT(kMaxLimit / 2, limit());
+
+  scheduler_.AdvanceTimeMs(3 * kSlowDelayMs);
+  EXPECT_GE(kInitialLimit, limit());
+  EXPECT_GT(200 + kMaxLimit + 3 * kInitialLimit, NumDone());
+}
+
+TEST_F(AdaptiveRateControllerTest, FixedLimitByDefault) {
+  rate_controller_.reset(new RateController(
+      1000, kInitialLimit, 1000, thread_system_.get(), &stats_));
+  Fetch(20, fast_fetcher_.get());
+  EXPECT_EQ(kInitialLimit, limit());
+  scheduler_.AdvanceTimeMs(5 * kFastDelayMs);
+  EXPECT_EQ(5 * kInitialLimit, NumDone());
+  EXPECT_EQ(kInitialLimit, limit());
+
+  // Without adaptive limits, idle hosts are forgotten.
+  scheduler_.AdvanceTimeMs(5 * kFastDelayMs);
+  EXPECT_EQ(20, NumDone());
+  EXPECT_EQ(-1, limit());
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -1383,6 +1383,7 @@
         'http/http_value.cc',
         'http/http_value_writer.cc',
         'http/inflating_fetch.cc',
+        'http/inflight_fetch_table.cc',
         'http/rate_controller.cc',
         'http/rate_controlling_url_async_fetcher.cc',
         'http/sync_fetcher_adapter_callback.cc',
@@ -1780,6 +1781,7 @@
         'rewriter/google_font_service_input_resource.cc',
         'rewriter/handle_noscript_redirect_filter.cc',
         'rewriter/header_decision_tree.cc',
+        'rewriter/html_output_cache.cc',
         'rewriter/iframe_fetcher.cc',
         'rewriter/image_rewrite_filter.cc',
         'rewriter/in_place_rewrite_context.cc',
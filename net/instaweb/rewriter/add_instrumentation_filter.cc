@@ -25,6 +25,7 @@
 #include "net/instaweb/rewriter/public/request_properties.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -75,6 +76,7 @@ AddInstrumentationFilter::~AddInstrumentationFilter() {}
 
 void AddInstrumentationFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kInstrumentationScriptAddedCount);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "AddInstrumentation");
 }
 
 void AddInstrumentationFilter::StartDocumentImpl() {
@@ -33,6 +33,7 @@
 #include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/single_rewrite_context.h"
 #include "net/instaweb/rewriter/public/url_namer.h"
@@ -93,6 +94,9 @@ CacheExtender::~CacheExtender() {}
 void CacheExtender::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCacheExtensions);
   statistics->AddVariable(kNotCacheable);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CacheExtender");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kCacheExtenderId);
 }
 
 bool CacheExtender::ShouldRewriteResource(
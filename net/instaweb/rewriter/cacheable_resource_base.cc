@@ -37,6 +37,7 @@
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/google_url.h"
 #include "pagespeed/kernel/http/http_names.h"
@@ -85,6 +86,7 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
     if (fallback_value != NULL) {
       fallback_value_.Link(fallback_value);
     }
+    set_inflight_fetch_table(server_context->inflight_fetch_table());
   }
 
   virtual ~FetchCallbackBase() {}
@@ -146,6 +148,42 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
     return success && AsyncFetchWithLock::HandleWrite(content, handler);
   }
 
+  // Overridden from AsyncFetchWithLock.  Only fetches made for the same
+  // HTTP cache and cache fragment, with the same options and Referer, share
+  // a response, so that the leader's cache writes serve its followers too.
+  virtual GoogleString InflightKey() {
+    GoogleString referer;
+    if (IsBackgroundFetch()) {
+      driver_->base_url().Spec().CopyToString(&referer);
+    } else if (driver_->request_headers() != NULL) {
+      const char* referer_str = driver_->request_headers()->Lookup1(
+          HttpAttributes::kReferer);
+      if (referer_str != NULL) {
+        referer = referer_str;
+      }
+    }
+    return StrCat(driver_->CacheFragment(), "/",
+                  server_context_->lock_hasher()->Hash(
+                      StrCat(rewrite_options_->signature(), "/", referer,
+                             "/", PointerToString(http_cache()))),
+                  "/", cache_key());
+  }
+
+  // Overridden from AsyncFetchWithLock.  A follower gets the response the
+  // leader's fetcher delivers, so it falls back to its own stale value on
+  // an origin error, just as the fetch it would make itself does.
+  virtual AsyncFetch* NewFollowerFetch() {
+    return NewFallbackFetch(this);
+  }
+
+  virtual void DeleteFollowerFetch(AsyncFetch* fetch) {
+    if (fetch != this) {
+      DCHECK_EQ(fallback_fetch_, fetch);
+      delete fallback_fetch_;
+      fallback_fetch_ = NULL;
+    }
+  }
+
   // Overridden from AsyncFetchWithLock.
   virtual void StartFetch(UrlAsyncFetcher* fetcher, MessageHandler* handler) {
     fetch_url_ = url();
@@ -178,16 +216,10 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
       return;
     }
 
-    AsyncFetch* fetch = this;
-    if (rewrite_options_->serve_stale_if_fetch_error() &&
-        !fallback_value_.Empty()) {
-      // Use a stale value if the fetch from the backend fails.
-      fallback_fetch_ = new FallbackSharedAsyncFetch(
-          this, &fallback_value_, message_handler_);
-      fallback_fetch_->set_fallback_responses_served(
-          server_context_->rewrite_stats()->fallback_responses_served());
-      fetch = fallback_fetch_;
-    }
+    // Any followers get the response before the fallback is applied, so
+    // they can each decide for themselves, but after it's been revalidated,
+    // since they didn't make the conditional request.
+    AsyncFetch* fetch = ShareResponse(NewFallbackFetch(this));
     if (!fallback_value_.Empty()) {
       // Use the conditional headers in a stale response in cache while
       // triggering the outgoing fetch.
@@ -204,7 +236,24 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
   }
 
  private:
-  // Returns true if the result was successfully cached.
+  // Wraps fetch, if configured to, so that it's given a stale value if the
+  // fetch from the backend fails.
+  AsyncFetch* NewFallbackFetch(AsyncFetch* fetch) {
+    if (rewrite_options_->serve_stale_if_fetch_error() &&
+        !fallback_value_.Empty()) {
+      fallback_fetch_ = new FallbackSharedAsyncFetch(
+          fetch, &fallback_value_, message_handler_);
+      fallback_fetch_->set_fallback_responses_served(
+          server_context_->rewrite_stats()->fallback_responses_served());
+      return fallback_fetch_;
+    }
+    return fetch;
+  }
+
+  // Returns true if the result was successfully cached.  A fetch that's
+  // following another one leaves the cache writes, and the memos of failed
+  // or uncacheable fetches, to that one, but still returns whether the
+  // result would have been cached.
   bool AddToCache(bool success) {
     ResponseHeaders* headers = response_headers();
     // Merge in any extra response headers.
@@ -219,9 +268,11 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
         // Do not cache empty 200 responses, but remember that they were empty
         // to avoid fetching too often.
         // https://github.com/pagespeed/mod_pagespeed/issues/1050
-        http_cache()->RememberEmpty(resource_->cache_key(),
-                                    driver_->CacheFragment(),
-                                    message_handler_);
+        if (!following()) {
+          http_cache()->RememberEmpty(resource_->cache_key(),
+                                      driver_->CacheFragment(),
+                                      message_handler_);
+        }
       } else {
         if (rewrite_options_->IsCacheTtlOverridden(url())) {
           headers->ForceCaching(rewrite_options_->override_caching_ttl_ms());
@@ -234,19 +285,21 @@ class CacheableResourceBase::FetchCallbackBase : public AsyncFetchWithLock {
           // But we must be careful in the mod_pagespeed ipro flow,
           // where we must avoid storing any resource obtained with a
           // Cookie.  For now we don't implement this.
-          http_cache()->Put(resource_->cache_key(), driver_->CacheFragment(),
-                            RequestHeaders::Properties(),
-                            request_context()->options(),
-                            value, message_handler_);
+          if (!following()) {
+            http_cache()->Put(resource_->cache_key(), driver_->CacheFragment(),
+                              RequestHeaders::Properties(),
+                              request_context()->options(),
+                              value, message_handler_);
+          }
           return true;
-        } else {
+        } else if (!following()) {
           http_cache()->RememberNotCacheable(
               resource_->cache_key(), driver_->CacheFragment(),
               headers->status_code() == HttpStatus::kOK,
               message_handler_);
         }
       }
-    } else {
+    } else if (!following()) {
       if (headers->Has(HttpAttributes::kXPsaLoadShed)) {
         http_cache()->RememberFetchDropped(resource_->cache_key(),
                                            driver_->CacheFragment(),
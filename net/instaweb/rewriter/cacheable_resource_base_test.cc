@@ -21,6 +21,7 @@
 #include "net/instaweb/http/public/counting_url_async_fetcher.h"
 #include "net/instaweb/http/public/http_cache.h"
 #include "net/instaweb/http/public/http_value.h"
+#include "net/instaweb/http/public/inflight_fetch_table.h"
 #include "net/instaweb/http/public/mock_url_fetcher.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
@@ -542,4 +543,169 @@ TEST_F(CacheableResourceBaseTest, PrepareHooks) {
   EXPECT_EQ(4, counting_url_async_fetcher()->fetch_count());
 }
 
+TEST_F(CacheableResourceBaseTest, ConcurrentLoadsShareFetch) {
+  SetResponseWithDefaultHeaders(kTestUrl, kContentTypeText,
+                                kContent, 1000);
+  SetupWaitFetcher();
+
+  // The second load finds the first one's fetch in flight, and gets its
+  // response instead of fetching again.
+  RefCountedPtr<TestResource> resource2(new TestResource(rewrite_driver()));
+  MockResourceCallback callback(ResourcePtr(resource_.get()),
+                                server_context()->thread_system());
+  MockResourceCallback callback2(ResourcePtr(resource2.get()),
+                                 server_context()->thread_system());
+  resource_->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback);
+  resource2->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback2);
+  EXPECT_FALSE(callback.done());
+  EXPECT_FALSE(callback2.done());
+
+  CallFetcherCallbacks();
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_TRUE(callback.done());
+  EXPECT_TRUE(callback.success());
+  EXPECT_EQ(kContent, resource_->contents());
+  EXPECT_TRUE(callback2.done());
+  EXPECT_TRUE(callback2.success());
+  EXPECT_EQ(kContent, resource2->contents());
+  // Only the leader writes the HTTP cache.
+  EXPECT_EQ(1, http_cache()->cache_inserts()->Get());
+
+  Statistics* stats = server_context()->statistics();
+  EXPECT_EQ(1, stats->GetVariable(
+      InflightFetchTable::kInflightFetchesIssued)->Get());
+  EXPECT_EQ(1, stats->GetVariable(
+      InflightFetchTable::kInflightFetchesCoalesced)->Get());
+}
+
+TEST_F(CacheableResourceBaseTest, ConcurrentLoadsOfUncacheableResource) {
+  ResponseHeaders response_headers;
+  SetDefaultLongCacheHeaders(&kContentTypeText, &response_headers);
+  response_headers.Add(HttpAttributes::kCacheControl, "private");
+  SetFetchResponse(kTestUrl, response_headers, kContent);
+  SetupWaitFetcher();
+
+  // The follower gets the response as fetched, not the leader's verdict on
+  // it, so it can load it even though the leader can't use it.
+  RefCountedPtr<TestResource> resource2(new TestResource(rewrite_driver()));
+  MockResourceCallback callback(ResourcePtr(resource_.get()),
+                                server_context()->thread_system());
+  MockResourceCallback callback2(ResourcePtr(resource2.get()),
+                                 server_context()->thread_system());
+  resource_->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback);
+  resource2->LoadAsync(Resource::kLoadEvenIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback2);
+  CallFetcherCallbacks();
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_TRUE(callback.done());
+  EXPECT_FALSE(callback.success());
+  EXPECT_TRUE(callback2.done());
+  EXPECT_TRUE(callback2.success());
+  EXPECT_EQ(kContent, resource2->contents());
+
+  // The leader remembered that the resource is not cacheable, and the
+  // follower didn't overwrite that with a fetch failure.
+  RefCountedPtr<TestResource> resource3(new TestResource(rewrite_driver()));
+  MockResourceCallback callback3(ResourcePtr(resource3.get()),
+                                 server_context()->thread_system());
+  resource3->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback3);
+  EXPECT_TRUE(callback3.done());
+  EXPECT_FALSE(callback3.success());
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  CheckStats(resource3.get(), 0, 0, 0, 1, 2);
+}
+
+TEST_F(CacheableResourceBaseTest, ConcurrentLoadsOfOversizedResource) {
+  SetResponseWithDefaultHeaders(kTestUrl, kContentTypeText,
+                                kContent, 1000);
+  http_cache()->set_max_cacheable_response_content_length(
+      STATIC_STRLEN(kContent) - 1);
+  SetupWaitFetcher();
+
+  // Neither load can buffer the response, so both fail, but the follower
+  // isn't cut short by the leader giving up on it.
+  RefCountedPtr<TestResource> resource2(new TestResource(rewrite_driver()));
+  MockResourceCallback callback(ResourcePtr(resource_.get()),
+                                server_context()->thread_system());
+  MockResourceCallback callback2(ResourcePtr(resource2.get()),
+                                 server_context()->thread_system());
+  resource_->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback);
+  resource2->LoadAsync(Resource::kLoadEvenIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback2);
+  CallFetcherCallbacks();
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_TRUE(callback.done());
+  EXPECT_FALSE(callback.success());
+  EXPECT_TRUE(callback2.done());
+  EXPECT_FALSE(callback2.success());
+  EXPECT_EQ(0, http_cache()->cache_inserts()->Get());
+}
+
+TEST_F(CacheableResourceBaseTest, ConcurrentLoadsServeStale) {
+  SetResponseWithDefaultHeaders(kTestUrl, kContentTypeText,
+                                kContent, 1000);
+  MockResourceCallback callback(ResourcePtr(resource_.get()),
+                                server_context()->thread_system());
+  resource_->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback);
+  EXPECT_TRUE(callback.success());
+
+  // Once the cached copy has expired, the origin starts failing.
+  AdvanceTimeMs(2000 * Timer::kSecondMs);
+  ResponseHeaders bad_headers;
+  bad_headers.set_first_line(1, 1, 500, "Internal Server Error");
+  mock_url_fetcher()->SetResponse(kTestUrl, bad_headers, "");
+  SetupWaitFetcher();
+  ClearStats();
+
+  // Both loads serve the stale copy, and neither writes it back as fresh.
+  RefCountedPtr<TestResource> resource2(new TestResource(rewrite_driver()));
+  RefCountedPtr<TestResource> resource3(new TestResource(rewrite_driver()));
+  MockResourceCallback callback2(ResourcePtr(resource2.get()),
+                                 server_context()->thread_system());
+  MockResourceCallback callback3(ResourcePtr(resource3.get()),
+                                 server_context()->thread_system());
+  resource2->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback2);
+  resource3->LoadAsync(Resource::kReportFailureIfNotCacheable,
+                       RequestContext::NewTestRequestContext(
+                           server_context()->thread_system()),
+                       &callback3);
+  CallFetcherCallbacks();
+  EXPECT_EQ(1, counting_url_async_fetcher()->fetch_count());
+  EXPECT_TRUE(callback2.done());
+  EXPECT_TRUE(callback2.success());
+  EXPECT_EQ(kContent, resource2->contents());
+  EXPECT_TRUE(callback3.done());
+  EXPECT_TRUE(callback3.success());
+  EXPECT_EQ(kContent, resource3->contents());
+  EXPECT_EQ(0, http_cache()->cache_inserts()->Get());
+  EXPECT_EQ(
+      2,
+      server_context()->rewrite_stats()->fallback_responses_served()->Get());
+}
+
 }  // namespace net_instaweb
@@ -29,6 +29,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -77,6 +78,7 @@ void CriticalCssBeaconFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCriticalCssBeaconAddedCount);
   statistics->AddVariable(kCriticalCssNoBeaconDueToMissingData);
   statistics->AddVariable(kCriticalCssSkippedDueToCharset);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CriticalCssBeacon");
 }
 
 bool CriticalCssBeaconFilter::MustSummarize(HtmlElement* element) const {
@@ -24,6 +24,7 @@
 #include "net/instaweb/rewriter/public/request_properties.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -90,6 +91,7 @@ void CriticalImagesBeaconFilter::DetermineEnabled(
 
 void CriticalImagesBeaconFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCriticalImagesBeaconAddedCount);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CriticalImagesBeacon");
 }
 
 void CriticalImagesBeaconFilter::EndDocument() {
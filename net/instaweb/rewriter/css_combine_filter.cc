@@ -37,7 +37,9 @@
 #include "net/instaweb/rewriter/public/rewrite_context.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_filter.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/charset_util.h"
 #include "pagespeed/kernel/base/proto_util.h"
@@ -365,6 +367,9 @@ CssCombineFilter::~CssCombineFilter() {
 void CssCombineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCssCombineOpportunities);
   statistics->AddVariable(kCssFileCountReduction);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CssCombine");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kCssCombinerId);
 }
 
 void CssCombineFilter::StartDocumentImpl() {
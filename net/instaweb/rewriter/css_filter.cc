@@ -50,6 +50,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/single_rewrite_context.h"
 #include "net/instaweb/rewriter/public/usage_data_reporter.h"
@@ -873,6 +874,11 @@ void CssFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(CssFilter::kMinifyFailed);
   statistics->AddVariable(CssFilter::kRecursion);
   statistics->AddVariable(CssFilter::kComplexQueries);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CssFilter");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kCssFilterId);
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kCssImportFlattenerId);
 }
 
 namespace {
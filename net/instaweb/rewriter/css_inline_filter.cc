@@ -26,6 +26,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_filter.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/charset_util.h"
 #include "pagespeed/kernel/base/statistics.h"
@@ -100,6 +101,9 @@ CssInlineFilter::CssInlineFilter(RewriteDriver* driver)
 
 void CssInlineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kNumCssInlined);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "InlineCss");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kCssInlineId);
 }
 
 void CssInlineFilter::StartDocumentImpl() {
@@ -26,6 +26,7 @@
 #include "net/instaweb/rewriter/public/css_tag_scanner.h"
 #include "net/instaweb/rewriter/public/css_util.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -57,6 +58,7 @@ CssInlineImportToLinkFilter::~CssInlineImportToLinkFilter() {}
 
 void CssInlineImportToLinkFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCssImportsToLinks);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "InlineImportToLinkCss");
 }
 
 void CssInlineImportToLinkFilter::StartDocument() {
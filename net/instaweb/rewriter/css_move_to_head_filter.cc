@@ -21,6 +21,7 @@
 #include "net/instaweb/rewriter/public/css_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_name.h"
@@ -48,6 +49,7 @@ CssMoveToHeadFilter::~CssMoveToHeadFilter() {}
 
 void CssMoveToHeadFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kCssElementsMoved);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "CssMoveToHead");
 }
 
 void CssMoveToHeadFilter::StartDocumentImpl() {
@@ -23,6 +23,7 @@
 #include "base/logging.h"
 #include "net/instaweb/rewriter/public/request_properties.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/hasher.h"
@@ -63,6 +64,7 @@ DedupInlinedImagesFilter::~DedupInlinedImagesFilter() {
 void DedupInlinedImagesFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(DedupInlinedImagesFilter::kCandidatesFound);
   statistics->AddVariable(DedupInlinedImagesFilter::kCandidatesReplaced);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "DedupInlinedImages");
 }
 
 void DedupInlinedImagesFilter::DetermineEnabled(GoogleString* disabled_reason) {
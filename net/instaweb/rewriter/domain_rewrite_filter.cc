@@ -24,6 +24,7 @@
 #include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -66,6 +67,7 @@ DomainRewriteFilter::~DomainRewriteFilter() {}
 
 void DomainRewriteFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kDomainRewrites);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "DomainRewrite");
 }
 
 void DomainRewriteFilter::UpdateDomainHeaders(
@@ -39,6 +39,7 @@
 
 #include "base/logging.h"
 #include "net/instaweb/rewriter/google_analytics_snippet.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
@@ -205,6 +206,7 @@ GoogleAnalyticsFilter::~GoogleAnalyticsFilter() {}
 void GoogleAnalyticsFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kPageLoadCount);
   statistics->AddVariable(kRewrittenCount);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "GoogleAnalytics");
 }
 
 void GoogleAnalyticsFilter::StartDocument() {
@@ -23,6 +23,7 @@
 #include "net/instaweb/rewriter/public/google_font_service_input_resource.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/http/google_url.h"
@@ -44,6 +45,9 @@ GoogleFontCssInlineFilter::~GoogleFontCssInlineFilter() {
 
 void GoogleFontCssInlineFilter::InitStats(Statistics* statistics) {
   GoogleFontServiceInputResource::InitStats(statistics);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "InlineGoogleFontCss");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kGoogleFontCssInlineId);
 }
 
 ResourcePtr GoogleFontCssInlineFilter::CreateResource(const char* url,
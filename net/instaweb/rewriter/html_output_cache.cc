@@ -0,0 +1,318 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "net/instaweb/rewriter/public/html_output_cache.h"
+
+#include "base/logging.h"
+#include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/http/public/http_value.h"
+#include "net/instaweb/rewriter/public/request_properties.h"
+#include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/http/content_type.h"
+#include "pagespeed/kernel/http/http_names.h"
+#include "pagespeed/kernel/http/request_headers.h"
+#include "pagespeed/kernel/http/response_headers.h"
+#include "pagespeed/kernel/http/user_agent_matcher.h"
+
+namespace net_instaweb {
+
+const char HtmlOutputCache::kFragmentPrefix[] = "html_output.";
+const char HtmlOutputCache::kDependencyHeader[] =
+    "X-PageSpeed-Html-Output-Dependency";
+
+const char HtmlOutputCache::kHtmlOutputCacheHits[] = "html_output_cache_hits";
+const char HtmlOutputCache::kHtmlOutputCacheMisses[] =
+    "html_output_cache_misses";
+const char HtmlOutputCache::kHtmlOutputCacheInserts[] =
+    "html_output_cache_inserts";
+const char HtmlOutputCache::kHtmlOutputCacheBypassTooLarge[] =
+    "html_output_cache_bypass_too_large";
+const char HtmlOutputCache::kHtmlOutputCacheBypassIncompleteRewrites[] =
+    "html_output_cache_bypass_incomplete_rewrites";
+const char HtmlOutputCache::kHtmlOutputCacheBypassHeadersChanged[] =
+    "html_output_cache_bypass_headers_changed";
+const char HtmlOutputCache::kHtmlOutputCacheBypassDependencyChanged[] =
+    "html_output_cache_bypass_dependency_changed";
+const char HtmlOutputCache::kHtmlOutputCacheBypassRequestDependentFilters[] =
+    "html_output_cache_bypass_request_dependent_filters";
+
+// Fetches all the dependencies of an entry at once, and serves the entry if
+// each of them still hashes to the recorded value.
+class HtmlOutputCache::DependencyCheck {
+ public:
+  DependencyCheck(HtmlOutputCache* cache, const StringStringMap& dependencies,
+                  GoogleString* html, Callback1<bool>* done)
+      : cache_(cache),
+        dependencies_(dependencies),
+        html_(html),
+        done_(done),
+        mutex_(cache->server_context_->thread_system()->NewMutex()),
+        pending_(dependencies.size()),
+        valid_(true) {
+  }
+
+  void Start();
+
+  void DependencyDone(bool valid) {
+    bool finished;
+    {
+      ScopedMutex lock(mutex_.get());
+      valid_ &= valid;
+      finished = (--pending_ == 0);
+    }
+    if (finished) {
+      Finish();
+    }
+  }
+
+ private:
+  void Finish() {
+    if (valid_) {
+      cache_->hits_->Add(1);
+    } else {
+      cache_->RecordBypass(kBypassDependencyChanged);
+      cache_->server_context_->http_cache()->Delete(cache_->url_,
+                                                    cache_->fragment_);
+      html_->clear();
+    }
+    done_->Run(valid_);
+    delete this;
+  }
+
+  HtmlOutputCache* cache_;
+  StringStringMap dependencies_;  // Hash of each entry, by key.
+  GoogleString* html_;
+  Callback1<bool>* done_;
+  scoped_ptr<AbstractMutex> mutex_;
+  int pending_;
+  bool valid_;
+
+  DISALLOW_COPY_AND_ASSIGN(DependencyCheck);
+};
+
+class HtmlOutputCache::DependencyCallback : public CacheInterface::Callback {
+ public:
+  DependencyCallback(DependencyCheck* check, const Hasher* hasher,
+                     const GoogleString& hash)
+      : check_(check), hasher_(hasher), hash_(hash) {
+  }
+
+  virtual void Done(CacheInterface::KeyState state) {
+    check_->DependencyDone((state == CacheInterface::kAvailable) &&
+                           (hasher_->Hash(value()->Value()) == hash_));
+    delete this;
+  }
+
+ private:
+  DependencyCheck* check_;
+  const Hasher* hasher_;
+  GoogleString hash_;
+
+  DISALLOW_COPY_AND_ASSIGN(DependencyCallback);
+};
+
+void HtmlOutputCache::DependencyCheck::Start() {
+  const Hasher* hasher = cache_->server_context_->hasher();
+  CacheInterface::MultiGetRequest* request =
+      new CacheInterface::MultiGetRequest;
+  for (StringStringMap::const_iterator p = dependencies_.begin(),
+           e = dependencies_.end(); p != e; ++p) {
+    request->push_back(CacheInterface::KeyCallback(
+        p->first, new DependencyCallback(this, hasher, p->second)));
+  }
+  cache_->server_context_->metadata_cache()->MultiGet(request);
+}
+
+class HtmlOutputCache::LookupCallback : public OptionsAwareHTTPCacheCallback {
+ public:
+  LookupCallback(HtmlOutputCache* cache, RewriteDriver* driver,
+                 GoogleString* html, Callback1<bool>* done)
+      : OptionsAwareHTTPCacheCallback(driver->options(),
+                                      driver->request_context()),
+        cache_(cache), html_(html), done_(done) {
+  }
+
+  virtual void Done(HTTPCache::FindResult find_result) {
+    StringPiece contents;
+    if ((find_result != HTTPCache::kFound) ||
+        !http_value()->ExtractContents(&contents)) {
+      cache_->misses_->Add(1);
+      done_->Run(false);
+      delete this;
+      return;
+    }
+    contents.CopyToString(html_);
+
+    // The dependencies are kept in headers of their own, which are not
+    // split at commas, since keys may contain them.
+    StringStringMap dependencies;
+    const ResponseHeaders* headers = response_headers();
+    for (int i = 0, n = headers->NumAttributes(); i < n; ++i) {
+      if (StringCaseEqual(headers->Name(i), kDependencyHeader)) {
+        StringPiece value(headers->Value(i));
+        stringpiece_ssize_type space = value.find(' ');
+        if (space != StringPiece::npos) {
+          dependencies[value.substr(space + 1).as_string()] =
+              value.substr(0, space).as_string();
+        }
+      }
+    }
+    if (dependencies.empty()) {
+      cache_->hits_->Add(1);
+      done_->Run(true);
+    } else {
+      DependencyCheck* check =
+          new DependencyCheck(cache_, dependencies, html_, done_);
+      check->Start();
+    }
+    delete this;
+  }
+
+  // The entry is stored for exactly as long as it may be served, which
+  // the options' cache-TTL overrides must not extend.
+  virtual int64 OverrideCacheTtlMs(const GoogleString& key) { return -1; }
+
+ private:
+  HtmlOutputCache* cache_;
+  GoogleString* html_;
+  Callback1<bool>* done_;
+
+  DISALLOW_COPY_AND_ASSIGN(LookupCallback);
+};
+
+HtmlOutputCache::HtmlOutputCache(ServerContext* server_context)
+    : server_context_(server_context),
+      http_options_(kDeprecatedDefaultHttpOptions) {
+  Statistics* stats = server_context->statistics();
+  hits_ = stats->GetVariable(kHtmlOutputCacheHits);
+  misses_ = stats->GetVariable(kHtmlOutputCacheMisses);
+  inserts_ = stats->GetVariable(kHtmlOutputCacheInserts);
+  bypass_too_large_ = stats->GetVariable(kHtmlOutputCacheBypassTooLarge);
+  bypass_incomplete_rewrites_ =
+      stats->GetVariable(kHtmlOutputCacheBypassIncompleteRewrites);
+  bypass_headers_changed_ =
+      stats->GetVariable(kHtmlOutputCacheBypassHeadersChanged);
+  bypass_dependency_changed_ =
+      stats->GetVariable(kHtmlOutputCacheBypassDependencyChanged);
+  bypass_request_dependent_filters_ =
+      stats->GetVariable(kHtmlOutputCacheBypassRequestDependentFilters);
+}
+
+HtmlOutputCache::~HtmlOutputCache() {
+}
+
+void HtmlOutputCache::InitStats(Statistics* statistics) {
+  statistics->AddVariable(kHtmlOutputCacheHits);
+  statistics->AddVariable(kHtmlOutputCacheMisses);
+  statistics->AddVariable(kHtmlOutputCacheInserts);
+  statistics->AddVariable(kHtmlOutputCacheBypassTooLarge);
+  statistics->AddVariable(kHtmlOutputCacheBypassIncompleteRewrites);
+  statistics->AddVariable(kHtmlOutputCacheBypassHeadersChanged);
+  statistics->AddVariable(kHtmlOutputCacheBypassDependencyChanged);
+  statistics->AddVariable(kHtmlOutputCacheBypassRequestDependentFilters);
+}
+
+void HtmlOutputCache::SetKey(const RewriteDriver* driver,
+                             const GoogleString& url,
+                             const StringPiece& input) {
+  // The user-agent class covers the properties that filters consult when
+  // deciding how to rewrite for a particular browser.
+  const RequestProperties* properties = driver->request_properties();
+  const RewriteOptions* options = driver->options();
+  GoogleString ua_class = StrCat(
+      UserAgentMatcher::DeviceTypeSuffix(driver->device_type()),
+      properties->SupportsWebpRewrittenUrls() ? "w" : "",
+      properties->SupportsWebpLosslessAlpha() ? "a" : "",
+      properties->SupportsImageInlining() ? "i" : "",
+      properties->SupportsLazyloadImages() ? "l" : "",
+      properties->SupportsJsDefer(
+          options->enable_aggressive_rewriters_for_mobile()) ? "d" : "",
+      properties->IsBot() ? "b" : "");
+  // Hashes never contain '/', which fragments must not.
+  url_ = url;
+  fragment_ = StrCat(
+      kFragmentPrefix,
+      server_context_->GetRewriteOptionsSignatureHash(options), ".", ua_class,
+      ".", server_context_->hasher()->Hash(input));
+  http_options_ = options->ComputeHttpOptions();
+}
+
+void HtmlOutputCache::Lookup(RewriteDriver* driver, GoogleString* html,
+                             Callback1<bool>* done) {
+  DCHECK(!fragment_.empty());
+  server_context_->http_cache()->Find(
+      url_, fragment_, server_context_->message_handler(),
+      new LookupCallback(this, driver, html, done));
+}
+
+void HtmlOutputCache::Insert(const StringPiece& html,
+                             const HtmlOutputDependencies& dependencies,
+                             int64 ttl_ms) {
+  DCHECK(!fragment_.empty());
+  if (!dependencies.complete()) {
+    RecordBypass(kBypassIncompleteRewrites);
+    return;
+  }
+  ResponseHeaders headers(http_options_);
+  headers.set_major_version(1);
+  headers.set_minor_version(1);
+  headers.SetStatusAndReason(HttpStatus::kOK);
+  headers.Add(HttpAttributes::kContentType, kContentTypeHtml.mime_type());
+  headers.SetDateAndCaching(server_context_->timer()->NowMs(), ttl_ms);
+  const StringStringMap& hashes = dependencies.hashes();
+  for (StringStringMap::const_iterator p = hashes.begin(), e = hashes.end();
+       p != e; ++p) {
+    headers.Add(kDependencyHeader, StrCat(p->second, " ", p->first));
+  }
+  headers.ComputeCaching();
+  server_context_->http_cache()->Put(
+      url_, fragment_, RequestHeaders::Properties(),
+      ResponseHeaders::kIgnoreVaryOnResources, &headers, html,
+      server_context_->message_handler());
+  inserts_->Add(1);
+}
+
+void HtmlOutputCache::RecordBypass(BypassReason reason) {
+  switch (reason) {
+    case kBypassTooLarge:
+      bypass_too_large_->Add(1);
+      break;
+    case kBypassIncompleteRewrites:
+      bypass_incomplete_rewrites_->Add(1);
+      break;
+    case kBypassHeadersChanged:
+      bypass_headers_changed_->Add(1);
+      break;
+    case kBypassDependencyChanged:
+      bypass_dependency_changed_->Add(1);
+      break;
+    case kBypassRequestDependentFilters:
+      bypass_request_dependent_filters_->Add(1);
+      break;
+  }
+}
+
+}  // namespace net_instaweb
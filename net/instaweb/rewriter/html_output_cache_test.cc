@@ -0,0 +1,205 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the HTML output cache.
+
+#include "net/instaweb/rewriter/public/html_output_cache.h"
+
+#include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_test_base.h"
+#include "net/instaweb/rewriter/public/server_context.h"
+#include "pagespeed/kernel/base/callback.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kUrl[] = "http://test.com/page.html";
+const char kInput[] = "<img src=a.jpg>";
+const char kOutput[] = "<img src=a.jpg.pagespeed.ce.0.jpg>";
+const char kDependencyKey[] = "rname/ce_0/http://test.com/a.jpg";
+const int64 kTtlMs = 10 * Timer::kMinuteMs;
+
+class HtmlOutputCacheTest : public RewriteTestBase {
+ protected:
+  HtmlOutputCacheTest() : hit_(false), done_(false) {}
+
+  virtual void SetUp() {
+    RewriteTestBase::SetUp();
+    UseMd5Hasher();  // So that distinct inputs get distinct hashes.
+    cache_.reset(new HtmlOutputCache(server_context()));
+  }
+
+  void SetKey() {
+    cache_->SetKey(rewrite_driver(), kUrl, kInput);
+  }
+
+  bool Lookup() {
+    done_ = false;
+    html_.clear();
+    cache_->Lookup(rewrite_driver(), &html_,
+                   NewCallback(this, &HtmlOutputCacheTest::LookupDone));
+    EXPECT_TRUE(done_);  // The LRU cache calls back synchronously.
+    return hit_;
+  }
+
+  void LookupDone(bool hit) {
+    hit_ = hit;
+    done_ = true;
+  }
+
+  void PutDependency(const StringPiece& value) {
+    PutDependency(kDependencyKey, value);
+  }
+
+  void PutDependency(const GoogleString& key, const StringPiece& value) {
+    GoogleString buf;
+    value.CopyToString(&buf);
+    lru_cache()->PutSwappingString(key, &buf);
+  }
+
+  int64 Stat(const char* name) {
+    return statistics()->GetVariable(name)->Get();
+  }
+
+  scoped_ptr<HtmlOutputCache> cache_;
+  GoogleString html_;
+  bool hit_;
+  bool done_;
+};
+
+TEST_F(HtmlOutputCacheTest, InsertAndHit) {
+  SetKey();
+  EXPECT_FALSE(Lookup());
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheMisses));
+
+  HtmlOutputDependencies dependencies;
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheInserts));
+  EXPECT_TRUE(Lookup());
+  EXPECT_EQ(kOutput, html_);
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheHits));
+}
+
+TEST_F(HtmlOutputCacheTest, StoredInHttpCache) {
+  SetKey();
+  EXPECT_EQ(kUrl, cache_->url());
+  HtmlOutputDependencies dependencies;
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+
+  EXPECT_EQ(1, Stat(HTTPCache::kCacheInserts));
+  EXPECT_TRUE(Lookup());
+
+  // Flushing the cache invalidates the page along with everything else.
+  AdvanceTimeMs(1);
+  options()->ClearSignatureForTesting();
+  options()->UpdateCacheInvalidationTimestampMs(timer()->NowMs());
+  options()->ComputeSignature();
+  EXPECT_FALSE(Lookup());
+}
+
+TEST_F(HtmlOutputCacheTest, FragmentDependsOnInput) {
+  SetKey();
+  GoogleString fragment = cache_->fragment();
+  EXPECT_TRUE(StringPiece(fragment).starts_with(
+      HtmlOutputCache::kFragmentPrefix));
+  EXPECT_EQ(GoogleString::npos, fragment.find('/'));
+  cache_->SetKey(rewrite_driver(), kUrl, "<p>");
+  EXPECT_NE(fragment, cache_->fragment());
+}
+
+TEST_F(HtmlOutputCacheTest, Expires) {
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+  AdvanceTimeMs(kTtlMs - 1);
+  EXPECT_TRUE(Lookup());
+  AdvanceTimeMs(1);
+  EXPECT_FALSE(Lookup());
+}
+
+TEST_F(HtmlOutputCacheTest, IncompleteNotStored) {
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  dependencies.MarkIncomplete();
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+  EXPECT_EQ(0, Stat(HtmlOutputCache::kHtmlOutputCacheInserts));
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheBypassIncompleteRewrites));
+  EXPECT_FALSE(Lookup());
+}
+
+TEST_F(HtmlOutputCacheTest, DependencyUnchanged) {
+  PutDependency("metadata");
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  dependencies.Add(kDependencyKey, hasher()->Hash("metadata"));
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+  EXPECT_TRUE(Lookup());
+  EXPECT_EQ(kOutput, html_);
+}
+
+TEST_F(HtmlOutputCacheTest, DependencyChanged) {
+  PutDependency("metadata");
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  dependencies.Add(kDependencyKey, hasher()->Hash("metadata"));
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+
+  PutDependency("new metadata");
+  EXPECT_FALSE(Lookup());
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheBypassDependencyChanged));
+
+  // The stale entry was removed, so restoring the dependency doesn't bring
+  // it back.
+  PutDependency("metadata");
+  EXPECT_FALSE(Lookup());
+}
+
+TEST_F(HtmlOutputCacheTest, DependencyKeysWithCommasAndSpaces) {
+  const char kOddKey[] = "rname/ic_0/http://test.com/a, b.jpg";
+  PutDependency(kOddKey, "metadata");
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  dependencies.Add(kOddKey, hasher()->Hash("metadata"));
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+  EXPECT_TRUE(Lookup());
+
+  PutDependency(kOddKey, "new metadata");
+  EXPECT_FALSE(Lookup());
+}
+
+TEST_F(HtmlOutputCacheTest, DependencyEvicted) {
+  PutDependency("metadata");
+  SetKey();
+  HtmlOutputDependencies dependencies;
+  dependencies.Add(kDependencyKey, hasher()->Hash("metadata"));
+  cache_->Insert(kOutput, dependencies, kTtlMs);
+
+  lru_cache()->Delete(kDependencyKey);
+  EXPECT_FALSE(Lookup());
+  EXPECT_EQ(1, Stat(HtmlOutputCache::kHtmlOutputCacheBypassDependencyChanged));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
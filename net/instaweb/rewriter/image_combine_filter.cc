@@ -39,6 +39,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/spriter/image_library_interface.h"
 #include "net/instaweb/spriter/public/image_spriter.h"
@@ -1145,6 +1146,9 @@ ImageCombineFilter::~ImageCombineFilter() {
 
 void ImageCombineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kImageFileCountReduction);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "ImageCombine");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kImageCombineId);
 }
 
 // Get the dimensions of the declaration.  This is tricky.
@@ -50,6 +50,7 @@
 #include "net/instaweb/rewriter/public/rewrite_context.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/single_rewrite_context.h"
 #include "net/instaweb/util/public/property_cache.h"
@@ -666,6 +667,9 @@ void ImageRewriteFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kImageWebpOpaqueTimeouts);
   statistics->AddHistogram(kImageWebpOpaqueSuccessMs);
   statistics->AddHistogram(kImageWebpOpaqueFailureMs);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "ImageRewrite");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kImageCompressionId);
 }
 
 void ImageRewriteFilter::Initialize() {
@@ -35,6 +35,7 @@
 #include "net/instaweb/rewriter/public/rewrite_filter.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -287,6 +288,8 @@ InPlaceRewriteContext::~InPlaceRewriteContext() {}
 void InPlaceRewriteContext::InitStats(Statistics* statistics) {
   statistics->AddVariable(kInPlaceOversizedOptStream);
   statistics->AddVariable(kInPlaceUncacheableRewrites);
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kInPlaceRewriteId);
 }
 
 int64 InPlaceRewriteContext::GetRewriteDeadlineAlarmMs() const {
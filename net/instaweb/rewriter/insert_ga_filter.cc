@@ -25,6 +25,7 @@
 #include "net/instaweb/rewriter/public/experiment_util.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
@@ -93,6 +94,7 @@ InsertGAFilter::InsertGAFilter(RewriteDriver* rewrite_driver)
 
 void InsertGAFilter::InitStats(Statistics* stats) {
   stats->AddVariable(kInsertedGaSnippets);
+  RewriteStats::InitHtmlFilterCostStats(stats, "InsertGASnippet");
 }
 
 InsertGAFilter::~InsertGAFilter() {}
@@ -30,8 +30,10 @@
 #include "net/instaweb/rewriter/public/resource.h"
 #include "net/instaweb/rewriter/public/resource_slot.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_query.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/script_tag_scanner.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/single_rewrite_context.h"
@@ -88,6 +90,12 @@ JavascriptFilter::~JavascriptFilter() { }
 
 void JavascriptFilter::InitStats(Statistics* statistics) {
   JavascriptRewriteConfig::InitStats(statistics);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "Javascript");
+  RewriteStats::InitHtmlFilterCostStats(statistics, "Javascript_Source_Map");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kJavascriptMinId);
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kJavascriptMinSourceMapId);
 }
 
 class JavascriptFilter::Context : public SingleRewriteContext {
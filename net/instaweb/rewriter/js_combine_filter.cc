@@ -40,7 +40,9 @@
 #include "net/instaweb/rewriter/public/resource_slot.h"
 #include "net/instaweb/rewriter/public/rewrite_context.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/script_tag_scanner.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/url_partnership.h"
@@ -513,6 +515,9 @@ JsCombineFilter::~JsCombineFilter() {
 
 void JsCombineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kJsFileCountReduction);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "JsCombine");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kJavascriptCombinerId);
 }
 
 bool JsCombineFilter::IsLikelyStrictMode(
@@ -22,6 +22,7 @@
 #include "net/instaweb/rewriter/public/resource.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/script_tag_scanner.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -74,6 +75,9 @@ JsInlineFilter::~JsInlineFilter() {}
 
 void JsInlineFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kNumJsInlined);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "InlineJs");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kJavascriptInlineId);
 }
 
 void JsInlineFilter::StartDocumentImpl() {
@@ -23,6 +23,8 @@
 #include "base/logging.h"
 #include "net/instaweb/rewriter/cached_result.pb.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -85,6 +87,9 @@ void LocalStorageCacheFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(LocalStorageCacheFilter::kStoredCss);
   statistics->AddVariable(LocalStorageCacheFilter::kCandidatesAdded);
   statistics->AddVariable(LocalStorageCacheFilter::kCandidatesRemoved);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "LocalStorageCache");
+  RewriteStats::InitRewriteFilterCostStats(
+      statistics, RewriteOptions::kLocalStorageCacheId);
 }
 
 void LocalStorageCacheFilter::StartDocumentImpl() {
@@ -22,6 +22,7 @@
 
 #include "base/logging.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_element.h"
@@ -63,6 +64,7 @@ void MakeShowAdsAsyncFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kShowAdsSnippetsConverted);
   statistics->AddVariable(kShowAdsSnippetsNotConverted);
   statistics->AddVariable(kShowAdsApiReplacedForAsync);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "MakeShowAdsAsyncFilter");
 }
 
 void MakeShowAdsAsyncFilter::StartDocumentImpl() {
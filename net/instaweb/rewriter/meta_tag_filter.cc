@@ -22,6 +22,7 @@
 #include "net/instaweb/rewriter/public/meta_tag_filter.h"
 
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -48,6 +49,7 @@ MetaTagFilter::MetaTagFilter(RewriteDriver* rewrite_driver)
 
 void MetaTagFilter::InitStats(Statistics* stats) {
   stats->AddVariable(kConvertedMetaTags);
+  RewriteStats::InitHtmlFilterCostStats(stats, "ConvertMetaTags");
 }
 
 MetaTagFilter::~MetaTagFilter() {}
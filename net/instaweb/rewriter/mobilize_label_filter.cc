@@ -29,6 +29,7 @@
 #include "net/instaweb/rewriter/public/property_cache_util.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/escaping.h"
 #include "pagespeed/kernel/base/message_handler.h"
@@ -542,6 +543,7 @@ void MobilizeLabelFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kMarginalRoles);
   statistics->AddVariable(kDivsUnlabeled);
   statistics->AddVariable(kAmbiguousRoleLabels);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "MobilizeLabel");
 }
 
 const MobilizeLabelFilter::MobilizationIds* MobilizeLabelFilter::IdsForRole(
@@ -24,6 +24,7 @@
 #include "net/instaweb/rewriter/mobilize_labeling.pb.h"
 #include "net/instaweb/rewriter/mobilize_menu.pb.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -63,6 +64,7 @@ MobilizeMenuFilter::~MobilizeMenuFilter() {
 
 void MobilizeMenuFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kMenusComputed);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "MobilizeMenu");
 }
 
 void MobilizeMenuFilter::StartDocumentImpl() {
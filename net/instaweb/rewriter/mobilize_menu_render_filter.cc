@@ -29,6 +29,7 @@
 #include "net/instaweb/rewriter/public/request_properties.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -48,6 +49,7 @@ const char MobilizeMenuRenderFilter::kMobilizeMenuPropertyName[] =
 
 void MobilizeMenuRenderFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kMenusAdded);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "MobilizeMenuRenderFilter");
 }
 
 class MobilizeMenuRenderFilter::MenuComputation
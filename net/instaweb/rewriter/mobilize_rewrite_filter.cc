@@ -28,6 +28,7 @@
 #include "net/instaweb/rewriter/public/request_properties.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/basictypes.h"
@@ -166,6 +167,7 @@ void MobilizeRewriteFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kContentBlocks);
   statistics->AddVariable(kMarginalBlocks);
   statistics->AddVariable(kDeletedElements);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "MobilizeRewrite");
 }
 
 bool MobilizeRewriteFilter::IsApplicableFor(RewriteDriver* driver) {
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NET_INSTAWEB_REWRITER_PUBLIC_HTML_OUTPUT_CACHE_H_
+#define NET_INSTAWEB_REWRITER_PUBLIC_HTML_OUTPUT_CACHE_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/callback.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/http/http_options.h"
+
+namespace net_instaweb {
+
+class RewriteDriver;
+class ServerContext;
+class Statistics;
+class Variable;
+
+// The metadata cache entries that the rewrites in a page were rendered
+// from, collected by RewriteDriver while it parses the page.  If the page
+// is served again from HtmlOutputCache, each entry must still hash to the
+// value recorded here.
+class HtmlOutputDependencies {
+ public:
+  HtmlOutputDependencies() : complete_(true) {}
+
+  // Records that a rewrite rendered from the metadata cache entry at key,
+  // whose contents hashed to hash.
+  void Add(const GoogleString& key, const GoogleString& hash) {
+    hashes_[key] = hash;
+  }
+
+  // Records that some rewrite was not rendered, or was rendered from a
+  // result that was not written to the metadata cache, so the page as
+  // rewritten would not be reproduced from the cache.
+  void MarkIncomplete() { complete_ = false; }
+
+  bool complete() const { return complete_; }
+  const StringStringMap& hashes() const { return hashes_; }
+
+ private:
+  bool complete_;
+  StringStringMap hashes_;
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlOutputDependencies);
+};
+
+// Stores fully rewritten HTML in the HTTP cache, under the page's URL and a
+// fragment made of a hash of the origin HTML, the options signature and the
+// user-agent class, so that a byte-identical origin response can be served
+// without being parsed again.  An entry is only stored when every rewrite
+// in the page was rendered, and is only served while every metadata cache
+// entry the page was rendered from is unchanged.
+//
+// Pages that vary from one request to the next for other reasons, such as
+// beacons or inlining of critical images and CSS, can't be stored; see
+// RewriteOptions::RequestDependentFiltersEnabled and
+// RewriteDriver::is_critical_images_beacon_enabled.
+//
+// This object is cheap to construct, and is made per request.
+class HtmlOutputCache {
+ public:
+  // Reasons for not serving, or not storing, a page.
+  enum BypassReason {
+    kBypassTooLarge,
+    kBypassIncompleteRewrites,
+    kBypassHeadersChanged,
+    kBypassDependencyChanged,
+    kBypassRequestDependentFilters
+  };
+
+  // The fragments of the HTTP cache entries start with this prefix.
+  static const char kFragmentPrefix[];
+
+  // The stored responses carry one of these headers for each metadata cache
+  // entry they were rendered from, with the hash of the entry and its key
+  // separated by a space.
+  static const char kDependencyHeader[];
+
+  static const char kHtmlOutputCacheHits[];
+  static const char kHtmlOutputCacheMisses[];
+  static const char kHtmlOutputCacheInserts[];
+  static const char kHtmlOutputCacheBypassTooLarge[];
+  static const char kHtmlOutputCacheBypassIncompleteRewrites[];
+  static const char kHtmlOutputCacheBypassHeadersChanged[];
+  static const char kHtmlOutputCacheBypassDependencyChanged[];
+  static const char kHtmlOutputCacheBypassRequestDependentFilters[];
+
+  explicit HtmlOutputCache(ServerContext* server_context);
+  ~HtmlOutputCache();
+
+  static void InitStats(Statistics* statistics);
+
+  // Selects the entry that Lookup and Insert refer to: the rewritten form of
+  // input, served for url through driver.  The driver's device type must
+  // already be known, i.e. the property-cache lookup must be complete.
+  void SetKey(const RewriteDriver* driver, const GoogleString& url,
+              const StringPiece& input);
+
+  const GoogleString& url() const { return url_; }
+  const GoogleString& fragment() const { return fragment_; }
+
+  // Looks up the entry.  If it is unexpired, and its dependencies are all
+  // unchanged, stores its HTML in *html and calls done->Run(true).
+  // Otherwise calls done->Run(false).  done may be called on any thread,
+  // possibly before Lookup returns.  driver's options must stay valid until
+  // done is called.
+  void Lookup(RewriteDriver* driver, GoogleString* html,
+              Callback1<bool>* done);
+
+  // Stores html for ttl_ms, unless dependencies is incomplete.
+  void Insert(const StringPiece& html,
+              const HtmlOutputDependencies& dependencies, int64 ttl_ms);
+
+  void RecordBypass(BypassReason reason);
+
+ private:
+  class DependencyCheck;
+  class DependencyCallback;
+  class LookupCallback;
+
+  ServerContext* server_context_;
+  GoogleString url_;
+  GoogleString fragment_;
+  HttpOptions http_options_;
+
+  Variable* hits_;
+  Variable* misses_;
+  Variable* inserts_;
+  Variable* bypass_too_large_;
+  Variable* bypass_incomplete_rewrites_;
+  Variable* bypass_headers_changed_;
+  Variable* bypass_dependency_changed_;
+  Variable* bypass_request_dependent_filters_;
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlOutputCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // NET_INSTAWEB_REWRITER_PUBLIC_HTML_OUTPUT_CACHE_H_
@@ -28,6 +28,7 @@
 #include "net/instaweb/rewriter/public/resource.h"
 #include "net/instaweb/rewriter/public/resource_slot.h"
 #include "net/instaweb/rewriter/public/rewrite_result.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -171,6 +172,9 @@ class RewriteContext {
     bool is_stale_rewrite;
     InputInfoStarVector revalidate;
     scoped_ptr<OutputPartitions> partitions;
+    // Hash of the cached value the partitions were decoded from; only
+    // computed when the HTML output cache is enabled.
+    GoogleString metadata_hash;
   };
 
   // Used for LookupMetadataForOutputResource.
@@ -782,6 +786,10 @@ class RewriteContext {
   void StartRewriteForHtml();
   void StartRewriteForFetch();
 
+  // Charges the time since start_us to this context's filter, for the given
+  // phase.
+  void AddFilterCost(RewriteStats::FilterPhase phase, int64 start_us);
+
   // Determines whether the Context is in a state where it's ready to
   // rewrite.  This requires:
   //    - no preceding RewriteContexts in progress
@@ -918,6 +926,11 @@ class RewriteContext {
   scoped_ptr<ResourceContext> resource_context_;
   GoogleString partition_key_;
 
+  // When the HTML output cache is enabled, the hash of the metadata cache
+  // value under partition_key_ that partitions_ was read from or written to.
+  // Empty if partitions_ does not match the metadata cache.
+  GoogleString partition_hash_;
+
   UrlSegmentEncoder default_encoder_;
 
   // Lock guarding output partitioning and rewriting.  Lazily initialized by
@@ -83,6 +83,7 @@ class FallbackPropertyPage;
 class FileSystem;
 class FlushEarlyInfo;
 class FlushEarlyRenderInfo;
+class HtmlOutputDependencies;
 class HtmlWriterFilter;
 class MessageHandler;
 class RequestProperties;
@@ -1194,6 +1195,14 @@ class RewriteDriver : public HtmlParse {
     return num_detached_rewrites_;
   }
 
+  // Collects the metadata cache entries that the top-level rewrites in this
+  // page are rendered from, for HtmlOutputCache.  Must be set before the
+  // parse starts, and must outlive it.  NULL, the default, collects nothing.
+  void set_html_output_dependencies(HtmlOutputDependencies* x) {
+    ScopedMutex lock(rewrite_mutex());
+    html_output_dependencies_ = x;
+  }
+
   void set_pagespeed_query_params(StringPiece x) {
     x.CopyToString(&pagespeed_query_params_);
   }
@@ -1227,6 +1236,7 @@ class RewriteDriver : public HtmlParse {
 
  protected:
   virtual void DetermineEnabledFiltersImpl();
+  virtual void ReportFilterTime(const FilterVector& filters, int64 time_us);
 
  private:
   friend class DistributedRewriteContextTest;
@@ -1605,6 +1615,9 @@ class RewriteDriver : public HtmlParse {
   // document.
   int64 num_detached_rewrites_ GUARDED_BY(rewrite_mutex());
 
+  HtmlOutputDependencies* html_output_dependencies_
+      GUARDED_BY(rewrite_mutex());
+
   // Contains the RewriteContext* that were still running at the deadline.
   // They are said to be in a "detached" state although the RewriteContexts
   // themselves don't know that.  They will continue performing their
@@ -45,6 +45,7 @@ class FileSystem;
 class FlushEarlyInfoFinder;
 class ExperimentMatcher;
 class Hasher;
+class InflightFetchTable;
 class MessageHandler;
 class MobilizeCachedFinder;
 class NamedLockManager;
@@ -128,6 +129,38 @@ class RewriteDriverFactory {
   // fecher to return cached versions.
   void set_force_caching(bool u) { force_caching_ = u; }
 
+  // Makes the rewrite and low-priority rewrite worker pools dispatch with
+  // work stealing; see QueuedWorkerPool::set_work_stealing.  Must be called
+  // before the pools are created.
+  void set_work_stealing_rewrite_pools(bool x) {
+    work_stealing_rewrite_pools_ = x;
+  }
+  bool work_stealing_rewrite_pools() const {
+    return work_stealing_rewrite_pools_;
+  }
+
+  // Sheds low-priority rewrites once they have been waiting more than
+  // target_ms for a sustained period, rather than waiting for the number of
+  // queued rewrites to reach a threshold; see QueueDelayController.  Shed
+  // rewrites are canceled, just as they are when the load-shedding threshold
+  // is reached.  0 disables this, which is the default.  Must be called
+  // before the pools are created.
+  void set_low_priority_queue_delay_target_ms(int64 target_ms) {
+    low_priority_queue_delay_target_ms_ = target_ms;
+  }
+  int64 low_priority_queue_delay_target_ms() const {
+    return low_priority_queue_delay_target_ms_;
+  }
+
+  // Recycles RewriteDrivers with custom options for up to this many distinct
+  // option-sets per ServerContext; see
+  // ServerContext::set_max_custom_driver_pools.  0 disables this, which is
+  // the default.  Must be called before the ServerContexts are initialized.
+  void set_max_custom_driver_pools(int max_pools) {
+    max_custom_driver_pools_ = max_pools;
+  }
+  int max_custom_driver_pools() const { return max_custom_driver_pools_; }
+
   // You can call set_base_url_async_fetcher to set up real async fetching
   // for real serving or for modeling of live traffic.
   //
@@ -164,6 +197,7 @@ class RewriteDriverFactory {
   // InitServerContext().
   Timer* timer();
   NamedLockManager* lock_manager();
+  InflightFetchTable* inflight_fetch_table();
   QueuedWorkerPool* WorkerPool(WorkerPoolCategory pool);
   Scheduler* scheduler();
   UsageDataReporter* usage_data_reporter();
@@ -472,6 +506,9 @@ class RewriteDriverFactory {
   GoogleString filename_prefix_;
   GoogleString slurp_directory_;
   bool force_caching_;
+  bool work_stealing_rewrite_pools_;
+  int64 low_priority_queue_delay_target_ms_;
+  int max_custom_driver_pools_;
   bool slurp_read_only_;
   bool slurp_print_urls_;
 
@@ -497,6 +534,11 @@ class RewriteDriverFactory {
   // Manage locks for output resources.
   scoped_ptr<NamedLockManager> lock_manager_;
 
+  // Shared by all server contexts.  Resource fetches are keyed on their
+  // cache fragment and options as well as their cache key, so they only
+  // follow fetches that would get them the same response.
+  scoped_ptr<InflightFetchTable> inflight_fetch_table_;
+
   scoped_ptr<ThreadSystem> thread_system_;
 
   // Default statistics implementation which can be overridden by children
@@ -19,9 +19,12 @@
 #ifndef NET_INSTAWEB_REWRITER_PUBLIC_REWRITE_DRIVER_POOL_H_
 #define NET_INSTAWEB_REWRITER_PUBLIC_REWRITE_DRIVER_POOL_H_
 
+#include <list>
+#include <map>
 #include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
 
 namespace net_instaweb {
 
@@ -52,6 +55,72 @@ class RewriteDriverPool  {
   DISALLOW_COPY_AND_ASSIGN(RewriteDriverPool);
 };
 
+// Recycles RewriteDrivers with custom options, which would otherwise be
+// deleted once released and rebuilt, filter-chain and all, for the next
+// request.  A free-list is kept for each of the max_pools most recently
+// used option signatures; when a new signature is added beyond that, the
+// least recently used free-list is deleted along with its drivers.  Like
+// RewriteDriverPool, this is not threadsafe, as ServerContext takes care
+// of that.
+class CustomRewriteDriverPools {
+ public:
+  CustomRewriteDriverPools();
+
+  // Deletes all drivers in all the pools.
+  ~CustomRewriteDriverPools();
+
+  // 0, the default, disables recycling: RecycleDriver will refuse all
+  // drivers.  Otherwise, reducing this does not evict anything until the
+  // next AddPool.
+  void set_max_pools(int max_pools) { max_pools_ = max_pools; }
+  int max_pools() const { return max_pools_; }
+  int num_pools() const { return pools_.size(); }
+
+  // Returns a recycled driver whose options are equal to 'options', which
+  // must be frozen, or NULL if there is none.  When a driver is returned,
+  // *construction_us is set to how long it took to construct a driver with
+  // these options, as reported to AddPool.
+  RewriteDriver* PopDriver(const RewriteOptions& options,
+                           int64* construction_us);
+
+  // Notes that a driver with 'options', which must be frozen, was just
+  // constructed, which took construction_us, and starts keeping a free-list
+  // for those options if there isn't one.  Returns the number of free-lists
+  // evicted to make room for it.
+  int AddPool(const RewriteOptions& options, int64 construction_us);
+
+  // Clear()s driver and stores it on the free-list for its options,
+  // returning true.  If there is no such free-list, returns false, and the
+  // caller retains ownership of driver.
+  bool RecycleDriver(RewriteDriver* driver);
+
+ private:
+  struct Pool {
+    Pool(const GoogleString& key_in, int64 construction_us_in)
+        : key(key_in), construction_us(construction_us_in) {}
+
+    GoogleString key;
+    int64 construction_us;
+    std::vector<RewriteDriver*> drivers;
+  };
+  typedef std::list<Pool*> PoolList;  // Most recently used first.
+  typedef std::map<GoogleString, PoolList::iterator> PoolMap;
+
+  // The signature does not cover the debug filter, but IsEqual does.
+  static GoogleString Key(const RewriteOptions& options);
+
+  // Returns the pool for key, moving it to the front of lru_, or NULL.
+  Pool* Find(const GoogleString& key);
+
+  static void DeletePool(Pool* pool);
+
+  int max_pools_;
+  PoolList lru_;
+  PoolMap pools_;
+
+  DISALLOW_COPY_AND_ASSIGN(CustomRewriteDriverPools);
+};
+
 }  // namespace net_instaweb
 
 #endif  // NET_INSTAWEB_REWRITER_PUBLIC_REWRITE_DRIVER_POOL_H_
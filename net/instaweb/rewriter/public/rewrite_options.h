@@ -276,6 +276,7 @@ class RewriteOptions {
   static const char kGoogleFontCssInlineMaxBytes[];
   static const char kForbidAllDisabledFilters[];
   static const char kHideRefererUsingMeta[];
+  static const char kHtmlOutputCacheTtlMs[];
   static const char kIdleFlushTimeMs[];
   static const char kImageInlineMaxBytes[];
   static const char kImageJpegNumProgressiveScans[];
@@ -373,6 +374,7 @@ class RewriteOptions {
   static const char kRewriteRandomDropPercentage[];
   static const char kRewriteUncacheableResources[];
   static const char kRunningExperiment[];
+  static const char kServeByteRangesFromCache[];
   static const char kServeGhostClickBusterWithSplitHtml[];
   static const char kServeSplitHtmlInTwoChunks[];
   static const char kServeStaleIfFetchError[];
@@ -745,6 +747,10 @@ class RewriteOptions {
   // after expiry.
   static const int64 kDefaultMetadataCacheStalenessThresholdMs;
 
+  // Default time for which rewritten HTML may be served from the HTML output
+  // cache; 0 disables it.
+  static const int64 kDefaultHtmlOutputCacheTtlMs;
+
   // Default maximum size of the combined CSS resource.
   static const int64 kDefaultMaxCombinedCssBytes;
 
@@ -1249,6 +1255,13 @@ class RewriteOptions {
   // Disables all filters that depend on executing custom javascript.
   void DisableFiltersRequiringScriptExecution();
 
+  // Returns true if any filter is enabled whose output varies from one
+  // request to the next for reasons other than the origin HTML, the options
+  // and the user-agent class, e.g. with beacon results or cookies.  Note
+  // that inline_images also does when RewriteDriver enables the critical
+  // images beacon.
+  bool RequestDependentFiltersEnabled() const;
+
   // Returns true if any filter benefits from per-origin property cache
   // information.
   bool UsePerOriginPropertyCachePage() const;
@@ -1813,6 +1826,13 @@ class RewriteOptions {
     return serve_stale_if_fetch_error_.value();
   }
 
+  void set_serve_byte_ranges_from_cache(bool x) {
+    set_option(x, &serve_byte_ranges_from_cache_);
+  }
+  bool serve_byte_ranges_from_cache() const {
+    return serve_byte_ranges_from_cache_.value();
+  }
+
   void set_serve_ghost_click_buster_with_split_html(bool x) {
     set_option(x, &serve_ghost_click_buster_with_split_html_);
   }
@@ -2026,6 +2046,13 @@ class RewriteOptions {
     return metadata_cache_staleness_threshold_ms_.value();
   }
 
+  void set_html_output_cache_ttl_ms(int64 x) {
+    set_option(x, &html_output_cache_ttl_ms_);
+  }
+  int64 html_output_cache_ttl_ms() const {
+    return html_output_cache_ttl_ms_.value();
+  }
+
   void set_metadata_input_errors_cache_ttl_ms(int64 x) {
     set_option(x, &metadata_input_errors_cache_ttl_ms_);
   }
@@ -3765,6 +3792,9 @@ class RewriteOptions {
   // Should we serve stale responses if the fetch results in a server side
   // error.
   Option<bool> serve_stale_if_fetch_error_;
+  // Should we answer Range requests for cached responses with the ranges
+  // asked for, rather than the whole response.
+  Option<bool> serve_byte_ranges_from_cache_;
   // Should we serve ghost click buster code when split html is enabled.
   Option<bool> serve_ghost_click_buster_with_split_html_;
   // Should we serve access control headers in response headers.
@@ -3931,6 +3961,10 @@ class RewriteOptions {
   // used.
   Option<int64> metadata_cache_staleness_threshold_ms_;
 
+  // How long rewritten HTML may be replayed for byte-identical input, as long
+  // as the metadata it was rendered from is unchanged.  0 disables it.
+  Option<int64> html_output_cache_ttl_ms_;
+
   // The metadata cache ttl for input resources which are 4xx errors.
   Option<int64> metadata_input_errors_cache_ttl_ms_;
 
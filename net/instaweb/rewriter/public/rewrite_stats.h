@@ -23,6 +23,7 @@
 
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
 
@@ -50,11 +51,38 @@ class RewriteStats {
   // successful (200s).
   static const char kSuccessfulDownstreamCachePurges[];
 
+  // The names of the histograms of the cost of each filter all start with
+  // this prefix, followed by the filter and the phase it is charged for,
+  // separated by a space.
+  static const char kFilterCostHistogramPrefix[];
+
+  // The phases of work whose cost is accounted to filters.  kHtmlPhase is an
+  // HtmlFilter's passes over the events of a document; the others are the
+  // corresponding steps of a RewriteContext.
+  enum FilterPhase {
+    kHtmlPhase,
+    kPartitionPhase,
+    kRewritePhase,
+    kRenderPhase,
+    kNumFilterPhases
+  };
+
   RewriteStats(Statistics* stats, ThreadSystem* thread_system, Timer* timer);
   ~RewriteStats();
 
   static void InitStats(Statistics* statistics);
 
+  // Declare the histograms of the cost of a filter, since shared-memory
+  // histograms must be declared before Init.  Filters call these from their
+  // own InitStats: InitHtmlFilterCostStats with the Name() of the
+  // HtmlFilter, and InitRewriteFilterCostStats with the id of the filter of
+  // its RewriteContexts.  The cost of filters that don't is charged to
+  // "Other".
+  static void InitHtmlFilterCostStats(Statistics* statistics,
+                                      StringPiece filter_name);
+  static void InitRewriteFilterCostStats(Statistics* statistics,
+                                         StringPiece filter_id);
+
   Variable* cached_output_hits() { return cached_output_hits_; }
   Variable* cached_output_missed_deadline() {
     return cached_output_missed_deadline_; }
@@ -100,6 +128,11 @@ class RewriteStats {
 
   Variable* num_conditional_refreshes() { return num_conditional_refreshes_; }
 
+  Variable* byte_range_responses_served() {
+    return byte_range_responses_served_;
+  }
+  Variable* byte_range_bytes_served() { return byte_range_bytes_served_; }
+
   Variable* ipro_served() { return ipro_served_; }
   Variable* ipro_not_in_cache() { return ipro_not_in_cache_; }
   Variable* ipro_not_rewritable() { return ipro_not_rewritable_; }
@@ -120,6 +153,26 @@ class RewriteStats {
   Histogram* rewrite_latency_histogram() { return rewrite_latency_histogram_; }
   Histogram* backend_latency_histogram() { return backend_latency_histogram_; }
 
+  // Returns the histogram of the cost of a filter in the given phase: per
+  // document for kHtmlPhase, and per RewriteContext otherwise.  HtmlFilters
+  // are keyed by their Name(), and RewriteContexts by the id of their
+  // filter.  Returns the "Other" histogram of the phase for filters that
+  // did not declare theirs.
+  Histogram* FilterCostHistogram(StringPiece filter, FilterPhase phase);
+
+  // Streaming-safe HtmlFilters that share a pass over the events are timed
+  // together, and their cost per document is recorded here.
+  Histogram* fused_filter_cost_histogram() {
+    return fused_filter_cost_histogram_;
+  }
+
+  // Records cost_us in the histogram for filter and phase, as above.
+  void AddFilterCost(StringPiece filter, FilterPhase phase, int64 cost_us);
+
+  // Records cost_us in a histogram of filter cost.  Timers are not
+  // guaranteed to go forward in time, so negative costs count as zero.
+  static void AddFilterCost(Histogram* histogram, int64 cost_us);
+
   // Number of .pagespeed. resources fetched.
   TimedVariable* total_fetch_count() { return total_fetch_count_; }
   // Number of HTML pages rewritten.
@@ -128,9 +181,32 @@ class RewriteStats {
   Waveform* thread_queue_depth(RewriteDriverFactory::WorkerPoolCategory pool) {
     return thread_queue_depths_[pool];
   }
+  // How long tasks wait in the pool's queue, in ms.
+  Histogram* thread_queue_delay_histogram(
+      RewriteDriverFactory::WorkerPoolCategory pool) {
+    return thread_queue_delay_histograms_[pool];
+  }
 
   TimedVariable* num_rewrites_executed() { return num_rewrites_executed_; }
   TimedVariable* num_rewrites_dropped() { return num_rewrites_dropped_; }
+  Variable* num_rewrites_shed_for_queue_delay() {
+    return num_rewrites_shed_for_queue_delay_;
+  }
+
+  Variable* custom_rewrite_driver_pool_hits() {
+    return custom_rewrite_driver_pool_hits_;
+  }
+  Variable* custom_rewrite_driver_pool_misses() {
+    return custom_rewrite_driver_pool_misses_;
+  }
+  Variable* custom_rewrite_driver_pool_evictions() {
+    return custom_rewrite_driver_pool_evictions_;
+  }
+  // Estimated microseconds not spent building filter-chains thanks to
+  // recycled custom RewriteDrivers.
+  Variable* rewrite_driver_construction_us_saved() {
+    return rewrite_driver_construction_us_saved_;
+  }
 
  private:
   Variable* cached_output_hits_;
@@ -152,6 +228,8 @@ class RewriteStats {
   Variable* num_proactively_freshen_user_facing_request_;
   Variable* fallback_responses_served_while_revalidate_;
   Variable* num_conditional_refreshes_;
+  Variable* byte_range_responses_served_;
+  Variable* byte_range_bytes_served_;
   Variable* ipro_served_;
   Variable* ipro_not_in_cache_;
   Variable* ipro_not_rewritable_;
@@ -167,8 +245,18 @@ class RewriteStats {
   TimedVariable* total_rewrite_count_;
   TimedVariable* num_rewrites_executed_;
   TimedVariable* num_rewrites_dropped_;
+  Variable* num_rewrites_shed_for_queue_delay_;
+  Variable* custom_rewrite_driver_pool_hits_;
+  Variable* custom_rewrite_driver_pool_misses_;
+  Variable* custom_rewrite_driver_pool_evictions_;
+  Variable* rewrite_driver_construction_us_saved_;
+
+  Statistics* statistics_;
+  Histogram* other_filter_cost_histograms_[kNumFilterPhases];
+  Histogram* fused_filter_cost_histogram_;
 
   std::vector<Waveform*> thread_queue_depths_;
+  std::vector<Histogram*> thread_queue_delay_histograms_;
 
   DISALLOW_COPY_AND_ASSIGN(RewriteStats);
 };
@@ -61,11 +61,13 @@ class CriticalCssFinder;
 class CriticalImagesFinder;
 class CriticalLineInfoFinder;
 class CriticalSelectorFinder;
+class CustomRewriteDriverPools;
 class RequestProperties;
 class ExperimentMatcher;
 class FileSystem;
 class FlushEarlyInfoFinder;
 class GoogleUrl;
+class InflightFetchTable;
 class MessageHandler;
 class MobilizeCachedFinder;
 class NamedLock;
@@ -137,12 +139,20 @@ class ServerContext {
   void set_statistics(Statistics* x) { statistics_ = x; }
   void set_rewrite_stats(RewriteStats* x) { rewrite_stats_ = x; }
   void set_lock_manager(NamedLockManager* x) { lock_manager_ = x; }
+  void set_inflight_fetch_table(InflightFetchTable* x) {
+    inflight_fetch_table_ = x;
+  }
   void set_enable_property_cache(bool enabled);
   void set_message_handler(MessageHandler* x) { message_handler_ = x; }
 
   StringPiece filename_prefix() const { return file_prefix_; }
   Statistics* statistics() const { return statistics_; }
   NamedLockManager* lock_manager() const { return lock_manager_; }
+  // Origin fetches in flight in this process, which resource fetches for the
+  // same cache key follow rather than fetch again.  May be NULL.
+  InflightFetchTable* inflight_fetch_table() const {
+    return inflight_fetch_table_;
+  }
   RewriteDriverFactory* factory() const { return factory_; }
   ThreadSynchronizer* thread_synchronizer() {
     return thread_synchronizer_.get();
@@ -490,15 +500,19 @@ class ServerContext {
   // activites on it have completed, including HTML Parsing
   // (FinishParse) and all pending Rewrites.
   //
-  // TODO(jmarantz): this cannot recycle RewriteDrivers with custom
-  // rewrite options, which is a potential performance issue for Apache
-  // installations that set custom options in .htaccess files, where
-  // essentially every RewriteDriver will be a custom driver.  To
-  // resolve this we need to make a comparator for RewriteOptions
-  // so that we can determine option-equivalence and, potentially,
-  // keep free-lists for each unique option-set.
+  // RewriteDrivers with custom rewrite options are only recycled when
+  // set_max_custom_driver_pools is non-zero, and are otherwise deleted.
   void ReleaseRewriteDriver(RewriteDriver* rewrite_driver);
 
+  // Keeps free-lists of released custom RewriteDrivers for this many
+  // distinct option-sets, so that NewCustomRewriteDriver can reuse them
+  // rather than building a new filter-chain.  This matters for Apache
+  // installations that set custom options in .htaccess files, where
+  // essentially every RewriteDriver will be a custom driver.  The least
+  // recently used option-set is dropped, with its drivers, when a new one
+  // would exceed the limit.  0, the default, disables this.
+  void set_max_custom_driver_pools(int max_pools);
+
   ThreadSystem* thread_system() { return thread_system_; }
   UsageDataReporter* usage_data_reporter() { return usage_data_reporter_; }
 
@@ -768,6 +782,7 @@ class ServerContext {
   bool enable_property_cache_;
 
   NamedLockManager* lock_manager_;
+  InflightFetchTable* inflight_fetch_table_;
   MessageHandler* message_handler_;
 
   const PropertyCache::Cohort* dom_cohort_;
@@ -785,6 +800,10 @@ class ServerContext {
   // Other RewriteDriverPool's whose lifetime we help manage for our subclasses.
   std::vector<RewriteDriverPool*> additional_driver_pools_;
 
+  // Released RewriteDrivers with custom options, keyed by their options.
+  // Protected by rewrite_drivers_mutex_.
+  scoped_ptr<CustomRewriteDriverPools> custom_driver_pools_;
+
   // RewriteDrivers that are currently in use.  This is retained
   // as a sanity check to make sure our system is coherent,
   // and to facilitate complete cleanup if a Shutdown occurs
@@ -50,6 +50,9 @@ class SuppressPreheadFilter : public HtmlWriterFilter {
 
   virtual void EndDocument();
 
+  // Unlike HtmlWriterFilter, this inserts nodes.
+  virtual bool IsStreamingSafe() const { return false; }
+
  protected:
   virtual void Clear();
   RewriteDriver* driver() const { return driver_; }
@@ -284,6 +284,11 @@ class RewriteContext::OutputCacheCallback : public CacheInterface::Callback {
       // if we are using stale contents.
       cache_result_->useable_cache_content = true;
       cache_result_->is_stale_rewrite = stale_rewrite;
+      if (rewrite_context_->Options()->html_output_cache_ttl_ms() > 0) {
+        cache_result_->metadata_hash =
+            rewrite_context_->FindServerContext()->hasher()->Hash(
+                value()->Value());
+      }
     }
     // We return cache_result_->cache_ok.  This means for the last call to
     // ValidateCandidate we might return false when we might actually end up
@@ -1201,11 +1206,20 @@ class RewriteContext::InvokeRewriteFunction : public Function {
   virtual ~InvokeRewriteFunction() {}
 
   virtual void Run() {
-    context_->FindServerContext()->rewrite_stats()->num_rewrites_executed()
-        ->IncBy(1);
+    ServerContext* server_context = context_->FindServerContext();
+    RewriteStats* stats = server_context->rewrite_stats();
+    stats->num_rewrites_executed()->IncBy(1);
+
+    // Once the rewrite is done the context may be deleted at any time, even
+    // before Rewrite returns, so hold onto what we need to account for it.
+    GoogleString id(context_->id());
+    Timer* timer = server_context->timer();
+    int64 start_us = timer->NowUs();
     context_->Rewrite(partition_,
                       context_->partitions_->mutable_partition(partition_),
                       output_);
+    stats->AddFilterCost(id, RewriteStats::kRewritePhase,
+                         timer->NowUs() - start_us);
   }
 
   virtual void Cancel() {
@@ -1582,6 +1596,9 @@ void RewriteContext::OutputCacheDone(CacheLookupResult* cache_result) {
   scoped_ptr<CacheLookupResult> owned_cache_result(cache_result);
 
   partitions_.reset(owned_cache_result->partitions.release());
+  if (owned_cache_result->cache_ok) {
+    partition_hash_.swap(owned_cache_result->metadata_hash);
+  }
   LogMetadataCacheInfo(owned_cache_result->cache_ok,
                        owned_cache_result->can_revalidate);
 
@@ -1896,6 +1913,7 @@ void RewriteContext::RepeatedSuccess(const RewriteContext* primary) {
     MarkTooBusy();
   }
   partitions_->CopyFrom(*primary->partitions_);
+  partition_hash_ = primary->partition_hash_;
   for (int i = 0, n = primary->num_outputs(); i < n; ++i) {
     outputs_.push_back(primary->outputs_[i]);
     if ((outputs_[i].get() != NULL) && !outputs_[i]->loaded()) {
@@ -2164,6 +2182,9 @@ void RewriteContext::WritePartition() {
         StringOutputStream sstream(&buf);  // finalizes buf in destructor
         partitions_->SerializeToZeroCopyStream(&sstream);
       }
+      if (Options()->html_output_cache_ttl_ms() > 0) {
+        partition_hash_ = server_context->hasher()->Hash(buf);
+      }
       metadata_cache->PutSwappingString(partition_key_, &buf);
     }
   } else {
@@ -2374,7 +2395,9 @@ void RewriteContext::Propagate(bool render_slots) {
       if (was_too_busy_) {
         WillNotRender();
       } else {
+        int64 start_us = FindServerContext()->timer()->NowUs();
         Render();
+        AddFilterCost(RewriteStats::kRenderPhase, start_us);
       }
     }
     CHECK_EQ(num_output_partitions(), num_outputs());
@@ -2666,7 +2689,17 @@ bool RewriteContext::Partition(OutputPartitions* partitions,
 
 void RewriteContext::PartitionAsync(OutputPartitions* partitions,
                                     OutputResourceVector* outputs) {
-  PartitionDone(Partition(partitions, outputs) ? kRewriteOk : kRewriteFailed);
+  int64 start_us = FindServerContext()->timer()->NowUs();
+  bool ok = Partition(partitions, outputs);
+  AddFilterCost(RewriteStats::kPartitionPhase, start_us);
+  PartitionDone(ok ? kRewriteOk : kRewriteFailed);
+}
+
+void RewriteContext::AddFilterCost(RewriteStats::FilterPhase phase,
+                                   int64 start_us) {
+  ServerContext* server_context = FindServerContext();
+  server_context->rewrite_stats()->AddFilterCost(
+      id(), phase, server_context->timer()->NowUs() - start_us);
 }
 
 void RewriteContext::CrossThreadPartitionDone(RewriteResult result) {
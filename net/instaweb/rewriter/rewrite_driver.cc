@@ -83,6 +83,7 @@
 #include "net/instaweb/rewriter/public/google_analytics_filter.h"
 #include "net/instaweb/rewriter/public/google_font_css_inline_filter.h"
 #include "net/instaweb/rewriter/public/handle_noscript_redirect_filter.h"
+#include "net/instaweb/rewriter/public/html_output_cache.h"
 #include "net/instaweb/rewriter/public/iframe_fetcher.h"
 #include "net/instaweb/rewriter/public/image_combine_filter.h"
 #include "net/instaweb/rewriter/public/image_rewrite_filter.h"
@@ -269,6 +270,7 @@ RewriteDriver::RewriteDriver(MessageHandler* message_handler,
       max_page_processing_delay_ms_(-1),
       num_initiated_rewrites_(0),
       num_detached_rewrites_(0),
+      html_output_dependencies_(NULL),
       possibly_quick_rewrites_(0),
       file_system_(file_system),
       server_context_(NULL),
@@ -453,6 +455,7 @@ void RewriteDriver::Clear() NO_THREAD_SAFETY_ANALYSIS {
   is_nested_ = false;
   num_initiated_rewrites_ = 0;
   num_detached_rewrites_ = 0;
+  html_output_dependencies_ = NULL;
   if (request_context_.get() != NULL) {
     request_context_->WriteBackgroundRewriteLog();
     request_context_.reset(NULL);
@@ -648,20 +651,8 @@ void RewriteDriver::FlushAsync(Function* callback) {
 
   DetermineEnabledFilters();
 
-  for (FilterList::iterator it = early_pre_render_filters_.begin();
-      it != early_pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
-    }
-  }
-  for (FilterList::iterator it = pre_render_filters_.begin();
-      it != pre_render_filters_.end(); ++it) {
-    HtmlFilter* filter = *it;
-    if (filter->is_enabled()) {
-      ApplyFilter(filter);
-    }
-  }
+  ApplyFilters(early_pre_render_filters_);
+  ApplyFilters(pre_render_filters_);
 
   int num_rewrites = rewrites_.size();
 
@@ -796,6 +787,9 @@ void RewriteDriver::FlushAsyncDone(int num_rewrites, Function* callback) {
       rewrite_context->WillNotRender();
       detached_rewrites_.insert(rewrite_context);
       ++num_detached_rewrites_;
+      if (html_output_dependencies_ != NULL) {
+        html_output_dependencies_->MarkIncomplete();
+      }
       ref_counts_.AddRefMutexHeld(kRefDetachedRewrites);
       ref_counts_.ReleaseRefMutexHeld(kRefPendingRewrites);
     }
@@ -862,6 +856,7 @@ void RewriteDriver::InitStats(Statistics* statistics) {
   DomainRewriteFilter::InitStats(statistics);
   GoogleAnalyticsFilter::InitStats(statistics);
   GoogleFontCssInlineFilter::InitStats(statistics);
+  HtmlOutputCache::InitStats(statistics);
   ImageCombineFilter::InitStats(statistics);
   ImageRewriteFilter::InitStats(statistics);
   InPlaceRewriteContext::InitStats(statistics);
@@ -2372,6 +2367,7 @@ bool RewriteDriver::StartParseId(const StringPiece& url, const StringPiece& id,
   }
   start_time_ms_ = server_context_->timer()->NowMs();
   set_log_rewrite_timing(options()->log_rewrite_timing());
+  set_time_filters(server_context_->rewrite_stats() != NULL);
 
   if (debug_filter_ != NULL) {
     debug_filter_->InitParse();
@@ -2496,6 +2492,17 @@ void RewriteDriver::RewriteComplete(RewriteContext* rewrite_context,
     // release_driver_ should be false since we moved a count between
     // categories, and didn't change the total.
     DCHECK(!release_driver_) << ref_counts_.DebugStringMutexHeld();
+    if (attached && (html_output_dependencies_ != NULL)) {
+      // A page can only be replayed from the HTML output cache if every
+      // rewrite in it rendered a result that is in the metadata cache.
+      if (!permit_render || rewrite_context->was_too_busy_ ||
+          rewrite_context->partition_hash_.empty()) {
+        html_output_dependencies_->MarkIncomplete();
+      } else {
+        html_output_dependencies_->Add(rewrite_context->partition_key_,
+                                       rewrite_context->partition_hash_);
+      }
+    }
     rewrite_context->Propagate(attached && permit_render);
     SignalIfRequired(signal_cookie);
   }
@@ -3583,6 +3590,18 @@ void RewriteDriver::DetermineEnabledFiltersImpl() {
   HtmlParse::DetermineEnabledFiltersImpl();
 }
 
+void RewriteDriver::ReportFilterTime(const FilterVector& filters,
+                                     int64 time_us) {
+  RewriteStats* stats = server_context_->rewrite_stats();
+  if (filters.size() == 1) {
+    stats->AddFilterCost(filters[0]->Name(), RewriteStats::kHtmlPhase,
+                         time_us);
+  } else {
+    RewriteStats::AddFilterCost(stats->fused_filter_cost_histogram(),
+                                time_us);
+  }
+}
+
 void RewriteDriver::ClearRequestProperties() {
   request_properties_.reset(new RequestProperties(
       server_context_->user_agent_matcher()));
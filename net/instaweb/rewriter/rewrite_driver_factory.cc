@@ -23,6 +23,7 @@
 #include "net/instaweb/http/public/http_cache.h"
 #include "net/instaweb/http/public/http_dump_url_async_writer.h"
 #include "net/instaweb/http/public/http_dump_url_fetcher.h"
+#include "net/instaweb/http/public/inflight_fetch_table.h"
 #include "net/instaweb/http/public/request_context.h"
 #include "net/instaweb/http/public/url_async_fetcher.h"
 #include "net/instaweb/rewriter/public/beacon_critical_images_finder.h"
@@ -61,6 +62,7 @@
 #include "pagespeed/kernel/cache/cache_batcher.h"
 #include "pagespeed/kernel/http/user_agent_matcher.h"
 #include "pagespeed/kernel/http/user_agent_normalizer.h"
+#include "pagespeed/kernel/thread/queue_delay_controller.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/scheduler.h"
 #include "pagespeed/kernel/util/file_system_lock_manager.h"
@@ -95,6 +97,9 @@ void RewriteDriverFactory::Init() {
   url_async_fetcher_ = NULL;
   distributed_async_fetcher_ = NULL;
   force_caching_ = false;
+  work_stealing_rewrite_pools_ = false;
+  low_priority_queue_delay_target_ms_ = 0;
+  max_custom_driver_pools_ = 0;
   slurp_read_only_ = false;
   slurp_print_urls_ = false;
   SetStatistics(&null_statistics_);
@@ -443,6 +448,16 @@ NamedLockManager* RewriteDriverFactory::lock_manager() {
   return lock_manager_.get();
 }
 
+InflightFetchTable* RewriteDriverFactory::inflight_fetch_table() {
+  if (inflight_fetch_table_ == NULL) {
+    inflight_fetch_table_.reset(new InflightFetchTable(
+        InflightFetchTable::kDefaultMaxFollowers,
+        InflightFetchTable::kDefaultMaxBufferedBytes,
+        thread_system(), statistics(), message_handler()));
+  }
+  return inflight_fetch_table_.get();
+}
+
 QueuedWorkerPool* RewriteDriverFactory::WorkerPool(WorkerPoolCategory pool) {
   if (worker_pools_[pool] == NULL) {
     StringPiece name;
@@ -465,9 +480,22 @@ QueuedWorkerPool* RewriteDriverFactory::WorkerPool(WorkerPoolCategory pool) {
     worker_pools_[pool] = CreateWorkerPool(pool, name);
     worker_pools_[pool]->set_queue_size_stat(
         rewrite_stats()->thread_queue_depth(pool));
+    worker_pools_[pool]->TrackQueueDelay(
+        timer(), rewrite_stats()->thread_queue_delay_histogram(pool));
+    if (work_stealing_rewrite_pools_ && (pool != kHtmlWorkers)) {
+      worker_pools_[pool]->set_work_stealing(true);
+    }
     if (pool == kLowPriorityRewriteWorkers) {
       worker_pools_[pool]->SetLoadSheddingThreshold(
           LowPriorityLoadSheddingThreshold());
+      if (low_priority_queue_delay_target_ms_ > 0) {
+        // CoDel's recommended interval is 20 times the target: long enough
+        // for a burst of rewrites from one page to drain without shedding.
+        int64 target_us = low_priority_queue_delay_target_ms_ * Timer::kMsUs;
+        worker_pools_[pool]->SetQueueDelayController(new QueueDelayController(
+            target_us, 20 * target_us, thread_system()->NewMutex(),
+            rewrite_stats()->num_rewrites_shed_for_queue_delay()));
+      }
     }
   }
 
@@ -518,6 +546,9 @@ void RewriteDriverFactory::InitServerContext(ServerContext* server_context) {
   if (server_context->lock_manager() == NULL) {
     server_context->set_lock_manager(lock_manager());
   }
+  if (server_context->inflight_fetch_table() == NULL) {
+    server_context->set_inflight_fetch_table(inflight_fetch_table());
+  }
   if (!server_context->has_default_system_fetcher()) {
     server_context->set_default_system_fetcher(ComputeUrlAsyncFetcher());
   }
@@ -530,6 +561,7 @@ void RewriteDriverFactory::InitServerContext(ServerContext* server_context) {
   server_context->set_url_namer(url_namer());
   server_context->SetRewriteOptionsManager(NewRewriteOptionsManager());
   server_context->set_user_agent_matcher(user_agent_matcher());
+  server_context->set_max_custom_driver_pools(max_custom_driver_pools_);
   server_context->set_file_system(file_system());
   server_context->set_filename_prefix(filename_prefix_);
   server_context->set_hasher(hasher());
@@ -772,6 +804,7 @@ void RewriteDriverFactory::AddCreatedDirectory(const GoogleString& dir) {
 
 void RewriteDriverFactory::InitStats(Statistics* statistics) {
   HTTPCache::InitStats(statistics);
+  InflightFetchTable::InitStats(statistics);
   RewriteDriver::InitStats(statistics);
   RewriteStats::InitStats(statistics);
   CacheBatcher::InitStats(statistics);
@@ -19,7 +19,9 @@
 #include "net/instaweb/rewriter/public/rewrite_driver_pool.h"
 
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
 
@@ -43,4 +45,98 @@ void RewriteDriverPool::RecycleDriver(RewriteDriver* driver) {
   driver->Clear();
 }
 
+CustomRewriteDriverPools::CustomRewriteDriverPools() : max_pools_(0) {}
+
+CustomRewriteDriverPools::~CustomRewriteDriverPools() {
+  for (PoolList::iterator p = lru_.begin(); p != lru_.end(); ++p) {
+    DeletePool(*p);
+  }
+}
+
+void CustomRewriteDriverPools::DeletePool(Pool* pool) {
+  STLDeleteElements(&pool->drivers);
+  delete pool;
+}
+
+GoogleString CustomRewriteDriverPools::Key(const RewriteOptions& options) {
+  DCHECK(options.frozen());
+  return StrCat(options.signature(),
+                options.Enabled(RewriteOptions::kDebug) ? "_dbg" : "");
+}
+
+CustomRewriteDriverPools::Pool* CustomRewriteDriverPools::Find(
+    const GoogleString& key) {
+  PoolMap::iterator p = pools_.find(key);
+  if (p == pools_.end()) {
+    return NULL;
+  }
+  PoolList::iterator cell = p->second;
+  if (cell != lru_.begin()) {
+    lru_.splice(lru_.begin(), lru_, cell);
+  }
+  return *cell;
+}
+
+RewriteDriver* CustomRewriteDriverPools::PopDriver(
+    const RewriteOptions& options, int64* construction_us) {
+  if (pools_.empty()) {
+    return NULL;
+  }
+  Pool* pool = Find(Key(options));
+  if (pool == NULL) {
+    return NULL;
+  }
+  while (!pool->drivers.empty()) {
+    RewriteDriver* driver = pool->drivers.back();
+    pool->drivers.pop_back();
+    // As in ServerContext::NewRewriteDriverFromPool, we insist on the
+    // options being equal and not just on matching signatures.
+    if (driver->options()->IsEqual(options)) {
+      *construction_us = pool->construction_us;
+      return driver;
+    }
+    delete driver;
+  }
+  return NULL;
+}
+
+int CustomRewriteDriverPools::AddPool(const RewriteOptions& options,
+                                      int64 construction_us) {
+  int num_evicted = 0;
+  if (max_pools_ <= 0) {
+    return num_evicted;
+  }
+  GoogleString key(Key(options));
+  Pool* pool = Find(key);
+  if (pool != NULL) {
+    pool->construction_us = construction_us;
+    return num_evicted;
+  }
+  while (static_cast<int>(lru_.size()) >= max_pools_) {
+    Pool* evicted = lru_.back();
+    lru_.pop_back();
+    pools_.erase(evicted->key);
+    DeletePool(evicted);
+    ++num_evicted;
+  }
+  lru_.push_front(new Pool(key, construction_us));
+  pools_[key] = lru_.begin();
+  return num_evicted;
+}
+
+bool CustomRewriteDriverPools::RecycleDriver(RewriteDriver* driver) {
+  const RewriteOptions* options = driver->options();
+  if ((max_pools_ <= 0) || (options == NULL) || !options->frozen()) {
+    return false;
+  }
+  PoolMap::iterator p = pools_.find(Key(*options));
+  if (p == pools_.end()) {
+    return false;
+  }
+  Pool* pool = *p->second;
+  pool->drivers.push_back(driver);
+  driver->Clear();
+  return true;
+}
+
 }  // namespace net_instaweb
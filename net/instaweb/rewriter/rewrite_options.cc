@@ -143,6 +143,7 @@ const char RewriteOptions::kForbidAllDisabledFilters[] =
 const char RewriteOptions::kGoogleFontCssInlineMaxBytes[] =
     "GoogleFontCssInlineMaxBytes";
 const char RewriteOptions::kHideRefererUsingMeta[] = "HideRefererUsingMeta";
+const char RewriteOptions::kHtmlOutputCacheTtlMs[] = "HtmlOutputCacheTtlMs";
 const char RewriteOptions::kIdleFlushTimeMs[] = "IdleFlushTimeMs";
 const char RewriteOptions::kImageInlineMaxBytes[] = "ImageInlineMaxBytes";
 const char RewriteOptions::kImageJpegNumProgressiveScans[] =
@@ -279,6 +280,8 @@ const char RewriteOptions::kRewriteRandomDropPercentage[] =
 const char RewriteOptions::kRewriteUncacheableResources[] =
     "RewriteUncacheableResources";
 const char RewriteOptions::kRunningExperiment[] = "RunExperiment";
+const char RewriteOptions::kServeByteRangesFromCache[] =
+    "ServeByteRangesFromCache";
 const char RewriteOptions::kServeGhostClickBusterWithSplitHtml[] =
     "ServeGhostClickBusterWithSplitHtml";
 const char RewriteOptions::kServeSplitHtmlInTwoChunks[] =
@@ -551,6 +554,7 @@ const int64 RewriteOptions::kDefaultFinderPropertiesCacheExpirationTimeMs =
 const int64 RewriteOptions::kDefaultFinderPropertiesCacheRefreshTimeMs =
     (3 * Timer::kHourMs) / 2;
 const int64 RewriteOptions::kDefaultMetadataCacheStalenessThresholdMs = 0;
+const int64 RewriteOptions::kDefaultHtmlOutputCacheTtlMs = 0;
 const char RewriteOptions::kDefaultDownstreamCachePurgeMethod[] = "PURGE";
 const int64
     RewriteOptions::kDefaultDownstreamCacheRewrittenPercentageThreshold = 95;
@@ -729,6 +733,25 @@ const RewriteOptions::Filter kRequiresScriptExecutionFilterSet[] = {
   // in a noscript block and the page will still load / function normally.
 };
 
+// List of filters whose output depends on more than the origin HTML, the
+// options and the user-agent class: on beacon results, cookies or the
+// property cache, or on nonces generated per request.  Pages rewritten by
+// them can't be stored in HtmlOutputCache.
+const RewriteOptions::Filter kRequestDependentFilterSet[] = {
+  RewriteOptions::kAddInstrumentation,
+  RewriteOptions::kCachePartialHtml,
+  RewriteOptions::kDebug,
+  RewriteOptions::kDelayImages,
+  RewriteOptions::kFlushSubresources,
+  RewriteOptions::kLazyloadImages,
+  RewriteOptions::kLocalStorageCache,
+  RewriteOptions::kMobilize,
+  RewriteOptions::kMobilizePrecompute,
+  RewriteOptions::kPrioritizeCriticalCss,
+  RewriteOptions::kResizeToRenderedImageDimensions,
+  RewriteOptions::kSplitHtml,
+};
+
 // List of filters which are essential for mobilizing webpages, i.e., for
 // making webpages designed for desktop computers look good on mobile devices.
 //
@@ -1225,6 +1248,8 @@ RewriteOptions::RewriteOptions(ThreadSystem* thread_system)
                          arraysize(kJsPreserveUrlDisabledFilters));
   CheckFilterSetOrdering(kCssPreserveUrlDisabledFilters,
                          arraysize(kCssPreserveUrlDisabledFilters));
+  CheckFilterSetOrdering(kRequestDependentFilterSet,
+                         arraysize(kRequestDependentFilterSet));
 
   // Ensure that all filters have unique IDs.
   StringSet id_set;
@@ -1630,6 +1655,12 @@ void RewriteOptions::AddProperties() {
       kServeStaleIfFetchError,
       kDirectoryScope,
       NULL, true);  // TODO(jmarantz): write help & doc for mod_pagespeed.
+  AddBaseProperty(
+      false, &RewriteOptions::serve_byte_ranges_from_cache_, "sbrc",
+      kServeByteRangesFromCache,
+      kDirectoryScope,
+      "Answer Range requests for cached responses with just the ranges "
+      "requested", true);
   AddBaseProperty(
       false, &RewriteOptions::proactively_freshen_user_facing_request_, "pfur",
       kProactivelyFreshenUserFacingRequest,
@@ -2152,6 +2183,15 @@ void RewriteOptions::AddProperties() {
       kMetadataCacheStalenessThresholdMs,
       kDirectoryScope,
       NULL, true);  // TODO(jmarantz): write help & doc for mod_pagespeed.
+  AddBaseProperty(
+      kDefaultHtmlOutputCacheTtlMs,
+      &RewriteOptions::html_output_cache_ttl_ms_, "hoct",
+      kHtmlOutputCacheTtlMs,
+      kDirectoryScope,
+      "Time in milliseconds for which fully rewritten HTML is reused for "
+      "byte-identical origin responses.  Only suitable for sites whose "
+      "pages don't carry per-request content such as beacons.  0 disables.",
+      true);
   AddBaseProperty(
       kDefaultDownstreamCachePurgeMethod,
       &RewriteOptions::downstream_cache_purge_method_, "dcpm",
@@ -3683,6 +3723,15 @@ void RewriteOptions::DisableFiltersRequiringScriptExecution() {
   }
 }
 
+bool RewriteOptions::RequestDependentFiltersEnabled() const {
+  for (int i = 0, n = arraysize(kRequestDependentFilterSet); i < n; ++i) {
+    if (Enabled(kRequestDependentFilterSet[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool RewriteOptions::UsePerOriginPropertyCachePage() const {
   return Enabled(kMobilize);
 }
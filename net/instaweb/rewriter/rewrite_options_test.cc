@@ -926,6 +926,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kForbidAllDisabledFilters,
     RewriteOptions::kGoogleFontCssInlineMaxBytes,
     RewriteOptions::kHideRefererUsingMeta,
+    RewriteOptions::kHtmlOutputCacheTtlMs,
     RewriteOptions::kIdleFlushTimeMs,
     RewriteOptions::kImageInlineMaxBytes,
     RewriteOptions::kImageJpegNumProgressiveScans,
@@ -1024,6 +1025,7 @@ TEST_F(RewriteOptionsTest, LookupOptionByNameTest) {
     RewriteOptions::kRewriteRandomDropPercentage,
     RewriteOptions::kRewriteUncacheableResources,
     RewriteOptions::kRunningExperiment,
+    RewriteOptions::kServeByteRangesFromCache,
     RewriteOptions::kServeGhostClickBusterWithSplitHtml,
     RewriteOptions::kServeSplitHtmlInTwoChunks,
     RewriteOptions::kServeStaleIfFetchError,
@@ -2496,6 +2498,21 @@ TEST_F(RewriteOptionsTest, EnabledFiltersRequiringJavaScriptTest) {
   EXPECT_TRUE(bar_fs.empty());
 }
 
+TEST_F(RewriteOptionsTest, RequestDependentFiltersEnabled) {
+  RewriteOptions foo(&thread_system_);
+  foo.ClearFilters();
+  foo.EnableFilter(RewriteOptions::kRewriteCss);
+  foo.EnableFilter(RewriteOptions::kInlineImages);
+  EXPECT_FALSE(foo.RequestDependentFiltersEnabled());
+  foo.EnableFilter(RewriteOptions::kPrioritizeCriticalCss);
+  EXPECT_TRUE(foo.RequestDependentFiltersEnabled());
+
+  RewriteOptions bar(&thread_system_);
+  bar.ClearFilters();
+  bar.EnableFilter(RewriteOptions::kLocalStorageCache);
+  EXPECT_TRUE(bar.RequestDependentFiltersEnabled());
+}
+
 TEST_F(RewriteOptionsTest, FilterLookupMethods) {
   EXPECT_STREQ("Add Head",
                RewriteOptions::FilterName(RewriteOptions::kAddHead));
@@ -18,9 +18,13 @@
 
 #include "net/instaweb/rewriter/public/rewrite_stats.h"
 
+#include <algorithm>
+
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/base/waveform.h"
 
 namespace net_instaweb {
@@ -45,6 +49,8 @@ const char kProactivelyFreshenUserFacingRequest[] =
 const char kFallbackResponsesServedWhileRevalidate[] =
     "num_fallback_responses_served_while_revalidate";
 const char kNumConditionalRefreshes[] = "num_conditional_refreshes";
+const char kByteRangeResponsesServed[] = "byte_range_responses_served";
+const char kByteRangeBytesServed[] = "byte_range_bytes_served";
 
 const char kIproServed[] = "ipro_served";
 const char kIproNotInCache[] = "ipro_not_in_cache";
@@ -56,6 +62,29 @@ const char* kWaveFormCounters[RewriteDriverFactory::kNumWorkerPools] = {
   "low-priority-worked-queue-depth"
 };
 
+// How long tasks wait in each pool before running, in ms.
+const char* kQueueDelayHistograms[RewriteDriverFactory::kNumWorkerPools] = {
+  "HTML Worker Queue Delay (ms)",
+  "Rewrite Worker Queue Delay (ms)",
+  "Low-Priority Rewrite Worker Queue Delay (ms)"
+};
+const double kQueueDelayMaxMs = 10 * Timer::kSecondMs;
+
+// Low-priority rewrites canceled because they waited too long; see
+// RewriteDriverFactory::set_low_priority_queue_delay_target_ms.
+const char kRewritesShedForQueueDelay[] = "num_rewrites_shed_for_queue_delay";
+
+// Recycling of RewriteDrivers with custom options; see
+// ServerContext::set_max_custom_driver_pools.  The time saved is what it
+// took to construct the recycled driver's predecessor.
+const char kCustomRewriteDriverPoolHits[] = "custom_rewrite_driver_pool_hits";
+const char kCustomRewriteDriverPoolMisses[] =
+    "custom_rewrite_driver_pool_misses";
+const char kCustomRewriteDriverPoolEvictions[] =
+    "custom_rewrite_driver_pool_evictions";
+const char kRewriteDriverConstructionUsSaved[] =
+    "rewrite_driver_construction_us_saved";
+
 // Variables for the beacon to increment.  These are currently handled in
 // mod_pagespeed_handler on apache.  The average load time in milliseconds is
 // total_page_load_ms / page_load_count.  Note that these are not updated
@@ -74,6 +103,38 @@ const char kRewriteLatencyHistogram[] = "Rewrite Latency Histogram";
 const char kBackendLatencyHistogram[] =
     "Backend Fetch First Byte Latency Histogram";
 
+const char kOtherFilter[] = "Other";
+const char kFusedFilters[] = "Fused streaming filters";
+
+const char* kFilterPhaseNames[RewriteStats::kNumFilterPhases] = {
+  "html",
+  "partition",
+  "rewrite",
+  "render",
+};
+
+// A document's HTML filtering should take well under 10ms per filter, and a
+// rewrite's steps under a second; the outliers beyond that are lumped into
+// the top bucket.
+const double kHtmlFilterCostMaxUs = 10 * Timer::kMsUs;
+const double kRewriteFilterCostMaxUs = Timer::kSecondUs;
+const int kFilterCostNumBuckets = 100;
+
+GoogleString FilterCostHistogramName(StringPiece filter,
+                                     RewriteStats::FilterPhase phase) {
+  return StrCat(RewriteStats::kFilterCostHistogramPrefix, filter, " ",
+                kFilterPhaseNames[phase]);
+}
+
+void AddFilterCostHistogram(Statistics* statistics, StringPiece filter,
+                            RewriteStats::FilterPhase phase) {
+  Histogram* histogram =
+      statistics->AddHistogram(FilterCostHistogramName(filter, phase));
+  histogram->SetSuggestedNumBuckets(kFilterCostNumBuckets);
+  histogram->SetMaxValue(phase == RewriteStats::kHtmlPhase
+                         ? kHtmlFilterCostMaxUs : kRewriteFilterCostMaxUs);
+}
+
 // TimedVariable names.
 const char kTotalFetchCount[] = "total_fetch_count";
 const char kTotalRewriteCount[] = "total_rewrite_count";
@@ -103,6 +164,8 @@ const char RewriteStats::kDownstreamCachePurgeAttempts[] =
 const char RewriteStats::kSuccessfulDownstreamCachePurges[] =
     "successful_downstream_cache_purges";
 
+const char RewriteStats::kFilterCostHistogramPrefix[] = "Filter cost (us): ";
+
 // In Apache, this is called in the root process to establish shared memory
 // boundaries prior to the primary initialization of RewriteDriverFactories.
 //
@@ -132,6 +195,8 @@ void RewriteStats::InitStats(Statistics* statistics) {
   statistics->AddVariable(kProactivelyFreshenUserFacingRequest);
   statistics->AddVariable(kFallbackResponsesServedWhileRevalidate);
   statistics->AddVariable(kNumConditionalRefreshes);
+  statistics->AddVariable(kByteRangeResponsesServed);
+  statistics->AddVariable(kByteRangeBytesServed);
   statistics->AddVariable(kIproServed);
   statistics->AddVariable(kIproNotInCache);
   statistics->AddVariable(kIproNotRewritable);
@@ -148,8 +213,35 @@ void RewriteStats::InitStats(Statistics* statistics) {
   statistics->AddVariable(kNumResourceFetchSuccesses);
   statistics->AddVariable(kNumResourceFetchFailures);
 
+  statistics->AddVariable(kRewritesShedForQueueDelay);
+  statistics->AddVariable(kCustomRewriteDriverPoolHits);
+  statistics->AddVariable(kCustomRewriteDriverPoolMisses);
+  statistics->AddVariable(kCustomRewriteDriverPoolEvictions);
+  statistics->AddVariable(kRewriteDriverConstructionUsSaved);
+
   for (int i = 0; i < RewriteDriverFactory::kNumWorkerPools; ++i) {
     statistics->AddUpDownCounter(kWaveFormCounters[i]);
+    statistics->AddHistogram(kQueueDelayHistograms[i])->SetMaxValue(
+        kQueueDelayMaxMs);
+  }
+
+  for (int p = 0; p < kNumFilterPhases; ++p) {
+    AddFilterCostHistogram(statistics, kOtherFilter,
+                           static_cast<FilterPhase>(p));
+  }
+  AddFilterCostHistogram(statistics, kFusedFilters, kHtmlPhase);
+}
+
+void RewriteStats::InitHtmlFilterCostStats(Statistics* statistics,
+                                           StringPiece filter_name) {
+  AddFilterCostHistogram(statistics, filter_name, kHtmlPhase);
+}
+
+void RewriteStats::InitRewriteFilterCostStats(Statistics* statistics,
+                                              StringPiece filter_id) {
+  for (int p = kPartitionPhase; p < kNumFilterPhases; ++p) {
+    AddFilterCostHistogram(statistics, filter_id,
+                           static_cast<FilterPhase>(p));
   }
 }
 
@@ -199,6 +291,9 @@ RewriteStats::RewriteStats(Statistics* stats,
           stats->GetVariable(kFallbackResponsesServedWhileRevalidate)),
       num_conditional_refreshes_(
           stats->GetVariable(kNumConditionalRefreshes)),
+      byte_range_responses_served_(
+          stats->GetVariable(kByteRangeResponsesServed)),
+      byte_range_bytes_served_(stats->GetVariable(kByteRangeBytesServed)),
       ipro_served_(stats->GetVariable(kIproServed)),
       ipro_not_in_cache_(stats->GetVariable(kIproNotInCache)),
       ipro_not_rewritable_(stats->GetVariable(kIproNotRewritable)),
@@ -217,7 +312,20 @@ RewriteStats::RewriteStats(Statistics* stats,
       total_fetch_count_(stats->GetTimedVariable(kTotalFetchCount)),
       total_rewrite_count_(stats->GetTimedVariable(kTotalRewriteCount)),
       num_rewrites_executed_(stats->GetTimedVariable(kRewritesExecuted)),
-      num_rewrites_dropped_(stats->GetTimedVariable(kRewritesDropped)) {
+      num_rewrites_dropped_(stats->GetTimedVariable(kRewritesDropped)),
+      num_rewrites_shed_for_queue_delay_(
+          stats->GetVariable(kRewritesShedForQueueDelay)),
+      custom_rewrite_driver_pool_hits_(
+          stats->GetVariable(kCustomRewriteDriverPoolHits)),
+      custom_rewrite_driver_pool_misses_(
+          stats->GetVariable(kCustomRewriteDriverPoolMisses)),
+      custom_rewrite_driver_pool_evictions_(
+          stats->GetVariable(kCustomRewriteDriverPoolEvictions)),
+      rewrite_driver_construction_us_saved_(
+          stats->GetVariable(kRewriteDriverConstructionUsSaved)),
+      statistics_(stats),
+      fused_filter_cost_histogram_(stats->GetHistogram(
+          FilterCostHistogramName(kFusedFilters, kHtmlPhase))) {
   // Timers are not guaranteed to go forward in time, however
   // Histograms will CHECK-fail given a negative value unless
   // EnableNegativeBuckets is called, allowing bars to be created with
@@ -232,6 +340,13 @@ RewriteStats::RewriteStats(Statistics* stats,
     thread_queue_depths_.push_back(
         new Waveform(thread_system, timer, kNumWaveformSamples,
                      stats->GetUpDownCounter(kWaveFormCounters[i])));
+    thread_queue_delay_histograms_.push_back(
+        stats->GetHistogram(kQueueDelayHistograms[i]));
+  }
+
+  for (int p = 0; p < kNumFilterPhases; ++p) {
+    other_filter_cost_histograms_[p] = stats->GetHistogram(
+        FilterCostHistogramName(kOtherFilter, static_cast<FilterPhase>(p)));
   }
 }
 
@@ -239,4 +354,21 @@ RewriteStats::~RewriteStats() {
   STLDeleteElements(&thread_queue_depths_);
 }
 
+Histogram* RewriteStats::FilterCostHistogram(StringPiece filter,
+                                             FilterPhase phase) {
+  Histogram* histogram =
+      statistics_->FindHistogram(FilterCostHistogramName(filter, phase));
+  return (histogram == NULL) ? other_filter_cost_histograms_[phase]
+                             : histogram;
+}
+
+void RewriteStats::AddFilterCost(StringPiece filter, FilterPhase phase,
+                                 int64 cost_us) {
+  AddFilterCost(FilterCostHistogram(filter, phase), cost_us);
+}
+
+void RewriteStats::AddFilterCost(Histogram* histogram, int64 cost_us) {
+  histogram->Add(std::max(static_cast<int64>(0), cost_us));
+}
+
 }  // namespace net_instaweb
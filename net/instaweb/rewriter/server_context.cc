@@ -286,12 +286,14 @@ ServerContext::ServerContext(RewriteDriverFactory* factory)
       response_headers_finalized_(true),
       enable_property_cache_(true),
       lock_manager_(NULL),
+      inflight_fetch_table_(NULL),
       message_handler_(NULL),
       dom_cohort_(NULL),
       blink_cohort_(NULL),
       beacon_cohort_(NULL),
       fix_reflow_cohort_(NULL),
       available_rewrite_drivers_(new GlobalOptionsRewriteDriverPool(this)),
+      custom_driver_pools_(new CustomRewriteDriverPools),
       trying_to_cleanup_rewrite_drivers_(false),
       shutdown_drivers_called_(false),
       factory_(factory),
@@ -350,6 +352,7 @@ ServerContext::~ServerContext() {
   }
   STLDeleteElements(&active_rewrite_drivers_);
   available_rewrite_drivers_.reset();
+  custom_driver_pools_.reset();
   STLDeleteElements(&additional_driver_pools_);
 }
 
@@ -729,6 +732,39 @@ bool ServerContext::HandleBeacon(StringPiece params,
 
 RewriteDriver* ServerContext::NewCustomRewriteDriver(
     RewriteOptions* options, const RequestContextPtr& request_ctx) {
+  bool recycling;
+  {
+    ScopedMutex lock(rewrite_drivers_mutex_.get());
+    recycling = (custom_driver_pools_->max_pools() > 0);
+  }
+  if (recycling) {
+    // AddFilters would compute the signature anyway, but we need it first
+    // to look for a recycled driver.
+    ComputeSignature(options);
+    RewriteDriver* rewrite_driver = NULL;
+    int64 construction_us = 0;
+    {
+      ScopedMutex lock(rewrite_drivers_mutex_.get());
+      rewrite_driver = custom_driver_pools_->PopDriver(*options,
+                                                       &construction_us);
+    }
+    if (rewrite_driver != NULL) {
+      delete options;
+      rewrite_driver->AddUserReference();
+      rewrite_driver->set_request_context(request_ctx);
+      ApplySessionFetchers(request_ctx, rewrite_driver);
+      {
+        ScopedMutex lock(rewrite_drivers_mutex_.get());
+        active_rewrite_drivers_.insert(rewrite_driver);
+      }
+      rewrite_stats_->custom_rewrite_driver_pool_hits()->Add(1);
+      rewrite_stats_->rewrite_driver_construction_us_saved()->Add(
+          construction_us);
+      return rewrite_driver;
+    }
+  }
+
+  int64 start_us = recycling ? timer_->NowUs() : 0;
   RewriteDriver* rewrite_driver = NewUnmanagedRewriteDriver(
       NULL /* no pool as custom*/,
       options,
@@ -744,9 +780,25 @@ RewriteDriver* ServerContext::NewCustomRewriteDriver(
   if (factory_ != NULL) {
     factory_->AddPlatformSpecificRewritePasses(rewrite_driver);
   }
+  if (recycling) {
+    int64 construction_us = timer_->NowUs() - start_us;
+    int num_evicted;
+    {
+      ScopedMutex lock(rewrite_drivers_mutex_.get());
+      num_evicted = custom_driver_pools_->AddPool(*rewrite_driver->options(),
+                                                  construction_us);
+    }
+    rewrite_stats_->custom_rewrite_driver_pool_misses()->Add(1);
+    rewrite_stats_->custom_rewrite_driver_pool_evictions()->Add(num_evicted);
+  }
   return rewrite_driver;
 }
 
+void ServerContext::set_max_custom_driver_pools(int max_pools) {
+  ScopedMutex lock(rewrite_drivers_mutex_.get());
+  custom_driver_pools_->set_max_pools(max_pools);
+}
+
 RewriteDriver* ServerContext::NewUnmanagedRewriteDriver(
     RewriteDriverPool* pool, RewriteOptions* options,
     const RequestContextPtr& request_ctx) {
@@ -841,7 +893,9 @@ void ServerContext::ReleaseRewriteDriverImpl(RewriteDriver* rewrite_driver) {
   } else {
     RewriteDriverPool* pool = rewrite_driver->controlling_pool();
     if (pool == NULL) {
-      delete rewrite_driver;
+      if (!custom_driver_pools_->RecycleDriver(rewrite_driver)) {
+        delete rewrite_driver;
+      }
     } else {
       pool->RecycleDriver(rewrite_driver);
     }
@@ -1504,6 +1558,12 @@ CacheUrlAsyncFetcher* ServerContext::CreateCustomCacheFetcher(
       stats->num_proactively_freshen_user_facing_request());
   cache_fetcher->set_serve_stale_while_revalidate_threshold_sec(
       options->serve_stale_while_revalidate_threshold_sec());
+  cache_fetcher->set_serve_byte_ranges(
+      options->serve_byte_ranges_from_cache());
+  cache_fetcher->set_byte_range_responses_served(
+      stats->byte_range_responses_served());
+  cache_fetcher->set_byte_range_bytes_served(
+      stats->byte_range_bytes_served());
   return cache_fetcher;
 }
 
@@ -760,6 +760,82 @@ TEST_F(ServerContextTest, TestPlatformSpecificConfiguration) {
   custom_driver->Cleanup();
 }
 
+class CustomDriverRecyclingTest : public ServerContextTest {
+ protected:
+  RewriteDriver* NewDriver(RewriteOptions::Filter filter, bool debug) {
+    RewriteOptions* options = new RewriteOptions(factory()->thread_system());
+    options->EnableFilter(filter);
+    if (debug) {
+      options->EnableFilter(RewriteOptions::kDebug);
+    }
+    return server_context()->NewCustomRewriteDriver(
+        options, RequestContext::NewTestRequestContext(
+            server_context()->thread_system()));
+  }
+
+  int64 Stat(const char* name) {
+    return statistics()->GetVariable(name)->Get();
+  }
+};
+
+TEST_F(CustomDriverRecyclingTest, RecyclesEqualOptions) {
+  server_context()->set_max_custom_driver_pools(2);
+  RewriteDriver* driver = NewDriver(RewriteOptions::kRewriteCss, false);
+  EXPECT_TRUE(driver->options()->Enabled(RewriteOptions::kRewriteCss));
+  driver->Cleanup();
+  EXPECT_EQ(driver, NewDriver(RewriteOptions::kRewriteCss, false));
+
+  // Options differing only in kDebug, which is left out of the signature,
+  // need a driver of their own.
+  RewriteDriver* debug_driver = NewDriver(RewriteOptions::kRewriteCss, true);
+  EXPECT_NE(driver, debug_driver);
+  EXPECT_TRUE(debug_driver->options()->Enabled(RewriteOptions::kDebug));
+  driver->Cleanup();
+  debug_driver->Cleanup();
+
+  EXPECT_EQ(1, Stat("custom_rewrite_driver_pool_hits"));
+  EXPECT_EQ(2, Stat("custom_rewrite_driver_pool_misses"));
+  EXPECT_EQ(0, Stat("custom_rewrite_driver_pool_evictions"));
+  EXPECT_LE(0, Stat("rewrite_driver_construction_us_saved"));
+}
+
+TEST_F(CustomDriverRecyclingTest, EvictsLeastRecentlyUsed) {
+  server_context()->set_max_custom_driver_pools(2);
+  RewriteDriver* css_driver = NewDriver(RewriteOptions::kRewriteCss, false);
+  css_driver->Cleanup();
+  RewriteDriver* js_driver =
+      NewDriver(RewriteOptions::kRewriteJavascriptExternal, false);
+  js_driver->Cleanup();
+
+  // Freshen the CSS options, so that the JS ones are evicted to make room
+  // for a third set of options.
+  EXPECT_EQ(css_driver, NewDriver(RewriteOptions::kRewriteCss, false));
+  css_driver->Cleanup();
+  RewriteDriver* image_driver = NewDriver(RewriteOptions::kRecompressPng,
+                                          false);
+  image_driver->Cleanup();
+  EXPECT_EQ(1, Stat("custom_rewrite_driver_pool_evictions"));
+  EXPECT_EQ(css_driver, NewDriver(RewriteOptions::kRewriteCss, false));
+  css_driver->Cleanup();
+  EXPECT_EQ(image_driver, NewDriver(RewriteOptions::kRecompressPng, false));
+  image_driver->Cleanup();
+
+  js_driver = NewDriver(RewriteOptions::kRewriteJavascriptExternal, false);
+  js_driver->Cleanup();
+  EXPECT_EQ(3, Stat("custom_rewrite_driver_pool_hits"));
+  EXPECT_EQ(4, Stat("custom_rewrite_driver_pool_misses"));
+  EXPECT_EQ(2, Stat("custom_rewrite_driver_pool_evictions"));
+}
+
+TEST_F(CustomDriverRecyclingTest, DisabledByDefault) {
+  RewriteDriver* driver = NewDriver(RewriteOptions::kRewriteCss, false);
+  driver->Cleanup();
+  driver = NewDriver(RewriteOptions::kRewriteCss, false);
+  driver->Cleanup();
+  EXPECT_EQ(0, Stat("custom_rewrite_driver_pool_hits"));
+  EXPECT_EQ(0, Stat("custom_rewrite_driver_pool_misses"));
+}
+
 // Tests that platform-specific rewriters are used for decoding fetches.
 TEST_F(ServerContextTest, TestPlatformSpecificRewritersDecoding) {
   GoogleString url = Encode("http://example.com/dir/123/",
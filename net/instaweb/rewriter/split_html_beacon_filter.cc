@@ -30,6 +30,7 @@
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/static_asset_manager.h"
 #include "pagespeed/kernel/base/escaping.h"
@@ -63,6 +64,7 @@ void SplitHtmlBeaconFilter::DetermineEnabled(GoogleString* disabled_reason) {
 
 void SplitHtmlBeaconFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kSplitHtmlBeaconAddedCount);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "SplitHtmlBeacon");
 }
 
 bool SplitHtmlBeaconFilter::ShouldApply(RewriteDriver* driver) {
@@ -24,6 +24,7 @@
 #include "base/logging.h"
 #include "net/instaweb/rewriter/public/resource_tag_scanner.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -53,6 +54,7 @@ UrlLeftTrimFilter::~UrlLeftTrimFilter() {}
 void UrlLeftTrimFilter::InitStats(Statistics* statistics) {
   statistics->AddVariable(kUrlTrims);
   statistics->AddVariable(kUrlTrimSavedBytes);
+  RewriteStats::InitHtmlFilterCostStats(statistics, "UrlLeftTrim");
 }
 
 // Do not rewrite the base tag.
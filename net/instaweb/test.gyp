@@ -85,6 +85,7 @@
         'http/http_response_parser_test.cc',
         'http/http_value_test.cc',
         'http/inflating_fetch_test.cc',
+        'http/inflight_fetch_table_test.cc',
         'http/mock_url_fetcher_test.cc',
         'http/rate_controlling_url_async_fetcher_test.cc',
         'http/reflecting_test_fetcher_test.cc',
@@ -159,6 +160,7 @@
         'rewriter/google_font_css_inline_filter_test.cc',
         'rewriter/google_font_service_input_resource_test.cc',
         'rewriter/handle_noscript_redirect_filter_test.cc',
+        'rewriter/html_output_cache_test.cc',
         'rewriter/image_combine_filter_test.cc',
         'rewriter/image_endian_test.cc',
         'rewriter/image_rewrite_filter_test.cc',
@@ -243,6 +245,7 @@
         '<(DEPTH)/pagespeed/kernel/base/countdown_timer_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/escaping_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/fast_wildcard_group_test.cc',
+        '<(DEPTH)/pagespeed/kernel/base/free_list_allocator_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/function_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/hasher_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/hostname_util_test.cc',
@@ -271,30 +274,38 @@
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group.cc',
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/wildcard_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/admission_filtered_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/async_cache_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/async_file_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/cache_batcher_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/cache_codec_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/cache_stats_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/compressed_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/delay_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/fallback_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/file_cache_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/file_cache_index_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/key_value_codec_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/lru_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/mock_time_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/purge_context_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/purge_set_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/sharded_lru_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/threadsafe_cache_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/tiny_lfu_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/write_through_cache_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/canonical_attributes_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/collapse_whitespace_filter_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/doctype_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/elide_attributes_filter_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_attribute_quote_removal_test.cc',
+        '<(DEPTH)/pagespeed/kernel/html/html_byte_scanner_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_keywords_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_name_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/remove_comments_filter_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/bot_checker_test.cc',
+        '<(DEPTH)/pagespeed/kernel/http/byte_range_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/caching_headers_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/content_type_test.cc',
         '<(DEPTH)/pagespeed/kernel/http/data_url_test.cc',
@@ -329,6 +340,7 @@
         '<(DEPTH)/pagespeed/kernel/thread/pthread_condvar_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/pthread_thread_system_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/queued_alarm_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/queue_delay_controller_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/queued_worker_pool_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/queued_worker_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/scheduler_based_abstract_lock_test.cc',
@@ -336,6 +348,7 @@
         '<(DEPTH)/pagespeed/kernel/thread/scheduler_thread_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/slow_worker_test.cc',
         '<(DEPTH)/pagespeed/kernel/thread/thread_synchronizer_test.cc',
+        '<(DEPTH)/pagespeed/kernel/util/async_file_io_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/categorized_refcount_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/copy_on_write_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/file_system_lock_manager_test.cc',
@@ -488,6 +501,7 @@
         '<(DEPTH)/third_party/css_parser/src',
       ],
       'sources': [
+        'http/http_value_writer_speed_test.cc',
         'rewriter/css_minify_speed_test.cc',
         'rewriter/domain_lawyer_speed_test.cc',
         'rewriter/image_speed_test.cc',
@@ -496,9 +510,13 @@
         '<(DEPTH)/pagespeed/kernel/base/fast_wildcard_group_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/string_multi_map_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/base/wildcard_group.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/async_file_cache_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/compressed_cache_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/cache/lru_cache_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/cache/multi_get_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/html/html_parse_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/queued_worker_pool_speed_test.cc',
+        '<(DEPTH)/pagespeed/kernel/thread/scheduler_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/deque_speed_test.cc',
         '<(DEPTH)/pagespeed/kernel/util/url_escaper_speed_test.cc',
       ],
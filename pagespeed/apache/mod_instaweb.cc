@@ -173,6 +173,12 @@ const char kModPagespeedUrlPrefix[] = "ModPagespeedUrlPrefix";
 const char kModPagespeedUrlValuedAttribute[] = "ModPagespeedUrlValuedAttribute";
 const char kModPagespeedUsePerVHostStatistics[] =
     "ModPagespeedUsePerVHostStatistics";
+const char kModPagespeedWorkStealingRewriteThreads[] =
+    "ModPagespeedWorkStealingRewriteThreads";
+const char kModPagespeedExpensiveRewriteQueueDelayTargetMs[] =
+    "ModPagespeedExpensiveRewriteQueueDelayTargetMs";
+const char kModPagespeedMaxCustomRewriteDriverPools[] =
+    "ModPagespeedMaxCustomRewriteDriverPools";
 
 // The following are deprecated due to spelling
 const char kModPagespeedImgInlineMaxBytes[] = "ModPagespeedImgInlineMaxBytes";
@@ -1712,6 +1718,15 @@ static const command_rec mod_pagespeed_filter_cmds[] = {
   APACHE_CONFIG_OPTION(kModPagespeedUrlPrefix, "No longer used."),
   APACHE_CONFIG_OPTION(kModPagespeedUsePerVHostStatistics,
         "If true, keep track of statistics per VHost and not just globally"),
+  APACHE_CONFIG_OPTION(kModPagespeedWorkStealingRewriteThreads,
+        "If true, rewrite threads take work from one another's queues "
+        "rather than sharing one queue"),
+  APACHE_CONFIG_OPTION(kModPagespeedExpensiveRewriteQueueDelayTargetMs,
+        "Cancel expensive rewrites while they persistently wait longer than "
+        "this many ms to run"),
+  APACHE_CONFIG_OPTION(kModPagespeedMaxCustomRewriteDriverPools,
+        "Number of distinct custom option-sets, e.g. from .htaccess files, "
+        "whose rewrite drivers are kept for reuse"),
   APACHE_CONFIG_OPTION(kModPagespeedBlockingRewriteRefererUrls,
                        "wildcard_spec for referer urls which trigger blocking "
                        "rewrites"),
@@ -1050,7 +1050,9 @@ for admin_path in pagespeed_admin pagespeed_global_admin alt/admin/path; do
   check_admin_banner $admin_path/config "Configuration"
   check_admin_banner $admin_path/spdy_config "SPDY Configuration"
   check_admin_banner $admin_path/histograms "Histograms"
+  check_admin_banner $admin_path/filter_costs "Filter Costs"
   check_admin_banner $admin_path/cache "Caches"
+  check_admin_banner $admin_path/fetch_limits "Fetch Limits"
   check_admin_banner $admin_path/console "Console"
   check_admin_banner $admin_path/message_history "Message History"
 done
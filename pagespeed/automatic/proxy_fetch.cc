@@ -43,7 +43,9 @@
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/ref_counted_ptr.h"
 #include "pagespeed/kernel/base/request_trace.h"
+#include "pagespeed/kernel/base/split_writer.h"
 #include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -516,7 +518,10 @@ ProxyFetch::ProxyFetch(
       waiting_for_flush_to_finish_(false),
       idle_alarm_(NULL),
       factory_(factory),
-      distributed_fetch_(false) {
+      distributed_fetch_(false),
+      html_output_cache_state_(kHtmlOutputCacheOff),
+      html_output_cache_ttl_ms_(0),
+      html_output_cache_input_bytes_(0) {
   driver_->SetWriter(async_fetch);
   set_request_headers(async_fetch->request_headers());
   set_response_headers(async_fetch->response_headers());
@@ -589,7 +594,13 @@ bool ProxyFetch::StartParse() {
     ScopedMutex lock(mutex_.get());
     sequence_ = driver_->html_worker();
   }
+  if (html_output_cache_state_ == kHtmlOutputCacheHolding) {
+    return true;
+  }
+  return StartDriverParse();
+}
 
+bool ProxyFetch::StartDriverParse() {
   // Start parsing.
   // TODO(sligocki): Allow calling StartParse with GoogleUrl.
   if (!driver_->StartParse(url_)) {
@@ -711,6 +722,22 @@ void ProxyFetch::SetupForHtml() {
   if (options->enabled() && options->IsAllowed(url_) && !distributed_fetch_) {
     // Note that we guard with distributed_fetch_ to avoid parsing HTML on a
     // distributed task, that's left to the ingress task to do.
+    if ((options->html_output_cache_ttl_ms() > 0) &&
+        (response_headers()->status_code() == HttpStatus::kOK) &&
+        GoogleUrl(url_).IsAnyValid()) {
+      html_output_cache_.reset(new HtmlOutputCache(server_context_));
+      if (options->RequestDependentFiltersEnabled() ||
+          driver_->is_critical_images_beacon_enabled()) {
+        // The output is not a function of the key, so it must not be
+        // shared between requests.
+        html_output_cache_->RecordBypass(
+            HtmlOutputCache::kBypassRequestDependentFilters);
+        html_output_cache_.reset();
+      } else {
+        html_output_cache_ttl_ms_ = options->html_output_cache_ttl_ms();
+        html_output_cache_state_ = kHtmlOutputCacheHolding;
+      }
+    }
     started_parse_ = StartParse();
     if (started_parse_) {
       // TODO(sligocki): Get these in the main flow.
@@ -852,6 +879,13 @@ void ProxyFetch::ScheduleQueueExecutionIfNeeded() {
     return;
   }
 
+  // While holding back HTML for the HTML output cache, there is nothing to
+  // do until all of it has arrived.
+  if ((html_output_cache_state_ == kHtmlOutputCacheHolding) &&
+      !done_outstanding_) {
+    return;
+  }
+
   queue_run_job_created_ = true;
   sequence_->Add(MakeFunction(this, &ProxyFetch::ExecuteQueued));
 }
@@ -953,6 +987,16 @@ bool ProxyFetch::HandleWrite(const StringPiece& str,
     {
       ScopedMutex lock(mutex_.get());
       text_queue_.insert(text_queue_.end(), chunks.begin(), chunks.end());
+      if (html_output_cache_state_ == kHtmlOutputCacheHolding) {
+        // Stop holding back HTML that would be too large to cache, and
+        // just rewrite it as it streams in.
+        html_output_cache_input_bytes_ += str.size();
+        int64 max_bytes = Options()->max_cacheable_response_content_length();
+        if ((max_bytes >= 0) && (html_output_cache_input_bytes_ > max_bytes)) {
+          html_output_cache_->RecordBypass(HtmlOutputCache::kBypassTooLarge);
+          html_output_cache_state_ = kHtmlOutputCacheReleased;
+        }
+      }
       ScheduleQueueExecutionIfNeeded();
     }
   } else {
@@ -1045,6 +1089,10 @@ void ProxyFetch::FlushDone() {
 }
 
 void ProxyFetch::ExecuteQueued() {
+  if ((html_output_cache_.get() != NULL) && StartHtmlOutputCacheLookup()) {
+    return;
+  }
+
   bool do_flush = false;
   bool do_finish = false;
   bool done_result = false;
@@ -1197,10 +1245,115 @@ void ProxyFetch::Finish(bool success) {
 
 void ProxyFetch::CompleteFinishParse(bool success) {
   driver_ = NULL;
+  if (html_output_cache_state_ == kHtmlOutputCacheCapturing) {
+    InsertInHtmlOutputCache(success);
+  }
   // Have to call directly -- sequence is gone with driver.
   Finish(success);
 }
 
+bool ProxyFetch::StartHtmlOutputCacheLookup() {
+  GoogleString input;
+  bool released = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (html_output_cache_state_ == kHtmlOutputCacheReleased) {
+      html_output_cache_state_ = kHtmlOutputCacheOff;
+      released = true;
+    } else if (html_output_cache_state_ == kHtmlOutputCacheHolding) {
+      DCHECK(done_outstanding_);
+      html_output_cache_state_ = kHtmlOutputCacheLookup;
+      for (int i = 0, n = text_queue_.size(); i < n; ++i) {
+        input.append(*text_queue_[i]);
+      }
+      // queue_run_job_created_ stays set until the lookup is handled, so
+      // that nothing else is scheduled in the meantime.
+    } else {
+      return false;
+    }
+  }
+
+  if (released) {
+    // The URL was validated before we started holding, so this is not
+    // expected to fail.
+    StartDriverParse();
+    return false;
+  }
+
+  // The property-cache lookup is complete by now, so the driver knows the
+  // device type for the key.
+  html_output_cache_->SetKey(driver_, url_, input);
+  html_output_cache_->Lookup(
+      driver_, &html_output_cache_html_,
+      NewCallback(this, &ProxyFetch::HtmlOutputCacheLookupDone));
+  return true;
+}
+
+void ProxyFetch::HtmlOutputCacheLookupDone(bool hit) {
+  sequence_->Add(
+      MakeFunction(this, &ProxyFetch::HandleHtmlOutputCacheLookup, hit));
+}
+
+void ProxyFetch::HandleHtmlOutputCacheLookup(bool hit) {
+  if (!hit && StartHtmlOutputCapture()) {
+    ScopedMutex lock(mutex_.get());
+    queue_run_job_created_ = false;
+    ScheduleQueueExecutionIfNeeded();
+    return;
+  }
+
+  // Serve the cached output, or if we failed to start the parse, the
+  // origin HTML, without involving the driver.
+  bool done_result;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (!hit) {
+      html_output_cache_html_.clear();
+      for (int i = 0, n = text_queue_.size(); i < n; ++i) {
+        html_output_cache_html_.append(*text_queue_[i]);
+      }
+    }
+    STLDeleteElements(&text_queue_);
+    queue_run_job_created_ = false;
+    network_flush_outstanding_ = false;
+    done_result = done_result_;
+  }
+  started_parse_ = false;
+  SharedAsyncFetch::HandleWrite(html_output_cache_html_,
+                                factory_->message_handler());
+  Finish(done_result);
+}
+
+bool ProxyFetch::StartHtmlOutputCapture() {
+  html_output_cache_state_ = kHtmlOutputCacheCapturing;
+  html_output_cache_headers_ = response_headers()->ToString();
+  html_output_writer_.reset(new StringWriter(&html_output_cache_html_));
+  html_output_split_writer_.reset(
+      new SplitWriter(driver_->writer(), html_output_writer_.get()));
+  driver_->SetWriter(html_output_split_writer_.get());
+  driver_->set_html_output_dependencies(&html_output_dependencies_);
+  if (!StartDriverParse()) {
+    html_output_cache_state_ = kHtmlOutputCacheOff;
+    return false;
+  }
+  return true;
+}
+
+void ProxyFetch::InsertInHtmlOutputCache(bool success) {
+  if (!success) {
+    return;
+  }
+  if (response_headers()->ToString() != html_output_cache_headers_) {
+    // A filter, e.g. convert_meta_tags, changed the headers; a hit would
+    // only replay the body.
+    html_output_cache_->RecordBypass(HtmlOutputCache::kBypassHeadersChanged);
+  } else {
+    html_output_cache_->Insert(html_output_cache_html_,
+                               html_output_dependencies_,
+                               html_output_cache_ttl_ms_);
+  }
+}
+
 void ProxyFetch::CancelIdleAlarm() {
   if (idle_alarm_ != NULL) {
     idle_alarm_->CancelAlarm();
@@ -29,6 +29,7 @@
 
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/request_context.h"
+#include "net/instaweb/rewriter/public/html_output_cache.h"
 #include "net/instaweb/util/public/fallback_property_page.h"
 #include "net/instaweb/util/public/property_cache.h"
 #include "pagespeed/automatic/html_detector.h"
@@ -55,6 +56,8 @@ class ServerContext;
 class ResponseHeaders;
 class RewriteDriver;
 class RewriteOptions;
+class SplitWriter;
+class StringWriter;
 class Timer;
 
 // Factory for creating and starting ProxyFetches. Must outlive all
@@ -384,9 +387,31 @@ class ProxyFetch : public SharedAsyncFetch {
   void AddPagespeedHeader();
 
   // Sets up driver_, registering the writer and start parsing url.
-  // Returns whether we started parsing successfully or not.
+  // Returns whether we started parsing successfully or not.  If the HTML
+  // output cache is in use, the driver's parse is started only once the
+  // lookup misses.
   bool StartParse();
 
+  // Starts the driver parsing url_.
+  bool StartDriverParse();
+
+  // If all the origin HTML has been held back for the HTML output cache,
+  // looks it up and returns true.  If holding was given up, starts the
+  // deferred parse and returns false.  Run in sequence_.
+  bool StartHtmlOutputCacheLookup();
+
+  // Callback for the HTML output cache lookup, which resumes in sequence_
+  // with HandleHtmlOutputCacheLookup.
+  void HtmlOutputCacheLookupDone(bool hit);
+  void HandleHtmlOutputCacheLookup(bool hit);
+
+  // Starts parsing the held-back HTML, capturing the output for the HTML
+  // output cache.  Returns false if the parse could not be started.
+  bool StartHtmlOutputCapture();
+
+  // Stores the captured output in the HTML output cache, if it is eligible.
+  void InsertInHtmlOutputCache(bool success);
+
   // Start the fetch which includes preparing the request.
   void StartFetch();
 
@@ -514,6 +539,33 @@ class ProxyFetch : public SharedAsyncFetch {
   // Set to true if this proxy_fetch is the result of a distributed fetch.
   bool distributed_fetch_;
 
+  // The HTML output cache is used for 200 HTML responses when
+  // html_output_cache_ttl_ms is set.  The origin HTML is then held back in
+  // text_queue_ until it is complete, and looked up in the cache; on a hit
+  // the cached output is served without parsing, and on a miss the HTML is
+  // parsed as usual, with the output captured to be stored.
+  enum HtmlOutputCacheState {
+    kHtmlOutputCacheOff,
+    kHtmlOutputCacheHolding,    // Holding back origin HTML; guarded by mutex_.
+    kHtmlOutputCacheReleased,   // Gave up holding; parse not yet started.
+    kHtmlOutputCacheLookup,     // Waiting on the lookup.
+    kHtmlOutputCacheCapturing   // Parsing a miss and capturing the output.
+  };
+  HtmlOutputCacheState html_output_cache_state_;
+  scoped_ptr<HtmlOutputCache> html_output_cache_;
+  int64 html_output_cache_ttl_ms_;
+  int64 html_output_cache_input_bytes_;
+
+  // The cached HTML on a hit, or the captured output on a miss.
+  GoogleString html_output_cache_html_;
+
+  // Response headers as they stood when a miss started parsing, to detect
+  // filters that alter them, which the cache does not replay.
+  GoogleString html_output_cache_headers_;
+  HtmlOutputDependencies html_output_dependencies_;
+  scoped_ptr<StringWriter> html_output_writer_;
+  scoped_ptr<SplitWriter> html_output_split_writer_;
+
   DISALLOW_COPY_AND_ASSIGN(ProxyFetch);
 };
 
@@ -31,6 +31,7 @@
 #include "net/instaweb/rewriter/public/blink_util.h"
 #include "net/instaweb/rewriter/public/domain_lawyer.h"
 #include "net/instaweb/rewriter/public/experiment_util.h"
+#include "net/instaweb/rewriter/public/html_output_cache.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
@@ -3475,6 +3476,80 @@ TEST_F(ProxyInterfaceTest, BailOutOfParsing) {
             "</body></html>", text);
 }
 
+TEST_F(ProxyInterfaceTest, HtmlOutputCache) {
+  RewriteOptions* options = server_context()->global_options();
+  options->ClearSignatureForTesting();
+  options->EnableExtendCacheFilters();
+  options->DisableFilter(RewriteOptions::kAddHead);
+  options->set_html_output_cache_ttl_ms(10 * Timer::kMinuteMs);
+  server_context()->ComputeSignature(options);
+
+  SetResponseWithDefaultHeaders(StrCat(kTestDomain, "1.jpg"), kContentTypeJpeg,
+                                "image", kHtmlCacheTimeSec * 2);
+  const char kContent[] = "<html><body><img src=\"1.jpg\"></body></html>";
+  const char kRewritten[] =
+      "<html><body><img src=\"1.jpg.pagespeed.ce.0.jpg\"></body></html>";
+  SetResponseWithDefaultHeaders(kPageUrl, kContentTypeHtml, kContent, 0);
+
+  // The first request is parsed, and its output stored.
+  ResponseHeaders headers;
+  GoogleString text;
+  FetchFromProxy(kPageUrl, true, &text, &headers);
+  EXPECT_EQ(kRewritten, text);
+  Variable* misses =
+      statistics()->GetVariable(HtmlOutputCache::kHtmlOutputCacheMisses);
+  Variable* inserts =
+      statistics()->GetVariable(HtmlOutputCache::kHtmlOutputCacheInserts);
+  Variable* hits =
+      statistics()->GetVariable(HtmlOutputCache::kHtmlOutputCacheHits);
+  EXPECT_EQ(1, misses->Get());
+  EXPECT_EQ(1, inserts->Get());
+  EXPECT_EQ(0, hits->Get());
+
+  // The same origin HTML is then served from the cache.
+  headers.Clear();
+  text.clear();
+  FetchFromProxy(kPageUrl, true, &text, &headers);
+  EXPECT_EQ(kRewritten, text);
+  EXPECT_EQ(HttpStatus::kOK, headers.status_code());
+  EXPECT_EQ(1, misses->Get());
+  EXPECT_EQ(1, hits->Get());
+
+  // Different origin HTML misses.
+  const char kNewContent[] = "<html><body><p>new</p></body></html>";
+  SetResponseWithDefaultHeaders(kPageUrl, kContentTypeHtml, kNewContent, 0);
+  headers.Clear();
+  text.clear();
+  FetchFromProxy(kPageUrl, true, &text, &headers);
+  EXPECT_EQ(kNewContent, text);
+  EXPECT_EQ(2, misses->Get());
+  EXPECT_EQ(1, hits->Get());
+}
+
+TEST_F(ProxyInterfaceTest, HtmlOutputCacheBypassedForRequestDependentFilters) {
+  RewriteOptions* options = server_context()->global_options();
+  options->ClearSignatureForTesting();
+  options->EnableFilter(RewriteOptions::kAddInstrumentation);
+  options->set_html_output_cache_ttl_ms(10 * Timer::kMinuteMs);
+  server_context()->ComputeSignature(options);
+
+  SetResponseWithDefaultHeaders(kPageUrl, kContentTypeHtml,
+                                "<html><body></body></html>", 0);
+  ResponseHeaders headers;
+  GoogleString text;
+  FetchFromProxy(kPageUrl, true, &text, &headers);
+  headers.Clear();
+  text.clear();
+  FetchFromProxy(kPageUrl, true, &text, &headers);
+
+  EXPECT_EQ(2, statistics()->GetVariable(
+      HtmlOutputCache::kHtmlOutputCacheBypassRequestDependentFilters)->Get());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      HtmlOutputCache::kHtmlOutputCacheMisses)->Get());
+  EXPECT_EQ(0, statistics()->GetVariable(
+      HtmlOutputCache::kHtmlOutputCacheInserts)->Get());
+}
+
 TEST_F(ProxyInterfaceTest, LoggingInfoRewriteInfoMaxSize) {
   RewriteOptions* options = server_context()->global_options();
   options->ClearSignatureForTesting();
@@ -38,6 +38,7 @@
       'sources': [
         'kernel/base/abstract_mutex.cc',
         'kernel/base/annotated_message_handler.cc',
+        'kernel/base/async_file_io.cc',
         'kernel/base/atom.cc',
         'kernel/base/debug.cc',
         'kernel/base/file_message_handler.cc',
@@ -91,6 +92,7 @@
         'kernel/base/escaping.cc',
         'kernel/base/fast_wildcard_group.cc',
         'kernel/base/file_writer.cc',
+        'kernel/base/free_list_allocator.cc',
         'kernel/base/function.cc',
         'kernel/base/hasher.cc',
         'kernel/base/hostname_util.cc',
@@ -163,8 +165,10 @@
         'kernel/sharedmem/shared_mem_cache_data_test_base.cc',
         'kernel/sharedmem/shared_mem_cache_test_base.cc',
         'kernel/sharedmem/shared_mem_lock_manager_test_base.cc',
+        'kernel/sharedmem/shared_mem_origin_health_test_base.cc',
         'kernel/sharedmem/shared_mem_statistics_test_base.cc',
         'kernel/sharedmem/shared_mem_test_base.cc',
+        'kernel/sharedmem/shared_mem_tiny_lfu_test_base.cc',
         'kernel/thread/thread_system_test_base.cc',
         'kernel/thread/worker_test_base.cc',
         'kernel/util/mock_nonce_generator.cc',
@@ -188,23 +192,30 @@
       'target_name': 'pagespeed_cache',
       'type': '<(library)',
       'sources': [
+        'kernel/cache/admission_filtered_cache.cc',
         'kernel/cache/async_cache.cc',
+        'kernel/cache/async_file_cache.cc',
         'kernel/cache/cache_batcher.cc',
+        'kernel/cache/cache_codec.cc',
         'kernel/cache/cache_stats.cc',
         'kernel/cache/compressed_cache.cc',
         'kernel/cache/delegating_cache_callback.cc',
         'kernel/cache/fallback_cache.cc',
         'kernel/cache/file_cache.cc',
+        'kernel/cache/file_cache_index.cc',
         'kernel/cache/key_value_codec.cc',
         'kernel/cache/lru_cache.cc',
         'kernel/cache/purge_context.cc',
         'kernel/cache/purge_set.cc',
+        'kernel/cache/sharded_lru_cache.cc',
         'kernel/cache/threadsafe_cache.cc',
+        'kernel/cache/tiny_lfu.cc',
         'kernel/cache/write_through_cache.cc',
        ],
       'dependencies': [
         'pagespeed_base',
         '<(DEPTH)/third_party/rdestl/rdestl.gyp:rdestl',
+        '<(DEPTH)/third_party/zlib/zlib.gyp:zlib',
       ],
       'include_dirs': [
         '<(DEPTH)',
@@ -234,6 +245,7 @@
         'kernel/html/doctype.cc',
         'kernel/html/empty_html_filter.cc',
         'kernel/html/html_attribute_quote_removal.cc',
+        'kernel/html/html_byte_scanner.cc',
         'kernel/html/html_element.cc',
         'kernel/html/html_event.cc',
         'kernel/html/html_filter.cc',
@@ -254,6 +266,7 @@
       'target_name': 'pagespeed_http_core',
       'type': '<(library)',
       'sources': [
+        'kernel/http/byte_range.cc',
         'kernel/http/caching_headers.cc',
         'kernel/http/content_type.cc',
         'kernel/http/google_url.cc',
@@ -386,10 +399,12 @@
         'kernel/util/gzip_inflater.cc',
         'kernel/util/hashed_nonce_generator.cc',
         'kernel/util/input_file_nonce_generator.cc',
+        'kernel/util/io_uring_file_io.cc',
         'kernel/util/nonce_generator.cc',
         'kernel/util/simple_random.cc',
         'kernel/util/statistics_logger.cc',
         'kernel/util/statistics_work_bound.cc',
+        'kernel/util/threaded_file_io.cc',
         'kernel/util/url_escaper.cc',
         'kernel/util/url_multipart_encoder.cc',
         'kernel/util/url_segment_encoder.cc',
@@ -531,11 +546,15 @@
         'kernel/sharedmem/shared_mem_cache.cc',
         'kernel/sharedmem/shared_mem_cache_data.cc',
         'kernel/sharedmem/shared_mem_lock_manager.cc',
+        'kernel/sharedmem/shared_mem_origin_health.cc',
         'kernel/sharedmem/shared_mem_statistics.cc',
+        'kernel/sharedmem/shared_mem_tiny_lfu.cc',
       ],
       'dependencies': [
         'pagespeed_base',
+        'pagespeed_cache',
         'pagespeed_sharedmem_pb',
+        '<(DEPTH)/third_party/zlib/zlib.gyp:zlib',
       ],
       'include_dirs': [
         '<(DEPTH)',
@@ -546,6 +565,7 @@
       'type': '<(library)',
       'sources': [
         'kernel/thread/queued_alarm.cc',
+        'kernel/thread/queue_delay_controller.cc',
         'kernel/thread/queued_worker.cc',
         'kernel/thread/queued_worker_pool.cc',
         'kernel/thread/scheduler.cc',
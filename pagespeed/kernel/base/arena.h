@@ -30,6 +30,10 @@ namespace net_instaweb {
 // This template keeps a packed set of objects inheriting from the same base
 // type (which must have a virtual destructor) where all of the
 // objects in the same arena are expected to be destroyed at once.
+//
+// Arena<char> can also be used as a pool of raw storage, e.g. for strings
+// that all live until the same point.  Allocations too big to pack
+// efficiently into a chunk get a heap block of their own.
 template<typename T>
 class Arena {
  public:
@@ -43,6 +47,7 @@ class Arena {
 
   ~Arena() {
     CHECK(chunks_.empty());
+    CHECK(large_objects_.empty());
   }
 
   void* Allocate(size_t size) {
@@ -50,7 +55,10 @@ class Arena {
     size = ExpandToAlign(size);
 
     DCHECK(sizeof(void*) <= kAlign);
-    DCHECK(size < Chunk::kSize);
+    ++num_allocations_;
+    if (size > kMaxChunkedSize) {
+      return AllocateLarge(size);
+    }
 
     if (next_alloc_ + size > chunk_end_) {
       AddChunk();
@@ -78,6 +86,11 @@ class Arena {
   // Cleans up all the objects in the arena. You must call this explicitly.
   void DestroyObjects();
 
+  // The number of Allocate calls, and the number of heap blocks backing
+  // them, since the last DestroyObjects.
+  int64 num_allocations() const { return num_allocations_; }
+  int num_blocks() const { return chunks_.size() + large_objects_.size(); }
+
   // Rounds block size up to 8; we always align to it, even on 32-bit.
   static size_t ExpandToAlign(size_t in) {
     return (in + kAlign - 1) & ~(kAlign - 1);
@@ -106,9 +119,16 @@ class Arena {
     char buf[kSize];
   };
 
+  // Allocations bigger than this (including the link) get a block of their
+  // own, so that a large object doesn't strand most of a chunk.
+  static const size_t kMaxChunkedSize = Chunk::kSize / 4;
+
   // Adds in a new chunk and initializes all the fields below to refer to it
   void AddChunk();
 
+  // Allocates a block holding just one object, of the already-expanded size.
+  void* AllocateLarge(size_t size);
+
   // Sets up all the pointers below to denote us being empty.
   void InitEmpty();
 
@@ -128,6 +148,12 @@ class Arena {
   char* scratch_;
 
   std::vector<Chunk*> chunks_;
+
+  // Blocks allocated by AllocateLarge.  Each holds a single object, at
+  // offset kAlign.
+  std::vector<char*> large_objects_;
+
+  int64 num_allocations_;
 };
 
 template<typename T>
@@ -139,6 +165,13 @@ void Arena<T>::AddChunk() {
   last_link_ = &scratch_;
 }
 
+template<typename T>
+void* Arena<T>::AllocateLarge(size_t size) {
+  char* base = new char[size];
+  large_objects_.push_back(base);
+  return base + kAlign;
+}
+
 template<typename T>
 void Arena<T>::DestroyObjects() {
   for (int i = 0; i < static_cast<int>(chunks_.size()); ++i) {
@@ -151,6 +184,11 @@ void Arena<T>::DestroyObjects() {
     delete chunks_[i];
   }
   chunks_.clear();
+  for (int i = 0, n = large_objects_.size(); i < n; ++i) {
+    reinterpret_cast<T*>(large_objects_[i] + kAlign)->~T();
+    delete [] large_objects_[i];
+  }
+  large_objects_.clear();
   InitEmpty();
 }
 
@@ -163,6 +201,7 @@ void Arena<T>::InitEmpty() {
   next_alloc_ = NULL;
   last_link_ = NULL;
   chunk_end_ = NULL;
+  num_allocations_ = 0;
 }
 
 }  // namespace  net_instaweb
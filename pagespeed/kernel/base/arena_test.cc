@@ -21,6 +21,7 @@
 #include "pagespeed/kernel/base/arena.h"
 
 #include <cstddef>
+#include <cstring>
 #include <set>
 
 #include "pagespeed/kernel/base/gtest.h"
@@ -95,6 +96,24 @@ class ArenaTest : public testing::Test {
     void* different_size;
   };
 
+  // KidC is too big to be packed into a chunk, so each one gets a block
+  // of its own.
+  class KidC : public Base {
+   public:
+    explicit KidC(ArenaTest* o) : Base(o) {}
+
+    ~KidC() {
+      ++owner_->destroyed_c_;
+    }
+
+    virtual void Made() {
+      ++owner_->made_c_;
+    }
+
+   private:
+    char big_[5000];
+  };
+
   // Tests a given mixture of allocations of KidA and KidB --
   // making sure we get sane pointers and delete things.
   void TestCombo(int num_a, int num_b) {
@@ -124,15 +143,19 @@ class ArenaTest : public testing::Test {
   void ClearStats() {
     made_a_ = 0;
     made_b_ = 0;
+    made_c_ = 0;
     destroyed_a_ = 0;
     destroyed_b_ = 0;
+    destroyed_c_ = 0;
     seen_ptrs_.clear();
   }
 
   int made_a_;
   int made_b_;
+  int made_c_;
   int destroyed_a_;
   int destroyed_b_;
+  int destroyed_c_;
   Arena<Base> arena_;
   std::set<void*> seen_ptrs_;
 };
@@ -175,6 +198,33 @@ TEST_F(ArenaTest, TestReuse) {
   TestCombo(20000, 10000);
 }
 
+TEST_F(ArenaTest, TestLarge) {
+  for (int i = 0; i < 10; ++i) {
+    CheckPtr(new (&arena_) KidA(this));
+    CheckPtr(new (&arena_) KidC(this));
+  }
+  EXPECT_EQ(20, arena_.num_allocations());
+  EXPECT_EQ(11, arena_.num_blocks());  // One chunk of KidAs, and 10 KidCs.
+  arena_.DestroyObjects();
+  EXPECT_EQ(10, made_a_);
+  EXPECT_EQ(10, made_c_);
+  EXPECT_EQ(10, destroyed_a_);
+  EXPECT_EQ(10, destroyed_c_);
+  EXPECT_EQ(0, arena_.num_allocations());
+  EXPECT_EQ(0, arena_.num_blocks());
+}
+
+TEST_F(ArenaTest, TestRawStorage) {
+  Arena<char> arena;
+  char* small = static_cast<char*>(arena.Allocate(10));
+  char* big = static_cast<char*>(arena.Allocate(100000));
+  memset(small, 'a', 10);
+  memset(big, 'b', 100000);
+  EXPECT_EQ(2, arena.num_allocations());
+  EXPECT_EQ(2, arena.num_blocks());
+  arena.DestroyObjects();
+}
+
 // Tests for alignment helper.
 TEST_F(ArenaTest, TestAlign) {
   // A few that work regardless of arch, to sanity-check
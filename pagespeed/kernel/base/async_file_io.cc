@@ -0,0 +1,39 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/base/async_file_io.h"
+
+namespace net_instaweb {
+
+AsyncFileIo::ReadCallback::~ReadCallback() {
+}
+
+AsyncFileIo::WriteCallback::~WriteCallback() {
+}
+
+AsyncFileIo::AsyncFileIo() {
+}
+
+AsyncFileIo::~AsyncFileIo() {
+}
+
+void AsyncFileIo::ReadFiles(const FileReadVector& reads) {
+  for (int i = 0, n = reads.size(); i < n; ++i) {
+    ReadFile(reads[i].filename, reads[i].callback);
+  }
+}
+
+}  // namespace net_instaweb
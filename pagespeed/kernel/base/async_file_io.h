@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_BASE_ASYNC_FILE_IO_H_
+#define PAGESPEED_KERNEL_BASE_ASYNC_FILE_IO_H_
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+
+namespace net_instaweb {
+
+class SharedString;
+
+// Interface for reading and writing whole files without blocking the
+// calling thread, as needed by FileCache.  Implementations include a
+// thread-pool on top of a FileSystem, and (on Linux) one that submits
+// batches of requests to the kernel through io_uring.
+//
+// Callbacks may be run on any thread, possibly before the request method
+// returns.  They are run exactly once, and are responsible for deleting
+// themselves if appropriate.
+class AsyncFileIo {
+ public:
+  class ReadCallback {
+   public:
+    virtual ~ReadCallback();
+
+    // If success is true, *contents holds the file's contents, which may be
+    // swapped out.
+    virtual void Done(bool success, GoogleString* contents) = 0;
+  };
+
+  class WriteCallback {
+   public:
+    virtual ~WriteCallback();
+    virtual void Done(bool success) = 0;
+  };
+
+  // A file to read as part of a batch.
+  struct FileRead {
+    FileRead(const GoogleString& filename_in, ReadCallback* callback_in)
+        : filename(filename_in), callback(callback_in) {}
+
+    GoogleString filename;
+    ReadCallback* callback;
+  };
+  typedef std::vector<FileRead> FileReadVector;
+
+  AsyncFileIo();
+  virtual ~AsyncFileIo();
+
+  // Reads the entire contents of filename.
+  virtual void ReadFile(const GoogleString& filename,
+                        ReadCallback* callback) = 0;
+
+  // Reads a batch of files, as if by calling ReadFile for each.  The default
+  // does exactly that; implementations that queue requests override it to
+  // queue the whole batch at once, so the reads can all be started together.
+  virtual void ReadFiles(const FileReadVector& reads);
+
+  // Like FileSystem::WriteFileAtomic: writes value to a temporary file and
+  // renames it to filename, creating any missing directories.  value is
+  // shared, not copied.
+  virtual void WriteFileAtomic(const GoogleString& filename,
+                               const SharedString& value,
+                               WriteCallback* callback) = 0;
+
+  // Stops accepting new requests, which will fail immediately, and waits for
+  // any requests already started to complete.
+  virtual void ShutDown() = 0;
+
+  // Short description of the implementation, for Name() of caches built on
+  // top of this.
+  virtual GoogleString Name() const = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AsyncFileIo);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_ASYNC_FILE_IO_H_
@@ -18,6 +18,10 @@
 
 #include "pagespeed/kernel/base/cache_interface.h"
 
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_hash.h"
+
 namespace net_instaweb {
 
 namespace {
@@ -49,6 +53,10 @@ CacheInterface* CacheInterface::Backend() {
   return this;
 }
 
+uint64 CacheInterface::AdmissionFingerprint(const GoogleString& key) {
+  return HashString<CasePreserve, uint64>(key.data(), key.size());
+}
+
 void CacheInterface::ValidateAndReportResult(const GoogleString& key,
                                              KeyState state,
                                              Callback* callback) {
@@ -19,6 +19,7 @@
 #ifndef PAGESPEED_KERNEL_BASE_CACHE_INTERFACE_H_
 #define PAGESPEED_KERNEL_BASE_CACHE_INTERFACE_H_
 
+#include <cstddef>
 #include <vector>
 
 #include "base/logging.h"
@@ -213,6 +214,26 @@ class CacheInterface {
     CHECK(false);
   }
 
+  // The following two methods let an admission policy, such as
+  // AdmissionFilteredCache, weigh a Put against the entry it would evict.
+  //
+  // Returns a 64-bit identifier for key, under which accesses to it are
+  // counted.  Caches that report eviction victims must return the same
+  // fingerprint for a victim here as from PeekEvictionVictim.  The default
+  // is a hash of the key.
+  virtual uint64 AdmissionFingerprint(const GoogleString& key);
+
+  // If storing value_size bytes under key, which is not yet in the cache,
+  // would evict an entry, sets *victim to that entry's AdmissionFingerprint
+  // and returns true.  Returns false if there is room, if the key is
+  // already present, or if the cache can't tell, in which case an
+  // admission policy lets the Put through.  This is advisory only: another
+  // thread may change the cache before the Put arrives.
+  virtual bool PeekEvictionVictim(const GoogleString& key, size_t value_size,
+                                  uint64* victim) {
+    return false;
+  }
+
  protected:
   // Invokes callback->ValidateCandidate() and callback->Done() as appropriate.
   void ValidateAndReportResult(const GoogleString& key, KeyState state,
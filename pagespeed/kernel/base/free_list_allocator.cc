@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/base/free_list_allocator.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace net_instaweb {
+
+FreeListPool::FreeListPool()
+    : block_size_(0),
+      free_list_(NULL),
+      next_alloc_(NULL),
+      chunk_end_(NULL),
+      num_outstanding_(0),
+      num_allocations_(0) {
+}
+
+FreeListPool::~FreeListPool() {
+  Clear();
+}
+
+void* FreeListPool::Allocate(size_t size) {
+  if (block_size_ == 0) {
+    // Round up so every block can hold a free-list link, and stays aligned.
+    block_size_ = std::max(size, sizeof(FreeBlock));
+    block_size_ = (block_size_ + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  }
+  if (size > block_size_) {
+    return ::operator new(size);
+  }
+  ++num_outstanding_;
+  ++num_allocations_;
+  if (free_list_ != NULL) {
+    FreeBlock* block = free_list_;
+    free_list_ = block->next;
+    return block;
+  }
+  if (next_alloc_ + block_size_ > chunk_end_) {
+    next_alloc_ = new char[kChunkSize];
+    chunk_end_ = next_alloc_ + kChunkSize;
+    chunks_.push_back(next_alloc_);
+  }
+  void* block = next_alloc_;
+  next_alloc_ += block_size_;
+  return block;
+}
+
+void FreeListPool::Deallocate(void* ptr, size_t size) {
+  if (size > block_size_) {
+    ::operator delete(ptr);
+    return;
+  }
+  DCHECK_LT(0, num_outstanding_);
+  --num_outstanding_;
+  FreeBlock* block = static_cast<FreeBlock*>(ptr);
+  block->next = free_list_;
+  free_list_ = block;
+}
+
+void FreeListPool::Clear() {
+  if (num_outstanding_ != 0) {
+    LOG(DFATAL) << "Clearing a FreeListPool with " << num_outstanding_
+                << " blocks still allocated";
+    return;
+  }
+  for (int i = 0, n = chunks_.size(); i < n; ++i) {
+    delete [] chunks_[i];
+  }
+  chunks_.clear();
+  free_list_ = NULL;
+  next_alloc_ = NULL;
+  chunk_end_ = NULL;
+  num_allocations_ = 0;
+}
+
+const size_t SizeClassPool::kMaxPooledSize =
+    (SizeClassPool::kMinBlockSize << (SizeClassPool::kNumClasses - 1)) -
+    SizeClassPool::kHeaderSize;
+
+SizeClassPool::SizeClassPool() : num_large_allocations_(0) {
+  COMPILE_ASSERT(sizeof(FreeListPool*) <= kHeaderSize, header_holds_pointer);
+}
+
+SizeClassPool::~SizeClassPool() {
+}
+
+void* SizeClassPool::Allocate(size_t size) {
+  size_t block_size = kMinBlockSize;
+  int size_class = 0;
+  while ((size_class < kNumClasses) && (block_size < size + kHeaderSize)) {
+    block_size *= 2;
+    ++size_class;
+  }
+  char* block;
+  FreeListPool* pool = NULL;
+  if (size_class < kNumClasses) {
+    pool = &pools_[size_class];
+    block = static_cast<char*>(pool->Allocate(block_size));
+  } else {
+    block = new char[size + kHeaderSize];
+    ++num_large_allocations_;
+  }
+  *reinterpret_cast<FreeListPool**>(block) = pool;
+  return block + kHeaderSize;
+}
+
+void SizeClassPool::Deallocate(void* ptr) {
+  char* block = static_cast<char*>(ptr) - kHeaderSize;
+  FreeListPool* pool = *reinterpret_cast<FreeListPool**>(block);
+  if (pool == NULL) {
+    delete [] block;
+  } else {
+    pool->Deallocate(block, pool->block_size());
+  }
+}
+
+void SizeClassPool::Clear() {
+  for (int i = 0; i < kNumClasses; ++i) {
+    pools_[i].Clear();
+  }
+  num_large_allocations_ = 0;
+}
+
+int64 SizeClassPool::num_allocations() const {
+  int64 num_allocations = num_large_allocations_;
+  for (int i = 0; i < kNumClasses; ++i) {
+    num_allocations += pools_[i].num_allocations();
+  }
+  return num_allocations;
+}
+
+int SizeClassPool::num_chunks() const {
+  int num_chunks = num_large_allocations_;
+  for (int i = 0; i < kNumClasses; ++i) {
+    num_chunks += pools_[i].num_chunks();
+  }
+  return num_chunks;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_BASE_FREE_LIST_ALLOCATOR_H_
+#define PAGESPEED_KERNEL_BASE_FREE_LIST_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+// Hands out fixed-size blocks carved from 8k chunks, recycling freed
+// blocks through a free-list.  This is intended for node-based containers
+// such as std::list, which allocate one node at a time, all the same size:
+// the block size is set by the first allocation, and any larger request is
+// passed through to the heap.
+//
+// Clear() returns the chunks to the heap all at once; every block must have
+// been deallocated by then.  This class is not thread-safe.
+class FreeListPool {
+ public:
+  FreeListPool();
+  ~FreeListPool();
+
+  void* Allocate(size_t size);
+  void Deallocate(void* ptr, size_t size);
+
+  // Frees all the chunks.  If any blocks are still allocated, this logs a
+  // DFATAL and keeps the chunks.
+  void Clear();
+
+  // The number of blocks handed out, and the number of chunks backing them,
+  // since the last Clear.
+  int64 num_allocations() const { return num_allocations_; }
+  int num_chunks() const { return chunks_.size(); }
+
+  // The size of the blocks, or 0 before the first allocation.
+  size_t block_size() const { return block_size_; }
+
+ private:
+  static const size_t kChunkSize = 8192;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  size_t block_size_;  // 0 until the first allocation.
+  FreeBlock* free_list_;
+  char* next_alloc_;
+  char* chunk_end_;
+  std::vector<char*> chunks_;
+  int num_outstanding_;
+  int64 num_allocations_;
+
+  DISALLOW_COPY_AND_ASSIGN(FreeListPool);
+};
+
+// Hands out blocks of any size, for objects such as short strings that are
+// freed one at a time and tend to be of similar sizes.  Each request is
+// rounded up to a power of two and served by a FreeListPool for that size,
+// so that a freed block is reused by a later request of the same size
+// class.  Requests bigger than kMaxPooledSize go to the heap.  Each block
+// records where it came from, so Deallocate needs neither its size nor the
+// pool.
+//
+// As with FreeListPool, every block must have been deallocated by Clear(),
+// and this class is not thread-safe.
+class SizeClassPool {
+ public:
+  SizeClassPool();
+  ~SizeClassPool();
+
+  void* Allocate(size_t size);
+  static void Deallocate(void* ptr);
+
+  // Frees all the chunks.  If any blocks are still allocated, this logs a
+  // DFATAL and keeps the chunks.
+  void Clear();
+
+  // The number of blocks handed out, and the number of heap blocks
+  // allocated for them (chunks, plus each large block), since the last
+  // Clear.
+  int64 num_allocations() const;
+  int num_chunks() const;
+
+  // The largest request served from a FreeListPool.
+  static const size_t kMaxPooledSize;
+
+ private:
+  // Blocks of 16, 32, ... 1024 bytes, each starting with a header that
+  // points to its FreeListPool, or is NULL for blocks from the heap.
+  static const int kNumClasses = 7;
+  static const size_t kMinBlockSize = 16;
+  static const size_t kHeaderSize = 8;
+
+  FreeListPool pools_[kNumClasses];
+  int64 num_large_allocations_;
+
+  DISALLOW_COPY_AND_ASSIGN(SizeClassPool);
+};
+
+// STL allocator drawing single objects from a FreeListPool.  Containers
+// that splice between each other must share a pool.  A default-constructed
+// allocator uses the heap.
+template<typename T>
+class FreeListAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template<typename U> struct rebind {
+    typedef FreeListAllocator<U> other;
+  };
+
+  FreeListAllocator() : pool_(NULL) {}
+  explicit FreeListAllocator(FreeListPool* pool) : pool_(pool) {}
+  template<typename U>
+  FreeListAllocator(const FreeListAllocator<U>& src)  // NOLINT
+      : pool_(src.pool()) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void* hint = NULL) {
+    if ((pool_ == NULL) || (n != 1)) {
+      return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<pointer>(pool_->Allocate(sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    if ((pool_ == NULL) || (n != 1)) {
+      ::operator delete(p);
+    } else {
+      pool_->Deallocate(p, sizeof(T));
+    }
+  }
+
+  size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+  void construct(pointer p, const T& value) {
+    new (static_cast<void*>(p)) T(value);
+  }
+  void destroy(pointer p) { p->~T(); }
+
+  FreeListPool* pool() const { return pool_; }
+
+ private:
+  FreeListPool* pool_;
+};
+
+template<typename T, typename U>
+inline bool operator==(const FreeListAllocator<T>& a,
+                       const FreeListAllocator<U>& b) {
+  return a.pool() == b.pool();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const FreeListAllocator<T>& a,
+                       const FreeListAllocator<U>& b) {
+  return a.pool() != b.pool();
+}
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_BASE_FREE_LIST_ALLOCATOR_H_
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the free-list pool and its STL allocator.
+
+#include "pagespeed/kernel/base/free_list_allocator.h"
+
+#include <cstring>
+#include <list>
+
+#include "pagespeed/kernel/base/gtest.h"
+
+namespace net_instaweb {
+
+namespace {
+
+typedef FreeListAllocator<int> IntAllocator;
+typedef std::list<int, IntAllocator> IntList;
+
+class FreeListAllocatorTest : public testing::Test {
+ protected:
+  FreeListPool pool_;
+};
+
+TEST_F(FreeListAllocatorTest, EmptyClear) {
+  pool_.Clear();
+  EXPECT_EQ(0, pool_.num_allocations());
+  EXPECT_EQ(0, pool_.num_chunks());
+}
+
+TEST_F(FreeListAllocatorTest, RecyclesBlocks) {
+  void* a = pool_.Allocate(24);
+  void* b = pool_.Allocate(24);
+  EXPECT_NE(a, b);
+  pool_.Deallocate(a, 24);
+  EXPECT_EQ(a, pool_.Allocate(24));
+  pool_.Deallocate(a, 24);
+  pool_.Deallocate(b, 24);
+  EXPECT_EQ(3, pool_.num_allocations());
+  EXPECT_EQ(1, pool_.num_chunks());
+  pool_.Clear();
+  EXPECT_EQ(0, pool_.num_chunks());
+}
+
+TEST_F(FreeListAllocatorTest, LargerRequestsUseHeap) {
+  void* small = pool_.Allocate(16);
+  void* large = pool_.Allocate(1000);
+  EXPECT_EQ(1, pool_.num_allocations());
+  pool_.Deallocate(large, 1000);
+  pool_.Deallocate(small, 16);
+}
+
+TEST_F(FreeListAllocatorTest, ListsSpliceWithinPool) {
+  {
+    IntList a((IntAllocator(&pool_)));
+    IntList b((IntAllocator(&pool_)));
+    for (int i = 0; i < 10000; ++i) {
+      a.push_back(i);
+    }
+    EXPECT_LT(1, pool_.num_chunks());
+    b.splice(b.end(), a, a.begin(), a.end());
+    EXPECT_TRUE(a.empty());
+    ASSERT_EQ(10000U, b.size());
+    int expected = 0;
+    for (IntList::iterator p = b.begin(); p != b.end(); ++p, ++expected) {
+      EXPECT_EQ(expected, *p);
+    }
+
+    // Erased nodes are reused rather than taking more chunks.
+    int num_chunks = pool_.num_chunks();
+    for (int i = 0; i < 5000; ++i) {
+      b.pop_front();
+    }
+    for (int i = 0; i < 5000; ++i) {
+      a.push_back(i);
+    }
+    EXPECT_EQ(num_chunks, pool_.num_chunks());
+    EXPECT_EQ(15000, pool_.num_allocations());
+  }
+  pool_.Clear();
+  EXPECT_EQ(0, pool_.num_chunks());
+}
+
+TEST_F(FreeListAllocatorTest, DefaultAllocatorUsesHeap) {
+  IntList list;
+  list.push_back(1);
+  list.push_back(2);
+  EXPECT_EQ(2U, list.size());
+  EXPECT_EQ(0, pool_.num_allocations());
+}
+
+TEST(SizeClassPoolTest, RecyclesBySizeClass) {
+  SizeClassPool pool;
+  char* a = static_cast<char*>(pool.Allocate(10));
+  char* b = static_cast<char*>(pool.Allocate(100));
+  memset(a, 'a', 10);
+  memset(b, 'b', 100);
+  EXPECT_EQ(2, pool.num_allocations());
+  EXPECT_EQ(2, pool.num_chunks());  // One for each size.
+
+  // A freed block is reused for another request of about the same size,
+  // but not for a much bigger one.
+  SizeClassPool::Deallocate(a);
+  EXPECT_EQ(a, pool.Allocate(20));
+  SizeClassPool::Deallocate(b);
+  char* c = static_cast<char*>(pool.Allocate(200));
+  EXPECT_NE(b, c);
+  EXPECT_EQ(b, pool.Allocate(90));
+  EXPECT_EQ(3, pool.num_chunks());
+
+  SizeClassPool::Deallocate(a);
+  SizeClassPool::Deallocate(b);
+  SizeClassPool::Deallocate(c);
+  pool.Clear();
+  EXPECT_EQ(0, pool.num_allocations());
+  EXPECT_EQ(0, pool.num_chunks());
+}
+
+TEST(SizeClassPoolTest, LargeRequestsUseHeap) {
+  SizeClassPool pool;
+  char* small = static_cast<char*>(
+      pool.Allocate(SizeClassPool::kMaxPooledSize));
+  char* large = static_cast<char*>(
+      pool.Allocate(SizeClassPool::kMaxPooledSize + 1));
+  memset(small, 's', SizeClassPool::kMaxPooledSize);
+  memset(large, 'l', SizeClassPool::kMaxPooledSize + 1);
+  EXPECT_EQ(2, pool.num_allocations());
+  EXPECT_EQ(2, pool.num_chunks());
+  SizeClassPool::Deallocate(large);
+  SizeClassPool::Deallocate(small);
+  pool.Clear();
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
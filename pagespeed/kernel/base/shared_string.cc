@@ -122,6 +122,13 @@ void SharedString::Extend(int new_size) {
   }
 }
 
+void SharedString::Reserve(int new_size) {
+  if (size_ < new_size) {
+    DetachRetainingContent();
+    ref_string_->reserve(new_size + skip_);
+  }
+}
+
 void SharedString::WriteAt(int dest_offset, const char* source, int count) {
   DCHECK_LT(dest_offset, size());
   DCHECK_LE(dest_offset + count, size());
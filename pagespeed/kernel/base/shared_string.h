@@ -103,6 +103,14 @@ class SharedString {
   // detached prior to extending it.
   void Extend(int new_size);
 
+  // Ensures the underlying storage can hold 'new_size' bytes without
+  // reallocating, so a value whose final size is known in advance can be
+  // built up by Append() without repeatedly copying it as it grows.  The
+  // visible value is not changed.  Since the reservation is meant for this
+  // SharedString alone, it is first detached from any other linked
+  // SharedStrings, as with DetachRetainingContent().
+  void Reserve(int new_size);
+
   // Swaps storage with the the passed-in string, detaching from any other
   // previously-linked SharedStrings.
   void SwapWithString(GoogleString* str);
@@ -230,4 +230,38 @@ TEST_F(SharedStringTest, ExtendUniqueTruncated) {
       << "Re-use the same storage across truncate/extend of unique string";
 }
 
+TEST_F(SharedStringTest, Reserve) {
+  SharedString ss("abc");
+  const GoogleString* original_storage = ss.StringValue();
+  ss.Reserve(1000);
+  EXPECT_STREQ("abc", ss.Value());
+  EXPECT_EQ(original_storage, ss.StringValue())
+      << "Re-use the same storage when reserving in a unique string";
+  EXPECT_LE(1000U, ss.StringValue()->capacity());
+
+  // Appending up to the reserved size does not move the data.
+  const char* data = ss.data();
+  GoogleString more(997, 'x');
+  ss.Append(more);
+  EXPECT_EQ(1000, ss.size());
+  EXPECT_EQ(data, ss.data());
+}
+
+TEST_F(SharedStringTest, ReserveDetaches) {
+  SharedString ss("abc");
+  SharedString ss2 = ss;
+  const GoogleString* original_storage = ss2.StringValue();
+  ss.Reserve(1000);
+  EXPECT_STREQ("abc", ss.Value());
+  EXPECT_FALSE(ss.SharesStorage(ss2)) << "reserving detaches";
+  EXPECT_LE(1000U, ss.StringValue()->capacity());
+
+  // The storage of the other SharedString is left alone.
+  EXPECT_EQ(original_storage, ss2.StringValue());
+  EXPECT_STREQ("abc", ss2.Value());
+  ss.Append("def");
+  EXPECT_STREQ("abcdef", ss.Value());
+  EXPECT_STREQ("abc", ss2.Value());
+}
+
 }  // namespace net_instaweb
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
+
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/cache/frequency_sketch.h"
+
+namespace net_instaweb {
+
+const char AdmissionFilteredCache::kAdmitted[] = "_admission_admitted";
+const char AdmissionFilteredCache::kRejected[] = "_admission_rejected";
+
+AdmissionFilteredCache::AdmissionFilteredCache(StringPiece prefix,
+                                               CacheInterface* cache,
+                                               FrequencySketch* sketch,
+                                               Statistics* statistics)
+    : cache_(cache),
+      sketch_(sketch),
+      admitted_(statistics->GetVariable(StrCat(prefix, kAdmitted))),
+      rejected_(statistics->GetVariable(StrCat(prefix, kRejected))) {
+}
+
+AdmissionFilteredCache::~AdmissionFilteredCache() {
+}
+
+void AdmissionFilteredCache::InitStats(StringPiece prefix,
+                                       Statistics* statistics) {
+  statistics->AddVariable(StrCat(prefix, kAdmitted));
+  statistics->AddVariable(StrCat(prefix, kRejected));
+}
+
+GoogleString AdmissionFilteredCache::FormatName(StringPiece cache) {
+  return StrCat("TinyLFU(", cache, ")");
+}
+
+void AdmissionFilteredCache::Get(const GoogleString& key,
+                                 Callback* callback) {
+  sketch_->Record(cache_->AdmissionFingerprint(key));
+  cache_->Get(key, callback);
+}
+
+void AdmissionFilteredCache::MultiGet(MultiGetRequest* request) {
+  for (int i = 0, n = request->size(); i < n; ++i) {
+    sketch_->Record(cache_->AdmissionFingerprint((*request)[i].key));
+  }
+  cache_->MultiGet(request);
+}
+
+void AdmissionFilteredCache::Put(const GoogleString& key,
+                                 SharedString* value) {
+  uint64 fingerprint = cache_->AdmissionFingerprint(key);
+  sketch_->Record(fingerprint);
+  uint64 victim;
+  if (cache_->PeekEvictionVictim(key, value->size(), &victim)) {
+    if (!sketch_->Admit(fingerprint, victim)) {
+      rejected_->Add(1);
+      return;
+    }
+    admitted_->Add(1);
+  }
+  cache_->Put(key, value);
+}
+
+void AdmissionFilteredCache::Delete(const GoogleString& key) {
+  cache_->Delete(key);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_ADMISSION_FILTERED_CACHE_H_
+#define PAGESPEED_KERNEL_CACHE_ADMISSION_FILTERED_CACHE_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+
+namespace net_instaweb {
+
+class FrequencySketch;
+class SharedString;
+class Statistics;
+class Variable;
+
+// Wraps a cache with a TinyLFU admission policy.  Every Get, MultiGet and
+// Put is counted in a frequency sketch.  A Put of a new key that would
+// evict an entry is dropped unless the new key has been accessed more
+// often than the entry it would evict, as reported by the wrapped cache's
+// PeekEvictionVictim.  Caches that don't report victims
+// see every Put.
+//
+// This keeps keys that are only ever looked up once from displacing
+// popular entries.  It suits small, fast L1 caches, and in particular a
+// WriteThroughCache's cache1, where otherwise every value found in cache2
+// is copied into cache1 whether or not it will be asked for again.
+//
+// As there can be more than one filtered cache in a system, the
+// constructor takes a statistics prefix, as CacheStats does.
+class AdmissionFilteredCache : public CacheInterface {
+ public:
+  // Statistics variable suffixes.
+  static const char kAdmitted[];
+  static const char kRejected[];
+
+  // Does not take ownership of cache, sketch or statistics.  A sketch may
+  // be shared by several filtered caches in front of the same backend.  It
+  // is usually a TinyLFU, or for a cache shared between processes, a
+  // SharedMemTinyLFU.
+  AdmissionFilteredCache(StringPiece prefix, CacheInterface* cache,
+                         FrequencySketch* sketch, Statistics* statistics);
+  virtual ~AdmissionFilteredCache();
+
+  // This must be called once for every unique prefix.
+  static void InitStats(StringPiece prefix, Statistics* statistics);
+
+  virtual void Get(const GoogleString& key, Callback* callback);
+  virtual void MultiGet(MultiGetRequest* request);
+  virtual void Put(const GoogleString& key, SharedString* value);
+  virtual void Delete(const GoogleString& key);
+  virtual CacheInterface* Backend() { return cache_; }
+  virtual bool IsBlocking() const { return cache_->IsBlocking(); }
+  virtual bool IsHealthy() const { return cache_->IsHealthy(); }
+  virtual void ShutDown() { cache_->ShutDown(); }
+  virtual uint64 AdmissionFingerprint(const GoogleString& key) {
+    return cache_->AdmissionFingerprint(key);
+  }
+  virtual bool PeekEvictionVictim(const GoogleString& key, size_t value_size,
+                                  uint64* victim) {
+    return cache_->PeekEvictionVictim(key, value_size, victim);
+  }
+
+  virtual GoogleString Name() const { return FormatName(cache_->Name()); }
+  static GoogleString FormatName(StringPiece cache);
+
+ private:
+  CacheInterface* cache_;
+  FrequencySketch* sketch_;
+  Variable* admitted_;  // New keys stored despite evicting another.
+  Variable* rejected_;  // New keys dropped in favor of the victim.
+
+  DISALLOW_COPY_AND_ASSIGN(AdmissionFilteredCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_ADMISSION_FILTERED_CACHE_H_
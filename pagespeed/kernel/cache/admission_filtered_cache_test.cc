@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the TinyLFU admission wrapper, in front of a single-shard
+// ShardedLRUCache.
+
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace {
+
+// Room for ten entries of a five-byte key and a five-byte value.
+const size_t kMaxSize = 100;
+const int kNumEntries = 10;
+
+}  // namespace
+
+namespace net_instaweb {
+
+class AdmissionFilteredCacheTest : public CacheTestBase {
+ protected:
+  AdmissionFilteredCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        stats_(thread_system_.get()),
+        lru_cache_(kMaxSize, 1, ShardedLRUCache::kLRU, thread_system_.get(),
+                   NULL),
+        tiny_lfu_(kNumEntries, thread_system_.get()) {
+    AdmissionFilteredCache::InitStats("test", &stats_);
+    cache_.reset(new AdmissionFilteredCache("test", &lru_cache_, &tiny_lfu_,
+                                            &stats_));
+  }
+
+  virtual CacheInterface* Cache() { return cache_.get(); }
+  virtual void PostOpCleanup() { lru_cache_.SanityCheck(); }
+
+  // Fills the cache with "name0".."name9", each looked up twice more.
+  void FillCache() {
+    for (int i = 0; i < kNumEntries; ++i) {
+      GoogleString key = StringPrintf("name%d", i);
+      GoogleString value = StringPrintf("valu%d", i);
+      CheckPut(key, value);
+      CheckGet(key, value);
+      CheckGet(key, value);
+    }
+    EXPECT_EQ(kMaxSize, lru_cache_.size_bytes());
+  }
+
+  int64 Admitted() {
+    return stats_.GetVariable(
+        StrCat("test", AdmissionFilteredCache::kAdmitted))->Get();
+  }
+
+  int64 Rejected() {
+    return stats_.GetVariable(
+        StrCat("test", AdmissionFilteredCache::kRejected))->Get();
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  SimpleStats stats_;
+  ShardedLRUCache lru_cache_;
+  TinyLFU tiny_lfu_;
+  scoped_ptr<AdmissionFilteredCache> cache_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AdmissionFilteredCacheTest);
+};
+
+TEST_F(AdmissionFilteredCacheTest, PutGetDelete) {
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  CheckNotFound("Another Name");
+  CheckDelete("Name");
+  CheckNotFound("Name");
+  EXPECT_EQ(0, Admitted());
+  EXPECT_EQ(0, Rejected());
+}
+
+TEST_F(AdmissionFilteredCacheTest, OneHitWonderRejected) {
+  FillCache();
+
+  // A key that has only been looked up once doesn't displace name0, which
+  // has been used three times.
+  CheckNotFound("nameA");
+  CheckPut("nameA", "valuA");
+  EXPECT_EQ(1, Rejected());
+  CheckNotFound("nameA");
+  CheckGet("name0", "valu0");
+  EXPECT_EQ(static_cast<size_t>(0), lru_cache_.num_evictions());
+}
+
+TEST_F(AdmissionFilteredCacheTest, PopularKeyAdmitted) {
+  FillCache();
+
+  // Once the new key has been asked for more often than the LRU victim,
+  // it gets in.
+  for (int i = 0; i < 4; ++i) {
+    CheckNotFound("nameA");
+  }
+  CheckPut("nameA", "valuA");
+  EXPECT_EQ(1, Admitted());
+  EXPECT_EQ(0, Rejected());
+  CheckGet("nameA", "valuA");
+  CheckNotFound("name0");
+  EXPECT_EQ(static_cast<size_t>(1), lru_cache_.num_evictions());
+}
+
+TEST_F(AdmissionFilteredCacheTest, ReplacementNotFiltered) {
+  FillCache();
+  CheckPut("name0", "new_0");
+  CheckGet("name0", "new_0");
+  EXPECT_EQ(0, Admitted());
+  EXPECT_EQ(0, Rejected());
+}
+
+TEST_F(AdmissionFilteredCacheTest, CacheWithoutVictimsSeesEveryPut) {
+  // LRUCache doesn't report eviction victims, so nothing is filtered.
+  LRUCache lru_cache(kMaxSize);
+  AdmissionFilteredCache cache("test", &lru_cache, &tiny_lfu_, &stats_);
+  for (int i = 0; i < kNumEntries; ++i) {
+    CheckPut(&cache, StringPrintf("name%d", i), StringPrintf("valu%d", i));
+  }
+  CheckPut(&cache, "nameA", "valuA");
+  CheckGet(&cache, "nameA", "valuA");
+  EXPECT_EQ(0, Rejected());
+}
+
+TEST_F(AdmissionFilteredCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
+TEST_F(AdmissionFilteredCacheTest, Name) {
+  EXPECT_EQ(AdmissionFilteredCache::FormatName(lru_cache_.Name()),
+            cache_->Name());
+  EXPECT_EQ(&lru_cache_, cache_->Backend());
+}
+
+}  // namespace net_instaweb
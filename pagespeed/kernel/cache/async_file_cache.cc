@@ -0,0 +1,173 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/async_file_cache.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/async_file_io.h"
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/cache/file_cache.h"
+
+namespace net_instaweb {
+
+class AsyncFileCache::ReadCallback : public AsyncFileIo::ReadCallback {
+ public:
+  ReadCallback(AsyncFileCache* cache, const GoogleString& key,
+               const GoogleString& filename, CacheInterface::Callback* callback)
+      : cache_(cache), key_(key), filename_(filename), callback_(callback) {}
+
+  virtual void Done(bool success, GoogleString* contents) {
+    FileCache* file_cache = cache_->file_cache_;
+    if (success) {
+      callback_->value()->SwapWithString(contents);
+      if (file_cache->cache_policy()->clean_with_index) {
+        file_cache->RecordAccess(filename_);
+      }
+    }
+    cache_->ValidateAndReportResult(key_, success ? kAvailable : kNotFound,
+                                    callback_);
+    cache_->outstanding_operations_.NoBarrierIncrement(-1);
+    delete this;
+  }
+
+ private:
+  AsyncFileCache* cache_;
+  GoogleString key_;
+  GoogleString filename_;
+  CacheInterface::Callback* callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadCallback);
+};
+
+class AsyncFileCache::WriteCallback : public AsyncFileIo::WriteCallback {
+ public:
+  WriteCallback(AsyncFileCache* cache, const GoogleString& filename,
+                int64 value_size)
+      : cache_(cache), filename_(filename), value_size_(value_size) {
+  }
+
+  virtual void Done(bool success) {
+    cache_->file_cache_->FinishPut(filename_, value_size_, success);
+    cache_->outstanding_operations_.NoBarrierIncrement(-1);
+    delete this;
+  }
+
+ private:
+  AsyncFileCache* cache_;
+  GoogleString filename_;
+  int64 value_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteCallback);
+};
+
+AsyncFileCache::AsyncFileCache(FileCache* file_cache, AsyncFileIo* io)
+    : file_cache_(file_cache),
+      io_(io) {
+  stopped_.set_value(false);
+}
+
+AsyncFileCache::~AsyncFileCache() {
+  DCHECK_EQ(0, outstanding_operations());
+}
+
+GoogleString AsyncFileCache::FormatName(StringPiece io_name) {
+  return StrCat("AsyncFileCache(", io_name, ")");
+}
+
+GoogleString AsyncFileCache::Name() const {
+  return FormatName((io_ == NULL) ? "blocking" : io_->Name());
+}
+
+CacheInterface* AsyncFileCache::Backend() {
+  return file_cache_;
+}
+
+bool AsyncFileCache::IsHealthy() const {
+  return !stopped_.value() && file_cache_->IsHealthy();
+}
+
+void AsyncFileCache::ShutDown() {
+  stopped_.set_value(true);
+}
+
+void AsyncFileCache::Get(const GoogleString& key, Callback* callback) {
+  GoogleString filename;
+  if (!IsHealthy() || !file_cache_->EncodeFilename(key, &filename)) {
+    ValidateAndReportResult(key, kNotFound, callback);
+    return;
+  }
+  if (io_ == NULL) {
+    file_cache_->Get(key, callback);
+    return;
+  }
+  outstanding_operations_.NoBarrierIncrement(1);
+  io_->ReadFile(filename, new ReadCallback(this, key, filename, callback));
+}
+
+void AsyncFileCache::MultiGet(MultiGetRequest* request) {
+  if (io_ == NULL) {
+    CacheInterface::MultiGet(request);
+    return;
+  }
+  bool healthy = IsHealthy();
+  AsyncFileIo::FileReadVector reads;
+  reads.reserve(request->size());
+  for (int i = 0, n = request->size(); i < n; ++i) {
+    KeyCallback& key_callback = (*request)[i];
+    GoogleString filename;
+    if (!healthy || !file_cache_->EncodeFilename(key_callback.key, &filename)) {
+      ValidateAndReportResult(key_callback.key, kNotFound,
+                              key_callback.callback);
+    } else {
+      reads.push_back(AsyncFileIo::FileRead(
+          filename, new ReadCallback(this, key_callback.key, filename,
+                                     key_callback.callback)));
+    }
+  }
+  delete request;
+  if (!reads.empty()) {
+    outstanding_operations_.NoBarrierIncrement(reads.size());
+    io_->ReadFiles(reads);
+  }
+}
+
+void AsyncFileCache::Put(const GoogleString& key, SharedString* value) {
+  GoogleString filename;
+  if (!IsHealthy() || !file_cache_->EncodeFilename(key, &filename)) {
+    return;
+  }
+  if (io_ == NULL) {
+    file_cache_->Put(key, value);
+    return;
+  }
+  outstanding_operations_.NoBarrierIncrement(1);
+  io_->WriteFileAtomic(filename, *value,
+                       new WriteCallback(this, filename, value->size()));
+
+  // The cleaning itself runs on the FileCache's worker.
+  file_cache_->CleanIfNeeded();
+}
+
+void AsyncFileCache::Delete(const GoogleString& key) {
+  file_cache_->Delete(key);
+}
+
+}  // namespace net_instaweb
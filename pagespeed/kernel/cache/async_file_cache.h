@@ -0,0 +1,87 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_ASYNC_FILE_CACHE_H_
+#define PAGESPEED_KERNEL_CACHE_ASYNC_FILE_CACHE_H_
+
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/cache_interface.h"
+
+namespace net_instaweb {
+
+class AsyncFileIo;
+class FileCache;
+class SharedString;
+
+// Non-blocking view of a FileCache, which reads and writes the cache's files
+// through an AsyncFileIo rather than blocking the calling thread.  Unlike
+// wrapping the FileCache in an AsyncCache, this does not tie up a thread
+// per outstanding operation, and does not serialize them.
+//
+// The FileCache continues to own the files, naming, statistics and
+// cleaning, and remains usable directly for callers that need a blocking
+// cache.  Deletes are rare and cheap, and are passed to it synchronously.
+class AsyncFileCache : public CacheInterface {
+ public:
+  // Does not take ownership of file_cache or io, which must outlive any
+  // operations issued through this cache; shutting down io waits for them.
+  // io may be NULL, in which case operations are passed synchronously to
+  // file_cache until set_io() is called.  This lets servers build their
+  // cache hierarchy before forking, and start I/O threads afterwards.
+  AsyncFileCache(FileCache* file_cache, AsyncFileIo* io);
+  virtual ~AsyncFileCache();
+
+  // Must be called before any operations are issued through this cache.
+  void set_io(AsyncFileIo* io) { io_ = io; }
+
+  virtual void Get(const GoogleString& key, Callback* callback);
+
+  // Passes all the reads to io together, so they can be started at once.
+  virtual void MultiGet(MultiGetRequest* request);
+  virtual void Put(const GoogleString& key, SharedString* value);
+  virtual void Delete(const GoogleString& key);
+  virtual CacheInterface* Backend();
+  static GoogleString FormatName(StringPiece io_name);
+  virtual GoogleString Name() const;
+  virtual bool IsBlocking() const { return false; }
+  virtual bool IsHealthy() const;
+
+  // Subsequent Gets report kNotFound, and Puts are dropped.  Operations
+  // already passed to io are completed.
+  virtual void ShutDown();
+
+  // Number of Gets and Puts passed to io that have not yet completed.
+  int32 outstanding_operations() { return outstanding_operations_.value(); }
+
+ private:
+  class ReadCallback;
+  class WriteCallback;
+
+  FileCache* file_cache_;
+  AsyncFileIo* io_;
+  AtomicBool stopped_;
+  AtomicInt32 outstanding_operations_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncFileCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_ASYNC_FILE_CACHE_H_
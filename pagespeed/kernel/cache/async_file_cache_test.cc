@@ -0,0 +1,293 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the asynchronous file cache, against both io backends.
+
+#include "pagespeed/kernel/cache/async_file_cache.h"
+
+#include <unistd.h>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/cache/file_cache.h"
+#include "pagespeed/kernel/thread/slow_worker.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/io_uring_file_io.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "pagespeed/kernel/util/threaded_file_io.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int64 kCleanIntervalMs = Timer::kHourMs;
+const int64 kTargetSize = 1000 * 1000;
+const int64 kTargetInodeLimit = 1000;
+
+}  // namespace
+
+// The parameter selects io_uring rather than the thread pool.  Where
+// io_uring is unavailable, those tests pass trivially.
+class AsyncFileCacheTest : public CacheTestBase,
+                           public ::testing::WithParamInterface<bool> {
+ protected:
+  class AsyncCallback : public CacheTestBase::Callback {
+   public:
+    explicit AsyncCallback(AsyncFileCacheTest* test)
+        : Callback(test),
+          sync_point_(test->thread_system_.get()) {
+    }
+
+    virtual void Done(CacheInterface::KeyState state) {
+      Callback::Done(state);
+      sync_point_.Notify();
+    }
+
+    virtual void Wait() { sync_point_.Wait(); }
+
+   private:
+    WorkerTestBase::SyncPoint sync_point_;
+  };
+
+  AsyncFileCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        timer_(thread_system_->NewTimer()),
+        worker_("cleaner", thread_system_.get()),
+        stats_(thread_system_.get()),
+        path_(StrCat(GTestTempDir(), "/async_file_cache")) {
+    set_mutex(thread_system_->NewMutex());
+    FileCache::InitStats(&stats_);
+  }
+
+  virtual void SetUp() {
+    RemoveRecursively(path_);
+    ASSERT_TRUE(file_system_.RecursivelyMakeDir(path_, &message_handler_));
+    worker_.Start();
+    file_cache_.reset(new FileCache(
+        path_, &file_system_, thread_system_.get(), &worker_,
+        new FileCache::CachePolicy(timer_.get(), &hasher_, kCleanIntervalMs,
+                                   kTargetSize, kTargetInodeLimit),
+        &stats_, &message_handler_));
+    threaded_io_.reset(new ThreadedFileIo(2, &file_system_,
+                                          thread_system_.get(),
+                                          &message_handler_));
+    AsyncFileIo* io = threaded_io_.get();
+    if (GetParam()) {
+      io_uring_.reset(IoUringFileIo::Create(
+          16, 2, threaded_io_.get(), thread_system_.get(),
+          &message_handler_));
+      io = io_uring_.get();
+    }
+    if (io != NULL) {
+      cache_.reset(new AsyncFileCache(file_cache_.get(), io));
+    }
+  }
+
+  virtual void TearDown() {
+    // Quiesce before destructing the caches.
+    if (io_uring_.get() != NULL) {
+      io_uring_->ShutDown();
+    }
+    threaded_io_->ShutDown();
+  }
+
+  // Returns false if the backend under test is not available here.
+  bool Available() { return cache_.get() != NULL; }
+
+  virtual CacheInterface* Cache() { return cache_.get(); }
+  virtual Callback* NewCallback() { return new AsyncCallback(this); }
+
+  // Puts are only known to be visible once they complete.
+  virtual void PostOpCleanup() {
+    while (cache_->outstanding_operations() != 0) {
+      usleep(10);
+    }
+  }
+
+  void RemoveRecursively(const GoogleString& path) {
+    NullMessageHandler null_handler;
+    if (file_system_.IsDir(path.c_str(), &null_handler).is_true()) {
+      StringVector files;
+      file_system_.ListContents(path, &files, &null_handler);
+      for (int i = 0, n = files.size(); i < n; ++i) {
+        RemoveRecursively(files[i]);
+      }
+      file_system_.RemoveDir(path.c_str(), &null_handler);
+    } else {
+      file_system_.RemoveFile(path.c_str(), &null_handler);
+    }
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<Timer> timer_;
+  MD5Hasher hasher_;
+  SlowWorker worker_;
+  StdioFileSystem file_system_;
+  SimpleStats stats_;
+  GoogleMessageHandler message_handler_;
+  const GoogleString path_;
+  scoped_ptr<FileCache> file_cache_;
+  scoped_ptr<ThreadedFileIo> threaded_io_;
+  scoped_ptr<IoUringFileIo> io_uring_;
+  scoped_ptr<AsyncFileCache> cache_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AsyncFileCacheTest);
+};
+
+TEST_P(AsyncFileCacheTest, PutGetDelete) {
+  if (!Available()) {
+    return;
+  }
+  EXPECT_FALSE(cache_->IsBlocking());
+  EXPECT_EQ(file_cache_.get(), cache_->Backend());
+
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  CheckNotFound("Another Name");
+
+  CheckPut("Name", "NewValue");
+  CheckGet("Name", "NewValue");
+
+  CheckDelete("Name");
+  CheckNotFound("Name");
+}
+
+TEST_P(AsyncFileCacheTest, SharedWithBlockingCache) {
+  if (!Available()) {
+    return;
+  }
+  CheckPut("Name", "Value");
+  CheckGet(file_cache_.get(), "Name", "Value");
+  CheckPut(file_cache_.get(), "Other", "Stuff");
+  CheckGet("Other", "Stuff");
+}
+
+TEST_P(AsyncFileCacheTest, LargeValue) {
+  if (!Available()) {
+    return;
+  }
+  // Bigger than any single read or write the backends issue.
+  GoogleString value;
+  for (int i = 0; value.size() < 3 * 1000 * 1000; ++i) {
+    StrAppend(&value, IntegerToString(i), " ");
+  }
+  CheckPut("Big", value);
+  CheckGet("Big", value);
+}
+
+TEST_P(AsyncFileCacheTest, EmptyValue) {
+  if (!Available()) {
+    return;
+  }
+  CheckPut("Empty", "");
+  CheckGet("Empty", "");
+}
+
+TEST_P(AsyncFileCacheTest, MultiGet) {
+  if (!Available()) {
+    return;
+  }
+  TestMultiGet();
+}
+
+TEST_P(AsyncFileCacheTest, ManyOutstanding) {
+  if (!Available()) {
+    return;
+  }
+  // More than the ring holds at once.
+  const int kNumKeys = 100;
+  for (int i = 0; i < kNumKeys; ++i) {
+    SharedString value(StrCat("v", IntegerToString(i)));
+    cache_->Put(StrCat("k", IntegerToString(i)), &value);
+  }
+  PostOpCleanup();
+
+  Callback* callbacks[kNumKeys];
+  for (int i = 0; i < kNumKeys; ++i) {
+    callbacks[i] = InitiateGet(StrCat("k", IntegerToString(i)));
+  }
+  for (int i = 0; i < kNumKeys; ++i) {
+    WaitAndCheck(callbacks[i], StrCat("v", IntegerToString(i)));
+  }
+  EXPECT_EQ(0, stats_.GetVariable(FileCache::kWriteErrors)->Get());
+}
+
+TEST_P(AsyncFileCacheTest, ManyOutstandingMultiGet) {
+  if (!Available()) {
+    return;
+  }
+  const int kNumKeys = 100;
+  for (int i = 0; i < kNumKeys; i += 2) {
+    SharedString value(StrCat("v", IntegerToString(i)));
+    cache_->Put(StrCat("k", IntegerToString(i)), &value);
+  }
+  PostOpCleanup();
+
+  // Every other key is missing.
+  CacheInterface::MultiGetRequest* request =
+      new CacheInterface::MultiGetRequest;
+  Callback* callbacks[kNumKeys];
+  for (int i = 0; i < kNumKeys; ++i) {
+    callbacks[i] = AddCallback();
+    request->push_back(CacheInterface::KeyCallback(
+        StrCat("k", IntegerToString(i)), callbacks[i]));
+  }
+  cache_->MultiGet(request);
+  for (int i = 0; i < kNumKeys; i += 2) {
+    WaitAndCheck(callbacks[i], StrCat("v", IntegerToString(i)));
+    WaitAndCheckNotFound(callbacks[i + 1]);
+  }
+}
+
+TEST_P(AsyncFileCacheTest, ShutDown) {
+  if (!Available()) {
+    return;
+  }
+  CheckPut("Name", "Value");
+  cache_->ShutDown();
+  EXPECT_FALSE(cache_->IsHealthy());
+  CheckNotFound("Name");
+  CheckPut("Other", "Stuff");
+  CheckGet(file_cache_.get(), "Name", "Value");
+  CheckNotFound(file_cache_.get(), "Other");
+}
+
+TEST_P(AsyncFileCacheTest, NoIo) {
+  // Until it's given an io, the cache just blocks.
+  AsyncFileCache cache(file_cache_.get(), NULL);
+  EXPECT_EQ("AsyncFileCache(blocking)", cache.Name());
+  CheckPut(&cache, "Name", "Value");
+  CheckGet(&cache, "Name", "Value");
+  CheckGet(file_cache_.get(), "Name", "Value");
+}
+
+INSTANTIATE_TEST_CASE_P(AsyncFileCacheTestInstance, AsyncFileCacheTest,
+                        ::testing::Bool());
+
+}  // namespace net_instaweb
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/cache_codec.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/string_util.h"
+#ifdef USE_SYSTEM_ZLIB
+#include "zlib.h"  // NOLINT
+#else
+#include "third_party/zlib/zlib.h"
+#endif
+
+namespace net_instaweb {
+
+namespace {
+
+// Dictionary training looks for kKmerSize-byte strings shared between
+// samples, and builds the dictionary out of kSegmentSize-byte pieces of
+// samples that contain many of them.
+const int kKmerSize = 8;
+const int kSegmentSize = 32;
+
+const int kChecksumSize = 4;
+
+// Size of each step by which Decode grows its output.
+const int kInflateChunkSize = 4096;
+
+uint32 Checksum(StringPiece data) {
+  uLong adler = adler32(0L, Z_NULL, 0);
+  return adler32(adler, reinterpret_cast<const Bytef*>(data.data()),
+                 data.size());
+}
+
+typedef std::map<StringPiece, int> KmerCounts;
+
+// Sums the counts of the shared k-mers in segment that aren't in covered.
+int ScoreSegment(StringPiece segment, const KmerCounts& counts,
+                 const std::set<StringPiece>& covered) {
+  int score = 0;
+  for (int i = 0; i + kKmerSize <= static_cast<int>(segment.size()); ++i) {
+    StringPiece kmer = segment.substr(i, kKmerSize);
+    KmerCounts::const_iterator p = counts.find(kmer);
+    if ((p != counts.end()) && (p->second > 1) &&
+        (covered.find(kmer) == covered.end())) {
+      score += p->second;
+    }
+  }
+  return score;
+}
+
+bool HigherScore(const std::pair<int, StringPiece>& a,
+                 const std::pair<int, StringPiece>& b) {
+  return a.first > b.first;
+}
+
+}  // namespace
+
+const char StoredCacheCodec::kId;
+const char DeflateCacheCodec::kId;
+const char DeflateCacheCodec::kDictionaryId;
+
+CacheCodec::~CacheCodec() {
+}
+
+StoredCacheCodec::~StoredCacheCodec() {
+}
+
+bool StoredCacheCodec::Encode(StringPiece in, GoogleString* out) const {
+  uint32 checksum = Checksum(in);
+  for (int i = 0; i < kChecksumSize; ++i) {
+    out->push_back(static_cast<char>(checksum >> (8 * i)));
+  }
+  in.AppendToString(out);
+  return true;
+}
+
+bool StoredCacheCodec::Decode(StringPiece in, GoogleString* out) const {
+  if (in.size() < static_cast<size_t>(kChecksumSize)) {
+    return false;
+  }
+  uint32 checksum = 0;
+  for (int i = 0; i < kChecksumSize; ++i) {
+    checksum |= static_cast<uint32>(static_cast<unsigned char>(in[i]))
+        << (8 * i);
+  }
+  StringPiece data = in.substr(kChecksumSize);
+  if (Checksum(data) != checksum) {
+    return false;
+  }
+  data.AppendToString(out);
+  return true;
+}
+
+DeflateCacheCodec::DeflateCacheCodec(int level, StringPiece dictionary)
+    : level_(level) {
+  dictionary.CopyToString(&dictionary_);
+}
+
+DeflateCacheCodec::~DeflateCacheCodec() {
+}
+
+char DeflateCacheCodec::id() const {
+  return dictionary_.empty() ? kId : kDictionaryId;
+}
+
+GoogleString DeflateCacheCodec::Name() const {
+  return StrCat("Deflate", IntegerToString(level_),
+                dictionary_.empty() ? "" : "WithDictionary");
+}
+
+bool DeflateCacheCodec::Encode(StringPiece in, GoogleString* out) const {
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  if (deflateInit(&strm, level_) != Z_OK) {
+    return false;
+  }
+  if (!dictionary_.empty() &&
+      (deflateSetDictionary(
+          &strm, reinterpret_cast<const Bytef*>(dictionary_.data()),
+          dictionary_.size()) != Z_OK)) {
+    deflateEnd(&strm);
+    return false;
+  }
+
+  // deflateBound gives enough room to finish in one call.
+  size_t start = out->size();
+  size_t bound = deflateBound(&strm, in.size());
+  out->resize(start + bound);
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  strm.avail_in = in.size();
+  strm.next_out = reinterpret_cast<Bytef*>(&(*out)[start]);
+  strm.avail_out = bound;
+  int ret = deflate(&strm, Z_FINISH);
+  out->resize(start + bound - strm.avail_out);
+  deflateEnd(&strm);
+  return (ret == Z_STREAM_END);
+}
+
+bool DeflateCacheCodec::Decode(StringPiece in, GoogleString* out) const {
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.next_in = Z_NULL;
+  strm.avail_in = 0;
+  if (inflateInit(&strm) != Z_OK) {
+    return false;
+  }
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  strm.avail_in = in.size();
+
+  size_t start = out->size();
+  size_t produced = 0;
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    out->resize(start + produced + kInflateChunkSize);
+    strm.next_out = reinterpret_cast<Bytef*>(&(*out)[start + produced]);
+    strm.avail_out = kInflateChunkSize;
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if ((ret == Z_NEED_DICT) && !dictionary_.empty()) {
+      // This fails if the stream was written with a different dictionary.
+      ret = inflateSetDictionary(
+          &strm, reinterpret_cast<const Bytef*>(dictionary_.data()),
+          dictionary_.size());
+    }
+    produced += kInflateChunkSize - strm.avail_out;
+    if ((ret == Z_BUF_ERROR) && (strm.avail_out == 0)) {
+      // No progress was possible only because the output was full.
+      ret = Z_OK;
+    }
+  }
+  out->resize(start + produced);
+  inflateEnd(&strm);
+  return (ret == Z_STREAM_END) && (strm.avail_in == 0);
+}
+
+GoogleString DeflateCacheCodec::TrainDictionary(const StringVector& samples,
+                                                int max_size) {
+  // Count the number of samples each k-mer appears in.
+  KmerCounts counts;
+  for (int s = 0, n = samples.size(); s < n; ++s) {
+    StringPiece sample(samples[s]);
+    std::set<StringPiece> seen;
+    for (int i = 0; i + kKmerSize <= static_cast<int>(sample.size()); ++i) {
+      StringPiece kmer = sample.substr(i, kKmerSize);
+      if (seen.insert(kmer).second) {
+        ++counts[kmer];
+      }
+    }
+  }
+
+  // Score every segment, and take the best ones, skipping any whose
+  // strings are already covered by segments taken before them.
+  std::set<StringPiece> covered;
+  std::vector<std::pair<int, StringPiece> > segments;
+  for (int s = 0, n = samples.size(); s < n; ++s) {
+    StringPiece sample(samples[s]);
+    for (int i = 0; i < static_cast<int>(sample.size()); i += kKmerSize) {
+      StringPiece segment = sample.substr(i, kSegmentSize);
+      int score = ScoreSegment(segment, counts, covered);
+      if (score > 0) {
+        segments.push_back(std::make_pair(score, segment));
+      }
+    }
+  }
+  std::stable_sort(segments.begin(), segments.end(), HigherScore);
+
+  std::vector<StringPiece> chosen;
+  int size = 0;
+  for (int i = 0, n = segments.size(); (i < n) && (size < max_size); ++i) {
+    StringPiece segment = segments[i].second;
+    if (ScoreSegment(segment, counts, covered) * 2 < segments[i].first) {
+      continue;
+    }
+    if (size + static_cast<int>(segment.size()) > max_size) {
+      segment = segment.substr(0, max_size - size);
+    }
+    for (int j = 0; j + kKmerSize <= static_cast<int>(segment.size()); ++j) {
+      covered.insert(segment.substr(j, kKmerSize));
+    }
+    chosen.push_back(segment);
+    size += segment.size();
+  }
+
+  // zlib finds strings near the end of the dictionary most cheaply, so the
+  // best segments go last.
+  GoogleString dictionary;
+  dictionary.reserve(size);
+  for (int i = chosen.size() - 1; i >= 0; --i) {
+    chosen[i].AppendToString(&dictionary);
+  }
+  return dictionary;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_CACHE_CODEC_H_
+#define PAGESPEED_KERNEL_CACHE_CACHE_CODEC_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// Compresses and decompresses the values stored by CompressedCache.  Each
+// codec has a one-byte id, which CompressedCache writes in front of every
+// value, so that values written with one codec can still be read after the
+// cache switches to another.
+//
+// Implementations must be thread-safe.
+class CacheCodec {
+ public:
+  CacheCodec() {}
+  virtual ~CacheCodec();
+
+  // Identifies the format Encode produces.  Ids must not have 8 as their
+  // low nibble, since that's how the zlib streams written before codecs
+  // existed start.
+  virtual char id() const = 0;
+
+  virtual GoogleString Name() const = 0;
+
+  // Appends the encoded form of in to *out.  Returns false on failure.
+  virtual bool Encode(StringPiece in, GoogleString* out) const = 0;
+
+  // Appends the decoded form of in to *out.  Returns false if in is corrupt,
+  // or was not produced by a compatible codec.
+  virtual bool Decode(StringPiece in, GoogleString* out) const = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CacheCodec);
+};
+
+// Stores values as they are, plus a checksum so that corruption is still
+// detected.  CompressedCache uses this for values that don't compress.
+class StoredCacheCodec : public CacheCodec {
+ public:
+  static const char kId = 's';
+
+  StoredCacheCodec() {}
+  virtual ~StoredCacheCodec();
+
+  virtual char id() const { return kId; }
+  virtual GoogleString Name() const { return "Stored"; }
+  virtual bool Encode(StringPiece in, GoogleString* out) const;
+  virtual bool Decode(StringPiece in, GoogleString* out) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StoredCacheCodec);
+};
+
+// Compresses with zlib at a given level, optionally using a preset
+// dictionary.  A dictionary helps a lot with values that are too small to
+// compress well on their own, such as metadata and property cache protos,
+// as long as it contains the strings they have in common.
+class DeflateCacheCodec : public CacheCodec {
+ public:
+  static const char kId = 'd';
+  static const char kDictionaryId = 'D';
+
+  // level is a zlib compression level, from 1 (fastest) to 9 (smallest).
+  // If dictionary is non-empty, it's used as a preset dictionary, and values
+  // can only be decoded by a codec with the same dictionary.
+  DeflateCacheCodec(int level, StringPiece dictionary);
+  virtual ~DeflateCacheCodec();
+
+  virtual char id() const;
+  virtual GoogleString Name() const;
+  virtual bool Encode(StringPiece in, GoogleString* out) const;
+  virtual bool Decode(StringPiece in, GoogleString* out) const;
+
+  // Builds a dictionary of at most max_size bytes out of the substrings
+  // most common among samples, which should be representative values.
+  static GoogleString TrainDictionary(const StringVector& samples,
+                                      int max_size);
+
+ private:
+  int level_;
+  GoogleString dictionary_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeflateCacheCodec);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_CACHE_CODEC_H_
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/cache_codec.h"
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/util/simple_random.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Something shaped like a small metadata cache entry: mostly the same
+// field names and URL prefixes, with a few unique bytes.
+GoogleString MetadataValue(SimpleRandom* random, int i) {
+  return StrCat(
+      "cached_result { optimizable: true url: \"http://www.example.com/"
+      "images/photo", IntegerToString(i), ".jpg.pagespeed.ic.",
+      random->GenerateHighEntropyString(10), ".jpg\" input { type: FILE "
+      "filename: \"/var/www/images/photo", IntegerToString(i),
+      ".jpg\" last_modified_time_ms: 1467312000000 } }");
+}
+
+class CacheCodecTest : public testing::Test {
+ protected:
+  CacheCodecTest() : random_(new NullMutex) {}
+
+  void RoundTrip(const CacheCodec& codec, StringPiece value) {
+    GoogleString encoded("prefix");
+    ASSERT_TRUE(codec.Encode(value, &encoded));
+    ASSERT_TRUE(StringPiece(encoded).starts_with("prefix"));
+    GoogleString decoded("prefix");
+    ASSERT_TRUE(codec.Decode(StringPiece(encoded).substr(6), &decoded));
+    EXPECT_EQ(StrCat("prefix", value), decoded);
+  }
+
+  void CheckCorruptionDetected(const CacheCodec& codec, StringPiece value) {
+    GoogleString encoded;
+    ASSERT_TRUE(codec.Encode(value, &encoded));
+    GoogleString decoded;
+
+    GoogleString truncated(encoded, 0, encoded.size() - 1);
+    EXPECT_FALSE(codec.Decode(truncated, &decoded));
+
+    GoogleString flipped(encoded);
+    flipped[flipped.size() / 2] ^= 0x40;
+    EXPECT_FALSE(codec.Decode(flipped, &decoded));
+
+    EXPECT_FALSE(codec.Decode(StrCat(encoded, "x"), &decoded));
+  }
+
+  SimpleRandom random_;
+};
+
+TEST_F(CacheCodecTest, Stored) {
+  StoredCacheCodec codec;
+  RoundTrip(codec, "");
+  RoundTrip(codec, "value");
+  CheckCorruptionDetected(codec, "some value or other");
+  GoogleString decoded;
+  EXPECT_FALSE(codec.Decode("abc", &decoded));
+}
+
+TEST_F(CacheCodecTest, Deflate) {
+  DeflateCacheCodec fast(1, "");
+  DeflateCacheCodec best(9, "");
+  EXPECT_EQ(DeflateCacheCodec::kId, fast.id());
+  EXPECT_EQ("Deflate1", fast.Name());
+
+  GoogleString large = random_.GenerateHighEntropyString(100 * 1000);
+  RoundTrip(fast, "");
+  RoundTrip(fast, large);
+  RoundTrip(best, large);
+  GoogleString numbers;
+  for (int i = 0; i < 1000; ++i) {
+    StrAppend(&numbers, IntegerToString(i), " ");
+  }
+  CheckCorruptionDetected(fast, numbers);
+
+  // The compression level doesn't matter for decoding.
+  GoogleString encoded, decoded;
+  ASSERT_TRUE(fast.Encode(large, &encoded));
+  ASSERT_TRUE(best.Decode(encoded, &decoded));
+  EXPECT_EQ(large, decoded);
+}
+
+TEST_F(CacheCodecTest, Dictionary) {
+  StringVector samples;
+  for (int i = 0; i < 50; ++i) {
+    samples.push_back(MetadataValue(&random_, i));
+  }
+  GoogleString dictionary = DeflateCacheCodec::TrainDictionary(samples, 1024);
+  EXPECT_GE(1024, static_cast<int>(dictionary.size()));
+  EXPECT_NE(GoogleString::npos, dictionary.find("http://www.example.com/"));
+
+  DeflateCacheCodec plain(6, "");
+  DeflateCacheCodec with_dictionary(6, dictionary);
+  EXPECT_EQ(DeflateCacheCodec::kDictionaryId, with_dictionary.id());
+
+  GoogleString value = MetadataValue(&random_, 1000);
+  RoundTrip(with_dictionary, value);
+  CheckCorruptionDetected(with_dictionary, value);
+  GoogleString plain_encoded, dictionary_encoded;
+  ASSERT_TRUE(plain.Encode(value, &plain_encoded));
+  ASSERT_TRUE(with_dictionary.Encode(value, &dictionary_encoded));
+  EXPECT_GT(plain_encoded.size(), 2 * dictionary_encoded.size());
+
+  // Values written with a dictionary need the same one to be read back.
+  GoogleString decoded;
+  EXPECT_FALSE(plain.Decode(dictionary_encoded, &decoded));
+  DeflateCacheCodec other_dictionary(6, "something else entirely");
+  EXPECT_FALSE(other_dictionary.Decode(dictionary_encoded, &decoded));
+}
+
+TEST_F(CacheCodecTest, TrainDictionaryWithoutCommonStrings) {
+  StringVector samples;
+  samples.push_back(random_.GenerateHighEntropyString(100));
+  samples.push_back(random_.GenerateHighEntropyString(100));
+  EXPECT_EQ("", DeflateCacheCodec::TrainDictionary(samples, 1024));
+  EXPECT_EQ("", DeflateCacheCodec::TrainDictionary(StringVector(), 1024));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
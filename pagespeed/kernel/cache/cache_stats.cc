@@ -160,6 +160,18 @@ void CacheStats::MultiGet(MultiGetRequest* request) {
   }
 }
 
+void CacheStats::AddToBackendMultiGet(const GoogleString& key,
+                                      Callback* callback,
+                                      MultiGetRequest* request) {
+  if (shutdown_.value()) {
+    ValidateAndReportResult(key, CacheInterface::kNotFound, callback);
+  } else {
+    request->push_back(
+        KeyCallback(key, new StatsCallback(this, timer_, callback)));
+    get_count_histogram_->Add(1);
+  }
+}
+
 void CacheStats::Put(const GoogleString& key, SharedString* value) {
   if (!shutdown_.value()) {
     int64 start_time_us = timer_->NowUs();
@@ -55,6 +55,22 @@ class CacheStats : public CacheInterface {
   virtual void Delete(const GoogleString& key);
   virtual CacheInterface* Backend() { return cache_; }
   virtual bool IsBlocking() const { return cache_->IsBlocking(); }
+  virtual uint64 AdmissionFingerprint(const GoogleString& key) {
+    return cache_->AdmissionFingerprint(key);
+  }
+  virtual bool PeekEvictionVictim(const GoogleString& key, size_t value_size,
+                                  uint64* victim) {
+    return cache_->PeekEvictionVictim(key, value_size, victim);
+  }
+
+  // Adds a lookup of key to request, counted against these statistics as
+  // if it were a Get.  The caller must pass request to Backend()->MultiGet.
+  // This lets lookups through several CacheStats that share a backend be
+  // sent to it in one batch, while each is still measured under its own
+  // prefix.  If this cache has been shut down, callback is instead told
+  // the key was not found, and nothing is added to request.
+  void AddToBackendMultiGet(const GoogleString& key, Callback* callback,
+                            MultiGetRequest* request);
 
   virtual bool IsHealthy() const {
     return !shutdown_.value() && cache_->IsHealthy();
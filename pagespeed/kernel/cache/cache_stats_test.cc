@@ -101,6 +101,42 @@ TEST_F(CacheStatsTest, BasicOperation) {
   // EXPECT_EQ(1, latency->Count());
 }
 
+TEST_F(CacheStatsTest, AddToBackendMultiGet) {
+  CacheStats::InitStats("other", &stats_);
+  CacheStats other_stats("other", delay_cache_.get(), &timer_, &stats_);
+  SharedString put_buffer("val");
+  cache_stats_->Put("key", &put_buffer);
+
+  // Lookups through both wrappers go to the shared backend in one batch,
+  // but are counted separately.
+  CacheTestBase::Callback hit, miss, other_hit;
+  CacheInterface::MultiGetRequest* request =
+      new CacheInterface::MultiGetRequest;
+  cache_stats_->AddToBackendMultiGet("key", &hit, request);
+  cache_stats_->AddToBackendMultiGet("no such key", &miss, request);
+  other_stats.AddToBackendMultiGet("key", &other_hit, request);
+  ASSERT_EQ(static_cast<size_t>(3), request->size());
+  cache_stats_->Backend()->MultiGet(request);
+
+  EXPECT_EQ(CacheInterface::kAvailable, hit.state());
+  EXPECT_EQ(CacheInterface::kNotFound, miss.state());
+  EXPECT_EQ(CacheInterface::kAvailable, other_hit.state());
+  EXPECT_EQ(1, stats_.GetVariable("test_hits")->Get());
+  EXPECT_EQ(1, stats_.GetVariable("test_misses")->Get());
+  EXPECT_EQ(1, stats_.GetVariable("other_hits")->Get());
+  EXPECT_EQ(0, stats_.GetVariable("other_misses")->Get());
+
+  // Once shut down, nothing is added.
+  CacheTestBase::Callback after_shutdown;
+  request = new CacheInterface::MultiGetRequest;
+  other_stats.ShutDown();
+  other_stats.AddToBackendMultiGet("key", &after_shutdown, request);
+  EXPECT_TRUE(request->empty());
+  EXPECT_TRUE(after_shutdown.called());
+  EXPECT_EQ(CacheInterface::kNotFound, after_shutdown.state());
+  delete request;
+}
+
 TEST_F(CacheStatsTest, Backend) {
   EXPECT_EQ(delay_cache_.get(), cache_stats_->Backend());
 }
@@ -22,9 +22,8 @@
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string_util.h"
-#include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/cache/cache_codec.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
-#include "pagespeed/kernel/util/gzip_inflater.h"
 
 namespace net_instaweb {
 
@@ -49,12 +48,20 @@ const char kCompressedCacheCompressedSize[] =
 const char kCompressedCacheCorruptPayloads[] =
     "compressed_cache_corrupt_payloads";
 
-class CompressedCallback : public CacheInterface::Callback {
+// zlib's own default level.
+const int kDefaultLevel = 6;
+
+// What StoredCacheCodec adds to a value, plus the id byte.
+const int kStoredOverhead = 5;
+
+}  // namespace
+
+class CompressedCache::CompressedCallback : public CacheInterface::Callback {
  public:
   CompressedCallback(CacheInterface::Callback* callback,
-                     Variable* corrupt_payloads)
+                     const CompressedCache* cache)
       : callback_(callback),
-        corrupt_payloads_(corrupt_payloads),
+        cache_(cache),
         validate_candidate_called_(false) {
   }
 
@@ -66,17 +73,12 @@ class CompressedCallback : public CacheInterface::Callback {
     bool ret = false;
     if (state == CacheInterface::kAvailable) {
       GoogleString uncompressed;
-      StringWriter writer(&uncompressed);
-      StringPiece compressed = value()->Value();
-      if (compressed.ends_with(StringPiece(kTrailer,
-                                           STATIC_STRLEN(kTrailer))) &&
-          GzipInflater::Inflate(compressed.substr(
-              0, compressed.size() - STATIC_STRLEN(kTrailer)), &writer)) {
+      if (cache_->Decode(value()->Value(), &uncompressed)) {
         callback_->value()->SwapWithString(&uncompressed);
         ret = true;
       } else {
         state = CacheInterface::kNotFound;
-        corrupt_payloads_->Add(1);
+        cache_->corrupt_payloads_->Add(1);
       }
     }
     ret &= callback_->DelegatedValidateCandidate(key, state);
@@ -89,15 +91,19 @@ class CompressedCallback : public CacheInterface::Callback {
     delete this;
   }
 
+ private:
   Callback* callback_;
-  Variable* corrupt_payloads_;
+  const CompressedCache* cache_;
   bool validate_candidate_called_;
-};
 
-}  // namespace
+  DISALLOW_COPY_AND_ASSIGN(CompressedCallback);
+};
 
 CompressedCache::CompressedCache(CacheInterface* cache, Statistics* stats)
-    : cache_(cache) {
+    : cache_(cache),
+      codec_(new DeflateCacheCodec(kDefaultLevel, "")),
+      default_codec_(new DeflateCacheCodec(kDefaultLevel, "")),
+      stored_codec_(new StoredCacheCodec) {
 #if INCLUDE_HISTOGRAMS
   compressed_cache_savings_ = stats->GetHistogram(kCompressedCacheSavings);
 #endif
@@ -109,6 +115,10 @@ CompressedCache::CompressedCache(CacheInterface* cache, Statistics* stats)
 CompressedCache::~CompressedCache() {
 }
 
+void CompressedCache::set_codec(CacheCodec* codec) {
+  codec_.reset(codec);
+}
+
 GoogleString CompressedCache::FormatName(StringPiece name) {
   return StrCat("Compressed(", name, ")");
 }
@@ -123,25 +133,66 @@ void CompressedCache::InitStats(Statistics* statistics) {
 }
 
 void CompressedCache::Get(const GoogleString& key, Callback* callback) {
-  CompressedCallback* cb = new CompressedCallback(callback, corrupt_payloads_);
+  CompressedCallback* cb = new CompressedCallback(callback, this);
   cache_->Get(key, cb);
 }
 
+void CompressedCache::MultiGet(MultiGetRequest* request) {
+  for (int i = 0, n = request->size(); i < n; ++i) {
+    KeyCallback& key_callback = (*request)[i];
+    key_callback.callback = new CompressedCallback(key_callback.callback,
+                                                   this);
+  }
+  cache_->MultiGet(request);
+}
+
 void CompressedCache::Put(const GoogleString& key, SharedString* value) {
   int64 old_size = value->size();
   GoogleString buf;
-  buf.reserve(old_size + STATIC_STRLEN(kTrailer));
-  StringWriter writer(&buf);
+  buf.reserve(old_size + STATIC_STRLEN(kTrailer) + 8);
   original_size_->Add(old_size);
-  if (GzipInflater::Deflate(value->Value(), &writer)) {
-    buf.append(kTrailer, STATIC_STRLEN(kTrailer));
+  buf.push_back(codec_->id());
+  if (!codec_->Encode(value->Value(), &buf)) {
+    return;
+  }
+
+  if (static_cast<int64>(buf.size()) > old_size + kStoredOverhead) {
+    buf.clear();
+    buf.push_back(stored_codec_->id());
+    stored_codec_->Encode(value->Value(), &buf);
+  }
+  buf.append(kTrailer, STATIC_STRLEN(kTrailer));
 #if INCLUDE_HISTOGRAMS
-    compressed_cache_savings_->Add(
-        old_size - static_cast<int64>(buf.size()));
+  compressed_cache_savings_->Add(
+      old_size - static_cast<int64>(buf.size()));
 #endif
-    compressed_size_->Add(buf.size());
-    cache_->PutSwappingString(key, &buf);
+  compressed_size_->Add(buf.size());
+  cache_->PutSwappingString(key, &buf);
+}
+
+bool CompressedCache::Decode(StringPiece physical, GoogleString* out) const {
+  StringPiece trailer(kTrailer, STATIC_STRLEN(kTrailer));
+  if (!physical.ends_with(trailer)) {
+    return false;
+  }
+  StringPiece payload = physical.substr(0, physical.size() - trailer.size());
+  if (payload.empty()) {
+    return false;
+  }
+  char id = payload[0];
+  const CacheCodec* codec = NULL;
+  if (id == codec_->id()) {
+    codec = codec_.get();
+  } else if (id == default_codec_->id()) {
+    codec = default_codec_.get();
+  } else if (id == stored_codec_->id()) {
+    codec = stored_codec_.get();
+  } else {
+    // Values written before codecs were introduced are bare zlib streams,
+    // which don't start with any of our ids.
+    return default_codec_->Decode(payload, out);
   }
+  return codec->Decode(payload.substr(1), out);
 }
 
 void CompressedCache::Delete(const GoogleString& key) {
@@ -20,27 +20,40 @@
 #define PAGESPEED_KERNEL_CACHE_COMPRESSED_CACHE_H_
 
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 
 namespace net_instaweb {
 
+class CacheCodec;
 class Histogram;
 class SharedString;
 class Statistics;
 class Variable;
 
-// Compressed cache adapter.
+// Compressed cache adapter.  Values are compressed with a CacheCodec, whose
+// id is stored along with them.  Values that don't get smaller are stored
+// uncompressed instead, which saves decompressing them.
 class CompressedCache : public CacheInterface {
  public:
-  // Does not takes ownership of cache or stats.
+  // Does not takes ownership of cache or stats.  Compresses with zlib at its
+  // default level until set_codec is called.
   CompressedCache(CacheInterface* cache, Statistics* stats);
   virtual ~CompressedCache();
 
   static void InitStats(Statistics* stats);
 
+  // Takes ownership of codec, and uses it to compress values from now on.
+  // Values written with zlib without a dictionary, including those written
+  // before codecs were introduced, can always be read back; others only
+  // while the codec that wrote them is in use.  Must be called before the
+  // cache is used.
+  void set_codec(CacheCodec* codec);
+
   virtual void Get(const GoogleString& key, Callback* callback);
+  virtual void MultiGet(MultiGetRequest* request);
   virtual void Put(const GoogleString& key, SharedString* value);
   virtual void Delete(const GoogleString& key);
   virtual GoogleString Name() const { return FormatName(cache_->Name()); }
@@ -63,7 +76,16 @@ class CompressedCache : public CacheInterface {
   int64 CompressedSize() const;
 
  private:
+  class CompressedCallback;
+
+  // Decodes the physical value stored in the backend into *out, returning
+  // false if it's corrupt.
+  bool Decode(StringPiece physical, GoogleString* out) const;
+
   CacheInterface* cache_;
+  scoped_ptr<CacheCodec> codec_;
+  scoped_ptr<CacheCodec> default_codec_;
+  scoped_ptr<CacheCodec> stored_codec_;
   Histogram* compressed_cache_savings_;
   Variable* corrupt_payloads_;
   Variable* original_size_;
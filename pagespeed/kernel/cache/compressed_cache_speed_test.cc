@@ -22,6 +22,11 @@
 // randomly generated bytes, concatenated together to form the total size
 // we want.
 //
+// The BM_Codec benchmarks compare codecs on low-entropy 1M values, and on
+// ~300-byte values shaped like metadata cache entries, reporting MB/s of
+// uncompressed data put and read back.  They print the compression ratio
+// each codec achieves the first time they run.
+//
 //
 // Benchmark                  Time(ns)    CPU(ns) Iterations
 // ---------------------------------------------------------
@@ -29,6 +34,17 @@
 // BM_Compress1KHighEntropy      62425      63000      10000
 // BM_Compress1MLowEntropy     7175143    7100000        100
 // BM_Compress1KLowEntropy       16620      16514      41176
+//
+// Benchmark                        MB/s    Ratio
+// -----------------------------------------------
+// BM_CodecDefault1MLowEntropy     219.6   165.54
+// BM_CodecFast1MLowEntropy        376.6   127.88
+// BM_CodecDefaultMetadata          17.4     1.43
+// BM_CodecFastMetadata             18.9     1.43
+// BM_CodecDictionaryMetadata       48.9     5.50
+
+#include <cstdio>
+#include <set>
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/benchmark.h"
@@ -38,6 +54,8 @@
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/cache_codec.h"
 #include "pagespeed/kernel/cache/compressed_cache.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
 #include "pagespeed/kernel/util/platform.h"
@@ -78,6 +96,127 @@ void TestCachePayload(int payload_size, int chunk_size, int iters) {
   }
 }
 
+enum Codec { kDefault, kFast, kDictionary };
+
+const int kNumMetadataValues = 100;
+
+// Roughly what a metadata cache entry for a rewritten image looks like.
+GoogleString MetadataValue(net_instaweb::SimpleRandom* random, int i) {
+  GoogleString url = net_instaweb::StrCat(
+      "http://www.example.com/images/photo", net_instaweb::IntegerToString(i),
+      ".jpg");
+  return net_instaweb::StrCat(
+      "cached_result { optimizable: true url: \"", url, ".pagespeed.ic.",
+      random->GenerateHighEntropyString(10), ".jpg\" input { index: 0 "
+      "type: URL last_modified_time_ms: 1467312000000 expiration_time_ms: "
+      "1467398400000 url: \"", url, "\" } image_file_dims { width: 640 "
+      "height: 480 } } partitions { rewrite_succeeded: true }");
+}
+
+// Returns the codec to test, or NULL to leave CompressedCache's default.
+net_instaweb::CacheCodec* NewCodec(Codec codec,
+                                   net_instaweb::SimpleRandom* random) {
+  switch (codec) {
+    case kDefault:
+      break;
+    case kFast:
+      return new net_instaweb::DeflateCacheCodec(1, "");
+    case kDictionary: {
+      // Train on different entries than the ones being stored.
+      net_instaweb::StringVector samples;
+      for (int i = 0; i < kNumMetadataValues; ++i) {
+        samples.push_back(MetadataValue(random, kNumMetadataValues + i));
+      }
+      GoogleString dictionary =
+          net_instaweb::DeflateCacheCodec::TrainDictionary(samples, 4096);
+      return new net_instaweb::DeflateCacheCodec(6, dictionary);
+    }
+  }
+  return NULL;
+}
+
+// Puts and gets every value iters times, printing the compression ratio
+// under name the first time it's called.
+void TestCodec(const char* name, Codec codec,
+               const net_instaweb::StringVector& values, int iters) {
+  StopBenchmarkTiming();
+  scoped_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  net_instaweb::SimpleStats stats(thread_system.get());
+  net_instaweb::CompressedCache::InitStats(&stats);
+  int64 total_size = 0;
+  for (int i = 0, n = values.size(); i < n; ++i) {
+    total_size += values[i].size();
+  }
+  net_instaweb::LRUCache lru_cache(total_size * 2);
+  net_instaweb::CompressedCache compressed_cache(&lru_cache, &stats);
+  net_instaweb::CacheCodec* cache_codec = NewCodec(codec, &random);
+  if (cache_codec != NULL) {
+    compressed_cache.set_codec(cache_codec);
+  }
+  EmptyCallback empty_callback;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int v = 0, n = values.size(); v < n; ++v) {
+      GoogleString key = net_instaweb::IntegerToString(v);
+      net_instaweb::SharedString str(values[v]);
+      compressed_cache.Put(key, &str);
+      compressed_cache.Get(key, &empty_callback);
+    }
+  }
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * total_size);
+
+  static std::set<GoogleString>* reported = new std::set<GoogleString>;
+  if (reported->insert(name).second) {
+    printf("%s compression ratio: %.2f\n", name,
+           static_cast<double>(compressed_cache.OriginalSize()) /
+           compressed_cache.CompressedSize());
+  }
+}
+
+net_instaweb::StringVector LowEntropyValues() {
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  GoogleString chunk = random.GenerateHighEntropyString(1000);
+  GoogleString value;
+  while (value.size() < 1000 * 1000) {
+    value += chunk;
+  }
+  return net_instaweb::StringVector(1, value);
+}
+
+net_instaweb::StringVector MetadataValues() {
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  net_instaweb::StringVector values;
+  for (int i = 0; i < kNumMetadataValues; ++i) {
+    values.push_back(MetadataValue(&random, i));
+  }
+  return values;
+}
+
+static void BM_CodecDefault1MLowEntropy(int iters) {
+  TestCodec("BM_CodecDefault1MLowEntropy", kDefault, LowEntropyValues(),
+            iters);
+}
+
+static void BM_CodecFast1MLowEntropy(int iters) {
+  TestCodec("BM_CodecFast1MLowEntropy", kFast, LowEntropyValues(), iters);
+}
+
+static void BM_CodecDefaultMetadata(int iters) {
+  TestCodec("BM_CodecDefaultMetadata", kDefault, MetadataValues(), iters);
+}
+
+static void BM_CodecFastMetadata(int iters) {
+  TestCodec("BM_CodecFastMetadata", kFast, MetadataValues(), iters);
+}
+
+static void BM_CodecDictionaryMetadata(int iters) {
+  TestCodec("BM_CodecDictionaryMetadata", kDictionary, MetadataValues(),
+            iters);
+}
+
 static void BM_Compress1MHighEntropy(int iters) {
   TestCachePayload(1000*1000, 1000*1000, iters);
 }
@@ -100,3 +239,8 @@ BENCHMARK(BM_Compress1MHighEntropy);
 BENCHMARK(BM_Compress1KHighEntropy);
 BENCHMARK(BM_Compress1MLowEntropy);
 BENCHMARK(BM_Compress1KLowEntropy);
+BENCHMARK(BM_CodecDefault1MLowEntropy);
+BENCHMARK(BM_CodecFast1MLowEntropy);
+BENCHMARK(BM_CodecDefaultMetadata);
+BENCHMARK(BM_CodecFastMetadata);
+BENCHMARK(BM_CodecDictionaryMetadata);
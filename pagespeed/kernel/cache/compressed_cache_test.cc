@@ -26,10 +26,14 @@
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/stack_buffer.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_codec.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/cache_test_base.h"
 #include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/util/gzip_inflater.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_random.h"
 #include "pagespeed/kernel/util/simple_stats.h"
@@ -90,6 +94,11 @@ TEST_F(CompressedCacheTest, PutGetDelete) {
   EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
 }
 
+TEST_F(CompressedCacheTest, MultiGet) {
+  TestMultiGet();
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+}
+
 TEST_F(CompressedCacheTest, SizeTest) {
   GoogleString value(3 * kStackBufferSize, 'a');
   CheckPut("Name", value);
@@ -181,4 +190,53 @@ TEST_F(CompressedCacheTest, RemoveOneByteFromMiddle) {
   EXPECT_EQ(1, compressed_cache_->CorruptPayloads());
 }
 
+TEST_F(CompressedCacheTest, IncompressibleValueStored) {
+  GoogleString value = random_.GenerateHighEntropyString(1000);
+  CheckPut("key", value);
+  CheckGet("key", value);
+  GoogleString raw_value = GetRawValue("key");
+  EXPECT_EQ(StoredCacheCodec::kId, raw_value[0]);
+  EXPECT_EQ(value.size() + 9, raw_value.size());
+
+  // The stored value is still checked for corruption.
+  raw_value[raw_value.size() / 2] ^= 1;
+  lru_cache_->PutSwappingString("key", &raw_value);
+  CheckNotFound("key");
+  EXPECT_EQ(1, compressed_cache_->CorruptPayloads());
+}
+
+TEST_F(CompressedCacheTest, ReadsPayloadsWithoutCodecId) {
+  // Values written before codecs were introduced are just a zlib stream
+  // and the trailer.
+  GoogleString value(1000, 'a');
+  GoogleString raw_value;
+  StringWriter writer(&raw_value);
+  ASSERT_TRUE(GzipInflater::Deflate(value, &writer));
+  raw_value.append("[[]]");
+  lru_cache_->PutSwappingString("key", &raw_value);
+  CheckGet("key", value);
+  EXPECT_EQ(0, compressed_cache_->CorruptPayloads());
+}
+
+TEST_F(CompressedCacheTest, SwitchCodecs) {
+  GoogleString value = StrCat(GoogleString(100, 'a'), "value");
+  CheckPut("default", value);
+  EXPECT_EQ(DeflateCacheCodec::kId, GetRawValue("default")[0]);
+
+  // Values written with the default codec stay readable once a dictionary
+  // is in use.
+  GoogleString dictionary = StrCat("common prefix ", GoogleString(100, 'a'));
+  compressed_cache_->set_codec(new DeflateCacheCodec(1, dictionary));
+  CheckPut("dictionary", value);
+  EXPECT_EQ(DeflateCacheCodec::kDictionaryId, GetRawValue("dictionary")[0]);
+  CheckGet("dictionary", value);
+  CheckGet("default", value);
+
+  // But values written with the dictionary aren't readable without it.
+  compressed_cache_->set_codec(new DeflateCacheCodec(1, ""));
+  CheckGet("default", value);
+  CheckNotFound("dictionary");
+  EXPECT_EQ(1, compressed_cache_->CorruptPayloads());
+}
+
 }  // namespace net_instaweb
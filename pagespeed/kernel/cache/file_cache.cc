@@ -37,12 +37,20 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
+#include "pagespeed/kernel/cache/file_cache_index.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
 #include "pagespeed/kernel/util/url_to_filename_encoder.h"
 
 namespace net_instaweb {
 
-namespace {  // For structs used only in Clean().
+namespace {
+
+// Bound on the memory used to suppress repeated journaling of reads of the
+// same file.  When this is exceeded we just start over, journaling a few
+// more reads than strictly necessary.
+const size_t kMaxRecentAccesses = 100000;
+
+// For structs used only in Clean().
 
 struct CompareByAtime {
  public:
@@ -75,12 +83,15 @@ const char FileCache::kCleanups[] = "file_cache_cleanups";
 const char FileCache::kDiskChecks[] = "file_cache_disk_checks";
 const char FileCache::kEvictions[] = "file_cache_evictions";
 const char FileCache::kWriteErrors[] = "file_cache_write_errors";
+const char FileCache::kCacheSizeBytes[] = "file_cache_size_bytes";
+const char FileCache::kCacheInodeCount[] = "file_cache_inode_count";
 
 // Filenames for the next scheduled clean time and the lockfile.  In
 // order to prevent these from colliding with actual cachefiles, they
 // contain characters that our filename encoder would escape.
 const char FileCache::kCleanTimeName[] = "!clean!time!";
 const char FileCache::kCleanLockName[] = "!clean!lock!";
+const char FileCache::kShmSnapshotName[] = "!shm!snapshot!";
 
 // TODO(abliss): remove policy from constructor; provide defaults here
 // and setters below.
@@ -97,16 +108,23 @@ FileCache::FileCache(const GoogleString& path, FileSystem* file_system,
       path_length_limit_(file_system_->MaxPathLength(path)),
       clean_time_path_(path),
       clean_lock_path_(path),
+      shm_snapshot_path_(path),
       disk_checks_(stats->GetVariable(kDiskChecks)),
       cleanups_(stats->GetVariable(kCleanups)),
       evictions_(stats->GetVariable(kEvictions)),
       bytes_freed_in_cleanup_(stats->GetVariable(kBytesFreedInCleanup)),
-      write_errors_(stats->GetVariable(kWriteErrors)) {
+      write_errors_(stats->GetVariable(kWriteErrors)),
+      cache_size_bytes_(stats->GetUpDownCounter(kCacheSizeBytes)),
+      cache_inode_count_(stats->GetUpDownCounter(kCacheInodeCount)) {
   next_clean_ms_ = policy->timer->NowMs() + policy->clean_interval_ms / 2;
   EnsureEndsInSlash(&clean_time_path_);
   StrAppend(&clean_time_path_, kCleanTimeName);
   EnsureEndsInSlash(&clean_lock_path_);
   StrAppend(&clean_lock_path_, kCleanLockName);
+  EnsureEndsInSlash(&shm_snapshot_path_);
+  StrAppend(&shm_snapshot_path_, kShmSnapshotName);
+  index_.reset(new FileCacheIndex(path, file_system, thread_system,
+                                  policy->timer, handler));
 }
 
 FileCache::~FileCache() {
@@ -118,6 +136,8 @@ void FileCache::InitStats(Statistics* statistics) {
   statistics->AddVariable(kDiskChecks);
   statistics->AddVariable(kEvictions);
   statistics->AddVariable(kWriteErrors);
+  statistics->AddUpDownCounter(kCacheSizeBytes);
+  statistics->AddUpDownCounter(kCacheInodeCount);
 }
 
 void FileCache::Get(const GoogleString& key, Callback* callback) {
@@ -132,27 +152,57 @@ void FileCache::Get(const GoogleString& key, Callback* callback) {
     GoogleString buf;
     ret = file_system_->ReadFile(filename.c_str(), &buf, &null_handler);
     callback->value()->SwapWithString(&buf);
+    if (ret && cache_policy_->clean_with_index) {
+      RecordAccess(filename);
+    }
   }
   ValidateAndReportResult(key, ret ? kAvailable : kNotFound, callback);
 }
 
 void FileCache::Put(const GoogleString& key, SharedString* value) {
   GoogleString filename;
-  if (EncodeFilename(key, &filename) &&
-      !file_system_->WriteFileAtomic(filename, value->Value(),
-                                     message_handler_)) {
-    write_errors_->Add(1);
+  if (EncodeFilename(key, &filename)) {
+    bool success = file_system_->WriteFileAtomic(filename, value->Value(),
+                                                 message_handler_);
+    FinishPut(filename, value->size(), success);
   }
   CleanIfNeeded();
 }
 
+void FileCache::FinishPut(const GoogleString& filename, int64 value_size,
+                          bool success) {
+  if (!success) {
+    write_errors_->Add(1);
+  } else if (cache_policy_->clean_with_index) {
+    index_->RecordPut(filename, value_size,
+                      cache_policy_->timer->NowMs() / Timer::kSecondMs);
+  }
+}
+
 void FileCache::Delete(const GoogleString& key) {
   GoogleString filename;
   if (!EncodeFilename(key, &filename)) {
     return;
   }
   NullMessageHandler null_handler;  // Do not emit messages on delete failures.
-  file_system_->RemoveFile(filename.c_str(), &null_handler);
+  if (file_system_->RemoveFile(filename.c_str(), &null_handler) &&
+      cache_policy_->clean_with_index) {
+    index_->RecordDelete(filename);
+  }
+}
+
+void FileCache::RecordAccess(const GoogleString& filename) {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (recent_accesses_.size() >= kMaxRecentAccesses) {
+      recent_accesses_.clear();
+    }
+    if (!recent_accesses_.insert(filename).second) {
+      return;
+    }
+  }
+  index_->RecordAccess(filename,
+                       cache_policy_->timer->NowMs() / Timer::kSecondMs);
 }
 
 bool FileCache::EncodeFilename(const GoogleString& key,
@@ -193,6 +243,12 @@ bool FileCache::Clean(int64 target_size_bytes, int64 target_inode_count) {
 
   bool everything_ok = true;
 
+  // Anything journaled from here on may not be reflected in the walk, so
+  // keep it for the next pass.
+  if (cache_policy_->clean_with_index) {
+    index_->StartRebuild();
+  }
+
   // Get the contents of the cache
   FileSystem::DirInfo dir_info;
   file_system_->GetDirInfo(path_, &dir_info, message_handler_);
@@ -209,6 +265,11 @@ bool FileCache::Clean(int64 target_size_bytes, int64 target_inode_count) {
                               "no cleanup needed.",
                               Integer64ToString(cache_size).c_str(),
                               Integer64ToString(cache_inode_count).c_str());
+    cache_size_bytes_->Set(cache_size);
+    cache_inode_count_->Set(cache_inode_count);
+    if (cache_policy_->clean_with_index) {
+      RebuildIndex(dir_info.files, 0);
+    }
     return true;
   }
 
@@ -261,9 +322,12 @@ bool FileCache::Clean(int64 target_size_bytes, int64 target_inode_count) {
     // Don't clean the clean_time or clean_lock files! They ought to be the
     // newest files (and very small) so they would normally not be deleted
     // anyway. But on some systems (e.g. mounted noatime?) they were getting
-    // deleted.
+    // deleted.  The shm snapshot is only rewritten at shutdown, so it would
+    // look stale.
     if (clean_time_path_.compare(file.name) == 0 ||
-        clean_lock_path_.compare(file.name) == 0) {
+        clean_lock_path_.compare(file.name) == 0 ||
+        shm_snapshot_path_.compare(file.name) == 0 ||
+        index_->IsIndexFile(file.name)) {
       continue;
     }
     cache_size -= file.size_bytes;
@@ -280,9 +344,91 @@ bool FileCache::Clean(int64 target_size_bytes, int64 target_inode_count) {
                             "File cache cleanup complete; freed %s bytes",
                             Integer64ToString(bytes_freed).c_str());
   bytes_freed_in_cleanup_->Add(bytes_freed);
+  cache_size_bytes_->Set(cache_size);
+  cache_inode_count_->Set(cache_inode_count);
+  if (cache_policy_->clean_with_index) {
+    RebuildIndex(dir_info.files, file_itr - dir_info.files.begin());
+  }
   return everything_ok;
 }
 
+bool FileCache::CleanWithIndex(int64 target_size_bytes,
+                               int64 target_inode_count) {
+  if (!index_->Update()) {
+    message_handler_->Message(kInfo, "No file cache index in %s; rebuilding it",
+                              path_.c_str());
+    return Clean(target_size_bytes, target_inode_count);
+  }
+  if (index_->cleans_since_rebuild() >= kCleansBetweenIndexRebuilds) {
+    return Clean(target_size_bytes, target_inode_count);
+  }
+
+  message_handler_->Message(kInfo,
+                            "Checking cache size against target %s and file "
+                            "count against target %s using index",
+                            Integer64ToString(target_size_bytes).c_str(),
+                            Integer64ToString(target_inode_count).c_str());
+  disk_checks_->Add(1);
+
+  int64 cache_size = index_->size_bytes();
+  int64 cache_file_count = index_->num_files();
+  if (cache_size < target_size_bytes &&
+      (target_inode_count == 0 ||
+       cache_file_count < target_inode_count)) {
+    message_handler_->Message(kInfo,
+                              "File cache size is %s and contains %s files; "
+                              "no cleanup needed.",
+                              Integer64ToString(cache_size).c_str(),
+                              Integer64ToString(cache_file_count).c_str());
+  } else {
+    message_handler_->Message(kInfo,
+                              "File cache size is %s and contains %s files; "
+                              "beginning cleanup.",
+                              Integer64ToString(cache_size).c_str(),
+                              Integer64ToString(cache_file_count).c_str());
+    cleanups_->Add(1);
+
+    std::vector<FileSystem::FileInfo> evicted;
+    index_->EvictOldest((target_size_bytes * 3) / 4,
+                        (target_inode_count * 3) / 4, &evicted);
+
+    // The index may be somewhat stale, so files that have already gone away
+    // are expected and not reported.  Other processes learn of the
+    // evictions from the journal.
+    NullMessageHandler null_handler;
+    for (int i = 0, n = evicted.size(); i < n; ++i) {
+      file_system_->RemoveFile(evicted[i].name.c_str(), &null_handler);
+      index_->RecordDelete(evicted[i].name);
+      evictions_->Add(1);
+    }
+
+    int64 bytes_freed = cache_size - index_->size_bytes();
+    message_handler_->Message(kInfo,
+                              "File cache cleanup complete; freed %s bytes",
+                              Integer64ToString(bytes_freed).c_str());
+    bytes_freed_in_cleanup_->Add(bytes_freed);
+  }
+
+  index_->RecordClean();
+  cache_size_bytes_->Set(index_->size_bytes());
+  cache_inode_count_->Set(index_->num_files());
+  bool ok = index_->MaybeCompact();
+  index_->FlushJournal();
+  return ok;
+}
+
+void FileCache::RebuildIndex(const std::vector<FileSystem::FileInfo>& files,
+                             int first_kept) {
+  for (int i = first_kept, n = files.size(); i < n; ++i) {
+    const FileSystem::FileInfo& file = files[i];
+    if (clean_time_path_ != file.name && clean_lock_path_ != file.name &&
+        shm_snapshot_path_ != file.name) {
+      index_->AddFile(file.name, file.size_bytes, file.atime_sec);
+    }
+  }
+  index_->FinishRebuild();
+}
+
 void FileCache::CleanWithLocking(int64 next_clean_time_ms) {
   if (file_system_->TryLockWithTimeout(
           clean_lock_path_, Timer::kHourMs, cache_policy_->timer,
@@ -299,7 +445,16 @@ void FileCache::CleanWithLocking(int64 next_clean_time_ms) {
     }
 
     // Now actually clean.
-    Clean(cache_policy_->target_size_bytes, cache_policy_->target_inode_count);
+    if (cache_policy_->clean_with_index) {
+      CleanWithIndex(cache_policy_->target_size_bytes,
+                     cache_policy_->target_inode_count);
+      // The next pass may well be made by another process, so don't hold
+      // on to the index in between.
+      index_->Release();
+    } else {
+      Clean(cache_policy_->target_size_bytes,
+            cache_policy_->target_inode_count);
+    }
     file_system_->Unlock(clean_lock_path_, message_handler_);
   }
 }
@@ -313,6 +468,8 @@ bool FileCache::ShouldClean(int64* suggested_next_clean_time_ms) {
       *suggested_next_clean_time_ms = next_clean_ms_;  // No change yet.
       return false;
     }
+    // Start a new interval for deduplicating journaled reads.
+    recent_accesses_.clear();
   }
 
   GoogleString clean_time_str;
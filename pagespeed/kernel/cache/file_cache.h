@@ -19,21 +19,26 @@
 #ifndef PAGESPEED_KERNEL_CACHE_FILE_CACHE_H_
 #define PAGESPEED_KERNEL_CACHE_FILE_CACHE_H_
 
+#include <vector>
+
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 
 namespace net_instaweb {
 
-class FileSystem;
+class FileCacheIndex;
 class Hasher;
 class MessageHandler;
 class SharedString;
 class SlowWorker;
 class Statistics;
 class Timer;
+class UpDownCounter;
 class Variable;
 
 // Simple C++ implementation of file cache.
@@ -44,12 +49,20 @@ class FileCache : public CacheInterface {
                 int64 target_size_bytes, int64 target_inode_count)
         : timer(timer), hasher(hasher), clean_interval_ms(clean_interval_ms),
           target_size_bytes(target_size_bytes),
-          target_inode_count(target_inode_count) {}
+          target_inode_count(target_inode_count),
+          clean_with_index(false) {}
     const Timer* timer;
     const Hasher* hasher;
     int64 clean_interval_ms;
     int64 target_size_bytes;
     int64 target_inode_count;
+    // If true, journal writes, reads and deletions to a FileCacheIndex and
+    // clean from that, rather than walking the whole cache directory on
+    // every pass.  A full walk is still done every
+    // kCleansBetweenIndexRebuilds passes to resynchronize the index.  Note
+    // that between walks, target_inode_count is compared against the number
+    // of files, not counting directories.
+    bool clean_with_index;
    private:
     DISALLOW_COPY_AND_ASSIGN(CachePolicy);
   };
@@ -87,9 +100,22 @@ class FileCache : public CacheInterface {
   // Files evicted from cache during cleanup.
   static const char kEvictions[];
   static const char kWriteErrors[];
+  // Size and inode count of the cache as of the last cleaning pass.
+  static const char kCacheSizeBytes[];
+  static const char kCacheInodeCount[];
+
+  // When cleaning with an index, the number of passes between full
+  // directory walks.
+  static const int kCleansBetweenIndexRebuilds = 24;
+
+  // The file in the cache directory where SystemCaches keeps a snapshot of
+  // the shared memory metadata cache created for the same path.  Cleaning
+  // leaves it alone.
+  static const char kShmSnapshotName[];
 
  private:
   class CacheCleanFunction;
+  friend class AsyncFileCache;
   friend class FileCacheTest;
   friend class CacheCleanFunction;
 
@@ -100,6 +126,21 @@ class FileCache : public CacheInterface {
   // target_inode_count of 0 means no inode limit is applied.
   bool Clean(int64 target_size_bytes, int64 target_inode_count);
 
+  // Like Clean, but uses the index rather than walking the cache directory,
+  // falling back to Clean if the index is missing or due to be rebuilt.
+  bool CleanWithIndex(int64 target_size_bytes, int64 target_inode_count);
+
+  // Replaces the index with files[first_kept..], as left over by Clean.
+  void RebuildIndex(const std::vector<FileSystem::FileInfo>& files,
+                    int first_kept);
+
+  // Accounts for the outcome of writing value_size bytes to filename.
+  void FinishPut(const GoogleString& filename, int64 value_size, bool success);
+
+  // Journals a read of filename, unless it has already been journaled
+  // since the last time we checked whether to clean.
+  void RecordAccess(const GoogleString& filename) LOCKS_EXCLUDED(mutex_);
+
   // Clean the cache, taking care of interprocess locking, as well as timestamp
   // update.
   void CleanWithLocking(int64 next_clean_time_ms) LOCKS_EXCLUDED(mutex_);
@@ -123,16 +164,24 @@ class FileCache : public CacheInterface {
   const scoped_ptr<CachePolicy> cache_policy_;
   scoped_ptr<AbstractMutex> mutex_;
   int64 next_clean_ms_ GUARDED_BY(mutex_);
+  // Files whose reads have been journaled this clean interval, so that a hot
+  // file only costs one journal record per interval.
+  StringSet recent_accesses_ GUARDED_BY(mutex_);
+  scoped_ptr<FileCacheIndex> index_;
   int path_length_limit_;  // Maximum total length of path file_system_ supports
-  // The full paths to our cleanup timestamp and lock files.
+  // The full paths to our cleanup timestamp and lock files, and to the
+  // shared memory cache snapshot.
   GoogleString clean_time_path_;
   GoogleString clean_lock_path_;
+  GoogleString shm_snapshot_path_;
 
   Variable* disk_checks_;
   Variable* cleanups_;
   Variable* evictions_;
   Variable* bytes_freed_in_cleanup_;
   Variable* write_errors_;
+  UpDownCounter* cache_size_bytes_;
+  UpDownCounter* cache_inode_count_;
 
   // The filename where we keep the next scheduled cleanup time in seconds.
   static const char kCleanTimeName[];
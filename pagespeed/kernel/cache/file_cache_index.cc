@@ -0,0 +1,500 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/file_cache_index.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// First line of the snapshot, followed by its generation, the last journal
+// segment it covers, and the number of passes since the last rebuild.  Bump
+// the version if the record format changes; a snapshot with an unexpected
+// header is treated as missing, forcing a rebuild.
+const char kIndexHeader[] = "pagespeed-file-cache-index 2 ";
+
+// Enough to read the header line without reading the whole snapshot.
+const int kMaxHeaderBytes = 128;
+
+// Splits the first space-delimited token off the front of *line.
+bool NextToken(StringPiece* line, StringPiece* token) {
+  stringpiece_ssize_type space = line->find(' ');
+  if (space == StringPiece::npos) {
+    return false;
+  }
+  *token = line->substr(0, space);
+  line->remove_prefix(space + 1);
+  return true;
+}
+
+bool NextInt64(StringPiece* line, int64* value) {
+  StringPiece token;
+  return NextToken(line, &token) && StringToInt64(token.as_string(), value);
+}
+
+// Splits the first line off the front of *contents, returning false once
+// there are no complete lines left.  A trailing partial line, as left by a
+// writer that died mid-append, is ignored.
+bool NextLine(StringPiece* contents, StringPiece* line) {
+  stringpiece_ssize_type newline = contents->find('\n');
+  if (newline == StringPiece::npos) {
+    return false;
+  }
+  *line = contents->substr(0, newline);
+  contents->remove_prefix(newline + 1);
+  return true;
+}
+
+GoogleString WithTrailingSlash(const GoogleString& path) {
+  GoogleString result(path);
+  EnsureEndsInSlash(&result);
+  return result;
+}
+
+}  // namespace
+
+const char FileCacheIndex::kIndexName[] = "!clean!index!";
+const char FileCacheIndex::kJournalName[] = "!clean!journal!";
+
+const int FileCacheIndex::kSegmentsPerSnapshot;
+const size_t FileCacheIndex::kMaxBufferedJournalBytes;
+const int64 FileCacheIndex::kMaxJournalDelayMs;
+
+// Sort by ascending atime, breaking ties by name so that the eviction order
+// is deterministic.
+bool FileCacheIndex::CompareByAtimeAndName::operator()(
+    EntryMap::iterator one, EntryMap::iterator two) const {
+  if (one->second.atime_sec != two->second.atime_sec) {
+    return one->second.atime_sec < two->second.atime_sec;
+  }
+  return one->first < two->first;
+}
+
+FileCacheIndex::FileCacheIndex(const GoogleString& path,
+                               FileSystem* file_system,
+                               ThreadSystem* thread_system,
+                               const Timer* timer,
+                               MessageHandler* handler)
+    : path_(WithTrailingSlash(path)),
+      file_system_(file_system),
+      timer_(timer),
+      message_handler_(handler),
+      mutex_(thread_system->NewMutex()),
+      flush_deadline_ms_(0),
+      size_bytes_(0),
+      cleans_since_rebuild_(0),
+      loaded_(false),
+      generation_(0),
+      snapshot_segment_(0),
+      segment_(0) {
+  index_path_ = StrCat(path_, kIndexName);
+  journal_path_ = StrCat(path_, kJournalName);
+}
+
+FileCacheIndex::~FileCacheIndex() {
+  FlushJournal();
+}
+
+bool FileCacheIndex::RelativeName(const GoogleString& filename,
+                                  StringPiece* name) const {
+  StringPiece full(filename);
+  if (!full.starts_with(path_) || full.find('\n') != StringPiece::npos) {
+    return false;
+  }
+  *name = full.substr(path_.size());
+  return !name->empty();
+}
+
+void FileCacheIndex::Append(const GoogleString& record) {
+  int64 now_ms = timer_->NowMs();
+  ScopedMutex lock(mutex_.get());
+  if (buffered_records_.empty()) {
+    flush_deadline_ms_ = now_ms + kMaxJournalDelayMs;
+  }
+  buffered_records_ += record;
+  if ((buffered_records_.size() >= kMaxBufferedJournalBytes) ||
+      (now_ms >= flush_deadline_ms_)) {
+    FlushJournalLockHeld();
+  }
+}
+
+void FileCacheIndex::FlushJournal() {
+  ScopedMutex lock(mutex_.get());
+  FlushJournalLockHeld();
+}
+
+void FileCacheIndex::FlushJournalLockHeld() {
+  if (buffered_records_.empty()) {
+    return;
+  }
+  // The batch is a single write to a file opened for append, so batches
+  // from concurrent writers do not interleave.  Failures are not reported:
+  // the journal is advisory, and the next rebuild will pick up anything we
+  // miss here.
+  NullMessageHandler null_handler;
+  FileSystem::OutputFile* file = file_system_->OpenOutputFileForAppend(
+      journal_path_.c_str(), &null_handler);
+  if (file != NULL) {
+    file->Write(buffered_records_, &null_handler);
+    file_system_->Close(file, &null_handler);
+  }
+  buffered_records_.clear();
+}
+
+void FileCacheIndex::RecordPut(const GoogleString& filename, int64 size_bytes,
+                               int64 atime_sec) {
+  StringPiece name;
+  if (RelativeName(filename, &name)) {
+    Append(StrCat("p ", Integer64ToString(size_bytes), " ",
+                  Integer64ToString(atime_sec), " ", name, "\n"));
+  }
+}
+
+void FileCacheIndex::RecordAccess(const GoogleString& filename,
+                                  int64 atime_sec) {
+  StringPiece name;
+  if (RelativeName(filename, &name)) {
+    Append(StrCat("a ", Integer64ToString(atime_sec), " ", name, "\n"));
+  }
+}
+
+void FileCacheIndex::RecordDelete(const GoogleString& filename) {
+  StringPiece name;
+  if (RelativeName(filename, &name)) {
+    Append(StrCat("d ", name, "\n"));
+  }
+}
+
+void FileCacheIndex::RecordClean() {
+  Append("c\n");
+}
+
+bool FileCacheIndex::IsIndexFile(const GoogleString& filename) const {
+  return ((filename == index_path_) ||
+          StringPiece(filename).starts_with(journal_path_));
+}
+
+GoogleString FileCacheIndex::SegmentPath(int64 segment) const {
+  return StrCat(journal_path_, Integer64ToString(segment));
+}
+
+bool FileCacheIndex::ParseHeader(StringPiece line, int64* generation,
+                                 int64* segment, int* cleans) const {
+  if (!line.starts_with(kIndexHeader)) {
+    return false;
+  }
+  line.remove_prefix(STATIC_STRLEN(kIndexHeader));
+  return (NextInt64(&line, generation) && NextInt64(&line, segment) &&
+          StringToInt(line.as_string(), cleans));
+}
+
+bool FileCacheIndex::ReadHeader(int64* generation, int64* segment,
+                                int* cleans) const {
+  NullMessageHandler null_handler;
+  FileSystem::InputFile* file =
+      file_system_->OpenInputFile(index_path_.c_str(), &null_handler);
+  if (file == NULL) {
+    return false;
+  }
+  char buf[kMaxHeaderBytes];
+  int size = file->Read(buf, sizeof(buf), &null_handler);
+  file_system_->Close(file, &null_handler);
+  StringPiece contents(buf, std::max(size, 0)), line;
+  return (NextLine(&contents, &line) &&
+          ParseHeader(line, generation, segment, cleans));
+}
+
+bool FileCacheIndex::LoadSnapshot() {
+  Clear();
+  NullMessageHandler null_handler;
+  GoogleString contents;
+  if (!file_system_->ReadFile(index_path_.c_str(), &contents, &null_handler)) {
+    return false;
+  }
+
+  StringPiece remaining(contents), line;
+  int64 generation = 0, segment = 0;
+  int cleans = 0;
+  if (!NextLine(&remaining, &line) ||
+      !ParseHeader(line, &generation, &segment, &cleans)) {
+    message_handler_->Message(kWarning, "Ignoring malformed file cache index "
+                              "%s", index_path_.c_str());
+    return false;
+  }
+  while (NextLine(&remaining, &line)) {
+    if (!line.starts_with("p ") || !ApplyRecord(line)) {
+      message_handler_->Message(kWarning, "Ignoring malformed file cache index "
+                                "%s", index_path_.c_str());
+      Clear();
+      return false;
+    }
+  }
+  cleans_since_rebuild_ = cleans;
+  loaded_ = true;
+  generation_ = generation;
+  snapshot_segment_ = segment;
+  segment_ = segment;
+  return true;
+}
+
+void FileCacheIndex::SealJournal() {
+  NullMessageHandler null_handler;
+  if (!file_system_->Exists(journal_path_.c_str(), &null_handler).is_true()) {
+    return;
+  }
+  // Segments sealed by other processes since our last pass are still there
+  // to be replayed, so skip past them.
+  int64 segment = segment_ + 1;
+  while (file_system_->Exists(SegmentPath(segment).c_str(),
+                              &null_handler).is_true()) {
+    ++segment;
+  }
+  file_system_->RenameFile(journal_path_.c_str(), SegmentPath(segment).c_str(),
+                           message_handler_);
+}
+
+bool FileCacheIndex::ReplaySegment(int64 segment) {
+  NullMessageHandler null_handler;
+  GoogleString contents;
+  GoogleString filename = SegmentPath(segment);
+  if (!file_system_->ReadFile(filename.c_str(), &contents, &null_handler)) {
+    return false;
+  }
+
+  // The journal is appended to without any locking, so just skip anything
+  // we can't make sense of.
+  int bad_records = 0;
+  StringPiece remaining(contents), line;
+  while (NextLine(&remaining, &line)) {
+    if (!ApplyRecord(line)) {
+      ++bad_records;
+    }
+  }
+  if (bad_records != 0) {
+    message_handler_->Message(kWarning, "Skipped %d malformed records in %s",
+                              bad_records, filename.c_str());
+  }
+  return true;
+}
+
+bool FileCacheIndex::Update() {
+  // Our own records go in this pass, too.
+  FlushJournal();
+
+  int64 generation, segment;
+  int cleans;
+  if (!ReadHeader(&generation, &segment, &cleans)) {
+    Clear();
+    return false;
+  }
+  if ((!loaded_ || (generation != generation_)) && !LoadSnapshot()) {
+    return false;
+  }
+
+  SealJournal();
+  while (ReplaySegment(segment_ + 1)) {
+    ++segment_;
+  }
+  return true;
+}
+
+void FileCacheIndex::Release() {
+  Clear();
+}
+
+void FileCacheIndex::Clear() {
+  entries_.clear();
+  size_bytes_ = 0;
+  cleans_since_rebuild_ = 0;
+  loaded_ = false;
+}
+
+void FileCacheIndex::SetEntry(StringPiece name, int64 size_bytes,
+                              int64 atime_sec) {
+  std::pair<EntryMap::iterator, bool> insertion =
+      entries_.insert(EntryMap::value_type(name.as_string(), Entry()));
+  Entry* entry = &insertion.first->second;
+  if (!insertion.second) {
+    size_bytes_ -= entry->size_bytes;
+  }
+  entry->size_bytes = size_bytes;
+  entry->atime_sec = atime_sec;
+  size_bytes_ += size_bytes;
+}
+
+void FileCacheIndex::EraseEntry(EntryMap::iterator p) {
+  size_bytes_ -= p->second.size_bytes;
+  entries_.erase(p);
+}
+
+bool FileCacheIndex::ApplyRecord(StringPiece record) {
+  if (record == "c") {
+    ++cleans_since_rebuild_;
+    return true;
+  }
+  StringPiece op;
+  if (!NextToken(&record, &op)) {
+    return false;
+  }
+  int64 size_bytes, atime_sec;
+  if (op == "p") {
+    if (!NextInt64(&record, &size_bytes) || !NextInt64(&record, &atime_sec) ||
+        record.empty()) {
+      return false;
+    }
+    SetEntry(record, size_bytes, atime_sec);
+  } else if (op == "a") {
+    if (!NextInt64(&record, &atime_sec) || record.empty()) {
+      return false;
+    }
+    // Reads of files we don't know the size of are dropped; the file will
+    // be picked up by the next rebuild.
+    EntryMap::iterator p = entries_.find(record.as_string());
+    if ((p != entries_.end()) && (atime_sec > p->second.atime_sec)) {
+      SetEntry(record, p->second.size_bytes, atime_sec);
+    }
+  } else if (op == "d") {
+    EntryMap::iterator p = entries_.find(record.as_string());
+    if (p != entries_.end()) {
+      EraseEntry(p);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void FileCacheIndex::StartRebuild() {
+  FlushJournal();
+
+  // Start numbering after whatever segments the current snapshot, if any,
+  // already covers; it may be newer than the one we loaded.
+  int64 generation, segment = 0;
+  int cleans;
+  ReadHeader(&generation, &segment, &cleans);
+  if (!loaded_) {
+    snapshot_segment_ = segment;
+    segment_ = segment;
+  }
+  segment_ = std::max(segment_, segment);
+
+  // Everything journaled so far is superseded by the walk, so seal it into
+  // segments for Save to delete, and skip past them.
+  SealJournal();
+  NullMessageHandler null_handler;
+  while (file_system_->Exists(SegmentPath(segment_ + 1).c_str(),
+                              &null_handler).is_true()) {
+    ++segment_;
+  }
+  Clear();
+}
+
+void FileCacheIndex::AddFile(const GoogleString& filename, int64 size_bytes,
+                             int64 atime_sec) {
+  StringPiece name;
+  if (RelativeName(filename, &name) && !IsIndexFile(filename)) {
+    SetEntry(name, size_bytes, atime_sec);
+  }
+}
+
+bool FileCacheIndex::FinishRebuild() {
+  cleans_since_rebuild_ = 0;
+  return Save();
+}
+
+void FileCacheIndex::EvictOldest(int64 target_size_bytes,
+                                 int64 target_file_count,
+                                 std::vector<FileSystem::FileInfo>* evicted) {
+  if ((size_bytes_ <= target_size_bytes) &&
+      ((target_file_count == 0) || (num_files() <= target_file_count))) {
+    return;
+  }
+  // Order the entries by access time only now, rather than keeping them
+  // ordered as the journal is replayed, which would cost a tree node per
+  // entry.
+  std::vector<EntryMap::iterator> by_atime;
+  by_atime.reserve(entries_.size());
+  for (EntryMap::iterator p = entries_.begin(); p != entries_.end(); ++p) {
+    by_atime.push_back(p);
+  }
+  std::sort(by_atime.begin(), by_atime.end(), CompareByAtimeAndName());
+  for (int i = 0, n = by_atime.size();
+       (i < n) &&
+           ((size_bytes_ > target_size_bytes) ||
+            ((target_file_count != 0) && (num_files() > target_file_count)));
+       ++i) {
+    EntryMap::iterator p = by_atime[i];
+    evicted->push_back(FileSystem::FileInfo(
+        p->second.size_bytes, p->second.atime_sec, StrCat(path_, p->first)));
+    EraseEntry(p);
+  }
+}
+
+bool FileCacheIndex::MaybeCompact() {
+  if (segment_ - snapshot_segment_ < kSegmentsPerSnapshot) {
+    return true;
+  }
+  return Save();
+}
+
+bool FileCacheIndex::Save() {
+  // Generations only need to differ between snapshots, but basing them on
+  // the clock keeps them from repeating if the snapshot is lost.
+  int64 generation = 0, segment;
+  int cleans;
+  ReadHeader(&generation, &segment, &cleans);
+  generation = std::max(std::max(generation, generation_) + 1,
+                        timer_->NowMs());
+
+  GoogleString contents = StrCat(
+      kIndexHeader, Integer64ToString(generation), " ",
+      Integer64ToString(segment_), " ",
+      IntegerToString(cleans_since_rebuild_), "\n");
+  for (EntryMap::const_iterator p = entries_.begin(); p != entries_.end();
+       ++p) {
+    StrAppend(&contents, "p ", Integer64ToString(p->second.size_bytes), " ",
+              Integer64ToString(p->second.atime_sec), " ", p->first, "\n");
+  }
+  if (!file_system_->WriteFileAtomic(index_path_, contents,
+                                     message_handler_)) {
+    return false;
+  }
+  NullMessageHandler null_handler;  // Segments may be missing.
+  for (int64 i = snapshot_segment_ + 1; i <= segment_; ++i) {
+    file_system_->RemoveFile(SegmentPath(i).c_str(), &null_handler);
+  }
+  loaded_ = true;
+  generation_ = generation;
+  snapshot_segment_ = segment_;
+  return true;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_FILE_CACHE_INDEX_H_
+#define PAGESPEED_KERNEL_CACHE_FILE_CACHE_INDEX_H_
+
+#include <map>
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class ThreadSystem;
+class Timer;
+
+// Persistent index of the files in a FileCache, so that the cache can be
+// cleaned without walking and stat()ing the whole directory tree.
+//
+// On disk, the index is a snapshot listing every cache file with its size
+// and last access time, plus a journal of the writes, reads and deletions
+// made since.  Any process serving from the cache may append to the live
+// journal.  At each cleaning pass, the process holding the cache-clean lock
+// seals the live journal into a numbered segment, and replays onto its
+// in-memory index only the segments it has not yet seen, so a pass costs
+// time in proportion to the recent traffic and the number of files evicted,
+// not the size of the cache.  Every kSegmentsPerSnapshot segments, the
+// cleaner compacts them into a new snapshot; a process whose index predates
+// the latest snapshot reloads it on its next pass.
+//
+// The in-memory index costs roughly 100 bytes per file plus the length of
+// its name, which for a cache of millions of files is hundreds of MB.  So
+// that no process keeps that between passes, FileCache calls Release() at
+// the end of each one, and the next pass reloads the snapshot; that is
+// still far cheaper than walking and stat()ing the directory tree.
+//
+// All files consist of text lines naming files relative to the cache root:
+//   p <size_bytes> <atime_sec> <name>   file written
+//   a <atime_sec> <name>                file read
+//   d <name>                            file deleted
+//   c                                   cleaning pass finished
+// The snapshot starts with a header line and otherwise holds only 'p' lines.
+//
+// Journal records are buffered in memory and appended in batches, so that
+// the journal is not opened for every cache operation.  The journal is
+// best-effort: records still buffered when a process dies are lost, and
+// files written behind the cache's back are never journaled at all.
+// Callers should therefore rebuild the index from a directory walk every
+// so often.
+class FileCacheIndex {
+ public:
+  // Names of the snapshot and live journal files; sealed segments are named
+  // by appending a number to kJournalName.  As with FileCache's clean-time
+  // and lock files, these contain characters that our filename encoder would
+  // escape, so they can't collide with cache entries.
+  static const char kIndexName[];
+  static const char kJournalName[];
+
+  // Number of sealed journal segments replayed between snapshots.
+  static const int kSegmentsPerSnapshot = 8;
+
+  // Buffered journal records are appended once they reach this many bytes,
+  // or once the oldest of them has been waiting this long.
+  static const size_t kMaxBufferedJournalBytes = 4096;
+  static const int64 kMaxJournalDelayMs = 1000;
+
+  // Does not take ownership of file_system, timer or handler.
+  FileCacheIndex(const GoogleString& path, FileSystem* file_system,
+                 ThreadSystem* thread_system, const Timer* timer,
+                 MessageHandler* handler);
+  ~FileCacheIndex();
+
+  // Journal a write, read, or deletion of the cache file with absolute path
+  // 'filename'.  These may be called from any thread or process.
+  void RecordPut(const GoogleString& filename, int64 size_bytes,
+                 int64 atime_sec) LOCKS_EXCLUDED(mutex_);
+  void RecordAccess(const GoogleString& filename, int64 atime_sec)
+      LOCKS_EXCLUDED(mutex_);
+  void RecordDelete(const GoogleString& filename) LOCKS_EXCLUDED(mutex_);
+
+  // Appends any buffered records to the journal.
+  void FlushJournal() LOCKS_EXCLUDED(mutex_);
+
+  // Returns true if 'filename' is the snapshot or a journal.
+  bool IsIndexFile(const GoogleString& filename) const;
+
+  // The remaining methods are for the cache cleaner, which must hold the
+  // FileCache's clean lock while calling them.
+
+  // Brings the in-memory index up to date: loads the snapshot if it has not
+  // been loaded or has been replaced since, seals the live journal, and
+  // replays the segments not yet seen.  Returns false if there is no usable
+  // snapshot, in which case the in-memory index is left empty and should be
+  // rebuilt.
+  bool Update();
+
+  // Drops the least recently accessed entries from the in-memory index until
+  // it totals at most target_size_bytes and holds at most target_file_count
+  // entries (0 meaning no limit), appending them to *evicted with absolute
+  // paths.  The files themselves are not touched, nor are the deletions
+  // journaled.
+  void EvictOldest(int64 target_size_bytes, int64 target_file_count,
+                   std::vector<FileSystem::FileInfo>* evicted);
+
+  // Journals the end of a cleaning pass, which counts towards
+  // cleans_since_rebuild() once replayed.
+  void RecordClean() LOCKS_EXCLUDED(mutex_);
+
+  // Writes a new snapshot if kSegmentsPerSnapshot segments have been
+  // replayed since the last one.  Returns false if that fails.
+  bool MaybeCompact();
+
+  // Rebuilding from a directory walk: StartRebuild seals the live journal
+  // and empties the in-memory index, to be refilled by AddFile, and
+  // FinishRebuild writes it as a new snapshot.  Records journaled after
+  // StartRebuild will be replayed onto the rebuilt index.  'filename' is an
+  // absolute path.
+  void StartRebuild();
+  void AddFile(const GoogleString& filename, int64 size_bytes,
+               int64 atime_sec);
+  bool FinishRebuild();
+
+  // Writes the snapshot and deletes the segments it supersedes.
+  bool Save();
+
+  // Frees the in-memory index, to be reloaded by the next Update().
+  void Release();
+
+  int64 size_bytes() const { return size_bytes_; }
+  int64 num_files() const { return entries_.size(); }
+
+  // Number of passes since the index was last rebuilt from a directory walk.
+  int cleans_since_rebuild() const { return cleans_since_rebuild_; }
+
+ private:
+  struct Entry {
+    int64 size_bytes;
+    int64 atime_sec;
+  };
+  typedef std::map<GoogleString, Entry> EntryMap;
+
+  // Orders entries by ascending access time, for eviction.
+  struct CompareByAtimeAndName {
+    bool operator()(EntryMap::iterator one, EntryMap::iterator two) const;
+  };
+
+  // Strips path_ from 'filename'.  Returns false if the file is outside the
+  // cache or its name can't be represented in a line-based record.
+  bool RelativeName(const GoogleString& filename, StringPiece* name) const;
+
+  void Append(const GoogleString& record) LOCKS_EXCLUDED(mutex_);
+  void FlushJournalLockHeld() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  GoogleString SegmentPath(int64 segment) const;
+
+  // Reads just the snapshot's header line.
+  bool ReadHeader(int64* generation, int64* segment, int* cleans) const;
+  bool ParseHeader(StringPiece line, int64* generation, int64* segment,
+                   int* cleans) const;
+  bool LoadSnapshot();
+
+  // Renames the live journal to the first unused segment after segment_.
+  void SealJournal();
+
+  // Replays the given segment.  Returns false if it does not exist.
+  bool ReplaySegment(int64 segment);
+
+  void Clear();
+  bool ApplyRecord(StringPiece record);
+  void SetEntry(StringPiece name, int64 size_bytes, int64 atime_sec);
+  void EraseEntry(EntryMap::iterator p);
+
+  const GoogleString path_;  // Always ends in a slash.
+  FileSystem* file_system_;
+  const Timer* timer_;
+  MessageHandler* message_handler_;
+  GoogleString index_path_;
+  GoogleString journal_path_;
+
+  scoped_ptr<AbstractMutex> mutex_;
+  GoogleString buffered_records_ GUARDED_BY(mutex_);
+  int64 flush_deadline_ms_ GUARDED_BY(mutex_);
+
+  // The in-memory index, touched only by the cleaner.
+  EntryMap entries_;
+  int64 size_bytes_;
+  int cleans_since_rebuild_;
+  // Whether entries_ holds a snapshot, which one, and the segment it
+  // covers; and the last segment replayed on top of it.
+  bool loaded_;
+  int64 generation_;
+  int64 snapshot_segment_;
+  int64 segment_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileCacheIndex);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_FILE_CACHE_INDEX_H_
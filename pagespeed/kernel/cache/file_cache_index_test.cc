@@ -0,0 +1,281 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the file cache index.
+
+#include "pagespeed/kernel/cache/file_cache_index.h"
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mem_file_system.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+class FileCacheIndexTest : public testing::Test {
+ protected:
+  FileCacheIndexTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        mock_timer_(thread_system_->NewMutex(), 0),
+        file_system_(thread_system_.get(), &mock_timer_),
+        path_(StrCat(GTestTempDir(), "/")),
+        index_(path_, &file_system_, thread_system_.get(), &mock_timer_,
+               &message_handler_) {
+  }
+
+  GoogleString Path(StringPiece name) { return StrCat(path_, name); }
+
+  GoogleString ReadJournal() {
+    GoogleString contents;
+    file_system_.ReadFile(Path(FileCacheIndex::kJournalName).c_str(),
+                          &contents, &message_handler_);
+    return contents;
+  }
+
+  bool Exists(StringPiece name) {
+    return file_system_.Exists(Path(name).c_str(),
+                               &message_handler_).is_true();
+  }
+
+  // Writes a snapshot holding "a" and "b".
+  void WriteSnapshot() {
+    index_.StartRebuild();
+    index_.AddFile(Path("a"), 10, 100);
+    index_.AddFile(Path("b"), 20, 110);
+    index_.AddFile(Path(FileCacheIndex::kJournalName), 1000, 0);
+    ASSERT_TRUE(index_.FinishRebuild());
+    EXPECT_EQ(2, index_.num_files());
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockTimer mock_timer_;
+  MemFileSystem file_system_;
+  GoogleMessageHandler message_handler_;
+  const GoogleString path_;
+  FileCacheIndex index_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FileCacheIndexTest);
+};
+
+TEST_F(FileCacheIndexTest, Journal) {
+  index_.RecordPut(Path("a/b"), 10, 100);
+  index_.RecordAccess(Path("a/b"), 200);
+  index_.RecordDelete(Path("c"));
+  index_.RecordClean();
+
+  // Files outside the cache, or whose names would break the record format,
+  // are not journaled.
+  index_.RecordPut("/elsewhere/d", 10, 100);
+  index_.RecordPut(Path("e\nf"), 10, 100);
+
+  // Records are buffered until flushed.
+  EXPECT_EQ("", ReadJournal());
+  index_.FlushJournal();
+  EXPECT_EQ("p 10 100 a/b\n"
+            "a 200 a/b\n"
+            "d c\n"
+            "c\n", ReadJournal());
+
+  EXPECT_TRUE(index_.IsIndexFile(Path(FileCacheIndex::kJournalName)));
+  EXPECT_TRUE(index_.IsIndexFile(
+      Path(StrCat(FileCacheIndex::kJournalName, "12"))));
+  EXPECT_TRUE(index_.IsIndexFile(Path(FileCacheIndex::kIndexName)));
+  EXPECT_FALSE(index_.IsIndexFile(Path("a/b")));
+}
+
+TEST_F(FileCacheIndexTest, JournalFlushesWhenDue) {
+  index_.RecordDelete(Path("a"));
+  mock_timer_.AdvanceMs(FileCacheIndex::kMaxJournalDelayMs - 1);
+  index_.RecordDelete(Path("b"));
+  EXPECT_EQ("", ReadJournal());
+  mock_timer_.AdvanceMs(1);
+  index_.RecordDelete(Path("c"));
+  EXPECT_EQ("d a\nd b\nd c\n", ReadJournal());
+
+  // Or when enough is buffered.
+  GoogleString name(FileCacheIndex::kMaxBufferedJournalBytes, 'x');
+  index_.RecordDelete(Path(name));
+  EXPECT_EQ(StrCat("d a\nd b\nd c\nd ", name, "\n"), ReadJournal());
+}
+
+TEST_F(FileCacheIndexTest, NoSnapshot) {
+  index_.RecordPut(Path("a"), 10, 100);
+  EXPECT_FALSE(index_.Update());
+  EXPECT_EQ(0, index_.num_files());
+}
+
+TEST_F(FileCacheIndexTest, ReplayJournal) {
+  WriteSnapshot();
+  index_.RecordPut(Path("c"), 5, 120);     // New file.
+  index_.RecordPut(Path("a"), 15, 130);    // Overwrite.
+  index_.RecordDelete(Path("b"));
+  index_.RecordAccess(Path("c"), 140);
+  index_.RecordAccess(Path("x"), 150);     // Unknown; ignored.
+  index_.RecordClean();
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(2, index_.num_files());
+  EXPECT_EQ(20, index_.size_bytes());
+  EXPECT_EQ(1, index_.cleans_since_rebuild());
+
+  // The journal was sealed into a segment, which stays until the next
+  // snapshot, and later records are replayed on top.
+  EXPECT_EQ("", ReadJournal());
+  EXPECT_TRUE(Exists(StrCat(FileCacheIndex::kJournalName, "1")));
+  index_.RecordDelete(Path("c"));
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(1, index_.num_files());
+  EXPECT_EQ(15, index_.size_bytes());
+  EXPECT_TRUE(Exists(StrCat(FileCacheIndex::kJournalName, "2")));
+}
+
+TEST_F(FileCacheIndexTest, SharedBetweenProcesses) {
+  WriteSnapshot();
+
+  // Another process, with its own in-memory index, cleans the cache.
+  FileCacheIndex other(path_, &file_system_, thread_system_.get(),
+                       &mock_timer_, &message_handler_);
+  index_.RecordPut(Path("c"), 5, 120);
+  index_.FlushJournal();
+  ASSERT_TRUE(other.Update());
+  EXPECT_EQ(3, other.num_files());
+  std::vector<FileSystem::FileInfo> evicted;
+  other.EvictOldest(25, 0, &evicted);
+  ASSERT_EQ(static_cast<size_t>(1), evicted.size());
+  EXPECT_EQ(Path("a"), evicted[0].name);
+  other.RecordDelete(evicted[0].name);
+  other.RecordClean();
+  other.FlushJournal();
+
+  // We pick up the segment the other process sealed, as well as the
+  // eviction it journaled.
+  index_.RecordPut(Path("d"), 1, 130);
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(3, index_.num_files());
+  EXPECT_EQ(26, index_.size_bytes());
+  EXPECT_EQ(1, index_.cleans_since_rebuild());
+}
+
+TEST_F(FileCacheIndexTest, Compact) {
+  WriteSnapshot();
+  FileCacheIndex other(path_, &file_system_, thread_system_.get(),
+                       &mock_timer_, &message_handler_);
+  for (int i = 0; i < FileCacheIndex::kSegmentsPerSnapshot; ++i) {
+    ASSERT_TRUE(other.Update());
+    other.RecordPut(Path(IntegerToString(i)), 1, 200 + i);
+    other.RecordClean();
+    ASSERT_TRUE(other.MaybeCompact());
+    other.FlushJournal();
+  }
+  // Nothing to compact until the last segment has been replayed.
+  EXPECT_TRUE(Exists(StrCat(FileCacheIndex::kJournalName, "1")));
+  ASSERT_TRUE(other.Update());
+  ASSERT_TRUE(other.MaybeCompact());
+  EXPECT_FALSE(Exists(StrCat(FileCacheIndex::kJournalName, "1")));
+  EXPECT_FALSE(Exists(StrCat(FileCacheIndex::kJournalName, "8")));
+
+  // Our index predates the new snapshot, so we reload it.
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(2 + FileCacheIndex::kSegmentsPerSnapshot, index_.num_files());
+  EXPECT_EQ(FileCacheIndex::kSegmentsPerSnapshot,
+            index_.cleans_since_rebuild());
+
+  // A rebuild replaces the snapshot, too.
+  other.StartRebuild();
+  other.AddFile(Path("z"), 1, 300);
+  ASSERT_TRUE(other.FinishRebuild());
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(1, index_.num_files());
+  EXPECT_EQ(0, index_.cleans_since_rebuild());
+}
+
+TEST_F(FileCacheIndexTest, Release) {
+  WriteSnapshot();
+  index_.RecordPut(Path("c"), 5, 120);
+  ASSERT_TRUE(index_.Update());
+  std::vector<FileSystem::FileInfo> evicted;
+  index_.EvictOldest(25, 0, &evicted);
+  ASSERT_EQ(static_cast<size_t>(1), evicted.size());
+  index_.RecordDelete(evicted[0].name);
+  index_.RecordClean();
+  index_.Release();
+  EXPECT_EQ(0, index_.num_files());
+  EXPECT_EQ(0, index_.size_bytes());
+
+  // The next pass reloads the snapshot and replays every segment since,
+  // including the eviction.
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(2, index_.num_files());
+  EXPECT_EQ(25, index_.size_bytes());
+  EXPECT_EQ(1, index_.cleans_since_rebuild());
+}
+
+TEST_F(FileCacheIndexTest, MalformedJournalRecords) {
+  WriteSnapshot();
+  file_system_.WriteFile(Path(FileCacheIndex::kJournalName).c_str(),
+                         "p 5 120 c\n"
+                         "x what\n"
+                         "p five 120 d\n"
+                         "p 7 130 e",  // Partial write; no newline.
+                         &message_handler_);
+  ASSERT_TRUE(index_.Update());
+  EXPECT_EQ(3, index_.num_files());
+  EXPECT_EQ(35, index_.size_bytes());
+}
+
+TEST_F(FileCacheIndexTest, MalformedSnapshot) {
+  file_system_.WriteFile(Path(FileCacheIndex::kIndexName).c_str(),
+                         "not an index\np 5 120 b\n", &message_handler_);
+  EXPECT_FALSE(index_.Update());
+  EXPECT_EQ(0, index_.num_files());
+}
+
+TEST_F(FileCacheIndexTest, EvictOldest) {
+  index_.AddFile(Path("new"), 10, 300);
+  index_.AddFile(Path("old"), 10, 100);
+  index_.AddFile(Path("mid"), 10, 200);
+  index_.AddFile(Path("mid2"), 10, 200);
+
+  std::vector<FileSystem::FileInfo> evicted;
+  index_.EvictOldest(40, 0, &evicted);
+  EXPECT_TRUE(evicted.empty());
+
+  // Ties in atime are broken by name.
+  index_.EvictOldest(25, 0, &evicted);
+  ASSERT_EQ(static_cast<size_t>(2), evicted.size());
+  EXPECT_EQ(Path("old"), evicted[0].name);
+  EXPECT_EQ(Path("mid"), evicted[1].name);
+  EXPECT_EQ(20, index_.size_bytes());
+
+  // Reads move entries to the back of the line.
+  index_.AddFile(Path("mid2"), 10, 400);
+  evicted.clear();
+  index_.EvictOldest(100, 1, &evicted);
+  ASSERT_EQ(static_cast<size_t>(1), evicted.size());
+  EXPECT_EQ(Path("new"), evicted[0].name);
+  EXPECT_EQ(1, index_.num_files());
+}
+
+}  // namespace net_instaweb
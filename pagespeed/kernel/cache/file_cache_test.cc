@@ -35,6 +35,7 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/cache/file_cache_index.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
 #include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_stats.h"
@@ -63,6 +64,8 @@ class FileCacheTest : public CacheTestBase {
     evictions_ = stats_.GetVariable(FileCache::kEvictions);
     bytes_freed_in_cleanup_ = stats_.GetVariable(
         FileCache::kBytesFreedInCleanup);
+    cache_size_bytes_ = stats_.GetUpDownCounter(FileCache::kCacheSizeBytes);
+    cache_inode_count_ = stats_.GetUpDownCounter(FileCache::kCacheInodeCount);
 
     // TODO(jmarantz): consider using mock_thread_system if we want
     // explicit control of time.
@@ -91,6 +94,12 @@ class FileCacheTest : public CacheTestBase {
     return cache_->Clean(size, inode_count);
   }
 
+  bool CleanWithIndex(int64 size, int64 inode_count) {
+    return cache_->CleanWithIndex(size, inode_count);
+  }
+
+  const FileCacheIndex* index() { return cache_->index_.get(); }
+
   void RunClean() {
     cache_->CleanIfNeeded();
     while (worker_.IsBusy()) {
@@ -115,6 +124,8 @@ class FileCacheTest : public CacheTestBase {
   Variable* cleanups_;
   Variable* evictions_;
   Variable* bytes_freed_in_cleanup_;
+  UpDownCounter* cache_size_bytes_;
+  UpDownCounter* cache_inode_count_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FileCacheTest);
@@ -249,6 +260,84 @@ TEST_F(FileCacheTest, Clean) {
   EXPECT_EQ(6, dir_info.inode_count);
 }
 
+// Clean from the index rather than by walking the directory.
+TEST_F(FileCacheTest, CleanWithIndex) {
+  cache_->mutable_cache_policy()->clean_with_index = true;
+  // As in the Clean test, the mem_file_system needs an explicit directory
+  // entry in order to recurse into it.
+  GoogleString dir = GTestTempDir() + "/c/";
+  EXPECT_TRUE(file_system_.MakeDir(dir.c_str(), &message_handler_));
+  const char* names[] = {"a", "b", "c/d", "e", "f"};
+  for (int i = 0; i < 5; i++) {
+    CheckPut(names[i], StrCat("val", IntegerToString(i)));
+  }
+
+  // There's no index yet, so the first pass walks the directory and builds
+  // one.
+  EXPECT_TRUE(CleanWithIndex(1000, 0));
+  EXPECT_EQ(1, disk_checks_->Get());
+  EXPECT_EQ(0, cleanups_->Get());
+  EXPECT_EQ(5, index()->num_files());
+  EXPECT_EQ(20, index()->size_bytes());
+
+  // Freshen "a" and "b", and write a file behind the cache's back, which
+  // the index won't know about until it is next rebuilt.
+  CheckGet("a", "val0");
+  CheckGet("b", "val1");
+  GoogleString stray = StrCat(GTestTempDir(), "/stray");
+  ASSERT_TRUE(file_system_.WriteFile(stray.c_str(), "stray",
+                                     &message_handler_));
+
+  stats_.Clear();
+  EXPECT_TRUE(CleanWithIndex(20, 0));
+  EXPECT_EQ(1, disk_checks_->Get());
+  EXPECT_EQ(1, cleanups_->Get());
+  EXPECT_EQ(2, evictions_->Get());
+  EXPECT_EQ(8, bytes_freed_in_cleanup_->Get());
+  EXPECT_EQ(12, cache_size_bytes_->Get());
+  EXPECT_EQ(3, cache_inode_count_->Get());
+  CheckGet("a", "val0");
+  CheckGet("b", "val1");
+  CheckNotFound("c/d");
+  CheckNotFound("e");
+  CheckGet("f", "val4");
+  EXPECT_TRUE(file_system_.Exists(stray.c_str(), &message_handler_).is_true());
+
+  // Deletions are journaled too.
+  cache_->Delete("f");
+  EXPECT_TRUE(CleanWithIndex(1000, 0));
+  EXPECT_EQ(2, index()->num_files());
+  EXPECT_EQ(8, index()->size_bytes());
+
+  // Eventually the index is rebuilt from a full walk, which finds the stray.
+  while (index()->cleans_since_rebuild() != 0) {
+    EXPECT_TRUE(CleanWithIndex(1000, 0));
+  }
+  EXPECT_EQ(3, index()->num_files());
+  EXPECT_EQ(13, index()->size_bytes());
+}
+
+// Between passes, the index is not kept in memory.
+TEST_F(FileCacheTest, IndexReleasedAfterClean) {
+  cache_->mutable_cache_policy()->clean_with_index = true;
+  cache_->mutable_cache_policy()->target_size_bytes = 1000;
+  CheckPut("Name1", "Value");
+  RunClean();
+  mock_timer_.SleepMs(kCleanIntervalMs + 1);
+  RunClean();
+  EXPECT_EQ(1, disk_checks_->Get());
+  EXPECT_EQ(0, index()->num_files());
+
+  // The next pass reloads it, and finds both files.
+  CheckPut("Name2", "Value2");
+  mock_timer_.SleepMs(kCleanIntervalMs + 1);
+  RunClean();
+  EXPECT_EQ(2, disk_checks_->Get());
+  EXPECT_EQ(2, cache_inode_count_->Get());
+  EXPECT_EQ(11, cache_size_bytes_->Get());
+  EXPECT_EQ(0, index()->num_files());
+}
+
 // Test the auto-cleaning behavior
 TEST_F(FileCacheTest, CheckClean) {
   CheckPut("Name1", "Value");
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_FREQUENCY_SKETCH_H_
+#define PAGESPEED_KERNEL_CACHE_FREQUENCY_SKETCH_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+
+namespace net_instaweb {
+
+// Interface for the access-frequency history an AdmissionFilteredCache
+// consults.  TinyLFU keeps it in process memory, for caches private to a
+// process; SharedMemTinyLFU keeps the same sketch in shared memory, for
+// caches shared between processes.
+class FrequencySketch {
+ public:
+  FrequencySketch() {}
+  virtual ~FrequencySketch() {}
+
+  // Counts one access to the key with the given fingerprint.
+  virtual void Record(uint64 fingerprint) = 0;
+
+  // Returns the estimated recent access count for fingerprint.
+  virtual int Estimate(uint64 fingerprint) const = 0;
+
+  // Returns whether an entry for candidate should be stored if it would
+  // evict victim: that is, whether candidate is estimated to be the more
+  // frequently accessed of the two.  Ties favor the victim.
+  bool Admit(uint64 candidate, uint64 victim) const {
+    return Estimate(candidate) > Estimate(victim);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FrequencySketch);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_FREQUENCY_SKETCH_H_
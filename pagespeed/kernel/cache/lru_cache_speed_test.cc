@@ -16,8 +16,14 @@
 
 // Author: jmarantz@google.com (Joshua Marantz)
 //
-// Tests the speed of LRUCache, using different insert-sizes & key sizes.
-//
+// Tests the speed of LRUCache, using different insert-sizes & key sizes,
+// and compares it with ShardedLRUCache, both single-threaded and with
+// several threads reading concurrently.  The concurrent benchmarks also
+// log lock-contention counts, and the Scan benchmarks log the hit-rate of
+// a hot working set while a one-pass scan streams through the cache.  The
+// TraceReplay benchmarks replay a synthetic request trace, mixing a skewed
+// popular set with one-hit crawler keys, against LRU and 2Q with and
+// without the TinyLFU admission filter, and log the overall hit-rate.
 //
 // Benchmark              Time(ns)    CPU(ns) Iterations
 // -----------------------------------------------------
@@ -30,6 +36,7 @@
 
 #include "pagespeed/kernel/cache/lru_cache.h"
 
+#include <cmath>
 #include <vector>
 
 #include "base/logging.h"
@@ -37,16 +44,31 @@
 #include "pagespeed/kernel/base/benchmark.h"
 #include "pagespeed/kernel/base/cache_interface.h"
 #include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+#include "pagespeed/kernel/util/platform.h"
 #include "pagespeed/kernel/util/simple_random.h"
+#include "pagespeed/kernel/util/simple_stats.h"
 
 namespace {
 
 const int kNumKeys = 100000;
 const int kKeySize = 50;
 const int kPayloadSize = 100;
+const int kNumShards = 16;
+const int kNumReaderThreads = 8;
+
+// Sharded caches don't spread keys perfectly evenly, so give them some
+// headroom when we want to avoid evictions.
+const int kShardedSlackFactor = 2;
 
 class EmptyCallback : public net_instaweb::CacheInterface::Callback {
  public:
@@ -58,15 +80,57 @@ class EmptyCallback : public net_instaweb::CacheInterface::Callback {
   DISALLOW_COPY_AND_ASSIGN(EmptyCallback);
 };
 
+// ThreadsafeCache wrapped around an LRUCache it owns, to serve as the
+// single-mutex baseline for the concurrent benchmarks.
+class LockedLRUCache : public net_instaweb::ThreadsafeCache {
+ public:
+  LockedLRUCache(int size, net_instaweb::ThreadSystem* thread_system)
+      : ThreadsafeCache(new net_instaweb::LRUCache(size),
+                        thread_system->NewMutex()),
+        lru_cache_(static_cast<net_instaweb::LRUCache*>(Backend())) {
+  }
+
+  size_t num_hits() const { return lru_cache_->num_hits(); }
+  size_t num_evictions() const { return lru_cache_->num_evictions(); }
+  void Clear() { lru_cache_->Clear(); }
+
+ private:
+  scoped_ptr<net_instaweb::LRUCache> lru_cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockedLRUCache);
+};
+
+net_instaweb::LRUCache* NewCache(int size,
+                                 net_instaweb::ThreadSystem* thread_system,
+                                 net_instaweb::LRUCache* /* type tag */) {
+  return new net_instaweb::LRUCache(size);
+}
+
+LockedLRUCache* NewCache(int size, net_instaweb::ThreadSystem* thread_system,
+                         LockedLRUCache* /* type tag */) {
+  return new LockedLRUCache(size, thread_system);
+}
+
+net_instaweb::ShardedLRUCache* NewCache(
+    int size, net_instaweb::ThreadSystem* thread_system,
+    net_instaweb::ShardedLRUCache* /* type tag */) {
+  return new net_instaweb::ShardedLRUCache(
+      size * kShardedSlackFactor, kNumShards,
+      net_instaweb::ShardedLRUCache::kLRU, thread_system, NULL);
+}
+
+template<class CacheType>
 class TestPayload {
  public:
   TestPayload(int key_size, int payload_size, int num_keys, bool do_puts)
       : random_(new net_instaweb::NullMutex),
+        thread_system_(net_instaweb::Platform::CreateThreadSystem()),
         cache_size_((key_size + payload_size) * num_keys),
         key_size_(key_size),
         num_keys_(num_keys),
         start_index_(0),
-        lru_cache_(cache_size_),
+        lru_cache_(NewCache(cache_size_, thread_system_.get(),
+                            static_cast<CacheType*>(NULL))),
         keys_(num_keys),
         values_(num_keys) {
     StopBenchmarkTiming();
@@ -103,25 +167,34 @@ class TestPayload {
 
   void DoPuts(int rotate_by) {
     for (int k = 0; k < num_keys_; ++k) {
-      lru_cache_.Put(keys_[(k + rotate_by) % num_keys_], &values_[k]);
+      lru_cache_->Put(keys_[(k + rotate_by) % num_keys_], &values_[k]);
     }
   }
 
   void DoGets() {
+    DoGets(&empty_callback_);
+  }
+
+  // Callbacks are stateful, so concurrent readers must each supply their own.
+  void DoGets(net_instaweb::CacheInterface::Callback* callback) {
     for (int k = 0; k < num_keys_; ++k) {
-      lru_cache_.Get(keys_[k], &empty_callback_);
+      lru_cache_->Get(keys_[k], callback);
     }
   }
 
-  net_instaweb::LRUCache* lru_cache() { return &lru_cache_; }
+  // Runs DoGets 'iters' times from each of num_threads threads at once.
+  void DoConcurrentGets(int num_threads, int iters);
+
+  CacheType* lru_cache() { return lru_cache_.get(); }
 
  private:
   net_instaweb::SimpleRandom random_;
+  scoped_ptr<net_instaweb::ThreadSystem> thread_system_;
   int cache_size_;
   int key_size_;
   int num_keys_;
   int start_index_;
-  net_instaweb::LRUCache lru_cache_;
+  scoped_ptr<CacheType> lru_cache_;
   net_instaweb::StringVector keys_;
   std::vector<net_instaweb::SharedString> values_;
   EmptyCallback empty_callback_;
@@ -130,8 +203,54 @@ class TestPayload {
   DISALLOW_COPY_AND_ASSIGN(TestPayload);
 };
 
+template<class CacheType>
+class ReaderThread : public net_instaweb::ThreadSystem::Thread {
+ public:
+  ReaderThread(net_instaweb::ThreadSystem* thread_system,
+               TestPayload<CacheType>* payload, int iters)
+      : Thread(thread_system, "lru_reader",
+               net_instaweb::ThreadSystem::kJoinable),
+        payload_(payload),
+        iters_(iters) {
+  }
+
+ protected:
+  virtual void Run() {
+    for (int i = 0; i < iters_; ++i) {
+      payload_->DoGets(&callback_);
+    }
+  }
+
+ private:
+  TestPayload<CacheType>* payload_;
+  int iters_;
+  EmptyCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReaderThread);
+};
+
+template<class CacheType>
+void TestPayload<CacheType>::DoConcurrentGets(int num_threads, int iters) {
+  std::vector<ReaderThread<CacheType>*> threads(num_threads);
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t] = new ReaderThread<CacheType>(thread_system_.get(), this,
+                                             iters);
+  }
+  for (int t = 0; t < num_threads; ++t) {
+    CHECK(threads[t]->Start());
+  }
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t]->Join();
+    delete threads[t];
+  }
+}
+
+typedef TestPayload<net_instaweb::LRUCache> LRUPayload;
+typedef TestPayload<LockedLRUCache> LockedLRUPayload;
+typedef TestPayload<net_instaweb::ShardedLRUCache> ShardedPayload;
+
 static void LRUPuts(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, false);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, false);
   for (int i = 0; i < iters; ++i) {
     payload.lru_cache()->Clear();
     payload.DoPuts(0);
@@ -140,7 +259,7 @@ static void LRUPuts(int iters) {
 }
 
 static void LRUReplaceSameValue(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
   for (int i = 0; i < iters; ++i) {
     payload.DoPuts(0);
   }
@@ -149,7 +268,7 @@ static void LRUReplaceSameValue(int iters) {
 }
 
 static void LRUReplaceNewValue(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
   for (int i = 0; i < iters; ++i) {
     payload.DoPuts(i + 1);
   }
@@ -158,7 +277,7 @@ static void LRUReplaceNewValue(int iters) {
 }
 
 static void LRUGets(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
   for (int i = 0; i < iters; ++i) {
     payload.DoGets();
   }
@@ -166,7 +285,7 @@ static void LRUGets(int iters) {
 }
 
 static void LRUFailedGets(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
   payload.RegenerateKeys();
   for (int i = 0; i < iters; ++i) {
     payload.DoGets();
@@ -175,7 +294,7 @@ static void LRUFailedGets(int iters) {
 }
 
 static void LRUEvictions(int iters) {
-  TestPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  LRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
   for (int i = 0; i < iters; ++i) {
     payload.RegenerateKeys();
     payload.DoPuts(0);
@@ -184,6 +303,184 @@ static void LRUEvictions(int iters) {
   CHECK_LT(0, static_cast<int>(payload.lru_cache()->num_evictions()));
 }
 
+static void ShardedLRUPuts(int iters) {
+  ShardedPayload payload(kKeySize, kPayloadSize, kNumKeys, false);
+  for (int i = 0; i < iters; ++i) {
+    payload.lru_cache()->Clear();
+    payload.DoPuts(0);
+  }
+}
+
+static void ShardedLRUGets(int iters) {
+  ShardedPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  for (int i = 0; i < iters; ++i) {
+    payload.DoGets();
+  }
+  CHECK_EQ(0, static_cast<int>(payload.lru_cache()->num_evictions()));
+  CHECK_EQ(kNumKeys * iters, static_cast<int>(payload.lru_cache()->num_hits()));
+}
+
+// The concurrent benchmarks run kNumReaderThreads threads, each doing
+// kNumKeys Gets per iteration, against the same cache.
+static void LockedLRUConcurrentGets(int iters) {
+  LockedLRUPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  payload.DoConcurrentGets(kNumReaderThreads, iters);
+  CHECK_EQ(kNumKeys * iters * kNumReaderThreads,
+           static_cast<int>(payload.lru_cache()->num_hits()));
+}
+
+static void ShardedLRUConcurrentGets(int iters) {
+  ShardedPayload payload(kKeySize, kPayloadSize, kNumKeys, true);
+  payload.DoConcurrentGets(kNumReaderThreads, iters);
+  net_instaweb::ShardedLRUCache* cache = payload.lru_cache();
+  CHECK_EQ(kNumKeys * iters * kNumReaderThreads,
+           static_cast<int>(cache->num_hits()));
+  LOG(INFO) << "ShardedLRUConcurrentGets: " << cache->num_lock_contentions()
+            << " lock contentions in " << cache->num_hits() << " gets";
+}
+
+// Simulates a hot working set interleaved with one-pass scans that are
+// each larger than the cache, doing a Put after every missed Get as a
+// caching client would.  Logs the hit-rate on the hot keys.
+static void RunScanWorkload(net_instaweb::ShardedLRUCache::Policy policy,
+                            int iters) {
+  StopBenchmarkTiming();
+  const int kNumHotKeys = 500;
+  const int kScanKeysPerRound = 2000;
+  const int kEntrySize = kKeySize + kPayloadSize;
+  scoped_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::ShardedLRUCache cache(
+      2 * kNumHotKeys * kEntrySize, 1, policy, thread_system.get(), NULL);
+  net_instaweb::SharedString value(GoogleString(kPayloadSize, 'v'));
+  net_instaweb::CacheInterface::SynchronousCallback callback;
+  GoogleString key_prefix(kKeySize - 10, 'k');
+  int hot_hits = 0;
+  int hot_gets = 0;
+  int scan_index = 0;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    for (int k = 0; k < kNumHotKeys; ++k) {
+      GoogleString key = net_instaweb::StrCat(
+          key_prefix, "h", net_instaweb::IntegerToString(k));
+      callback.Reset();
+      cache.Get(key, &callback);
+      ++hot_gets;
+      if (callback.state() == net_instaweb::CacheInterface::kAvailable) {
+        ++hot_hits;
+      } else {
+        cache.Put(key, &value);
+      }
+    }
+    for (int k = 0; k < kScanKeysPerRound; ++k, ++scan_index) {
+      GoogleString key = net_instaweb::StrCat(
+          key_prefix, "s", net_instaweb::IntegerToString(scan_index));
+      callback.Reset();
+      cache.Get(key, &callback);
+      if (callback.state() != net_instaweb::CacheInterface::kAvailable) {
+        cache.Put(key, &value);
+      }
+    }
+  }
+  LOG(INFO) << cache.Name() << ": hot-set hit rate "
+            << (100.0 * hot_hits / hot_gets) << "% over " << iters
+            << " rounds";
+}
+
+static void LRUScanHitRate(int iters) {
+  RunScanWorkload(net_instaweb::ShardedLRUCache::kLRU, iters);
+}
+
+static void TwoQueueScanHitRate(int iters) {
+  RunScanWorkload(net_instaweb::ShardedLRUCache::kTwoQueue, iters);
+}
+
+// Builds a request trace in which half the requests go to a popular set
+// of keys with a roughly Zipfian (log-uniform) rank distribution, and the
+// other half are keys requested exactly once, as from a crawler.
+void BuildTrace(int length, net_instaweb::StringVector* trace) {
+  const int kNumPopularKeys = 10000;
+  net_instaweb::SimpleRandom random(new net_instaweb::NullMutex);
+  GoogleString key_prefix(kKeySize - 10, 'k');
+  trace->clear();
+  for (int i = 0; i < length; ++i) {
+    uint32 r = random.Next();
+    if ((r & 1) == 0) {
+      double u = (r >> 1) / 2147483648.0;
+      int rank = static_cast<int>(pow(kNumPopularKeys, u)) - 1;
+      trace->push_back(net_instaweb::StrCat(
+          key_prefix, "p", net_instaweb::IntegerToString(rank)));
+    } else {
+      trace->push_back(net_instaweb::StrCat(
+          key_prefix, "c", net_instaweb::IntegerToString(i)));
+    }
+  }
+}
+
+// Replays a trace from BuildTrace against a cache holding a tenth of the
+// popular keys, doing a Put after every missed Get, and logs the hit-rate.
+static void RunTraceReplay(net_instaweb::ShardedLRUCache::Policy policy,
+                           bool admission_filter, int iters) {
+  StopBenchmarkTiming();
+  const int kTraceLength = 200000;
+  const int kCacheEntries = 1000;
+  net_instaweb::StringVector trace;
+  BuildTrace(kTraceLength, &trace);
+  scoped_ptr<net_instaweb::ThreadSystem> thread_system(
+      net_instaweb::Platform::CreateThreadSystem());
+  net_instaweb::SimpleStats stats(thread_system.get());
+  net_instaweb::AdmissionFilteredCache::InitStats("trace", &stats);
+  net_instaweb::SharedString value(GoogleString(kPayloadSize, 'v'));
+  net_instaweb::CacheInterface::SynchronousCallback callback;
+  int hits = 0;
+  int gets = 0;
+  GoogleString name;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    net_instaweb::ShardedLRUCache lru_cache(
+        kCacheEntries * (kKeySize + kPayloadSize), 1, policy,
+        thread_system.get(), NULL);
+    net_instaweb::TinyLFU tiny_lfu(kCacheEntries, thread_system.get());
+    net_instaweb::AdmissionFilteredCache filtered_cache(
+        "trace", &lru_cache, &tiny_lfu, &stats);
+    net_instaweb::CacheInterface* cache = &lru_cache;
+    if (admission_filter) {
+      cache = &filtered_cache;
+    }
+    name = cache->Name();
+    for (int k = 0, n = trace.size(); k < n; ++k) {
+      callback.Reset();
+      cache->Get(trace[k], &callback);
+      ++gets;
+      if (callback.state() == net_instaweb::CacheInterface::kAvailable) {
+        ++hits;
+      } else {
+        cache->Put(trace[k], &value);
+      }
+    }
+  }
+  LOG(INFO) << name << ": trace hit rate " << (100.0 * hits / gets)
+            << "% over " << iters << " replays";
+}
+
+static void LRUTraceReplay(int iters) {
+  RunTraceReplay(net_instaweb::ShardedLRUCache::kLRU, false, iters);
+}
+
+static void LRUTinyLFUTraceReplay(int iters) {
+  RunTraceReplay(net_instaweb::ShardedLRUCache::kLRU, true, iters);
+}
+
+static void TwoQueueTraceReplay(int iters) {
+  RunTraceReplay(net_instaweb::ShardedLRUCache::kTwoQueue, false, iters);
+}
+
+static void TwoQueueTinyLFUTraceReplay(int iters) {
+  RunTraceReplay(net_instaweb::ShardedLRUCache::kTwoQueue, true, iters);
+}
+
 }  // namespace
 
 BENCHMARK(LRUPuts);
@@ -192,3 +489,13 @@ BENCHMARK(LRUReplaceNewValue);
 BENCHMARK(LRUGets);
 BENCHMARK(LRUFailedGets);
 BENCHMARK(LRUEvictions);
+BENCHMARK(ShardedLRUPuts);
+BENCHMARK(ShardedLRUGets);
+BENCHMARK(LockedLRUConcurrentGets);
+BENCHMARK(ShardedLRUConcurrentGets);
+BENCHMARK(LRUScanHitRate);
+BENCHMARK(TwoQueueScanHitRate);
+BENCHMARK(LRUTraceReplay);
+BENCHMARK(LRUTinyLFUTraceReplay);
+BENCHMARK(TwoQueueTraceReplay);
+BENCHMARK(TwoQueueTinyLFUTraceReplay);
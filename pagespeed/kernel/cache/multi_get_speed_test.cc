@@ -0,0 +1,450 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares looking up the property-cache entries for a page with one Get
+// per cohort against a single MultiGet, over the caches the metadata and
+// property caches are normally built from.  Each iteration looks up
+// kNumCohorts keys, so the per-key latency is the time divided by
+// kNumCohorts.  For the write-through cache, half the keys are only in the
+// file-cache L2, which is read through io_uring where available.  The
+// Concurrent variants run the same lookups from kNumLookupThreads threads.
+//
+// On a single-core Linux VM the in-process caches gain nothing from
+// MultiGet: an uncontended lock costs less than building the request, and
+// those caches still look keys up one at a time.  The benefit is expected
+// on many-core hosts, where SharedMemCache takes each contended sector lock
+// once per batch and the file cache submits all of its reads together.
+//
+// Benchmark                             Time(ns)
+// ----------------------------------------------
+// ThreadsafeLRUGets                         6738
+// ThreadsafeLRUMultiGet                     6444
+// ShardedLRUGets                            6336
+// ShardedLRUMultiGet                        6913
+// SharedMemGets                            10986
+// SharedMemMultiGet                        12384
+// WriteThroughFileGets                     82697
+// WriteThroughFileMultiGet                 89053
+// ThreadsafeLRUConcurrentGets              51787
+// ThreadsafeLRUConcurrentMultiGet          61780
+// ShardedLRUConcurrentGets                 49417
+// ShardedLRUConcurrentMultiGet             69221
+// SharedMemConcurrentGets                  81884
+// SharedMemConcurrentMultiGet              87742
+
+#include <unistd.h>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/benchmark.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/async_file_cache.h"
+#include "pagespeed/kernel/cache/file_cache.h"
+#include "pagespeed/kernel/cache/lru_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/cache/write_through_cache.h"
+#include "pagespeed/kernel/sharedmem/inprocess_shared_mem.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
+#include "pagespeed/kernel/thread/slow_worker.h"
+#include "pagespeed/kernel/util/io_uring_file_io.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_random.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+#include "pagespeed/kernel/util/threaded_file_io.h"
+
+namespace {
+
+const int kNumCohorts = 20;
+const int kPayloadSize = 512;
+const int kCacheSize = 10 * 1000 * 1000;
+const int kNumShards = 16;
+const int kShmSectors = 64;
+const int kShmSizeKb = 10 * 1024;
+const int kNumIoThreads = 8;
+const int kNumLookupThreads = 8;
+const int kQueueDepth = 64;
+const char kShmSegment[] = "multi_get_speed_test";
+
+// Counts down outstanding lookups.
+class CountingCallback : public net_instaweb::CacheInterface::Callback {
+ public:
+  explicit CountingCallback(net_instaweb::AtomicInt32* outstanding)
+      : outstanding_(outstanding) {}
+  virtual ~CountingCallback() {}
+
+  virtual void Done(net_instaweb::CacheInterface::KeyState state) {
+    CHECK_EQ(net_instaweb::CacheInterface::kAvailable, state);
+    outstanding_->NoBarrierIncrement(-1);
+    delete this;
+  }
+
+ private:
+  net_instaweb::AtomicInt32* outstanding_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingCallback);
+};
+
+class PageLookupBenchmark {
+ public:
+  enum Stack {
+    kThreadsafeLRU,
+    kShardedLRU,
+    kSharedMem,
+    kWriteThroughFile,
+  };
+
+  explicit PageLookupBenchmark(Stack stack)
+      : stack_(stack),
+        thread_system_(net_instaweb::Platform::CreateThreadSystem()),
+        timer_(thread_system_->NewTimer()),
+        worker_("cleaner", thread_system_.get()),
+        stats_(thread_system_.get()),
+        random_(new net_instaweb::NullMutex),
+        path_(net_instaweb::StrCat(net_instaweb::GTestTempDir(),
+                                   "/multi_get_speed_test")),
+        cache_(NULL) {
+    StopBenchmarkTiming();
+    switch (stack) {
+      case kThreadsafeLRU:
+        lru_cache_.reset(new net_instaweb::LRUCache(kCacheSize));
+        threadsafe_cache_.reset(new net_instaweb::ThreadsafeCache(
+            lru_cache_.get(), thread_system_->NewMutex()));
+        cache_ = threadsafe_cache_.get();
+        break;
+      case kShardedLRU:
+        sharded_cache_.reset(NewShardedCache());
+        cache_ = sharded_cache_.get();
+        break;
+      case kSharedMem:
+        InitSharedMemCache();
+        cache_ = shm_cache_.get();
+        break;
+      case kWriteThroughFile:
+        if (InitFileCache()) {
+          sharded_cache_.reset(NewShardedCache());
+          write_through_cache_.reset(new net_instaweb::WriteThroughCache(
+              sharded_cache_.get(), async_cache_.get()));
+          cache_ = write_through_cache_.get();
+        }
+        break;
+    }
+
+    GoogleString value = random_.GenerateHighEntropyString(kPayloadSize);
+    value_.Assign(value);
+    for (int i = 0; i < kNumCohorts; ++i) {
+      keys_.push_back(net_instaweb::StrCat(
+          "prop_page/http://example.com/index.html@hash_cohort",
+          net_instaweb::IntegerToString(i)));
+    }
+    if (cache_ != NULL) {
+      for (int i = 0; i < kNumCohorts; ++i) {
+        cache_->Put(keys_[i], &value_);
+      }
+      WaitForPuts();
+    }
+    StartBenchmarkTiming();
+  }
+
+  ~PageLookupBenchmark() {
+    StopBenchmarkTiming();
+    if (io_uring_.get() != NULL) {
+      io_uring_->ShutDown();
+    }
+    if (threaded_io_.get() != NULL) {
+      threaded_io_->ShutDown();
+    }
+    if (file_cache_.get() != NULL) {
+      for (int i = 0; i < kNumCohorts; ++i) {
+        file_cache_->Delete(keys_[i]);
+      }
+    }
+    if (shm_cache_.get() != NULL) {
+      shm_cache_.reset(NULL);
+      net_instaweb::SharedMemCache<64>::GlobalCleanup(
+          shm_runtime_.get(), kShmSegment, &handler_);
+    }
+    StartBenchmarkTiming();
+  }
+
+  bool ok() const { return cache_ != NULL; }
+
+  void Run(int iters, bool use_multi_get) {
+    for (int i = 0; i < iters; ++i) {
+      if (stack_ == kWriteThroughFile) {
+        // Leave only the even cohorts in the L1, so that the odd ones have
+        // to be read from the file cache.
+        StopBenchmarkTiming();
+        for (int k = 1; k < kNumCohorts; k += 2) {
+          sharded_cache_->Delete(keys_[k]);
+        }
+        StartBenchmarkTiming();
+      }
+      LookUpPage(use_multi_get, &outstanding_);
+    }
+  }
+
+  // Runs kNumLookupThreads threads, each looking up the page iters times.
+  void RunConcurrent(int iters, bool use_multi_get);
+
+  void LookUpPage(bool use_multi_get, net_instaweb::AtomicInt32* outstanding) {
+    outstanding->set_value(kNumCohorts);
+    if (use_multi_get) {
+      net_instaweb::CacheInterface::MultiGetRequest* request =
+          new net_instaweb::CacheInterface::MultiGetRequest;
+      request->reserve(kNumCohorts);
+      for (int k = 0; k < kNumCohorts; ++k) {
+        request->push_back(net_instaweb::CacheInterface::KeyCallback(
+            keys_[k], new CountingCallback(outstanding)));
+      }
+      cache_->MultiGet(request);
+    } else {
+      for (int k = 0; k < kNumCohorts; ++k) {
+        cache_->Get(keys_[k], new CountingCallback(outstanding));
+      }
+    }
+    while (outstanding->value() != 0) {
+      usleep(10);
+    }
+  }
+
+ private:
+  net_instaweb::ShardedLRUCache* NewShardedCache() {
+    return new net_instaweb::ShardedLRUCache(
+        kCacheSize, kNumShards, net_instaweb::ShardedLRUCache::kLRU,
+        thread_system_.get(), NULL);
+  }
+
+  void InitSharedMemCache() {
+    int entries, blocks;
+    int64 size_cap;
+    net_instaweb::SharedMemCache<64>::ComputeDimensions(
+        kShmSizeKb, 2 /* block_entry_ratio */, kShmSectors, &entries, &blocks,
+        &size_cap);
+    shm_runtime_.reset(new net_instaweb::InProcessSharedMem(
+        thread_system_.get()));
+    shm_cache_.reset(new net_instaweb::SharedMemCache<64>(
+        shm_runtime_.get(), kShmSegment, timer_.get(), &hasher_, kShmSectors,
+        entries, blocks, &handler_));
+    CHECK(shm_cache_->Initialize());
+  }
+
+  // Returns false if io_uring is not available.
+  bool InitFileCache() {
+    net_instaweb::FileCache::InitStats(&stats_);
+    file_system_.RecursivelyMakeDir(path_, &handler_);
+    // Large enough that we never clean during the benchmark.
+    file_cache_.reset(new net_instaweb::FileCache(
+        path_, &file_system_, thread_system_.get(), &worker_,
+        new net_instaweb::FileCache::CachePolicy(
+            timer_.get(), &hasher_, net_instaweb::Timer::kHourMs,
+            1000 * 1000 * 1000, 0),
+        &stats_, &handler_));
+    threaded_io_.reset(new net_instaweb::ThreadedFileIo(
+        kNumIoThreads, &file_system_, thread_system_.get(), &handler_));
+    io_uring_.reset(net_instaweb::IoUringFileIo::Create(
+        kQueueDepth, kNumIoThreads, threaded_io_.get(), thread_system_.get(),
+        &handler_));
+    if (io_uring_.get() == NULL) {
+      return false;
+    }
+    async_cache_.reset(new net_instaweb::AsyncFileCache(
+        file_cache_.get(), io_uring_.get()));
+    return true;
+  }
+
+  void WaitForPuts() {
+    if (async_cache_.get() != NULL) {
+      while (async_cache_->outstanding_operations() != 0) {
+        usleep(10);
+      }
+    }
+  }
+
+  Stack stack_;
+  scoped_ptr<net_instaweb::ThreadSystem> thread_system_;
+  scoped_ptr<net_instaweb::Timer> timer_;
+  net_instaweb::MD5Hasher hasher_;
+  net_instaweb::SlowWorker worker_;
+  net_instaweb::StdioFileSystem file_system_;
+  net_instaweb::SimpleStats stats_;
+  net_instaweb::NullMessageHandler handler_;
+  net_instaweb::SimpleRandom random_;
+  const GoogleString path_;
+
+  scoped_ptr<net_instaweb::LRUCache> lru_cache_;
+  scoped_ptr<net_instaweb::ThreadsafeCache> threadsafe_cache_;
+  scoped_ptr<net_instaweb::ShardedLRUCache> sharded_cache_;
+  scoped_ptr<net_instaweb::InProcessSharedMem> shm_runtime_;
+  scoped_ptr<net_instaweb::SharedMemCache<64> > shm_cache_;
+  scoped_ptr<net_instaweb::FileCache> file_cache_;
+  scoped_ptr<net_instaweb::ThreadedFileIo> threaded_io_;
+  scoped_ptr<net_instaweb::IoUringFileIo> io_uring_;
+  scoped_ptr<net_instaweb::AsyncFileCache> async_cache_;
+  scoped_ptr<net_instaweb::WriteThroughCache> write_through_cache_;
+  net_instaweb::CacheInterface* cache_;
+
+  net_instaweb::SharedString value_;
+  net_instaweb::StringVector keys_;
+  net_instaweb::AtomicInt32 outstanding_;
+
+  DISALLOW_COPY_AND_ASSIGN(PageLookupBenchmark);
+};
+
+class LookupThread : public net_instaweb::ThreadSystem::Thread {
+ public:
+  LookupThread(net_instaweb::ThreadSystem* thread_system,
+               PageLookupBenchmark* benchmark, int iters, bool use_multi_get)
+      : Thread(thread_system, "page_lookup",
+               net_instaweb::ThreadSystem::kJoinable),
+        benchmark_(benchmark),
+        iters_(iters),
+        use_multi_get_(use_multi_get) {
+  }
+
+ protected:
+  virtual void Run() {
+    for (int i = 0; i < iters_; ++i) {
+      benchmark_->LookUpPage(use_multi_get_, &outstanding_);
+    }
+  }
+
+ private:
+  PageLookupBenchmark* benchmark_;
+  int iters_;
+  bool use_multi_get_;
+  net_instaweb::AtomicInt32 outstanding_;
+
+  DISALLOW_COPY_AND_ASSIGN(LookupThread);
+};
+
+void PageLookupBenchmark::RunConcurrent(int iters, bool use_multi_get) {
+  std::vector<LookupThread*> threads(kNumLookupThreads);
+  for (int t = 0; t < kNumLookupThreads; ++t) {
+    threads[t] = new LookupThread(thread_system_.get(), this, iters,
+                                  use_multi_get);
+  }
+  for (int t = 0; t < kNumLookupThreads; ++t) {
+    CHECK(threads[t]->Start());
+  }
+  for (int t = 0; t < kNumLookupThreads; ++t) {
+    threads[t]->Join();
+    delete threads[t];
+  }
+}
+
+void RunBenchmark(PageLookupBenchmark::Stack stack, bool use_multi_get,
+                  int iters) {
+  PageLookupBenchmark benchmark(stack);
+  if (!benchmark.ok()) {
+    LOG(WARNING) << "io_uring not available; skipping benchmark";
+    return;
+  }
+  benchmark.Run(iters, use_multi_get);
+}
+
+void RunConcurrentBenchmark(PageLookupBenchmark::Stack stack,
+                            bool use_multi_get, int iters) {
+  PageLookupBenchmark benchmark(stack);
+  benchmark.RunConcurrent(iters, use_multi_get);
+}
+
+static void ThreadsafeLRUGets(int iters) {
+  RunBenchmark(PageLookupBenchmark::kThreadsafeLRU, false, iters);
+}
+
+static void ThreadsafeLRUMultiGet(int iters) {
+  RunBenchmark(PageLookupBenchmark::kThreadsafeLRU, true, iters);
+}
+
+static void ShardedLRUGets(int iters) {
+  RunBenchmark(PageLookupBenchmark::kShardedLRU, false, iters);
+}
+
+static void ShardedLRUMultiGet(int iters) {
+  RunBenchmark(PageLookupBenchmark::kShardedLRU, true, iters);
+}
+
+static void SharedMemGets(int iters) {
+  RunBenchmark(PageLookupBenchmark::kSharedMem, false, iters);
+}
+
+static void SharedMemMultiGet(int iters) {
+  RunBenchmark(PageLookupBenchmark::kSharedMem, true, iters);
+}
+
+static void WriteThroughFileGets(int iters) {
+  RunBenchmark(PageLookupBenchmark::kWriteThroughFile, false, iters);
+}
+
+static void WriteThroughFileMultiGet(int iters) {
+  RunBenchmark(PageLookupBenchmark::kWriteThroughFile, true, iters);
+}
+
+static void ThreadsafeLRUConcurrentGets(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kThreadsafeLRU, false, iters);
+}
+
+static void ThreadsafeLRUConcurrentMultiGet(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kThreadsafeLRU, true, iters);
+}
+
+static void ShardedLRUConcurrentGets(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kShardedLRU, false, iters);
+}
+
+static void ShardedLRUConcurrentMultiGet(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kShardedLRU, true, iters);
+}
+
+static void SharedMemConcurrentGets(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kSharedMem, false, iters);
+}
+
+static void SharedMemConcurrentMultiGet(int iters) {
+  RunConcurrentBenchmark(PageLookupBenchmark::kSharedMem, true, iters);
+}
+
+}  // namespace
+
+BENCHMARK(ThreadsafeLRUGets);
+BENCHMARK(ThreadsafeLRUMultiGet);
+BENCHMARK(ShardedLRUGets);
+BENCHMARK(ShardedLRUMultiGet);
+BENCHMARK(SharedMemGets);
+BENCHMARK(SharedMemMultiGet);
+BENCHMARK(WriteThroughFileGets);
+BENCHMARK(WriteThroughFileMultiGet);
+BENCHMARK(ThreadsafeLRUConcurrentGets);
+BENCHMARK(ThreadsafeLRUConcurrentMultiGet);
+BENCHMARK(ShardedLRUConcurrentGets);
+BENCHMARK(ShardedLRUConcurrentMultiGet);
+BENCHMARK(SharedMemConcurrentGets);
+BENCHMARK(SharedMemConcurrentMultiGet);
@@ -0,0 +1,651 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <utility>  // for pair
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/rde_hash_map.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_hash.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Number of entries allocated at once when a shard's free-list runs dry.
+const int kEntriesPerSlab = 256;
+
+// 2Q tuning parameters, from the paper.  The probation (A1in) queue is
+// allowed to hold a quarter of the shard's bytes before we prefer to
+// evict from it, and the ghost (A1out) list remembers about half as many
+// keys as are resident.
+const int kProbationFraction = 4;
+const size_t kMinGhostEntries = 16;
+
+}  // namespace
+
+const int ShardedLRUCache::kDefaultNumShards;
+
+const char ShardedLRUCache::kLockContentions[] =
+    "lru_cache_shard_lock_contentions";
+
+// One independently locked partition of the cache.
+class ShardedLRUCache::Shard {
+ public:
+  Shard(size_t max_bytes, Policy policy, AbstractMutex* mutex,
+        Variable* lock_contentions)
+      : max_bytes_(max_bytes),
+        policy_(policy),
+        mutex_(mutex),
+        lock_contentions_variable_(lock_contentions),
+        free_list_(NULL),
+        current_bytes_(0) {
+    ClearStats();
+  }
+
+  ~Shard() {
+    ClearLockHeld();
+    for (int i = 0, n = slabs_.size(); i < n; ++i) {
+      delete [] slabs_[i];
+    }
+  }
+
+  // Copies the value for key into *value if present, freshening the entry.
+  bool Get(const GoogleString& key, SharedString* value)
+      LOCKS_EXCLUDED(mutex_) {
+    LockAndCount();
+    bool found = false;
+    Map::iterator p = map_.find(key);
+    if (p != map_.end()) {
+      Entry* entry = p->second;
+      // In 2Q, references to entries still in the probation queue are
+      // assumed to be correlated with the initial reference, and so do not
+      // affect their position.
+      if (entry->queue == kMainQueue) {
+        main_.MoveToFront(entry);
+      }
+      *value = entry->value;
+      found = true;
+      ++num_hits_;
+    } else {
+      ++num_misses_;
+    }
+    mutex_->Unlock();
+    return found;
+  }
+
+  void Put(const GoogleString& key, size_t hash, SharedString* new_value)
+      LOCKS_EXCLUDED(mutex_) {
+    LockAndCount();
+    size_t bytes_needed = key.size() + new_value->size();
+    bool admit_to_main = (policy_ == kLRU);
+    Map::iterator p = map_.find(key);
+    if (p != map_.end()) {
+      Entry* entry = p->second;
+      if (entry->value.Value() == new_value->Value()) {
+        if (entry->queue == kMainQueue) {
+          main_.MoveToFront(entry);
+        }
+        ++num_identical_reinserts_;
+        mutex_->Unlock();
+        return;
+      }
+
+      // Replacing the value: remove the old entry entirely so it's not a
+      // candidate for eviction, but keep its queue membership.
+      admit_to_main = admit_to_main || (entry->queue == kMainQueue);
+      ++num_deletes_;
+      map_.erase(p);
+      RemoveEntry(entry);
+    }
+
+    if (bytes_needed < max_bytes_) {
+      if (!admit_to_main && IsGhost(hash)) {
+        admit_to_main = true;
+        ++num_ghost_hits_;
+      }
+      while (bytes_needed + current_bytes_ > max_bytes_) {
+        EvictOne();
+      }
+      Entry* entry = NewEntry();
+      entry->key = key;
+      entry->value = *new_value;
+      entry->hash = hash;
+      entry->bytes = bytes_needed;
+      map_.insert(Map::value_type(entry->key, entry));
+      if (admit_to_main) {
+        entry->queue = kMainQueue;
+        main_.PushFront(entry);
+      } else {
+        entry->queue = kProbationQueue;
+        probation_.PushFront(entry);
+      }
+      current_bytes_ += bytes_needed;
+      ++num_inserts_;
+    }
+    mutex_->Unlock();
+  }
+
+  // Sets *victim_hash to the hash of the entry that would be evicted first
+  // to make room for bytes_needed more bytes under key, if any would be.
+  bool PeekEvictionVictim(const GoogleString& key, size_t bytes_needed,
+                          size_t* victim_hash) LOCKS_EXCLUDED(mutex_) {
+    LockAndCount();
+    bool would_evict = false;
+    if ((bytes_needed < max_bytes_) &&
+        (bytes_needed + current_bytes_ > max_bytes_) &&
+        (map_.find(key) == map_.end())) {
+      *victim_hash = NextVictim()->hash;
+      would_evict = true;
+    }
+    mutex_->Unlock();
+    return would_evict;
+  }
+
+  void Delete(const GoogleString& key) LOCKS_EXCLUDED(mutex_) {
+    LockAndCount();
+    Map::iterator p = map_.find(key);
+    if (p != map_.end()) {
+      Entry* entry = p->second;
+      map_.erase(p);
+      RemoveEntry(entry);
+      ++num_deletes_;
+    }
+    mutex_->Unlock();
+  }
+
+  void Clear() LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    ClearLockHeld();
+  }
+
+  void ClearStats() {
+    num_evictions_ = 0;
+    num_hits_ = 0;
+    num_misses_ = 0;
+    num_inserts_ = 0;
+    num_identical_reinserts_ = 0;
+    num_deletes_ = 0;
+    num_lock_contentions_ = 0;
+    num_ghost_hits_ = 0;
+  }
+
+  void SanityCheck() LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    size_t count = 0;
+    size_t bytes = 0;
+    SanityCheckList(&probation_, kProbationQueue, &count, &bytes);
+    SanityCheckList(&main_, kMainQueue, &count, &bytes);
+    CHECK_EQ(count, static_cast<size_t>(map_.size()));
+    CHECK_EQ(current_bytes_, bytes);
+    CHECK_LE(current_bytes_, max_bytes_);
+    CHECK_EQ(ghost_fifo_.size(), NumCountedGhosts());
+    if (policy_ == kLRU) {
+      CHECK(probation_.empty());
+    }
+  }
+
+  // Identifies the counters that can be read via Stat().
+  enum StatIndex {
+    kSizeBytes,
+    kNumElements,
+    kNumEvictions,
+    kNumHits,
+    kNumMisses,
+    kNumInserts,
+    kNumIdenticalReinserts,
+    kNumDeletes,
+    kNumLockContentions,
+    kNumGhostHits,
+    kNumStats
+  };
+
+  size_t Stat(StatIndex index) LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    switch (index) {
+      case kSizeBytes:             return current_bytes_;
+      case kNumElements:           return map_.size();
+      case kNumEvictions:          return num_evictions_;
+      case kNumHits:               return num_hits_;
+      case kNumMisses:             return num_misses_;
+      case kNumInserts:            return num_inserts_;
+      case kNumIdenticalReinserts: return num_identical_reinserts_;
+      case kNumDeletes:            return num_deletes_;
+      case kNumLockContentions:    return num_lock_contentions_;
+      case kNumGhostHits:          return num_ghost_hits_;
+      case kNumStats:              break;
+    }
+    LOG(DFATAL) << "Invalid stat index " << index;
+    return 0;
+  }
+
+  void ResetStats() LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    ClearStats();
+  }
+
+ private:
+  enum Queue {
+    kFree,
+    kProbationQueue,
+    kMainQueue
+  };
+
+  // Intrusive links, so that list manipulation never allocates.
+  struct Links {
+    Links* prev;
+    Links* next;
+  };
+
+  struct Entry : public Links {
+    GoogleString key;
+    SharedString value;
+    size_t hash;
+    size_t bytes;
+    Queue queue;
+  };
+
+  // Circular doubly-linked list with a sentinel; front is most recently
+  // used (or most recently inserted, for the FIFO probation queue).
+  class EntryList {
+   public:
+    EntryList() : bytes_(0) {
+      sentinel_.prev = &sentinel_;
+      sentinel_.next = &sentinel_;
+    }
+
+    bool empty() const { return sentinel_.next == &sentinel_; }
+    size_t bytes() const { return bytes_; }
+
+    Entry* Front() { return empty() ? NULL : ToEntry(sentinel_.next); }
+    Entry* Back() { return empty() ? NULL : ToEntry(sentinel_.prev); }
+    Entry* Next(Entry* entry) {
+      return (entry->next == &sentinel_) ? NULL : ToEntry(entry->next);
+    }
+
+    void PushFront(Entry* entry) {
+      entry->prev = &sentinel_;
+      entry->next = sentinel_.next;
+      sentinel_.next->prev = entry;
+      sentinel_.next = entry;
+      bytes_ += entry->bytes;
+    }
+
+    void Remove(Entry* entry) {
+      entry->prev->next = entry->next;
+      entry->next->prev = entry->prev;
+      entry->prev = NULL;
+      entry->next = NULL;
+      DCHECK_GE(bytes_, entry->bytes);
+      bytes_ -= entry->bytes;
+    }
+
+    void MoveToFront(Entry* entry) {
+      if (sentinel_.next != entry) {
+        Remove(entry);
+        PushFront(entry);
+      }
+    }
+
+   private:
+    static Entry* ToEntry(Links* links) { return static_cast<Entry*>(links); }
+
+    Links sentinel_;
+    size_t bytes_;
+
+    DISALLOW_COPY_AND_ASSIGN(EntryList);
+  };
+
+  // The map keys point into Entry::key, which is stable for as long as the
+  // entry is in the map.
+  typedef rde::hash_map<StringPiece, Entry*, CasePreserveStringPieceHash> Map;
+  typedef rde::hash_map<size_t, int> GhostCountMap;
+
+  void LockAndCount() EXCLUSIVE_LOCK_FUNCTION(mutex_) {
+    if (!mutex_->TryLock()) {
+      mutex_->Lock();
+      ++num_lock_contentions_;
+      if (lock_contentions_variable_ != NULL) {
+        lock_contentions_variable_->Add(1);
+      }
+    }
+  }
+
+  EntryList* ListFor(Entry* entry) {
+    DCHECK_NE(kFree, entry->queue);
+    return (entry->queue == kMainQueue) ? &main_ : &probation_;
+  }
+
+  Entry* NewEntry() {
+    if (free_list_ == NULL) {
+      Entry* slab = new Entry[kEntriesPerSlab];
+      slabs_.push_back(slab);
+      for (int i = 0; i < kEntriesPerSlab; ++i) {
+        FreeEntry(&slab[i]);
+      }
+    }
+    Entry* entry = free_list_;
+    free_list_ = static_cast<Entry*>(entry->next);
+    entry->next = NULL;
+    return entry;
+  }
+
+  void FreeEntry(Entry* entry) {
+    entry->key.clear();
+    entry->value.DetachAndClear();
+    entry->queue = kFree;
+    entry->prev = NULL;
+    entry->next = free_list_;
+    free_list_ = entry;
+  }
+
+  // Unlinks entry from its queue, updates byte accounting, and returns it to
+  // the free-list.  The caller must already have removed it from map_.
+  void RemoveEntry(Entry* entry) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    ListFor(entry)->Remove(entry);
+    DCHECK_GE(current_bytes_, entry->bytes);
+    current_bytes_ -= entry->bytes;
+    FreeEntry(entry);
+  }
+
+  // Returns the entry EvictOne would remove.  The shard must not be empty.
+  Entry* NextVictim() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    bool from_probation =
+        !probation_.empty() &&
+        (main_.empty() ||
+         (probation_.bytes() > max_bytes_ / kProbationFraction));
+    Entry* victim = from_probation ? probation_.Back() : main_.Back();
+    CHECK(victim != NULL);
+    return victim;
+  }
+
+  void EvictOne() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    Entry* victim = NextVictim();
+    if (victim->queue == kProbationQueue) {
+      AddGhost(victim->hash);
+    }
+    map_.erase(victim->key);
+    RemoveEntry(victim);
+    ++num_evictions_;
+  }
+
+  // The ghost list is a FIFO of key-hashes, with a count-map for fast
+  // membership tests.  Hash collisions just cause an occasional spurious
+  // promotion to the main queue, which is harmless.
+  void AddGhost(size_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    ghost_fifo_.push_back(hash);
+    ++ghost_counts_[hash];
+    size_t max_ghosts = std::max(kMinGhostEntries,
+                                 static_cast<size_t>(map_.size()) / 2);
+    while (ghost_fifo_.size() > max_ghosts) {
+      DropGhost(ghost_fifo_.front());
+      ghost_fifo_.pop_front();
+    }
+  }
+
+  // Ghosts stay in the FIFO after a hit; they are simply aged out.  That
+  // keeps ghost_counts_ an exact count of the hashes in ghost_fifo_.
+  bool IsGhost(size_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return ghost_counts_.find(hash) != ghost_counts_.end();
+  }
+
+  void DropGhost(size_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    GhostCountMap::iterator p = ghost_counts_.find(hash);
+    DCHECK(p != ghost_counts_.end());
+    if (--p->second == 0) {
+      ghost_counts_.erase(p);
+    }
+  }
+
+  size_t NumCountedGhosts() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    size_t count = 0;
+    for (GhostCountMap::iterator p = ghost_counts_.begin(),
+             e = ghost_counts_.end(); p != e; ++p) {
+      count += p->second;
+    }
+    return count;
+  }
+
+  void SanityCheckList(EntryList* list, Queue queue, size_t* count,
+                       size_t* bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    size_t list_bytes = 0;
+    for (Entry* entry = list->Front(); entry != NULL;
+         entry = list->Next(entry)) {
+      CHECK_EQ(queue, entry->queue);
+      Map::iterator p = map_.find(entry->key);
+      CHECK(p != map_.end());
+      CHECK(p->second == entry);
+      CHECK_EQ(entry->key.size() + entry->value.size(), entry->bytes);
+      list_bytes += entry->bytes;
+      ++*count;
+    }
+    CHECK_EQ(list->bytes(), list_bytes);
+    *bytes += list_bytes;
+  }
+
+  void ClearLockHeld() {
+    while (!probation_.empty()) {
+      RemoveEntry(probation_.Back());
+    }
+    while (!main_.empty()) {
+      RemoveEntry(main_.Back());
+    }
+    map_.clear();
+    ghost_fifo_.clear();
+    ghost_counts_.clear();
+    DCHECK_EQ(0U, current_bytes_);
+  }
+
+  const size_t max_bytes_;
+  const Policy policy_;
+  scoped_ptr<AbstractMutex> mutex_;
+  Variable* lock_contentions_variable_;
+
+  std::vector<Entry*> slabs_;  // Each element is new[]'d kEntriesPerSlab.
+  Entry* free_list_ GUARDED_BY(mutex_);
+  Map map_ GUARDED_BY(mutex_);
+  EntryList probation_ GUARDED_BY(mutex_);  // 2Q's A1in; empty for kLRU.
+  EntryList main_ GUARDED_BY(mutex_);       // 2Q's Am.
+  std::deque<size_t> ghost_fifo_ GUARDED_BY(mutex_);  // 2Q's A1out.
+  GhostCountMap ghost_counts_ GUARDED_BY(mutex_);
+  size_t current_bytes_ GUARDED_BY(mutex_);
+
+  size_t num_evictions_;
+  size_t num_hits_;
+  size_t num_misses_;
+  size_t num_inserts_;
+  size_t num_identical_reinserts_;
+  size_t num_deletes_;
+  size_t num_lock_contentions_;
+  size_t num_ghost_hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(Shard);
+};
+
+ShardedLRUCache::ShardedLRUCache(size_t max_size, int num_shards,
+                                 Policy policy, ThreadSystem* thread_system,
+                                 Statistics* statistics)
+    : max_bytes_in_cache_(max_size),
+      policy_(policy),
+      lock_contentions_((statistics == NULL) ? NULL :
+                        statistics->GetVariable(kLockContentions)) {
+  CHECK_LT(0, num_shards);
+  size_t bytes_per_shard = max_size / num_shards;
+  for (int i = 0; i < num_shards; ++i) {
+    shards_.push_back(new Shard(bytes_per_shard, policy,
+                                thread_system->NewMutex(),
+                                lock_contentions_));
+  }
+}
+
+ShardedLRUCache::~ShardedLRUCache() {
+  STLDeleteElements(&shards_);
+}
+
+void ShardedLRUCache::InitStats(Statistics* statistics) {
+  statistics->AddVariable(kLockContentions);
+}
+
+bool ShardedLRUCache::ParsePolicy(StringPiece name, Policy* policy) {
+  if (StringCaseEqual(name, "lru")) {
+    *policy = kLRU;
+  } else if (StringCaseEqual(name, "2q")) {
+    *policy = kTwoQueue;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* ShardedLRUCache::PolicyName(Policy policy) {
+  switch (policy) {
+    case kLRU:      return "lru";
+    case kTwoQueue: return "2q";
+  }
+  return "unknown";
+}
+
+GoogleString ShardedLRUCache::FormatName(Policy policy, int num_shards) {
+  return StrCat("ShardedLRUCache(", PolicyName(policy), ",",
+                IntegerToString(num_shards), ")");
+}
+
+ShardedLRUCache::Shard* ShardedLRUCache::ShardForKey(const GoogleString& key,
+                                                     size_t* hash) const {
+  *hash = HashString<CasePreserve, size_t>(key.data(), key.size());
+
+  // The shard-map's hash table uses the low-order bits of the same string
+  // hash, so scramble it before picking a shard; otherwise every key in a
+  // shard would share its low bits and collide in the shard's table.
+  uint32 mixed = static_cast<uint32>(*hash) * 2654435761U;
+  return shards_[(mixed >> 16) % shards_.size()];
+}
+
+void ShardedLRUCache::Get(const GoogleString& key, Callback* callback) {
+  KeyState key_state = kNotFound;
+  if (!shut_down_.value()) {
+    size_t hash;
+    Shard* shard = ShardForKey(key, &hash);
+    if (shard->Get(key, callback->value())) {
+      key_state = kAvailable;
+    }
+  }
+
+  // Note that the shard lock has been released at this point, so the
+  // validator does not block other threads.
+  ValidateAndReportResult(key, key_state, callback);
+}
+
+void ShardedLRUCache::Put(const GoogleString& key, SharedString* new_value) {
+  if (shut_down_.value()) {
+    return;
+  }
+  size_t hash;
+  Shard* shard = ShardForKey(key, &hash);
+  shard->Put(key, hash, new_value);
+}
+
+uint64 ShardedLRUCache::AdmissionFingerprint(const GoogleString& key) {
+  return HashString<CasePreserve, size_t>(key.data(), key.size());
+}
+
+bool ShardedLRUCache::PeekEvictionVictim(const GoogleString& key,
+                                         size_t value_size, uint64* victim) {
+  size_t hash;
+  Shard* shard = ShardForKey(key, &hash);
+  size_t victim_hash;
+  if (!shard->PeekEvictionVictim(key, key.size() + value_size,
+                                 &victim_hash)) {
+    return false;
+  }
+  *victim = victim_hash;
+  return true;
+}
+
+void ShardedLRUCache::Delete(const GoogleString& key) {
+  if (shut_down_.value()) {
+    return;
+  }
+  size_t hash;
+  Shard* shard = ShardForKey(key, &hash);
+  shard->Delete(key);
+}
+
+bool ShardedLRUCache::IsHealthy() const {
+  return !shut_down_.value();
+}
+
+void ShardedLRUCache::ShutDown() {
+  shut_down_.set_value(true);
+}
+
+#define SHARDED_LRU_CACHE_SUM_STAT(method, index)               \
+  size_t ShardedLRUCache::method() const {                      \
+    size_t sum = 0;                                             \
+    for (int i = 0, n = shards_.size(); i < n; ++i) {           \
+      sum += shards_[i]->Stat(Shard::index);                    \
+    }                                                           \
+    return sum;                                                 \
+  }
+
+SHARDED_LRU_CACHE_SUM_STAT(size_bytes, kSizeBytes)
+SHARDED_LRU_CACHE_SUM_STAT(num_elements, kNumElements)
+SHARDED_LRU_CACHE_SUM_STAT(num_evictions, kNumEvictions)
+SHARDED_LRU_CACHE_SUM_STAT(num_hits, kNumHits)
+SHARDED_LRU_CACHE_SUM_STAT(num_misses, kNumMisses)
+SHARDED_LRU_CACHE_SUM_STAT(num_inserts, kNumInserts)
+SHARDED_LRU_CACHE_SUM_STAT(num_identical_reinserts, kNumIdenticalReinserts)
+SHARDED_LRU_CACHE_SUM_STAT(num_deletes, kNumDeletes)
+SHARDED_LRU_CACHE_SUM_STAT(num_lock_contentions, kNumLockContentions)
+SHARDED_LRU_CACHE_SUM_STAT(num_ghost_hits, kNumGhostHits)
+
+#undef SHARDED_LRU_CACHE_SUM_STAT
+
+void ShardedLRUCache::SanityCheck() {
+  for (int i = 0, n = shards_.size(); i < n; ++i) {
+    shards_[i]->SanityCheck();
+  }
+}
+
+void ShardedLRUCache::Clear() {
+  for (int i = 0, n = shards_.size(); i < n; ++i) {
+    shards_[i]->Clear();
+  }
+}
+
+void ShardedLRUCache::ClearStats() {
+  for (int i = 0, n = shards_.size(); i < n; ++i) {
+    shards_[i]->ResetStats();
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
+#define PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/atomic_bool.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+class SharedString;
+class Statistics;
+class ThreadSystem;
+class Variable;
+
+// Thread-safe in-memory cache, split into a number of independent shards
+// selected by key hash.  Each shard has its own mutex, hash-map, and
+// intrusive replacement lists, so concurrent lookups of different keys
+// usually do not contend with one another.  This is intended to replace
+// the combination ThreadsafeCache(LRUCache), which serializes every
+// operation in the process on a single mutex.
+//
+// Entries are allocated from per-shard slabs and recycled through a free
+// list, so steady-state operation does not call malloc for the entry
+// bookkeeping itself (keys and values are still heap strings).
+//
+// Two replacement policies are supported:
+//   kLRU:       classic least-recently-used, matching LRUCache.
+//   kTwoQueue:  the 2Q algorithm (Johnson & Shasha, VLDB '94).  New keys are
+//               admitted to a FIFO probation queue.  Keys that are re-inserted
+//               shortly after being evicted from probation (tracked via a
+//               ghost list of key hashes) are admitted to the main LRU queue.
+//               This keeps one-pass scans from flushing the working set.
+//
+// Note that max_size is divided evenly between the shards, and there is no
+// accounting shared between them, so the largest value that can be stored
+// is max_size / num_shards (less the key), not max_size as with LRUCache.
+// Puts of larger values are silently dropped; see max_bytes_per_shard().
+//
+// Unlike ThreadsafeCache, no lock is held while the callback's validator
+// or Done method is run.
+class ShardedLRUCache : public CacheInterface {
+ public:
+  enum Policy {
+    kLRU,
+    kTwoQueue
+  };
+
+  // Default number of shards, used for the LRUCacheShards option.
+  static const int kDefaultNumShards = 16;
+
+  // Statistics variable names.
+  static const char kLockContentions[];
+
+  // Does not take ownership of thread_system or statistics.  statistics
+  // may be NULL, in which case lock contention is only counted internally.
+  ShardedLRUCache(size_t max_size, int num_shards, Policy policy,
+                  ThreadSystem* thread_system, Statistics* statistics);
+  virtual ~ShardedLRUCache();
+
+  static void InitStats(Statistics* statistics);
+
+  // Parses a policy name ("lru" or "2q", case-insensitive).  Returns false
+  // if the name is not recognized, leaving *policy unchanged.
+  static bool ParsePolicy(StringPiece name, Policy* policy);
+  static const char* PolicyName(Policy policy);
+
+  virtual void Get(const GoogleString& key, Callback* callback);
+  virtual void Put(const GoogleString& key, SharedString* new_value);
+  virtual void Delete(const GoogleString& key);
+
+  // Reports the entry that the Put would evict from key's shard.  This is
+  // the policy's next victim, i.e. the LRU tail, or for 2Q the probation
+  // or main queue tail, whichever the shard would take from.
+  virtual uint64 AdmissionFingerprint(const GoogleString& key);
+  virtual bool PeekEvictionVictim(const GoogleString& key, size_t value_size,
+                                  uint64* victim);
+
+  static GoogleString FormatName(Policy policy, int num_shards);
+  virtual GoogleString Name() const {
+    return FormatName(policy_, num_shards());
+  }
+  virtual bool IsBlocking() const { return true; }
+  // Once ShutDown is called, the cache reports itself unhealthy, and Gets
+  // miss while Puts and Deletes are dropped, as callers may still be
+  // using it while the process exits.
+  virtual bool IsHealthy() const;
+  virtual void ShutDown();
+
+  int num_shards() const { return static_cast<int>(shards_.size()); }
+  Policy policy() const { return policy_; }
+
+  // Aggregate statistics, summed over all shards.  Each of these takes
+  // every shard lock in turn, so they are not intended for hot paths.
+  size_t size_bytes() const;
+  size_t max_bytes_in_cache() const { return max_bytes_in_cache_; }
+  size_t max_bytes_per_shard() const {
+    return max_bytes_in_cache_ / shards_.size();
+  }
+  size_t num_elements() const;
+  size_t num_evictions() const;
+  size_t num_hits() const;
+  size_t num_misses() const;
+  size_t num_inserts() const;
+  size_t num_identical_reinserts() const;
+  size_t num_deletes() const;
+
+  // Number of times a thread found its shard lock already held.
+  size_t num_lock_contentions() const;
+
+  // Number of 2Q admissions to the main queue via the ghost list.  Always
+  // zero for kLRU.
+  size_t num_ghost_hits() const;
+
+  // Sanity check the cache data structures.
+  void SanityCheck();
+
+  // Clear the entire cache.  Used primarily for testing.  Note that this
+  // will not clear the stats.
+  void Clear();
+
+  // Clear the stats -- note that this will not clear the content.
+  void ClearStats();
+
+ private:
+  class Shard;
+
+  Shard* ShardForKey(const GoogleString& key, size_t* hash) const;
+
+  const size_t max_bytes_in_cache_;
+  const Policy policy_;
+  std::vector<Shard*> shards_;
+  Variable* lock_contentions_;  // may be NULL.
+  AtomicBool shut_down_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardedLRUCache);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_SHARDED_LRU_CACHE_H_
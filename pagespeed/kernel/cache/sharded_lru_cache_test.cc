@@ -0,0 +1,252 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the sharded lru cache.
+
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/cache_spammer.h"
+#include "pagespeed/kernel/cache/cache_test_base.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace {
+
+const size_t kMaxSize = 100;
+const int kNumThreads = 4;
+const int kNumIters = 10000;
+const int kNumInserts = 10;
+
+}  // namespace
+
+namespace net_instaweb {
+
+class ShardedLRUCacheTest : public CacheTestBase {
+ protected:
+  ShardedLRUCacheTest()
+      : thread_system_(Platform::CreateThreadSystem()) {
+    ResetCache(1, ShardedLRUCache::kLRU);
+  }
+
+  void ResetCache(int num_shards, ShardedLRUCache::Policy policy) {
+    cache_.reset(new ShardedLRUCache(kMaxSize, num_shards, policy,
+                                     thread_system_.get(), NULL));
+  }
+
+  virtual CacheInterface* Cache() { return cache_.get(); }
+  virtual void PostOpCleanup() { cache_->SanityCheck(); }
+
+  // Fills a single-shard cache with 10 ten-byte entries "name0".."name9".
+  void FillCache() {
+    for (int i = 0; i < 10; ++i) {
+      CheckPut(StringPrintf("name%d", i), StringPrintf("valu%d", i));
+    }
+    EXPECT_EQ(kMaxSize, cache_->size_bytes());
+    EXPECT_EQ(static_cast<size_t>(0), cache_->num_evictions());
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<ShardedLRUCache> cache_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ShardedLRUCacheTest);
+};
+
+TEST_F(ShardedLRUCacheTest, PutGetDelete) {
+  EXPECT_EQ(static_cast<size_t>(0), cache_->size_bytes());
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  EXPECT_EQ(static_cast<size_t>(9), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+  CheckNotFound("Another Name");
+
+  CheckPut("Name", "NewValue");
+  CheckGet("Name", "NewValue");
+  EXPECT_EQ(static_cast<size_t>(12), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+
+  CheckDelete("Name");
+  CheckNotFound("Name");
+  EXPECT_EQ(static_cast<size_t>(0), cache_->size_bytes());
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_elements());
+}
+
+TEST_F(ShardedLRUCacheTest, ShutDown) {
+  ResetCache(4, ShardedLRUCache::kLRU);
+  CheckPut("Name", "Value");
+  CheckGet("Name", "Value");
+  EXPECT_TRUE(cache_->IsHealthy());
+
+  cache_->ShutDown();
+  EXPECT_FALSE(cache_->IsHealthy());
+  CheckNotFound("Name");
+  CheckPut("Other", "Value");
+  CheckNotFound("Other");
+  CheckDelete("Name");
+  Callback* c0 = AddCallback();
+  Callback* c1 = AddCallback();
+  Callback* c2 = AddCallback();
+  IssueMultiGet(c0, "Name", c1, "Other", c2, "Third");
+  WaitAndCheckNotFound(c0);
+  WaitAndCheckNotFound(c1);
+  WaitAndCheckNotFound(c2);
+
+  // The entries are left in place; they are just no longer served.
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_elements());
+}
+
+TEST_F(ShardedLRUCacheTest, IdenticalReinsert) {
+  CheckPut("Name", "Value");
+  CheckPut("Name", "Value");
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_identical_reinserts());
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_inserts());
+}
+
+TEST_F(ShardedLRUCacheTest, TooBig) {
+  CheckPut("Name", GoogleString(kMaxSize, 'x'));
+  CheckNotFound("Name");
+  EXPECT_EQ(static_cast<size_t>(0), cache_->size_bytes());
+}
+
+TEST_F(ShardedLRUCacheTest, TooBigForShard) {
+  // With four shards, each gets a quarter of kMaxSize, and a value that
+  // would fit in the whole cache is dropped if it does not fit in a shard.
+  ResetCache(4, ShardedLRUCache::kLRU);
+  EXPECT_EQ(kMaxSize / 4, cache_->max_bytes_per_shard());
+  CheckPut("Name", GoogleString(kMaxSize / 4, 'x'));
+  CheckNotFound("Name");
+  CheckPut("Name", GoogleString(kMaxSize / 4 - 5, 'x'));
+  CheckGet("Name", GoogleString(kMaxSize / 4 - 5, 'x'));
+}
+
+TEST_F(ShardedLRUCacheTest, LeastRecentlyUsed) {
+  FillCache();
+
+  // Freshen name0, then add a new entry; name1 is the oldest and goes.
+  CheckGet("name0", "valu0");
+  CheckPut("nameA", "valuA");
+  EXPECT_EQ(static_cast<size_t>(1), cache_->num_evictions());
+  CheckGet("name0", "valu0");
+  CheckNotFound("name1");
+  CheckGet("nameA", "valuA");
+}
+
+TEST_F(ShardedLRUCacheTest, PeekEvictionVictim) {
+  uint64 victim = 0;
+  EXPECT_FALSE(cache_->PeekEvictionVictim("nameA", 5, &victim));
+  FillCache();
+
+  // A new key would evict the LRU tail, but replacing a key or storing
+  // one too large to keep evicts nothing.
+  CheckGet("name0", "valu0");
+  EXPECT_TRUE(cache_->PeekEvictionVictim("nameA", 5, &victim));
+  EXPECT_EQ(cache_->AdmissionFingerprint("name1"), victim);
+  EXPECT_FALSE(cache_->PeekEvictionVictim("name3", 5, &victim));
+  EXPECT_FALSE(cache_->PeekEvictionVictim("nameA", kMaxSize, &victim));
+
+  // Peeking doesn't evict anything.
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_evictions());
+  CheckGet("name1", "valu1");
+}
+
+TEST_F(ShardedLRUCacheTest, TwoQueueScanResistance) {
+  ResetCache(1, ShardedLRUCache::kTwoQueue);
+
+  // Establish a working set of two keys.  The first Put lands in probation;
+  // once it has been evicted from there, re-inserting it promotes it to the
+  // main queue via the ghost list.
+  CheckPut("hot0", "valu0");
+  CheckPut("hot1", "valu1");
+  for (int i = 0; i < 10; ++i) {
+    CheckPut(StringPrintf("scan%d", i), StringPrintf("valu%d", i));
+  }
+  CheckNotFound("hot0");
+  CheckNotFound("hot1");
+  CheckPut("hot0", "valu0");
+  CheckPut("hot1", "valu1");
+  EXPECT_EQ(static_cast<size_t>(2), cache_->num_ghost_hits());
+
+  // Now scan through many more keys than fit in the cache.  With LRU this
+  // would flush the working set; with 2Q the scan only churns probation.
+  for (int i = 0; i < 100; ++i) {
+    CheckPut(StringPrintf("scan%02d", i), StringPrintf("val%02d", i));
+  }
+  CheckGet("hot0", "valu0");
+  CheckGet("hot1", "valu1");
+}
+
+TEST_F(ShardedLRUCacheTest, LRUIsNotScanResistant) {
+  CheckPut("hot0", "valu0");
+  for (int i = 0; i < 100; ++i) {
+    CheckPut(StringPrintf("scan%02d", i), StringPrintf("val%02d", i));
+  }
+  CheckNotFound("hot0");
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_ghost_hits());
+}
+
+TEST_F(ShardedLRUCacheTest, MultipleShards) {
+  ResetCache(4, ShardedLRUCache::kTwoQueue);
+  EXPECT_EQ(4, cache_->num_shards());
+  for (int i = 0; i < 4; ++i) {
+    CheckPut(StringPrintf("k%d", i), StringPrintf("v%d", i));
+  }
+  for (int i = 0; i < 4; ++i) {
+    CheckGet(StringPrintf("k%d", i), StringPrintf("v%d", i));
+  }
+  EXPECT_EQ(static_cast<size_t>(4), cache_->num_hits());
+  cache_->Clear();
+  EXPECT_EQ(static_cast<size_t>(0), cache_->num_elements());
+}
+
+TEST_F(ShardedLRUCacheTest, ParsePolicy) {
+  ShardedLRUCache::Policy policy = ShardedLRUCache::kLRU;
+  EXPECT_TRUE(ShardedLRUCache::ParsePolicy("2Q", &policy));
+  EXPECT_EQ(ShardedLRUCache::kTwoQueue, policy);
+  EXPECT_TRUE(ShardedLRUCache::ParsePolicy("lru", &policy));
+  EXPECT_EQ(ShardedLRUCache::kLRU, policy);
+  EXPECT_FALSE(ShardedLRUCache::ParsePolicy("clock", &policy));
+  EXPECT_EQ(ShardedLRUCache::kLRU, policy);
+}
+
+TEST_F(ShardedLRUCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheWithDeletionsAndEvictions) {
+  ResetCache(4, ShardedLRUCache::kTwoQueue);
+  CacheSpammer::RunTests(kNumThreads, kNumIters, kNumInserts,
+                         true /* expecting_evictions */,
+                         true /* do_deletes */, "value",
+                         cache_.get(), thread_system_.get());
+  cache_->SanityCheck();
+}
+
+TEST_F(ShardedLRUCacheTest, SpamCacheNoEvictionsOrDeletions) {
+  CacheSpammer::RunTests(kNumThreads, kNumIters, kNumInserts,
+                         false /* expecting_evictions */,
+                         false /* do_deletes */, "valu",
+                         cache_.get(), thread_system_.get());
+  cache_->SanityCheck();
+}
+
+}  // namespace net_instaweb
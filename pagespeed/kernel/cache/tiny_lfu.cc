@@ -0,0 +1,218 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// The segment is selected by the top bits of the mixed fingerprint.
+const int kNumSegmentBits = 4;
+
+// Each row has this many counters per entry the segment is expected to
+// cover, so that keys rarely share all their counters with other keys.
+const size_t kCountersPerEntry = 4;
+
+// Segments are sized for at least this many entries, so small caches still
+// get a usable sketch.
+const size_t kMinEntriesPerSegment = 16;
+
+// A segment is aged after it records this many accesses per entry it is
+// expected to cover.  The TinyLFU paper uses a sample size of ten times
+// the cache size.
+const int kSampleSizeFactor = 10;
+
+// Odd multipliers giving each row its own hash of the fingerprint.  Four
+// rows keep the chance of every counter for a key being shared with a
+// hotter key small.
+const uint64 kRowSeeds[TinyLFU::kNumRows] = {
+  0xc3a5c85c97cb3127ULL,
+  0xb492b66fbe98f273ULL,
+  0x9ae16a3b2f90404fULL,
+  0xcbf29ce484222325ULL,
+};
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+size_t CounterIndex(uint64 mixed, size_t row_width, int row) {
+  uint64 row_hash = (mixed ^ kRowSeeds[row]) * kRowSeeds[row];
+  return row * row_width + ((row_hash >> 32) & (row_width - 1));
+}
+
+}  // namespace
+
+const int TinyLFU::kMaxFrequency;
+const int TinyLFU::kNumSegments;
+const int TinyLFU::kNumRows;
+
+// One independently locked count-min sketch, covering the fingerprints
+// that map to it.
+class TinyLFU::Segment {
+ public:
+  Segment(size_t row_width, int64 sample_size, AbstractMutex* mutex)
+      : row_width_(row_width),
+        sample_size_(sample_size),
+        mutex_(mutex),
+        counters_(kNumRows * row_width, 0),
+        additions_(0),
+        num_resets_(0) {
+  }
+
+  void Record(uint64 mixed) LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    // Accesses to keys that are already saturated don't count towards the
+    // sample, as they carry no new information.
+    if (IncrementCounters(mixed, row_width_, &counters_[0]) &&
+        (++additions_ >= sample_size_)) {
+      HalveCounters(row_width_, &counters_[0]);
+      additions_ /= 2;
+      ++num_resets_;
+    }
+  }
+
+  int Estimate(uint64 mixed) const LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    return EstimateFromCounters(mixed, row_width_, &counters_[0]);
+  }
+
+  int64 num_resets() const LOCKS_EXCLUDED(mutex_) {
+    ScopedMutex lock(mutex_.get());
+    return num_resets_;
+  }
+
+ private:
+  const size_t row_width_;
+  const int64 sample_size_;
+  scoped_ptr<AbstractMutex> mutex_;
+  std::vector<uint8> counters_ GUARDED_BY(mutex_);  // kNumRows rows.
+  int64 additions_ GUARDED_BY(mutex_);
+  int64 num_resets_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(Segment);
+};
+
+TinyLFU::TinyLFU(int expected_entries, ThreadSystem* thread_system) {
+  size_t row_width;
+  int64 sample_size;
+  ComputeDimensions(expected_entries, &row_width, &sample_size);
+  for (int i = 0; i < kNumSegments; ++i) {
+    segments_.push_back(new Segment(row_width, sample_size,
+                                    thread_system->NewMutex()));
+  }
+}
+
+TinyLFU::~TinyLFU() {
+  STLDeleteElements(&segments_);
+}
+
+void TinyLFU::Record(uint64 fingerprint) {
+  uint64 mixed = Mix(fingerprint);
+  segments_[SegmentIndex(mixed)]->Record(mixed);
+}
+
+int TinyLFU::Estimate(uint64 fingerprint) const {
+  uint64 mixed = Mix(fingerprint);
+  return segments_[SegmentIndex(mixed)]->Estimate(mixed);
+}
+
+int64 TinyLFU::num_resets() const {
+  int64 sum = 0;
+  for (int i = 0, n = segments_.size(); i < n; ++i) {
+    sum += segments_[i]->num_resets();
+  }
+  return sum;
+}
+
+void TinyLFU::ComputeDimensions(int expected_entries, size_t* row_width,
+                                int64* sample_size) {
+  size_t entries_per_segment = std::max(
+      kMinEntriesPerSegment,
+      static_cast<size_t>(std::max(0, expected_entries) / kNumSegments + 1));
+  *row_width = RoundUpToPowerOfTwo(kCountersPerEntry * entries_per_segment);
+  *sample_size = kSampleSizeFactor * static_cast<int64>(entries_per_segment);
+}
+
+// Every bit of the result depends on every input bit.  Fingerprints are
+// often weak string hashes whose low bits vary little, and the row and
+// segment indices are taken from disjoint slices of the result.  This is
+// the splitmix64 finalizer.
+uint64 TinyLFU::Mix(uint64 x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+int TinyLFU::SegmentIndex(uint64 mixed) {
+  COMPILE_ASSERT((1 << kNumSegmentBits) == kNumSegments,
+                 segment_bits_match_segments);
+  return static_cast<int>(mixed >> (64 - kNumSegmentBits));
+}
+
+bool TinyLFU::IncrementCounters(uint64 mixed, size_t row_width,
+                                uint8* counters) {
+  DCHECK_EQ(0U, row_width & (row_width - 1)) << "must be a power of 2";
+  bool incremented = false;
+  for (int row = 0; row < kNumRows; ++row) {
+    uint8* counter = &counters[CounterIndex(mixed, row_width, row)];
+    if (*counter < kMaxFrequency) {
+      ++*counter;
+      incremented = true;
+    }
+  }
+  return incremented;
+}
+
+int TinyLFU::EstimateFromCounters(uint64 mixed, size_t row_width,
+                                  const uint8* counters) {
+  int estimate = kMaxFrequency;
+  for (int row = 0; row < kNumRows; ++row) {
+    estimate = std::min(
+        estimate,
+        static_cast<int>(counters[CounterIndex(mixed, row_width, row)]));
+  }
+  return estimate;
+}
+
+// Dividing by two is what the paper calls a reset: old accesses count for
+// less than new ones.
+void TinyLFU::HalveCounters(size_t row_width, uint8* counters) {
+  for (size_t i = 0, n = kNumRows * row_width; i < n; ++i) {
+    counters[i] >>= 1;
+  }
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_CACHE_TINY_LFU_H_
+#define PAGESPEED_KERNEL_CACHE_TINY_LFU_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/cache/frequency_sketch.h"
+
+namespace net_instaweb {
+
+class ThreadSystem;
+
+// Approximate access-frequency history for a cache's admission policy, as
+// described in "TinyLFU: A Highly Efficient Cache Admission Policy"
+// (Einziger, Friedman & Manes, 2017).
+//
+// Accesses are counted in a count-min sketch: each key fingerprint bumps
+// one small saturating counter in each of several rows, and the estimate
+// for a key is the smallest of its counters.  Once the number of recorded
+// accesses reaches a sample size proportional to the cache's capacity,
+// every counter is halved, so the history favors recent popularity and
+// keys that were hot long ago fade out.
+//
+// Admit() implements the TinyLFU rule: a new entry only displaces the
+// cache's eviction victim if it has been seen more often than the victim.
+// That keeps one-hit wonders, such as resources fetched once by a
+// crawler, from pushing out entries that are actually being reused.
+//
+// The sketch is split into independently locked segments selected by
+// fingerprint, like ShardedLRUCache, so that recording accesses from many
+// threads does not serialize them on one mutex.  Counters are stored a
+// byte apiece but saturate at 15.  There are four rows of four counters per
+// expected cache entry, so the sketch takes about 16 bytes per entry.
+//
+// This keeps the sketch in process memory.  The static functions below
+// define its layout and arithmetic, so that SharedMemTinyLFU can keep the
+// same sketch in shared memory.
+class TinyLFU : public FrequencySketch {
+ public:
+  // Largest value a counter (and so an estimate) can reach.
+  static const int kMaxFrequency = 15;
+
+  // The sketch is split into kNumSegments segments, each with kNumRows rows
+  // of counters.
+  static const int kNumSegments = 16;
+  static const int kNumRows = 4;
+
+  // expected_entries is roughly how many entries the cache holds.  It
+  // sizes the sketch and sets the aging period to ten times that many
+  // accesses.  Does not take ownership of thread_system.
+  TinyLFU(int expected_entries, ThreadSystem* thread_system);
+  virtual ~TinyLFU();
+
+  virtual void Record(uint64 fingerprint);
+
+  // Returns the estimated recent access count for fingerprint, between 0
+  // and kMaxFrequency.  This never underestimates, except for the halving
+  // done while aging.
+  virtual int Estimate(uint64 fingerprint) const;
+
+  // Number of times a segment has been aged.  Used for testing.
+  int64 num_resets() const;
+
+  // Computes the number of counters in each row of a segment, and the
+  // number of accesses a segment records before it is aged, for a cache of
+  // expected_entries.
+  static void ComputeDimensions(int expected_entries, size_t* row_width,
+                                int64* sample_size);
+
+  // Scrambles a key fingerprint; the functions below take the result.
+  static uint64 Mix(uint64 fingerprint);
+
+  // Returns which segment mixed belongs to.
+  static int SegmentIndex(uint64 mixed);
+
+  // These operate on the kNumRows * row_width counters of one segment.
+  // IncrementCounters returns whether any counter was below kMaxFrequency,
+  // in which case the access counts towards the segment's sample.
+  static bool IncrementCounters(uint64 mixed, size_t row_width,
+                                uint8* counters);
+  static int EstimateFromCounters(uint64 mixed, size_t row_width,
+                                  const uint8* counters);
+  static void HalveCounters(size_t row_width, uint8* counters);
+
+ private:
+  class Segment;
+
+  std::vector<Segment*> segments_;
+
+  DISALLOW_COPY_AND_ASSIGN(TinyLFU);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_CACHE_TINY_LFU_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the TinyLFU frequency sketch.
+
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace {
+
+const int kExpectedEntries = 1000;
+
+// Bound on the number of keys streamed through to age the sketch, so that
+// a broken sketch fails rather than hangs.
+const int kMaxStreamed = 1000 * 1000;
+
+}  // namespace
+
+namespace net_instaweb {
+
+class TinyLFUTest : public testing::Test {
+ protected:
+  TinyLFUTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        tiny_lfu_(new TinyLFU(kExpectedEntries, thread_system_.get())) {
+  }
+
+  void RecordTimes(uint64 fingerprint, int times) {
+    for (int i = 0; i < times; ++i) {
+      tiny_lfu_->Record(fingerprint);
+    }
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  scoped_ptr<TinyLFU> tiny_lfu_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TinyLFUTest);
+};
+
+TEST_F(TinyLFUTest, CountsAccesses) {
+  EXPECT_EQ(0, tiny_lfu_->Estimate(1));
+  RecordTimes(1, 3);
+  RecordTimes(2, 5);
+  EXPECT_EQ(3, tiny_lfu_->Estimate(1));
+  EXPECT_EQ(5, tiny_lfu_->Estimate(2));
+  EXPECT_EQ(0, tiny_lfu_->Estimate(3));
+}
+
+TEST_F(TinyLFUTest, Saturates) {
+  RecordTimes(1, 2 * TinyLFU::kMaxFrequency);
+  EXPECT_EQ(TinyLFU::kMaxFrequency, tiny_lfu_->Estimate(1));
+}
+
+TEST_F(TinyLFUTest, NeverUnderestimatesBeforeAging) {
+  // Fill the sketch with far more distinct keys than it was sized for, so
+  // that counters are shared, but not enough accesses to age it.
+  for (uint64 i = 0; i < 4 * kExpectedEntries; ++i) {
+    tiny_lfu_->Record(i);
+  }
+  RecordTimes(12345678, 2);
+  EXPECT_EQ(0, tiny_lfu_->num_resets());
+  EXPECT_LE(2, tiny_lfu_->Estimate(12345678));
+}
+
+TEST_F(TinyLFUTest, Admit) {
+  RecordTimes(1, 4);
+  RecordTimes(2, 1);
+  EXPECT_TRUE(tiny_lfu_->Admit(1, 2));
+  EXPECT_FALSE(tiny_lfu_->Admit(2, 1));
+
+  // Ties go to the victim.
+  RecordTimes(3, 4);
+  EXPECT_FALSE(tiny_lfu_->Admit(3, 1));
+}
+
+TEST_F(TinyLFUTest, AgingHalvesCounts) {
+  RecordTimes(1, 8);
+  EXPECT_EQ(8, tiny_lfu_->Estimate(1));
+
+  // Stream distinct keys through until the frequent key's segment ages.
+  // Other keys may share its counters, but not enough of them to keep it
+  // from being halved.
+  uint64 fingerprint = 1000;
+  for (int i = 0; (tiny_lfu_->Estimate(1) >= 8) && (i < kMaxStreamed); ++i) {
+    tiny_lfu_->Record(++fingerprint);
+  }
+  EXPECT_LT(0, tiny_lfu_->num_resets());
+  EXPECT_GT(8, tiny_lfu_->Estimate(1));
+}
+
+TEST_F(TinyLFUTest, RecentPopularityWins) {
+  // A key that was popular long ago loses to one that is popular now.
+  RecordTimes(1, TinyLFU::kMaxFrequency);
+  uint64 fingerprint = 1000;
+  for (int i = 0; (tiny_lfu_->Estimate(1) > 1) && (i < kMaxStreamed); ++i) {
+    tiny_lfu_->Record(++fingerprint);
+  }
+  EXPECT_LE(3, tiny_lfu_->num_resets());
+  RecordTimes(2, 3);
+  EXPECT_TRUE(tiny_lfu_->Admit(2, 1));
+  EXPECT_FALSE(tiny_lfu_->Admit(1, 2));
+}
+
+}  // namespace net_instaweb
@@ -19,7 +19,10 @@
 #include "pagespeed/kernel/cache/write_through_cache.h"
 
 #include <cstddef>
+#include <vector>
 
+#include "pagespeed/kernel/base/atomic_int32.h"
+#include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
@@ -39,6 +42,8 @@ void WriteThroughCache::PutInCache1(const GoogleString& key,
   }
 }
 
+class WriteThroughMultiGet;
+
 class WriteThroughCallback : public CacheInterface::Callback {
  public:
   WriteThroughCallback(WriteThroughCache* wtc,
@@ -47,7 +52,16 @@ class WriteThroughCallback : public CacheInterface::Callback {
       : write_through_cache_(wtc),
         key_(key),
         callback_(callback),
-        trying_cache2_(false) {
+        trying_cache2_(false),
+        batch_(NULL),
+        index_(0) {
+  }
+
+  // Makes this part of a MultiGet, in which case misses in cache1 are
+  // reported to the batch rather than looked up in cache2 one at a time.
+  void set_batch(WriteThroughMultiGet* batch, int index) {
+    batch_ = batch;
+    index_ = index;
   }
 
   virtual bool ValidateCandidate(const GoogleString& key,
@@ -56,29 +70,91 @@ class WriteThroughCallback : public CacheInterface::Callback {
     return callback_->DelegatedValidateCandidate(key, state);
   }
 
-  virtual void Done(CacheInterface::KeyState state) {
-    if (state == CacheInterface::kAvailable) {
-      if (trying_cache2_) {
-        write_through_cache_->PutInCache1(key_, value());
+  virtual void Done(CacheInterface::KeyState state);
+
+  WriteThroughCache* write_through_cache_;
+  GoogleString key_;
+  CacheInterface::Callback* callback_;
+  bool trying_cache2_;
+  WriteThroughMultiGet* batch_;
+  int index_;
+};
+
+// Tracks the cache1 lookups of a MultiGet, collecting the misses so they
+// can be sent to cache2 as a single MultiGet once cache1 has answered for
+// every key.  cache1 may call back from any thread, so each key gets its
+// own slot and the last one to report issues the cache2 lookup.
+class WriteThroughMultiGet {
+ public:
+  WriteThroughMultiGet(WriteThroughCache* wtc, int num_keys)
+      : write_through_cache_(wtc),
+        misses_(num_keys, static_cast<WriteThroughCallback*>(NULL)),
+        remaining_(num_keys) {
+  }
+
+  // Called once for each key when cache1 is done with it, passing the
+  // key's callback if it missed, or NULL if it was found.  Deletes this
+  // once all keys have reported.
+  void Report(int index, WriteThroughCallback* miss) {
+    misses_[index] = miss;
+    if (remaining_.BarrierIncrement(-1) != 0) {
+      return;
+    }
+    CacheInterface::MultiGetRequest* request =
+        new CacheInterface::MultiGetRequest;
+    for (int i = 0, n = misses_.size(); i < n; ++i) {
+      if (misses_[i] != NULL) {
+        request->push_back(
+            CacheInterface::KeyCallback(misses_[i]->key_, misses_[i]));
       }
-      callback_->DelegatedDone(state);
-      delete this;
-    } else if (trying_cache2_) {
-      callback_->DelegatedDone(state);
-      delete this;
+    }
+    CacheInterface* cache2 = write_through_cache_->cache2();
+    delete this;
+    if (request->empty()) {
+      delete request;
     } else {
-      trying_cache2_ = true;
-      write_through_cache_->cache2()->Get(key_, this);
+      cache2->MultiGet(request);
     }
   }
 
-
+ private:
   WriteThroughCache* write_through_cache_;
-  GoogleString key_;
-  CacheInterface::Callback* callback_;
-  bool trying_cache2_;
+  std::vector<WriteThroughCallback*> misses_;
+  AtomicInt32 remaining_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteThroughMultiGet);
 };
 
+void WriteThroughCallback::Done(CacheInterface::KeyState state) {
+  WriteThroughMultiGet* batch = batch_;
+  int index = index_;
+  if (state == CacheInterface::kAvailable) {
+    if (trying_cache2_) {
+      write_through_cache_->PutInCache1(key_, value());
+    }
+    callback_->DelegatedDone(state);
+    delete this;
+  } else if (trying_cache2_) {
+    callback_->DelegatedDone(state);
+    delete this;
+  } else {
+    trying_cache2_ = true;
+    if (batch == NULL) {
+      write_through_cache_->cache2()->Get(key_, this);
+    } else {
+      batch_ = NULL;
+      batch->Report(index, this);
+    }
+    return;
+  }
+
+  // A key that was found in cache1 still needs to report to its batch.
+  // Keys found in cache2 already reported when they missed in cache1.
+  if (batch != NULL) {
+    batch->Report(index, NULL);
+  }
+}
+
 GoogleString WriteThroughCache::FormatName(StringPiece cache1,
                                            StringPiece cache2) {
   return StrCat("WriteThroughCache(l1=", cache1, ",l2=", cache2, ")");
@@ -88,6 +164,23 @@ void WriteThroughCache::Get(const GoogleString& key, Callback* callback) {
   cache1_->Get(key, new WriteThroughCallback(this, key, callback));
 }
 
+void WriteThroughCache::MultiGet(MultiGetRequest* request) {
+  int n = request->size();
+  if (n == 0) {
+    delete request;
+    return;
+  }
+  WriteThroughMultiGet* batch = new WriteThroughMultiGet(this, n);
+  for (int i = 0; i < n; ++i) {
+    KeyCallback& key_callback = (*request)[i];
+    WriteThroughCallback* callback = new WriteThroughCallback(
+        this, key_callback.key, key_callback.callback);
+    callback->set_batch(batch, i);
+    key_callback.callback = callback;
+  }
+  cache1_->MultiGet(request);
+}
+
 void WriteThroughCache::Put(const GoogleString& key, SharedString* value) {
   PutInCache1(key, value);
   cache2_->Put(key, value);
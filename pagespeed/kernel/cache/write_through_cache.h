@@ -45,6 +45,10 @@ class WriteThroughCache : public CacheInterface {
   virtual ~WriteThroughCache();
 
   virtual void Get(const GoogleString& key, Callback* callback);
+
+  // Looks up all the keys in cache1 with one MultiGet, then looks up
+  // whichever of them missed in cache2 with a second one.
+  virtual void MultiGet(MultiGetRequest* request);
   virtual void Put(const GoogleString& key, SharedString* value);
   virtual void Delete(const GoogleString& key);
 
@@ -79,6 +83,7 @@ class WriteThroughCache : public CacheInterface {
  private:
   void PutInCache1(const GoogleString& key, SharedString* value);
   friend class WriteThroughCallback;
+  friend class WriteThroughMultiGet;
 
   CacheInterface* cache1_;
   CacheInterface* cache2_;
@@ -121,4 +121,25 @@ TEST_F(WriteThroughCacheTest, FindShadowedValid) {
   CheckGet(&small_cache_, "Name", "valid");
 }
 
+TEST_F(WriteThroughCacheTest, MultiGet) {
+  TestMultiGet();
+}
+
+TEST_F(WriteThroughCacheTest, MultiGetSplitsHitsAndMisses) {
+  // "n0" is in both caches, "n1" only in the L2, and "n2" in neither.
+  CheckPut("n0", "v0");
+  CheckPut(&big_cache_, "n1", "v1");
+  Callback* n0 = AddCallback();
+  Callback* n1 = AddCallback();
+  Callback* n2 = AddCallback();
+  IssueMultiGet(n0, "n0", n1, "n1", n2, "n2");
+  WaitAndCheck(n0, "v0");
+  WaitAndCheck(n1, "v1");
+  WaitAndCheckNotFound(n2);
+
+  // The L2 hit is copied into the L1.
+  CheckGet(&small_cache_, "n1", "v1");
+  CheckNotFound(&small_cache_, "n2");
+}
+
 }  // namespace net_instaweb
@@ -36,6 +36,7 @@ class CanonicalAttributes : public EmptyHtmlFilter {
 
   virtual void StartDocument();
   virtual void StartElement(HtmlElement* element);
+  virtual bool IsStreamingSafe() const { return true; }
   virtual const char* Name() const { return "CanonicalAttributes"; }
   int num_changes() const { return num_changes_; }
   int num_errors() const { return num_errors_; }
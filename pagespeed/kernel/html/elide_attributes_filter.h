@@ -37,6 +37,7 @@ class ElideAttributesFilter : public EmptyHtmlFilter {
   virtual ~ElideAttributesFilter();
 
   virtual void StartElement(HtmlElement* element);
+  virtual bool IsStreamingSafe() const { return true; }
   virtual const char* Name() const { return "ElideAttributes"; }
 
  private:
@@ -51,6 +51,7 @@ class HtmlAttributeQuoteRemoval : public EmptyHtmlFilter {
     return total_quotes_removed_;
   }
 
+  virtual bool IsStreamingSafe() const { return true; }
   virtual const char* Name() const { return "HtmlAttributeQuoteRemoval"; }
 
  private:
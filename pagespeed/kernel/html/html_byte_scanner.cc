@@ -0,0 +1,214 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/html/html_byte_scanner.h"
+
+#include <cstring>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+// The vector implementations need the SSE2 intrinsics, which every x86-64
+// compiler provides, and the GCC/clang 'target' attribute, so that the AVX2
+// version can be compiled without building the whole file for AVX2.
+#if defined(__SSE2__) && defined(__GNUC__)
+#define PAGESPEED_HTML_BYTE_SCANNER_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace net_instaweb {
+
+namespace {
+
+#ifdef PAGESPEED_HTML_BYTE_SCANNER_X86
+
+// Returns the number of set bits of mask below bit 'offset'.
+inline int CountBitsBelow(uint32 mask, int offset) {
+  return __builtin_popcount(mask & ((1U << offset) - 1));
+}
+
+// Scans whole 16-byte blocks of text for any of bytes[0, num_bytes).
+// Returns the offset of the first match, or of the first byte of the
+// partial block at the end if there was none; the caller scans the rest.
+int ScanSse2(const char* text, int size, const char* bytes, int num_bytes,
+             int* newlines) {
+  __m128i needles[HtmlByteScanner::kMaxBytes];
+  for (int k = 0; k < num_bytes; ++k) {
+    needles[k] = _mm_set1_epi8(bytes[k]);
+  }
+  const __m128i newline = _mm_set1_epi8('\n');
+  int lines = 0;
+  int i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(text + i));
+    __m128i matches = _mm_cmpeq_epi8(block, needles[0]);
+    for (int k = 1; k < num_bytes; ++k) {
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[k]));
+    }
+    uint32 match_mask = _mm_movemask_epi8(matches);
+    uint32 newline_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    if (match_mask != 0) {
+      int offset = __builtin_ctz(match_mask);
+      *newlines += lines + CountBitsBelow(newline_mask, offset);
+      return i + offset;
+    }
+    if (newline_mask != 0) {
+      lines += __builtin_popcount(newline_mask);
+    }
+  }
+  *newlines += lines;
+  return i;
+}
+
+// As ScanSse2, but 32 bytes at a time.  Only called if the CPU has AVX2.
+__attribute__((target("avx2")))
+int ScanAvx2(const char* text, int size, const char* bytes, int num_bytes,
+             int* newlines) {
+  __m256i needles[HtmlByteScanner::kMaxBytes];
+  for (int k = 0; k < num_bytes; ++k) {
+    needles[k] = _mm256_set1_epi8(bytes[k]);
+  }
+  const __m256i newline = _mm256_set1_epi8('\n');
+  int lines = 0;
+  int i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(text + i));
+    __m256i matches = _mm256_cmpeq_epi8(block, needles[0]);
+    for (int k = 1; k < num_bytes; ++k) {
+      matches = _mm256_or_si256(matches,
+                                _mm256_cmpeq_epi8(block, needles[k]));
+    }
+    uint32 match_mask = _mm256_movemask_epi8(matches);
+    uint32 newline_mask = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(block, newline));
+    if (match_mask != 0) {
+      int offset = __builtin_ctz(match_mask);
+      *newlines += lines + CountBitsBelow(newline_mask, offset);
+      return i + offset;
+    }
+    if (newline_mask != 0) {
+      lines += __builtin_popcount(newline_mask);
+    }
+  }
+  *newlines += lines;
+  return i;
+}
+
+#endif  // PAGESPEED_HTML_BYTE_SCANNER_X86
+
+}  // namespace
+
+HtmlByteScanner::HtmlByteScanner(StringPiece bytes)
+    : implementation_(BestImplementation()) {
+  Init(bytes);
+}
+
+HtmlByteScanner::HtmlByteScanner(StringPiece bytes,
+                                 Implementation implementation)
+    : implementation_(implementation) {
+  DCHECK(IsSupported(implementation));
+  Init(bytes);
+}
+
+void HtmlByteScanner::Init(StringPiece bytes) {
+  CHECK_LE(1U, bytes.size());
+  CHECK_GE(static_cast<size_t>(kMaxBytes), bytes.size());
+  num_bytes_ = bytes.size();
+  memset(bytes_, 0, sizeof(bytes_));
+  memcpy(bytes_, bytes.data(), bytes.size());
+  memset(is_match_, 0, sizeof(is_match_));
+  for (int i = 0; i < num_bytes_; ++i) {
+    is_match_[static_cast<uint8>(bytes_[i])] = true;
+  }
+}
+
+// static
+HtmlByteScanner::Implementation HtmlByteScanner::BestImplementation() {
+  if (IsSupported(kAvx2)) {
+    return kAvx2;
+  } else if (IsSupported(kSse2)) {
+    return kSse2;
+  }
+  return kPortable;
+}
+
+// static
+bool HtmlByteScanner::IsSupported(Implementation implementation) {
+  switch (implementation) {
+    case kPortable:
+      return true;
+#ifdef PAGESPEED_HTML_BYTE_SCANNER_X86
+    case kSse2:
+      return true;
+    case kAvx2:
+      return __builtin_cpu_supports("avx2");
+#else
+    case kSse2:
+    case kAvx2:
+      return false;
+#endif
+  }
+  return false;
+}
+
+// static
+const char* HtmlByteScanner::ImplementationName(
+    Implementation implementation) {
+  switch (implementation) {
+    case kPortable: return "portable";
+    case kSse2: return "sse2";
+    case kAvx2: return "avx2";
+  }
+  return "unknown";
+}
+
+int HtmlByteScanner::Scan(const char* text, int size, int* newlines) const {
+  int i = 0;
+#ifdef PAGESPEED_HTML_BYTE_SCANNER_X86
+  if (implementation_ == kAvx2) {
+    i = ScanAvx2(text, size, bytes_, num_bytes_, newlines);
+  } else if (implementation_ == kSse2) {
+    i = ScanSse2(text, size, bytes_, num_bytes_, newlines);
+  }
+#endif
+  // Finish off the partial block at the end, or the whole buffer if there
+  // is no vector implementation.  If the vector scan found a match, this
+  // returns immediately.
+  return i + ScanPortable(text + i, size - i, newlines);
+}
+
+int HtmlByteScanner::ScanPortable(const char* text, int size,
+                                  int* newlines) const {
+  int lines = 0;
+  int i = 0;
+  for (; i < size; ++i) {
+    uint8 c = static_cast<uint8>(text[i]);
+    if (is_match_[c]) {
+      break;
+    }
+    if (c == '\n') {
+      ++lines;
+    }
+  }
+  *newlines += lines;
+  return i;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_HTML_HTML_BYTE_SCANNER_H_
+#define PAGESPEED_KERNEL_HTML_HTML_BYTE_SCANNER_H_
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// Finds the next occurrence of any of a small set of bytes in a buffer,
+// counting the newlines it passes on the way.  HtmlLexer uses this to skip
+// over runs of bytes that cannot change its state, such as the body of a
+// text node, comment or quoted attribute value, rather than feeding them
+// through its state machine one at a time.
+//
+// On x86 the scan compares 16 (SSE2) or 32 (AVX2) bytes per step; AVX2 is
+// used only if the CPU we're running on supports it.  Elsewhere, and for
+// the tail of a buffer, it falls back to a table lookup per byte.
+class HtmlByteScanner {
+ public:
+  enum Implementation {
+    kPortable,
+    kSse2,
+    kAvx2,
+  };
+
+  // Maximum number of distinct bytes a scanner can look for.
+  static const int kMaxBytes = 4;
+
+  // Scans for any of the bytes in 'bytes', of which there must be between
+  // 1 and kMaxBytes, using the fastest implementation available.
+  explicit HtmlByteScanner(StringPiece bytes);
+
+  // As above, but with a specific implementation, which must be supported.
+  HtmlByteScanner(StringPiece bytes, Implementation implementation);
+
+  // Returns the offset of the first byte in text[0, size) that is one of
+  // the scanner's bytes, or size if there is none.  Adds the number of
+  // newlines in the bytes skipped to *newlines.
+  int Scan(const char* text, int size, int* newlines) const;
+
+  Implementation implementation() const { return implementation_; }
+
+  // Returns the fastest implementation supported by this CPU.
+  static Implementation BestImplementation();
+
+  // Returns whether implementation can be used on this CPU.
+  static bool IsSupported(Implementation implementation);
+
+  static const char* ImplementationName(Implementation implementation);
+
+ private:
+  void Init(StringPiece bytes);
+  int ScanPortable(const char* text, int size, int* newlines) const;
+
+  Implementation implementation_;
+  int num_bytes_;
+  char bytes_[kMaxBytes];
+  bool is_match_[256];
+
+  DISALLOW_COPY_AND_ASSIGN(HtmlByteScanner);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTML_HTML_BYTE_SCANNER_H_
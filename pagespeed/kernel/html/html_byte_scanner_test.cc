@@ -0,0 +1,139 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the byte scanner used by HtmlLexer, comparing each
+// implementation the CPU supports against a simple loop.
+
+#include "pagespeed/kernel/html/html_byte_scanner.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_mutex.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/util/simple_random.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const HtmlByteScanner::Implementation kImplementations[] = {
+  HtmlByteScanner::kPortable,
+  HtmlByteScanner::kSse2,
+  HtmlByteScanner::kAvx2,
+};
+
+class HtmlByteScannerTest : public testing::Test {
+ protected:
+  HtmlByteScannerTest() : random_(new NullMutex) {}
+
+  // Scans text with every supported implementation, and checks that each
+  // agrees with a byte-at-a-time scan.
+  void CheckScan(StringPiece bytes, StringPiece text) {
+    int expected_newlines = 0;
+    int expected = 0;
+    for (int n = text.size(); expected < n; ++expected) {
+      if (bytes.find(text[expected]) != StringPiece::npos) {
+        break;
+      }
+      if (text[expected] == '\n') {
+        ++expected_newlines;
+      }
+    }
+    for (int i = 0; i < static_cast<int>(arraysize(kImplementations)); ++i) {
+      HtmlByteScanner::Implementation implementation = kImplementations[i];
+      if (!HtmlByteScanner::IsSupported(implementation)) {
+        continue;
+      }
+      HtmlByteScanner scanner(bytes, implementation);
+      int newlines = 0;
+      EXPECT_EQ(expected, scanner.Scan(text.data(), text.size(), &newlines))
+          << HtmlByteScanner::ImplementationName(implementation);
+      EXPECT_EQ(expected_newlines, newlines)
+          << HtmlByteScanner::ImplementationName(implementation);
+    }
+  }
+
+  SimpleRandom random_;
+};
+
+TEST_F(HtmlByteScannerTest, Empty) {
+  CheckScan("<", "");
+}
+
+TEST_F(HtmlByteScannerTest, NoMatch) {
+  CheckScan("<", "hello");
+  CheckScan("<", GoogleString(100, 'x'));
+  CheckScan("<", StrCat(GoogleString(40, 'x'), "\n", GoogleString(40, 'y')));
+}
+
+TEST_F(HtmlByteScannerTest, MatchAtEveryOffset) {
+  // Cover matches in the first and later vector blocks, and in the tail
+  // after the last whole block.
+  for (int size = 1; size <= 100; ++size) {
+    for (int offset = 0; offset < size; ++offset) {
+      GoogleString text(size, 'a');
+      text[offset] = '<';
+      if (offset > 0) {
+        text[offset / 2] = '\n';
+      }
+      CheckScan("<", text);
+    }
+  }
+}
+
+TEST_F(HtmlByteScannerTest, SeveralBytes) {
+  CheckScan("<-", "var x = y-- < 3;");
+  CheckScan("<-", StrCat(GoogleString(50, 'z'), "<!--"));
+  CheckScan("\"'", "abc'def\"");
+  CheckScan("abcd", "xyzd");
+}
+
+TEST_F(HtmlByteScannerTest, NewlinesBeforeMatch) {
+  CheckScan("<", StrCat(GoogleString(70, '\n'), "<", GoogleString(70, '\n')));
+}
+
+TEST_F(HtmlByteScannerTest, HighBitBytes) {
+  CheckScan("\xff", StrCat(GoogleString(40, '\x80'), "\xff"));
+  CheckScan("<", GoogleString(40, '\xfe'));
+}
+
+TEST_F(HtmlByteScannerTest, Random) {
+  for (int i = 0; i < 1000; ++i) {
+    int size = random_.Next() % 200;
+    GoogleString text;
+    for (int j = 0; j < size; ++j) {
+      // Mostly letters, with the occasional newline or markup character.
+      uint32 r = random_.Next() % 64;
+      text.push_back(r < 4 ? "\n<-]"[r] : static_cast<char>('a' + r % 26));
+    }
+    CheckScan("<", text);
+    CheckScan("<-", text);
+    CheckScan("]", text);
+  }
+}
+
+TEST_F(HtmlByteScannerTest, BestImplementationIsSupported) {
+  EXPECT_TRUE(HtmlByteScanner::IsSupported(
+      HtmlByteScanner::BestImplementation()));
+  EXPECT_TRUE(HtmlByteScanner::IsSupported(HtmlByteScanner::kPortable));
+  HtmlByteScanner scanner("<");
+  EXPECT_EQ(HtmlByteScanner::BestImplementation(), scanner.implementation());
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
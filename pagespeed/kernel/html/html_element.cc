@@ -21,6 +21,7 @@
 #include <cstdio>
 
 #include "base/logging.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -31,9 +32,10 @@
 namespace net_instaweb {
 
 HtmlElement::HtmlElement(HtmlElement* parent, const HtmlName& name,
-    const HtmlEventListIterator& begin, const HtmlEventListIterator& end)
+    const HtmlEventListIterator& begin, const HtmlEventListIterator& end,
+    SizeClassPool* attribute_pool)
     : HtmlNode(parent),
-      data_(new Data(name, begin, end)) {
+      data_(new Data(name, begin, end, attribute_pool)) {
 }
 
 HtmlElement::~HtmlElement() {
@@ -41,14 +43,17 @@ HtmlElement::~HtmlElement() {
 
 HtmlElement::Data::Data(const HtmlName& name,
                         const HtmlEventListIterator& begin,
-                        const HtmlEventListIterator& end)
+                        const HtmlEventListIterator& end,
+                        SizeClassPool* attribute_pool)
     : begin_line_number_(0),
       live_(1),
       end_line_number_(0),
       style_(AUTO_CLOSE),
       name_(name),
       begin_(begin),
-      end_(end) {
+      end_(end),
+      attribute_pool_(attribute_pool) {
+  DCHECK(attribute_pool != NULL);
 }
 
 HtmlElement::Data::~Data() {
@@ -63,11 +68,14 @@ void HtmlElement::MarkAsDead(const HtmlEventListIterator& end) {
 }
 
 void HtmlElement::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                   HtmlEventList* queue) {
+                                   HtmlEventList* queue,
+                                   FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since these events are synthetic.
-  HtmlEvent* start_tag = new HtmlStartElementEvent(this, Data::kMaxLineNumber);
+  HtmlEvent* start_tag = new (event_pool) HtmlStartElementEvent(
+      this, Data::kMaxLineNumber);
   set_begin(queue->insert(iter, start_tag));
-  HtmlEvent* end_tag = new HtmlEndElementEvent(this, Data::kMaxLineNumber);
+  HtmlEvent* end_tag = new (event_pool) HtmlEndElementEvent(
+      this, Data::kMaxLineNumber);
   set_end(queue->insert(iter, end_tag));
 }
 
@@ -168,13 +176,13 @@ void HtmlElement::DebugPrint() const {
 }
 
 void HtmlElement::AddAttribute(const Attribute& src_attr) {
-  Attribute* attr = new Attribute(src_attr.name(),
-                                  src_attr.escaped_value(),
-                                  src_attr.quote_style());
+  Attribute* attr = new (data_->attribute_pool_) Attribute(
+      src_attr.name(), src_attr.escaped_value(), src_attr.quote_style(),
+      data_->attribute_pool_);
   if (src_attr.decoded_value_computed_) {
     attr->decoded_value_computed_ = true;
     attr->decoding_error_ = src_attr.decoding_error_;
-    Attribute::CopyValue(src_attr.decoded_value_.get(), &attr->decoded_value_);
+    attr->decoded_value_ = attr->CopyValue(src_attr.decoded_value_);
   }
   data_->attributes_.Append(attr);
 }
@@ -183,44 +191,57 @@ void HtmlElement::AddAttribute(const HtmlName& name,
                                const StringPiece& decoded_value,
                                QuoteStyle quote_style) {
   GoogleString buf;
-  Attribute* attr = new Attribute(name,
-                                  HtmlKeywords::Escape(decoded_value, &buf),
-                                  quote_style);
+  Attribute* attr = new (data_->attribute_pool_) Attribute(
+      name, HtmlKeywords::Escape(decoded_value, &buf), quote_style,
+      data_->attribute_pool_);
   attr->decoded_value_computed_ = true;
   attr->decoding_error_ = false;
-  Attribute::CopyValue(decoded_value, &attr->decoded_value_);
+  attr->decoded_value_ = attr->CopyValue(decoded_value);
   data_->attributes_.Append(attr);
 }
 
 void HtmlElement::AddEscapedAttribute(const HtmlName& name,
                                       const StringPiece& escaped_value,
                                       QuoteStyle quote_style) {
-  Attribute* attr = new Attribute(name, escaped_value, quote_style);
+  Attribute* attr = new (data_->attribute_pool_) Attribute(
+      name, escaped_value, quote_style, data_->attribute_pool_);
   data_->attributes_.Append(attr);
 }
 
-void HtmlElement::Attribute::CopyValue(const StringPiece& src,
-                                       scoped_array<char>* dst) {
+const char* HtmlElement::Attribute::CopyValue(const StringPiece& src) const {
   if (src.data() == NULL) {
     // This case indicates attribute without value <tag attr>, as opposed
     // to data()=="", which implies an empty value <tag attr=>.
-    dst->reset();
-  } else {
-    char* buf = new char[src.size() + 1];
-    memcpy(buf, src.data(), src.size());
-    buf[src.size()] = '\0';
-    dst->reset(buf);
+    return NULL;
+  }
+  char* buf = static_cast<char*>(pool_->Allocate(src.size() + 1));
+  memcpy(buf, src.data(), src.size());
+  buf[src.size()] = '\0';
+  return buf;
+}
+
+void HtmlElement::Attribute::FreeValue(const char* value) {
+  if (value != NULL) {
+    SizeClassPool::Deallocate(const_cast<char*>(value));
   }
 }
 
 HtmlElement::Attribute::Attribute(const HtmlName& name,
                                   const StringPiece& escaped_value,
-                                  QuoteStyle quote_style)
-    : name_(name),
+                                  QuoteStyle quote_style,
+                                  SizeClassPool* pool)
+    : pool_(pool),
+      name_(name),
       quote_style_(quote_style),
       decoding_error_(false),
-      decoded_value_computed_(false) {
-  CopyValue(escaped_value, &escaped_value_);
+      decoded_value_computed_(false),
+      decoded_value_(NULL) {
+  escaped_value_ = CopyValue(escaped_value);
+}
+
+HtmlElement::Attribute::~Attribute() {
+  FreeValue(escaped_value_);
+  FreeValue(decoded_value_);
 }
 
 // Modify value of attribute (eg to rewrite dest of src or href).
@@ -228,34 +249,36 @@ HtmlElement::Attribute::Attribute(const HtmlName& name,
 // ownership of value.
 void HtmlElement::Attribute::SetValue(const StringPiece& decoded_value) {
   GoogleString buf;
-  // Note that we execute the lines in this order in case value
-  // is a substring of value_.  This copies the value just prior
-  // to deallocation of the old value_.
-  const char* escaped_chars = escaped_value_.get();
+  // Note that we copy the new values before freeing the old ones, in case
+  // value is a substring of decoded_value_.
+  const char* escaped_chars = escaped_value_;
+  const char* old_decoded_value = decoded_value_;
   DCHECK(decoded_value.data() + decoded_value.size() < escaped_chars ||
          escaped_chars + strlen(escaped_chars) < decoded_value.data())
       << "Setting unescaped value from substring of escaped value.";
-  CopyValue(HtmlKeywords::Escape(decoded_value, &buf), &escaped_value_);
-  CopyValue(decoded_value, &decoded_value_);
+  escaped_value_ = CopyValue(HtmlKeywords::Escape(decoded_value, &buf));
+  decoded_value_ = CopyValue(decoded_value);
+  FreeValue(escaped_chars);
+  FreeValue(old_decoded_value);
 }
 
 void HtmlElement::Attribute::SetEscapedValue(const StringPiece& escaped_value) {
-  GoogleString buf;
-  // Note that we execute the lines in this order in case value
-  // is a substring of value_.  This copies the value just prior
-  // to deallocation of the old value_.
-  const char* value_chars = decoded_value_.get();
+  const char* value_chars = decoded_value_;
   if (value_chars != NULL) {
     DCHECK(value_chars + strlen(value_chars) < escaped_value.data() ||
            escaped_value.data() + escaped_value.size() < value_chars)
         << "Setting escaped value from substring of unescaped value.";
   }
 
-  decoded_value_.reset();
+  FreeValue(value_chars);
+  decoded_value_ = NULL;
   decoding_error_ = false;
   decoded_value_computed_ = false;
 
-  CopyValue(escaped_value, &escaped_value_);
+  // As in SetValue, escaped_value may be a substring of escaped_value_.
+  const char* old_escaped_value = escaped_value_;
+  escaped_value_ = CopyValue(escaped_value);
+  FreeValue(old_escaped_value);
 }
 
 const char* HtmlElement::Attribute::quote_str() const {
@@ -273,8 +296,9 @@ const char* HtmlElement::Attribute::quote_str() const {
 void HtmlElement::Attribute::ComputeDecodedValue() const {
   GoogleString buf;
   StringPiece unescaped_value = HtmlKeywords::Unescape(
-      escaped_value_.get(), &buf, &decoding_error_);
-  CopyValue(unescaped_value, &decoded_value_);
+      escaped_value_, &buf, &decoding_error_);
+  FreeValue(decoded_value_);
+  decoded_value_ = CopyValue(unescaped_value);
   decoded_value_computed_ = true;
 }
 
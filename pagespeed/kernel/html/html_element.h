@@ -19,7 +19,10 @@
 #ifndef PAGESPEED_KERNEL_HTML_HTML_ELEMENT_H_
 #define PAGESPEED_KERNEL_HTML_HTML_ELEMENT_H_
 
+#include <cstddef>
+
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/inline_slist.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
@@ -88,7 +91,7 @@ class HtmlElement : public HtmlNode {
 
     // Returns the value in its original directly from the HTML source.
     // This may have HTML escapes in it, such as "&amp;".
-    const char* escaped_value() const { return escaped_value_.get(); }
+    const char* escaped_value() const { return escaped_value_; }
 
     // The result of DecodedValueOrNull() is still owned by this, and
     // will be invalidated by a subsequent call to SetValue().
@@ -119,7 +122,7 @@ class HtmlElement : public HtmlNode {
       if (!decoded_value_computed_) {
         ComputeDecodedValue();
       }
-      return decoded_value_.get();
+      return decoded_value_;
     }
 
     void set_decoding_error(bool x) { decoding_error_ = x; }
@@ -168,16 +171,34 @@ class HtmlElement : public HtmlNode {
 
     friend class HtmlElement;
 
+    // Attributes and their values are allocated from HtmlParse's attribute
+    // pool, and returned to it when the attribute is removed, or its
+    // element's data is freed at a flush.
+    ~Attribute();
+    void operator delete(void* ptr) { SizeClassPool::Deallocate(ptr); }
+
    private:
+    void* operator new(size_t size, SizeClassPool* pool) {
+      return pool->Allocate(size);
+    }
+    void operator delete(void* ptr, SizeClassPool* pool) {
+      SizeClassPool::Deallocate(ptr);
+    }
+
     void ComputeDecodedValue() const;
 
     // This should only be called from AddAttribute
     Attribute(const HtmlName& name, const StringPiece& escaped_value,
-              QuoteStyle quote_style);
+              QuoteStyle quote_style, SizeClassPool* pool);
+
+    // Returns a NUL-terminated copy of src in pool_, or NULL if src.data()
+    // is NULL.
+    const char* CopyValue(const StringPiece& src) const;
 
-    static inline void CopyValue(const StringPiece& src,
-                                 scoped_array<char>* dst);
+    // Returns a value from CopyValue to the pool.
+    static void FreeValue(const char* value);
 
+    SizeClassPool* pool_;
     HtmlName name_;
     QuoteStyle quote_style_ : 8;
     mutable bool decoding_error_;
@@ -191,7 +212,7 @@ class HtmlElement : public HtmlNode {
     // Note that it is acceptable to have 8-bit characters in escape
     // sequences (typically iso8859).  However we will not be able to
     // decode such attributes.
-    scoped_array<char> escaped_value_;
+    const char* escaped_value_;
 
     // An 8-bit representation of the escaped_value.  Escape sequences
     // that contain character-codes >= 256 are not decoded, and will
@@ -209,7 +230,7 @@ class HtmlElement : public HtmlNode {
     // Note that we do not decode non-ASCII characters but we can
     // represent them in escaped_value_.  We can get 8-bit characters
     // into decoded_value_ via &#129; etc.
-    mutable scoped_array<char> decoded_value_;
+    mutable const char* decoded_value_;
 
     DISALLOW_COPY_AND_ASSIGN(Attribute);
   };
@@ -342,7 +363,8 @@ class HtmlElement : public HtmlNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
   virtual HtmlEventListIterator begin() const { return data_->begin_; }
   virtual HtmlEventListIterator end() const { return data_->end_; }
@@ -353,7 +375,8 @@ class HtmlElement : public HtmlNode {
   struct Data {
     Data(const HtmlName& name,
          const HtmlEventListIterator& begin,
-         const HtmlEventListIterator& end);
+         const HtmlEventListIterator& end,
+         SizeClassPool* attribute_pool);
     ~Data();
 
     // Max value for the line numbers below.  Since they are 24-bits,
@@ -380,6 +403,7 @@ class HtmlElement : public HtmlNode {
     AttributeList attributes_;
     HtmlEventListIterator begin_;
     HtmlEventListIterator end_;
+    SizeClassPool* attribute_pool_;
   };
 
   // Begin/end event iterators are used by HtmlParse to keep track
@@ -391,10 +415,12 @@ class HtmlElement : public HtmlNode {
   void set_begin_line_number(int line) { data_->begin_line_number_ = line; }
   void set_end_line_number(int line) { data_->end_line_number_ = line; }
 
-  // construct via HtmlParse::NewElement
+  // construct via HtmlParse::NewElement.  Attributes are allocated from
+  // attribute_pool.
   HtmlElement(HtmlElement* parent, const HtmlName& name,
               const HtmlEventListIterator& begin,
-              const HtmlEventListIterator& end);
+              const HtmlEventListIterator& end,
+              SizeClassPool* attribute_pool);
 
   // HtmlElement data is held in HtmlElement::Data*, which is freed
   // when a CloseElement is Flushed.  The pointers themselves are
@@ -18,15 +18,37 @@
 
 #include "pagespeed/kernel/html/html_event.h"
 
+#include <cstddef>
 #include <cstdio>
 
+#include "base/logging.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/string.h"
 
 namespace net_instaweb {
 
+namespace {
+
+// Every event gets a block of this size, so that the pool can reuse one kind
+// of event's block for another.  Each event holds a line number and at most
+// one pointer.
+const size_t kEventBlockSize = sizeof(HtmlStartElementEvent);
+
+}  // namespace
+
 HtmlEvent::~HtmlEvent() {
 }
 
+void* HtmlEvent::operator new(size_t size, FreeListPool* pool) {
+  CHECK_LE(size, kEventBlockSize);
+  return pool->Allocate(kEventBlockSize);
+}
+
+void HtmlEvent::Free(HtmlEvent* event, FreeListPool* pool) {
+  event->~HtmlEvent();
+  pool->Deallocate(event, kEventBlockSize);
+}
+
 void HtmlEvent::DebugPrint() {
   puts(ToString().c_str());
 }
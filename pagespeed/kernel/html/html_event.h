@@ -19,7 +19,11 @@
 #ifndef PAGESPEED_KERNEL_HTML_HTML_EVENT_H_
 #define PAGESPEED_KERNEL_HTML_HTML_EVENT_H_
 
+#include <cstddef>
+
+#include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/html_element.h"
@@ -51,6 +55,21 @@ class HtmlEvent {
 
   int line_number() const { return line_number_; }
 
+  // Events are allocated from HtmlParse's event pool, all in blocks of the
+  // same size, and are returned to it with Free once flushed.
+  void* operator new(size_t size, FreeListPool* pool);
+  static void Free(HtmlEvent* event, FreeListPool* pool);
+
+  void operator delete(void* ptr, FreeListPool* pool) {
+    LOG(FATAL) << "HtmlEvent must not be deleted directly.";
+  }
+
+ protected:
+  // Version that affects visibility of the destructor.
+  void operator delete(void* ptr) {
+    LOG(FATAL) << "HtmlEvent must not be deleted directly.";
+  }
+
  private:
   int line_number_;
 
@@ -93,6 +93,17 @@ class HtmlFilter {
   // pre-render filters to inherit off it.
   virtual void RenderDone();
 
+  // Returns whether this filter is streaming-safe, meaning that HtmlParse
+  // may hand each event to it and to any adjacent streaming-safe filters
+  // before moving to the next event, rather than running each filter over
+  // the whole flush window in turn.  A streaming-safe filter may mutate the
+  // node it is called for (e.g. its attributes or contents), and may look at
+  // that node's ancestors, but must not look ahead at later nodes, defer,
+  // insert, delete or move nodes, nor mutate anything from Flush().  Filters
+  // that follow it in the same pass will have seen only the events up to the
+  // current one.  The default implementation returns false.
+  virtual bool IsStreamingSafe() const;
+
   // Invoked by rewrite driver where all filters should determine whether
   // they are enabled for this request. The re-writer my optionally set
   // disabled_reason to explain why it disabled itself, which will appear
@@ -166,7 +166,14 @@ HtmlLexer::HtmlLexer(HtmlParse* html_parse)
       discard_until_start_state_for_error_recovery_(false),
       size_limit_exceeded_(false),
       skip_parsing_(false),
-      size_limit_(-1) {
+      size_limit_(-1),
+      text_scanner_("<"),
+      comment_scanner_("-"),
+      cdata_scanner_("]"),
+      attr_val_dq_scanner_("\""),
+      attr_val_sq_scanner_("'"),
+      literal_scanner_(">"),
+      script_scanner_("<-") {
 #ifndef NDEBUG
   CHECK_KEYWORD_SET_ORDERING(kImplicitlyClosedHtmlTags);
   CHECK_KEYWORD_SET_ORDERING(kNonBriefTerminatedTags);
@@ -637,7 +644,7 @@ void HtmlLexer::EvalScriptTag(char c) {
 // Emits raw uninterpreted characters.
 void HtmlLexer::EmitLiteral() {
   if (!literal_.empty()) {
-    html_parse_->AddEvent(new HtmlCharactersEvent(
+    html_parse_->AddEvent(new (html_parse_->event_pool()) HtmlCharactersEvent(
         html_parse_->NewCharactersNode(Parent(), literal_), tag_start_line_));
     literal_.clear();
   }
@@ -654,10 +661,12 @@ void HtmlLexer::EmitComment() {
       (token_.find("[endif]") != GoogleString::npos)) {
     HtmlIEDirectiveNode* node =
         html_parse_->NewIEDirectiveNode(Parent(), token_);
-    html_parse_->AddEvent(new HtmlIEDirectiveEvent(node, tag_start_line_));
+    html_parse_->AddEvent(new (html_parse_->event_pool()) HtmlIEDirectiveEvent(
+        node, tag_start_line_));
   } else {
     HtmlCommentNode* node = html_parse_->NewCommentNode(Parent(), token_);
-    html_parse_->AddEvent(new HtmlCommentEvent(node, tag_start_line_));
+    html_parse_->AddEvent(new (html_parse_->event_pool()) HtmlCommentEvent(
+        node, tag_start_line_));
   }
   token_.clear();
   state_ = START;
@@ -665,7 +674,7 @@ void HtmlLexer::EmitComment() {
 
 void HtmlLexer::EmitCdata() {
   literal_.clear();
-  html_parse_->AddEvent(new HtmlCdataEvent(
+  html_parse_->AddEvent(new (html_parse_->event_pool()) HtmlCdataEvent(
       html_parse_->NewCdataNode(Parent(), token_), tag_start_line_));
   token_.clear();
   state_ = START;
@@ -1013,7 +1022,7 @@ void HtmlLexer::EmitTagClose(HtmlElement::Style style) {
 
 void HtmlLexer::EmitDirective() {
   literal_.clear();
-  html_parse_->AddEvent(new HtmlDirectiveEvent(
+  html_parse_->AddEvent(new (html_parse_->event_pool()) HtmlDirectiveEvent(
       html_parse_->NewDirectiveNode(Parent(), token_), line_));
   // Update the doctype; note that if this is not a doctype directive, Parse()
   // will return false and not alter doctype_.
@@ -1022,6 +1031,47 @@ void HtmlLexer::EmitDirective() {
   state_ = START;
 }
 
+const HtmlByteScanner* HtmlLexer::FastPathScanner() const {
+  switch (state_) {
+    case START:           return &text_scanner_;
+    case COMMENT_BODY:    return &comment_scanner_;
+    case CDATA_BODY:      return &cdata_scanner_;
+    case TAG_ATTR_VALDQ:  return &attr_val_dq_scanner_;
+    case TAG_ATTR_VALSQ:  return &attr_val_sq_scanner_;
+    case LITERAL_TAG:     return &literal_scanner_;
+    case SCRIPT_TAG: {
+      // EvalScriptTag looks at the bytes after "<!--", "</script", "<script"
+      // and "-->", so stop at every '<' and '-', and go byte at a time until
+      // the last of them is far enough behind us to be out of the picture.
+      static const int kLookBehind = STATIC_STRLEN("</script");
+      int tail = std::min(static_cast<int>(literal_.size()), kLookBehind);
+      StringPiece recent(literal_.data() + literal_.size() - tail, tail);
+      if ((recent.find('<') != StringPiece::npos) ||
+          (recent.find('-') != StringPiece::npos)) {
+        return NULL;
+      }
+      return &script_scanner_;
+    }
+    default:              return NULL;
+  }
+}
+
+void HtmlLexer::AppendRun(const char* text, int size) {
+  literal_.append(text, size);
+  switch (state_) {
+    case COMMENT_BODY:
+    case CDATA_BODY:
+      token_.append(text, size);
+      break;
+    case TAG_ATTR_VALDQ:
+    case TAG_ATTR_VALSQ:
+      attr_value_.append(text, size);
+      break;
+    default:
+      break;
+  }
+}
+
 void HtmlLexer::Parse(const char* text, int size) {
   num_bytes_parsed_ += size;
   if (size_limit_ > 0 && num_bytes_parsed_ > size_limit_) {
@@ -1035,6 +1085,22 @@ void HtmlLexer::Parse(const char* text, int size) {
       // Return without doing anything if skip_parsing_ is true.
       return;
     }
+
+    // In states that only react to a few specific bytes, skip straight to
+    // the next of them.  Nothing is emitted in such a run, so skip_parsing_
+    // can't change.
+    const HtmlByteScanner* scanner = FastPathScanner();
+    if (scanner != NULL) {
+      int run = scanner->Scan(text + i, size - i, &line_);
+      if (run != 0) {
+        AppendRun(text + i, run);
+        i += run;
+        if (i == size) {
+          break;
+        }
+      }
+    }
+
     char c = text[i];
     if (c == '\n') {
       ++line_;
@@ -26,6 +26,7 @@
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/html/doctype.h"
+#include "pagespeed/kernel/html/html_byte_scanner.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_name.h"
 #include "pagespeed/kernel/http/content_type.h"
@@ -129,6 +130,16 @@ class HtmlLexer {
   inline void EvalDirective(char c);
   inline void EvalBogusComment(char c);
 
+  // Returns the scanner that finds the next byte that could change the
+  // lexer's state, or NULL if there is no such fast path from the current
+  // state.  Every byte before that one would just be appended to literal_,
+  // and possibly to token_ or attr_value_ too.
+  inline const HtmlByteScanner* FastPathScanner() const;
+
+  // Appends a run of bytes found by FastPathScanner() to the buffers the
+  // current state would have appended them to one at a time.
+  inline void AppendRun(const char* text, int size);
+
   // Makes an element based on token_, which will be parsed as the tag
   // name.
   void MakeElement();
@@ -250,6 +261,15 @@ class HtmlLexer {
   int64 num_bytes_parsed_;
   int64 size_limit_;
 
+  // Scanners for FastPathScanner(), named for the states that use them.
+  HtmlByteScanner text_scanner_;
+  HtmlByteScanner comment_scanner_;
+  HtmlByteScanner cdata_scanner_;
+  HtmlByteScanner attr_val_dq_scanner_;
+  HtmlByteScanner attr_val_sq_scanner_;
+  HtmlByteScanner literal_scanner_;
+  HtmlByteScanner script_scanner_;
+
   DISALLOW_COPY_AND_ASSIGN(HtmlLexer);
 };
 
@@ -48,45 +48,51 @@ void HtmlLeafNode::MarkAsDead(const HtmlEventListIterator& end) {
 HtmlCdataNode::~HtmlCdataNode() {}
 
 void HtmlCdataNode::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                     HtmlEventList* queue) {
+                                     HtmlEventList* queue,
+                                     FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since the event is synthetic.
-  HtmlCdataEvent* event = new HtmlCdataEvent(this, -1);
+  HtmlCdataEvent* event = new (event_pool) HtmlCdataEvent(this, -1);
   set_iter(queue->insert(iter, event));
 }
 
 HtmlCharactersNode::~HtmlCharactersNode() {}
 
 void HtmlCharactersNode::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                          HtmlEventList* queue) {
+                                          HtmlEventList* queue,
+                                          FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since the event is synthetic.
-  HtmlCharactersEvent* event = new HtmlCharactersEvent(this, -1);
+  HtmlCharactersEvent* event = new (event_pool) HtmlCharactersEvent(this, -1);
   set_iter(queue->insert(iter, event));
 }
 
 HtmlCommentNode::~HtmlCommentNode() {}
 
 void HtmlCommentNode::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                       HtmlEventList* queue) {
+                                       HtmlEventList* queue,
+                                       FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since the event is synthetic.
-  HtmlCommentEvent* event = new HtmlCommentEvent(this, -1);
+  HtmlCommentEvent* event = new (event_pool) HtmlCommentEvent(this, -1);
   set_iter(queue->insert(iter, event));
 }
 
 HtmlIEDirectiveNode::~HtmlIEDirectiveNode() {}
 
 void HtmlIEDirectiveNode::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                         HtmlEventList* queue) {
+                                         HtmlEventList* queue,
+                                         FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since the event is synthetic.
-  HtmlIEDirectiveEvent* event = new HtmlIEDirectiveEvent(this, -1);
+  HtmlIEDirectiveEvent* event =
+      new (event_pool) HtmlIEDirectiveEvent(this, -1);
   set_iter(queue->insert(iter, event));
 }
 
 HtmlDirectiveNode::~HtmlDirectiveNode() {}
 
 void HtmlDirectiveNode::SynthesizeEvents(const HtmlEventListIterator& iter,
-                                         HtmlEventList* queue) {
+                                         HtmlEventList* queue,
+                                         FreeListPool* event_pool) {
   // We use -1 as a bogus line number, since the event is synthetic.
-  HtmlDirectiveEvent* event = new HtmlDirectiveEvent(this, -1);
+  HtmlDirectiveEvent* event = new (event_pool) HtmlDirectiveEvent(this, -1);
   set_iter(queue->insert(iter, event));
 }
 
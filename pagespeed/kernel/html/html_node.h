@@ -25,6 +25,7 @@
 #include "base/logging.h"
 #include "pagespeed/kernel/base/arena.h"
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
@@ -34,7 +35,10 @@ namespace net_instaweb {
 class HtmlElement;
 class HtmlEvent;
 
-typedef std::list<HtmlEvent*> HtmlEventList;
+// The links of the event lists are drawn from a per-document pool owned by
+// HtmlParse, so that lists can be spliced into each other.
+typedef FreeListAllocator<HtmlEvent*> HtmlEventListAllocator;
+typedef std::list<HtmlEvent*, HtmlEventListAllocator> HtmlEventList;
 typedef HtmlEventList::iterator HtmlEventListIterator;
 
 // Base class for HtmlElement and HtmlLeafNode.  Generally represents all
@@ -70,12 +74,14 @@ class HtmlNode {
   // when calling HtmlParse::ApplyFilter.
   explicit HtmlNode(HtmlElement* parent) : parent_(parent) {}
 
-  // Create new event object(s) representing this node, and insert them into
-  // the queue just before the given iterator; also, update this node object as
-  // necessary so that begin() and end() will return iterators pointing to
-  // the new event(s).  The line number for each event should probably be -1.
+  // Create new event object(s) representing this node from event_pool, and
+  // insert them into the queue just before the given iterator; also, update
+  // this node object as necessary so that begin() and end() will return
+  // iterators pointing to the new event(s).  The line number for each event
+  // should probably be -1.
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue) = 0;
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool) = 0;
 
   // Return an iterator pointing to the first event associated with this node.
   virtual HtmlEventListIterator begin() const = 0;
@@ -151,7 +157,8 @@ class HtmlCdataNode : public HtmlLeafNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
  private:
   HtmlCdataNode(HtmlElement* parent,
@@ -177,7 +184,8 @@ class HtmlCharactersNode : public HtmlLeafNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
  private:
   HtmlCharactersNode(HtmlElement* parent,
@@ -197,7 +205,8 @@ class HtmlCommentNode : public HtmlLeafNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
  private:
   HtmlCommentNode(HtmlElement* parent,
@@ -217,7 +226,8 @@ class HtmlIEDirectiveNode : public HtmlLeafNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
  private:
   HtmlIEDirectiveNode(HtmlElement* parent,
@@ -237,7 +247,8 @@ class HtmlDirectiveNode : public HtmlLeafNode {
 
  protected:
   virtual void SynthesizeEvents(const HtmlEventListIterator& iter,
-                                HtmlEventList* queue);
+                                HtmlEventList* queue,
+                                FreeListPool* event_pool);
 
  private:
   HtmlDirectiveNode(HtmlElement* parent,
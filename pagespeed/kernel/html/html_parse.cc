@@ -47,6 +47,8 @@ HtmlParse::HtmlParse(MessageHandler* message_handler)
     : lexer_(NULL),  // Can't initialize here, since "this" should not be used
                      // in the initializer list (it generates an error in
                      // Visual Studio builds).
+      queue_(HtmlEventListAllocator(&event_links_)),
+      retired_events_(HtmlEventListAllocator(&event_links_)),
       current_(queue_.end()),
       message_handler_(message_handler),
       line_number_(1),
@@ -55,10 +57,13 @@ HtmlParse::HtmlParse(MessageHandler* message_handler)
       need_sanity_check_(false),
       coalesce_characters_(true),
       need_coalesce_characters_(false),
+      fuse_streaming_filters_(true),
       url_valid_(false),
       log_rewrite_timing_(false),
+      time_filters_(false),
       running_filters_(false),
       parse_start_time_us_(0),
+      delayed_start_literal_(NULL),
       timer_(NULL),
       current_filter_(NULL),
       dynamically_disabled_filter_list_(NULL) {
@@ -68,7 +73,6 @@ HtmlParse::HtmlParse(MessageHandler* message_handler)
 
 HtmlParse::~HtmlParse() {
   delete lexer_;
-  STLDeleteElements(&queue_);
   STLDeleteElements(&event_listeners_);
   ClearElements();
 }
@@ -208,7 +212,8 @@ void HtmlParse::InsertScriptAfterCurrent(StringPiece text, bool external) {
 
 HtmlElement* HtmlParse::NewElement(HtmlElement* parent, const HtmlName& name) {
   HtmlElement* element =
-      new (&nodes_) HtmlElement(parent, name, queue_.end(), queue_.end());
+      new (&nodes_) HtmlElement(parent, name, queue_.end(), queue_.end(),
+                                 &attribute_pool_);
   if (IsOptionallyClosedTag(name.keyword())) {
     // When we programmatically insert HTML nodes we should default to
     // including an explicit close-tag if they are optionally closed
@@ -220,7 +225,7 @@ HtmlElement* HtmlParse::NewElement(HtmlElement* parent, const HtmlName& name) {
 
 void HtmlParse::AddElement(HtmlElement* element, int line_number) {
   HtmlStartElementEvent* event =
-      new HtmlStartElementEvent(element, line_number);
+      new (&event_pool_) HtmlStartElementEvent(element, line_number);
   AddEvent(event);
   element->set_begin(Last());
   element->set_begin_line_number(line_number);
@@ -228,7 +233,7 @@ void HtmlParse::AddElement(HtmlElement* element, int line_number) {
 
 bool HtmlParse::StartParseId(const StringPiece& url, const StringPiece& id,
                              const ContentType& content_type) {
-  delayed_start_literal_.reset();
+  delayed_start_literal_ = NULL;
   determine_enabled_filters_called_ = false;
 
   // Paranoid debug-checking and unconditional clearing of state variables.
@@ -242,6 +247,7 @@ bool HtmlParse::StartParseId(const StringPiece& url, const StringPiece& id,
   current_filter_ = NULL;
   DCHECK(deferred_deleted_nodes_.empty());
   deferred_deleted_nodes_.clear();
+  filter_time_us_.clear();
 
   if (dynamically_disabled_filter_list_ != NULL) {
     dynamically_disabled_filter_list_->clear();
@@ -263,7 +269,7 @@ bool HtmlParse::StartParseId(const StringPiece& url, const StringPiece& id,
       parse_start_time_us_ = timer_->NowUs();
       InfoHere("HtmlParse::StartParse");
     }
-    AddEvent(new HtmlStartDocumentEvent(line_number_));
+    AddEvent(new (&event_pool_) HtmlStartDocumentEvent(line_number_));
     lexer_->StartParse(id, content_type);
   }
   return url_valid_;
@@ -292,9 +298,9 @@ void HtmlParse::BeginFinishParse() {
   DCHECK(url_valid_) << "Invalid to call FinishParse on invalid input";
   if (url_valid_) {
     lexer_->FinishParse();
-    DCHECK(delayed_start_literal_.get() == NULL);
-    delayed_start_literal_.reset();
-    AddEvent(new HtmlEndDocumentEvent(line_number_));
+    DCHECK(delayed_start_literal_ == NULL);
+    delayed_start_literal_ = NULL;
+    AddEvent(new (&event_pool_) HtmlEndDocumentEvent(line_number_));
   }
 }
 
@@ -302,7 +308,16 @@ void HtmlParse::EndFinishParse() {
   if (url_valid_) {
     ClearElements();
     ShowProgress("FinishParse");
+    for (FilterTimeMap::iterator p = filter_time_us_.begin(),
+             e = filter_time_us_.end(); p != e; ++p) {
+      ReportFilterTime(p->first, p->second);
+    }
   }
+  filter_time_us_.clear();
+}
+
+void HtmlParse::ReportFilterTime(const FilterVector& filters,
+                                 int64 time_us) {
 }
 
 void HtmlParse::Clear() {
@@ -365,11 +380,7 @@ void HtmlParse::ApplyFilter(HtmlFilter* filter) {
     }
   }
 
-  if (coalesce_characters_ && need_coalesce_characters_) {
-    CoalesceAdjacentCharactersNodes();
-    DelayLiteralTag();
-    need_coalesce_characters_ = false;
-  }
+  PrepareQueueForFilter();
 
   ShowProgress(StrCat("ApplyFilter:", filter->Name()).c_str());
   for (current_ = queue_.begin(); current_ != queue_.end(); NextEvent()) {
@@ -386,6 +397,89 @@ void HtmlParse::ApplyFilter(HtmlFilter* filter) {
   current_filter_ = NULL;
 }
 
+void HtmlParse::ApplyFilters(const FilterList& filters) {
+  FilterVector pass;
+  for (FilterList::const_iterator i = filters.begin(); i != filters.end();
+       ++i) {
+    HtmlFilter* filter = *i;
+    if (!filter->is_enabled()) {
+      continue;
+    }
+    if (fuse_streaming_filters_ && filter->IsStreamingSafe()) {
+      pass.push_back(filter);
+    } else {
+      ApplyFilterPass(pass);
+      pass.assign(1, filter);
+      ApplyFilterPass(pass);
+      pass.clear();
+    }
+  }
+  ApplyFilterPass(pass);
+}
+
+// Runs the filters in one pass over the queue, and charges its time to it.
+void HtmlParse::ApplyFilterPass(const FilterVector& filters) {
+  if (filters.empty()) {
+    return;
+  }
+  int64 start_us = time_filters_ ? timer_->NowUs() : 0;
+  if (filters.size() == 1) {
+    ApplyFilter(filters[0]);
+  } else {
+    ApplyStreamingFilters(filters);
+  }
+  if (time_filters_) {
+    filter_time_us_[filters] += timer_->NowUs() - start_us;
+  }
+}
+
+void HtmlParse::ApplyStreamingFilters(const FilterVector& filters) {
+  // Streaming-safe filters never defer nodes, so unlike ApplyFilter there
+  // are no deferred events to move out of the queue first.
+  DCHECK(current_filter_ == NULL);
+  PrepareQueueForFilter();
+
+  // Streaming-safe filters must not change the structure of the queue,
+  // which would leave the later filters in the pass with a different view
+  // of it than a pass of their own would.  Those changes all request a
+  // sanity-check, so check up front for any the lexer made.
+  if (need_sanity_check_) {
+    SanityCheck();
+    need_sanity_check_ = false;
+  }
+
+  ShowProgress("ApplyStreamingFilters");
+  int num_filters = filters.size();
+  for (current_ = queue_.begin(); current_ != queue_.end(); ++current_) {
+    HtmlEvent* event = *current_;
+    line_number_ = event->line_number();
+    for (int i = 0; i < num_filters; ++i) {
+      current_filter_ = filters[i];
+      event->Run(current_filter_);
+    }
+  }
+  for (int i = 0; i < num_filters; ++i) {
+    current_filter_ = filters[i];
+    current_filter_->Flush();
+  }
+  current_filter_ = NULL;
+
+  DCHECK(!need_sanity_check_ && !skip_increment_)
+      << "A streaming-safe filter mutated the event queue";
+  if (need_sanity_check_) {
+    SanityCheck();
+    need_sanity_check_ = false;
+  }
+}
+
+void HtmlParse::PrepareQueueForFilter() {
+  if (coalesce_characters_ && need_coalesce_characters_) {
+    CoalesceAdjacentCharactersNodes();
+    DelayLiteralTag();
+    need_coalesce_characters_ = false;
+  }
+}
+
 void HtmlParse::NextEvent() {
   if (skip_increment_) {
     skip_increment_ = false;
@@ -402,8 +496,7 @@ void HtmlParse::CoalesceAdjacentCharactersNodes() {
     HtmlCharactersNode* node = event->GetCharactersNode();
     if ((node != NULL) && (prev != NULL)) {
       prev->Append(node->contents());
-      current_ = queue_.erase(current_);  // returns element after erased
-      delete event;
+      current_ = RetireEvent(current_);  // returns element after erased
       node->MarkAsDead(queue_.end());
       need_sanity_check_ = true;
     } else {
@@ -426,7 +519,7 @@ void HtmlParse::DelayLiteralTag() {
     // tag.  We are not going to process this within the current
     // flush window, but instead wait till the EndElement arrives
     // from the lexer.
-    delayed_start_literal_.reset(event);
+    delayed_start_literal_ = event;
     queue_.erase(current_);
   }
   current_ = queue_.end();
@@ -530,13 +623,7 @@ void HtmlParse::Flush() {
   DCHECK(url_valid_) << "Invalid to call FinishParse with invalid url";
   if (url_valid_) {
     ShowProgress("Flush");
-
-    for (FilterList::iterator i = filters_.begin(); i != filters_.end(); ++i) {
-      HtmlFilter* filter = *i;
-      if (filter->is_enabled()) {
-        ApplyFilter(filter);
-      }
-    }
+    ApplyFilters(filters_);
     ClearEvents();
   }
 }
@@ -565,13 +652,28 @@ void HtmlParse::ClearEvents() {
         }
       }
     }
-    delete event;
   }
-  queue_.clear();
+  FreeEvents(&queue_);
+  FreeEvents(&retired_events_);
   need_sanity_check_ = false;
   need_coalesce_characters_ = false;
 }
 
+HtmlEventListIterator HtmlParse::RetireEvent(HtmlEventListIterator event) {
+  HtmlEventListIterator next = event;
+  ++next;
+  retired_events_.splice(retired_events_.end(), queue_, event);
+  return next;
+}
+
+void HtmlParse::FreeEvents(HtmlEventList* events) {
+  for (HtmlEventListIterator p = events->begin(), e = events->end(); p != e;
+       ++p) {
+    HtmlEvent::Free(*p, &event_pool_);
+  }
+  events->clear();
+}
+
 size_t HtmlParse::GetEventQueueSize() {
   return queue_.size();
 }
@@ -647,7 +749,7 @@ void HtmlParse::InsertNodeBeforeEvent(const HtmlEventListIterator& event,
                                       HtmlNode* new_node) {
   need_sanity_check_ = true;
   need_coalesce_characters_ = true;
-  new_node->SynthesizeEvents(event, &queue_);
+  new_node->SynthesizeEvents(event, &queue_, &event_pool_);
 }
 
 void HtmlParse::InsertNodeAfterEvent(const HtmlEventListIterator& event,
@@ -853,7 +955,7 @@ bool HtmlParse::DeleteNode(HtmlNode* node) {
         current_ = node->end();
         ++current_;
       }
-      p = queue_.erase(p);
+      p = RetireEvent(p);
 
       HtmlNode* nested_node = event->GetElementIfEndEvent();
       if (nested_node == NULL) {
@@ -863,8 +965,6 @@ bool HtmlParse::DeleteNode(HtmlNode* node) {
         message_handler_->Check(nested_node->live(), "!nested_node->live()");
         nested_node->MarkAsDead(queue_.end());
       }
-
-      delete event;
     }
 
     // Our iteration should have covered the passed-in element as well.
@@ -992,8 +1092,19 @@ bool HtmlParse::IsInEventWindow(const HtmlEventListIterator& iter) const {
 }
 
 void HtmlParse::ClearElements() {
+  // Normally everything but the deferred nodes was freed by the last flush,
+  // but a parse can also be abandoned part-way.
+  FreeEvents(&queue_);
+  FreeEvents(&retired_events_);
+  if (delayed_start_literal_ != NULL) {
+    HtmlEvent::Free(delayed_start_literal_, &event_pool_);
+    delayed_start_literal_ = NULL;
+  }
   ClearDeferredNodes();
-  nodes_.DestroyObjects();
+  nodes_.DestroyObjects();  // Frees the attributes of elements still open.
+  event_pool_.Clear();
+  attribute_pool_.Clear();
+  event_links_.Clear();
   DCHECK(!running_filters_);
 }
 
@@ -1119,8 +1230,10 @@ void HtmlParse::FatalErrorHere(const char* msg, ...) {
 
 void HtmlParse::CloseElement(
     HtmlElement* element, HtmlElement::Style style, int line_number) {
-  if (delayed_start_literal_.get() != NULL) {
-    HtmlElement* element = delayed_start_literal_->GetElementIfStartEvent();
+  if (delayed_start_literal_ != NULL) {
+    HtmlEvent* start_event = delayed_start_literal_;
+    delayed_start_literal_ = NULL;
+    HtmlElement* element = start_event->GetElementIfStartEvent();
     DCHECK(element != NULL);
     bool insert_at_begin = true;
     if (!queue_.empty()) {
@@ -1140,8 +1253,7 @@ void HtmlParse::CloseElement(
       if (node != NULL) {
         if (p != queue_.begin()) {
           --p;
-          element->set_begin(
-              queue_.insert(p, delayed_start_literal_.release()));
+          element->set_begin(queue_.insert(p, start_event));
           insert_at_begin = false;
         }
       } else {
@@ -1158,14 +1270,13 @@ void HtmlParse::CloseElement(
       }
     }
     if (insert_at_begin) {
-      queue_.push_front(delayed_start_literal_.release());
+      queue_.push_front(start_event);
       element->set_begin(queue_.begin());
     }
-    DCHECK(delayed_start_literal_.get() == NULL);
   }
 
   HtmlEndElementEvent* end_event =
-      new HtmlEndElementEvent(element, line_number);
+      new (&event_pool_) HtmlEndElementEvent(element, line_number);
   if (element->style() != HtmlElement::INVISIBLE) {
     element->set_style(style);
   }
@@ -1258,7 +1369,8 @@ bool HtmlParse::InsertComment(StringPiece unescaped) {
       return false;
     }
     AddEvent(
-        new HtmlCommentEvent(NewCommentNode(lexer_->Parent(), escaped), 0));
+        new (&event_pool_) HtmlCommentEvent(
+            NewCommentNode(lexer_->Parent(), escaped), 0));
   }
   return true;
 }
@@ -1284,7 +1396,8 @@ void HtmlParse::DeferCurrentNode() {
   //      StartElement event is not in the flush window.  We avoid this
   //      case by requiring that callers run DeferCurentNode from the
   //      StartElement event.
-  HtmlEventList* node_events = new HtmlEventList;
+  HtmlEventList* node_events =
+      new HtmlEventList(HtmlEventListAllocator(&event_links_));
   deferred_nodes_[node] = node_events;
   HtmlEventListIterator node_last = node->end();
   if (node_last != queue_.end()) {
@@ -1370,7 +1483,7 @@ void HtmlParse::ClearDeferredNodes() {
       message_handler_->Message(
           kWarning, "Removed node %s never replaced", node->ToString().c_str());
     }
-    STLDeleteElements(events);
+    FreeEvents(events);
     delete events;
   }
   deferred_nodes_.clear();
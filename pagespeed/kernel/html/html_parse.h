@@ -29,6 +29,7 @@
 
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/arena.h"
+#include "pagespeed/kernel/base/free_list_allocator.h"
 #include "pagespeed/kernel/base/printf_format.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
@@ -439,12 +440,22 @@ class HtmlParse {
   // Run a filter on the current queue of parse nodes.
   void ApplyFilter(HtmlFilter* filter);
 
+  // Runs the enabled filters in the list, in order, on the current queue of
+  // parse nodes.  Consecutive streaming-safe filters (see
+  // HtmlFilter::IsStreamingSafe) share a single pass over the queue.
+  void ApplyFilters(const std::list<HtmlFilter*>& filters);
+
   // Provide timer to helping to report timing of each filter.  You must also
   // set_log_rewrite_timing(true) to turn on this reporting.
   void set_timer(Timer* timer) { timer_ = timer; }
   Timer* timer() const { return timer_; }
   void set_log_rewrite_timing(bool x) { log_rewrite_timing_ = x; }
 
+  // Turns on accounting of the time each pass of filters spends over the
+  // flush windows, which is reported per document to ReportFilterTime.
+  // Requires set_timer.  Off by default.
+  void set_time_filters(bool x) { time_filters_ = x; }
+
   // Adds a filter to be called during parsing as new events are added.
   // Takes ownership of the HtmlFilter passed in.
   void add_event_listener(HtmlFilter* listener);
@@ -465,6 +476,24 @@ class HtmlParse {
   // Returns whether we have exceeded the size limit.
   bool size_limit_exceeded() const;
 
+  // Controls whether runs of streaming-safe filters share a pass over each
+  // flush window.  On by default; turning it off runs every filter in its
+  // own pass, for comparison in tests and benchmarks.
+  void set_fuse_streaming_filters(bool x) { fuse_streaming_filters_ = x; }
+
+  // Returns the number of events, event-list links and attributes (with their
+  // values) allocated for the current document, and the number of heap blocks
+  // those allocations were carved from.  Their storage is recycled at each
+  // flush, and released at FinishParse.  Intended for tests and benchmarks.
+  int64 num_arena_allocations() const {
+    return (event_pool_.num_allocations() + event_links_.num_allocations() +
+            attribute_pool_.num_allocations());
+  }
+  int num_arena_blocks() const {
+    return (event_pool_.num_chunks() + event_links_.num_chunks() +
+            attribute_pool_.num_chunks());
+  }
+
   // For debugging purposes. If this vector is supplied, DetermineEnabledFilters
   // will populate it with the list of Filters that were disabled, plus the
   // associated reason, if supplied by the Filter. Caller retains ownership
@@ -554,7 +583,17 @@ class HtmlParse {
   // calling the base DetermineEnabledFiltersImpl.
   virtual void DetermineEnabledFiltersImpl();
 
+  // If set_time_filters(true) has been called, this is called from
+  // EndFinishParse for each pass of filters that ran on the document, with
+  // the total time in microseconds of the pass over the flush windows.  A
+  // pass is either a single filter, or streaming-safe filters fused into
+  // one pass, whose time is reported for them as a whole since it can't be
+  // told apart.  The default implementation does nothing.
+  virtual void ReportFilterTime(const FilterVector& filters, int64 time_us);
+
  private:
+  typedef std::map<FilterVector, int64> FilterTimeMap;
+
   void ApplyFilterHelper(HtmlFilter* filter);
   HtmlEventListIterator Last();  // Last element in queue
   bool IsInEventWindow(const HtmlEventListIterator& iter) const;
@@ -573,6 +612,9 @@ class HtmlParse {
                   const HtmlEventListIterator& end_inclusive,
                   HtmlElement* new_parent);
   void CoalesceAdjacentCharactersNodes();
+  void PrepareQueueForFilter();
+  void ApplyFilterPass(const FilterVector& filters);
+  void ApplyStreamingFilters(const FilterVector& filters);
   void ClearEvents();
   void EmitQueue(MessageHandler* handler);
   inline void NextEvent();
@@ -581,6 +623,16 @@ class HtmlParse {
   inline bool IsRewritableIgnoringEnd(const HtmlNode* node) const;
   void SetupScript(StringPiece text, bool external, HtmlElement* script);
 
+  // Events are allocated here, by HtmlParse and HtmlLexer.
+  FreeListPool* event_pool() { return &event_pool_; }
+
+  // Removes event from queue_, returning the event after it.  The event is
+  // freed at the next flush, as the filter that removed it may be running it.
+  HtmlEventListIterator RetireEvent(HtmlEventListIterator event);
+
+  // Frees the events in events, and clears it.
+  void FreeEvents(HtmlEventList* events);
+
   // Visible for testing only, via HtmlTestingPeer
   friend class HtmlTestingPeer;
   void AddEvent(HtmlEvent* event);
@@ -602,7 +654,17 @@ class HtmlParse {
   FilterList filters_;
   HtmlLexer* lexer_;
   Arena<HtmlNode> nodes_;
+  // Events, the links of the event lists, and attributes are recycled once
+  // flushed: ClearEvents frees the flushed events, and with them the links
+  // of the queue, and the attributes of the elements that were closed.
+  // Unlike the nodes, whose pointers filters may hold until FinishParse,
+  // only what spans a flush, such as open elements and deferred nodes, is
+  // kept until ClearElements.
+  FreeListPool event_pool_;
+  FreeListPool event_links_;
+  SizeClassPool attribute_pool_;
   HtmlEventList queue_;
+  HtmlEventList retired_events_;  // Removed from queue_ in this flush window.
   HtmlEventListIterator current_;
   // Have we deleted current? Then we shouldn't do certain manipulations to it.
   MessageHandler* message_handler_;
@@ -615,13 +677,16 @@ class HtmlParse {
   bool need_sanity_check_;
   bool coalesce_characters_;
   bool need_coalesce_characters_;
+  bool fuse_streaming_filters_;
   bool url_valid_;
   bool log_rewrite_timing_;  // Should we time the speed of parsing?
+  bool time_filters_;
   bool running_filters_;
   int64 parse_start_time_us_;
-  scoped_ptr<HtmlEvent> delayed_start_literal_;
+  HtmlEvent* delayed_start_literal_;
   Timer* timer_;
   HtmlFilter* current_filter_;      // Filter currently running in ApplyFilter
+  FilterTimeMap filter_time_us_;    // Time of each pass, per document.
 
   // When deferring a node that spans a flush window, we present upstream
   // filters with a view of the event-stream that is not impacted by the
@@ -23,6 +23,19 @@
 // BM_ParseAndSerializeNewParserEachIter     433780     433690       1591
 // BM_ParseAndSerializeReuseParser           433498     436118       1628
 // BM_ParseAndSerializeReuseParserX50      22954185   22900000        100
+//
+// The BM_Scan* benchmarks time the HtmlByteScanner that HtmlLexer uses to
+// skip runs of text, comments, attribute values and script bodies, using
+// the best implementation for the CPU; BM_ScanTextPortable is the
+// table-driven baseline for comparison.
+//
+// BM_StreamingFiltersFused and BM_StreamingFiltersUnfused compare running
+// a chain of streaming-safe filters in one pass per flush window against
+// one pass per filter.
+//
+// BM_ParseAndSerializeReuseParser also logs how many events, event-list
+// links and attributes one document needs, and how many heap blocks the
+// parser's pools carved them from.
 
 #include "pagespeed/kernel/html/html_parse.h"
 
@@ -38,6 +51,11 @@
 #include "pagespeed/kernel/base/stdio_file_system.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/html/canonical_attributes.h"
+#include "pagespeed/kernel/html/collapse_whitespace_filter.h"
+#include "pagespeed/kernel/html/elide_attributes_filter.h"
+#include "pagespeed/kernel/html/html_attribute_quote_removal.h"
+#include "pagespeed/kernel/html/html_byte_scanner.h"
 #include "pagespeed/kernel/html/html_writer_filter.h"
 
 namespace net_instaweb {
@@ -86,6 +104,18 @@ const StringPiece GetHtmlText() {
   return *sHtmlText;
 }
 
+// Parses text once more and logs the parser's arena usage, which is only
+// observable until FinishParse releases it.
+void LogArenaUsage(StringPiece text, HtmlParse* parser) {
+  parser->StartParse("http://example.com/benchmark");
+  parser->ParseText(text);
+  parser->Flush();
+  LOG(INFO) << "Parsing " << text.size() << " bytes made "
+            << parser->num_arena_allocations() << " arena allocations from "
+            << parser->num_arena_blocks() << " heap blocks";
+  parser->FinishParse();
+}
+
 static void BM_ParseAndSerializeNewParserEachIter(int iters) {
   StopBenchmarkTiming();
   StringPiece text = GetHtmlText();
@@ -105,6 +135,7 @@ static void BM_ParseAndSerializeNewParserEachIter(int iters) {
     parser.ParseText(text);
     parser.FinishParse();
   }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
 }
 BENCHMARK(BM_ParseAndSerializeNewParserEachIter);
 
@@ -128,6 +159,9 @@ static void BM_ParseAndSerializeReuseParser(int iters) {
     parser.ParseText(text);
     parser.FinishParse();
   }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
+  StopBenchmarkTiming();
+  LogArenaUsage(text, &parser);
 }
 BENCHMARK(BM_ParseAndSerializeReuseParser);
 
@@ -157,9 +191,140 @@ static void BM_ParseAndSerializeReuseParserX50(int iters) {
     parser.ParseText(text);
     parser.FinishParse();
   }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
 }
 BENCHMARK(BM_ParseAndSerializeReuseParserX50);
 
+// Parses a document made mostly of long runs the lexer can skip in bulk:
+// inline scripts, data: URLs in attribute values, and comments.
+static void BM_ParseAndSerializeLongRuns(int iters) {
+  StopBenchmarkTiming();
+  GoogleString script;
+  for (int i = 0; i < 1000; ++i) {
+    StrAppend(&script, "  var x", IntegerToString(i), " = x + 1;\n");
+  }
+  GoogleString text("<html><body>\n");
+  for (int i = 0; i < 20; ++i) {
+    StrAppend(&text, "<script>\n", script, "</script>\n");
+    StrAppend(&text, "<img src=\"data:image/png;base64,",
+              GoogleString(20000, 'A'), "\">\n");
+    StrAppend(&text, "<!-- ", GoogleString(5000, 'c'), " -->\n");
+  }
+  StrAppend(&text, "</body></html>\n");
+
+  NullWriter writer;
+  NullMessageHandler handler;
+  HtmlParse parser(&handler);
+  HtmlWriterFilter writer_filter(&parser);
+  parser.AddFilter(&writer_filter);
+  writer_filter.set_writer(&writer);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    parser.StartParse("http://example.com/benchmark");
+    parser.ParseText(text);
+    parser.FinishParse();
+  }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
+}
+BENCHMARK(BM_ParseAndSerializeLongRuns);
+
+// Runs the streaming-safe kernel filters and the writer over the testdata,
+// flushing every 4k like a server streaming a response.  The filters either
+// share a single pass over each flush window, or each get their own.
+static void ParseWithStreamingFilters(int iters, bool fuse) {
+  StopBenchmarkTiming();
+  StringPiece text = GetHtmlText();
+  if (text.empty()) {
+    return;
+  }
+  static const int kFlushWindowBytes = 4096;
+
+  NullWriter writer;
+  NullMessageHandler handler;
+  HtmlParse parser(&handler);
+  parser.set_fuse_streaming_filters(fuse);
+  CanonicalAttributes canonical_attributes(&parser);
+  CollapseWhitespaceFilter collapse_whitespace(&parser);
+  ElideAttributesFilter elide_attributes(&parser);
+  HtmlAttributeQuoteRemoval quote_removal(&parser);
+  HtmlWriterFilter writer_filter(&parser);
+  parser.AddFilter(&canonical_attributes);
+  parser.AddFilter(&collapse_whitespace);
+  parser.AddFilter(&elide_attributes);
+  parser.AddFilter(&quote_removal);
+  parser.AddFilter(&writer_filter);
+  writer_filter.set_writer(&writer);
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    parser.StartParse("http://example.com/benchmark");
+    for (int pos = 0, n = text.size(); pos < n; pos += kFlushWindowBytes) {
+      parser.ParseText(text.substr(pos, kFlushWindowBytes));
+      parser.Flush();
+    }
+    parser.FinishParse();
+  }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
+}
+
+static void BM_StreamingFiltersFused(int iters) {
+  ParseWithStreamingFilters(iters, true);
+}
+BENCHMARK(BM_StreamingFiltersFused);
+
+static void BM_StreamingFiltersUnfused(int iters) {
+  ParseWithStreamingFilters(iters, false);
+}
+BENCHMARK(BM_StreamingFiltersUnfused);
+
+// Scans the testdata for the given bytes, stepping over each match, the
+// way the lexer does in the corresponding state.
+static void ScanHtmlText(int iters, StringPiece bytes,
+                         HtmlByteScanner::Implementation implementation) {
+  StopBenchmarkTiming();
+  StringPiece text = GetHtmlText();
+  if (text.empty()) {
+    return;
+  }
+  HtmlByteScanner scanner(bytes, implementation);
+  int newlines = 0;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    for (int pos = 0, n = text.size(); pos < n; ++pos) {
+      pos += scanner.Scan(text.data() + pos, n - pos, &newlines);
+    }
+  }
+  SetBenchmarkBytesProcessed(static_cast<int64>(iters) * text.size());
+  CHECK_LT(0, newlines);
+}
+
+static void BM_ScanTextPortable(int iters) {
+  ScanHtmlText(iters, "<", HtmlByteScanner::kPortable);
+}
+BENCHMARK(BM_ScanTextPortable);
+
+static void BM_ScanText(int iters) {
+  ScanHtmlText(iters, "<", HtmlByteScanner::BestImplementation());
+}
+BENCHMARK(BM_ScanText);
+
+static void BM_ScanComment(int iters) {
+  ScanHtmlText(iters, "-", HtmlByteScanner::BestImplementation());
+}
+BENCHMARK(BM_ScanComment);
+
+static void BM_ScanAttrValue(int iters) {
+  ScanHtmlText(iters, "\"", HtmlByteScanner::BestImplementation());
+}
+BENCHMARK(BM_ScanAttrValue);
+
+static void BM_ScanScript(int iters) {
+  ScanHtmlText(iters, "<-", HtmlByteScanner::BestImplementation());
+}
+BENCHMARK(BM_ScanScript);
+
 }  // namespace
 
 }  // namespace net_instaweb
@@ -19,6 +19,7 @@
 // Unit-test the html reader/writer to ensure that a few tricky
 // constructs come through without corruption.
 
+#include <map>
 #include <vector>
 
 #include "pagespeed/kernel/base/basictypes.h"
@@ -26,13 +27,18 @@
 #include "pagespeed/kernel/base/gmock.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/null_mutex.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/string_writer.h"
+#include "pagespeed/kernel/html/collapse_whitespace_filter.h"
 #include "pagespeed/kernel/html/disable_test_filter.h"
+#include "pagespeed/kernel/html/elide_attributes_filter.h"
 #include "pagespeed/kernel/html/empty_html_filter.h"
 #include "pagespeed/kernel/html/explicit_close_tag.h"
+#include "pagespeed/kernel/html/html_attribute_quote_removal.h"
 #include "pagespeed/kernel/html/html_element.h"
 #include "pagespeed/kernel/html/html_event.h"
 #include "pagespeed/kernel/html/html_filter.h"
@@ -492,6 +498,65 @@ TEST_F(HtmlParseTest, BogusComment) {
   ValidateNoChanges("bad break", "</\na>");
 }
 
+// The lexer skips over long runs of text, comments, quoted attribute values
+// and script bodies in bulk.  Make sure that gives the same results
+// wherever the input is split.
+TEST_F(HtmlParseTest, LongRunsSplitAnywhere) {
+  SetupWriter();
+  GoogleString input = StrCat(
+      "<div title=\"", GoogleString(40, 'a'), "'", GoogleString(40, 'b'),
+      "\" alt='", GoogleString(40, 'c'), "\"", GoogleString(40, 'd'), "'>");
+  StrAppend(&input, GoogleString(100, 'e'), "&amp;", GoogleString(40, 'f'));
+  StrAppend(&input, "<!--", GoogleString(50, 'g'), "-", GoogleString(50, 'h'),
+            "--", GoogleString(50, 'i'), "-->");
+  StrAppend(&input, "<![CDATA[", GoogleString(50, 'j'), "]",
+            GoogleString(50, 'k'), "]]></div>");
+  StrAppend(&input, "<script>", GoogleString(50, 'l'), "<!--<script>",
+            GoogleString(50, 'm'), "</script>", GoogleString(50, 'n'),
+            "--></script>");
+  StrAppend(&input, "<textarea>", GoogleString(50, 'o'), "</b>",
+            GoogleString(50, 'p'), "</textarea>");
+  for (int i = 0, n = input.size(); i < n; ++i) {
+    ParseWithFlush(input, i);
+    EXPECT_STREQ(input, output_buffer_) << " flush " << i;
+  }
+}
+
+namespace {
+
+// Records the line on which each element starts.
+class ElementLinesFilter : public EmptyHtmlFilter {
+ public:
+  ElementLinesFilter() {}
+
+  virtual void StartDocument() { lines_.clear(); }
+  virtual void StartElement(HtmlElement* element) {
+    StrAppend(&lines_, element->name_str(), ":",
+              IntegerToString(element->begin_line_number()), " ");
+  }
+  virtual const char* Name() const { return "ElementLines"; }
+
+  const GoogleString& lines() const { return lines_; }
+
+ private:
+  GoogleString lines_;
+
+  DISALLOW_COPY_AND_ASSIGN(ElementLinesFilter);
+};
+
+}  // namespace
+
+TEST_F(HtmlParseTest, LineNumbersAfterLongRuns) {
+  ElementLinesFilter lines_filter;
+  html_parse()->AddFilter(&lines_filter);
+  const GoogleString kInput = StrCat(
+      "<a>\n", GoogleString(100, 'x'), "\n\n<b><!--\n---\n-->",
+      "<c x=\"\n", GoogleString(80, 'y'), "\"><script>\n<!--\n",
+      GoogleString(70, 'z'), "\n</script><d>");
+  Parse("line_numbers", kInput);
+  EXPECT_EQ("html:1 body:1 a:2 b:5 c:7 script:8 d:11 ", lines_filter.lines());
+}
+
 namespace {
 
 class AnnotatingHtmlFilter : public EmptyHtmlFilter {
@@ -1026,6 +1091,34 @@ TEST_F(HtmlAnnotationTest, FlushDoesNotBreakCharacterBlock) {
       annotation());
 }
 
+// The events, event-list links and attributes of a flush window are
+// recycled for the next one, so a long document parsed in many windows needs
+// no more storage than the first few.
+TEST_F(HtmlParseTest, FlushRecyclesStorage) {
+  static const char kChunk[] =
+      "<div class=a id=b><a href='x.html' title=\"&amp;t\">link</a>text"
+      "<!--c--><img src=y.png alt='a much longer attribute value'></div>\n";
+  html_parse_.StartParse("http://test.com/recycle.html");
+  html_parse_.ParseText("<html><body class=open>");
+  for (int i = 0; i < 3; ++i) {
+    html_parse_.ParseText(kChunk);
+    html_parse_.Flush();
+  }
+  int num_blocks = html_parse_.num_arena_blocks();
+  int64 num_allocations = html_parse_.num_arena_allocations();
+  for (int i = 0; i < 100; ++i) {
+    html_parse_.ParseText(kChunk);
+    html_parse_.Flush();
+  }
+  EXPECT_EQ(num_blocks, html_parse_.num_arena_blocks());
+  EXPECT_LT(num_allocations, html_parse_.num_arena_allocations());
+  html_parse_.ParseText("</body></html>");
+  html_parse_.FinishParse();
+
+  // Everything was returned by the end of the document.
+  EXPECT_EQ(0, html_parse_.num_arena_blocks());
+}
+
 TEST_F(HtmlAnnotationTest, FlushDoesNotBreakScriptTag) {
   annotation_.set_annotate_flush(true);
   html_parse_.StartParse("http://test.com/blank_flush.html");
@@ -1414,8 +1507,7 @@ class EventListManipulationTest : public HtmlParseTest {
     static const char kUrl[] = "http://html.parse.test/event_list_test.html";
     ASSERT_TRUE(html_parse_.StartParse(kUrl));
     node1_ = html_parse_.NewCharactersNode(NULL, "1");
-    HtmlTestingPeer::AddEvent(&html_parse_,
-                              new HtmlCharactersEvent(node1_, -1));
+    HtmlTestingPeer::AddCharactersEvent(&html_parse_, node1_);
     node2_ = html_parse_.NewCharactersNode(NULL, "2");
     node3_ = html_parse_.NewCharactersNode(NULL, "3");
     // Note: the last 2 are not added in SetUp.
@@ -1488,8 +1580,8 @@ TEST_F(EventListManipulationTest, TestDeleteOnly) {
 
 TEST_F(EventListManipulationTest, TestDeleteFirst) {
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   html_parse_.DeleteNode(node1_);
   CheckExpected("23");
   html_parse_.DeleteNode(node2_);
@@ -1500,8 +1592,8 @@ TEST_F(EventListManipulationTest, TestDeleteFirst) {
 
 TEST_F(EventListManipulationTest, TestDeleteLast) {
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   html_parse_.DeleteNode(node3_);
   CheckExpected("12");
   html_parse_.DeleteNode(node2_);
@@ -1512,8 +1604,8 @@ TEST_F(EventListManipulationTest, TestDeleteLast) {
 
 TEST_F(EventListManipulationTest, TestDeleteMiddle) {
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   html_parse_.DeleteNode(node2_);
   CheckExpected("13");
 }
@@ -1524,8 +1616,8 @@ TEST_F(EventListManipulationTest, TestDeleteMiddle) {
 // parent-pointer check.
 TEST_F(EventListManipulationTest, TestAddParentToSequence) {
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node3_, div));
   CheckExpected("<div>123</div>");
@@ -1572,17 +1664,17 @@ TEST_F(EventListManipulationTest, TestAppendChild) {
 
 TEST_F(EventListManipulationTest, TestAddParentToSequenceDifferentParents) {
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node2_, div));
   CheckExpected("<div>12</div>");
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   CheckExpected("<div>12</div>3");
   EXPECT_FALSE(html_parse_.AddParentToSequence(node2_, node3_, div));
 }
 
 TEST_F(EventListManipulationTest, TestDeleteGroup) {
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node2_, div));
   CheckExpected("<div>12</div>");
@@ -1594,11 +1686,11 @@ TEST_F(EventListManipulationTest, TestMoveElementIntoParent1) {
   HtmlElement* head = html_parse_.NewElement(NULL, HtmlName::kHead);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node1_, head));
   CheckExpected("<head>1</head>");
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node2_, node2_, div));
   CheckExpected("<head>1</head><div>2</div>");
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   CheckExpected("<head>1</head><div>2</div>3");
   HtmlTestingPeer::SetCurrent(&html_parse_, div);
   EXPECT_TRUE(html_parse_.MoveCurrentInto(head));
@@ -1610,8 +1702,8 @@ TEST_F(EventListManipulationTest, TestMoveElementIntoParent2) {
   HtmlElement* head = html_parse_.NewElement(NULL, HtmlName::kHead);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node1_, head));
   CheckExpected("<head>1</head>");
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   CheckExpected("<head>1</head>23");
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node3_, node3_, div));
@@ -1637,10 +1729,10 @@ TEST_F(EventListManipulationTest, TestDeleteSavingChildrenEnd) {
 TEST_F(EventListManipulationTest, TestMoveCurrentBefore) {
   // Setup events.
   HtmlTestingPeer::set_coalesce_characters(&html_parse_, false);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   EXPECT_TRUE(html_parse_.AddParentToSequence(node1_, node2_, div));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   CheckExpected("<div>12</div>3");
   HtmlTestingPeer::SetCurrent(&html_parse_, node3_);
 
@@ -1668,7 +1760,7 @@ TEST_F(EventListManipulationTest, TestMoveCurrentBefore) {
 
 TEST_F(EventListManipulationTest, TestCoalesceOnAdd) {
   CheckExpected("1");
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   CheckExpected("12");
 
   // this will coalesce node1 and node2 togethers.  So there is only
@@ -1682,11 +1774,11 @@ TEST_F(EventListManipulationTest, TestCoalesceOnDelete) {
   CheckExpected("1");
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   html_parse_.AddElement(div, -1);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlTestingPeer testing_peer;
   testing_peer.SetNodeParent(node2_, div);
   html_parse_.CloseElement(div, HtmlElement::EXPLICIT_CLOSE, -1);
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node3_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node3_);
   CheckExpected("1<div>2</div>3");
 
   // Removing the div, leaving the children intact...
@@ -1704,7 +1796,7 @@ TEST_F(EventListManipulationTest, TestHasChildren) {
   HtmlElement* div = html_parse_.NewElement(NULL, HtmlName::kDiv);
   html_parse_.AddElement(div, -1);
   EXPECT_FALSE(html_parse_.HasChildrenInFlushWindow(div));
-  HtmlTestingPeer::AddEvent(&html_parse_, new HtmlCharactersEvent(node2_, -1));
+  HtmlTestingPeer::AddCharactersEvent(&html_parse_, node2_);
   HtmlTestingPeer testing_peer;
   testing_peer.SetNodeParent(node2_, div);
 
@@ -3160,4 +3252,237 @@ TEST_F(HtmlParseTestNoBody, InsertExternalScriptAfterEndOfHead) {
                    "<head>text</head><script src=\"inserted\"></script>");
 }
 
+// Logs the events it sees, tagged with its name, into a log shared with
+// other filters, so tests can see the order the filters ran in.
+class EventLogFilter : public EmptyHtmlFilter {
+ public:
+  EventLogFilter(const char* name, bool streaming_safe, GoogleString* log)
+      : name_(name), streaming_safe_(streaming_safe), log_(log) {}
+
+  virtual void StartElement(HtmlElement* element) {
+    Log("<", element->name_str());
+  }
+  virtual void EndElement(HtmlElement* element) {
+    Log("/", element->name_str());
+  }
+  virtual void Characters(HtmlCharactersNode* characters) {
+    Log("'", characters->contents());
+  }
+  virtual void Flush() { Log("F", ""); }
+  virtual bool IsStreamingSafe() const { return streaming_safe_; }
+  virtual const char* Name() const { return name_; }
+
+ private:
+  void Log(StringPiece type, StringPiece text) {
+    StrAppend(log_, name_, type, text, " ");
+  }
+
+  const char* name_;
+  bool streaming_safe_;
+  GoogleString* log_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventLogFilter);
+};
+
+class StreamingFilterTest : public HtmlParseTestNoBodyNoHtml {
+ protected:
+  StreamingFilterTest()
+      : a_("a", true, &log_),
+        b_("b", true, &log_),
+        c_("c", false, &log_) {
+  }
+
+  GoogleString log_;
+  EventLogFilter a_;
+  EventLogFilter b_;
+  EventLogFilter c_;
+};
+
+TEST_F(StreamingFilterTest, FusesStreamingFilters) {
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  ValidateNoChanges("fused", "<div>x</div>");
+  EXPECT_EQ("a<div b<div a'x b'x a/div b/div aF bF ", log_);
+}
+
+TEST_F(StreamingFilterTest, NonStreamingFilterSplitsPass) {
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&c_);
+  html_parse_.AddFilter(&b_);
+  ValidateNoChanges("split", "<div>x</div>");
+  EXPECT_EQ("a<div a'x a/div aF "
+            "c<div c'x c/div cF "
+            "b<div b'x b/div bF ", log_);
+}
+
+TEST_F(StreamingFilterTest, DisabledFiltersAreSkipped) {
+  DisableTestFilter disabled("disabled", false, "");
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&disabled);
+  html_parse_.AddFilter(&b_);
+  ValidateNoChanges("disabled", "<div>x</div>");
+  EXPECT_EQ("a<div b<div a'x b'x a/div b/div aF bF ", log_);
+}
+
+TEST_F(StreamingFilterTest, FusionOff) {
+  html_parse_.set_fuse_streaming_filters(false);
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  ValidateNoChanges("fusion_off", "<div>x</div>");
+  EXPECT_EQ("a<div a'x a/div aF b<div b'x b/div bF ", log_);
+}
+
+TEST_F(StreamingFilterTest, EachFlushWindowIsFused) {
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  SetupWriter();
+  html_parse_.StartParse("http://test.com/flush.html");
+  html_parse_.ParseText("<div>x");
+  html_parse_.Flush();
+  html_parse_.ParseText("</div>");
+  html_parse_.FinishParse();
+  EXPECT_EQ("<div>x</div>", output_buffer_);
+  // Trailing characters are held for the next flush window, in case more
+  // follow.
+  EXPECT_EQ("a<div b<div aF bF a'x b'x a/div b/div aF bF ", log_);
+}
+
+// The streaming-safe kernel filters produce the same output whether or not
+// they share a pass.
+TEST_F(StreamingFilterTest, SameOutputWithFusionOff) {
+  CollapseWhitespaceFilter collapse_whitespace(&html_parse_);
+  ElideAttributesFilter elide_attributes(&html_parse_);
+  HtmlAttributeQuoteRemoval quote_removal(&html_parse_);
+  html_parse_.AddFilter(&collapse_whitespace);
+  html_parse_.AddFilter(&elide_attributes);
+  html_parse_.AddFilter(&quote_removal);
+  static const char kInput[] =
+      "<form method=\"get\">\n  <input type=\"text\" disabled=\"disabled\">"
+      "</form>\n\n<pre>  a  </pre>   <b class=\"x y\">  b  </b>";
+  static const char kExpected[] =
+      "<form>\n<input type=text disabled>"
+      "</form>\n<pre>  a  </pre> <b class=\"x y\"> b </b>";
+  ValidateExpected("fused", kInput, kExpected);
+  html_parse_.set_fuse_streaming_filters(false);
+  ValidateExpected("unfused", kInput, kExpected);
+}
+
+// Costs a fixed amount of mock time per element.
+class SlowFilter : public EmptyHtmlFilter {
+ public:
+  SlowFilter(const char* name, bool streaming_safe, int64 cost_us,
+             MockTimer* timer)
+      : name_(name), streaming_safe_(streaming_safe), cost_us_(cost_us),
+        timer_(timer) {}
+
+  virtual void StartElement(HtmlElement* element) {
+    timer_->AdvanceUs(cost_us_);
+  }
+  virtual bool IsStreamingSafe() const { return streaming_safe_; }
+  virtual const char* Name() const { return name_; }
+
+ private:
+  const char* name_;
+  bool streaming_safe_;
+  int64 cost_us_;
+  MockTimer* timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlowFilter);
+};
+
+// Collects the filter times reported at the end of each document, keyed by
+// the names of the filters in each pass, joined by "+".
+class TimedHtmlParse : public HtmlParse {
+ public:
+  explicit TimedHtmlParse(MessageHandler* handler) : HtmlParse(handler) {}
+
+  std::map<GoogleString, int64>* reports() { return &reports_; }
+
+ protected:
+  virtual void ReportFilterTime(const FilterVector& filters, int64 time_us) {
+    GoogleString pass;
+    for (int i = 0, n = filters.size(); i < n; ++i) {
+      StrAppend(&pass, (i == 0) ? "" : "+", filters[i]->Name());
+    }
+    EXPECT_EQ(0, reports_.count(pass)) << pass;
+    reports_[pass] = time_us;
+  }
+
+ private:
+  std::map<GoogleString, int64> reports_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimedHtmlParse);
+};
+
+class FilterTimingTest : public testing::Test {
+ protected:
+  FilterTimingTest()
+      : handler_(new NullMutex),
+        timer_(new NullMutex, MockTimer::kApr_5_2010_ms),
+        html_parse_(&handler_),
+        a_("a", true, 10, &timer_),
+        b_("b", true, 30, &timer_),
+        c_("c", false, 100, &timer_) {
+    html_parse_.set_timer(&timer_);
+  }
+
+  void Parse(StringPiece html) {
+    html_parse_.reports()->clear();
+    html_parse_.StartParse("http://test.com/timing.html");
+    html_parse_.ParseText(html);
+    html_parse_.Flush();
+    html_parse_.ParseText(html);
+    html_parse_.FinishParse();
+  }
+
+  int64 Report(const char* name) {
+    std::map<GoogleString, int64>::const_iterator p =
+        html_parse_.reports()->find(name);
+    return (p == html_parse_.reports()->end()) ? -1 : p->second;
+  }
+
+  MockMessageHandler handler_;
+  MockTimer timer_;
+  TimedHtmlParse html_parse_;
+  SlowFilter a_;
+  SlowFilter b_;
+  SlowFilter c_;
+};
+
+TEST_F(FilterTimingTest, OffByDefault) {
+  html_parse_.AddFilter(&c_);
+  Parse("<div></div>");
+  EXPECT_TRUE(html_parse_.reports()->empty());
+}
+
+TEST_F(FilterTimingTest, TimeAccumulatesOverFlushWindows) {
+  html_parse_.set_time_filters(true);
+  html_parse_.AddFilter(&c_);
+  Parse("<div></div><p>");
+  EXPECT_EQ(400, Report("c"));
+  EXPECT_EQ(1U, html_parse_.reports()->size());
+
+  // Each document is reported separately.
+  Parse("<div></div>");
+  EXPECT_EQ(200, Report("c"));
+}
+
+TEST_F(FilterTimingTest, FusedPassIsReportedAsOneUnit) {
+  html_parse_.set_time_filters(true);
+  html_parse_.AddFilter(&a_);
+  html_parse_.AddFilter(&b_);
+  html_parse_.AddFilter(&c_);
+  Parse("<div></div>");
+  EXPECT_EQ(80, Report("a+b"));
+  EXPECT_EQ(200, Report("c"));
+  EXPECT_EQ(2U, html_parse_.reports()->size());
+
+  html_parse_.set_fuse_streaming_filters(false);
+  Parse("<div></div>");
+  EXPECT_EQ(20, Report("a"));
+  EXPECT_EQ(60, Report("b"));
+  EXPECT_EQ(200, Report("c"));
+  EXPECT_EQ(3U, html_parse_.reports()->size());
+}
+
 }  // namespace net_instaweb
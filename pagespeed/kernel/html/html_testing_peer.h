@@ -22,13 +22,13 @@
 #include <cstddef>
 
 #include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/html/html_event.h"
 #include "pagespeed/kernel/html/html_node.h"
 #include "pagespeed/kernel/html/html_parse.h"
 
 namespace net_instaweb {
 
 class HtmlElement;
-class HtmlEvent;
 
 class HtmlTestingPeer {
  public:
@@ -40,6 +40,12 @@ class HtmlTestingPeer {
   static void AddEvent(HtmlParse* parser, HtmlEvent* event) {
     parser->AddEvent(event);
   }
+  // Adds a synthetic (line -1) Characters event for node, allocated in
+  // the parser's event pool.
+  static void AddCharactersEvent(HtmlParse* parser, HtmlCharactersNode* node) {
+    parser->AddEvent(
+        new (parser->event_pool()) HtmlCharactersEvent(node, -1));
+  }
   static void SetCurrent(HtmlParse* parser, HtmlNode* node) {
     parser->SetCurrent(node);
   }
@@ -55,6 +55,7 @@ class HtmlWriterFilter : public HtmlFilter {
   virtual void Directive(HtmlDirectiveNode* directive);
   virtual void Flush();
   virtual void DetermineEnabled(GoogleString* disabled_reason);
+  virtual bool IsStreamingSafe() const { return true; }
 
   void set_max_column(int max_column) { max_column_ = max_column; }
   void set_case_fold(bool case_fold) { case_fold_ = case_fold; }
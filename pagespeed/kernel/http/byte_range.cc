@@ -0,0 +1,174 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/http/byte_range.h"
+
+#include <algorithm>
+
+#include "pagespeed/kernel/http/http_names.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kBytesPrefix[] = "bytes=";
+
+// Parses a non-empty string of decimal digits.  Values too large for an
+// int64 saturate, as they're still well-formed positions past the end of
+// any body we could hold.
+bool ParseBytePosition(StringPiece str, int64* value) {
+  if (str.empty()) {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0, n = str.size(); i < n; ++i) {
+    char c = str[i];
+    if ((c < '0') || (c > '9')) {
+      return false;
+    }
+    if (*value > (kint64max - 9) / 10) {
+      *value = kint64max;
+    } else {
+      *value = (*value * 10) + (c - '0');
+    }
+  }
+  return true;
+}
+
+bool LessByFirst(const ByteRange& a, const ByteRange& b) {
+  return a.first < b.first;
+}
+
+// If any of ranges overlap or abut, replaces them with the sorted union.
+void MergeByteRanges(ByteRangeVector* ranges) {
+  ByteRangeVector sorted(*ranges);
+  std::sort(sorted.begin(), sorted.end(), LessByFirst);
+  ByteRangeVector merged;
+  for (int i = 0, n = sorted.size(); i < n; ++i) {
+    if (!merged.empty() && (sorted[i].first <= merged.back().last + 1)) {
+      merged.back().last = std::max(merged.back().last, sorted[i].last);
+    } else {
+      merged.push_back(sorted[i]);
+    }
+  }
+  if (merged.size() != ranges->size()) {
+    ranges->swap(merged);
+  }
+}
+
+}  // namespace
+
+ByteRangeStatus ParseByteRanges(StringPiece header, int64 content_length,
+                                ByteRangeVector* ranges) {
+  ranges->clear();
+  TrimWhitespace(&header);
+  if (!StringCaseStartsWith(header, kBytesPrefix)) {
+    return kByteRangeIgnored;
+  }
+  header.remove_prefix(STATIC_STRLEN(kBytesPrefix));
+  StringPieceVector specs;
+  SplitStringPieceToVector(header, ",", &specs, true);
+  if (specs.empty() || (static_cast<int>(specs.size()) > kMaxByteRanges)) {
+    return kByteRangeIgnored;
+  }
+
+  // A single malformed spec makes the whole header invalid, so parse them
+  // all before deciding anything.
+  int num_specs = 0;
+  for (int i = 0, n = specs.size(); i < n; ++i) {
+    StringPiece spec = specs[i];
+    TrimWhitespace(&spec);
+    stringpiece_ssize_type dash = spec.find('-');
+    if (dash == StringPiece::npos) {
+      if (spec.empty()) {
+        continue;  // Empty list elements are allowed.
+      }
+      ranges->clear();
+      return kByteRangeIgnored;
+    }
+    ++num_specs;
+    StringPiece first_str = spec.substr(0, dash);
+    StringPiece last_str = spec.substr(dash + 1);
+    TrimWhitespace(&first_str);
+    TrimWhitespace(&last_str);
+    int64 first, last;
+    if (first_str.empty()) {
+      // "-n" asks for the last n bytes.
+      if (!ParseBytePosition(last_str, &last)) {
+        ranges->clear();
+        return kByteRangeIgnored;
+      }
+      if ((last > 0) && (content_length > 0)) {
+        ranges->push_back(ByteRange(std::max(content_length - last,
+                                             static_cast<int64>(0)),
+                                    content_length - 1));
+      }
+    } else {
+      if (!ParseBytePosition(first_str, &first)) {
+        ranges->clear();
+        return kByteRangeIgnored;
+      }
+      if (last_str.empty()) {
+        last = kint64max;
+      } else if (!ParseBytePosition(last_str, &last) || (last < first)) {
+        ranges->clear();
+        return kByteRangeIgnored;
+      }
+      if (first < content_length) {
+        ranges->push_back(ByteRange(first, std::min(last,
+                                                     content_length - 1)));
+      }
+    }
+  }
+
+  if (num_specs == 0) {
+    return kByteRangeIgnored;
+  } else if (ranges->empty()) {
+    return kByteRangeNotSatisfiable;
+  }
+  MergeByteRanges(ranges);
+  return kByteRangeSatisfiable;
+}
+
+GoogleString ContentRangeValue(const ByteRange& range, int64 content_length) {
+  return StrCat("bytes ", Integer64ToString(range.first), "-",
+                Integer64ToString(range.last), "/",
+                Integer64ToString(content_length));
+}
+
+GoogleString UnsatisfiedContentRangeValue(int64 content_length) {
+  return StrCat("bytes */", Integer64ToString(content_length));
+}
+
+GoogleString MultipartByteRangeHeader(StringPiece boundary,
+                                      StringPiece content_type,
+                                      const ByteRange& range,
+                                      int64 content_length) {
+  GoogleString header = StrCat("\r\n--", boundary, "\r\n");
+  if (!content_type.empty()) {
+    StrAppend(&header, HttpAttributes::kContentType, ": ", content_type,
+              "\r\n");
+  }
+  StrAppend(&header, HttpAttributes::kContentRange, ": ",
+            ContentRangeValue(range, content_length), "\r\n\r\n");
+  return header;
+}
+
+GoogleString MultipartByteRangesTrailer(StringPiece boundary) {
+  return StrCat("\r\n--", boundary, "--\r\n");
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parsing of Range request headers, and formatting of the headers that go
+// with the partial responses to them (RFC 7233).
+
+#ifndef PAGESPEED_KERNEL_HTTP_BYTE_RANGE_H_
+#define PAGESPEED_KERNEL_HTTP_BYTE_RANGE_H_
+
+#include <vector>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+// An inclusive range of byte offsets within a response body.
+struct ByteRange {
+  ByteRange() : first(0), last(-1) {}
+  ByteRange(int64 first_byte, int64 last_byte)
+      : first(first_byte), last(last_byte) {}
+
+  int64 size() const { return last - first + 1; }
+
+  int64 first;
+  int64 last;
+};
+
+typedef std::vector<ByteRange> ByteRangeVector;
+
+enum ByteRangeStatus {
+  // The header is malformed, not in bytes, or asks for too many ranges; the
+  // whole body should be served as if there were no Range header.
+  kByteRangeIgnored,
+  // At least one range overlaps the body; serve a 206.
+  kByteRangeSatisfiable,
+  // No range overlaps the body; serve a 416.
+  kByteRangeNotSatisfiable,
+};
+
+// Requests asking for more ranges than this are served the whole body, as
+// many small ranges cost more to serve than they save.
+const int kMaxByteRanges = 16;
+
+// Parses the value of a Range header against a body of content_length
+// bytes.  On kByteRangeSatisfiable, fills ranges with the satisfiable
+// ranges, clamped to the body.  Ranges that overlap or abut are merged, in
+// which case the result is sorted by offset; otherwise they are left in
+// the order requested.
+ByteRangeStatus ParseByteRanges(StringPiece header, int64 content_length,
+                                ByteRangeVector* ranges);
+
+// Value of the Content-Range header for range of a body of content_length
+// bytes, e.g. "bytes 0-499/1234".
+GoogleString ContentRangeValue(const ByteRange& range, int64 content_length);
+
+// Value of the Content-Range header of a 416 response, e.g. "bytes */1234".
+GoogleString UnsatisfiedContentRangeValue(int64 content_length);
+
+// Part headers that precede range in a multipart/byteranges body, starting
+// with the CRLF and delimiter line.  The body ends with
+// MultipartByteRangesTrailer.
+GoogleString MultipartByteRangeHeader(StringPiece boundary,
+                                      StringPiece content_type,
+                                      const ByteRange& range,
+                                      int64 content_length);
+GoogleString MultipartByteRangesTrailer(StringPiece boundary);
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_HTTP_BYTE_RANGE_H_
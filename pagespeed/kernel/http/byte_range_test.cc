@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/http/byte_range.h"
+
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const int64 kLength = 1000;
+
+class ByteRangeTest : public testing::Test {
+ protected:
+  // Returns the ranges parsed from header as "first-last,...", or the
+  // status if they aren't satisfiable.
+  GoogleString Parse(StringPiece header, int64 content_length) {
+    ByteRangeVector ranges;
+    switch (ParseByteRanges(header, content_length, &ranges)) {
+      case kByteRangeIgnored:
+        EXPECT_TRUE(ranges.empty());
+        return "ignored";
+      case kByteRangeNotSatisfiable:
+        EXPECT_TRUE(ranges.empty());
+        return "unsatisfiable";
+      case kByteRangeSatisfiable:
+        break;
+    }
+    GoogleString result;
+    for (int i = 0, n = ranges.size(); i < n; ++i) {
+      StrAppend(&result, (i == 0) ? "" : ",",
+                Integer64ToString(ranges[i].first), "-",
+                Integer64ToString(ranges[i].last));
+    }
+    return result;
+  }
+
+  GoogleString Parse(StringPiece header) { return Parse(header, kLength); }
+};
+
+TEST_F(ByteRangeTest, SingleRanges) {
+  EXPECT_EQ("0-499", Parse("bytes=0-499"));
+  EXPECT_EQ("500-999", Parse("bytes=500-"));
+  EXPECT_EQ("900-999", Parse("bytes=-100"));
+  EXPECT_EQ("999-999", Parse("bytes=999-999"));
+  EXPECT_EQ("0-0", Parse(" Bytes=0-0 "));
+}
+
+TEST_F(ByteRangeTest, Clamping) {
+  EXPECT_EQ("500-999", Parse("bytes=500-5000"));
+  EXPECT_EQ("0-999", Parse("bytes=-5000"));
+  EXPECT_EQ("0-999", Parse("bytes=0-99999999999999999999999999"));
+}
+
+TEST_F(ByteRangeTest, MultipleRanges) {
+  // Disjoint ranges keep the order they were asked for in.
+  EXPECT_EQ("500-599,0-99", Parse("bytes=500-599,0-99"));
+  EXPECT_EQ("0-0,999-999", Parse("bytes=0-0, -1"));
+  // Empty list elements are allowed.
+  EXPECT_EQ("0-9,20-29", Parse("bytes=0-9,,20-29,"));
+  // Unsatisfiable ones are dropped if others can be satisfied.
+  EXPECT_EQ("0-9", Parse("bytes=2000-3000,0-9"));
+}
+
+TEST_F(ByteRangeTest, Coalescing) {
+  EXPECT_EQ("0-199", Parse("bytes=100-199,0-150"));
+  EXPECT_EQ("0-19", Parse("bytes=0-9,10-19"));
+  EXPECT_EQ("0-9,50-99", Parse("bytes=50-99,60-70,0-9"));
+  EXPECT_EQ("0-999", Parse("bytes=0-,-10"));
+}
+
+TEST_F(ByteRangeTest, Unsatisfiable) {
+  EXPECT_EQ("unsatisfiable", Parse("bytes=1000-"));
+  EXPECT_EQ("unsatisfiable", Parse("bytes=1000-2000,5000-6000"));
+  EXPECT_EQ("unsatisfiable", Parse("bytes=-0"));
+  EXPECT_EQ("unsatisfiable", Parse("bytes=0-10", 0));
+  EXPECT_EQ("unsatisfiable", Parse("bytes=-10", 0));
+}
+
+TEST_F(ByteRangeTest, Ignored) {
+  EXPECT_EQ("ignored", Parse(""));
+  EXPECT_EQ("ignored", Parse("bytes="));
+  EXPECT_EQ("ignored", Parse("bytes= , "));
+  EXPECT_EQ("ignored", Parse("items=0-10"));
+  EXPECT_EQ("ignored", Parse("bytes=10"));
+  EXPECT_EQ("ignored", Parse("bytes=-"));
+  EXPECT_EQ("ignored", Parse("bytes=a-b"));
+  EXPECT_EQ("ignored", Parse("bytes=-1-2"));
+  EXPECT_EQ("ignored", Parse("bytes=+1-2"));
+  EXPECT_EQ("ignored", Parse("bytes=20-10"));
+  // One bad spec spoils the lot.
+  EXPECT_EQ("ignored", Parse("bytes=0-10,junk"));
+
+  GoogleString many("bytes=0-0");
+  for (int i = 1; i <= kMaxByteRanges; ++i) {
+    StrAppend(&many, ",", IntegerToString(2 * i), "-", IntegerToString(2 * i));
+  }
+  EXPECT_EQ("ignored", Parse(many));
+}
+
+TEST_F(ByteRangeTest, Headers) {
+  EXPECT_EQ("bytes 0-499/1234", ContentRangeValue(ByteRange(0, 499), 1234));
+  EXPECT_EQ("bytes */1234", UnsatisfiedContentRangeValue(1234));
+  EXPECT_EQ("\r\n--xyz\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Range: bytes 5-9/10\r\n"
+            "\r\n",
+            MultipartByteRangeHeader("xyz", "text/plain", ByteRange(5, 9), 10));
+  EXPECT_EQ("\r\n--xyz\r\n"
+            "Content-Range: bytes 5-9/10\r\n"
+            "\r\n",
+            MultipartByteRangeHeader("xyz", "", ByteRange(5, 9), 10));
+  EXPECT_EQ("\r\n--xyz--\r\n", MultipartByteRangesTrailer("xyz"));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
@@ -26,6 +26,7 @@ namespace net_instaweb {
 
 const char HttpAttributes::kAccept[] = "Accept";
 const char HttpAttributes::kAcceptEncoding[] = "Accept-Encoding";
+const char HttpAttributes::kAcceptRanges[] = "Accept-Ranges";
 const char HttpAttributes::kAccessControlAllowOrigin[] =
     "Access-Control-Allow-Origin";
 const char HttpAttributes::kAccessControlAllowCredentials[] =
@@ -40,6 +41,7 @@ const char HttpAttributes::kContentDisposition[] = "Content-Disposition";
 const char HttpAttributes::kContentEncoding[] = "Content-Encoding";
 const char HttpAttributes::kContentLanguage[] = "Content-Language";
 const char HttpAttributes::kContentLength[] = "Content-Length";
+const char HttpAttributes::kContentRange[] = "Content-Range";
 const char HttpAttributes::kContentType[] = "Content-Type";
 const char HttpAttributes::kCookie[] = "Cookie";
 const char HttpAttributes::kCookie2[] = "Cookie2";
@@ -52,6 +54,7 @@ const char HttpAttributes::kGzip[] = "gzip";
 const char HttpAttributes::kHost[] = "Host";
 const char HttpAttributes::kIfModifiedSince[] = "If-Modified-Since";
 const char HttpAttributes::kIfNoneMatch[] = "If-None-Match";
+const char HttpAttributes::kIfRange[] = "If-Range";
 const char HttpAttributes::kKeepAlive[] = "Keep-Alive";
 const char HttpAttributes::kLastModified[] = "Last-Modified";
 const char HttpAttributes::kLocation[] = "Location";
@@ -67,6 +70,7 @@ const char HttpAttributes::kProxyAuthenticate[] = "Proxy-Authenticate";
 const char HttpAttributes::kProxyAuthorization[] = "Proxy-Authorization";
 const char HttpAttributes::kPublic[] = "public";
 const char HttpAttributes::kPurpose[] = "Purpose";
+const char HttpAttributes::kRange[] = "Range";
 const char HttpAttributes::kReferer[] = "Referer";  // sic
 const char HttpAttributes::kRefresh[] = "Refresh";
 const char HttpAttributes::kServer[] = "Server";
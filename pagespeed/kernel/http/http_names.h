@@ -32,6 +32,7 @@ namespace net_instaweb {
 struct HttpAttributes {
   static const char kAccept[];
   static const char kAcceptEncoding[];
+  static const char kAcceptRanges[];
   static const char kAccessControlAllowOrigin[];
   static const char kAccessControlAllowCredentials[];
   static const char kAge[];
@@ -44,6 +45,7 @@ struct HttpAttributes {
   static const char kContentDisposition[];
   static const char kContentLanguage[];
   static const char kContentLength[];
+  static const char kContentRange[];
   static const char kContentType[];
   static const char kCookie[];
   static const char kCookie2[];
@@ -56,6 +58,7 @@ struct HttpAttributes {
   static const char kHost[];
   static const char kIfModifiedSince[];
   static const char kIfNoneMatch[];
+  static const char kIfRange[];
   static const char kKeepAlive[];
   static const char kLastModified[];
   static const char kLocation[];
@@ -71,6 +74,7 @@ struct HttpAttributes {
   static const char kProxyAuthorization[];
   static const char kPublic[];
   static const char kPurpose[];
+  static const char kRange[];
   static const char kReferer[];  // sic
   static const char kRefresh[];
   static const char kServer[];
@@ -37,8 +37,10 @@
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_data_test_base.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_test_base.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health_test_base.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics_test_base.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu_test_base.h"
 #include "pagespeed/kernel/util/platform.h"
 
 namespace net_instaweb {
@@ -117,10 +119,14 @@ INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemCacheDataTestTemplate,
                               InProcessSharedMemEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemLockManagerTestTemplate,
                               InProcessSharedMemEnv);
+INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemOriginHealthTestTemplate,
+                              InProcessSharedMemEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemStatisticsTestTemplate,
                               InProcessSharedMemEnv);
 INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemTestTemplate,
                               InProcessSharedMemEnv);
+INSTANTIATE_TYPED_TEST_CASE_P(InprocessShm, SharedMemTinyLFUTestTemplate,
+                              InProcessSharedMemEnv);
 
 }  // namespace
 
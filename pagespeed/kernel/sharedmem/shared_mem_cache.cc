@@ -114,12 +114,24 @@
 //
 // For now, writers wait in sleep loop, while readers simply fail/miss.
 //
+// version is a per-entry sequence number used for lock-free reads. It is
+// odd while creating is set, and is also advanced when the entry is freed
+// (possibly having its blocks handed to another entry). Get first tries to
+// copy the payload without the sector lock: it samples the versions of all
+// candidate entries, copies out the data for a matching key, and then
+// re-checks the version. If anything changed, or a write was in progress,
+// it falls back to the locked path described above. Lock-free readers do
+// not write to shared memory at all: their LRU touches and statistics are
+// buffered in the process-local Sector object and applied by the next
+// operation that holds the sector lock.
+//
 // TODO(morlovich): Evaluate using chaining and one more layer of indirection
 // instead, as it should hopefully produce much better utilization and avoid
 // conflict misses entirely.
 
 #include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
 
+#include <algorithm>
 #include <cstddef>                     // for size_t
 #include <cstring>
 #include <map>
@@ -132,8 +144,10 @@
 #include "pagespeed/kernel/base/base64_util.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/cache_interface.h"
+#include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
 #include "pagespeed/kernel/base/proto_util.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/shared_string.h"
@@ -143,6 +157,11 @@
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_data.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_snapshot.pb.h"
+#ifdef USE_SYSTEM_ZLIB
+#include "zlib.h"  // NOLINT
+#else
+#include "third_party/zlib/zlib.h"
+#endif
 
 namespace net_instaweb {
 
@@ -169,10 +188,66 @@ bool IsAllNil(const StringPiece& raw_hash) {
   return all_nil;
 }
 
+// Admission fingerprints are the leading bytes of an entry's hash, so that
+// they can be computed both from a key and from a stored entry.
+uint64 RawHashFingerprint(const char* hash_bytes) {
+  uint64 fingerprint;
+  COMPILE_ASSERT(kHashSize >= sizeof(fingerprint), hash_too_short);
+  std::memcpy(&fingerprint, hash_bytes, sizeof(fingerprint));
+  return fingerprint;
+}
+
 GoogleString FormatSize(size_t size) {
   return Integer64ToString(static_cast<int64>(size));
 }
 
+// Snapshot files start with a SnapshotFileHeader, followed by each sector's
+// image preceded by its CRC-32, so they can be written and read one sector
+// at a time. Everything is in native byte order; a file from a machine with
+// a different one won't have a matching version.
+const char kSnapshotMagic[8] = { 'P', 'S', 'S', 'H', 'M', 'I', 'M', 'G' };
+const uint32 kSnapshotVersion = 2;
+
+struct SnapshotFileHeader {
+  char magic[8];
+  uint32 version;
+  uint32 block_size;
+  uint32 entry_size;
+  int32 num_sectors;
+  int32 entries_per_sector;
+  int32 blocks_per_sector;
+  uint64 image_size;
+};
+
+uint32 ImageChecksum(const char* image, size_t size) {
+  // crc32 takes 32-bit lengths, so feed it in pieces.
+  const size_t kMaxChunk = 1 << 30;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  while (size > 0) {
+    size_t chunk = std::min(size, kMaxChunk);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(image), chunk);
+    image += chunk;
+    size -= chunk;
+  }
+  return static_cast<uint32>(crc);
+}
+
+// Reads exactly size bytes from file into buf, returning false if there
+// aren't that many.
+bool ReadFully(FileSystem::InputFile* file, char* buf, size_t size,
+               MessageHandler* handler) {
+  const size_t kMaxChunk = 1 << 30;
+  while (size > 0) {
+    int read = file->Read(buf, std::min(size, kMaxChunk), handler);
+    if (read <= 0) {
+      return false;
+    }
+    buf += read;
+    size -= read;
+  }
+  return true;
+}
+
 // A couple of debug helpers.
 #ifndef NDEBUG
 
@@ -321,6 +396,7 @@ GoogleString SharedMemCache<kBlockSize>::DumpStats() {
   SectorStats aggregate;
   for (size_t c = 0; c < sectors_.size(); ++c) {
     sectors_[c]->mutex()->Lock();
+    ApplyLockFreeGets(sectors_[c]);
     aggregate.Add(*sectors_[c]->sector_stats());
     sectors_[c]->mutex()->Unlock();
   }
@@ -337,6 +413,7 @@ void SharedMemCache<kBlockSize>::AddSectorToSnapshot(
 
   Sector<kBlockSize>* sector = sectors_[sector_num];
   sector->mutex()->Lock();
+  ApplyLockFreeGets(sector);
 
   EntryNum cur = sector->OldestEntryNum();
   while (cur != kInvalidEntry) {
@@ -402,6 +479,145 @@ void SharedMemCache<kBlockSize>::DemarshalSnapshot(
   out->ParseFromZeroCopyStream(&input);
 }
 
+template<size_t kBlockSize>
+bool SharedMemCache<kBlockSize>::SaveSnapshotFile(const GoogleString& path,
+                                                  FileSystem* file_system) {
+  if (sectors_.empty()) {
+    return false;
+  }
+  FileSystem::OutputFile* file =
+      file_system->OpenTempFile(StrCat(path, ".temp"), handler_);
+  if (file == NULL) {
+    return false;
+  }
+  GoogleString temp_path = file->filename();
+
+  size_t image_size = sectors_[0]->ImageSize();
+  SnapshotFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.block_size = kBlockSize;
+  header.entry_size = sizeof(CacheEntry);
+  header.num_sectors = num_sectors_;
+  header.entries_per_sector = entries_per_sector_;
+  header.blocks_per_sector = blocks_per_sector_;
+  header.image_size = image_size;
+  bool ok = file->Write(
+      StringPiece(reinterpret_cast<const char*>(&header), sizeof(header)),
+      handler_);
+
+  // Only one sector's image is held in memory at a time, and each sector is
+  // locked only while it's being copied.
+  std::vector<char> image(image_size);
+  for (int s = 0; ok && (s < num_sectors_); ++s) {
+    Sector<kBlockSize>* sector = sectors_[s];
+    sector->mutex()->Lock();
+    ApplyLockFreeGets(sector);
+    sector->CopyToImage(&image[0]);
+    sector->mutex()->Unlock();
+    uint32 checksum = ImageChecksum(&image[0], image_size);
+    ok = file->Write(StringPiece(reinterpret_cast<const char*>(&checksum),
+                                 sizeof(checksum)), handler_) &&
+         file->Write(StringPiece(&image[0], image_size), handler_);
+  }
+  ok &= file_system->Close(file, handler_);
+  if (ok) {
+    ok = file_system->RenameFile(temp_path.c_str(), path.c_str(), handler_);
+  }
+  if (!ok) {
+    handler_->Message(kError, "SharedMemCache: unable to write snapshot %s",
+                      path.c_str());
+    file_system->RemoveFile(temp_path.c_str(), handler_);
+  }
+  return ok;
+}
+
+template<size_t kBlockSize>
+bool SharedMemCache<kBlockSize>::RestoreSnapshotFile(const GoogleString& path,
+                                                     FileSystem* file_system) {
+  if (sectors_.empty()) {
+    return false;
+  }
+  // Not having a snapshot is normal on first start.
+  NullMessageHandler null_handler;
+  FileSystem::InputFile* file =
+      file_system->OpenInputFile(path.c_str(), &null_handler);
+  if (file == NULL) {
+    handler_->Message(kInfo, "SharedMemCache: no snapshot at %s",
+                      path.c_str());
+    return false;
+  }
+
+  size_t image_size = sectors_[0]->ImageSize();
+  SnapshotFileHeader header;
+  bool header_ok =
+      ReadFully(file, reinterpret_cast<char*>(&header), sizeof(header),
+                handler_) &&
+      (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) ==
+       0) &&
+      (header.version == kSnapshotVersion) &&
+      (header.block_size == kBlockSize) &&
+      (header.entry_size == sizeof(CacheEntry)) &&
+      (header.num_sectors == num_sectors_) &&
+      (header.entries_per_sector == entries_per_sector_) &&
+      (header.blocks_per_sector == blocks_per_sector_) &&
+      (header.image_size == image_size);
+  if (!header_ok) {
+    handler_->Message(kWarning, "SharedMemCache: snapshot %s is from an "
+                      "incompatible cache or truncated; ignoring it",
+                      path.c_str());
+    file_system->Close(file, handler_);
+    return false;
+  }
+
+  std::vector<char> image(image_size);
+  int restored = 0;
+  for (int s = 0; s < num_sectors_; ++s) {
+    uint32 checksum;
+    if (!ReadFully(file, reinterpret_cast<char*>(&checksum), sizeof(checksum),
+                   handler_) ||
+        !ReadFully(file, &image[0], image_size, handler_)) {
+      break;
+    }
+    if (ImageChecksum(&image[0], image_size) != checksum) {
+      continue;
+    }
+    Sector<kBlockSize>* sector = sectors_[s];
+    sector->mutex()->Lock();
+    ApplyLockFreeGets(sector);
+    if (sector->RestoreFromImage(&image[0])) {
+      CleanUpRestoredSector(sector);
+      ++restored;
+    }
+    sector->mutex()->Unlock();
+  }
+  file_system->Close(file, handler_);
+
+  handler_->Message(
+      (restored == num_sectors_) ? kInfo : kWarning,
+      "SharedMemCache: restored %d of %d sectors of %s from %s", restored,
+      num_sectors_, filename_.c_str(), path.c_str());
+  return (restored == num_sectors_);
+}
+
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::CleanUpRestoredSector(
+    Sector<kBlockSize>* sector) {
+  for (EntryNum e = 0; e < entries_per_sector_; ++e) {
+    CacheEntry* entry = sector->EntryAt(e);
+    entry->open_count = 0;
+    if (entry->creating) {
+      // The payload may only be partly there.
+      BlockVector blocks;
+      sector->BlockListForEntry(entry, &blocks);
+      sector->ReturnBlocksToFreeList(blocks);
+      FinishWriting(sector, entry);
+      MarkEntryFree(sector, e);
+    }
+  }
+}
+
 template<size_t kBlockSize>
 void SharedMemCache<kBlockSize>::Put(const GoogleString& key,
                                      SharedString* value) {
@@ -433,6 +649,7 @@ void SharedMemCache<kBlockSize>::PutRawHash(
   Sector<kBlockSize>* sector = sectors_[pos.sector];
   SectorStats* stats = sector->sector_stats();
   sector->mutex()->Lock();
+  ApplyLockFreeGets(sector);
   ++stats->num_put;
 
   // See if our key already exists. Note that if it does, we will attempt to
@@ -514,7 +731,7 @@ void SharedMemCache<kBlockSize>::PutIntoEntry(
       // and fail the insertion. This should be pretty much impossible.
       // TODO(morlovich): log warning?
       sector->ReturnBlocksToFreeList(blocks);
-      entry->creating = false;
+      FinishWriting(sector, entry);
       MarkEntryFree(sector, entry_num);
       sector->mutex()->Unlock();
       return;
@@ -556,7 +773,7 @@ void SharedMemCache<kBlockSize>::PutIntoEntry(
 
   // We're done, clear creating bit.
   sector->mutex()->Lock();
-  entry->creating = false;
+  FinishWriting(sector, entry);
   sector->mutex()->Unlock();
 }
 
@@ -567,7 +784,15 @@ void SharedMemCache<kBlockSize>::Get(const GoogleString& key,
   Position pos;
   ExtractPosition(raw_hash, &pos);
   Sector<kBlockSize>* sector = sectors_[pos.sector];
+
+  bool found = false;
+  if (TryGetLockFree(raw_hash, pos, sector, callback->value(), &found)) {
+    ValidateAndReportResult(key, found ? kAvailable : kNotFound, callback);
+    return;
+  }
+
   sector->mutex()->Lock();
+  ApplyLockFreeGets(sector);
   SectorStats* stats = sector->sector_stats();
   ++stats->num_get;
 
@@ -585,6 +810,173 @@ void SharedMemCache<kBlockSize>::Get(const GoogleString& key,
   ValidateAndReportResult(key, kNotFound, callback);
 }
 
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::MultiGet(MultiGetRequest* request) {
+  // Keys that can be read without locking are reported right away, as in
+  // Get.  The rest are grouped by sector, and looked up once all the others
+  // are done, so that each sector's lock is taken at most once.
+  std::vector<std::vector<LockedGet> > locked_by_sector;
+  LockedGet get;
+  for (int i = 0, n = request->size(); i < n; ++i) {
+    KeyCallback& key_callback = (*request)[i];
+    get.raw_hash = ToRawHash(key_callback.key);
+    ExtractPosition(get.raw_hash, &get.pos);
+    bool found = false;
+    if (TryGetLockFree(get.raw_hash, get.pos, sectors_[get.pos.sector],
+                       key_callback.callback->value(), &found)) {
+      ValidateAndReportResult(key_callback.key,
+                              found ? kAvailable : kNotFound,
+                              key_callback.callback);
+    } else {
+      if (locked_by_sector.empty()) {
+        locked_by_sector.resize(num_sectors_);
+      }
+      get.index = i;
+      locked_by_sector[get.pos.sector].push_back(get);
+    }
+  }
+  for (int s = 0, num_sectors = locked_by_sector.size(); s < num_sectors;
+       ++s) {
+    if (!locked_by_sector[s].empty()) {
+      MultiGetLocked(sectors_[s], *request, locked_by_sector[s]);
+    }
+  }
+  delete request;
+}
+
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::MultiGetLocked(
+    Sector<kBlockSize>* sector, const MultiGetRequest& request,
+    const std::vector<LockedGet>& gets) {
+  int num_keys = gets.size();
+  std::vector<KeyState> states(num_keys, kNotFound);
+
+  // Small values are copied while holding the lock, which saves the two
+  // lock acquisitions per key that opening the entries for reading would
+  // cost.  Bigger ones are opened for reading as in Get, copied once the
+  // lock is dropped, and then closed together.
+  std::vector<int> opened;
+  std::vector<EntryNum> opened_entries;
+  std::vector<BlockVector> opened_blocks;
+  sector->mutex()->Lock();
+  ApplyLockFreeGets(sector);
+  SectorStats* stats = sector->sector_stats();
+  int64 now_ms = timer_->NowMs();
+  for (int i = 0; i < num_keys; ++i) {
+    const LockedGet& get = gets[i];
+    ++stats->num_get;
+    for (int p = 0; p < kAssociativity; ++p) {
+      EntryNum cand_key = get.pos.keys[p];
+      CacheEntry* cand = sector->EntryAt(cand_key);
+      if (KeyMatch(cand, get.raw_hash)) {
+        ++stats->num_get_hit;
+        // As in Get, consider concurrent creation a miss.
+        if (!cand->creating) {
+          TouchEntry(sector, now_ms, cand_key);
+          BlockVector blocks;
+          sector->BlockListForEntry(cand, &blocks);
+          if (cand->byte_size <= kMaxMultiGetCopyUnderLock) {
+            CopyBlocks(sector, cand, blocks,
+                       request[get.index].callback->value());
+          } else {
+            ++cand->open_count;
+            opened.push_back(i);
+            opened_entries.push_back(cand_key);
+            opened_blocks.push_back(BlockVector());
+            opened_blocks.back().swap(blocks);
+          }
+          states[i] = kAvailable;
+        }
+        break;
+      }
+    }
+  }
+  sector->mutex()->Unlock();
+
+  if (!opened.empty()) {
+    for (int j = 0, n = opened.size(); j < n; ++j) {
+      CopyBlocks(sector, sector->EntryAt(opened_entries[j]), opened_blocks[j],
+                 request[gets[opened[j]].index].callback->value());
+    }
+    sector->mutex()->Lock();
+    for (int j = 0, n = opened.size(); j < n; ++j) {
+      --sector->EntryAt(opened_entries[j])->open_count;
+    }
+    sector->mutex()->Unlock();
+  }
+
+  for (int i = 0; i < num_keys; ++i) {
+    const KeyCallback& key_callback = request[gets[i].index];
+    ValidateAndReportResult(key_callback.key, states[i],
+                            key_callback.callback);
+  }
+}
+
+template<size_t kBlockSize>
+bool SharedMemCache<kBlockSize>::TryGetLockFree(
+    const GoogleString& raw_hash, const Position& pos,
+    Sector<kBlockSize>* sector, SharedString* value, bool* found) {
+  int32 versions[kAssociativity];
+  for (int p = 0; p < kAssociativity; ++p) {
+    CacheEntry* cand = sector->EntryAt(pos.keys[p]);
+    versions[p] = Sector<kBlockSize>::EntryVersion(cand);
+    if ((versions[p] & 1) != 0) {
+      return false;  // Write in progress.
+    }
+  }
+
+  EntryNum hit = kInvalidEntry;
+  for (int p = 0; p < kAssociativity; ++p) {
+    EntryNum cand_key = pos.keys[p];
+    CacheEntry* cand = sector->EntryAt(cand_key);
+    if (KeyMatch(cand, raw_hash)) {
+      if (!sector->CopyEntryPayloadUnlocked(cand, MaxValueSize(), value) ||
+          !Sector<kBlockSize>::EntryVersionUnchanged(cand, versions[p])) {
+        return false;
+      }
+      hit = cand_key;
+      break;
+    }
+  }
+
+  if (hit == kInvalidEntry) {
+    // Make sure we didn't miss because the key was being written.
+    for (int p = 0; p < kAssociativity; ++p) {
+      if (!Sector<kBlockSize>::EntryVersionUnchanged(
+              sector->EntryAt(pos.keys[p]), versions[p])) {
+        return false;
+      }
+    }
+  }
+
+  if (sector->RecordLockFreeGet(hit) && sector->mutex()->TryLock()) {
+    ApplyLockFreeGets(sector);
+    sector->mutex()->Unlock();
+  }
+  *found = (hit != kInvalidEntry);
+  return true;
+}
+
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::ApplyLockFreeGets(
+    Sector<kBlockSize>* sector) {
+  EntryNum touched[Sector<kBlockSize>::kDeferredTouches];
+  int num_touched = sector->DrainLockFreeGets(touched);
+  if (num_touched == 0) {
+    return;
+  }
+  int64 now_ms = timer_->NowMs();
+  for (int i = 0; i < num_touched; ++i) {
+    // The entry may have been freed or reused since it was read; touching
+    // a reused entry is harmless, but we must not put free ones in the LRU.
+    CacheEntry* entry = sector->EntryAt(touched[i]);
+    if (!entry->creating &&
+        !IsAllNil(StringPiece(entry->hash_bytes, kHashSize))) {
+      TouchEntry(sector, now_ms, touched[i]);
+    }
+  }
+}
+
 template<size_t kBlockSize>
 void SharedMemCache<kBlockSize>::GetFromEntry(
     const GoogleString& key,
@@ -609,7 +1001,21 @@ void SharedMemCache<kBlockSize>::GetFromEntry(
   sector->mutex()->Unlock();
 
   // Collect the contents.
-  SharedString* out = callback->value();
+  CopyBlocks(sector, entry, blocks, callback->value());
+
+  // Now reduce the reference count.
+  // TODO(morlovich): atomic ops?
+  sector->mutex()->Lock();
+  --entry->open_count;
+  sector->mutex()->Unlock();
+  ValidateAndReportResult(key, kAvailable, callback);
+}
+
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::CopyBlocks(Sector<kBlockSize>* sector,
+                                            const CacheEntry* entry,
+                                            const BlockVector& blocks,
+                                            SharedString* out) {
   out->DetachAndClear();
   out->Extend(entry->byte_size);
 
@@ -620,13 +1026,50 @@ void SharedMemCache<kBlockSize>::GetFromEntry(
     out->WriteAt(pos, sector->BlockBytes(blocks[b]), bytes);
     pos += bytes;
   }
+}
 
-  // Now reduce the reference count.
-  // TODO(morlovich): atomic ops?
+template<size_t kBlockSize>
+uint64 SharedMemCache<kBlockSize>::AdmissionFingerprint(
+    const GoogleString& key) {
+  return RawHashFingerprint(ToRawHash(key).data());
+}
+
+template<size_t kBlockSize>
+bool SharedMemCache<kBlockSize>::PeekEvictionVictim(
+    const GoogleString& key, size_t value_size, uint64* victim) {
+  if (value_size > MaxValueSize()) {
+    return false;
+  }
+  GoogleString raw_hash = ToRawHash(key);
+  Position pos;
+  ExtractPosition(raw_hash, &pos);
+
+  Sector<kBlockSize>* sector = sectors_[pos.sector];
   sector->mutex()->Lock();
-  --entry->open_count;
+  ApplyLockFreeGets(sector);
+
+  // This mirrors the choice of entry in PutRawHash.
+  CacheEntry* best = NULL;
+  for (int p = 0; p < kAssociativity; ++p) {
+    CacheEntry* cand = sector->EntryAt(pos.keys[p]);
+    if (KeyMatch(cand, raw_hash)) {
+      sector->mutex()->Unlock();
+      return false;
+    }
+    if (Writeable(cand) &&
+        ((best == NULL) ||
+         (cand->last_use_timestamp_ms < best->last_use_timestamp_ms))) {
+      best = cand;
+    }
+  }
+
+  bool would_evict =
+      (best != NULL) && !IsAllNil(StringPiece(best->hash_bytes, kHashSize));
+  if (would_evict) {
+    *victim = RawHashFingerprint(best->hash_bytes);
+  }
   sector->mutex()->Unlock();
-  ValidateAndReportResult(key, kAvailable, callback);
+  return would_evict;
 }
 
 template<size_t kBlockSize>
@@ -637,6 +1080,7 @@ void SharedMemCache<kBlockSize>::Delete(const GoogleString& key) {
 
   Sector<kBlockSize>* sector = sectors_[pos.sector];
   sector->mutex()->Lock();
+  ApplyLockFreeGets(sector);
 
   for (int p = 0; p < kAssociativity; ++p) {
     EntryNum cand_key = pos.keys[p];
@@ -657,7 +1101,7 @@ void SharedMemCache<kBlockSize>::DeleteEntry(Sector<kBlockSize>* sector,
   BlockVector blocks;
   sector->BlockListForEntry(entry, &blocks);
   sector->ReturnBlocksToFreeList(blocks);
-  entry->creating = false;
+  FinishWriting(sector, entry);
   MarkEntryFree(sector, entry_num);
   sector->mutex()->Unlock();
 }
@@ -727,6 +1171,9 @@ void SharedMemCache<kBlockSize>::MarkEntryFree(Sector<kBlockSize>* sector,
   sector->UnlinkEntryFromLRU(entry_num);
   CacheEntry* entry = sector->EntryAt(entry_num);
   CHECK(Writeable(entry));
+  // The entry's blocks may get reused by someone else, so make sure any
+  // lock-free readers notice.
+  sector->BumpEntryVersion(entry);
   std::memset(entry->hash_bytes, 0, kHashSize);
   entry->last_use_timestamp_ms = 0;
   entry->byte_size = 0;
@@ -816,6 +1263,7 @@ void SharedMemCache<kBlockSize>::EnsureReadyForWriting(
   // as if there were, we would have given up ourselves).
   //
   entry->creating = true;
+  sector->BeginEntryWrite(entry);
 
   // Now just wait for previous readers to leave.
   while (entry->open_count > 0) {
@@ -826,6 +1274,13 @@ void SharedMemCache<kBlockSize>::EnsureReadyForWriting(
   }
 }
 
+template<size_t kBlockSize>
+void SharedMemCache<kBlockSize>::FinishWriting(Sector<kBlockSize>* sector,
+                                               CacheEntry* entry) {
+  entry->creating = false;
+  sector->EndEntryWrite(entry);
+}
+
 template class SharedMemCache<64>;  // metadata ("rname") cache
 template class SharedMemCache<512>;  // testing
 template class SharedMemCache<4096>;  // HTTP cache
@@ -33,6 +33,7 @@ namespace net_instaweb {
 
 class AbstractSharedMem;
 class AbstractSharedMemSegment;
+class FileSystem;
 class Hasher;
 class MessageHandler;
 class SharedMemCacheDump;
@@ -113,9 +114,39 @@ class SharedMemCache : public CacheInterface {
   static void DemarshalSnapshot(const GoogleString& marshaled,
                                 SharedMemCacheDump* out);
 
+  // Writes the whole cache to the file at path, as a versioned header and
+  // then each sector's memory image with its checksum. Unlike the
+  // SharedMemCacheDump route, nothing is re-encoded, and only one sector's
+  // image is buffered at a time. Each sector is locked only while it's being
+  // copied. The file is written under a temporary name and renamed into
+  // place. Returns whether successful.
+  bool SaveSnapshotFile(const GoogleString& path, FileSystem* file_system);
+
+  // Reads a file written by SaveSnapshotFile and copies its sector images
+  // straight into this cache. The file must come from a cache with the same
+  // block size, number of sectors, and sector dimensions. Sectors whose
+  // checksums don't match are left as they were. Returns true if every
+  // sector was restored.
+  //
+  // This should be called in the root process right after Initialize, since
+  // it replaces the sectors wholesale.
+  bool RestoreSnapshotFile(const GoogleString& path, FileSystem* file_system);
+
   virtual void Get(const GoogleString& key, Callback* callback);
+
+  // Looks up each key lock-free where possible, and otherwise takes each
+  // sector's lock at most once for the whole batch.
+  virtual void MultiGet(MultiGetRequest* request);
   virtual void Put(const GoogleString& key, SharedString* value);
   virtual void Delete(const GoogleString& key);
+
+  // A Put of a new key displaces the least recently used of the entries in
+  // its set, if they are all occupied; that entry is the victim reported
+  // here.  Blocks reclaimed from other entries to make room for a large
+  // value are not considered.
+  virtual uint64 AdmissionFingerprint(const GoogleString& key);
+  virtual bool PeekEvictionVictim(const GoogleString& key, size_t value_size,
+                                  uint64* victim);
   static GoogleString FormatName();
   virtual GoogleString Name() const { return FormatName();}
 
@@ -135,6 +166,19 @@ class SharedMemCache : public CacheInterface {
     SharedMemCacheData::EntryNum keys[kAssociativity];
   };
 
+  // A key of a MultiGet that has to be looked up under its sector's lock,
+  // with the hash and position already computed for the lock-free attempt.
+  struct LockedGet {
+    int index;  // Into the MultiGetRequest.
+    GoogleString raw_hash;
+    Position pos;
+  };
+
+  // Values of at most this many bytes are copied by MultiGet while holding
+  // the sector lock; larger ones are opened for reading and copied after
+  // it is released, as in Get, so a big value doesn't hold up the sector.
+  static const size_t kMaxMultiGetCopyUnderLock = 4096;
+
   bool InitCache(bool parent);
 
   void PutRawHash(const GoogleString& raw_hash, int64 last_use_timestamp_ms,
@@ -147,6 +191,41 @@ class SharedMemCache : public CacheInterface {
                     SharedMemCacheData::EntryNum entry_num, Callback* callback)
       UNLOCK_FUNCTION(sector->mutex());
 
+  // Frees any entries in a sector just restored from a file that were being
+  // written when the snapshot was taken, and forgets about any readers.
+  void CleanUpRestoredSector(SharedMemCacheData::Sector<kBlockSize>* sector)
+      EXCLUSIVE_LOCKS_REQUIRED(sector->mutex());
+
+  // Looks up the given keys of request, all of which belong to sector, with
+  // a single acquisition of its lock, plus one more to close any entries
+  // too big to copy while holding it.
+  void MultiGetLocked(SharedMemCacheData::Sector<kBlockSize>* sector,
+                      const MultiGetRequest& request,
+                      const std::vector<LockedGet>& gets)
+      LOCKS_EXCLUDED(sector->mutex());
+
+  // Copies the payload of entry, whose blocks are given, into *out. The
+  // caller must either hold the sector lock or have the entry open for
+  // reading.
+  void CopyBlocks(SharedMemCacheData::Sector<kBlockSize>* sector,
+                  const SharedMemCacheData::CacheEntry* entry,
+                  const SharedMemCacheData::BlockVector& blocks,
+                  SharedString* out);
+
+  // Tries to look up raw_hash without taking the sector lock, copying the
+  // payload into *value on a hit. Returns true if the lookup was
+  // conclusive, in which case *found tells whether there was a hit; returns
+  // false if a concurrent write interfered, in which case the caller should
+  // use the locked path instead. *value may be modified either way.
+  bool TryGetLockFree(const GoogleString& raw_hash, const Position& pos,
+                      SharedMemCacheData::Sector<kBlockSize>* sector,
+                      SharedString* value, bool* found)
+      LOCKS_EXCLUDED(sector->mutex());
+
+  // Applies the LRU touches and statistics buffered by lock-free readers.
+  void ApplyLockFreeGets(SharedMemCacheData::Sector<kBlockSize>* sector)
+      EXCLUSIVE_LOCKS_REQUIRED(sector->mutex());
+
   // Finish a put into the given entry. Lock is expected to be held at entry,
   // will be released when done. The hash in the entry must also be already
   // correct at time of entry.
@@ -200,6 +279,12 @@ class SharedMemCache : public CacheInterface {
                              SharedMemCacheData::CacheEntry* entry)
       EXCLUSIVE_LOCKS_REQUIRED(sector->mutex());
 
+  // Clears the creating bit set by EnsureReadyForWriting, and lets lock-free
+  // readers see the entry again.
+  void FinishWriting(SharedMemCacheData::Sector<kBlockSize>* sector,
+                     SharedMemCacheData::CacheEntry* entry)
+      EXCLUSIVE_LOCKS_REQUIRED(sector->mutex());
+
   AbstractSharedMem* shm_runtime_;
   const Hasher* hasher_;
   Timer* timer_;
@@ -21,10 +21,13 @@
 
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_data.h"
 
+#include <cstring>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
 #include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string_util.h"
 
 namespace net_instaweb {
@@ -37,6 +40,11 @@ inline size_t AlignTo(size_t alignment, size_t in) {
   return (in + (alignment - 1)) & ~(alignment - 1);
 }
 
+// Whether link is either -1 (for none) or a valid index below limit.
+inline bool IsValidLink(int32 link, int32 limit) {
+  return (link >= -1) && (link < limit);
+}
+
 double percent(int64 portion, int64 total) {
   return static_cast<double>(portion) / static_cast<double>(total) * 100.0;
 }
@@ -49,7 +57,7 @@ struct Sector<kBlockSize>::MemLayout {
     // Check out alignment assumptions -- everything must be of a size
     // that's multiple of 8. The exact sizes don't matter too much, but
     // we check it anyway to avoid surprises.
-    CHECK_EQ(96u, sizeof(SectorHeader));
+    CHECK_EQ(104u, sizeof(SectorHeader));
     CHECK_EQ(48u, sizeof(CacheEntry));
 
     header_bytes = AlignTo(8, sizeof(SectorHeader) + mutex_size);
@@ -73,7 +81,13 @@ Sector<kBlockSize>::Sector(AbstractSharedMemSegment* segment,
     : cache_entries_(cache_entries),
       data_blocks_(data_blocks),
       segment_(segment),
-      sector_offset_(sector_offset) {
+      sector_offset_(sector_offset),
+      lock_free_gets_(0),
+      lock_free_hits_(0),
+      num_deferred_touches_(0) {
+  for (int i = 0; i < kDeferredTouches; ++i) {
+    deferred_touches_[i] = kInvalidEntry;
+  }
   MemLayout layout(segment->SharedMutexSize(), cache_entries, data_blocks);
   char* base = const_cast<char*>(segment->Base()) + sector_offset;
   sector_header_ = reinterpret_cast<SectorHeader*>(base);
@@ -115,6 +129,7 @@ bool Sector<kBlockSize>::Initialize(MessageHandler* handler)
     entry->lru_prev = kInvalidEntry;
     entry->lru_next = kInvalidEntry;
     entry->first_block = kInvalidBlock;
+    entry->version = 0;
   }
 
   // Initialize the freelist and block successor list.
@@ -242,6 +257,148 @@ int Sector<kBlockSize>::BlockListForEntry(CacheEntry* entry,
   return data_blocks;
 }
 
+template<size_t kBlockSize>
+bool Sector<kBlockSize>::CopyEntryPayloadUnlocked(
+    const CacheEntry* entry, size_t max_size, SharedString* out)
+    NO_THREAD_SAFETY_ANALYSIS {
+  // Everything here may be changing under us, so we validate anything we
+  // use for addressing before relying on it.
+  int32 byte_size = entry->byte_size;
+  if ((byte_size < 0) || (static_cast<size_t>(byte_size) > max_size)) {
+    return false;
+  }
+  size_t total_blocks = DataBlocksForSize(byte_size);
+
+  out->DetachAndClear();
+  out->Extend(byte_size);
+  BlockNum block = entry->first_block;
+  int pos = 0;
+  for (size_t b = 0; b < total_blocks; ++b) {
+    if ((block < 0) || (block >= static_cast<BlockNum>(data_blocks_))) {
+      return false;
+    }
+    int bytes = BytesInPortion(byte_size, b, total_blocks);
+    out->WriteAt(pos, BlockBytes(block), bytes);
+    pos += bytes;
+    block = block_successors_[block];
+  }
+  return true;
+}
+
+template<size_t kBlockSize>
+size_t Sector<kBlockSize>::ImageSize() const {
+  return AlignTo(8, sizeof(SectorHeader)) + ImageMetadataBytes() +
+         data_blocks_ * kBlockSize;
+}
+
+template<size_t kBlockSize>
+size_t Sector<kBlockSize>::ImageMetadataBytes() const {
+  // The successor list and the directory are adjacent in the sector, so
+  // they're copied together.
+  return (directory_base_ - reinterpret_cast<char*>(block_successors_)) +
+         sizeof(CacheEntry) * cache_entries_;
+}
+
+template<size_t kBlockSize>
+void Sector<kBlockSize>::CopyToImage(char* image) {
+  size_t header_bytes = AlignTo(8, sizeof(SectorHeader));
+  std::memset(image, 0, header_bytes);
+  std::memcpy(image, sector_header_, sizeof(SectorHeader));
+  image += header_bytes;
+  std::memcpy(image, block_successors_, ImageMetadataBytes());
+  image += ImageMetadataBytes();
+  std::memcpy(image, blocks_base_, data_blocks_ * kBlockSize);
+}
+
+template<size_t kBlockSize>
+bool Sector<kBlockSize>::RestoreFromImage(const char* image) {
+  size_t header_bytes = AlignTo(8, sizeof(SectorHeader));
+  const SectorHeader* header = reinterpret_cast<const SectorHeader*>(image);
+  const BlockNum* successors =
+      reinterpret_cast<const BlockNum*>(image + header_bytes);
+  const CacheEntry* directory = reinterpret_cast<const CacheEntry*>(
+      image + header_bytes +
+      (directory_base_ - reinterpret_cast<char*>(block_successors_)));
+
+  // Everything that's followed later without checking has to be in range.
+  // We don't look for cycles; the snapshot's checksums protect against
+  // those.
+  BlockNum num_blocks = static_cast<BlockNum>(data_blocks_);
+  EntryNum num_entries = static_cast<EntryNum>(cache_entries_);
+  if (!IsValidLink(header->free_list_front, num_blocks) ||
+      !IsValidLink(header->lru_list_front, num_entries) ||
+      !IsValidLink(header->lru_list_rear, num_entries)) {
+    return false;
+  }
+  for (BlockNum b = 0; b < num_blocks; ++b) {
+    if (!IsValidLink(successors[b], num_blocks)) {
+      return false;
+    }
+  }
+  for (EntryNum e = 0; e < num_entries; ++e) {
+    const CacheEntry& entry = directory[e];
+    if ((entry.byte_size < 0) ||
+        (DataBlocksForSize(entry.byte_size) > data_blocks_) ||
+        !IsValidLink(entry.first_block, num_blocks) ||
+        !IsValidLink(entry.lru_prev, num_entries) ||
+        !IsValidLink(entry.lru_next, num_entries)) {
+      return false;
+    }
+  }
+
+  std::memcpy(sector_header_, image, sizeof(SectorHeader));
+  image += header_bytes;
+  std::memcpy(block_successors_, image, ImageMetadataBytes());
+  image += ImageMetadataBytes();
+  std::memcpy(blocks_base_, image, data_blocks_ * kBlockSize);
+  return true;
+}
+
+template<size_t kBlockSize>
+bool Sector<kBlockSize>::RecordLockFreeGet(EntryNum entry_num) {
+  int32 gets = base::subtle::NoBarrier_AtomicIncrement(&lock_free_gets_, 1);
+  if (entry_num == kInvalidEntry) {
+    // Nothing to touch, but make sure the counts get folded in periodically.
+    return (gets % kDeferredTouches) == 0;
+  }
+  base::subtle::NoBarrier_AtomicIncrement(&lock_free_hits_, 1);
+  int32 slot =
+      base::subtle::NoBarrier_AtomicIncrement(&num_deferred_touches_, 1) - 1;
+  if (slot < kDeferredTouches) {
+    base::subtle::NoBarrier_Store(&deferred_touches_[slot], entry_num);
+  }
+  return (slot + 1 >= kDeferredTouches);
+}
+
+template<size_t kBlockSize>
+int Sector<kBlockSize>::DrainLockFreeGets(EntryNum* touched) {
+  if (base::subtle::NoBarrier_Load(&lock_free_gets_) == 0) {
+    return 0;
+  }
+  int32 gets = base::subtle::NoBarrier_AtomicExchange(&lock_free_gets_, 0);
+  int32 hits = base::subtle::NoBarrier_AtomicExchange(&lock_free_hits_, 0);
+  SectorStats* stats = sector_stats();
+  stats->num_get += gets;
+  stats->num_get_hit += hits;
+  stats->num_get_lock_free += gets;
+
+  int32 pending =
+      base::subtle::NoBarrier_AtomicExchange(&num_deferred_touches_, 0);
+  if (pending > kDeferredTouches) {
+    pending = kDeferredTouches;
+  }
+  int num_touched = 0;
+  for (int i = 0; i < pending; ++i) {
+    EntryNum entry_num = base::subtle::NoBarrier_AtomicExchange(
+        &deferred_touches_[i], kInvalidEntry);
+    if (entry_num != kInvalidEntry) {
+      touched[num_touched] = entry_num;
+      ++num_touched;
+    }
+  }
+  return num_touched;
+}
+
 SectorStats::SectorStats()
     : num_put(0),
       num_put_update(0),
@@ -251,6 +408,7 @@ SectorStats::SectorStats()
       num_put_spins(0),
       num_get(0),
       num_get_hit(0),
+      num_get_lock_free(0),
       used_entries(0),
       used_blocks(0) {
 }
@@ -264,6 +422,7 @@ void SectorStats::Add(const SectorStats& other) {
   num_put_spins += other.num_put_spins;
   num_get += other.num_get;
   num_get_hit += other.num_get_hit;
+  num_get_lock_free += other.num_get_lock_free;
   used_entries += other.used_entries;
   used_blocks += other.used_blocks;
 }
@@ -292,6 +451,9 @@ GoogleString SectorStats::Dump(size_t total_entries,
   StringAppendF(&out, "  hits: %s (%.2f%%)\n",
                 Integer64ToString(num_get_hit).c_str(),
                 percent(num_get_hit, num_get));
+  StringAppendF(&out, "  served without sector lock: %s (%.2f%%)\n",
+                Integer64ToString(num_get_lock_free).c_str(),
+                percent(num_get_lock_free, num_get));
 
   StringAppendF(&out, "Entries used: %s (%.2f%%)\n",
                 Integer64ToString(used_entries).c_str(),
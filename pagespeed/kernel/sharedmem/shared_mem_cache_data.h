@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "base/logging.h"
+#include "pagespeed/kernel/base/atomicops.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
@@ -37,6 +38,7 @@ class AbstractMutex;
 class AbstractSharedMem;
 class AbstractSharedMemSegment;
 class MessageHandler;
+class SharedString;
 
 namespace SharedMemCacheData {
 
@@ -66,6 +68,7 @@ struct SectorStats {
   int64 num_put_spins;  // # of times writers had to sleep behind readers
   int64 num_get;    // # of calls to get
   int64 num_get_hit;
+  int64 num_get_lock_free;  // gets answered without taking the sector lock
 
   // Current state stats --- updated by SharedMemCacheData
   int64 used_entries;
@@ -108,7 +111,12 @@ struct CacheEntry {
   // Number of readers currently accessing the data.
   uint32 open_count : 31;
 
-  uint32 padding;  // ensures we're 8-aligned.
+  // Sequence number for lock-free readers. It is odd while the entry is
+  // being written (e.g. whenever creating is set), and is advanced whenever
+  // the entry's key, size, or blocks change. Only modified with the sector
+  // lock held, via the Sector::*EntryWrite methods; read with atomic ops.
+  // Also keeps us 8-aligned.
+  base::subtle::Atomic32 version;
 };
 
 // Helper for operating on a given sector's data structures; helping
@@ -250,6 +258,92 @@ class Sector {
   int BlockListForEntry(CacheEntry* entry, BlockVector* out_blocks)
       EXCLUSIVE_LOCKS_REQUIRED(mutex());
 
+  // Lock-free read support
+  // ------------------------------------------------------------
+  //
+  // Readers may copy out an entry without the sector lock, seqlock-style:
+  // they read the entry's version, copy the payload, and then check that the
+  // version did not change in the mean time (and that it was even, meaning
+  // no write was in progress). Writers, which always hold the sector lock
+  // while updating metadata, bracket their changes with BeginEntryWrite and
+  // EndEntryWrite, or call BumpEntryVersion for a one-shot change.
+
+  // Returns the current version of the entry. If it's odd, the entry is
+  // being written and must not be read without the lock.
+  static int32 EntryVersion(const CacheEntry* entry) {
+    return base::subtle::Acquire_Load(&entry->version);
+  }
+
+  // Returns true if the entry's version is still 'version', meaning that
+  // everything read from the entry since that version was fetched is
+  // consistent.
+  static bool EntryVersionUnchanged(const CacheEntry* entry, int32 version) {
+    base::subtle::MemoryBarrier();
+    return base::subtle::NoBarrier_Load(&entry->version) == version;
+  }
+
+  void BeginEntryWrite(CacheEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(mutex()) {
+    DCHECK_EQ(0, entry->version & 1);
+    base::subtle::NoBarrier_Store(&entry->version, entry->version + 1);
+    base::subtle::MemoryBarrier();
+  }
+
+  void EndEntryWrite(CacheEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(mutex()) {
+    DCHECK_EQ(1, entry->version & 1);
+    base::subtle::Release_Store(&entry->version, entry->version + 1);
+  }
+
+  // Advances the version without changing whether a write is in progress.
+  void BumpEntryVersion(CacheEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(mutex()) {
+    base::subtle::NoBarrier_Store(&entry->version, entry->version + 2);
+    base::subtle::MemoryBarrier();
+  }
+
+  // Copies the payload of the given entry into *out without the sector
+  // lock. The result is only meaningful if EntryVersionUnchanged() holds
+  // afterwards. Returns false if the metadata was visibly inconsistent,
+  // which can only happen if it was concurrently modified; in that case
+  // *out is in an unspecified state.
+  bool CopyEntryPayloadUnlocked(const CacheEntry* entry, size_t max_size,
+                                SharedString* out);
+
+  // Lock-free readers must not write to the shared segment, so they record
+  // their gets here, in process-local memory, and whoever next holds the
+  // sector lock applies them via DrainLockFreeGets. entry_num should be
+  // kInvalidEntry for a miss. Returns true if the caller should try to
+  // drain the buffer, e.g. because it is full. Touches may be
+  // dropped if the buffer overflows, since they're only an LRU hint.
+  bool RecordLockFreeGet(EntryNum entry_num);
+
+  // Folds the lock-free get counts into the sector statistics, and stores
+  // the entries lock-free readers have hit since the last call into
+  // touched[], which must have room for kDeferredTouches entries.
+  // Returns the number of entries stored.
+  int DrainLockFreeGets(EntryNum* touched) EXCLUSIVE_LOCKS_REQUIRED(mutex());
+
+  static const int kDeferredTouches = 64;
+
+  // Image ops
+  // ------------------------------------------------------------
+  //
+  // An image is a flat copy of the sector's header, block successor list,
+  // directory, and data blocks, in that order. It leaves out the mutex,
+  // whose size and contents depend on the shared memory implementation.
+
+  // Number of bytes in an image of this sector.
+  size_t ImageSize() const;
+
+  // Copies the sector into image, which must have room for ImageSize()
+  // bytes.
+  void CopyToImage(char* image) EXCLUSIVE_LOCKS_REQUIRED(mutex());
+
+  // Replaces the contents of the sector with the ImageSize() bytes at image.
+  // Returns false, leaving the sector alone, if any of the links in the
+  // image are out of range. Entries that were being read or written when
+  // the image was taken are copied as they were; it's up to the caller to
+  // clean them up.
+  bool RestoreFromImage(const char* image) EXCLUSIVE_LOCKS_REQUIRED(mutex());
+
   // Statistics stuff
   // ------------------------------------------------------------
 
@@ -263,6 +357,9 @@ class Sector {
   // Helper for doing sizing/memory layout computations.
   struct MemLayout;
 
+  // Size of the block successor list and directory in an image.
+  size_t ImageMetadataBytes() const;
+
   // How many piece_size pieces suffice to fit total
   static size_t NeededPieces(size_t total, size_t piece_size) {
     return (total + piece_size - 1) / piece_size;
@@ -281,6 +378,12 @@ class Sector {
   char* blocks_base_;
   size_t sector_offset_;  // offset of the sector within the SHM segment
 
+  // Process-local state for lock-free readers; see RecordLockFreeGet.
+  base::subtle::Atomic32 lock_free_gets_;
+  base::subtle::Atomic32 lock_free_hits_;
+  base::subtle::Atomic32 num_deferred_touches_;
+  base::subtle::Atomic32 deferred_touches_[kDeferredTouches];
+
   DISALLOW_COPY_AND_ASSIGN(Sector);
 };
 
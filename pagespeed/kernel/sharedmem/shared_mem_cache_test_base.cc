@@ -21,10 +21,15 @@
 #include <map>
 #include <utility>
 
+#include "base/logging.h"
 #include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mem_file_system.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/shared_string.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_cache.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_cache_snapshot.pb.h"
@@ -42,6 +47,54 @@ const int kSectorEntries = 256;
 
 const int kSpinRuns = 100;
 
+// Parameters for the contention test: kContentionReaders processes each do
+// kContentionGets lookups over kContentionKeys keys, while the parent
+// rewrites all of them kContentionWrites times.
+const int kContentionReaders = 4;
+const int kContentionGets = 20000;
+const int kContentionKeys = 8;
+const int kContentionWrites = 1000;
+
+GoogleString ContentionKey(int k) {
+  return StrCat("contended", IntegerToString(k));
+}
+
+// Values written for a given key vary between 1 and 3 blocks in length
+// between generations, so that the writer keeps moving them between blocks,
+// and are filled with a single character, so torn reads are easy to detect.
+// The last key's values are bigger than MultiGet will copy under the lock.
+int ContentionValueSize(int k, int fill) {
+  int size = 700 * ((k + fill) % 3) + 17 + k;
+  if (k == kContentionKeys - 1) {
+    size += 5000;
+  }
+  return size;
+}
+
+GoogleString ContentionValue(int k, int generation) {
+  int fill = generation % 26;
+  return GoogleString(ContentionValueSize(k, fill), 'a' + fill);
+}
+
+// Returns true if value is something ContentionValue(k, ...) could have
+// produced.
+bool IsConsistentContentionValue(int k, StringPiece value) {
+  if (value.empty()) {
+    return false;
+  }
+  int fill = value[0] - 'a';
+  if ((fill < 0) || (fill >= 26) ||
+      (static_cast<int>(value.size()) != ContentionValueSize(k, fill))) {
+    return false;
+  }
+  for (size_t i = 1; i < value.size(); ++i) {
+    if (value[i] != value[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // In some tests we have tight consumer/producer spinloops assuming they'll get
 // preempted to let other end proceed. Valgrind does not actually do that
 // sometimes.
@@ -376,6 +429,171 @@ void SharedMemCacheTestBase::TestSnapshot() {
   }
 }
 
+void SharedMemCacheTestBase::TestSnapshotFile() {
+  const int kEntries = 20;
+  for (int i = 0; i < kEntries; ++i) {
+    CheckPut(StrCat("key", IntegerToString(i)),
+             StrCat("val", IntegerToString(i)));
+    timer_.AdvanceMs(1);
+  }
+  CheckPut("big", large_);
+
+  SharedMemCacheDump dump;
+  for (int i = 0; i < kSectors; ++i) {
+    Cache()->AddSectorToSnapshot(i, &dump);
+  }
+
+  MemFileSystem file_system(thread_system_.get(), &timer_);
+  GoogleString path = StrCat(GTestTempDir(), "/shared_mem_cache_snapshot");
+  ASSERT_TRUE(Cache()->SaveSnapshotFile(path, &file_system));
+
+  // A fresh cache restored from the file should have the same entries, with
+  // the same timestamps and LRU order.
+  ResetCache();
+  CheckNotFound("big");
+  EXPECT_TRUE(Cache()->RestoreSnapshotFile(path, &file_system));
+  SharedMemCacheDump restored_dump;
+  for (int i = 0; i < kSectors; ++i) {
+    Cache()->AddSectorToSnapshot(i, &restored_dump);
+  }
+  CheckDumpsEqual(dump, restored_dump, "dump vs. restored_dump");
+  for (int i = 0; i < kEntries; ++i) {
+    CheckGet(StrCat("key", IntegerToString(i)),
+             StrCat("val", IntegerToString(i)));
+  }
+  CheckGet("big", large_);
+
+  // The restored cache should keep working normally.
+  CheckPut("new", "value");
+  CheckGet("new", "value");
+  CheckDelete("key0");
+  CheckNotFound("key0");
+
+  // Damage the last sector's image. The other sector should still be
+  // restored.
+  GoogleString contents;
+  ASSERT_TRUE(file_system.ReadFile(path.c_str(), &contents, &handler_));
+  contents[contents.size() - 1] ^= 1;
+  ASSERT_TRUE(file_system.WriteFile(path.c_str(), contents, &handler_));
+  ResetCache();
+  EXPECT_FALSE(Cache()->RestoreSnapshotFile(path, &file_system));
+  int found = 0;
+  for (int i = 0; i < kEntries; ++i) {
+    GoogleString key = StrCat("key", IntegerToString(i));
+    Callback* callback = InitiateGet(key);
+    if (callback->state() == CacheInterface::kAvailable) {
+      EXPECT_EQ(StrCat("val", IntegerToString(i)), callback->value()->Value());
+      ++found;
+    }
+  }
+  EXPECT_LT(0, found);
+  EXPECT_GT(kEntries, found);
+  SanityCheck();
+
+  // Caches of a different shape can't use the file at all, nor can anyone
+  // use a file that isn't there.
+  scoped_ptr<SharedMemCache<kBlockSize> > other_cache(
+      new SharedMemCache<kBlockSize>(shmem_runtime_.get(), kAltSegment,
+                                     &timer_, &hasher_, kSectors,
+                                     kSectorEntries * 2, kSectorBlocks,
+                                     &handler_));
+  ASSERT_TRUE(other_cache->Initialize());
+  EXPECT_FALSE(other_cache->RestoreSnapshotFile(path, &file_system));
+  other_cache->GlobalCleanup(shmem_runtime_.get(), kAltSegment, &handler_);
+  EXPECT_FALSE(Cache()->RestoreSnapshotFile(StrCat(path, ".missing"),
+                                            &file_system));
+}
+
+void SharedMemCacheTestBase::TestMultiGet() {
+  CheckPut("200", "OK");
+  CheckPut("big", large_);
+  CheckPut("002", "KO!");
+
+  Callback* ok = AddCallback();
+  Callback* not_found = AddCallback();
+  Callback* big = AddCallback();
+  IssueMultiGet(ok, "200", not_found, "404", big, "big");
+  WaitAndCheck(ok, "OK");
+  WaitAndCheckNotFound(not_found);
+  WaitAndCheck(big, large_);
+}
+
+void SharedMemCacheTestBase::TestContention() {
+  // This is too much traffic to sanity-check after every operation.
+  sanity_checks_enabled_ = false;
+  for (int k = 0; k < kContentionKeys; ++k) {
+    CheckPut(ContentionKey(k), ContentionValue(k, 0));
+  }
+
+  scoped_ptr<Timer> timer(Platform::CreateTimer());
+  int64 start_us = timer->NowUs();
+  for (int c = 0; c < kContentionReaders; ++c) {
+    ASSERT_TRUE(CreateChild(&SharedMemCacheTestBase::TestContentionChild));
+  }
+
+  for (int i = 1; i <= kContentionWrites; ++i) {
+    for (int k = 0; k < kContentionKeys; ++k) {
+      SharedString value(ContentionValue(k, i));
+      cache_->Put(ContentionKey(k), &value);
+    }
+  }
+  test_env_->WaitForChildren();
+  int64 elapsed_us = timer->NowUs() - start_us;
+
+  LOG(INFO) << "SharedMemCache contention: " << kContentionReaders
+            << " readers x " << kContentionGets << " gets against "
+            << kContentionWrites * kContentionKeys << " writes took "
+            << elapsed_us << "us\n" << cache_->DumpStats();
+
+  cache_->SanityCheck();
+  for (int k = 0; k < kContentionKeys; ++k) {
+    CheckGet(ContentionKey(k), ContentionValue(k, kContentionWrites));
+  }
+}
+
+void SharedMemCacheTestBase::TestContentionChild() {
+  scoped_ptr<SharedMemCache<kBlockSize> > child_cache(MakeCache());
+  if (!child_cache->Attach()) {
+    test_env_->ChildFailed();
+  }
+
+  CacheTestBase::Callback callback;
+  for (int i = 0; i < kContentionGets; ++i) {
+    int k = i % kContentionKeys;
+    child_cache->Get(ContentionKey(k), callback.Reset());
+    if (!callback.called()) {
+      test_env_->ChildFailed();
+    }
+
+    // Misses are fine if we ran into the writer, but anything we do get
+    // must be a complete value.
+    if ((callback.state() == CacheInterface::kAvailable) &&
+        !IsConsistentContentionValue(k, callback.value()->Value())) {
+      test_env_->ChildFailed();
+    }
+  }
+
+  // Batched lookups fall back to the locked path per sector rather than
+  // per key, so exercise them against the writer as well.
+  CacheTestBase::Callback callbacks[kContentionKeys];
+  for (int i = 0; i < kContentionGets / kContentionKeys; ++i) {
+    CacheInterface::MultiGetRequest* request =
+        new CacheInterface::MultiGetRequest;
+    for (int k = 0; k < kContentionKeys; ++k) {
+      request->push_back(CacheInterface::KeyCallback(ContentionKey(k),
+                                                     callbacks[k].Reset()));
+    }
+    child_cache->MultiGet(request);
+    for (int k = 0; k < kContentionKeys; ++k) {
+      if (!callbacks[k].called() ||
+          ((callbacks[k].state() == CacheInterface::kAvailable) &&
+           !IsConsistentContentionValue(k, callbacks[k].value()->Value()))) {
+        test_env_->ChildFailed();
+      }
+    }
+  }
+}
+
 void SharedMemCacheTestBase::CheckDelete(const char* key) {
   cache_->Delete(key);
   SanityCheck();
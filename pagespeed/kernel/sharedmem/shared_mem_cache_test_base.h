@@ -53,6 +53,9 @@ class SharedMemCacheTestBase : public CacheTestBase {
   void TestConflict();
   void TestEvict();
   void TestSnapshot();
+  void TestSnapshotFile();
+  void TestMultiGet();
+  void TestContention();
 
   void ResetCache();
 
@@ -66,6 +69,7 @@ class SharedMemCacheTestBase : public CacheTestBase {
   SharedMemCache<kBlockSize>* MakeCache();
   void CheckDelete(const char* key);
   void TestReaderWriterChild();
+  void TestContentionChild();
 
   scoped_ptr<SharedMemTestEnv> test_env_;
   scoped_ptr<AbstractSharedMem> shmem_runtime_;
@@ -121,9 +125,22 @@ TYPED_TEST_P(SharedMemCacheTestTemplate, TestSnapshot) {
   SharedMemCacheTestBase::TestSnapshot();
 }
 
+TYPED_TEST_P(SharedMemCacheTestTemplate, TestSnapshotFile) {
+  SharedMemCacheTestBase::TestSnapshotFile();
+}
+
+TYPED_TEST_P(SharedMemCacheTestTemplate, TestMultiGet) {
+  SharedMemCacheTestBase::TestMultiGet();
+}
+
+TYPED_TEST_P(SharedMemCacheTestTemplate, TestContention) {
+  SharedMemCacheTestBase::TestContention();
+}
+
 REGISTER_TYPED_TEST_CASE_P(SharedMemCacheTestTemplate, TestBasic, TestReinsert,
                            TestReplacement, TestReaderWriter, TestConflict,
-                           TestEvict, TestSnapshot);
+                           TestEvict, TestSnapshot, TestSnapshotFile,
+                           TestMultiGet, TestContention);
 
 }  // namespace net_instaweb
 
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/hasher.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/timer.h"
+
+namespace net_instaweb {
+
+namespace SharedMemOriginHealthData {
+
+// Memory structure, as for SharedMemLockManager:
+//
+// Bucket 0:
+//  Slot 0 .. Slot kSlotsPerBucket - 1
+//  Mutex
+//  (pad to 64-byte alignment)
+// Bucket 1:
+//  ..
+// Bucket kBuckets - 1:
+//  ..
+//
+// Each host is assigned to a bucket by its hash, and its slot holds the rest
+// of the hash as a key.  A slot with a hash of kFreeSlot is unused.
+const size_t kBuckets = 64;   // needs to be <= 65536 as we use 2 bytes of
+                              // hash to pick a bucket.
+const size_t kSlotsPerBucket = 16;
+
+const uint64 kFreeSlot = 0;
+
+struct Slot {
+  uint64 hash;
+  int64 last_use_ms;
+  double error_rate;
+  double latency_us;
+  int32 fetches;            // Recorded since the host was last unhealthy.
+  int32 state;              // A SharedMemOriginHealth::State.
+  int64 retry_at_ms;        // When unhealthy, when the next probe may go.
+  int64 retry_interval_ms;  // When unhealthy, the current retry interval.
+};
+
+struct Bucket {
+  Slot slots[kSlotsPerBucket];
+  char mutex_base[1];
+};
+
+inline size_t Align64(size_t in) {
+  return (in + 63) & ~63;
+}
+
+inline size_t BucketSize(size_t lock_size) {
+  return Align64(offsetof(Bucket, mutex_base) + lock_size);
+}
+
+inline size_t SegmentSize(size_t lock_size) {
+  return kBuckets * BucketSize(lock_size);
+}
+
+// The error rate and latency are each averaged over about this many
+// fetches.
+const double kWindow = 10;
+
+}  // namespace SharedMemOriginHealthData
+
+namespace Data = SharedMemOriginHealthData;
+
+namespace {
+
+const char kSharedMemOriginHealthObjName[] = "SharedMemOriginHealth";
+
+}  // namespace
+
+const double SharedMemOriginHealth::kErrorRateThreshold = 0.5;
+const int SharedMemOriginHealth::kMinFetches = 5;
+const int64 SharedMemOriginHealth::kInitialRetryMs = 5 * Timer::kSecondMs;
+const int64 SharedMemOriginHealth::kMaxRetryMs = Timer::kMinuteMs;
+
+SharedMemOriginHealth::SharedMemOriginHealth(
+    AbstractSharedMem* shm_runtime, const GoogleString& filename_prefix,
+    const GoogleString& filename_suffix, Timer* timer, Hasher* hasher)
+    : shm_runtime_(shm_runtime),
+      filename_prefix_(filename_prefix),
+      filename_suffix_(filename_suffix),
+      timer_(timer),
+      hasher_(hasher),
+      bucket_size_(Data::BucketSize(shm_runtime->SharedMutexSize())) {
+}
+
+SharedMemOriginHealth::~SharedMemOriginHealth() {
+}
+
+bool SharedMemOriginHealth::InitSegment(bool parent,
+                                        MessageHandler* handler) {
+  size_t size = Data::SegmentSize(shm_runtime_->SharedMutexSize());
+  if (parent) {
+    // The segment comes zeroed, so every slot starts out free.
+    segment_.reset(shm_runtime_->CreateSegment(SegmentName(), size, handler));
+    if (segment_.get() == NULL) {
+      return false;
+    }
+    for (size_t b = 0; b < Data::kBuckets; ++b) {
+      Data::Bucket* bucket = GetBucket(b);
+      if (!segment_->InitializeSharedMutex(
+              bucket->mutex_base - segment_->Base(), handler)) {
+        handler->Message(
+            kError, "Unable to create mutex for shared memory origin health");
+        segment_.reset(NULL);
+        shm_runtime_->DestroySegment(SegmentName(), handler);
+        return false;
+      }
+    }
+  } else {
+    segment_.reset(
+        shm_runtime_->AttachToSegment(SegmentName(), size, handler));
+    if (segment_.get() == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SharedMemOriginHealth::GlobalCleanup(MessageHandler* handler) {
+  if (segment_.get() != NULL) {
+    shm_runtime_->DestroySegment(SegmentName(), handler);
+  }
+}
+
+bool SharedMemOriginHealth::AllowFetch(const StringPiece& host) {
+  size_t bucket_num;
+  uint64 hash;
+  GetBucketAndHash(host, &bucket_num, &hash);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+  int64 now_ms = timer_->NowMs();
+
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(bucket));
+  ScopedMutex hold_lock(mutex.get());
+  Data::Slot* slot = FindSlot(bucket, hash, false, now_ms);
+  if ((slot == NULL) || (slot->state == kHealthy)) {
+    return true;
+  }
+  if (now_ms < slot->retry_at_ms) {
+    return false;
+  }
+  // Time to probe.  If the probe doesn't report back within the retry
+  // interval, presume it lost and let another go.
+  slot->state = kProbing;
+  slot->retry_at_ms = now_ms + slot->retry_interval_ms;
+  return true;
+}
+
+void SharedMemOriginHealth::RecordFetch(const StringPiece& host, bool success,
+                                        int64 latency_us) {
+  size_t bucket_num;
+  uint64 hash;
+  GetBucketAndHash(host, &bucket_num, &hash);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+  int64 now_ms = timer_->NowMs();
+
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(bucket));
+  ScopedMutex hold_lock(mutex.get());
+  Data::Slot* slot = FindSlot(bucket, hash, true, now_ms);
+  // Until a window's worth of fetches has been recorded this is their plain
+  // mean, so that a single early failure does not dominate the rate.
+  double error = success ? 0.0 : 1.0;
+  double divisor = std::min(static_cast<double>(slot->fetches) + 1,
+                            Data::kWindow);
+  slot->error_rate += (error - slot->error_rate) / divisor;
+  if (slot->fetches < kint32max) {
+    ++slot->fetches;
+  }
+  if (success) {
+    double sample = static_cast<double>(latency_us);
+    if (slot->latency_us == 0) {
+      slot->latency_us = sample;
+    } else {
+      slot->latency_us += (sample - slot->latency_us) / Data::kWindow;
+    }
+  }
+
+  if (slot->state == kHealthy) {
+    if ((slot->fetches >= kMinFetches) &&
+        (slot->error_rate >= kErrorRateThreshold)) {
+      slot->state = kUnhealthy;
+      slot->retry_interval_ms = kInitialRetryMs;
+      slot->retry_at_ms = now_ms + kInitialRetryMs;
+    }
+  } else if (success) {
+    // Start over, so that it takes kMinFetches new fetches to judge it.
+    slot->state = kHealthy;
+    slot->fetches = 0;
+    slot->retry_interval_ms = 0;
+    slot->retry_at_ms = 0;
+  } else if (slot->state == kProbing) {
+    slot->state = kUnhealthy;
+    slot->retry_interval_ms = std::min(2 * slot->retry_interval_ms,
+                                       kMaxRetryMs);
+    slot->retry_at_ms = now_ms + slot->retry_interval_ms;
+  }
+}
+
+SharedMemOriginHealth::State SharedMemOriginHealth::GetState(
+    const StringPiece& host) {
+  size_t bucket_num;
+  uint64 hash;
+  GetBucketAndHash(host, &bucket_num, &hash);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(bucket));
+  ScopedMutex hold_lock(mutex.get());
+  Data::Slot* slot = FindSlot(bucket, hash, false, 0);
+  return (slot == NULL) ? kHealthy : static_cast<State>(slot->state);
+}
+
+double SharedMemOriginHealth::ErrorRate(const StringPiece& host) {
+  size_t bucket_num;
+  uint64 hash;
+  GetBucketAndHash(host, &bucket_num, &hash);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(bucket));
+  ScopedMutex hold_lock(mutex.get());
+  Data::Slot* slot = FindSlot(bucket, hash, false, 0);
+  return (slot == NULL) ? 0.0 : slot->error_rate;
+}
+
+int64 SharedMemOriginHealth::LatencyUs(const StringPiece& host) {
+  size_t bucket_num;
+  uint64 hash;
+  GetBucketAndHash(host, &bucket_num, &hash);
+  Data::Bucket* bucket = GetBucket(bucket_num);
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(bucket));
+  ScopedMutex hold_lock(mutex.get());
+  Data::Slot* slot = FindSlot(bucket, hash, false, 0);
+  return (slot == NULL) ? 0 : static_cast<int64>(slot->latency_us);
+}
+
+void SharedMemOriginHealth::GetBucketAndHash(const StringPiece& host,
+                                             size_t* bucket,
+                                             uint64* hash) const {
+  GoogleString raw_hash = hasher_->RawHash(host);
+
+  // As in SharedMemLockManager, 2 bytes of the hash choose the bucket, and 8
+  // others form the key.
+  CHECK_GE(raw_hash.size(), 10u);
+  unsigned char bucket_low = static_cast<unsigned char>(raw_hash[8]);
+  unsigned char bucket_high = static_cast<unsigned char>(raw_hash[9]);
+  *bucket = (bucket_high * 256 + bucket_low) % Data::kBuckets;
+
+  uint64 key = 0;
+  for (int c = 0; c < 8; ++c) {
+    key = (key << 8) | static_cast<unsigned char>(raw_hash[c]);
+  }
+  if (key == Data::kFreeSlot) {
+    key = 1;
+  }
+  *hash = key;
+}
+
+Data::Bucket* SharedMemOriginHealth::GetBucket(size_t bucket) const {
+  return reinterpret_cast<Data::Bucket*>(
+      const_cast<char*>(segment_->Base()) + bucket * bucket_size_);
+}
+
+AbstractMutex* SharedMemOriginHealth::AttachMutex(Data::Bucket* bucket) const {
+  return segment_->AttachToSharedMutex(bucket->mutex_base - segment_->Base());
+}
+
+Data::Slot* SharedMemOriginHealth::FindSlot(Data::Bucket* bucket, uint64 hash,
+                                            bool create, int64 now_ms) const {
+  Data::Slot* free_slot = NULL;
+  Data::Slot* oldest_slot = NULL;
+  for (size_t s = 0; s < Data::kSlotsPerBucket; ++s) {
+    Data::Slot* slot = &bucket->slots[s];
+    if (slot->hash == hash) {
+      if (create) {
+        slot->last_use_ms = now_ms;
+      }
+      return slot;
+    } else if (slot->hash == Data::kFreeSlot) {
+      if (free_slot == NULL) {
+        free_slot = slot;
+      }
+    } else if ((oldest_slot == NULL) ||
+               (slot->last_use_ms < oldest_slot->last_use_ms)) {
+      oldest_slot = slot;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  Data::Slot* slot = (free_slot != NULL) ? free_slot : oldest_slot;
+  slot->hash = hash;
+  slot->last_use_ms = now_ms;
+  slot->error_rate = 0;
+  slot->latency_us = 0;
+  slot->fetches = 0;
+  slot->state = kHealthy;
+  slot->retry_at_ms = 0;
+  slot->retry_interval_ms = 0;
+  return slot;
+}
+
+GoogleString SharedMemOriginHealth::SegmentName() const {
+  return StrCat(filename_prefix_, kSharedMemOriginHealthObjName, ".",
+                filename_suffix_);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+
+namespace net_instaweb {
+
+class AbstractMutex;
+class AbstractSharedMem;
+class AbstractSharedMemSegment;
+class Hasher;
+class MessageHandler;
+class Timer;
+
+namespace SharedMemOriginHealthData {
+
+struct Bucket;
+struct Slot;
+
+}  // namespace SharedMemOriginHealthData
+
+// Tracks the health of origin servers in shared memory, so that once one
+// process finds that an origin is down or failing, every process stops
+// fetching from it.  For each host it keeps moving averages of the error
+// rate and latency of recent fetches, and a circuit breaker:
+//  - A host starts out healthy, and fetches from it proceed.
+//  - Once enough fetches have been recorded and the error rate reaches the
+//    threshold, the host becomes unhealthy, and AllowFetch refuses fetches
+//    for a retry interval.
+//  - After that, AllowFetch lets one fetch through as a probe.  If it
+//    succeeds, the host is healthy again; if it fails, the retry interval
+//    doubles, up to a minute.
+// Any successful fetch from an unhealthy host, such as a user-facing one
+// that was not asked about, also makes it healthy again.
+//
+// The table holds a fixed number of hosts, in buckets chosen by hash and
+// each guarded by its own shared mutex.  When a bucket is full, the host
+// least recently fetched from is forgotten.
+//
+// As with SharedCircularBuffer, call InitSegment(true, handler) once in the
+// root process, and InitSegment(false, handler) in each child.
+class SharedMemOriginHealth {
+ public:
+  enum State {
+    kHealthy,
+    kUnhealthy,
+    kProbing  // Unhealthy, with a probe fetch outstanding.
+  };
+
+  // filename_prefix and filename_suffix are used to name the segment, as for
+  // SharedCircularBuffer.  Does not take ownership of any of the arguments.
+  SharedMemOriginHealth(AbstractSharedMem* shm_runtime,
+                        const GoogleString& filename_prefix,
+                        const GoogleString& filename_suffix,
+                        Timer* timer, Hasher* hasher);
+  ~SharedMemOriginHealth();
+
+  // Creates the shared memory segment if parent is true, and attaches to it
+  // otherwise.  Returns whether successful.
+  bool InitSegment(bool parent, MessageHandler* handler);
+
+  // This should be called from the root process as it is about to exit, when
+  // no future children are expected to start.
+  void GlobalCleanup(MessageHandler* handler);
+
+  // Returns whether a fetch from host should go out now: true unless the
+  // host is unhealthy, or is being probed by another fetch.  Returning true
+  // for an unhealthy host starts a probe, so the caller must follow up with
+  // RecordFetch.  host should be lower-case.
+  bool AllowFetch(const StringPiece& host);
+
+  // Records the outcome of a fetch from host that took latency_us.
+  void RecordFetch(const StringPiece& host, bool success, int64 latency_us);
+
+  // Returns the state of host; kHealthy if it is not being tracked.
+  State GetState(const StringPiece& host);
+
+  // Returns the moving average of the error rate of fetches from host,
+  // between 0 and 1, or 0 if it is not being tracked.
+  double ErrorRate(const StringPiece& host);
+
+  // Returns the moving average of the latency of successful fetches from
+  // host, or 0 if none have been recorded.
+  int64 LatencyUs(const StringPiece& host);
+
+  // The error rate at which a host becomes unhealthy, once at least
+  // kMinFetches fetches from it have been recorded.
+  static const double kErrorRateThreshold;
+  static const int kMinFetches;
+  // How long an unhealthy host is left alone before it is probed, at first,
+  // and at most after repeated failed probes.
+  static const int64 kInitialRetryMs;
+  static const int64 kMaxRetryMs;
+
+ private:
+  // Computes the bucket and key hash for host.
+  void GetBucketAndHash(const StringPiece& host, size_t* bucket,
+                        uint64* hash) const;
+  SharedMemOriginHealthData::Bucket* GetBucket(size_t bucket) const;
+  AbstractMutex* AttachMutex(SharedMemOriginHealthData::Bucket* bucket) const;
+
+  // Returns the slot for hash in bucket, or NULL if it is not there.  If
+  // create is true, a missing host is given a slot, replacing the one least
+  // recently used if need be.  Must be called with the bucket's mutex held.
+  SharedMemOriginHealthData::Slot* FindSlot(
+      SharedMemOriginHealthData::Bucket* bucket, uint64 hash, bool create,
+      int64 now_ms) const;
+
+  GoogleString SegmentName() const;
+
+  AbstractSharedMem* shm_runtime_;
+  const GoogleString filename_prefix_;
+  const GoogleString filename_suffix_;
+  Timer* timer_;
+  Hasher* hasher_;
+  size_t bucket_size_;
+  scoped_ptr<AbstractSharedMemSegment> segment_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemOriginHealth);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_H_
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health_test_base.h"
+
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kPrefix[] = "/prefix/";
+const char kSuffix[] = "suffix";
+const char kHostA[] = "a.example.com";
+const char kHostB[] = "b.example.com";
+const int64 kLatencyUs = 100000;
+
+}  // namespace
+
+SharedMemOriginHealthTestBase::SharedMemOriginHealthTestBase(
+    SharedMemTestEnv* test_env)
+    : test_env_(test_env),
+      shmem_runtime_(test_env->CreateSharedMemRuntime()),
+      thread_system_(Platform::CreateThreadSystem()),
+      timer_(thread_system_->NewMutex(), 0),
+      handler_(thread_system_->NewMutex()) {
+}
+
+void SharedMemOriginHealthTestBase::SetUp() {
+  root_origin_health_.reset(CreateOriginHealth());
+  EXPECT_TRUE(root_origin_health_->InitSegment(true, &handler_));
+}
+
+void SharedMemOriginHealthTestBase::TearDown() {
+  root_origin_health_->GlobalCleanup(&handler_);
+}
+
+bool SharedMemOriginHealthTestBase::CreateChild(TestMethod method) {
+  Function* callback =
+      new MemberFunction0<SharedMemOriginHealthTestBase>(method, this);
+  return test_env_->CreateChild(callback);
+}
+
+SharedMemOriginHealth* SharedMemOriginHealthTestBase::CreateOriginHealth() {
+  return new SharedMemOriginHealth(shmem_runtime_.get(), kPrefix, kSuffix,
+                                   &timer_, &hasher_);
+}
+
+SharedMemOriginHealth* SharedMemOriginHealthTestBase::AttachDefault() {
+  SharedMemOriginHealth* origin_health = CreateOriginHealth();
+  if (!origin_health->InitSegment(false, &handler_)) {
+    delete origin_health;
+    origin_health = NULL;
+  }
+  return origin_health;
+}
+
+void SharedMemOriginHealthTestBase::MakeUnhealthy(
+    SharedMemOriginHealth* origin_health, const char* host) {
+  for (int i = 0; i < SharedMemOriginHealth::kMinFetches; ++i) {
+    origin_health->RecordFetch(host, false, 0);
+  }
+}
+
+void SharedMemOriginHealthTestBase::TestBecomesUnhealthy() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+
+  // Hosts we know nothing about are healthy.
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+  EXPECT_EQ(0.0, origin_health->ErrorRate(kHostA));
+
+  // Every fetch fails, but it takes kMinFetches of them to judge the host.
+  for (int i = 1; i < SharedMemOriginHealth::kMinFetches; ++i) {
+    origin_health->RecordFetch(kHostA, false, 0);
+    EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  }
+  EXPECT_EQ(1.0, origin_health->ErrorRate(kHostA));
+  origin_health->RecordFetch(kHostA, false, 0);
+  EXPECT_EQ(SharedMemOriginHealth::kUnhealthy,
+            origin_health->GetState(kHostA));
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+
+  // Other hosts are unaffected.
+  EXPECT_TRUE(origin_health->AllowFetch(kHostB));
+
+  // A fetch that goes out anyway and succeeds makes the host healthy again.
+  origin_health->RecordFetch(kHostA, true, kLatencyUs);
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  EXPECT_EQ(kLatencyUs, origin_health->LatencyUs(kHostA));
+
+  // And it again takes kMinFetches failures to make it unhealthy.
+  for (int i = 1; i < SharedMemOriginHealth::kMinFetches; ++i) {
+    origin_health->RecordFetch(kHostA, false, 0);
+  }
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  origin_health->RecordFetch(kHostA, false, 0);
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+}
+
+void SharedMemOriginHealthTestBase::TestOccasionalErrors() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+
+  // One fetch in four failing isn't enough to make a host unhealthy.
+  for (int i = 0; i < 100; ++i) {
+    bool success = (i % 4) != 3;
+    origin_health->RecordFetch(kHostA, success, success ? kLatencyUs : 0);
+    EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  }
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+  EXPECT_LT(0.0, origin_health->ErrorRate(kHostA));
+  EXPECT_GT(SharedMemOriginHealth::kErrorRateThreshold,
+            origin_health->ErrorRate(kHostA));
+  // Failed fetches don't count towards latency.
+  EXPECT_EQ(kLatencyUs, origin_health->LatencyUs(kHostA));
+
+  // A run of failures does.
+  for (int i = 0; i < 10; ++i) {
+    origin_health->RecordFetch(kHostA, false, 0);
+  }
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+}
+
+void SharedMemOriginHealthTestBase::TestEarlyError() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+
+  // Nor is it when the very first fetch is the one that fails.
+  for (int i = 0; i < 100; ++i) {
+    bool success = (i % 4) != 0;
+    origin_health->RecordFetch(kHostA, success, success ? kLatencyUs : 0);
+    EXPECT_TRUE(origin_health->AllowFetch(kHostA)) << i;
+  }
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+}
+
+void SharedMemOriginHealthTestBase::TestOccasionalErrorsAfterRecovery() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+  MakeUnhealthy(origin_health.get(), kHostA);
+  origin_health->RecordFetch(kHostA, true, kLatencyUs);
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+
+  // Once recovered, one fetch in four failing still isn't enough to make the
+  // host unhealthy, even though the errors from before recovery were many.
+  for (int i = 0; i < 100; ++i) {
+    bool success = (i % 4) != 0;
+    origin_health->RecordFetch(kHostA, success, success ? kLatencyUs : 0);
+    EXPECT_TRUE(origin_health->AllowFetch(kHostA)) << i;
+  }
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+  EXPECT_GT(SharedMemOriginHealth::kErrorRateThreshold,
+            origin_health->ErrorRate(kHostA));
+}
+
+void SharedMemOriginHealthTestBase::TestProbe() {
+  const int64 kRetryMs = SharedMemOriginHealth::kInitialRetryMs;
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+  MakeUnhealthy(origin_health.get(), kHostA);
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+
+  // Once the retry interval is up, exactly one fetch is let through.
+  timer_.AdvanceMs(kRetryMs - 1);
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+  timer_.AdvanceMs(1);
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  EXPECT_EQ(SharedMemOriginHealth::kProbing, origin_health->GetState(kHostA));
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+
+  // It fails, so the next probe waits twice as long.
+  origin_health->RecordFetch(kHostA, false, 0);
+  EXPECT_EQ(SharedMemOriginHealth::kUnhealthy,
+            origin_health->GetState(kHostA));
+  timer_.AdvanceMs(kRetryMs);
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+  timer_.AdvanceMs(kRetryMs);
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+
+  // That probe never reports back, so after another interval a new one goes.
+  timer_.AdvanceMs(2 * kRetryMs);
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+
+  // It succeeds, so the host is healthy again.
+  origin_health->RecordFetch(kHostA, true, kLatencyUs);
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy, origin_health->GetState(kHostA));
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+
+  // However many probes fail, the retry interval is capped.
+  MakeUnhealthy(origin_health.get(), kHostA);
+  for (int i = 0; i < 10; ++i) {
+    timer_.AdvanceMs(SharedMemOriginHealth::kMaxRetryMs);
+    EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+    origin_health->RecordFetch(kHostA, false, 0);
+  }
+  timer_.AdvanceMs(SharedMemOriginHealth::kMaxRetryMs - 1);
+  EXPECT_FALSE(origin_health->AllowFetch(kHostA));
+  timer_.AdvanceMs(1);
+  EXPECT_TRUE(origin_health->AllowFetch(kHostA));
+}
+
+void SharedMemOriginHealthTestBase::TestSharedWithChild() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+  MakeUnhealthy(origin_health.get(), kHostA);
+
+  ASSERT_TRUE(CreateChild(
+      &SharedMemOriginHealthTestBase::TestSharedWithChildChild));
+  test_env_->WaitForChildren();
+
+  // What the child learned about B is visible here.
+  EXPECT_EQ(SharedMemOriginHealth::kUnhealthy,
+            origin_health->GetState(kHostB));
+  EXPECT_FALSE(origin_health->AllowFetch(kHostB));
+}
+
+void SharedMemOriginHealthTestBase::TestSharedWithChildChild() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  if (origin_health.get() == NULL) {
+    test_env_->ChildFailed();
+    return;
+  }
+  // The parent found A unhealthy.
+  if (origin_health->AllowFetch(kHostA) || !origin_health->AllowFetch(kHostB)) {
+    test_env_->ChildFailed();
+  }
+  MakeUnhealthy(origin_health.get(), kHostB);
+}
+
+void SharedMemOriginHealthTestBase::TestManyHosts() {
+  scoped_ptr<SharedMemOriginHealth> origin_health(AttachDefault());
+  ASSERT_TRUE(origin_health.get() != NULL);
+
+  // Far more hosts than the table holds; the oldest are forgotten, and the
+  // most recent are remembered.
+  GoogleString host;
+  for (int i = 0; i < 5000; ++i) {
+    host = StrCat("host", IntegerToString(i), ".example.com");
+    timer_.AdvanceMs(1);
+    MakeUnhealthy(origin_health.get(), host.c_str());
+  }
+  EXPECT_EQ(SharedMemOriginHealth::kUnhealthy, origin_health->GetState(host));
+  EXPECT_FALSE(origin_health->AllowFetch(host));
+  EXPECT_EQ(SharedMemOriginHealth::kHealthy,
+            origin_health->GetState("host0.example.com"));
+}
+
+}  // namespace net_instaweb
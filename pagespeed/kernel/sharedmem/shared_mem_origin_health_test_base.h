@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_TEST_BASE_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_TEST_BASE_H_
+
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/md5_hasher.h"
+#include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/mock_timer.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+
+namespace net_instaweb {
+
+class SharedMemOriginHealthTestBase : public testing::Test {
+ protected:
+  typedef void (SharedMemOriginHealthTestBase::*TestMethod)();
+
+  explicit SharedMemOriginHealthTestBase(SharedMemTestEnv* test_env);
+  virtual void SetUp();
+  virtual void TearDown();
+
+  void TestBecomesUnhealthy();
+  void TestOccasionalErrors();
+  void TestEarlyError();
+  void TestOccasionalErrorsAfterRecovery();
+  void TestProbe();
+  void TestSharedWithChild();
+  void TestManyHosts();
+
+ private:
+  bool CreateChild(TestMethod method);
+
+  SharedMemOriginHealth* CreateOriginHealth();
+  SharedMemOriginHealth* AttachDefault();
+
+  // Records enough failed fetches from host to make it unhealthy.
+  void MakeUnhealthy(SharedMemOriginHealth* origin_health, const char* host);
+
+  void TestSharedWithChildChild();
+
+  scoped_ptr<SharedMemTestEnv> test_env_;
+  scoped_ptr<AbstractSharedMem> shmem_runtime_;
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockTimer timer_;   // Note: if we are running in a process-based environment
+                      // this object is not shared at all; therefore all time
+                      // advancement must be done in either parent or kid but
+                      // not both.
+  MockMessageHandler handler_;
+  MD5Hasher hasher_;
+  scoped_ptr<SharedMemOriginHealth> root_origin_health_;  // for init only.
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemOriginHealthTestBase);
+};
+
+template<typename ConcreteTestEnv>
+class SharedMemOriginHealthTestTemplate : public SharedMemOriginHealthTestBase {
+ public:
+  SharedMemOriginHealthTestTemplate()
+      : SharedMemOriginHealthTestBase(new ConcreteTestEnv) {
+  }
+};
+
+TYPED_TEST_CASE_P(SharedMemOriginHealthTestTemplate);
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestBecomesUnhealthy) {
+  SharedMemOriginHealthTestBase::TestBecomesUnhealthy();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestOccasionalErrors) {
+  SharedMemOriginHealthTestBase::TestOccasionalErrors();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestEarlyError) {
+  SharedMemOriginHealthTestBase::TestEarlyError();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate,
+             TestOccasionalErrorsAfterRecovery) {
+  SharedMemOriginHealthTestBase::TestOccasionalErrorsAfterRecovery();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestProbe) {
+  SharedMemOriginHealthTestBase::TestProbe();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestSharedWithChild) {
+  SharedMemOriginHealthTestBase::TestSharedWithChild();
+}
+
+TYPED_TEST_P(SharedMemOriginHealthTestTemplate, TestManyHosts) {
+  SharedMemOriginHealthTestBase::TestManyHosts();
+}
+
+REGISTER_TYPED_TEST_CASE_P(SharedMemOriginHealthTestTemplate,
+                           TestBecomesUnhealthy, TestOccasionalErrors,
+                           TestEarlyError, TestOccasionalErrorsAfterRecovery,
+                           TestProbe, TestSharedWithChild, TestManyHosts);
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_ORIGIN_HEALTH_TEST_BASE_H_
@@ -19,11 +19,13 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <limits>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/atomicops.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/null_mutex.h"
@@ -51,9 +53,81 @@ const char kStatisticsObjName[] = "statistics";
 // statistics.
 const char kTimestampVariable[] = "timestamp_";
 
+// Variables and histograms are each padded out to a multiple of this, so
+// that processes updating neighboring statistics don't contend for the same
+// cache line.
+const size_t kCacheLineSize = 64;
+
+size_t RoundUp(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+// The offset of a variable's value or a histogram's body from its mutex,
+// 8-byte aligned as atomic operations require.
+size_t DataOffset(size_t mutex_size) {
+  return RoundUp(mutex_size, sizeof(int64));
+}
+
+// Chromium's atomicops only provide 64-bit operations on 64-bit CPUs.
+// Elsewhere we take the statistics' mutexes, and these helpers are called
+// with the mutex held.
+#if defined(ARCH_CPU_64_BITS)
+#define SHARED_MEM_STATISTICS_LOCK_FREE 1
+
+using base::subtle::Atomic64;
+
+inline volatile Atomic64* AsAtomic64(volatile int64* value) {
+  COMPILE_ASSERT(sizeof(Atomic64) == sizeof(int64), atomic64_is_not_int64);
+  return reinterpret_cast<volatile Atomic64*>(value);
+}
+
+inline Atomic64 DoubleToBits(double value) {
+  Atomic64 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline double BitsToDouble(Atomic64 bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Replaces *value with op(*value, arg) using compare-and-swap, unless
+// op returns *value unchanged.
+template<class Op>
+inline void UpdateDouble(volatile double* value, double arg, Op op) {
+  volatile Atomic64* bits = reinterpret_cast<volatile Atomic64*>(value);
+  Atomic64 old_bits = base::subtle::NoBarrier_Load(bits);
+  for (;;) {
+    double old_value = BitsToDouble(old_bits);
+    double new_value = op(old_value, arg);
+    if (new_value == old_value) {
+      return;
+    }
+    Atomic64 seen_bits = base::subtle::NoBarrier_CompareAndSwap(
+        bits, old_bits, DoubleToBits(new_value));
+    if (seen_bits == old_bits) {
+      return;
+    }
+    old_bits = seen_bits;
+  }
+}
+#else
+template<class Op>
+inline void UpdateDouble(volatile double* value, double arg, Op op) {
+  *value = op(*value, arg);
+}
+#endif
+
+inline double Sum(double a, double b) { return a + b; }
+inline double Min(double a, double b) { return std::min(a, b); }
+inline double Max(double a, double b) { return std::max(a, b); }
+
 }  // namespace
 
-// Our shared memory storage format is an array of (mutex, int64).
+// Our shared memory storage format is an array of (mutex, int64), each
+// padded to a cache line, followed by the histograms.
 SharedMemVariable::SharedMemVariable(StringPiece name, Statistics* stats)
     : name_(name.as_string()),
       value_ptr_(NULL) {
@@ -88,6 +162,68 @@ SharedMemStatistics::Hist* SharedMemStatistics::NewHistogram(
   return new Hist(name, this);
 }
 
+size_t SharedMemVariable::AllocationSize(AbstractSharedMem* shm_runtime) {
+  return RoundUp(DataOffset(shm_runtime->SharedMutexSize()) + sizeof(int64),
+                 kCacheLineSize);
+}
+
+// A NULL mutex_ means that we failed to attach, in which case the mutexed
+// versions do nothing and return -1.
+#ifdef SHARED_MEM_STATISTICS_LOCK_FREE
+
+int64 SharedMemVariable::Get() const {
+  if (mutex_.get() == NULL) {
+    return -1;
+  }
+  return GetLockHeld();
+}
+
+void SharedMemVariable::Set(int64 value) {
+  SetReturningPreviousValue(value);
+}
+
+int64 SharedMemVariable::SetReturningPreviousValue(int64 value) {
+  if (mutex_.get() == NULL) {
+    return -1;
+  }
+  return SetReturningPreviousValueLockHeld(value);
+}
+
+int64 SharedMemVariable::AddHelper(int64 delta) {
+  if (mutex_.get() == NULL) {
+    return -1;
+  }
+  return base::subtle::NoBarrier_AtomicIncrement(AsAtomic64(value_ptr_),
+                                                 delta);
+}
+
+int64 SharedMemVariable::GetLockHeld() const {
+  return base::subtle::NoBarrier_Load(AsAtomic64(value_ptr_));
+}
+
+int64 SharedMemVariable::SetReturningPreviousValueLockHeld(int64 new_value) {
+  return base::subtle::NoBarrier_AtomicExchange(AsAtomic64(value_ptr_),
+                                                new_value);
+}
+
+#else
+
+int64 SharedMemVariable::Get() const {
+  return MutexedScalar::Get();
+}
+
+void SharedMemVariable::Set(int64 value) {
+  MutexedScalar::Set(value);
+}
+
+int64 SharedMemVariable::SetReturningPreviousValue(int64 value) {
+  return MutexedScalar::SetReturningPreviousValue(value);
+}
+
+int64 SharedMemVariable::AddHelper(int64 delta) {
+  return MutexedScalar::AddHelper(delta);
+}
+
 int64 SharedMemVariable::GetLockHeld() const {
   return *value_ptr_;
 }
@@ -98,6 +234,8 @@ int64 SharedMemVariable::SetReturningPreviousValueLockHeld(int64 new_value) {
   return previous_value;
 }
 
+#endif  // SHARED_MEM_STATISTICS_LOCK_FREE
+
 void SharedMemVariable::AttachTo(
     AbstractSharedMemSegment* segment, size_t offset,
     MessageHandler* message_handler) {
@@ -109,7 +247,7 @@ void SharedMemVariable::AttachTo(
   }
 
   value_ptr_ = reinterpret_cast<volatile int64*>(
-      segment->Base() + offset + segment->SharedMutexSize());
+      segment->Base() + offset + DataOffset(segment->SharedMutexSize()));
 }
 
 void SharedMemVariable::Reset() {
@@ -128,6 +266,14 @@ SharedMemHistogram::SharedMemHistogram(StringPiece name, Statistics* stats)
 SharedMemHistogram::~SharedMemHistogram() {
 }
 
+size_t SharedMemHistogram::AllocationSize(AbstractSharedMem* shm_runtime) {
+  // Shared memory space should include a mutex, HistogramBody and the storage
+  // for the actual buckets.
+  return RoundUp(DataOffset(shm_runtime->SharedMutexSize()) +
+                 sizeof(HistogramBody) + sizeof(double) * NumBuckets(),
+                 kCacheLineSize);
+}
+
 void SharedMemHistogram::Init() {
   if (buffer_ == NULL) {
     return;
@@ -155,7 +301,7 @@ void SharedMemHistogram::AttachTo(
     return;
   }
   buffer_ = reinterpret_cast<HistogramBody*>(const_cast<char*>(
-      segment->Base() + offset + segment->SharedMutexSize()));
+      segment->Base() + offset + DataOffset(segment->SharedMutexSize())));
 }
 
 void SharedMemHistogram::Reset() {
@@ -188,7 +334,9 @@ void SharedMemHistogram::Add(double value) {
   if (buffer_ == NULL) {
     return;
   }
+#ifndef SHARED_MEM_STATISTICS_LOCK_FREE
   ScopedMutex hold_lock(mutex_.get());
+#endif
   // See if we should put the value in one of the out-of-bounds catcher buckets,
   // in which case we will change index from -1.
   int index = -1;
@@ -217,19 +365,15 @@ void SharedMemHistogram::Add(double value) {
     LOG(ERROR) << "Invalid bucket index found for" << value;
     return;
   }
-  buffer_->values_[index]++;
-  // Update actual min & max values;
-  if (buffer_->count_ == 0) {
-    buffer_->min_ = value;
-    buffer_->max_ = value;
-  } else if (value < buffer_->min_) {
-    buffer_->min_ = value;
-  } else if (value > buffer_->max_) {
-    buffer_->max_ = value;
-  }
-  buffer_->count_++;
-  buffer_->sum_ += value;
-  buffer_->sum_of_squares_ += value * value;
+  // Each field is updated atomically, but not all together, so a reader
+  // may see some of this Add's updates and not others.  Updating count_
+  // last means a reader never sees more values counted than bucketed.
+  UpdateDouble(&buffer_->min_, value, Min);
+  UpdateDouble(&buffer_->max_, value, Max);
+  UpdateDouble(&buffer_->values_[index], 1, Sum);
+  UpdateDouble(&buffer_->sum_, value, Sum);
+  UpdateDouble(&buffer_->sum_of_squares_, value * value, Sum);
+  UpdateDouble(&buffer_->count_, 1, Sum);
 }
 
 void SharedMemHistogram::Clear() {
@@ -243,8 +387,8 @@ void SharedMemHistogram::Clear() {
 
 void SharedMemHistogram::ClearInternal() {
   // Throw away data.
-  buffer_->min_ = 0;
-  buffer_->max_ = 0;
+  buffer_->min_ = std::numeric_limits<double>::infinity();
+  buffer_->max_ = -std::numeric_limits<double>::infinity();
   buffer_->count_ = 0;
   buffer_->sum_ = 0;
   buffer_->sum_of_squares_ = 0;
@@ -381,6 +525,9 @@ double SharedMemHistogram::MaximumInternal() {
   if (buffer_ == NULL) {
     return -1.0;
   }
+  if (buffer_->count_ == 0) {
+    return 0.0;
+  }
   return buffer_->max_;
 }
 
@@ -388,6 +535,9 @@ double SharedMemHistogram::MinimumInternal() {
   if (buffer_ == NULL) {
     return -1.0;
   }
+  if (buffer_->count_ == 0) {
+    return 0.0;
+  }
   return buffer_->min_;
 }
 
@@ -512,7 +662,7 @@ bool SharedMemStatistics::Init(bool parent,
   frozen_ = true;
 
   // Compute size of shared memory
-  size_t per_var = shm_runtime_->SharedMutexSize() + sizeof(int64);
+  size_t per_var = SharedMemVariable::AllocationSize(shm_runtime_);
   size_t total = (variables_size() + up_down_size()) * per_var;
   for (size_t i = 0; i < histograms_size(); ++i) {
     SharedMemHistogram* hist = histograms(i);
@@ -37,10 +37,12 @@ class Timer;
 
 // An implementation of Statistics using our shared memory infrastructure.
 // These statistics will be shared amongst all processes and threads
-// spawned by our host.  Note that we will be obtaining a per-variable mutex for
-// every read and write to these variables.  Since this may be expensive,
-// we may need each thread to keep a local cache and infrequently write
-// through to this Statistics object.  TODO(abliss): actually do this.
+// spawned by our host.  On 64-bit CPUs, variables and histograms are updated
+// with atomic operations rather than under their mutexes, since counters
+// such as http_cache_hits are incremented by every process on every request.
+// Each variable is padded to its own cache line.  The per-variable mutexes
+// remain, for StatisticsLogger and for 32-bit CPUs, where the 64-bit atomic
+// operations are not available.
 //
 // Because we must allocate shared memory segments and mutexes before any child
 // processes and threads are created, all AddVariable calls must be done in
@@ -59,6 +61,17 @@ class SharedMemVariable : public MutexedScalar {
   virtual ~SharedMemVariable() {}
   virtual StringPiece GetName() const { return name_; }
 
+  // These hide MutexedScalar's versions, which take the mutex, with
+  // lock-free ones where possible.  VarTemplate and UpDownTemplate call them
+  // directly.
+  int64 Get() const;
+  void Set(int64 value);
+  int64 SetReturningPreviousValue(int64 value);
+  int64 AddHelper(int64 delta);
+
+  // Returns the amount of shared memory each variable needs.
+  static size_t AllocationSize(AbstractSharedMem* shm_runtime);
+
  protected:
   virtual AbstractMutex* mutex() const;
   virtual int64 GetLockHeld() const;
@@ -116,12 +129,7 @@ class SharedMemHistogram : public Histogram {
 
   // Return the amount of shared memory this Histogram objects needs for its
   // use.
-  size_t AllocationSize(AbstractSharedMem* shm_runtime) {
-    // Shared memory space should include a mutex, HistogramBody and the storage
-    // for the actual buckets.
-    return shm_runtime->SharedMutexSize() + sizeof(HistogramBody) +
-        sizeof(double) * NumBuckets();
-  }
+  size_t AllocationSize(AbstractSharedMem* shm_runtime);
 
  protected:
   virtual AbstractMutex* lock() {
@@ -163,9 +171,9 @@ class SharedMemHistogram : public Histogram {
     // Maximum value allowed in Histogram,
     // numeric_limits<double>::max() by default.
     double max_value_;
-    // Real minimum value.
+    // Real minimum value; +infinity when the histogram is empty.
     double min_;
-    // Real maximum value.
+    // Real maximum value; -infinity when the histogram is empty.
     double max_;
     double count_;
     double sum_;
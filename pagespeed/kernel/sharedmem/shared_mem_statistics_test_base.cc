@@ -16,6 +16,7 @@
 
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics_test_base.h"
 
+#include "base/logging.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/gtest.h"
 #include "pagespeed/kernel/base/mock_message_handler.h"
@@ -41,6 +42,9 @@ const char kHist2[] = "Html Time us Histogram";
 // We cannot init the logger unless all stats are initialized.
 const char kStatsLogFile[] = "";
 
+const int kNumConcurrentChildren = 4;
+const int kNumConcurrentAdds = 100000;
+
 }  // namespace
 
 const int64 SharedMemStatisticsTestBase::kLogIntervalMs = 3 * Timer::kSecondMs;
@@ -286,6 +290,47 @@ void SharedMemStatisticsTestBase::TestAddChild() {
   hist2->Add(4);
 }
 
+// Several children updating the same variable and histogram at once, as
+// every process does with counters like http_cache_hits.  Each update must
+// land.  This also serves as a benchmark: the time per update is logged.
+void SharedMemStatisticsTestBase::TestConcurrentAdd() {
+  ParentInit();
+  UpDownCounter* v1 = stats_->GetUpDownCounter(kVar1);
+  Histogram* hist1 = stats_->GetHistogram(kHist1);
+
+  scoped_ptr<Timer> timer(Platform::CreateTimer());
+  int64 start_us = timer->NowUs();
+  for (int i = 0; i < kNumConcurrentChildren; ++i) {
+    ASSERT_TRUE(CreateChild(
+        &SharedMemStatisticsTestBase::TestConcurrentAddChild));
+  }
+  test_env_->WaitForChildren();
+  int64 elapsed_us = timer->NowUs() - start_us;
+
+  const int kTotal = kNumConcurrentChildren * kNumConcurrentAdds;
+  EXPECT_EQ(kTotal, v1->Get());
+  EXPECT_EQ(kTotal, hist1->Count());
+  EXPECT_EQ(0, hist1->Minimum());
+  EXPECT_EQ(9, hist1->Maximum());
+  EXPECT_DOUBLE_EQ(4.5, hist1->Average());
+  LOG(INFO) << kNumConcurrentChildren << " children made " << kTotal
+            << " variable and histogram updates at "
+            << elapsed_us * 1000.0 / kTotal << "ns per update";
+}
+
+void SharedMemStatisticsTestBase::TestConcurrentAddChild() {
+  scoped_ptr<SharedMemStatistics> stats(ChildInit());
+  if (stats.get() == NULL) {
+    return;
+  }
+  UpDownCounter* v1 = stats->GetUpDownCounter(kVar1);
+  Histogram* hist1 = stats->GetHistogram(kHist1);
+  for (int i = 0; i < kNumConcurrentAdds; ++i) {
+    v1->Add(1);
+    hist1->Add(i % 10);
+  }
+}
+
 // This function tests the Histogram options with multi-processes.
 void SharedMemStatisticsTestBase::TestHistogram() {
   ParentInit();
@@ -58,6 +58,7 @@ class SharedMemStatisticsTestBase : public testing::Test {
   void TestHistogramExtremeBuckets();
   void TestTimedVariableEmulation();
   void TestConsoleStatisticsLogger();
+  void TestConcurrentAdd();
 
   StatisticsLogger* console_logger() const {
     return stats_->console_logger_.get();
@@ -76,6 +77,9 @@ class SharedMemStatisticsTestBase : public testing::Test {
 
   // Adds 10x +1 to variable 1, and 10x +2 to variable 2.
   void TestAddChild();
+  // Adds 1 to variable 1, and i % 10 to hist1, for i up to
+  // kNumConcurrentAdds.
+  void TestConcurrentAddChild();
   bool AddVars(SharedMemStatistics* stats);
   bool AddHistograms(SharedMemStatistics* stats);
   // Helper function for TestHistogramRender().
@@ -142,13 +146,18 @@ TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestTimedVariableEmulation) {
   SharedMemStatisticsTestBase::TestTimedVariableEmulation();
 }
 
+TYPED_TEST_P(SharedMemStatisticsTestTemplate, TestConcurrentAdd) {
+  SharedMemStatisticsTestBase::TestConcurrentAdd();
+}
+
 REGISTER_TYPED_TEST_CASE_P(SharedMemStatisticsTestTemplate, TestCreate,
                            TestSet, TestClear, TestAdd,
                            TestSetReturningPrevious,
                            TestHistogram, TestHistogramRender,
                            TestHistogramNoExtraClear,
                            TestHistogramExtremeBuckets,
-                           TestTimedVariableEmulation);
+                           TestTimedVariableEmulation,
+                           TestConcurrentAdd);
 
 }  // namespace net_instaweb
 
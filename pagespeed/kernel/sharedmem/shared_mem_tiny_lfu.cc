@@ -0,0 +1,178 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu.h"
+
+#include <cstddef>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+
+namespace net_instaweb {
+
+namespace SharedMemTinyLFUData {
+
+// Memory structure:
+//
+// Shard 0:
+//  additions, num_resets
+//  Mutex
+//  (pad to 8-byte alignment)
+//  TinyLFU::kNumRows * row_width counters
+//  (pad to 64-byte alignment)
+// Shard 1:
+//  ..
+// Shard TinyLFU::kNumSegments - 1:
+//  ..
+struct Shard {
+  int64 additions;
+  int64 num_resets;
+  char mutex_base[1];
+};
+
+inline size_t Align8(size_t in) {
+  return (in + 7) & ~7;
+}
+
+inline size_t Align64(size_t in) {
+  return (in + 63) & ~63;
+}
+
+}  // namespace SharedMemTinyLFUData
+
+namespace Data = SharedMemTinyLFUData;
+
+namespace {
+
+const char kSharedMemTinyLFUObjName[] = "SharedMemTinyLFU";
+
+}  // namespace
+
+SharedMemTinyLFU::SharedMemTinyLFU(AbstractSharedMem* shm_runtime,
+                                   const GoogleString& filename_prefix,
+                                   const GoogleString& filename_suffix,
+                                   int expected_entries)
+    : shm_runtime_(shm_runtime),
+      filename_prefix_(filename_prefix),
+      filename_suffix_(filename_suffix) {
+  TinyLFU::ComputeDimensions(expected_entries, &row_width_, &sample_size_);
+  counters_offset_ = Data::Align8(offsetof(Data::Shard, mutex_base) +
+                                  shm_runtime->SharedMutexSize());
+  shard_size_ =
+      Data::Align64(counters_offset_ + TinyLFU::kNumRows * row_width_);
+}
+
+SharedMemTinyLFU::~SharedMemTinyLFU() {
+}
+
+bool SharedMemTinyLFU::InitSegment(bool parent, MessageHandler* handler) {
+  size_t size = TinyLFU::kNumSegments * shard_size_;
+  if (parent) {
+    // The segment comes zeroed, so every counter starts out at 0.
+    segment_.reset(shm_runtime_->CreateSegment(SegmentName(), size, handler));
+    if (segment_.get() == NULL) {
+      return false;
+    }
+    for (int s = 0; s < TinyLFU::kNumSegments; ++s) {
+      Data::Shard* shard = GetShard(s);
+      if (!segment_->InitializeSharedMutex(
+              shard->mutex_base - segment_->Base(), handler)) {
+        handler->Message(
+            kError, "Unable to create mutex for shared memory TinyLFU");
+        segment_.reset(NULL);
+        shm_runtime_->DestroySegment(SegmentName(), handler);
+        return false;
+      }
+    }
+  } else {
+    segment_.reset(
+        shm_runtime_->AttachToSegment(SegmentName(), size, handler));
+    if (segment_.get() == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SharedMemTinyLFU::GlobalCleanup(MessageHandler* handler) {
+  if (segment_.get() != NULL) {
+    shm_runtime_->DestroySegment(SegmentName(), handler);
+  }
+}
+
+void SharedMemTinyLFU::Record(uint64 fingerprint) {
+  DCHECK(segment_.get() != NULL);
+  uint64 mixed = TinyLFU::Mix(fingerprint);
+  Data::Shard* shard = GetShard(TinyLFU::SegmentIndex(mixed));
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(shard));
+  ScopedMutex hold_lock(mutex.get());
+  // As in TinyLFU, accesses to saturated keys don't count towards the
+  // sample.
+  uint8* counters = Counters(shard);
+  if (TinyLFU::IncrementCounters(mixed, row_width_, counters) &&
+      (++shard->additions >= sample_size_)) {
+    TinyLFU::HalveCounters(row_width_, counters);
+    shard->additions /= 2;
+    ++shard->num_resets;
+  }
+}
+
+int SharedMemTinyLFU::Estimate(uint64 fingerprint) const {
+  DCHECK(segment_.get() != NULL);
+  uint64 mixed = TinyLFU::Mix(fingerprint);
+  Data::Shard* shard = GetShard(TinyLFU::SegmentIndex(mixed));
+  scoped_ptr<AbstractMutex> mutex(AttachMutex(shard));
+  ScopedMutex hold_lock(mutex.get());
+  return TinyLFU::EstimateFromCounters(mixed, row_width_, Counters(shard));
+}
+
+int64 SharedMemTinyLFU::num_resets() const {
+  int64 sum = 0;
+  for (int s = 0; s < TinyLFU::kNumSegments; ++s) {
+    Data::Shard* shard = GetShard(s);
+    scoped_ptr<AbstractMutex> mutex(AttachMutex(shard));
+    ScopedMutex hold_lock(mutex.get());
+    sum += shard->num_resets;
+  }
+  return sum;
+}
+
+Data::Shard* SharedMemTinyLFU::GetShard(int shard) const {
+  return reinterpret_cast<Data::Shard*>(
+      const_cast<char*>(segment_->Base()) + shard * shard_size_);
+}
+
+AbstractMutex* SharedMemTinyLFU::AttachMutex(Data::Shard* shard) const {
+  return segment_->AttachToSharedMutex(shard->mutex_base - segment_->Base());
+}
+
+uint8* SharedMemTinyLFU::Counters(Data::Shard* shard) const {
+  return reinterpret_cast<uint8*>(shard) + counters_offset_;
+}
+
+GoogleString SharedMemTinyLFU::SegmentName() const {
+  return StrCat(filename_prefix_, kSharedMemTinyLFUObjName, ".",
+                filename_suffix_);
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_H_
+
+#include <cstddef>
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/cache/frequency_sketch.h"
+
+namespace net_instaweb {
+
+class AbstractMutex;
+class AbstractSharedMem;
+class AbstractSharedMemSegment;
+class MessageHandler;
+
+namespace SharedMemTinyLFUData {
+
+struct Shard;
+
+}  // namespace SharedMemTinyLFUData
+
+// The TinyLFU frequency sketch, kept in shared memory so that every process
+// using a shared memory cache records its accesses in, and admits entries
+// by, the same history.  With a TinyLFU per process, each process would
+// only see its own share of the traffic, and would weigh entries other
+// processes had stored without knowing how often they had been used.
+//
+// The sketch is laid out and aged exactly as TinyLFU's, with each of its
+// TinyLFU::kNumSegments shards guarded by its own shared mutex.
+//
+// As with SharedMemOriginHealth, call InitSegment(true, handler) once in
+// the root process, and InitSegment(false, handler) in each child, before
+// using it.
+class SharedMemTinyLFU : public FrequencySketch {
+ public:
+  // filename_prefix and filename_suffix are used to name the segment, as for
+  // SharedCircularBuffer.  expected_entries sizes the sketch, as for
+  // TinyLFU, and must be the same in every process.  Does not take
+  // ownership of shm_runtime.
+  SharedMemTinyLFU(AbstractSharedMem* shm_runtime,
+                   const GoogleString& filename_prefix,
+                   const GoogleString& filename_suffix,
+                   int expected_entries);
+  virtual ~SharedMemTinyLFU();
+
+  // Creates the shared memory segment if parent is true, and attaches to it
+  // otherwise.  Returns whether successful.
+  bool InitSegment(bool parent, MessageHandler* handler);
+
+  // This should be called from the root process as it is about to exit, when
+  // no future children are expected to start.
+  void GlobalCleanup(MessageHandler* handler);
+
+  virtual void Record(uint64 fingerprint);
+  virtual int Estimate(uint64 fingerprint) const;
+
+  // Number of times a shard has been aged, in all processes.  Used for
+  // testing.
+  int64 num_resets() const;
+
+ private:
+  SharedMemTinyLFUData::Shard* GetShard(int shard) const;
+  AbstractMutex* AttachMutex(SharedMemTinyLFUData::Shard* shard) const;
+  uint8* Counters(SharedMemTinyLFUData::Shard* shard) const;
+
+  GoogleString SegmentName() const;
+
+  AbstractSharedMem* shm_runtime_;
+  const GoogleString filename_prefix_;
+  const GoogleString filename_suffix_;
+  size_t row_width_;
+  int64 sample_size_;
+  size_t counters_offset_;  // From the start of a shard.
+  size_t shard_size_;
+  scoped_ptr<AbstractSharedMemSegment> segment_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemTinyLFU);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_H_
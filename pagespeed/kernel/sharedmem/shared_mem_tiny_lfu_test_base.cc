@@ -0,0 +1,160 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu_test_base.h"
+
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu.h"
+#include "pagespeed/kernel/util/platform.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kPrefix[] = "/prefix/";
+const char kSuffix[] = "suffix";
+const int kExpectedEntries = 1000;
+
+// Bound on the number of keys streamed through to age the sketch, so that
+// a broken sketch fails rather than hangs.
+const int kMaxStreamed = 1000 * 1000;
+
+void RecordTimes(FrequencySketch* sketch, uint64 fingerprint, int times) {
+  for (int i = 0; i < times; ++i) {
+    sketch->Record(fingerprint);
+  }
+}
+
+}  // namespace
+
+SharedMemTinyLFUTestBase::SharedMemTinyLFUTestBase(
+    SharedMemTestEnv* test_env)
+    : test_env_(test_env),
+      shmem_runtime_(test_env->CreateSharedMemRuntime()),
+      thread_system_(Platform::CreateThreadSystem()),
+      handler_(thread_system_->NewMutex()) {
+}
+
+void SharedMemTinyLFUTestBase::SetUp() {
+  root_tiny_lfu_.reset(CreateTinyLFU());
+  EXPECT_TRUE(root_tiny_lfu_->InitSegment(true, &handler_));
+}
+
+void SharedMemTinyLFUTestBase::TearDown() {
+  root_tiny_lfu_->GlobalCleanup(&handler_);
+}
+
+bool SharedMemTinyLFUTestBase::CreateChild(TestMethod method) {
+  Function* callback =
+      new MemberFunction0<SharedMemTinyLFUTestBase>(method, this);
+  return test_env_->CreateChild(callback);
+}
+
+SharedMemTinyLFU* SharedMemTinyLFUTestBase::CreateTinyLFU() {
+  return new SharedMemTinyLFU(shmem_runtime_.get(), kPrefix, kSuffix,
+                              kExpectedEntries);
+}
+
+SharedMemTinyLFU* SharedMemTinyLFUTestBase::AttachDefault() {
+  SharedMemTinyLFU* tiny_lfu = CreateTinyLFU();
+  if (!tiny_lfu->InitSegment(false, &handler_)) {
+    delete tiny_lfu;
+    tiny_lfu = NULL;
+  }
+  return tiny_lfu;
+}
+
+void SharedMemTinyLFUTestBase::TestCountsAccesses() {
+  scoped_ptr<SharedMemTinyLFU> tiny_lfu(AttachDefault());
+  ASSERT_TRUE(tiny_lfu.get() != NULL);
+  EXPECT_EQ(0, tiny_lfu->Estimate(1));
+  RecordTimes(tiny_lfu.get(), 1, 3);
+  RecordTimes(tiny_lfu.get(), 2, 5);
+  EXPECT_EQ(3, tiny_lfu->Estimate(1));
+  EXPECT_EQ(5, tiny_lfu->Estimate(2));
+  EXPECT_EQ(0, tiny_lfu->Estimate(3));
+  EXPECT_TRUE(tiny_lfu->Admit(2, 1));
+  EXPECT_FALSE(tiny_lfu->Admit(1, 2));
+
+  RecordTimes(tiny_lfu.get(), 1, 2 * TinyLFU::kMaxFrequency);
+  EXPECT_EQ(TinyLFU::kMaxFrequency, tiny_lfu->Estimate(1));
+}
+
+void SharedMemTinyLFUTestBase::TestMatchesTinyLFU() {
+  // The same accesses give the same estimates as an in-process TinyLFU of
+  // the same size, aging included.
+  scoped_ptr<SharedMemTinyLFU> tiny_lfu(AttachDefault());
+  ASSERT_TRUE(tiny_lfu.get() != NULL);
+  TinyLFU local(kExpectedEntries, thread_system_.get());
+  for (uint64 i = 0; i < 20 * kExpectedEntries; ++i) {
+    uint64 fingerprint = (i * 7919) % (5 * kExpectedEntries);
+    tiny_lfu->Record(fingerprint);
+    local.Record(fingerprint);
+  }
+  EXPECT_EQ(local.num_resets(), tiny_lfu->num_resets());
+  EXPECT_LT(0, tiny_lfu->num_resets());
+  for (uint64 i = 0; i < 5 * kExpectedEntries; ++i) {
+    EXPECT_EQ(local.Estimate(i), tiny_lfu->Estimate(i)) << i;
+  }
+}
+
+void SharedMemTinyLFUTestBase::TestAging() {
+  scoped_ptr<SharedMemTinyLFU> tiny_lfu(AttachDefault());
+  ASSERT_TRUE(tiny_lfu.get() != NULL);
+  RecordTimes(tiny_lfu.get(), 1, 8);
+  EXPECT_EQ(8, tiny_lfu->Estimate(1));
+  uint64 fingerprint = 1000;
+  for (int i = 0; (tiny_lfu->Estimate(1) >= 8) && (i < kMaxStreamed); ++i) {
+    tiny_lfu->Record(++fingerprint);
+  }
+  EXPECT_LT(0, tiny_lfu->num_resets());
+  EXPECT_GT(8, tiny_lfu->Estimate(1));
+}
+
+void SharedMemTinyLFUTestBase::TestSharedWithChild() {
+  scoped_ptr<SharedMemTinyLFU> tiny_lfu(AttachDefault());
+  ASSERT_TRUE(tiny_lfu.get() != NULL);
+  RecordTimes(tiny_lfu.get(), 1, 3);
+
+  ASSERT_TRUE(CreateChild(
+      &SharedMemTinyLFUTestBase::TestSharedWithChildChild));
+  test_env_->WaitForChildren();
+
+  // What the child recorded is counted here.
+  EXPECT_EQ(5, tiny_lfu->Estimate(1));
+  EXPECT_EQ(1, tiny_lfu->Estimate(2));
+  EXPECT_TRUE(tiny_lfu->Admit(1, 2));
+}
+
+void SharedMemTinyLFUTestBase::TestSharedWithChildChild() {
+  scoped_ptr<SharedMemTinyLFU> tiny_lfu(AttachDefault());
+  if (tiny_lfu.get() == NULL) {
+    test_env_->ChildFailed();
+    return;
+  }
+  // The parent's accesses are counted here.
+  if (tiny_lfu->Estimate(1) != 3) {
+    test_env_->ChildFailed();
+  }
+  RecordTimes(tiny_lfu.get(), 1, 2);
+  tiny_lfu->Record(2);
+}
+
+}  // namespace net_instaweb
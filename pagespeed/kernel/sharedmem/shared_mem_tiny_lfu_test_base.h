@@ -0,0 +1,93 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_TEST_BASE_H_
+#define PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_TEST_BASE_H_
+
+#include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_test_base.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu.h"
+
+namespace net_instaweb {
+
+class SharedMemTinyLFUTestBase : public testing::Test {
+ protected:
+  typedef void (SharedMemTinyLFUTestBase::*TestMethod)();
+
+  explicit SharedMemTinyLFUTestBase(SharedMemTestEnv* test_env);
+  virtual void SetUp();
+  virtual void TearDown();
+
+  void TestCountsAccesses();
+  void TestMatchesTinyLFU();
+  void TestAging();
+  void TestSharedWithChild();
+
+ private:
+  bool CreateChild(TestMethod method);
+
+  SharedMemTinyLFU* CreateTinyLFU();
+  SharedMemTinyLFU* AttachDefault();
+
+  void TestSharedWithChildChild();
+
+  scoped_ptr<SharedMemTestEnv> test_env_;
+  scoped_ptr<AbstractSharedMem> shmem_runtime_;
+  scoped_ptr<ThreadSystem> thread_system_;
+  MockMessageHandler handler_;
+  scoped_ptr<SharedMemTinyLFU> root_tiny_lfu_;  // for init only.
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemTinyLFUTestBase);
+};
+
+template<typename ConcreteTestEnv>
+class SharedMemTinyLFUTestTemplate : public SharedMemTinyLFUTestBase {
+ public:
+  SharedMemTinyLFUTestTemplate()
+      : SharedMemTinyLFUTestBase(new ConcreteTestEnv) {
+  }
+};
+
+TYPED_TEST_CASE_P(SharedMemTinyLFUTestTemplate);
+
+TYPED_TEST_P(SharedMemTinyLFUTestTemplate, TestCountsAccesses) {
+  SharedMemTinyLFUTestBase::TestCountsAccesses();
+}
+
+TYPED_TEST_P(SharedMemTinyLFUTestTemplate, TestMatchesTinyLFU) {
+  SharedMemTinyLFUTestBase::TestMatchesTinyLFU();
+}
+
+TYPED_TEST_P(SharedMemTinyLFUTestTemplate, TestAging) {
+  SharedMemTinyLFUTestBase::TestAging();
+}
+
+TYPED_TEST_P(SharedMemTinyLFUTestTemplate, TestSharedWithChild) {
+  SharedMemTinyLFUTestBase::TestSharedWithChild();
+}
+
+REGISTER_TYPED_TEST_CASE_P(SharedMemTinyLFUTestTemplate,
+                           TestCountsAccesses, TestMatchesTinyLFU, TestAging,
+                           TestSharedWithChild);
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_SHAREDMEM_SHARED_MEM_TINY_LFU_TEST_BASE_H_
@@ -167,6 +167,41 @@ TEST_F(MockSchedulerTest, Cancellation) {
   EXPECT_EQ("124", string_);
 }
 
+// Alarms far enough out to sit in the coarser levels of the scheduler's
+// timing wheel, or beyond it, still run in order and at the right time.
+TEST_F(MockSchedulerTest, ScheduleOrderingAcrossWheelLevels) {
+  AddTask(3 * Timer::kYearMs * Timer::kMsUs, '6');
+  AddTask(Timer::kDayMs * Timer::kMsUs, '5');
+  AddTask(Timer::kMinuteMs * Timer::kMsUs + 1, '4');
+  AddTask(Timer::kMinuteMs * Timer::kMsUs, '3');
+  AddTask(Timer::kSecondUs, '2');
+  AddTask(1, '1');
+  AdvanceTimeUs(Timer::kMinuteMs * Timer::kMsUs);
+  EXPECT_EQ("123", string_);
+  AdvanceTimeUs(1);
+  EXPECT_EQ("1234", string_);
+  AdvanceTimeMs(Timer::kDayMs - Timer::kMinuteMs - 1);
+  EXPECT_EQ("1234", string_);
+  AdvanceTimeMs(1);
+  EXPECT_EQ("12345", string_);
+  AdvanceTimeMs(3 * Timer::kYearMs);
+  EXPECT_EQ("123456", string_);
+}
+
+TEST_F(MockSchedulerTest, CancelFarAlarms) {
+  Scheduler::Alarm* alarm1 = AddTask(Timer::kHourMs * Timer::kMsUs, '1');
+  AddTask(2 * Timer::kHourMs * Timer::kMsUs, '2');
+  Scheduler::Alarm* alarm3 = AddTask(Timer::kYearMs * Timer::kMsUs, '3');
+  AddTask(2 * Timer::kYearMs * Timer::kMsUs, '4');
+  {
+    ScopedMutex lock(scheduler_->mutex());
+    EXPECT_TRUE(scheduler_->CancelAlarm(alarm1));
+    EXPECT_TRUE(scheduler_->CancelAlarm(alarm3));
+  }
+  AdvanceTimeMs(3 * Timer::kYearMs);
+  EXPECT_EQ("24", string_);
+}
+
 // Verifies that we can add a new alarm from an Alarm::Run() method.
 TEST_F(MockSchedulerTest, ChainedAlarms) {
   int count = 10;
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/thread/queue_delay_controller.h"
+
+#include <cmath>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/statistics.h"
+
+namespace net_instaweb {
+
+QueueDelayController::QueueDelayController(
+    int64 target_us, int64 interval_us, AbstractMutex* mutex,
+    Variable* shed_count)
+    : target_us_(target_us),
+      interval_us_(interval_us),
+      mutex_(mutex),
+      shed_count_(shed_count),
+      first_above_time_us_(0),
+      dropping_(false),
+      drop_next_us_(0),
+      count_(0),
+      last_count_(0) {
+  DCHECK_GT(target_us, 0);
+  DCHECK_GT(interval_us, target_us);
+}
+
+QueueDelayController::~QueueDelayController() {
+}
+
+bool QueueDelayController::AboveTargetForInterval(int64 delay_us,
+                                                  int64 now_us) {
+  if (delay_us < target_us_) {
+    first_above_time_us_ = 0;
+    return false;
+  }
+  if (first_above_time_us_ == 0) {
+    first_above_time_us_ = now_us + interval_us_;
+    return false;
+  }
+  return now_us >= first_above_time_us_;
+}
+
+int64 QueueDelayController::ControlLaw(int64 time_us) const {
+  return time_us + static_cast<int64>(interval_us_ / std::sqrt(
+      static_cast<double>(count_)));
+}
+
+bool QueueDelayController::ShouldDrop(int64 delay_us, int64 now_us) {
+  bool drop = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    bool above_target = AboveTargetForInterval(delay_us, now_us);
+    if (dropping_) {
+      if (!above_target) {
+        dropping_ = false;
+      } else if (now_us >= drop_next_us_) {
+        ++count_;
+        drop_next_us_ = ControlLaw(drop_next_us_);
+        drop = true;
+      }
+    } else if (above_target) {
+      // If we were dropping recently, resume at about the rate we left off,
+      // as the delay evidently wasn't under control.
+      dropping_ = true;
+      int delta = count_ - last_count_;
+      if ((delta > 1) && (now_us - drop_next_us_ < 16 * interval_us_)) {
+        count_ = delta;
+      } else {
+        count_ = 1;
+      }
+      drop_next_us_ = ControlLaw(now_us);
+      last_count_ = count_;
+      drop = true;
+    }
+  }
+  if (drop && (shed_count_ != NULL)) {
+    shed_count_->Add(1);
+  }
+  return drop;
+}
+
+}  // namespace net_instaweb
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_THREAD_QUEUE_DELAY_CONTROLLER_H_
+#define PAGESPEED_KERNEL_THREAD_QUEUE_DELAY_CONTROLLER_H_
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+
+namespace net_instaweb {
+
+class Variable;
+
+// Decides when to shed tasks from a work queue based on how long they have
+// waited in it, following CoDel (Nichols and Jacobson, "Controlling Queue
+// Delay", ACM Queue, May 2012).  A burst that drains within an interval is
+// left alone however long the queue gets, but once every task has waited
+// longer than the target for a whole interval, tasks are dropped as they
+// are dequeued, at a rate that rises with the square root of the number
+// dropped, until a task is dequeued within the target.
+//
+// This is thread-safe.
+class QueueDelayController {
+ public:
+  // Takes ownership of mutex.  shed_count, which may be NULL, is
+  // incremented for each task dropped.
+  QueueDelayController(int64 target_us, int64 interval_us,
+                       AbstractMutex* mutex, Variable* shed_count);
+  ~QueueDelayController();
+
+  // Called as each task is taken off the queue at now_us, having waited
+  // delay_us.  Returns true if the task should be dropped rather than run.
+  bool ShouldDrop(int64 delay_us, int64 now_us);
+
+  int64 target_us() const { return target_us_; }
+  int64 interval_us() const { return interval_us_; }
+
+ private:
+  // Returns whether delay_us has been above target for an interval.
+  bool AboveTargetForInterval(int64 delay_us, int64 now_us)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the time of the next drop after time_us.
+  int64 ControlLaw(int64 time_us) const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const int64 target_us_;
+  const int64 interval_us_;
+  scoped_ptr<AbstractMutex> mutex_;
+  Variable* shed_count_;
+
+  // When the delay first went above target, plus an interval; 0 if the
+  // delay is below target.
+  int64 first_above_time_us_ GUARDED_BY(mutex_);
+  bool dropping_ GUARDED_BY(mutex_);
+  int64 drop_next_us_ GUARDED_BY(mutex_);
+  int count_ GUARDED_BY(mutex_);       // Drops in this dropping state.
+  int last_count_ GUARDED_BY(mutex_);  // count_ at the last state change.
+
+  DISALLOW_COPY_AND_ASSIGN(QueueDelayController);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_THREAD_QUEUE_DELAY_CONTROLLER_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test for QueueDelayController.
+
+#include "pagespeed/kernel/thread/queue_delay_controller.h"
+
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/simple_stats.h"
+
+namespace net_instaweb {
+
+namespace {
+
+const char kShedCount[] = "shed-count";
+const int64 kTargetUs = 5000;
+const int64 kIntervalUs = 100000;
+const int64 kStartUs = 1000000;
+
+class QueueDelayControllerTest : public testing::Test {
+ protected:
+  QueueDelayControllerTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        stats_(thread_system_.get()) {
+    stats_.AddVariable(kShedCount);
+    controller_.reset(new QueueDelayController(
+        kTargetUs, kIntervalUs, thread_system_->NewMutex(),
+        stats_.GetVariable(kShedCount)));
+  }
+
+  int64 shed_count() { return stats_.GetVariable(kShedCount)->Get(); }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  SimpleStats stats_;
+  scoped_ptr<QueueDelayController> controller_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(QueueDelayControllerTest);
+};
+
+TEST_F(QueueDelayControllerTest, BelowTargetNeverDrops) {
+  for (int64 now_us = kStartUs; now_us < kStartUs + 10 * kIntervalUs;
+       now_us += 1000) {
+    EXPECT_FALSE(controller_->ShouldDrop(kTargetUs - 1, now_us));
+  }
+  EXPECT_EQ(0, shed_count());
+}
+
+TEST_F(QueueDelayControllerTest, ShortBurstNeverDrops) {
+  // The delay is far above target, but not for a whole interval.
+  int64 now_us = kStartUs;
+  for (; now_us < kStartUs + kIntervalUs; now_us += 1000) {
+    EXPECT_FALSE(controller_->ShouldDrop(50 * kTargetUs, now_us));
+  }
+  EXPECT_FALSE(controller_->ShouldDrop(0, now_us));
+  EXPECT_EQ(0, shed_count());
+}
+
+TEST_F(QueueDelayControllerTest, DropsAfterInterval) {
+  const int64 kDelayUs = 2 * kTargetUs;
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, kStartUs));
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs,
+                                       kStartUs + kIntervalUs - 1));
+
+  // Above target for a whole interval: drop once, then wait an interval
+  // before dropping again.
+  int64 now_us = kStartUs + kIntervalUs;
+  EXPECT_TRUE(controller_->ShouldDrop(kDelayUs, now_us));
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, now_us + 1));
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs,
+                                       now_us + kIntervalUs - 1));
+  now_us += kIntervalUs;
+  EXPECT_TRUE(controller_->ShouldDrop(kDelayUs, now_us));
+
+  // The next drop comes sooner: interval / sqrt(2).
+  const int64 kNextUs = static_cast<int64>(kIntervalUs / 1.41421356);
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, now_us + kNextUs - 1));
+  EXPECT_TRUE(controller_->ShouldDrop(kDelayUs, now_us + kNextUs));
+  EXPECT_EQ(3, shed_count());
+
+  // One task under target ends the dropping state.
+  now_us += kNextUs;
+  EXPECT_FALSE(controller_->ShouldDrop(kTargetUs - 1, now_us + 1));
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, now_us + 2));
+  EXPECT_EQ(3, shed_count());
+}
+
+TEST_F(QueueDelayControllerTest, DropRateRises) {
+  // Keep the delay above target, asking once a millisecond, and count the
+  // drops in successive intervals once dropping starts.
+  int64 now_us = kStartUs;
+  EXPECT_FALSE(controller_->ShouldDrop(kTargetUs, now_us));
+  now_us += kIntervalUs;
+  int last_drops = 0;
+  for (int interval = 0; interval < 5; ++interval) {
+    int drops = 0;
+    for (int i = 0; i < kIntervalUs / 1000; ++i, now_us += 1000) {
+      if (controller_->ShouldDrop(kTargetUs, now_us)) {
+        ++drops;
+      }
+    }
+    EXPECT_LE(last_drops, drops);
+    last_drops = drops;
+  }
+  EXPECT_LT(2, last_drops);
+}
+
+TEST_F(QueueDelayControllerTest, ResumesNearPreviousRate) {
+  const int64 kDelayUs = 2 * kTargetUs;
+  int64 now_us = kStartUs;
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, now_us));
+  now_us += kIntervalUs;
+  int drops = 0;
+  for (int i = 0; i < 1000; ++i, now_us += 1000) {
+    if (controller_->ShouldDrop(kDelayUs, now_us)) {
+      ++drops;
+    }
+  }
+  ASSERT_LT(2, drops);
+
+  // Dip below target briefly, then go back above it for an interval.  The
+  // first drop of the new dropping state starts at the earlier count, so
+  // the second follows much sooner than a whole interval.
+  EXPECT_FALSE(controller_->ShouldDrop(0, now_us));
+  EXPECT_FALSE(controller_->ShouldDrop(kDelayUs, now_us + 1000));
+  now_us += 1000 + kIntervalUs;
+  EXPECT_TRUE(controller_->ShouldDrop(kDelayUs, now_us));
+  EXPECT_TRUE(controller_->ShouldDrop(kDelayUs, now_us + kIntervalUs / 2));
+}
+
+}  // namespace
+
+}  // namespace net_instaweb
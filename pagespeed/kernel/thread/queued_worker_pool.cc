@@ -18,6 +18,7 @@
 
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 
+#include <algorithm>
 #include <deque>
 #include <set>
 #include <vector>
@@ -26,10 +27,13 @@
 #include "pagespeed/kernel/base/abstract_mutex.h"
 #include "pagespeed/kernel/base/condvar.h"
 #include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/thread_annotations.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/base/waveform.h"
+#include "pagespeed/kernel/thread/queue_delay_controller.h"
 #include "pagespeed/kernel/thread/queued_worker.h"
 
 namespace net_instaweb {
@@ -46,6 +50,78 @@ const size_t kUnboundedQueue = 0;
 
 }  // namespace
 
+// A worker's queue of runnable sequences, for work-stealing dispatch.  The
+// owning worker sleeps on wakeup_ when there is nothing to run anywhere.
+class QueuedWorkerPool::StealingQueue {
+ public:
+  explicit StealingQueue(ThreadSystem* thread_system)
+      : mutex_(thread_system->NewMutex()),
+        wakeup_(mutex_->NewCondvar()),
+        wake_(false),
+        shutdown_(false) {
+  }
+
+  void Push(Sequence* sequence) {
+    ScopedMutex lock(mutex_.get());
+    sequences_.push_back(sequence);
+    size_.set_value(sequences_.size());
+  }
+
+  // Removes the oldest sequence.  Returns NULL if the queue is empty, or
+  // if block is false and another thread holds the lock.
+  Sequence* Pop(bool block) {
+    if (size_.value() == 0) {
+      return NULL;
+    }
+    if (block) {
+      mutex_->Lock();
+    } else if (!mutex_->TryLock()) {
+      return NULL;
+    }
+    Sequence* sequence = NULL;
+    if (!sequences_.empty()) {
+      sequence = sequences_.front();
+      sequences_.pop_front();
+      size_.set_value(sequences_.size());
+    }
+    mutex_->Unlock();
+    return sequence;
+  }
+
+  // Called by the owning worker.  Returns false if the pool is shutting
+  // down, or true once Wake has been called.
+  bool Sleep() {
+    ScopedMutex lock(mutex_.get());
+    while (!wake_ && !shutdown_) {
+      wakeup_->Wait();
+    }
+    wake_ = false;
+    return !shutdown_;
+  }
+
+  void Wake() {
+    ScopedMutex lock(mutex_.get());
+    wake_ = true;
+    wakeup_->Signal();
+  }
+
+  void ShutDown() {
+    ScopedMutex lock(mutex_.get());
+    shutdown_ = true;
+    wakeup_->Signal();
+  }
+
+ private:
+  scoped_ptr<ThreadSystem::CondvarCapableMutex> mutex_;
+  scoped_ptr<ThreadSystem::Condvar> wakeup_;
+  std::deque<Sequence*> sequences_;
+  AtomicInt32 size_;  // sequences_.size(), readable without the lock.
+  bool wake_;
+  bool shutdown_;
+
+  DISALLOW_COPY_AND_ASSIGN(StealingQueue);
+};
+
 QueuedWorkerPool::QueuedWorkerPool(
     int max_workers, StringPiece thread_name_base, ThreadSystem* thread_system)
     : thread_system_(thread_system),
@@ -53,7 +129,11 @@ QueuedWorkerPool::QueuedWorkerPool(
       max_workers_(max_workers),
       shutdown_(false),
       queue_size_(NULL),
-      load_shedding_threshold_(kNoLoadShedding) {
+      load_shedding_threshold_(kNoLoadShedding),
+      timer_(NULL),
+      queue_delay_ms_(NULL),
+      work_stealing_(false),
+      idle_mutex_(thread_system_->NewMutex()) {
   thread_name_base.CopyToString(&thread_name_base_);
 }
 
@@ -67,6 +147,7 @@ QueuedWorkerPool::~QueuedWorkerPool() {
     sequence->WaitForShutDown();
     delete sequence;
   }
+  STLDeleteElements(&stealing_queues_);
 }
 
 void QueuedWorkerPool::ShutDown() {
@@ -99,6 +180,12 @@ void QueuedWorkerPool::InitiateShutDown() {
     // Do not delete the sequence; just leave it in shutdown-mode so no
     // further tasks will be started in the thread.
   }
+
+  // Let any sleeping work-stealing workers exit.  stealing_queues_ is
+  // only mutated when shutdown_ == false, too.
+  for (int i = 0, n = stealing_queues_.size(); i < n; ++i) {
+    stealing_queues_[i]->ShutDown();
+  }
 }
 
 void QueuedWorkerPool::WaitForShutDownComplete() {
@@ -182,6 +269,11 @@ QueuedWorkerPool::Sequence* QueuedWorkerPool::AssignWorkerToNextSequence(
 }
 
 void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
+  if (work_stealing_) {
+    QueueStealableSequence(sequence);
+    return;
+  }
+
   QueuedWorker* worker = NULL;
   Sequence* drop_sequence = NULL;
   {
@@ -230,6 +322,121 @@ void QueuedWorkerPool::QueueSequence(Sequence* sequence) {
   }
 }
 
+void QueuedWorkerPool::StartStealingWorkers() {
+  for (size_t i = 0; i < max_workers_; ++i) {
+    stealing_queues_.push_back(new StealingQueue(thread_system_));
+  }
+  for (size_t i = 0; i < max_workers_; ++i) {
+    QueuedWorker* worker = new QueuedWorker(
+        StrCat(thread_name_base_, "-", IntegerToString(i)), thread_system_);
+    worker->Start();
+    active_workers_.insert(worker);
+    worker->RunInWorkThread(new MemberFunction1<QueuedWorkerPool, int>(
+        &QueuedWorkerPool::RunStealingWorker, this, i));
+  }
+}
+
+// The body of each work-stealing worker thread, which returns only when
+// the pool shuts down.
+void QueuedWorkerPool::RunStealingWorker(int index) {
+  while (Sequence* sequence = NextStealableSequence(index)) {
+    while (Function* function = sequence->NextFunction()) {
+      function->CallRun();
+    }
+  }
+}
+
+void QueuedWorkerPool::QueueStealableSequence(Sequence* sequence) {
+  uint32 next = static_cast<uint32>(next_queue_.NoBarrierIncrement(1));
+  StealingQueue* queue = stealing_queues_[next % stealing_queues_.size()];
+  queue->Push(sequence);
+
+  // The full barrier here pairs with the one in NextStealableSequence: a
+  // worker that is about to sleep either sees the push or is counted in
+  // num_idle_workers_ below.
+  int queued = num_queued_sequences_.BarrierIncrement(1);
+  if ((load_shedding_threshold_ != kNoLoadShedding) &&
+      (queued > load_shedding_threshold_)) {
+    Sequence* drop_sequence = queue->Pop(true);
+    if (drop_sequence != NULL) {
+      num_queued_sequences_.BarrierIncrement(-1);
+      drop_sequence->Cancel();
+    }
+  }
+  if (num_idle_workers_.value() > 0) {
+    WakeIdleWorker();
+  }
+}
+
+QueuedWorkerPool::Sequence* QueuedWorkerPool::NextStealableSequence(
+    int index) {
+  while (true) {
+    Sequence* sequence = TakeSequence(index, false);
+    if (sequence == NULL) {
+      // Declare ourselves idle and then look again, waiting for the locks
+      // of any queues that were contended, so that we can't miss a
+      // sequence queued after the first look.
+      {
+        ScopedMutex lock(idle_mutex_.get());
+        idle_workers_.push_back(index);
+        num_idle_workers_.BarrierIncrement(1);
+      }
+      sequence = TakeSequence(index, true);
+      if (sequence == NULL) {
+        if (!stealing_queues_[index]->Sleep()) {
+          return NULL;
+        }
+        continue;
+      }
+      // If a waker has already taken us off the idle list, our next Sleep
+      // returns immediately, which is harmless.
+      RemoveIdleWorker(index);
+    }
+    num_queued_sequences_.BarrierIncrement(-1);
+    return sequence;
+  }
+}
+
+// Takes a sequence from the worker's own queue if it has one, and otherwise
+// steals one from the other queues, starting with the next worker's.
+QueuedWorkerPool::Sequence* QueuedWorkerPool::TakeSequence(int index,
+                                                          bool block) {
+  for (int i = 0, n = stealing_queues_.size(); i < n; ++i) {
+    Sequence* sequence = stealing_queues_[(index + i) % n]->Pop(
+        block || (i == 0));
+    if (sequence != NULL) {
+      return sequence;
+    }
+  }
+  return NULL;
+}
+
+void QueuedWorkerPool::WakeIdleWorker() {
+  int index = -1;
+  {
+    ScopedMutex lock(idle_mutex_.get());
+    if (!idle_workers_.empty()) {
+      index = idle_workers_.back();
+      idle_workers_.pop_back();
+      num_idle_workers_.BarrierIncrement(-1);
+    }
+  }
+  if (index >= 0) {
+    stealing_queues_[index]->Wake();
+  }
+}
+
+void QueuedWorkerPool::RemoveIdleWorker(int index) {
+  ScopedMutex lock(idle_mutex_.get());
+  for (int i = 0, n = idle_workers_.size(); i < n; ++i) {
+    if (idle_workers_[i] == index) {
+      idle_workers_.erase(idle_workers_.begin() + i);
+      num_idle_workers_.BarrierIncrement(-1);
+      break;
+    }
+  }
+}
+
 bool QueuedWorkerPool::AreBusy(const SequenceSet& sequences)
     NO_THREAD_SAFETY_ANALYSIS {
   // This is the only operation that accesses multiple workers at once.
@@ -261,13 +468,30 @@ void QueuedWorkerPool::SetLoadSheddingThreshold(int x) {
   load_shedding_threshold_ = x;
 }
 
+void QueuedWorkerPool::TrackQueueDelay(Timer* timer, Histogram* histogram) {
+  timer_ = timer;
+  queue_delay_ms_ = histogram;
+}
+
+void QueuedWorkerPool::SetQueueDelayController(
+    QueueDelayController* controller) {
+  DCHECK(timer_ != NULL);
+  queue_delay_controller_.reset(controller);
+}
+
 QueuedWorkerPool::Sequence* QueuedWorkerPool::NewSequence() {
   ScopedMutex lock(mutex_.get());
   Sequence* sequence = NULL;
   if (!shutdown_) {
+    if (work_stealing_ && stealing_queues_.empty()) {
+      StartStealingWorkers();
+    }
     if (free_sequences_.empty()) {
       sequence = new Sequence(thread_system_, this);
       sequence->set_queue_size_stat(queue_size_);
+      sequence->timer_ = timer_;
+      sequence->queue_delay_ms_ = queue_delay_ms_;
+      sequence->queue_delay_controller_ = queue_delay_controller_.get();
       all_sequences_.push_back(sequence);
     } else {
       sequence = free_sequences_.back();
@@ -303,7 +527,10 @@ QueuedWorkerPool::Sequence::Sequence(ThreadSystem* thread_system,
       pool_(pool),
       termination_condvar_(sequence_mutex_->NewCondvar()),
       queue_size_(NULL),
-      max_queue_size_(kUnboundedQueue) {
+      max_queue_size_(kUnboundedQueue),
+      timer_(NULL),
+      queue_delay_ms_(NULL),
+      queue_delay_controller_(NULL) {
   Reset();
 }
 
@@ -350,8 +577,7 @@ void QueuedWorkerPool::Sequence::WaitForShutDown() {
 int QueuedWorkerPool::Sequence::CancelTasksOnWorkQueue() {
   int num_canceled = 0;
   while (!work_queue_.empty()) {
-    Function* function = work_queue_.front();
-    work_queue_.pop_front();
+    Function* function = PopFunction(NULL);
     sequence_mutex_->Unlock();
     function->CallCancel();
     ++num_canceled;
@@ -373,6 +599,7 @@ void QueuedWorkerPool::Sequence::Cancel() {
 void QueuedWorkerPool::Sequence::Add(Function* function) {
   bool queue_sequence = false;
   bool cancel = false;
+  int64 now_us = (timer_ == NULL) ? 0 : timer_->NowUs();
   {
     ScopedMutex lock(sequence_mutex_.get());
     if (shutdown_) {
@@ -388,12 +615,14 @@ void QueuedWorkerPool::Sequence::Add(Function* function) {
         // of older HTML requests that are waiting to be retired.  We'd rather
         // retire them without optimization than delay them further with a
         // slow cache.
-        function = work_queue_.front();
-        work_queue_.pop_front();
+        function = PopFunction(NULL);
         cancel = true;
       }
 
       work_queue_.push_back(function_to_add);
+      if (timer_ != NULL) {
+        add_times_us_.push_back(now_us);
+      }
       queue_sequence = (!active_ && (work_queue_.size() == 1));
     }
   }
@@ -411,6 +640,7 @@ void QueuedWorkerPool::Sequence::CancelPendingFunctions() {
   {
     ScopedMutex lock(sequence_mutex_.get());
     work_queue_.swap(cancel_queue);
+    add_times_us_.clear();
   }
   UpdateWaveform(queue_size_, -static_cast<int>(cancel_queue.size()));
   while (!cancel_queue.empty()) {
@@ -420,7 +650,42 @@ void QueuedWorkerPool::Sequence::CancelPendingFunctions() {
   }
 }
 
+Function* QueuedWorkerPool::Sequence::PopFunction(int64* add_time_us) {
+  Function* function = work_queue_.front();
+  work_queue_.pop_front();
+  if (!add_times_us_.empty()) {
+    if (add_time_us != NULL) {
+      *add_time_us = add_times_us_.front();
+    }
+    add_times_us_.pop_front();
+  }
+  return function;
+}
+
 Function* QueuedWorkerPool::Sequence::NextFunction() {
+  int64 add_time_us = 0;
+  Function* function;
+  while ((function = TakeNextFunction(&add_time_us)) != NULL) {
+    if (timer_ == NULL) {
+      break;
+    }
+    int64 now_us = timer_->NowUs();
+    int64 delay_us = now_us - add_time_us;
+    if (queue_delay_ms_ != NULL) {
+      // Timers are not guaranteed to go forward in time.
+      queue_delay_ms_->Add(std::max(static_cast<int64>(0), delay_us) /
+                           Timer::kMsUs);
+    }
+    if ((queue_delay_controller_ == NULL) ||
+        !queue_delay_controller_->ShouldDrop(delay_us, now_us)) {
+      break;
+    }
+    function->CallCancel();
+  }
+  return function;
+}
+
+Function* QueuedWorkerPool::Sequence::TakeNextFunction(int64* add_time_us) {
   Function* function = NULL;
   QueuedWorkerPool* release_to_pool = NULL;
   int queue_size_delta = 0;
@@ -449,8 +714,7 @@ Function* QueuedWorkerPool::Sequence::NextFunction() {
     } else if (work_queue_.empty()) {
       active_ = false;
     } else {
-      function = work_queue_.front();
-      work_queue_.pop_front();
+      function = PopFunction(add_time_us);
       active_ = true;
       --queue_size_delta;
     }
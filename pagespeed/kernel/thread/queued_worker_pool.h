@@ -21,6 +21,11 @@
 //
 // This differs from QueuedWorker, which always uses exactly one thread.
 // In this interface, any task can be assigned to any thread.
+//
+// By default runnable sequences wait for a worker in a single queue under
+// the pool mutex.  With set_work_stealing(true) each worker instead has its
+// own queue of runnable sequences, and a worker with nothing to do takes
+// sequences from the other workers' queues.
 
 #ifndef PAGESPEED_KERNEL_THREAD_QUEUED_WORKER_POOL_H_
 #define PAGESPEED_KERNEL_THREAD_QUEUED_WORKER_POOL_H_
@@ -30,6 +35,7 @@
 #include <set>
 #include <vector>
 
+#include "pagespeed/kernel/base/atomic_int32.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
@@ -41,7 +47,10 @@
 namespace net_instaweb {
 
 class AbstractMutex;
+class Histogram;
+class QueueDelayController;
 class QueuedWorker;
+class Timer;
 class Waveform;
 
 // Maintains a predefined number of worker threads, and dispatches any
@@ -132,9 +141,20 @@ class QueuedWorkerPool {
     bool InitiateShutDown() LOCKS_EXCLUDED(sequence_mutex_);
 
     // Gets the next function in the sequence, and transfers ownership
-    // the the caller.
+    // the the caller.  Functions that the pool's QueueDelayController
+    // drops are canceled and skipped.
     Function* NextFunction() LOCKS_EXCLUDED(sequence_mutex_);
 
+    // Gets the next function in the sequence, and the time it was added
+    // if queue delay is being tracked.
+    Function* TakeNextFunction(int64* add_time_us)
+        LOCKS_EXCLUDED(sequence_mutex_);
+
+    // Removes the oldest function from work_queue_, along with the time
+    // it was added, which is stored in *add_time_us if that's non-NULL.
+    Function* PopFunction(int64* add_time_us)
+        EXCLUSIVE_LOCKS_REQUIRED(sequence_mutex_);
+
     bool IsBusy() EXCLUSIVE_LOCKS_REQUIRED(sequence_mutex_);
 
     // Returns number of tasks that were canceled.
@@ -145,6 +165,8 @@ class QueuedWorkerPool {
 
     friend class QueuedWorkerPool;
     std::deque<Function*> work_queue_;
+    // When each function in work_queue_ was added, if timer_ != NULL.
+    std::deque<int64> add_times_us_;
     scoped_ptr<ThreadSystem::CondvarCapableMutex> sequence_mutex_;
     QueuedWorkerPool* pool_;
     bool shutdown_;
@@ -153,6 +175,11 @@ class QueuedWorkerPool {
     Waveform* queue_size_;
     size_t max_queue_size_;
 
+    // Copied from the pool; see QueuedWorkerPool::TrackQueueDelay.
+    Timer* timer_;
+    Histogram* queue_delay_ms_;
+    QueueDelayController* queue_delay_controller_;
+
     DISALLOW_COPY_AND_ASSIGN(Sequence);
   };
 
@@ -216,13 +243,54 @@ class QueuedWorkerPool {
   // This must be called prior to creating sequences.
   void set_queue_size_stat(Waveform* x) { queue_size_ = x; }
 
+  // Measures how long each function waits in its Sequence before it runs,
+  // adding the delay in milliseconds to histogram, which may be NULL.
+  //
+  // This must be called prior to creating sequences.
+  void TrackQueueDelay(Timer* timer, Histogram* histogram);
+
+  // Sheds load based on how long functions have waited, rather than on the
+  // number of sequences waiting: when the controller says to drop a
+  // function as it comes to the front of its Sequence, the function is
+  // canceled rather than run.  This can be used alongside, or instead of,
+  // SetLoadSheddingThreshold.  Takes ownership of controller.
+  //
+  // Requires TrackQueueDelay, and must be called prior to creating
+  // sequences.
+  void SetQueueDelayController(QueueDelayController* controller);
+
+  // Selects work-stealing dispatch.  Sequences that become runnable are
+  // spread round-robin over per-worker queues, so queueing one takes only
+  // that queue's lock rather than the pool mutex.  A worker whose own queue
+  // is empty steals from the others' queues, skipping empty ones without
+  // locking and contended ones with TryLock, before going to sleep.  All
+  // max_workers threads are started when the first sequence is created.
+  //
+  // Functions in a Sequence still run one at a time, in the order added.
+  // Load-shedding cancels the oldest sequence on the queue that pushes the
+  // total over the threshold, rather than the oldest in the pool.
+  //
+  // Must be called before creating any sequences.
+  void set_work_stealing(bool x) { work_stealing_ = x; }
+  bool work_stealing() const { return work_stealing_; }
+
  private:
+  class StealingQueue;
   friend class Sequence;
   void Run(Sequence* sequence, QueuedWorker* worker);
   void QueueSequence(Sequence* sequence);
   Sequence* AssignWorkerToNextSequence(QueuedWorker* worker);
   void SequenceNoLongerActive(Sequence* sequence);
 
+  // Work-stealing dispatch; see set_work_stealing.
+  void StartStealingWorkers() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RunStealingWorker(int index);
+  void QueueStealableSequence(Sequence* sequence);
+  Sequence* NextStealableSequence(int index);
+  Sequence* TakeSequence(int index, bool block);
+  void WakeIdleWorker();
+  void RemoveIdleWorker(int index);
+
   ThreadSystem* thread_system_;
   scoped_ptr<AbstractMutex> mutex_;
 
@@ -244,6 +312,20 @@ class QueuedWorkerPool {
   Waveform* queue_size_;
   int load_shedding_threshold_;
 
+  Timer* timer_;
+  Histogram* queue_delay_ms_;
+  scoped_ptr<QueueDelayController> queue_delay_controller_;
+
+  // Work-stealing state.  stealing_queues_ is filled in once, under mutex_,
+  // by the first NewSequence, and is read without locking after that.
+  bool work_stealing_;
+  std::vector<StealingQueue*> stealing_queues_;
+  scoped_ptr<AbstractMutex> idle_mutex_;
+  std::vector<int> idle_workers_ GUARDED_BY(idle_mutex_);
+  AtomicInt32 num_idle_workers_;       // idle_workers_.size(), for peeking.
+  AtomicInt32 num_queued_sequences_;   // Over all of stealing_queues_.
+  AtomicInt32 next_queue_;             // Round-robin queue selector.
+
   DISALLOW_COPY_AND_ASSIGN(QueuedWorkerPool);
 };
 
@@ -19,12 +19,19 @@
 
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 
+#include <vector>
+
 #include "base/logging.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/function.h"
 #include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/mock_timer.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/thread/queue_delay_controller.h"
 #include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/simple_stats.h"
 
 namespace net_instaweb {
 namespace {
@@ -328,6 +335,281 @@ TEST_F(QueuedWorkerPoolTest, CancelPending) {
   EXPECT_EQ(-300, count);
 }
 
+// Advances a MockTimer as it runs, counting runs and cancels.
+class AdvanceTimerFunction : public Function {
+ public:
+  AdvanceTimerFunction(MockTimer* timer, int64 advance_ms, int* runs,
+                       int* cancels)
+      : timer_(timer),
+        advance_ms_(advance_ms),
+        runs_(runs),
+        cancels_(cancels) {
+  }
+
+  virtual void Run() {
+    timer_->AdvanceMs(advance_ms_);
+    ++*runs_;
+  }
+  virtual void Cancel() { ++*cancels_; }
+
+ private:
+  MockTimer* timer_;
+  int64 advance_ms_;
+  int* runs_;
+  int* cancels_;
+
+  DISALLOW_COPY_AND_ASSIGN(AdvanceTimerFunction);
+};
+
+TEST_F(QueuedWorkerPoolTest, QueueDelayShedding) {
+  const char kDelay[] = "delay";
+  const char kShed[] = "shed";
+  MockTimer timer(thread_runtime_->NewMutex(), MockTimer::kApr_5_2010_ms);
+  SimpleStats stats(thread_runtime_.get());
+  stats.AddHistogram(kDelay);
+  stats.AddVariable(kShed);
+  worker_->TrackQueueDelay(&timer, stats.GetHistogram(kDelay));
+  worker_->SetQueueDelayController(new QueueDelayController(
+      10 * Timer::kMsUs, 100 * Timer::kMsUs, thread_runtime_->NewMutex(),
+      stats.GetVariable(kShed)));
+
+  SyncPoint started(thread_runtime_.get());
+  SyncPoint wait(thread_runtime_.get());
+  SyncPoint done(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  int runs = 0;
+  int cancels = 0;
+  sequence->Add(new NotifyAndWait(&started, &wait));
+  started.Wait();
+  sequence->Add(new AdvanceTimerFunction(&timer, 200, &runs, &cancels));
+  sequence->Add(new AdvanceTimerFunction(&timer, 200, &runs, &cancels));
+  sequence->Add(new NotifyRunFunction(&done));
+  timer.AdvanceMs(1000);
+  wait.Notify();
+  done.Wait();
+
+  // The first function waited 1s, far over the 10ms target, but one task
+  // is not enough to tell a standing queue from a burst, so it runs.  By the
+  // time the second is dequeued, delay has been over target for the 100ms
+  // interval so it is dropped.  The third is not due to be dropped until
+  // another interval has passed.
+  EXPECT_EQ(1, runs);
+  EXPECT_EQ(1, cancels);
+  EXPECT_EQ(1, stats.GetVariable(kShed)->Get());
+
+  // Every function was timed, including the wedge, which did not wait.
+  EXPECT_EQ(4, stats.GetHistogram(kDelay)->Count());
+  worker_->FreeSequence(sequence);
+}
+
+// The same pool with work-stealing dispatch.
+class WorkStealingQueuedWorkerPoolTest : public QueuedWorkerPoolTest {
+ public:
+  WorkStealingQueuedWorkerPoolTest() {
+    worker_->set_work_stealing(true);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingQueuedWorkerPoolTest);
+};
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, BasicOperation) {
+  const int kBound = 42;
+  int count = 0;
+  SyncPoint sync(thread_runtime_.get());
+
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  for (int i = 0; i < kBound; ++i) {
+    sequence->Add(new Increment(i + 1, &count));
+  }
+
+  sequence->Add(new NotifyRunFunction(&sync));
+  sync.Wait();
+  EXPECT_EQ(kBound, count);
+  worker_->FreeSequence(sequence);
+}
+
+// Sequences are queued round-robin, so the fast sequence lands on the same
+// queue as the wedged slow one, and the other worker must take it from
+// there.
+TEST_F(WorkStealingQueuedWorkerPoolTest, SlowAndFastSequences) {
+  const int kBound = 42;
+  int count = 0;
+  SyncPoint started(thread_runtime_.get());
+  SyncPoint wait(thread_runtime_.get());
+  SyncPoint sync(thread_runtime_.get());
+
+  QueuedWorkerPool::Sequence* slow_sequence = worker_->NewSequence();
+  slow_sequence->Add(new NotifyAndWait(&started, &wait));
+  slow_sequence->Add(new NotifyRunFunction(&sync));
+  started.Wait();
+
+  // Queue a sequence on the second worker's queue, so that the fast one
+  // lands on the first worker's.
+  QueuedWorkerPool::Sequence* filler = worker_->NewSequence();
+  WaitUntilSequenceCompletes(filler);
+
+  QueuedWorkerPool::Sequence* fast_sequence = worker_->NewSequence();
+  for (int i = 0; i < kBound; ++i) {
+    fast_sequence->Add(new Increment(i + 1, &count));
+  }
+  fast_sequence->Add(new NotifyRunFunction(&wait));
+
+  sync.Wait();
+  EXPECT_EQ(kBound, count);
+  worker_->FreeSequence(fast_sequence);
+  worker_->FreeSequence(filler);
+  worker_->FreeSequence(slow_sequence);
+}
+
+// Many sequences, each fed from its own thread, must each still run their
+// functions in order, one at a time.
+class AddIncrements : public Function {
+ public:
+  AddIncrements(QueuedWorkerPool::Sequence* sequence, int bound, int* count,
+                WorkerTestBase::SyncPoint* done)
+      : sequence_(sequence), bound_(bound), count_(count), done_(done) {
+  }
+
+  virtual void Run() {
+    for (int i = 0; i < bound_; ++i) {
+      sequence_->Add(new Increment(i + 1, count_));
+    }
+    sequence_->Add(new WorkerTestBase::NotifyRunFunction(done_));
+  }
+
+ private:
+  QueuedWorkerPool::Sequence* sequence_;
+  int bound_;
+  int* count_;
+  WorkerTestBase::SyncPoint* done_;
+
+  DISALLOW_COPY_AND_ASSIGN(AddIncrements);
+};
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, ManySequences) {
+  const int kNumSequences = 20;
+  const int kBound = 500;
+  QueuedWorkerPool feeders(kNumSequences, "feeder", thread_runtime_.get());
+  std::vector<QueuedWorkerPool::Sequence*> sequences;
+  std::vector<int> counts(kNumSequences, 0);
+  std::vector<SyncPoint*> done;
+  for (int i = 0; i < kNumSequences; ++i) {
+    sequences.push_back(worker_->NewSequence());
+    done.push_back(new SyncPoint(thread_runtime_.get()));
+  }
+  for (int i = 0; i < kNumSequences; ++i) {
+    feeders.NewSequence()->Add(
+        new AddIncrements(sequences[i], kBound, &counts[i], done[i]));
+  }
+  for (int i = 0; i < kNumSequences; ++i) {
+    done[i]->Wait();
+    EXPECT_EQ(kBound, counts[i]);
+    worker_->FreeSequence(sequences[i]);
+    delete done[i];
+  }
+  feeders.ShutDown();
+}
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, RestartSequenceFromFunction) {
+  SyncPoint sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  sequence->Add(new MakeNewSequence(&sync, worker_.get(), sequence));
+  sync.Wait();
+}
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, AddAfterShutDown) {
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  worker_->ShutDown();
+  LogOpsFunction f;
+  sequence->Add(&f);
+  worker_.reset(NULL);
+  EXPECT_TRUE(f.cancel_called());
+  EXPECT_FALSE(f.run_called());
+}
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, LoadShedding) {
+  const int kThresh = 100;
+  worker_->SetLoadSheddingThreshold(kThresh);
+  // Wedge both workers, then queue 2*kThresh independent LogOpsFunctions
+  // and a notify.  Every sequence queued beyond kThresh cancels the oldest
+  // on its queue, so the first kThresh + 1 are canceled and the rest run.
+  SyncPoint started1(thread_runtime_.get());
+  SyncPoint started2(thread_runtime_.get());
+  SyncPoint wedge1_sync(thread_runtime_.get());
+  SyncPoint wedge2_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* wedge1 = worker_->NewSequence();
+  wedge1->Add(new NotifyAndWait(&started1, &wedge1_sync));
+  QueuedWorkerPool::Sequence* wedge2 = worker_->NewSequence();
+  wedge2->Add(new NotifyAndWait(&started2, &wedge2_sync));
+  started1.Wait();
+  started2.Wait();
+
+  std::vector<QueuedWorkerPool::Sequence*> log_ops;
+  std::vector<LogOpsFunction*> log_ops_functions;
+  for (int i = 0; i < 2 * kThresh; ++i) {
+    LogOpsFunction* fn = new LogOpsFunction;
+    QueuedWorkerPool::Sequence* log_op = worker_->NewSequence();
+    log_op->Add(fn);
+    log_ops.push_back(log_op);
+    log_ops_functions.push_back(fn);
+  }
+
+  SyncPoint done_sync(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* done = worker_->NewSequence();
+  done->Add(new NotifyRunFunction(&done_sync));
+
+  wedge1_sync.Notify();
+  wedge2_sync.Notify();
+  done_sync.Wait();
+
+  // The other queue may still be working through its log ops.
+  for (int i = kThresh + 1; i < 2 * kThresh; ++i) {
+    WaitUntilSequenceCompletes(log_ops[i]);
+  }
+  worker_->ShutDown();
+
+  // Sequences alternate between the two queues, so the ones canceled are
+  // the oldest, as with a single queue.
+  for (int i = 0; i <= kThresh; ++i) {
+    EXPECT_TRUE(log_ops_functions[i]->cancel_called());
+    EXPECT_FALSE(log_ops_functions[i]->run_called());
+    delete log_ops_functions[i];
+    worker_->FreeSequence(log_ops[i]);
+  }
+
+  for (int i = kThresh + 1; i < 2 * kThresh; ++i) {
+    EXPECT_FALSE(log_ops_functions[i]->cancel_called());
+    EXPECT_TRUE(log_ops_functions[i]->run_called());
+    delete log_ops_functions[i];
+    worker_->FreeSequence(log_ops[i]);
+  }
+
+  worker_->FreeSequence(wedge1);
+  worker_->FreeSequence(wedge2);
+  worker_->FreeSequence(done);
+}
+
+TEST_F(WorkStealingQueuedWorkerPoolTest, MaxQueueSize) {
+  SyncPoint started(thread_runtime_.get());
+  SyncPoint wait(thread_runtime_.get());
+  SyncPoint done(thread_runtime_.get());
+  QueuedWorkerPool::Sequence* sequence = worker_->NewSequence();
+  sequence->set_max_queue_size(4);
+  int count = 0;
+  sequence->Add(new NotifyAndWait(&started, &wait));
+  started.Wait();
+  sequence->Add(new Increment(-100, &count));  // will be canceled: -100.
+  sequence->Add(new Increment(-99, &count));   // will be run: +1 == -99.
+  sequence->Add(new Increment(-98, &count));   // will be run: +1 == -98.
+  sequence->Add(new NotifyRunFunction(&done));
+  sequence->Add(new Increment(-97, &count));   // Cancels first increment.
+  wait.Notify();
+  done.Wait();
+  WaitUntilSequenceCompletes(sequence);
+  EXPECT_EQ(-97, count);
+}
+
 }  // namespace
 
 }  // namespace net_instaweb
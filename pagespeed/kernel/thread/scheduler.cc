@@ -74,11 +74,16 @@ class Scheduler::Alarm {
  protected:
   Alarm() : wakeup_time_us_(0),
             index_(kIndexNotSet),
-            in_wait_dispatch_(false) { }
+            in_wait_dispatch_(false),
+            prev_(NULL),
+            next_(NULL),
+            slot_(NULL),
+            in_ready_set_(false) { }
   virtual ~Alarm() { }
 
  private:
   friend class Scheduler;
+  friend class Scheduler::AlarmWheel;
   int64 wakeup_time_us_;
   uint32 index_;  // Set by scheduler to disambiguate equal wakeup times.
 
@@ -86,9 +91,364 @@ class Scheduler::Alarm {
   // as owned by it for purposes of cleanup, so any concurrent timeout will
   // know not to delete it.
   bool in_wait_dispatch_;
+
+  // Position in the AlarmWheel: either linked into the list headed by
+  // *slot_, or in its ready set, or (if neither) not queued at all.
+  Alarm* prev_;
+  Alarm* next_;
+  Alarm** slot_;
+  bool in_ready_set_;
   DISALLOW_COPY_AND_ASSIGN(Alarm);
 };
 
+// A hierarchical timing wheel holding the outstanding alarms, so that adding
+// and cancelling an alarm takes constant time however many are pending.
+//
+// Time is divided into ticks of kTickUs.  Alarms due within 256 ticks of the
+// wheel's cursor sit in a level-0 slot for their tick; later ones sit in a
+// slot of one of the coarser levels, each of which has 64 slots 64 times
+// as wide as the level below, and are cascaded down a level when the cursor
+// reaches the start of their slot.  Alarms beyond the last level wait in an
+// overflow list that is redistributed each time the cursor crosses a
+// top-level slot.  Alarms in ticks the cursor has reached are kept in a
+// small ready set ordered by CompareAlarms, which is where they are run from
+// in exactly the order the scheduler has always used.
+class Scheduler::AlarmWheel {
+ public:
+  explicit AlarmWheel(int64 now_us)
+      : cursor_(TickFor(now_us)),
+        size_(0),
+        wheel_size_(0),
+        overflow_(NULL),
+        next_wakeup_us_(0),
+        next_wakeup_valid_(true) {
+    for (int i = 0; i < kNumSlots; ++i) {
+      slots_[i] = NULL;
+    }
+    for (int i = 0; i < kNumWords; ++i) {
+      occupied_[i] = 0;
+    }
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  void Insert(Alarm* alarm) {
+    DCHECK(alarm->slot_ == NULL && !alarm->in_ready_set_);
+    if (size_ == 0) {
+      next_wakeup_us_ = alarm->wakeup_time_us_;
+      next_wakeup_valid_ = true;
+    } else if (next_wakeup_valid_ &&
+               (alarm->wakeup_time_us_ < next_wakeup_us_)) {
+      next_wakeup_us_ = alarm->wakeup_time_us_;
+    }
+    ++size_;
+    Place(alarm);
+  }
+
+  // Removes alarm, returning false if it was not queued.
+  bool Remove(Alarm* alarm) {
+    if (alarm->slot_ != NULL) {
+      Unlink(alarm);
+      --wheel_size_;
+    } else if (alarm->in_ready_set_) {
+      ready_.erase(alarm);
+      alarm->in_ready_set_ = false;
+    } else {
+      return false;
+    }
+    --size_;
+    if (alarm->wakeup_time_us_ == next_wakeup_us_) {
+      next_wakeup_valid_ = false;
+    }
+    return true;
+  }
+
+  // Removes and returns the first alarm if it is due by now_us, else NULL.
+  Alarm* PopDue(int64 now_us) {
+    Advance(TickFor(now_us));
+    if (ready_.empty()) {
+      return NULL;
+    }
+    AlarmSet::iterator first = ready_.begin();
+    Alarm* alarm = *first;
+    if (alarm->wakeup_time_us_ > now_us) {
+      return NULL;
+    }
+    ready_.erase(first);
+    alarm->in_ready_set_ = false;
+    --size_;
+    next_wakeup_valid_ = false;
+    return alarm;
+  }
+
+  // Returns the earliest wakeup time, or 0 if there are no alarms.
+  int64 NextWakeupUs() {
+    if (size_ == 0) {
+      return 0;
+    } else if (!ready_.empty()) {
+      // Everything in the wheel is in a later tick.
+      return (*ready_.begin())->wakeup_time_us_;
+    } else if (!next_wakeup_valid_) {
+      next_wakeup_us_ = ComputeNextWakeupUs();
+      next_wakeup_valid_ = true;
+    }
+    return next_wakeup_us_;
+  }
+
+ private:
+  static const int64 kTickUs = Timer::kMsUs;
+  static const int kNumLevels = 4;
+  static const int kLevel0Bits = 8;
+  static const int kLevelBits = 6;
+  static const int kLevel0Slots = 1 << kLevel0Bits;
+  static const int kLevelSlots = 1 << kLevelBits;
+  static const int kNumSlots =
+      kLevel0Slots + (kNumLevels - 1) * kLevelSlots;
+  static const int kTopShift = kLevel0Bits + (kNumLevels - 2) * kLevelBits;
+  static const int kNumWords = kNumSlots / 64;
+
+  static int64 TickFor(int64 time_us) { return time_us / kTickUs; }
+
+  // The log2 of the width, in ticks, of a slot at level >= 1.
+  static int Shift(int level) {
+    return kLevel0Bits + (level - 1) * kLevelBits;
+  }
+
+  static int NumSlots(int level) {
+    return (level == 0) ? kLevel0Slots : kLevelSlots;
+  }
+
+  // The index in slots_ of the first slot of level.
+  static int LevelBase(int level) {
+    return (level == 0) ? 0 : kLevel0Slots + (level - 1) * kLevelSlots;
+  }
+
+  Alarm** LevelSlot(int level, int64 block) {
+    return &slots_[LevelBase(level) + (block & (NumSlots(level) - 1))];
+  }
+
+  void SetOccupied(Alarm** slot, bool occupied) {
+    if (slot != &overflow_) {
+      int index = slot - slots_;
+      uint64 bit = static_cast<uint64>(1) << (index & 63);
+      if (occupied) {
+        occupied_[index >> 6] |= bit;
+      } else {
+        occupied_[index >> 6] &= ~bit;
+      }
+    }
+  }
+
+  // Returns the index of the lowest set bit of a non-zero word.
+  static int LowestBit(uint64 word) {
+    static const int kDeBruijnIndex[64] = {
+       0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+      62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+      63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+      46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+    };
+    uint64 lowest = word & (~word + 1);
+    return kDeBruijnIndex[(lowest * 0x03f79d71b4cb0a89ULL) >> 58];
+  }
+
+  // Returns k in [1, NumSlots(level)] such that the slot k after the one
+  // for position 'current' is the first occupied one in level, or 0 if the
+  // level is empty.  Scans a word of the occupancy bitmap at a time.
+  int NextOccupied(int level, int64 current) {
+    int num_slots = NumSlots(level);
+    int base = LevelBase(level);
+    int start = (current + 1) & (num_slots - 1);
+    int pos = start;
+    for (int remaining = num_slots; remaining > 0; ) {
+      int bit = pos & 63;
+      int span = std::min(64 - bit, remaining);
+      uint64 bits = occupied_[(base + pos) >> 6] >> bit;
+      if (span < 64) {
+        bits &= (static_cast<uint64>(1) << span) - 1;
+      }
+      if (bits != 0) {
+        return ((pos + LowestBit(bits) - start) & (num_slots - 1)) + 1;
+      }
+      remaining -= span;
+      pos = (pos + span) & (num_slots - 1);
+    }
+    return 0;
+  }
+
+  // Links alarm into the ready set or the slot for its tick, relative to
+  // the current cursor.
+  void Place(Alarm* alarm) {
+    int64 tick = TickFor(alarm->wakeup_time_us_);
+    if (tick <= cursor_) {
+      ready_.insert(alarm);
+      alarm->in_ready_set_ = true;
+      return;
+    }
+    ++wheel_size_;
+    if (tick - cursor_ <= kLevel0Slots) {
+      Link(LevelSlot(0, tick), alarm);
+      return;
+    }
+    for (int level = 1; level < kNumLevels; ++level) {
+      int shift = Shift(level);
+      int64 block = tick >> shift;
+      if (block - (cursor_ >> shift) <= kLevelSlots) {
+        Link(LevelSlot(level, block), alarm);
+        return;
+      }
+    }
+    Link(&overflow_, alarm);
+  }
+
+  void Link(Alarm** slot, Alarm* alarm) {
+    alarm->slot_ = slot;
+    alarm->prev_ = NULL;
+    alarm->next_ = *slot;
+    if (*slot != NULL) {
+      (*slot)->prev_ = alarm;
+    } else {
+      SetOccupied(slot, true);
+    }
+    *slot = alarm;
+  }
+
+  void Unlink(Alarm* alarm) {
+    if (alarm->prev_ == NULL) {
+      *alarm->slot_ = alarm->next_;
+      if (alarm->next_ == NULL) {
+        SetOccupied(alarm->slot_, false);
+      }
+    } else {
+      alarm->prev_->next_ = alarm->next_;
+    }
+    if (alarm->next_ != NULL) {
+      alarm->next_->prev_ = alarm->prev_;
+    }
+    alarm->slot_ = NULL;
+    alarm->prev_ = NULL;
+    alarm->next_ = NULL;
+  }
+
+  // Detaches the list in *slot and places each of its alarms afresh.
+  void Redistribute(Alarm** slot) {
+    Alarm* alarm = *slot;
+    *slot = NULL;
+    SetOccupied(slot, false);
+    while (alarm != NULL) {
+      Alarm* next = alarm->next_;
+      alarm->slot_ = NULL;
+      alarm->prev_ = NULL;
+      alarm->next_ = NULL;
+      --wheel_size_;
+      Place(alarm);
+      alarm = next;
+    }
+  }
+
+  // Returns the first tick after the cursor at which a slot comes due, or
+  // kint64max if there is none.
+  int64 NextEventTick() {
+    int64 best = kint64max;
+    int k = NextOccupied(0, cursor_);
+    if (k != 0) {
+      best = cursor_ + k;
+    }
+    for (int level = 1; level < kNumLevels; ++level) {
+      int shift = Shift(level);
+      int64 block = cursor_ >> shift;
+      if (best <= ((block + 1) << shift)) {
+        continue;  // No slot of this level can start sooner.
+      }
+      k = NextOccupied(level, block);
+      if (k != 0) {
+        best = std::min(best, (block + k) << shift);
+      }
+    }
+    if (overflow_ != NULL) {
+      best = std::min(best, ((cursor_ >> kTopShift) + 1) << kTopShift);
+    }
+    return best;
+  }
+
+  // Moves the cursor to now_tick, cascading or readying each slot that
+  // comes due on the way.  Each step of the loop empties at least one slot,
+  // or crosses a top-level boundary while there are overflow alarms.
+  void Advance(int64 now_tick) {
+    while (cursor_ < now_tick) {
+      int64 event = (wheel_size_ == 0) ? kint64max : NextEventTick();
+      if (event > now_tick) {
+        cursor_ = now_tick;
+        break;
+      }
+      cursor_ = event;
+      if ((cursor_ & ((static_cast<int64>(1) << kTopShift) - 1)) == 0) {
+        Redistribute(&overflow_);
+      }
+      for (int level = kNumLevels - 1; level >= 1; --level) {
+        int shift = Shift(level);
+        if ((cursor_ & ((static_cast<int64>(1) << shift) - 1)) == 0) {
+          Redistribute(LevelSlot(level, cursor_ >> shift));
+        }
+      }
+      Redistribute(LevelSlot(0, cursor_));
+    }
+  }
+
+  // Finds the earliest alarm in the wheel.  Each level-0 slot holds a single
+  // tick and each coarser slot a single block, so the earliest alarm is in
+  // the first non-empty slot of some level, or if the wheel is otherwise
+  // empty, in the overflow list.  A coarse slot is only scanned if it starts
+  // before the best time found so far, which is rare, as alarms are usually
+  // cascaded down to level 0 well before they are due.
+  int64 ComputeNextWakeupUs() {
+    DCHECK(ready_.empty());
+    int64 best = kint64max;
+    int k = NextOccupied(0, cursor_);
+    if (k != 0) {
+      best = EarliestInList(*LevelSlot(0, cursor_ + k));
+    }
+    for (int level = 1; level < kNumLevels; ++level) {
+      int shift = Shift(level);
+      int64 block = cursor_ >> shift;
+      if (best <= ((block + 1) << shift) * kTickUs) {
+        continue;
+      }
+      k = NextOccupied(level, block);
+      if ((k != 0) && (((block + k) << shift) * kTickUs < best)) {
+        best = std::min(best, EarliestInList(*LevelSlot(level, block + k)));
+      }
+    }
+    if (best == kint64max) {
+      DCHECK(overflow_ != NULL);
+      best = EarliestInList(overflow_);
+    }
+    return best;
+  }
+
+  static int64 EarliestInList(Alarm* alarm) {
+    int64 earliest = alarm->wakeup_time_us_;
+    for (alarm = alarm->next_; alarm != NULL; alarm = alarm->next_) {
+      earliest = std::min(earliest, alarm->wakeup_time_us_);
+    }
+    return earliest;
+  }
+
+  int64 cursor_;       // The last tick the wheel has advanced to.
+  int size_;           // Number of alarms, including the ready set.
+  int wheel_size_;     // Number of alarms in slots_ and overflow_.
+  Alarm* slots_[kNumSlots];
+  uint64 occupied_[kNumWords];  // Bitmap of the non-empty slots_.
+  Alarm* overflow_;
+  AlarmSet ready_;     // Alarms in ticks <= cursor_.
+
+  // Cache of NextWakeupUs(), which is kept up to date by Insert and only
+  // invalidated by removing the earliest alarm.
+  int64 next_wakeup_us_;
+  bool next_wakeup_valid_;
+
+  DISALLOW_COPY_AND_ASSIGN(AlarmWheel);
+};
+
 namespace {
 
 // private class to encapsulate a function being
@@ -204,6 +564,7 @@ Scheduler::Scheduler(ThreadSystem* thread_system, Timer* timer)
       mutex_(thread_system->NewMutex()),
       condvar_(mutex_->NewCondvar()),
       index_(kIndexNotSet),
+      outstanding_alarms_(new AlarmWheel(timer->NowUs())),
       signal_count_(0),
       running_waiting_alarms_(false) {
 }
@@ -211,10 +572,8 @@ Scheduler::Scheduler(ThreadSystem* thread_system, Timer* timer)
 Scheduler::~Scheduler() {
 #if SCHEDULER_CANCEL_OUTSTANDING_ALARMS_ON_DESTRUCTION
   ScopedMutex lock(mutex_.get());
-  while (!outstanding_alarms_.empty()) {
-    AlarmSet::iterator p = outstanding_alarms_.begin();
-    Alarm* alarm = *p;
-    outstanding_alarms_.erase(p);
+  while (!outstanding_alarms_->empty()) {
+    Alarm* alarm = outstanding_alarms_->PopDue(kint64max);
     alarm->CancelAlarm();
   }
 #endif
@@ -306,15 +665,11 @@ void Scheduler::AddAlarmMutexHeldUs(int64 wakeup_time_us, Alarm* alarm) {
   alarm->wakeup_time_us_ = wakeup_time_us;
   alarm->index_ = ++index_;
   // Someone may care about changes in wait time.  Broadcast if any occurred.
-  if (!outstanding_alarms_.empty()) {
-    Alarm* first_alarm = *outstanding_alarms_.begin();
-    if (wakeup_time_us < first_alarm->wakeup_time_us_) {
-      condvar_->Broadcast();
-    }
-  } else {
+  if (outstanding_alarms_->empty() ||
+      (wakeup_time_us < outstanding_alarms_->NextWakeupUs())) {
     condvar_->Broadcast();
   }
-  outstanding_alarms_.insert(alarm);
+  outstanding_alarms_->Insert(alarm);
 }
 
 Scheduler::Alarm* Scheduler::AddAlarmAtUs(int64 wakeup_time_us,
@@ -328,7 +683,7 @@ Scheduler::Alarm* Scheduler::AddAlarmAtUs(int64 wakeup_time_us,
 
 bool Scheduler::CancelAlarm(Alarm* alarm) {
   mutex_->DCheckLocked();
-  if (outstanding_alarms_.erase(alarm) != 0) {
+  if (outstanding_alarms_->Remove(alarm)) {
     // Note: the following call may drop and re-lock the scheduler mutex.
     alarm->CancelAlarm();
     return true;
@@ -338,20 +693,17 @@ bool Scheduler::CancelAlarm(Alarm* alarm) {
 }
 
 int64 Scheduler::RunAlarms(bool* ran_alarms) {
-  while (!outstanding_alarms_.empty()) {
+  while (!outstanding_alarms_->empty()) {
     mutex_->DCheckLocked();
-    // We don't use the iterator to go through the set, because we're dropping
-    // the lock in mid-loop thus permitting new insertions and cancellations.
-    AlarmSet::iterator first_alarm_iterator = outstanding_alarms_.begin();
-    Alarm* first_alarm = *first_alarm_iterator;
+    // We take one alarm at a time, because we're dropping the lock in
+    // mid-loop thus permitting new insertions and cancellations.  Popping
+    // first_alarm prevents its cancellation.
     int64 now_us = timer_->NowUs();
-    if (now_us < first_alarm->wakeup_time_us_) {
+    Alarm* first_alarm = outstanding_alarms_->PopDue(now_us);
+    if (first_alarm == NULL) {
       // The next deadline lies in the future.
-      return first_alarm->wakeup_time_us_;
+      return outstanding_alarms_->NextWakeupUs();
     }
-    // first_alarm should be run.  It can't have been cancelled as we've held
-    // the lock since we found it.
-    outstanding_alarms_.erase(first_alarm_iterator);  // Prevent cancellation.
     if (ran_alarms != NULL) {
       *ran_alarms = true;
     }
@@ -394,7 +746,7 @@ void Scheduler::ProcessAlarmsOrWaitUs(int64 timeout_us) {
 // For testing purposes, let a tester know when the scheduler has quiesced.
 bool Scheduler::NoPendingAlarms() {
   mutex_->DCheckLocked();
-  return (outstanding_alarms_.empty());
+  return outstanding_alarms_->empty();
 }
 
 SchedulerBlockingFunction::SchedulerBlockingFunction(Scheduler* scheduler)
@@ -162,6 +162,7 @@ class Scheduler {
   bool running_waiting_alarms() const { return running_waiting_alarms_; }
 
  private:
+  class AlarmWheel;
   class CondVarTimeout;
   class CondVarCallbackTimeout;
   friend class SchedulerTest;
@@ -179,9 +180,10 @@ class Scheduler {
   // signal_count_ increasing) events occur.
   scoped_ptr<ThreadSystem::Condvar> condvar_;
   uint32 index_;  // Used to disambiguate alarms with equal deadlines
-  AlarmSet outstanding_alarms_;  // Priority queue of future alarms
+  // Priority queue of future alarms, with O(1) insertion and cancellation.
   // An alarm may be deleted iff it is successfully removed from
   // outstanding_alarms_.
+  scoped_ptr<AlarmWheel> outstanding_alarms_;
   int64 signal_count_;           // Number of times Signal has been called
   AlarmSet waiting_alarms_;      // Alarms waiting for signal_count to change
   bool running_waiting_alarms_;  // True if we're in process of invoking
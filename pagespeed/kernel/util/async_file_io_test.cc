@@ -0,0 +1,227 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Unit-test the AsyncFileIo implementations.
+
+#include "pagespeed/kernel/base/async_file_io.h"
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/google_message_handler.h"
+#include "pagespeed/kernel/base/gtest.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/stdio_file_system.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/worker_test_base.h"
+#include "pagespeed/kernel/util/io_uring_file_io.h"
+#include "pagespeed/kernel/util/platform.h"
+#include "pagespeed/kernel/util/threaded_file_io.h"
+
+namespace net_instaweb {
+
+namespace {
+
+class TestReadCallback : public AsyncFileIo::ReadCallback {
+ public:
+  explicit TestReadCallback(ThreadSystem* thread_system)
+      : sync_point_(thread_system), success_(false) {}
+
+  virtual void Done(bool success, GoogleString* contents) {
+    success_ = success;
+    contents->swap(contents_);
+    sync_point_.Notify();
+  }
+
+  void Wait() { sync_point_.Wait(); }
+  bool success() const { return success_; }
+  const GoogleString& contents() const { return contents_; }
+
+ private:
+  WorkerTestBase::SyncPoint sync_point_;
+  bool success_;
+  GoogleString contents_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestReadCallback);
+};
+
+class TestWriteCallback : public AsyncFileIo::WriteCallback {
+ public:
+  explicit TestWriteCallback(ThreadSystem* thread_system)
+      : sync_point_(thread_system), success_(false) {}
+
+  virtual void Done(bool success) {
+    success_ = success;
+    sync_point_.Notify();
+  }
+
+  void Wait() { sync_point_.Wait(); }
+  bool success() const { return success_; }
+
+ private:
+  WorkerTestBase::SyncPoint sync_point_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestWriteCallback);
+};
+
+}  // namespace
+
+class AsyncFileIoTest : public testing::Test {
+ protected:
+  AsyncFileIoTest()
+      : thread_system_(Platform::CreateThreadSystem()),
+        path_(StrCat(GTestTempDir(), "/async_file_io/")) {
+  }
+
+  virtual void SetUp() {
+    NullMessageHandler null_handler;
+    file_system_.RemoveFile(Filename("a").c_str(), &null_handler);
+    file_system_.RemoveFile(Filename("dir/b").c_str(), &null_handler);
+    file_system_.RemoveDir(Filename("dir").c_str(), &null_handler);
+    ASSERT_TRUE(file_system_.RecursivelyMakeDir(path_, &message_handler_));
+    threaded_io_.reset(new ThreadedFileIo(2, &file_system_,
+                                          thread_system_.get(),
+                                          &message_handler_));
+  }
+
+  GoogleString Filename(StringPiece name) { return StrCat(path_, name); }
+
+  bool Write(AsyncFileIo* io, const GoogleString& filename,
+             const GoogleString& value) {
+    TestWriteCallback callback(thread_system_.get());
+    io->WriteFileAtomic(filename, SharedString(value), &callback);
+    callback.Wait();
+    return callback.success();
+  }
+
+  bool Read(AsyncFileIo* io, const GoogleString& filename,
+            GoogleString* contents) {
+    TestReadCallback callback(thread_system_.get());
+    io->ReadFile(filename, &callback);
+    callback.Wait();
+    *contents = callback.contents();
+    return callback.success();
+  }
+
+  void TestReadWrite(AsyncFileIo* io) {
+    GoogleString contents;
+    EXPECT_FALSE(Read(io, Filename("a"), &contents));
+    ASSERT_TRUE(Write(io, Filename("a"), "hello"));
+    ASSERT_TRUE(Read(io, Filename("a"), &contents));
+    EXPECT_EQ("hello", contents);
+
+    // Missing directories are created.
+    ASSERT_TRUE(Write(io, Filename("dir/b"), "world"));
+    ASSERT_TRUE(Read(io, Filename("dir/b"), &contents));
+    EXPECT_EQ("world", contents);
+
+    // Temp files are cleaned up.
+    StringVector files;
+    ASSERT_TRUE(file_system_.ListContents(path_, &files, &message_handler_));
+    EXPECT_EQ(static_cast<size_t>(2), files.size());
+  }
+
+  void TestReadFiles(AsyncFileIo* io) {
+    ASSERT_TRUE(Write(io, Filename("a"), "hello"));
+    ASSERT_TRUE(Write(io, Filename("dir/b"), "world"));
+
+    TestReadCallback a(thread_system_.get());
+    TestReadCallback missing(thread_system_.get());
+    TestReadCallback b(thread_system_.get());
+    AsyncFileIo::FileReadVector reads;
+    reads.push_back(AsyncFileIo::FileRead(Filename("a"), &a));
+    reads.push_back(AsyncFileIo::FileRead(Filename("missing"), &missing));
+    reads.push_back(AsyncFileIo::FileRead(Filename("dir/b"), &b));
+    io->ReadFiles(reads);
+    a.Wait();
+    missing.Wait();
+    b.Wait();
+    EXPECT_TRUE(a.success());
+    EXPECT_EQ("hello", a.contents());
+    EXPECT_FALSE(missing.success());
+    EXPECT_TRUE(b.success());
+    EXPECT_EQ("world", b.contents());
+  }
+
+  void TestShutDown(AsyncFileIo* io) {
+    io->ShutDown();
+    EXPECT_FALSE(Write(io, Filename("a"), "hello"));
+    GoogleString contents;
+    EXPECT_FALSE(Read(io, Filename("a"), &contents));
+    EXPECT_TRUE(file_system_.Exists(Filename("a").c_str(),
+                                    &message_handler_).is_false());
+  }
+
+  scoped_ptr<ThreadSystem> thread_system_;
+  StdioFileSystem file_system_;
+  GoogleMessageHandler message_handler_;
+  const GoogleString path_;
+  scoped_ptr<ThreadedFileIo> threaded_io_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AsyncFileIoTest);
+};
+
+TEST_F(AsyncFileIoTest, ThreadedReadWrite) {
+  TestReadWrite(threaded_io_.get());
+}
+
+TEST_F(AsyncFileIoTest, ThreadedShutDown) {
+  TestShutDown(threaded_io_.get());
+}
+
+TEST_F(AsyncFileIoTest, ThreadedReadFiles) {
+  TestReadFiles(threaded_io_.get());
+}
+
+TEST_F(AsyncFileIoTest, IoUringReadWrite) {
+  scoped_ptr<IoUringFileIo> io(IoUringFileIo::Create(
+      8, 2, threaded_io_.get(), thread_system_.get(), &message_handler_));
+  if (io.get() == NULL) {
+    LOG(WARNING) << "io_uring not available; skipping test";
+    return;
+  }
+  TestReadWrite(io.get());
+
+  // Only the write into a new directory needed the fallback.
+  EXPECT_EQ(1, io->num_fallbacks());
+}
+
+TEST_F(AsyncFileIoTest, IoUringReadFiles) {
+  scoped_ptr<IoUringFileIo> io(IoUringFileIo::Create(
+      8, 2, threaded_io_.get(), thread_system_.get(), &message_handler_));
+  if (io.get() == NULL) {
+    LOG(WARNING) << "io_uring not available; skipping test";
+    return;
+  }
+  TestReadFiles(io.get());
+}
+
+TEST_F(AsyncFileIoTest, IoUringShutDown) {
+  scoped_ptr<IoUringFileIo> io(IoUringFileIo::Create(
+      8, 2, threaded_io_.get(), thread_system_.get(), &message_handler_));
+  if (io.get() == NULL) {
+    LOG(WARNING) << "io_uring not available; skipping test";
+    return;
+  }
+  TestShutDown(io.get());
+}
+
+}  // namespace net_instaweb
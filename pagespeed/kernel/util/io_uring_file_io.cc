@@ -0,0 +1,849 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/util/io_uring_file_io.h"
+
+// We talk to the kernel directly rather than through liburing, so all we
+// need are the kernel's own headers, recent enough to know about renameat.
+#if defined(__linux) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+#define PAGESPEED_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef PAGESPEED_HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/atomicops.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
+#include "pagespeed/kernel/base/thread.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+namespace net_instaweb {
+
+namespace {
+
+// Reads start with this much buffer, doubling until we hit EOF.
+const int kInitialReadSize = 16 * 1024;
+const int kMaxReadSize = 1024 * 1024;
+
+// user_data value for the read of the wakeup eventfd.  Requests use their
+// address, which can't be 0.
+const uint64 kWakeupUserData = 0;
+
+inline uint32 LoadAcquire(const unsigned* p) {
+  return base::subtle::Acquire_Load(
+      reinterpret_cast<volatile const base::subtle::Atomic32*>(p));
+}
+
+inline void StoreRelease(unsigned* p, uint32 value) {
+  base::subtle::Release_Store(
+      reinterpret_cast<volatile base::subtle::Atomic32*>(p), value);
+}
+
+}  // namespace
+
+// The kernel's submission and completion queues, mapped into our address
+// space, plus an eventfd used to wake the ring thread when new requests are
+// queued.  Only the ring thread touches the queues.
+class IoUringFileIo::Ring {
+ public:
+  Ring()
+      : fd_(-1),
+        wakeup_fd_(-1),
+        sq_ptr_(MAP_FAILED),
+        cq_ptr_(MAP_FAILED),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sq_size_(0),
+        cq_size_(0),
+        num_sq_entries_(0),
+        sq_tail_(0),
+        num_to_submit_(0),
+        have_renameat_(false),
+        wakeup_count_(0) {
+  }
+
+  ~Ring() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, num_sq_entries_ * sizeof(io_uring_sqe));
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+      munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+      munmap(sq_ptr_, sq_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    if (wakeup_fd_ >= 0) {
+      close(wakeup_fd_);
+    }
+  }
+
+  bool Init(int queue_depth, MessageHandler* handler) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (fd_ < 0) {
+      handler->Message(kInfo, "io_uring unavailable: %s", strerror(errno));
+      return false;
+    }
+    if (!ProbeOps(handler)) {
+      return false;
+    }
+
+    num_sq_entries_ = params.sq_entries;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = mmap(NULL, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+      handler->Message(kWarning, "io_uring mmap failed: %s", strerror(errno));
+      return false;
+    }
+    if (single_mmap) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      cq_ptr_ = mmap(NULL, cq_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq_ptr_ == MAP_FAILED) {
+        handler->Message(kWarning, "io_uring mmap failed: %s",
+                         strerror(errno));
+        return false;
+      }
+    }
+    sqes_ = static_cast<io_uring_sqe*>(
+        mmap(NULL, num_sq_entries_ * sizeof(io_uring_sqe),
+             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+             IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      handler->Message(kWarning, "io_uring mmap failed: %s", strerror(errno));
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ptr_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_tail_ = *sq_tail_ptr_;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+      handler->Message(kWarning, "eventfd failed: %s", strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  // Number of requests that can be outstanding at once, leaving room for
+  // the wakeup read.  The completion queue is at least as large as the
+  // submission queue, so it can't overflow either.
+  int max_in_flight() const { return num_sq_entries_ - 1; }
+
+  bool have_renameat() const { return have_renameat_; }
+
+  // Returns a zeroed submission queue entry, to be sent with the next
+  // SubmitAndWait().
+  io_uring_sqe* NewSqe(uint64 user_data) {
+    CHECK_LT(sq_tail_ - LoadAcquire(sq_head_), num_sq_entries_);
+    unsigned index = sq_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    ++sq_tail_;
+    ++num_to_submit_;
+    return sqe;
+  }
+
+  // Queues a read of the wakeup eventfd, which completes the next time
+  // Wake() is called.
+  void ArmWakeup() {
+    io_uring_sqe* sqe = NewSqe(kWakeupUserData);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup_fd_;
+    sqe->addr = reinterpret_cast<uint64>(&wakeup_count_);
+    sqe->len = sizeof(wakeup_count_);
+  }
+
+  // Called from any thread.
+  void Wake() {
+    uint64 one = 1;
+    ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+    DCHECK_EQ(static_cast<ssize_t>(sizeof(one)), written);
+  }
+
+  // Submits everything queued by NewSqe() and waits for at least one
+  // completion.  Returns false, with errno set, if the ring has failed.
+  bool SubmitAndWait() {
+    StoreRelease(sq_tail_ptr_, sq_tail_);
+    return Enter(num_to_submit_);
+  }
+
+  // Waits for at least one completion without submitting anything.
+  bool Wait() {
+    return Enter(0);
+  }
+
+  // Takes back the entries queued by NewSqe() that the kernel has not yet
+  // consumed, appending their user_data to *user_data.
+  void TakeUnsubmitted(std::vector<uint64>* user_data) {
+    unsigned head = LoadAcquire(sq_head_);
+    for (unsigned i = head; i != sq_tail_; ++i) {
+      user_data->push_back(sqes_[i & sq_mask_].user_data);
+    }
+    sq_tail_ = head;
+    StoreRelease(sq_tail_ptr_, sq_tail_);
+    num_to_submit_ = 0;
+  }
+
+  // Pops the next completion, if any.
+  bool NextCompletion(uint64* user_data, int* result) {
+    unsigned head = *cq_head_;
+    if (head == LoadAcquire(cq_tail_)) {
+      return false;
+    }
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    *user_data = cqe.user_data;
+    *result = cqe.res;
+    StoreRelease(cq_head_, head + 1);
+    return true;
+  }
+
+ private:
+  bool Enter(unsigned to_submit) {
+    while (true) {
+      int submitted = syscall(__NR_io_uring_enter, fd_, to_submit, 1,
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+      if (submitted >= 0) {
+        num_to_submit_ -= submitted;
+        return true;
+      }
+      // EINTR just means a signal arrived; EBUSY and EAGAIN mean the kernel
+      // wants us to reap completions first, which the caller will do next.
+      // Anything else, such as ENOMEM, means the ring is no longer usable.
+      if (errno == EBUSY || errno == EAGAIN) {
+        return true;
+      } else if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Checks that the kernel supports the operations we need.
+  bool ProbeOps(MessageHandler* handler) {
+    const int kNumOps = 256;
+    scoped_array<char> storage(
+        new char[sizeof(io_uring_probe) + kNumOps * sizeof(io_uring_probe_op)]);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.get());
+    memset(probe, 0, sizeof(*probe) + kNumOps * sizeof(io_uring_probe_op));
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+                kNumOps) < 0) {
+      handler->Message(kInfo, "io_uring too old to probe: %s",
+                       strerror(errno));
+      return false;
+    }
+    const int kRequiredOps[] = {
+      IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE,
+    };
+    for (int i = 0; i < static_cast<int>(arraysize(kRequiredOps)); ++i) {
+      int op = kRequiredOps[i];
+      if (op > probe->last_op ||
+          (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+        handler->Message(kInfo, "io_uring lacks required op %d", op);
+        return false;
+      }
+    }
+    // Without renameat (before 5.11), we rename synchronously.
+    have_renameat_ = (IORING_OP_RENAMEAT <= probe->last_op &&
+                      (probe->ops[IORING_OP_RENAMEAT].flags &
+                       IO_URING_OP_SUPPORTED) != 0);
+    return true;
+  }
+
+  int fd_;
+  int wakeup_fd_;
+  void* sq_ptr_;
+  void* cq_ptr_;
+  io_uring_sqe* sqes_;
+  size_t sq_size_;
+  size_t cq_size_;
+  unsigned num_sq_entries_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_ptr_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned sq_tail_;  // Local copy, published by SubmitAndWait.
+  unsigned num_to_submit_;
+
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  bool have_renameat_;
+  uint64 wakeup_count_;  // Target of the wakeup read.
+
+  DISALLOW_COPY_AND_ASSIGN(Ring);
+};
+
+class IoUringFileIo::RingThread : public ThreadSystem::Thread {
+ public:
+  RingThread(IoUringFileIo* io, ThreadSystem* thread_system)
+      : Thread(thread_system, "io_uring", ThreadSystem::kJoinable),
+        io_(io) {}
+
+  virtual void Run() { io_->Loop(); }
+
+ private:
+  IoUringFileIo* io_;
+
+  DISALLOW_COPY_AND_ASSIGN(RingThread);
+};
+
+struct IoUringFileIo::Request {
+  enum Type {
+    kRead,
+    kWrite,
+  };
+
+  enum Stage {
+    kOpen,
+    kTransfer,
+    kRename,
+  };
+
+  Request(Type type, const GoogleString& filename)
+      : type(type), stage(kOpen), filename(filename), fd(-1), offset(0),
+        success(false), read_callback(NULL), write_callback(NULL) {}
+
+  void RunCallback() {
+    if (type == kRead) {
+      read_callback->Done(success, &contents);
+    } else {
+      write_callback->Done(success);
+    }
+  }
+
+  Type type;
+  Stage stage;
+  GoogleString filename;
+  GoogleString temp_filename;  // Writes only.
+  GoogleString contents;       // Reads only.
+  SharedString value;          // Writes only.
+  int fd;
+  int64 offset;
+  bool success;
+  ReadCallback* read_callback;
+  WriteCallback* write_callback;
+};
+
+// Runs the callbacks of requests that finished together, then deletes the
+// requests.  If the pool is shut down first, the callbacks are run anyway,
+// as the requests are already done.
+class IoUringFileIo::CallbackBatch : public Function {
+ public:
+  explicit CallbackBatch(std::vector<Request*>* requests) {
+    requests_.swap(*requests);
+  }
+
+ protected:
+  virtual void Run() { RunCallbacks(); }
+  virtual void Cancel() { RunCallbacks(); }
+
+ private:
+  void RunCallbacks() {
+    for (int i = 0, n = requests_.size(); i < n; ++i) {
+      requests_[i]->RunCallback();
+      delete requests_[i];
+    }
+  }
+
+  std::vector<Request*> requests_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallbackBatch);
+};
+
+IoUringFileIo* IoUringFileIo::Create(int queue_depth, int num_callback_threads,
+                                     AsyncFileIo* fallback,
+                                     ThreadSystem* thread_system,
+                                     MessageHandler* handler) {
+  scoped_ptr<Ring> ring(new Ring);
+  if (!ring->Init(queue_depth, handler)) {
+    return NULL;
+  }
+  IoUringFileIo* io = new IoUringFileIo(ring.release(), num_callback_threads,
+                                        fallback, thread_system, handler);
+  if (!io->thread_->Start()) {
+    handler->Message(kWarning, "Could not start io_uring thread");
+    {
+      ScopedMutex lock(io->mutex_.get());
+      io->shut_down_ = true;  // So the destructor won't try to join it.
+    }
+    delete io;
+    return NULL;
+  }
+  return io;
+}
+
+IoUringFileIo::IoUringFileIo(Ring* ring, int num_callback_threads,
+                             AsyncFileIo* fallback,
+                             ThreadSystem* thread_system,
+                             MessageHandler* handler)
+    : ring_(ring),
+      fallback_(fallback),
+      message_handler_(handler),
+      thread_(new RingThread(this, thread_system)),
+      callback_pool_(new QueuedWorkerPool(num_callback_threads,
+                                          "io_uring_callbacks",
+                                          thread_system)),
+      mutex_(thread_system->NewMutex()),
+      shut_down_(false),
+      failed_(false),
+      num_fallbacks_(0),
+      next_callback_sequence_(0),
+      ring_failed_(false),
+      next_temp_id_(0) {
+  DCHECK(fallback != NULL);
+  DCHECK_LT(0, num_callback_threads);
+  for (int i = 0; i < num_callback_threads; ++i) {
+    callback_sequences_.push_back(callback_pool_->NewSequence());
+  }
+}
+
+IoUringFileIo::~IoUringFileIo() {
+  ShutDown();
+}
+
+void IoUringFileIo::ShutDown() {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (shut_down_) {
+      return;
+    }
+    shut_down_ = true;
+  }
+  ring_->Wake();
+  thread_->Join();
+
+  // Runs the callbacks of any requests that have finished, but have not
+  // been delivered yet.
+  callback_pool_->ShutDown();
+}
+
+int64 IoUringFileIo::num_fallbacks() const {
+  ScopedMutex lock(mutex_.get());
+  return num_fallbacks_;
+}
+
+bool IoUringFileIo::failed() const {
+  ScopedMutex lock(mutex_.get());
+  return failed_;
+}
+
+void IoUringFileIo::ReadFile(const GoogleString& filename,
+                             ReadCallback* callback) {
+  Request* request = new Request(Request::kRead, filename);
+  request->read_callback = callback;
+  Enqueue(request);
+}
+
+void IoUringFileIo::WriteFileAtomic(const GoogleString& filename,
+                                    const SharedString& value,
+                                    WriteCallback* callback) {
+  Request* request = new Request(Request::kWrite, filename);
+  request->value = value;
+  request->write_callback = callback;
+  Enqueue(request);
+}
+
+void IoUringFileIo::ReadFiles(const FileReadVector& reads) {
+  std::vector<Request*> requests;
+  requests.reserve(reads.size());
+  for (int i = 0, n = reads.size(); i < n; ++i) {
+    Request* request = new Request(Request::kRead, reads[i].filename);
+    request->read_callback = reads[i].callback;
+    requests.push_back(request);
+  }
+  EnqueueBatch(requests);
+}
+
+void IoUringFileIo::Enqueue(Request* request) {
+  EnqueueBatch(std::vector<Request*>(1, request));
+}
+
+void IoUringFileIo::EnqueueBatch(const std::vector<Request*>& requests) {
+  bool accepted = false;
+  bool failed = false;
+  bool wake = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (shut_down_) {
+      // Rejected below.
+    } else if (failed_) {
+      failed = true;
+      num_fallbacks_ += requests.size();
+    } else {
+      // If requests are already pending, the ring thread has been woken
+      // and will pick these up along with them.
+      accepted = true;
+      wake = pending_.empty();
+      pending_.insert(pending_.end(), requests.begin(), requests.end());
+    }
+  }
+  if (accepted) {
+    if (wake) {
+      ring_->Wake();
+    }
+    return;
+  }
+  for (int i = 0, n = requests.size(); i < n; ++i) {
+    Request* request = requests[i];
+    if (!failed) {
+      // Rejected after shutdown, so never counted as in flight.
+      request->RunCallback();
+    } else if (request->type == Request::kRead) {
+      fallback_->ReadFile(request->filename, request->read_callback);
+    } else {
+      fallback_->WriteFileAtomic(request->filename, request->value,
+                                 request->write_callback);
+    }
+    delete request;
+  }
+}
+
+void IoUringFileIo::Loop() {
+  ring_->ArmWakeup();
+  while (true) {
+    {
+      ScopedMutex lock(mutex_.get());
+      backlog_.insert(backlog_.end(), pending_.begin(), pending_.end());
+      pending_.clear();
+    }
+    int max_in_flight = ring_failed_ ? 0 : ring_->max_in_flight();
+    while (!backlog_.empty() &&
+           (static_cast<int>(in_flight_.size()) < max_in_flight)) {
+      Request* request = backlog_.front();
+      backlog_.pop_front();
+      in_flight_.insert(request);
+      StartRequest(request);
+    }
+    while (ring_failed_ && !backlog_.empty()) {
+      Request* request = backlog_.front();
+      backlog_.pop_front();
+      in_flight_.insert(request);
+      FallBack(request);
+    }
+    DispatchCallbacks();
+    if (in_flight_.empty()) {
+      ScopedMutex lock(mutex_.get());
+      // Once the ring has failed, requests go straight to the fallback, so
+      // once the last of ours is done there's nothing left to wait for.
+      if ((shut_down_ || failed_) && pending_.empty()) {
+        break;
+      }
+    }
+
+    // One system call submits the next step of every request that has
+    // advanced since the last time around, and waits for more completions.
+    if (!(ring_failed_ ? ring_->Wait() : ring_->SubmitAndWait())) {
+      RingFailed(errno);
+      if (in_flight_.empty()) {
+        continue;
+      }
+      if (!ring_->Wait()) {
+        AbandonInFlight();
+        continue;
+      }
+    }
+
+    uint64 user_data;
+    int result;
+    while (ring_->NextCompletion(&user_data, &result)) {
+      if (user_data == kWakeupUserData) {
+        if (!ring_failed_) {
+          ring_->ArmWakeup();
+        }
+      } else {
+        HandleCompletion(reinterpret_cast<Request*>(user_data), result);
+      }
+    }
+  }
+}
+
+void IoUringFileIo::RingFailed(int error) {
+  if (!ring_failed_) {
+    message_handler_->Message(
+        kError, "io_uring failed (%s); falling back to the thread pool",
+        strerror(error));
+    ring_failed_ = true;
+    {
+      ScopedMutex lock(mutex_.get());
+      failed_ = true;
+    }
+
+    // Requests the kernel never saw can simply start over on the fallback.
+    std::vector<uint64> unsubmitted;
+    ring_->TakeUnsubmitted(&unsubmitted);
+    for (int i = 0, n = unsubmitted.size(); i < n; ++i) {
+      if (unsubmitted[i] != kWakeupUserData) {
+        FallBack(reinterpret_cast<Request*>(unsubmitted[i]));
+      }
+    }
+    DispatchCallbacks();
+  }
+}
+
+void IoUringFileIo::AbandonInFlight() {
+  message_handler_->Message(
+      kError, "io_uring can't be waited on (%s); failing %d requests",
+      strerror(errno), static_cast<int>(in_flight_.size()));
+
+  // The kernel may yet write into these requests' buffers, so we can't
+  // free them, or even close their files.  This should never happen.
+  for (std::set<Request*>::iterator p = in_flight_.begin(),
+           e = in_flight_.end(); p != e; ++p) {
+    Request* request = *p;
+    if (request->type == Request::kRead) {
+      GoogleString empty;
+      request->read_callback->Done(false, &empty);
+    } else {
+      request->write_callback->Done(false);
+    }
+  }
+  in_flight_.clear();
+}
+
+void IoUringFileIo::DispatchCallbacks() {
+  if (!finished_.empty()) {
+    QueuedWorkerPool::Sequence* sequence =
+        callback_sequences_[next_callback_sequence_];
+    next_callback_sequence_ =
+        (next_callback_sequence_ + 1) % callback_sequences_.size();
+    sequence->Add(new CallbackBatch(&finished_));
+  }
+}
+
+void IoUringFileIo::StartRequest(Request* request) {
+  io_uring_sqe* sqe = ring_->NewSqe(reinterpret_cast<uint64>(request));
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  if (request->type == Request::kRead) {
+    sqe->addr = reinterpret_cast<uint64>(request->filename.c_str());
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  } else {
+    // Like mkstemp, as used by StdioFileSystem::WriteFileAtomic, but with a
+    // name unique to this process so we don't need to retry.
+    request->temp_filename = StrCat(
+        request->filename, ".temp", IntegerToString(getpid()), "_",
+        Integer64ToString(next_temp_id_++));
+    sqe->addr = reinterpret_cast<uint64>(request->temp_filename.c_str());
+    sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    sqe->len = 0600;
+  }
+}
+
+void IoUringFileIo::PrepareTransfer(Request* request) {
+  io_uring_sqe* sqe = ring_->NewSqe(reinterpret_cast<uint64>(request));
+  sqe->fd = request->fd;
+  sqe->off = request->offset;
+  if (request->type == Request::kRead) {
+    GoogleString* contents = &request->contents;
+    if (contents->size() == static_cast<size_t>(request->offset)) {
+      int grow = std::min(std::max(static_cast<int>(contents->size()),
+                                   kInitialReadSize),
+                          kMaxReadSize);
+      contents->resize(contents->size() + grow);
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->addr = reinterpret_cast<uint64>(&(*contents)[request->offset]);
+    sqe->len = contents->size() - request->offset;
+  } else {
+    StringPiece value = request->value.Value();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->addr = reinterpret_cast<uint64>(value.data() + request->offset);
+    sqe->len = value.size() - request->offset;
+  }
+}
+
+void IoUringFileIo::PrepareRename(Request* request) {
+  // Closing a file we've just written doesn't wait for the disk, so we don't
+  // bother sending it through the ring.
+  close(request->fd);
+  request->fd = -1;
+  request->stage = Request::kRename;
+  if (!ring_->have_renameat()) {
+    int result = rename(request->temp_filename.c_str(),
+                        request->filename.c_str());
+    FinishRequest(request, result == 0);
+    return;
+  }
+  io_uring_sqe* sqe = ring_->NewSqe(reinterpret_cast<uint64>(request));
+  sqe->opcode = IORING_OP_RENAMEAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64>(request->temp_filename.c_str());
+  sqe->len = AT_FDCWD;
+  sqe->addr2 = reinterpret_cast<uint64>(request->filename.c_str());
+}
+
+void IoUringFileIo::HandleCompletion(Request* request, int result) {
+  if (ring_failed_ && (request->stage != Request::kRename)) {
+    // The next step can't go through the ring, so start over, cleaning up
+    // any file just opened.
+    if ((request->stage == Request::kOpen) && (result >= 0)) {
+      request->fd = result;
+      request->stage = Request::kTransfer;
+    }
+    FallBack(request);
+    return;
+  }
+  switch (request->stage) {
+    case Request::kOpen:
+      if (result < 0) {
+        // A missing file is just a cache miss, but a write may be missing
+        // its directory, which the fallback knows how to create.
+        if (request->type == Request::kWrite) {
+          FallBack(request);
+        } else {
+          FinishRequest(request, false);
+        }
+        return;
+      }
+      request->fd = result;
+      request->stage = Request::kTransfer;
+      if ((request->type == Request::kWrite) && request->value.empty()) {
+        PrepareRename(request);
+      } else {
+        PrepareTransfer(request);
+      }
+      return;
+
+    case Request::kTransfer:
+      if ((result == -EINTR) || (result == -EAGAIN)) {
+        PrepareTransfer(request);
+      } else if (result < 0) {
+        FinishRequest(request, false);
+      } else if (request->type == Request::kRead) {
+        if (result == 0) {
+          request->contents.resize(request->offset);
+          FinishRequest(request, true);
+        } else {
+          request->offset += result;
+          PrepareTransfer(request);
+        }
+      } else {
+        request->offset += result;
+        if (request->offset < request->value.size()) {
+          PrepareTransfer(request);
+        } else {
+          PrepareRename(request);
+        }
+      }
+      return;
+
+    case Request::kRename:
+      FinishRequest(request, result == 0);
+      return;
+  }
+}
+
+void IoUringFileIo::FinishRequest(Request* request, bool success) {
+  if (request->fd >= 0) {
+    close(request->fd);
+    request->fd = -1;
+  }
+  if (!success && !request->temp_filename.empty()) {
+    // Delete any temp file as it's probably incomplete.
+    unlink(request->temp_filename.c_str());
+  }
+  request->success = success;
+  in_flight_.erase(request);
+  finished_.push_back(request);
+}
+
+void IoUringFileIo::FallBack(Request* request) {
+  {
+    ScopedMutex lock(mutex_.get());
+    ++num_fallbacks_;
+  }
+  if (request->fd >= 0) {
+    close(request->fd);
+  }
+  if ((request->type == Request::kWrite) &&
+      (request->stage != Request::kOpen)) {
+    unlink(request->temp_filename.c_str());
+  }
+  in_flight_.erase(request);
+  if (request->type == Request::kRead) {
+    fallback_->ReadFile(request->filename, request->read_callback);
+  } else {
+    fallback_->WriteFileAtomic(request->filename, request->value,
+                               request->write_callback);
+  }
+  delete request;
+}
+
+}  // namespace net_instaweb
+
+#else  // PAGESPEED_HAVE_IO_URING
+
+namespace net_instaweb {
+
+IoUringFileIo* IoUringFileIo::Create(int queue_depth, int num_callback_threads,
+                                     AsyncFileIo* fallback,
+                                     ThreadSystem* thread_system,
+                                     MessageHandler* handler) {
+  return NULL;
+}
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_HAVE_IO_URING
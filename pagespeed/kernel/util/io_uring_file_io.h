@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_UTIL_IO_URING_FILE_IO_H_
+#define PAGESPEED_KERNEL_UTIL_IO_URING_FILE_IO_H_
+
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/async_file_io.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+namespace net_instaweb {
+
+class MessageHandler;
+class SharedString;
+
+// AsyncFileIo using Linux io_uring.  A single thread owns the ring: it
+// collects whatever requests have been queued since it last woke, submits
+// the next step of each (open, read, write, rename) to the kernel in one
+// system call, and advances requests as their completions arrive.  Any
+// number of requests can thus be in flight with no thread waiting on each.
+//
+// This works directly on the real filesystem, bypassing FileSystem.
+// Requests io_uring can't complete by itself -- writes that need new
+// directories, say -- are handed to a fallback AsyncFileIo.  If the ring
+// itself fails, everything from then on goes to the fallback.
+//
+// Callbacks, which may do real work such as decompressing the value read,
+// are not run on the ring thread.  Instead, each batch of requests that
+// completes together is handed to one of a small pool of threads.
+class IoUringFileIo : public AsyncFileIo {
+ public:
+  // Returns NULL if io_uring is not usable here: on other platforms, on
+  // kernels older than 5.6, or where a seccomp policy forbids it.  Does not
+  // take ownership of fallback, thread_system, or handler; fallback must
+  // outlive the returned object.
+  static IoUringFileIo* Create(int queue_depth, int num_callback_threads,
+                               AsyncFileIo* fallback,
+                               ThreadSystem* thread_system,
+                               MessageHandler* handler);
+  virtual ~IoUringFileIo();
+
+  virtual void ReadFile(const GoogleString& filename, ReadCallback* callback);
+  virtual void ReadFiles(const FileReadVector& reads);
+  virtual void WriteFileAtomic(const GoogleString& filename,
+                               const SharedString& value,
+                               WriteCallback* callback);
+  virtual void ShutDown();
+  virtual GoogleString Name() const { return "io_uring"; }
+
+  // Number of requests passed on to the fallback.
+  int64 num_fallbacks() const;
+
+  // Whether the ring has failed, so that all requests go to the fallback.
+  bool failed() const;
+
+ private:
+  class CallbackBatch;
+  class Ring;
+  class RingThread;
+  struct Request;
+
+  IoUringFileIo(Ring* ring, int num_callback_threads, AsyncFileIo* fallback,
+                ThreadSystem* thread_system, MessageHandler* handler);
+
+  void Enqueue(Request* request) LOCKS_EXCLUDED(mutex_);
+  void EnqueueBatch(const std::vector<Request*>& requests)
+      LOCKS_EXCLUDED(mutex_);
+  void Loop();
+
+  // These run on the ring thread.
+  void StartRequest(Request* request);
+  void PrepareTransfer(Request* request);
+  void PrepareRename(Request* request);
+  void HandleCompletion(Request* request, int result);
+  void FinishRequest(Request* request, bool success);
+  void FallBack(Request* request);
+  void DispatchCallbacks();
+
+  // Called when the ring can't be submitted to or waited on; error is the
+  // errno.  The first time, stops using the ring for new work; requests
+  // already submitted are still reaped if possible.  If even that fails,
+  // gives up on them.
+  void RingFailed(int error) LOCKS_EXCLUDED(mutex_);
+  void AbandonInFlight();
+
+  scoped_ptr<Ring> ring_;
+  AsyncFileIo* fallback_;
+  MessageHandler* message_handler_;
+  scoped_ptr<RingThread> thread_;
+  scoped_ptr<QueuedWorkerPool> callback_pool_;
+  std::vector<QueuedWorkerPool::Sequence*> callback_sequences_;
+
+  scoped_ptr<AbstractMutex> mutex_;
+  std::deque<Request*> pending_ GUARDED_BY(mutex_);
+  bool shut_down_ GUARDED_BY(mutex_);
+  bool failed_ GUARDED_BY(mutex_);
+  int64 num_fallbacks_ GUARDED_BY(mutex_);
+
+  // Owned by the ring thread.
+  std::deque<Request*> backlog_;
+  std::set<Request*> in_flight_;
+  std::vector<Request*> finished_;
+  int next_callback_sequence_;
+  bool ring_failed_;
+  int64 next_temp_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringFileIo);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_IO_URING_FILE_IO_H_
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pagespeed/kernel/util/threaded_file_io.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/file_system.h"
+#include "pagespeed/kernel/base/function.h"
+#include "pagespeed/kernel/base/null_message_handler.h"
+#include "pagespeed/kernel/base/shared_string.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+namespace net_instaweb {
+
+class ThreadedFileIo::Request {
+ public:
+  Request() {}
+  virtual ~Request() {}
+
+  // Exactly one of these is called, after which the request is deleted.
+  virtual void Run(FileSystem* file_system, MessageHandler* handler) = 0;
+  virtual void Cancel() = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Request);
+};
+
+class ThreadedFileIo::ReadRequest : public ThreadedFileIo::Request {
+ public:
+  ReadRequest(const GoogleString& filename, ReadCallback* callback)
+      : filename_(filename), callback_(callback) {}
+
+  virtual void Run(FileSystem* file_system, MessageHandler* handler) {
+    // As in FileCache, read errors are mostly just cache misses, so don't
+    // report them.
+    NullMessageHandler null_handler;
+    GoogleString contents;
+    bool ok = file_system->ReadFile(filename_.c_str(), &contents,
+                                    &null_handler);
+    callback_->Done(ok, &contents);
+  }
+
+  virtual void Cancel() {
+    GoogleString empty;
+    callback_->Done(false, &empty);
+  }
+
+ private:
+  GoogleString filename_;
+  ReadCallback* callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadRequest);
+};
+
+class ThreadedFileIo::WriteRequest : public ThreadedFileIo::Request {
+ public:
+  WriteRequest(const GoogleString& filename, const SharedString& value,
+               WriteCallback* callback)
+      : filename_(filename), value_(value), callback_(callback) {}
+
+  virtual void Run(FileSystem* file_system, MessageHandler* handler) {
+    callback_->Done(file_system->WriteFileAtomic(filename_, value_.Value(),
+                                                 handler));
+  }
+
+  virtual void Cancel() {
+    callback_->Done(false);
+  }
+
+ private:
+  GoogleString filename_;
+  SharedString value_;
+  WriteCallback* callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteRequest);
+};
+
+ThreadedFileIo::ThreadedFileIo(int num_threads, FileSystem* file_system,
+                               ThreadSystem* thread_system,
+                               MessageHandler* handler)
+    : file_system_(file_system),
+      message_handler_(handler),
+      pool_(new QueuedWorkerPool(num_threads, "file_io", thread_system)),
+      mutex_(thread_system->NewMutex()),
+      num_draining_(0),
+      next_sequence_(0),
+      shut_down_(false) {
+  DCHECK_LT(0, num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    sequences_.push_back(pool_->NewSequence());
+  }
+}
+
+ThreadedFileIo::~ThreadedFileIo() {
+  ShutDown();
+}
+
+void ThreadedFileIo::ReadFile(const GoogleString& filename,
+                              ReadCallback* callback) {
+  Enqueue(new ReadRequest(filename, callback));
+}
+
+void ThreadedFileIo::WriteFileAtomic(const GoogleString& filename,
+                                     const SharedString& value,
+                                     WriteCallback* callback) {
+  Enqueue(new WriteRequest(filename, value, callback));
+}
+
+void ThreadedFileIo::ReadFiles(const FileReadVector& reads) {
+  std::vector<Request*> requests;
+  requests.reserve(reads.size());
+  for (int i = 0, n = reads.size(); i < n; ++i) {
+    requests.push_back(new ReadRequest(reads[i].filename, reads[i].callback));
+  }
+  EnqueueBatch(requests);
+}
+
+void ThreadedFileIo::Enqueue(Request* request) {
+  EnqueueBatch(std::vector<Request*>(1, request));
+}
+
+void ThreadedFileIo::EnqueueBatch(const std::vector<Request*>& requests) {
+  std::vector<QueuedWorkerPool::Sequence*> to_wake;
+  bool accepted = false;
+  {
+    ScopedMutex lock(mutex_.get());
+    if (!shut_down_) {
+      accepted = true;
+      queue_.insert(queue_.end(), requests.begin(), requests.end());
+      // Wake another thread for each new request, as long as all the ones
+      // already draining might be busy with one.
+      int num_threads = sequences_.size();
+      for (int i = 0, n = requests.size();
+           (i < n) && (num_draining_ < num_threads); ++i) {
+        ++num_draining_;
+        to_wake.push_back(sequences_[next_sequence_]);
+        next_sequence_ = (next_sequence_ + 1) % num_threads;
+      }
+    }
+  }
+  if (!accepted) {
+    for (int i = 0, n = requests.size(); i < n; ++i) {
+      requests[i]->Cancel();
+      delete requests[i];
+    }
+    return;
+  }
+  for (int i = 0, n = to_wake.size(); i < n; ++i) {
+    to_wake[i]->Add(MakeFunction(this, &ThreadedFileIo::Drain));
+  }
+}
+
+void ThreadedFileIo::Drain() {
+  while (true) {
+    Request* request;
+    {
+      ScopedMutex lock(mutex_.get());
+      if (queue_.empty()) {
+        --num_draining_;
+        return;
+      }
+      request = queue_.front();
+      queue_.pop_front();
+    }
+    request->Run(file_system_, message_handler_);
+    delete request;
+  }
+}
+
+void ThreadedFileIo::ShutDown() {
+  {
+    ScopedMutex lock(mutex_.get());
+    if (shut_down_) {
+      return;
+    }
+    shut_down_ = true;
+  }
+
+  // Waits for any running Drain() calls, which finish everything queued, and
+  // cancels those that have not started yet.
+  pool_->ShutDown();
+
+  std::deque<Request*> leftovers;
+  {
+    ScopedMutex lock(mutex_.get());
+    leftovers.swap(queue_);
+  }
+  for (int i = 0, n = leftovers.size(); i < n; ++i) {
+    leftovers[i]->Cancel();
+    delete leftovers[i];
+  }
+}
+
+}  // namespace net_instaweb
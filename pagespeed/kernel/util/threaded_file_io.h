@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PAGESPEED_KERNEL_UTIL_THREADED_FILE_IO_H_
+#define PAGESPEED_KERNEL_UTIL_THREADED_FILE_IO_H_
+
+#include <deque>
+#include <vector>
+
+#include "pagespeed/kernel/base/abstract_mutex.h"
+#include "pagespeed/kernel/base/async_file_io.h"
+#include "pagespeed/kernel/base/basictypes.h"
+#include "pagespeed/kernel/base/scoped_ptr.h"
+#include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/thread_annotations.h"
+#include "pagespeed/kernel/thread/queued_worker_pool.h"
+
+namespace net_instaweb {
+
+class FileSystem;
+class MessageHandler;
+class SharedString;
+class ThreadSystem;
+
+// AsyncFileIo running blocking FileSystem calls on a small pool of threads.
+// Requests go onto a single queue, and each thread drains as many requests
+// as it finds there before going back to sleep, so a burst of requests
+// costs one wakeup per thread rather than one per request.
+//
+// This works with any FileSystem, and is the fallback where io_uring is not
+// available.
+class ThreadedFileIo : public AsyncFileIo {
+ public:
+  // Does not take ownership of file_system, thread_system or handler.
+  ThreadedFileIo(int num_threads, FileSystem* file_system,
+                 ThreadSystem* thread_system, MessageHandler* handler);
+  virtual ~ThreadedFileIo();
+
+  virtual void ReadFile(const GoogleString& filename, ReadCallback* callback);
+  virtual void ReadFiles(const FileReadVector& reads);
+  virtual void WriteFileAtomic(const GoogleString& filename,
+                               const SharedString& value,
+                               WriteCallback* callback);
+  virtual void ShutDown();
+  virtual GoogleString Name() const { return "threads"; }
+
+ private:
+  class Request;
+  class ReadRequest;
+  class WriteRequest;
+
+  void Enqueue(Request* request) LOCKS_EXCLUDED(mutex_);
+  void EnqueueBatch(const std::vector<Request*>& requests)
+      LOCKS_EXCLUDED(mutex_);
+  void Drain() LOCKS_EXCLUDED(mutex_);
+
+  FileSystem* file_system_;
+  MessageHandler* message_handler_;
+  scoped_ptr<QueuedWorkerPool> pool_;
+  std::vector<QueuedWorkerPool::Sequence*> sequences_;
+
+  scoped_ptr<AbstractMutex> mutex_;
+  std::deque<Request*> queue_ GUARDED_BY(mutex_);
+  int num_draining_ GUARDED_BY(mutex_);
+  int next_sequence_ GUARDED_BY(mutex_);
+  bool shut_down_ GUARDED_BY(mutex_);
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadedFileIo);
+};
+
+}  // namespace net_instaweb
+
+#endif  // PAGESPEED_KERNEL_UTIL_THREADED_FILE_IO_H_
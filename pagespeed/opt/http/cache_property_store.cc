@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "pagespeed/kernel/base/abstract_mutex.h"
@@ -92,9 +93,6 @@ class CachePropertyStoreGetCallback : public PropertyStoreGetCallback {
 
 // Tracks multiple cache lookups.  When they are all complete, page->Done() is
 // called.
-//
-// TODO(pulkitg): Use CacheInterface::MultiGet() instead of using
-// CacheInterface::Get() for each cohort.
 class CachePropertyStoreCallbackCollector {
  public:
   CachePropertyStoreCallbackCollector(
@@ -228,17 +226,47 @@ void CachePropertyStore::Get(
           property_store_get_callback,
           cohort_list.size(),
           thread_system_->NewMutex());
+
+  // Cohorts are normally all backed by the same cache, so rather than doing
+  // a Get per cohort, batch the lookups into one MultiGet per backend.  Each
+  // lookup is still counted against its cohort's statistics.  There are
+  // only ever a few distinct backends, so a vector is fine for finding them.
+  typedef std::vector<std::pair<CacheInterface*,
+                                CacheInterface::MultiGetRequest*> >
+      BackendRequestVector;
+  BackendRequestVector requests;
   for (int j = 0, n = cohort_list.size(); j < n; ++j) {
     const PropertyCache::Cohort* cohort = cohort_list[j];
     CohortCacheMap::iterator cohort_itr =
         cohort_cache_map_.find(cohort->name());
     CHECK(cohort_itr != cohort_cache_map_.end());
+    CacheStats* cohort_cache = cohort_itr->second;
+    CacheInterface* backend = cohort_cache->Backend();
+    CacheInterface::MultiGetRequest* request = NULL;
+    for (int i = 0, num_requests = requests.size(); i < num_requests; ++i) {
+      if (requests[i].first == backend) {
+        request = requests[i].second;
+        break;
+      }
+    }
+    if (request == NULL) {
+      request = new CacheInterface::MultiGetRequest;
+      requests.push_back(std::make_pair(backend, request));
+    }
     const GoogleString cache_key = CacheKey(
         url, options_signature_hash, cache_key_suffix, cohort);
-    cohort_itr->second->Get(
+    cohort_cache->AddToBackendMultiGet(
         cache_key,
         new CachePropertyStoreCacheCallback(
-            cohort, property_store_get_callback, collector));
+            cohort, property_store_get_callback, collector),
+        request);
+  }
+  for (int i = 0, n = requests.size(); i < n; ++i) {
+    if (requests[i].second->empty()) {
+      delete requests[i].second;
+    } else {
+      requests[i].first->MultiGet(requests[i].second);
+    }
   }
 }
 
@@ -269,11 +297,11 @@ void CachePropertyStore::AddCohortWithCache(
     const GoogleString& cohort, CacheInterface* cache) {
   std::pair<CohortCacheMap::iterator, bool> insertions =
       cohort_cache_map_.insert(
-        make_pair(cohort, static_cast<CacheInterface*>(NULL)));
+        make_pair(cohort, static_cast<CacheStats*>(NULL)));
   CHECK(insertions.second) << cohort << " is added twice.";
   // Create a new CacheStats for every cohort so that we can track cache
   // statistics independently for every cohort.
-  CacheInterface* cache_stats = new CacheStats(
+  CacheStats* cache_stats = new CacheStats(
         PropertyCache::GetStatsPrefix(cohort), cache, timer_, stats_);
   insertions.first->second = cache_stats;
 }
@@ -18,9 +18,10 @@
 //
 // Reads the properties stored in the CacheInterface and popluates them in
 // PropertyPage.
-// There is a CacheInterface object for every cohort which is stored in
+// There is a CacheStats object for every cohort which is stored in
 // CohortCacheMap and read/write for a cohort happens on its respective
-// CacheInterface object.
+// CacheStats object.  Lookups of all the cohorts of a page that share a
+// cache are batched into a single MultiGet.
 
 #ifndef PAGESPEED_OPT_HTTP_CACHE_PROPERTY_STORE_H_
 #define PAGESPEED_OPT_HTTP_CACHE_PROPERTY_STORE_H_
@@ -37,6 +38,7 @@
 
 namespace net_instaweb {
 
+class CacheStats;
 class PropertyCacheValues;
 class Statistics;
 class ThreadSystem;
@@ -104,7 +106,7 @@ class CachePropertyStore : public PropertyStore {
 
  private:
   GoogleString cache_key_prefix_;
-  typedef std::map<GoogleString, CacheInterface*> CohortCacheMap;
+  typedef std::map<GoogleString, CacheStats*> CohortCacheMap;
   CohortCacheMap cohort_cache_map_;
   CacheInterface* default_cache_;
   Timer* timer_;
@@ -17,6 +17,7 @@
 
 #include "pagespeed/system/admin_site.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <memory>
 #include <set>
@@ -24,8 +25,10 @@
 
 #include "net/instaweb/http/public/async_fetch.h"
 #include "net/instaweb/http/public/http_cache.h"
+#include "net/instaweb/http/public/rate_controller.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
 #include "net/instaweb/rewriter/public/rewrite_query.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "pagespeed/system/system_cache_path.h"
 #include "pagespeed/system/system_caches.h"
@@ -89,7 +92,11 @@ const Tab kTabs[] = {
   {"Configuration", "Configuration", "config", "?config", kShortBreak},
   {"(SPDY)", "SPDY Configuration", "spdy_config", "?spdy_config", kLongBreak},
   {"Histograms", "Histograms", "histograms", "?histograms", kLongBreak},
+  {"Filter Costs", "Filter Costs", "filter_costs", "?filter_costs",
+   kLongBreak},
   {"Caches", "Caches", "cache", "?cache", kLongBreak},
+  {"Fetch Limits", "Fetch Limits", "fetch_limits", "?fetch_limits",
+   kLongBreak},
   {"Console", "Console", "console", NULL, kLongBreak},
   {"Message History", "Message History", "message_history", NULL, kLongBreak},
   {"Graphs", "Graphs", "graphs", NULL, kLongBreak},
@@ -373,6 +380,143 @@ void AdminSite::PrintHistograms(AdminSource source, AsyncFetch* fetch,
 
 namespace {
 
+// The columns of the filter-costs table, by their names in the sort= query
+// parameter.  The first two are text, and the rest are costs in
+// microseconds, apart from the count.
+const char* kFilterCostColumns[] = {
+  "filter", "phase", "count", "mean", "p50", "p99", "max", "total"
+};
+const int kNumFilterCostTextColumns = 2;
+const int kNumFilterCostValues =
+    arraysize(kFilterCostColumns) - kNumFilterCostTextColumns;
+const int kTotalFilterCostColumn = arraysize(kFilterCostColumns) - 1;
+
+// A row of the filter-costs table, from the histogram of the cost of one
+// filter in one phase.
+struct FilterCost {
+  GoogleString filter;
+  GoogleString phase;
+  double values[kNumFilterCostValues];
+};
+
+// Orders the rows by a column: text ascending, and numbers descending so
+// the most expensive filters come first.
+class FilterCostOrder {
+ public:
+  explicit FilterCostOrder(int column) : column_(column) {}
+
+  bool operator()(const FilterCost& a, const FilterCost& b) const {
+    switch (column_) {
+      case 0:
+        return a.filter < b.filter;
+      case 1:
+        return a.phase < b.phase;
+      default: {
+        int index = column_ - kNumFilterCostTextColumns;
+        return a.values[index] > b.values[index];
+      }
+    }
+  }
+
+ private:
+  int column_;
+};
+
+}  // namespace
+
+void AdminSite::PrintFilterCosts(AdminSource source,
+                                 const QueryParams& query_params,
+                                 AsyncFetch* fetch, Statistics* stats) {
+  AdminHtml admin_html("filter_costs", "", source, fetch, message_handler_);
+
+  // Collect the filters that have run from the histograms of their costs,
+  // whose names end with the filter and the phase, separated by a space.
+  std::vector<FilterCost> costs;
+  StringPiece prefix(RewriteStats::kFilterCostHistogramPrefix);
+  const StringVector& names = stats->HistogramNames();
+  for (int i = 0, n = names.size(); i < n; ++i) {
+    StringPiece name(names[i]);
+    if (!name.starts_with(prefix)) {
+      continue;
+    }
+    Histogram* histogram = stats->GetHistogram(name);
+    double count = histogram->Count();
+    if (count == 0) {
+      continue;
+    }
+    name.remove_prefix(prefix.size());
+    size_t space = name.rfind(' ');
+    if (space == StringPiece::npos) {
+      continue;
+    }
+    FilterCost cost;
+    name.substr(0, space).CopyToString(&cost.filter);
+    name.substr(space + 1).CopyToString(&cost.phase);
+    double mean = histogram->Average();
+    double values[kNumFilterCostValues] = {
+      count, mean, histogram->Percentile(50), histogram->Percentile(99),
+      histogram->Maximum(), count * mean
+    };
+    std::copy(values, values + kNumFilterCostValues, cost.values);
+    costs.push_back(cost);
+  }
+
+  int sort_column = kTotalFilterCostColumn;
+  GoogleString sort;
+  if (query_params.Lookup1Unescaped("sort", &sort)) {
+    for (int i = 0, n = arraysize(kFilterCostColumns); i < n; ++i) {
+      if (sort == kFilterCostColumns[i]) {
+        sort_column = i;
+      }
+    }
+  }
+  std::stable_sort(costs.begin(), costs.end(), FilterCostOrder(sort_column));
+
+  // Each column header links to the table sorted by that column.
+  StringPiece sort_link;
+  switch (source) {
+    case kPageSpeedAdmin:
+      sort_link = "?sort=";
+      break;
+    case kStatistics:
+      sort_link = "?filter_costs&sort=";
+      break;
+    case kOther:
+      break;
+  }
+  GoogleString html(
+      "<p>Time spent by each filter, in microseconds: per document for HTML "
+      "filtering, and per resource for the partition, rewrite and render "
+      "phases of rewriting.</p>\n"
+      "<table>\n  <thead><tr>");
+  for (int i = 0, n = arraysize(kFilterCostColumns); i < n; ++i) {
+    const char* column = kFilterCostColumns[i];
+    if (sort_link.empty()) {
+      StrAppend(&html, "<th>", column, "</th>");
+    } else {
+      StrAppend(&html, "<th><a href='", sort_link, column, "'>", column,
+                "</a></th>");
+    }
+  }
+  StrAppend(&html, "</tr></thead>\n  <tbody>\n");
+  GoogleString escaped_filter, escaped_phase;
+  for (int i = 0, n = costs.size(); i < n; ++i) {
+    const FilterCost& cost = costs[i];
+    StrAppend(&html, "    <tr><td>",
+              HtmlKeywords::Escape(cost.filter, &escaped_filter), "</td><td>",
+              HtmlKeywords::Escape(cost.phase, &escaped_phase), "</td>");
+    for (int j = 0; j < kNumFilterCostValues; ++j) {
+      StrAppend(&html, "<td align='right'>",
+                StringPrintf("%.0f", cost.values[j]), "</td>");
+    }
+    StrAppend(&html, "</tr>\n");
+  }
+  StrAppend(&html, "  </tbody>\n</table>\n");
+  fetch->Write(html, message_handler_);
+}
+
+namespace {
+
 static const char kTableStart[] =
     "<table class='pagespeed-caches-structure'>\n"
     "  <thead>\n"
@@ -642,6 +786,28 @@ void AdminSite::PrintSpdyConfig(AdminSource source, AsyncFetch* fetch,
   }
 }
 
+void AdminSite::PrintFetchLimits(AdminSource source, AsyncFetch* fetch,
+                                 RateController* rate_controller) {
+  AdminHtml admin_html("fetch_limits", "", source, fetch, message_handler_);
+  if (rate_controller == NULL) {
+    fetch->Write("Background fetches are not rate-limited.",
+                 message_handler_);
+    return;
+  }
+  // Unlike statistics, the limits and fetch counts are not aggregated
+  // across processes, so say whose they are.
+  fetch->Write("Limits and fetches of the server process that served this "
+               "page only; each process tracks its own.  Origin health is "
+               "shared by all processes.",
+               message_handler_);
+  GoogleString host_limits;
+  rate_controller->PrintHostLimits(&host_limits);
+  if (host_limits.empty()) {
+    host_limits = "No fetches in progress in this process.";
+  }
+  HtmlKeywords::WritePre(host_limits, "", fetch, message_handler_);
+}
+
 void AdminSite::MessageHistoryHandler(const RewriteOptions& options,
                                       AdminSource source, AsyncFetch* fetch) {
   // Request for page /mod_pagespeed_message.
@@ -705,7 +871,7 @@ void AdminSite::AdminPage(
     CacheInterface* metadata_cache, PropertyCache* page_property_cache,
     ServerContext* server_context, Statistics* statistics, Statistics* stats,
     SystemRewriteOptions* global_system_rewrite_options,
-    const SystemRewriteOptions* spdy_config) {
+    const SystemRewriteOptions* spdy_config, RateController* rate_controller) {
   // The handler is "pagespeed_admin", so we must dispatch off of
   // the remainder of the URL.  For
   // "http://example.com/pagespeed_admin/foo?a=b" we want to pull out
@@ -768,6 +934,10 @@ void AdminSite::AdminPage(
                   page_property_cache, server_context);
     } else if (leaf == "histograms") {
       PrintHistograms(kPageSpeedAdmin, fetch, stats);
+    } else if (leaf == "filter_costs") {
+      PrintFilterCosts(kPageSpeedAdmin, query_params, fetch, stats);
+    } else if (leaf == "fetch_limits") {
+      PrintFetchLimits(kPageSpeedAdmin, fetch, rate_controller);
     } else {
       fetch->response_headers()->SetStatusAndReason(HttpStatus::kNotFound);
       fetch->response_headers()->Add(HttpAttributes::kContentType, "text/html");
@@ -799,7 +969,7 @@ void AdminSite::StatisticsPage(
     PropertyCache* page_property_cache, ServerContext* server_context,
     Statistics* statistics, Statistics* stats,
     SystemRewriteOptions* global_system_rewrite_options,
-    const SystemRewriteOptions* spdy_config) {
+    const SystemRewriteOptions* spdy_config, RateController* rate_controller) {
   if (query_params.Has("json")) {
     ConsoleJsonHandler(query_params, fetch, statistics);
   } else if (query_params.Has("config")) {
@@ -808,6 +978,10 @@ void AdminSite::StatisticsPage(
     PrintSpdyConfig(kStatistics, fetch, spdy_config);
   } else if (query_params.Has("histograms")) {
     PrintHistograms(kStatistics, fetch, stats);
+  } else if (query_params.Has("filter_costs")) {
+    PrintFilterCosts(kStatistics, query_params, fetch, stats);
+  } else if (query_params.Has("fetch_limits")) {
+    PrintFetchLimits(kStatistics, fetch, rate_controller);
   } else if (query_params.Has("graphs")) {
     GraphsHandler(*options, kStatistics, query_params, fetch, statistics);
   } else if (query_params.Has("cache")) {
@@ -30,6 +30,7 @@ class HTTPCache;
 class MessageHandler;
 class PropertyCache;
 class QueryParams;
+class RateController;
 class RewriteOptions;
 class ServerContext;
 class StaticAssetManager;
@@ -86,7 +87,8 @@ class AdminSite {
                  ServerContext* server_context, Statistics* statistics,
                  Statistics* stats,
                  SystemRewriteOptions* global_system_rewrite_options,
-                 const SystemRewriteOptions* spdy_config);
+                 const SystemRewriteOptions* spdy_config,
+                 RateController* rate_controller);
 
   // Handle a request for the legacy /*_pagespeed_statistics page, which also
   // serves as a launching point for a subset of the admin pages.  Because the
@@ -102,7 +104,8 @@ class AdminSite {
                       ServerContext* server_context, Statistics* statistics,
                       Statistics* stats,
                       SystemRewriteOptions* global_system_rewrite_options,
-                      const SystemRewriteOptions* spdy_config);
+                      const SystemRewriteOptions* spdy_config,
+                      RateController* rate_controller);
 
   // Returns JSON used by the PageSpeed Console JavaScript.
   void ConsoleJsonHandler(const QueryParams& params, AsyncFetch* fetch,
@@ -157,6 +160,18 @@ class AdminSite {
   void PrintHistograms(AdminSource source, AsyncFetch* fetch,
                        Statistics* stats);
 
+  // Print a table of the cost of each filter, drawn from the histograms kept
+  // by RewriteStats, sorted by the column named in the "sort" query param.
+  void PrintFilterCosts(AdminSource source, const QueryParams& query_params,
+                        AsyncFetch* fetch, Statistics* stats);
+
+  // Print the limit on background fetches to each origin server, with its
+  // outgoing and queued fetches and latency.  These are kept per process, so
+  // only those of the process serving the page are shown.  rate_controller
+  // may be NULL if fetches are not rate-limited.
+  void PrintFetchLimits(AdminSource source, AsyncFetch* fetch,
+                        RateController* rate_controller);
+
   void PurgeHandler(StringPiece url, SystemCachePath* cache_path,
                     AsyncFetch* fetch);
 
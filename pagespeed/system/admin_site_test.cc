@@ -20,8 +20,11 @@
 #include "pagespeed/system/admin_site.h"
 
 #include "net/instaweb/http/public/async_fetch.h"
+#include "net/instaweb/http/public/rate_controller.h"
 #include "net/instaweb/rewriter/public/custom_rewrite_test_base.h"
 #include "net/instaweb/rewriter/public/rewrite_driver.h"
+#include "net/instaweb/rewriter/public/rewrite_options.h"
+#include "net/instaweb/rewriter/public/rewrite_stats.h"
 #include "net/instaweb/rewriter/public/rewrite_test_base.h"
 #include "net/instaweb/rewriter/public/server_context.h"
 #include "net/instaweb/rewriter/public/test_rewrite_driver_factory.h"
@@ -33,7 +36,9 @@
 #include "pagespeed/kernel/base/mock_message_handler.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/string.h"
+#include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/http/query_params.h"
 #include "pagespeed/kernel/util/platform.h"
 
 namespace net_instaweb {
@@ -83,6 +88,32 @@ class AdminSiteTest : public CustomRewriteTestBase<SystemRewriteOptions> {
     return server_context.release();
   }
 
+  // Prints the filter-costs table sorted by the given column, and returns
+  // the filter and phase of each row.
+  GoogleString FilterCostRows(StringPiece sort) {
+    QueryParams query_params;
+    if (!sort.empty()) {
+      query_params.AddEscaped("sort", sort);
+    }
+    GoogleString buffer;
+    StringAsyncFetch fetch(rewrite_driver()->request_context(), &buffer);
+    admin_site_->PrintFilterCosts(AdminSite::kPageSpeedAdmin, query_params,
+                                  &fetch, factory()->statistics());
+    GoogleString rows;
+    static const char kRowStart[] = "<tr><td>";
+    static const char kCellBreak[] = "</td><td>";
+    for (size_t pos = buffer.find(kRowStart); pos != GoogleString::npos;
+         pos = buffer.find(kRowStart, pos)) {
+      pos += STATIC_STRLEN(kRowStart);
+      size_t filter_end = buffer.find(kCellBreak, pos);
+      size_t phase = filter_end + STATIC_STRLEN(kCellBreak);
+      size_t phase_end = buffer.find("</td>", phase);
+      StrAppend(&rows, buffer.substr(pos, filter_end - pos), " ",
+                buffer.substr(phase, phase_end - phase), ",");
+    }
+    return rows;
+  }
+
   scoped_ptr<ThreadSystem> thread_system_;
   scoped_ptr<ServerContext> server_context_;
   scoped_ptr<SystemRewriteOptions> options_;
@@ -113,6 +144,53 @@ TEST_F(AdminSiteTest, ColorMessagesInHistoryPage) {
       buffer, ::testing::HasSubstr(StringPrintf(kColorTemplate, "brown")));
   EXPECT_THAT(buffer, ::testing::HasSubstr("style=\"margin:0;\""));
 }
+
+TEST_F(AdminSiteTest, FilterCostsTable) {
+  RewriteStats* rewrite_stats = factory()->rewrite_stats();
+  rewrite_stats->AddFilterCost("CssFilter", RewriteStats::kHtmlPhase, 100);
+  rewrite_stats->AddFilterCost("CssCombine", RewriteStats::kHtmlPhase, 20);
+  rewrite_stats->AddFilterCost("CssCombine", RewriteStats::kHtmlPhase, 20);
+  // Filters that did not declare a histogram of their own are charged to
+  // "Other".
+  rewrite_stats->AddFilterCost("NoSuchFilter", RewriteStats::kHtmlPhase, 5);
+  rewrite_stats->AddFilterCost(RewriteOptions::kImageCompressionId,
+                               RewriteStats::kRewritePhase, 5000);
+  RewriteStats::AddFilterCost(rewrite_stats->fused_filter_cost_histogram(),
+                              10);
+
+  EXPECT_EQ("ic rewrite,CssFilter html,CssCombine html,"
+            "Fused streaming filters html,Other html,",
+            FilterCostRows(""));
+  EXPECT_EQ("CssCombine html,CssFilter html,Fused streaming filters html,"
+            "Other html,ic rewrite,",
+            FilterCostRows("filter"));
+  // Ties keep the order in which the histograms were declared.
+  EXPECT_EQ("CssCombine html,CssFilter html,ic rewrite,Other html,"
+            "Fused streaming filters html,",
+            FilterCostRows("count"));
+  EXPECT_EQ("ic rewrite,CssFilter html,CssCombine html,"
+            "Fused streaming filters html,Other html,",
+            FilterCostRows("max"));
+}
+
+TEST_F(AdminSiteTest, FetchLimitsPage) {
+  GoogleString buffer;
+  StringAsyncFetch fetch(rewrite_driver()->request_context(), &buffer);
+  admin_site_->PrintFetchLimits(AdminSite::kPageSpeedAdmin, &fetch, NULL);
+  EXPECT_THAT(buffer,
+              ::testing::HasSubstr("Background fetches are not rate-limited"));
+
+  RateController rate_controller(10, 2, 4, thread_system_.get(),
+                                 factory()->statistics());
+  buffer.clear();
+  StringAsyncFetch fetch2(rewrite_driver()->request_context(), &buffer);
+  admin_site_->PrintFetchLimits(AdminSite::kPageSpeedAdmin, &fetch2,
+                                &rate_controller);
+  EXPECT_THAT(buffer, ::testing::HasSubstr("server process that served"));
+  EXPECT_THAT(buffer,
+              ::testing::HasSubstr("No fetches in progress in this process."));
+}
+
 // TODO(xqyin): Add unit tests for other methods in AdminSite.
 
 }  // namespace
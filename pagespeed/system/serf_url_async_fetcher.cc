@@ -22,8 +22,12 @@
 
 #include "pagespeed/system/serf_url_async_fetcher.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <deque>
 #include <list>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include "apr.h"
@@ -43,6 +47,8 @@
 #include "pagespeed/kernel/base/pool_element.h"
 #include "pagespeed/kernel/base/scoped_ptr.h"
 #include "pagespeed/kernel/base/statistics.h"
+#include "pagespeed/kernel/base/stl_util.h"
+#include "pagespeed/kernel/base/string_hash.h"
 #include "pagespeed/kernel/base/string_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
@@ -99,6 +105,25 @@ const char SerfStats::kSerfFetchActiveCount[] =
 const char SerfStats::kSerfFetchTimeoutCount[] = "serf_fetch_timeout_count";
 const char SerfStats::kSerfFetchFailureCount[] = "serf_fetch_failure_count";
 const char SerfStats::kSerfFetchCertErrors[] = "serf_fetch_cert_errors";
+const char SerfStats::kSerfFetchConnectionCount[] =
+    "serf_fetch_connection_count";
+const char SerfStats::kSerfFetchConnectionReuseCount[] =
+    "serf_fetch_connection_reuse_count";
+const char SerfStats::kSerfFetchConnectionWaitCount[] =
+    "serf_fetch_connection_wait_count";
+
+const int64 SerfUrlAsyncFetcher::kDefaultIdleConnectionTimeoutMs =
+    4 * Timer::kSecondMs;
+const int SerfUrlAsyncFetcher::kMaxFetchThreads;
+
+GoogleString SerfStats::LoopFetchCount(int loop_index) {
+  return StrCat("serf_fetch_loop", IntegerToString(loop_index),
+                "_fetch_count");
+}
+
+GoogleString SerfStats::LoopBusyUs(int loop_index) {
+  return StrCat("serf_fetch_loop", IntegerToString(loop_index), "_busy_us");
+}
 
 GoogleString GetAprErrorString(apr_status_t status) {
   char error_str[1024];
@@ -106,6 +131,134 @@ GoogleString GetAprErrorString(apr_status_t status) {
   return error_str;
 }
 
+// A serf connection to one origin.  It carries one fetch at a time, but
+// when the fetcher keeps idle connections it can carry a series of them,
+// which saves each one after the first a TCP (and TLS) handshake.
+class SerfConnection {
+ public:
+  SerfConnection(SerfUrlAsyncFetcher* fetcher, const GoogleString& key,
+                 MessageHandler* message_handler)
+      : fetcher_(fetcher),
+        key_(key),
+        message_handler_(message_handler),
+        pool_(NULL),
+        bucket_alloc_(NULL),
+        connection_(NULL),
+        closed_(false),
+        fetch_(NULL),
+        idle_since_ms_(0),
+        using_https_(false),
+        sni_host_(NULL),
+        ssl_context_(NULL) {
+    memset(&host_info_, 0, sizeof(host_info_));
+    apr_pool_create(&pool_, fetcher->pool());
+    bucket_alloc_ = serf_bucket_allocator_create(pool_, NULL, NULL);
+  }
+
+  ~SerfConnection() {
+    Close();
+    apr_pool_destroy(pool_);
+  }
+
+  // Creates the serf connection to url's origin.  Serf connects lazily, once
+  // a request has been queued on it.
+  apr_status_t Open(const apr_uri_t& url, const char* sni_host) {
+    // serf keeps the host info we pass it, so it must live as long as the
+    // connection does, not just as long as the first fetch.
+    host_info_.scheme = apr_pstrdup(pool_, url.scheme);
+    host_info_.hostinfo = apr_pstrdup(pool_, url.hostinfo);
+    host_info_.hostname = apr_pstrdup(pool_, url.hostname);
+    host_info_.port_str = apr_pstrdup(pool_, url.port_str);
+    host_info_.port = url.port;
+    using_https_ = StringCaseEqual("https", url.scheme);
+    sni_host_ = apr_pstrdup(pool_, sni_host);
+    apr_status_t status = serf_connection_create2(&connection_,
+                                                  fetcher_->serf_context(),
+                                                  host_info_,
+                                                  ConnectionSetup, this,
+                                                  ClosedConnection, this,
+                                                  pool_);
+    if (status != APR_SUCCESS) {
+      connection_ = NULL;
+    }
+    return status;
+  }
+
+  // Closes the serf connection, dropping any request queued on it.
+  void Close() {
+    if (connection_ != NULL) {
+      serf_connection_close(connection_);
+      connection_ = NULL;
+    }
+  }
+
+  // Whether a new request can be sent on this connection: it must not have
+  // been closed, either by us or by the origin.
+  bool IsOpen() const { return (connection_ != NULL) && !closed_; }
+
+  bool InErrorState() const {
+    return (connection_ != NULL) &&
+        serf_connection_is_in_error_state(connection_);
+  }
+
+  serf_connection_t* serf_connection() { return connection_; }
+  const GoogleString& key() const { return key_; }
+
+  // The fetch whose request is on the connection, if any.
+  void set_fetch(SerfFetch* fetch) { fetch_ = fetch; }
+
+  int64 idle_since_ms() const { return idle_since_ms_; }
+  void set_idle_since_ms(int64 x) { idle_since_ms_ = x; }
+
+ private:
+#if SERF_HTTPS_FETCHING
+  static apr_status_t SSLCertError(void *data, int failures,
+                                   const serf_ssl_certificate_t *cert) {
+    return static_cast<SerfConnection*>(data)->HandleSSLCertErrors(failures,
+                                                                   0);
+  }
+
+  static apr_status_t SSLCertChainError(
+      void *data, int failures, int error_depth,
+      const serf_ssl_certificate_t * const *certs,
+      apr_size_t certs_count) {
+    return static_cast<SerfConnection*>(data)->HandleSSLCertErrors(
+        failures, error_depth);
+  }
+
+  // Certificates are checked as the connection is set up, on behalf of
+  // the fetch that is using it.
+  apr_status_t HandleSSLCertErrors(int errors, int failure_depth);
+#endif
+
+  static apr_status_t ConnectionSetup(
+      apr_socket_t* socket, serf_bucket_t **read_bkt, serf_bucket_t **write_bkt,
+      void* setup_baton, apr_pool_t* pool);
+
+  static void ClosedConnection(serf_connection_t* conn,
+                               void* closed_baton,
+                               apr_status_t why,
+                               apr_pool_t* pool);
+
+  SerfUrlAsyncFetcher* fetcher_;
+  const GoogleString key_;
+  MessageHandler* message_handler_;
+  apr_pool_t* pool_;
+  serf_bucket_alloc_t* bucket_alloc_;
+  apr_uri_t host_info_;  // strings in pool_
+  serf_connection_t* connection_;
+  bool closed_;
+  SerfFetch* fetch_;
+  int64 idle_since_ms_;
+
+  // Variables used for HTTPS connection handling
+  bool using_https_;
+  const char* sni_host_;  // in pool_
+  serf_ssl_context_t* ssl_context_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerfConnection);
+};
+
 // TODO(lsong): Move this to a separate file. Necessary?
 class SerfFetch : public PoolElement<SerfFetch> {
  public:
@@ -125,33 +278,38 @@ class SerfFetch : public PoolElement<SerfFetch> {
         saved_byte_('\0'),
         message_handler_(message_handler),
         pool_(NULL),  // filled in once assigned to a thread, to use its pool.
-        bucket_alloc_(NULL),
         host_header_(NULL),
         sni_host_(NULL),
         connection_(NULL),
+        keep_alive_(false),
+        reusable_(false),
         bytes_received_(0),
         fetch_start_ms_(0),
         fetch_end_ms_(0),
-        using_https_(false),
-        ssl_context_(NULL),
+        busy_us_(0),
+        busy_start_us_(0),
         ssl_error_message_(NULL) {
     memset(&url_, 0, sizeof(url_));
   }
 
-  ~SerfFetch() {
-    DCHECK(async_fetch_ == NULL);
-    if (connection_ != NULL) {
-      serf_connection_close(connection_);
-    }
-    if (pool_ != NULL) {
-      apr_pool_destroy(pool_);
-    }
-  }
+  // Hands any connection back to the fetcher's connection pool.  This
+  // must be called with fetcher->mutex_ held, outside the serf event loop.
+  ~SerfFetch();
 
   // Start the fetch. It returns immediately.  This can only be run when
   // locked with fetcher->mutex_.
   bool Start(SerfUrlAsyncFetcher* fetcher);
 
+  // Queues the fetch's request on connection, which the fetch holds until
+  // it is deleted.  Must be called with fetcher->mutex_ held.
+  bool SendRequest(SerfConnection* connection);
+
+  // Identifies the connections this fetch can use: those to the same host
+  // and port with the same scheme and, for https, the same SNI host.
+  const GoogleString& origin_key() const { return origin_key_; }
+  const apr_uri_t& url() const { return url_; }
+  const char* sni_host() const { return sni_host_; }
+
   GoogleString DebugInfo() {
     if (host_header_ != NULL &&
         url_.scheme != NULL &&
@@ -175,24 +333,7 @@ class SerfFetch : public PoolElement<SerfFetch> {
   }
 
   // This must be called while holding SerfUrlAsyncFetcher's mutex_.
-  void Cancel() {
-    if (connection_ != NULL) {
-      // We can get here either because we're canceling the connection ourselves
-      // or because Serf detected an error.
-      //
-      // If we canceled/timed out, we want to close the serf connection so it
-      // doesn't call us back, as we will detach from the async_fetch_ shortly.
-      //
-      // If Serf detected an error we also want to clean up as otherwise it will
-      // keep re-detecting it, which will interfere with other jobs getting
-      // handled (until we finally cleanup the old fetch and close things in
-      // ~SerfFetch).
-      serf_connection_close(connection_);
-      connection_ = NULL;
-    }
-
-    CallCallback(false);
-  }
+  void Cancel();
 
   // Calls the callback supplied by the user.  This needs to happen
   // exactly once.  In some error cases it appears that Serf calls
@@ -208,6 +349,9 @@ class SerfFetch : public PoolElement<SerfFetch> {
     }
 
     if (async_fetch_ != NULL) {
+      // Once a response has been read in full, the connection can carry the
+      // next request to the origin, unless either side asked to close it.
+      reusable_ = success && keep_alive_;
       fetch_end_ms_ = timer_->NowMs();
       fetcher_->ReportCompletedFetchStats(this);
       CallbackDone(success);
@@ -241,8 +385,7 @@ class SerfFetch : public PoolElement<SerfFetch> {
   // If last poll of this fetch's connection resulted in an error, clean it up.
   // Must be called after serf_context_run, with fetcher's mutex_ held.
   void CleanupIfError() {
-    if ((connection_ != NULL) &&
-        serf_connection_is_in_error_state(connection_)) {
+    if ((connection_ != NULL) && connection_->InErrorState()) {
       message_handler_->Message(
           kInfo, "Serf cleanup for error'd fetch of: %s", DebugInfo().c_str());
       Cancel();
@@ -261,98 +404,18 @@ class SerfFetch : public PoolElement<SerfFetch> {
   size_t bytes_received() const { return bytes_received_; }
   MessageHandler* message_handler() { return message_handler_; }
 
- private:
-  // Static functions used in callbacks.
-
-  // The code under SERF_HTTPS_FETCHING was contributed by Devin Anderson
-  // (surfacepatterns@gmail.com).
-  //
-  // Note this must be ifdef'd because calling serf_bucket_ssl_decrypt_create
-  // requires ssl_buckets.c in the link.  ssl_buckets.c requires openssl.
-#if SERF_HTTPS_FETCHING
-  static apr_status_t SSLCertError(void *data, int failures,
-                                   const serf_ssl_certificate_t *cert) {
-    return static_cast<SerfFetch*>(data)->HandleSSLCertErrors(failures, 0);
-  }
-
-  static apr_status_t SSLCertChainError(
-      void *data, int failures, int error_depth,
-      const serf_ssl_certificate_t * const *certs,
-      apr_size_t certs_count) {
-    return static_cast<SerfFetch*>(data)->HandleSSLCertErrors(failures,
-                                                              error_depth);
-  }
-#endif
-
-  static apr_status_t ConnectionSetup(
-      apr_socket_t* socket, serf_bucket_t **read_bkt, serf_bucket_t **write_bkt,
-      void* setup_baton, apr_pool_t* pool) {
-    SerfFetch* fetch = static_cast<SerfFetch*>(setup_baton);
-    *read_bkt = serf_bucket_socket_create(socket, fetch->bucket_alloc_);
-#if SERF_HTTPS_FETCHING
-    apr_status_t status = APR_SUCCESS;
-    if (fetch->using_https_) {
-      *read_bkt = serf_bucket_ssl_decrypt_create(*read_bkt,
-                                                 fetch->ssl_context_,
-                                                 fetch->bucket_alloc_);
-      if (fetch->ssl_context_ == NULL) {
-        fetch->ssl_context_ = serf_bucket_ssl_decrypt_context_get(*read_bkt);
-        if (fetch->ssl_context_ == NULL) {
-          status = APR_EGENERAL;
-        } else {
-          SerfUrlAsyncFetcher* fetcher = fetch->fetcher_;
-          const GoogleString& certs_dir = fetcher->ssl_certificates_dir();
-          const GoogleString& certs_file = fetcher->ssl_certificates_file();
-
-          if (!certs_file.empty()) {
-            status = serf_ssl_set_certificates_file(
-                fetch->ssl_context_, certs_file.c_str());
-          }
-          if ((status == APR_SUCCESS) && !certs_dir.empty()) {
-            status = serf_ssl_set_certificates_directory(fetch->ssl_context_,
-                                                         certs_dir.c_str());
-          }
-
-          // If no explicit file or directory is specified, then use the
-          // compiled-in default.
-          if (certs_dir.empty() && certs_file.empty()) {
-            status = serf_ssl_use_default_certificates(fetch->ssl_context_);
-          }
-        }
-        if (status != APR_SUCCESS) {
-          return status;
-        }
-      }
-
-      serf_ssl_server_cert_callback_set(fetch->ssl_context_, SSLCertError,
-                                        fetch);
-
-      serf_ssl_server_cert_chain_callback_set(fetch->ssl_context_,
-                                              SSLCertError, SSLCertChainError,
-                                              fetch);
-
-      serf_ssl_set_hostname(fetch->ssl_context_, fetch->sni_host_);
-      *write_bkt = serf_bucket_ssl_encrypt_create(*write_bkt,
-                                                  fetch->ssl_context_,
-                                                  fetch->bucket_alloc_);
+  // Time spent reading and parsing the response, including the time so far
+  // in the current read, since the fetch reports its stats before the read
+  // returns.
+  int64 busy_us() const {
+    if (busy_start_us_ == 0) {
+      return busy_us_;
     }
-#endif
-    return APR_SUCCESS;
+    return busy_us_ + timer_->NowUs() - busy_start_us_;
   }
 
-  static void ClosedConnection(serf_connection_t* conn,
-                               void* closed_baton,
-                               apr_status_t why,
-                               apr_pool_t* pool) {
-    SerfFetch* fetch = static_cast<SerfFetch*>(closed_baton);
-    if (why != APR_SUCCESS) {
-      fetch->message_handler_->Warning(
-          fetch->DebugInfo().c_str(), 0, "Connection close (code=%d %s).",
-          why, GetAprErrorString(why).c_str());
-    }
-    // Connection is closed.
-    fetch->connection_ = NULL;
-  }
+ private:
+  // Static functions used in callbacks.
 
   static serf_bucket_t* AcceptResponse(serf_request_t* request,
                                        serf_bucket_t* stream,
@@ -376,7 +439,13 @@ class SerfFetch : public PoolElement<SerfFetch> {
                                      void* handler_baton,
                                      apr_pool_t* pool) {
     SerfFetch* fetch = static_cast<SerfFetch*>(handler_baton);
-    return fetch->HandleResponse(response);
+    // Account for the time this thread spends on the response, which holds
+    // up the other fetches on it.
+    fetch->busy_start_us_ = fetch->timer_->NowUs();
+    apr_status_t status = fetch->HandleResponse(response);
+    fetch->busy_us_ += fetch->timer_->NowUs() - fetch->busy_start_us_;
+    fetch->busy_start_us_ = 0;
+    return status;
   }
 
   static bool MoreDataAvailable(apr_status_t status) {
@@ -395,6 +464,25 @@ class SerfFetch : public PoolElement<SerfFetch> {
             MoreDataAvailable(status));
   }
 
+  // Whether the response leaves the connection open for another request.
+  static bool KeepAlive(const ResponseHeaders* response_headers) {
+    if ((response_headers->major_version() < 1) ||
+        ((response_headers->major_version() == 1) &&
+         (response_headers->minor_version() < 1))) {
+      return false;
+    }
+    ConstStringStarVector values;
+    if (response_headers->Lookup(HttpAttributes::kConnection, &values)) {
+      for (int i = 0, n = values.size(); i < n; ++i) {
+        if ((values[i] != NULL) && StringCaseEqual(*values[i], "close")) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+ public:
 #if SERF_HTTPS_FETCHING
   // Called indicating whether SSL certificate errors have occurred detected.
   // The function returns SUCCESS in all cases, but sets ssl_error_message_
@@ -451,6 +539,7 @@ class SerfFetch : public PoolElement<SerfFetch> {
   }
 #endif
 
+ private:
   // The handler MUST process data from the response bucket until the
   // bucket's read function states it would block (APR_STATUS_IS_EAGAIN).
   // The handler is invoked only when new data arrives. If no further data
@@ -560,6 +649,9 @@ class SerfFetch : public PoolElement<SerfFetch> {
       if (parser_.ParseChunk(StringPiece(data, len), message_handler_)) {
         if (parser_.headers_complete()) {
           ResponseHeaders* response_headers = async_fetch_->response_headers();
+          // Decide now, as the fetch's consumer may rewrite the headers,
+          // e.g. dropping Connection, once we pass the response along.
+          keep_alive_ = KeepAlive(response_headers);
           if (ssl_error_message_ != NULL) {
             response_headers->set_status_code(HttpStatus::kNotFound);
             message_handler_->Message(kInfo, "%s: %s", DebugInfo().c_str(),
@@ -745,11 +837,15 @@ class SerfFetch : public PoolElement<SerfFetch> {
 
     host_header_ = apr_pstrdup(pool_, host);
 
+    origin_key_ = StrCat(url_.scheme, "://",
+                         (url_.hostname == NULL) ? "" : url_.hostname, ":",
+                         IntegerToString(url_.port));
     if (is_https) {
       // SNI hosts, unlike Host: do not have a port number.
       GoogleString sni_host =
           SerfUrlAsyncFetcher::RemovePortFromHostHeader(host_header_);
       sni_host_ = apr_pstrdup(pool_, sni_host.c_str());
+      StrAppend(&origin_key_, " ", sni_host);
     }
 
     return true;
@@ -767,26 +863,363 @@ class SerfFetch : public PoolElement<SerfFetch> {
   MessageHandler* message_handler_;
 
   apr_pool_t* pool_;
-  serf_bucket_alloc_t* bucket_alloc_;
   apr_uri_t url_;
   const char* host_header_;  // in pool_
   const char* sni_host_;  // in pool_
-  serf_connection_t* connection_;
+  GoogleString origin_key_;
+  SerfConnection* connection_;
+  bool keep_alive_;  // Whether the origin's headers allow another request.
+  bool reusable_;  // Whether connection_ can carry another request.
   size_t bytes_received_;
   int64 fetch_start_ms_;
   int64 fetch_end_ms_;
+  int64 busy_us_;
+  int64 busy_start_us_;  // 0 unless the response is being read.
 
   // Variables used for HTTPS connection handling
-  bool using_https_;
-  serf_ssl_context_t* ssl_context_;
   const char* ssl_error_message_;
 
   DISALLOW_COPY_AND_ASSIGN(SerfFetch);
 };
 
+#if SERF_HTTPS_FETCHING
+apr_status_t SerfConnection::HandleSSLCertErrors(int errors,
+                                                 int failure_depth) {
+  if (fetch_ == NULL) {
+    // We only set up connections to send a fetch's request on them.
+    return APR_EGENERAL;
+  }
+  return fetch_->HandleSSLCertErrors(errors, failure_depth);
+}
+#endif
+
+apr_status_t SerfConnection::ConnectionSetup(
+    apr_socket_t* socket, serf_bucket_t **read_bkt, serf_bucket_t **write_bkt,
+    void* setup_baton, apr_pool_t* pool) {
+  SerfConnection* connection = static_cast<SerfConnection*>(setup_baton);
+  *read_bkt = serf_bucket_socket_create(socket, connection->bucket_alloc_);
+#if SERF_HTTPS_FETCHING
+  apr_status_t status = APR_SUCCESS;
+  if (connection->using_https_) {
+    *read_bkt = serf_bucket_ssl_decrypt_create(*read_bkt,
+                                               connection->ssl_context_,
+                                               connection->bucket_alloc_);
+    if (connection->ssl_context_ == NULL) {
+      connection->ssl_context_ =
+          serf_bucket_ssl_decrypt_context_get(*read_bkt);
+      if (connection->ssl_context_ == NULL) {
+        status = APR_EGENERAL;
+      } else {
+        SerfUrlAsyncFetcher* fetcher = connection->fetcher_;
+        const GoogleString& certs_dir = fetcher->ssl_certificates_dir();
+        const GoogleString& certs_file = fetcher->ssl_certificates_file();
+
+        if (!certs_file.empty()) {
+          status = serf_ssl_set_certificates_file(
+              connection->ssl_context_, certs_file.c_str());
+        }
+        if ((status == APR_SUCCESS) && !certs_dir.empty()) {
+          status = serf_ssl_set_certificates_directory(
+              connection->ssl_context_, certs_dir.c_str());
+        }
+
+        // If no explicit file or directory is specified, then use the
+        // compiled-in default.
+        if (certs_dir.empty() && certs_file.empty()) {
+          status = serf_ssl_use_default_certificates(connection->ssl_context_);
+        }
+      }
+      if (status != APR_SUCCESS) {
+        return status;
+      }
+    }
+
+    serf_ssl_server_cert_callback_set(connection->ssl_context_, SSLCertError,
+                                      connection);
+
+    serf_ssl_server_cert_chain_callback_set(connection->ssl_context_,
+                                            SSLCertError, SSLCertChainError,
+                                            connection);
+
+    serf_ssl_set_hostname(connection->ssl_context_, connection->sni_host_);
+    *write_bkt = serf_bucket_ssl_encrypt_create(*write_bkt,
+                                                connection->ssl_context_,
+                                                connection->bucket_alloc_);
+  }
+#endif
+  return APR_SUCCESS;
+}
+
+void SerfConnection::ClosedConnection(serf_connection_t* conn,
+                                      void* closed_baton,
+                                      apr_status_t why,
+                                      apr_pool_t* pool) {
+  SerfConnection* connection = static_cast<SerfConnection*>(closed_baton);
+  if (why != APR_SUCCESS) {
+    GoogleString debug_info = (connection->fetch_ == NULL)
+        ? connection->key_ : connection->fetch_->DebugInfo();
+    connection->message_handler_->Warning(
+        debug_info.c_str(), 0, "Connection close (code=%d %s).",
+        why, GetAprErrorString(why).c_str());
+  }
+  // serf reopens a connection the origin has closed if there are requests
+  // left on it, so we hold onto it until it is released, but we won't send
+  // it any more.
+  connection->closed_ = true;
+}
+
+// Keeps the connections to each origin that are not in use, so that a fetch
+// can reuse one left idle by an earlier fetch, and limits how many
+// connections to an origin are in use at once, queueing the fetches over
+// the limit until a connection is released.
+//
+// This must be accessed with the fetcher's mutex_ held.
+class SerfConnectionPool {
+ public:
+  enum AcquireResult {
+    kConnected,  // The fetch has a connection and can send its request.
+    kWaiting,    // The fetch is queued until a connection is released.
+    kFailed      // No connection could be created.
+  };
+
+  SerfConnectionPool(SerfUrlAsyncFetcher* fetcher, Timer* timer,
+                     Variable* connection_count, Variable* reuse_count,
+                     Variable* wait_count)
+      : fetcher_(fetcher),
+        timer_(timer),
+        connection_count_(connection_count),
+        reuse_count_(reuse_count),
+        wait_count_(wait_count) {
+  }
+
+  ~SerfConnectionPool() {
+    for (OriginMap::iterator p = origins_.begin(), e = origins_.end();
+         p != e; ++p) {
+      STLDeleteElements(&p->second.idle);
+    }
+    for (int i = 0, n = ready_.size(); i < n; ++i) {
+      delete ready_[i].second;
+    }
+  }
+
+  // Finds a connection for fetch, whose URL has been parsed.
+  AcquireResult Acquire(SerfFetch* fetch, SerfConnection** connection) {
+    Origin& origin = origins_[fetch->origin_key()];
+    int64 now_ms = timer_->NowMs();
+    while (!origin.idle.empty()) {
+      // The most recently used connection is the least likely to have been
+      // closed by the origin.
+      SerfConnection* idle = origin.idle.back();
+      origin.idle.pop_back();
+      if (IsReusable(idle, now_ms)) {
+        ++origin.num_active;
+        reuse_count_->Add(1);
+        *connection = idle;
+        return kConnected;
+      }
+      delete idle;
+    }
+    int max_active = fetcher_->max_connections_per_host();
+    if ((max_active > 0) && (origin.num_active >= max_active)) {
+      origin.waiting.push_back(fetch);
+      wait_count_->Add(1);
+      return kWaiting;
+    }
+    *connection = NewConnection(fetch);
+    if (*connection == NULL) {
+      EraseIfUnused(origins_.find(fetch->origin_key()));
+      return kFailed;
+    }
+    ++origin.num_active;
+    return kConnected;
+  }
+
+  // Takes back a connection from a finished fetch, handing it to the next
+  // fetch waiting for the origin or keeping it idle if it is reusable.
+  // This must be called outside the serf event loop.
+  void Release(SerfConnection* connection, bool reusable) {
+    OriginMap::iterator iter = origins_.find(connection->key());
+    DCHECK(iter != origins_.end());
+    Origin& origin = iter->second;
+    connection->set_fetch(NULL);
+    if (!reusable || !connection->IsOpen()) {
+      delete connection;
+      connection = NULL;
+    }
+    while (!origin.waiting.empty()) {
+      SerfFetch* fetch = origin.waiting.front();
+      origin.waiting.pop_front();
+      if (connection == NULL) {
+        connection = NewConnection(fetch);
+      } else {
+        reuse_count_->Add(1);
+      }
+      // A fetch without a connection is canceled by StartReadyFetches.
+      ready_.push_back(ReadyFetch(fetch, connection));
+      if (connection != NULL) {
+        return;  // fetch takes over the released connection's slot.
+      }
+    }
+    --origin.num_active;
+    if (connection != NULL) {
+      if (static_cast<int>(origin.idle.size()) <
+          fetcher_->max_idle_connections_per_host()) {
+        connection->set_idle_since_ms(timer_->NowMs());
+        origin.idle.push_back(connection);
+      } else {
+        delete connection;
+      }
+    }
+    EraseIfUnused(iter);
+  }
+
+  // Forgets fetch, which is being canceled, if it is waiting for a
+  // connection or has just been handed one.
+  void RemoveWaiting(SerfFetch* fetch) {
+    OriginMap::iterator iter = origins_.find(fetch->origin_key());
+    if (iter != origins_.end()) {
+      std::deque<SerfFetch*>& waiting = iter->second.waiting;
+      for (std::deque<SerfFetch*>::iterator p = waiting.begin(),
+               e = waiting.end(); p != e; ++p) {
+        if (*p == fetch) {
+          waiting.erase(p);
+          return;
+        }
+      }
+    }
+    for (ReadyFetches::iterator p = ready_.begin(), e = ready_.end();
+         p != e; ++p) {
+      if (p->first == fetch) {
+        SerfConnection* connection = p->second;
+        ready_.erase(p);
+        if (connection != NULL) {
+          Release(connection, true);
+        }
+        return;
+      }
+    }
+  }
+
+  // Takes the next fetch that has been handed a connection, returning
+  // false if there are none.  *connection is NULL if one could not be
+  // created for the fetch.
+  bool TakeReady(SerfFetch** fetch, SerfConnection** connection) {
+    if (ready_.empty()) {
+      return false;
+    }
+    *fetch = ready_.front().first;
+    *connection = ready_.front().second;
+    ready_.pop_front();
+    return true;
+  }
+
+  // Closes connections that have been idle too long, or that the origin
+  // has closed.
+  void CloseIdleConnections() {
+    int64 now_ms = timer_->NowMs();
+    for (OriginMap::iterator p = origins_.begin(); p != origins_.end(); ) {
+      std::vector<SerfConnection*>& idle = p->second.idle;
+      int kept = 0;
+      for (int i = 0, n = idle.size(); i < n; ++i) {
+        if (IsReusable(idle[i], now_ms)) {
+          idle[kept++] = idle[i];
+        } else {
+          delete idle[i];
+        }
+      }
+      idle.resize(kept);
+      EraseIfUnused(p++);
+    }
+  }
+
+ private:
+  struct Origin {
+    Origin() : num_active(0) {}
+
+    // Connections held by fetches, including those about to be started.
+    int num_active;
+    std::vector<SerfConnection*> idle;  // Most recently used last.
+    std::deque<SerfFetch*> waiting;
+  };
+  typedef std::map<GoogleString, Origin> OriginMap;
+  typedef std::pair<SerfFetch*, SerfConnection*> ReadyFetch;
+  typedef std::deque<ReadyFetch> ReadyFetches;
+
+  bool IsReusable(SerfConnection* connection, int64 now_ms) const {
+    return connection->IsOpen() &&
+        (now_ms - connection->idle_since_ms() <
+         fetcher_->idle_connection_timeout_ms());
+  }
+
+  SerfConnection* NewConnection(SerfFetch* fetch) {
+    SerfConnection* connection = new SerfConnection(
+        fetcher_, fetch->origin_key(), fetch->message_handler());
+    apr_status_t status = connection->Open(fetch->url(), fetch->sni_host());
+    if (status != APR_SUCCESS) {
+      fetch->message_handler()->Error(
+          fetch->DebugInfo().c_str(), 0,
+          "Error status=%d (%s) serf_connection_create2",
+          status, GetAprErrorString(status).c_str());
+      delete connection;
+      return NULL;
+    }
+    connection_count_->Add(1);
+    return connection;
+  }
+
+  void EraseIfUnused(OriginMap::iterator iter) {
+    const Origin& origin = iter->second;
+    if ((origin.num_active == 0) && origin.idle.empty() &&
+        origin.waiting.empty()) {
+      origins_.erase(iter);
+    }
+  }
+
+  SerfUrlAsyncFetcher* fetcher_;
+  Timer* timer_;
+  Variable* connection_count_;
+  Variable* reuse_count_;
+  Variable* wait_count_;
+  OriginMap origins_;
+  ReadyFetches ready_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerfConnectionPool);
+};
+
+SerfFetch::~SerfFetch() {
+  DCHECK(async_fetch_ == NULL);
+  if (connection_ != NULL) {
+    fetcher_->connection_pool_->Release(connection_, reusable_);
+  }
+  if (pool_ != NULL) {
+    apr_pool_destroy(pool_);
+  }
+}
+
+void SerfFetch::Cancel() {
+  if (connection_ != NULL) {
+    // We can get here either because we're canceling the connection ourselves
+    // or because Serf detected an error.
+    //
+    // If we canceled/timed out, we want to close the serf connection so it
+    // doesn't call us back, as we will detach from the async_fetch_ shortly.
+    //
+    // If Serf detected an error we also want to clean up as otherwise it will
+    // keep re-detecting it, which will interfere with other jobs getting
+    // handled (until we finally release the connection in ~SerfFetch).
+    connection_->Close();
+  } else {
+    // We may still be waiting for a connection.
+    fetcher_->connection_pool_->RemoveWaiting(this);
+  }
+
+  CallCallback(false);
+}
+
 class SerfThreadedFetcher : public SerfUrlAsyncFetcher {
  public:
-  SerfThreadedFetcher(SerfUrlAsyncFetcher* parent, const char* proxy) :
+  SerfThreadedFetcher(SerfUrlAsyncFetcher* parent, const char* proxy,
+                      int loop_index) :
       SerfUrlAsyncFetcher(parent, proxy),
       thread_id_(NULL),
       initiate_mutex_(parent->thread_system()->NewMutex()),
@@ -794,6 +1227,7 @@ class SerfThreadedFetcher : public SerfUrlAsyncFetcher {
       initiate_fetches_nonempty_(initiate_mutex_->NewCondvar()),
       thread_finish_(false),
       thread_started_(false) {
+    InitLoopStats(loop_index);
   }
 
   ~SerfThreadedFetcher() {
@@ -1025,7 +1459,6 @@ bool SerfFetch::Start(SerfUrlAsyncFetcher* fetcher) {
   // the pool ops.
   fetcher_ = fetcher;
   apr_pool_create(&pool_, fetcher_->pool());
-  bucket_alloc_ = serf_bucket_allocator_create(pool_, NULL, NULL);
 
   fetch_start_ms_ = timer_->NowMs();
   // Parse and validate the URL.
@@ -1033,26 +1466,30 @@ bool SerfFetch::Start(SerfUrlAsyncFetcher* fetcher) {
     return false;
   }
 
-  using_https_ = StringCaseEqual("https", url_.scheme);
-  DCHECK(fetcher->allow_https() || !using_https_);
-
-  apr_status_t status = serf_connection_create2(&connection_,
-                                                fetcher_->serf_context(),
-                                                url_,
-                                                ConnectionSetup, this,
-                                                ClosedConnection, this,
-                                                pool_);
-  if (status != APR_SUCCESS) {
-    message_handler_->Error(DebugInfo().c_str(), 0,
-                            "Error status=%d (%s) serf_connection_create2",
-                            status, GetAprErrorString(status).c_str());
-    return false;
+  SerfConnection* connection = NULL;
+  switch (fetcher_->connection_pool_->Acquire(this, &connection)) {
+    case SerfConnectionPool::kConnected:
+      return SendRequest(connection);
+    case SerfConnectionPool::kWaiting:
+      // StartReadyFetches will send our request once a connection to the
+      // origin is released.
+      return true;
+    case SerfConnectionPool::kFailed:
+      break;
   }
-  serf_connection_request_create(connection_, SetupRequest, this);
+  return false;
+}
 
-  // Start the fetch. It will connect to the remote host, send the request,
-  // and accept the response, without blocking.
-  status = serf_context_run(fetcher_->serf_context(), 0, fetcher_->pool());
+bool SerfFetch::SendRequest(SerfConnection* connection) {
+  connection_ = connection;
+  connection_->set_fetch(this);
+  serf_connection_request_create(connection_->serf_connection(),
+                                 SetupRequest, this);
+
+  // Start the fetch. It will connect to the remote host if need be, send the
+  // request, and accept the response, without blocking.
+  apr_status_t status = serf_context_run(fetcher_->serf_context(), 0,
+                                         fetcher_->pool());
 
   if (status == APR_SUCCESS || APR_STATUS_IS_TIMEUP(status)) {
     return true;
@@ -1098,7 +1535,7 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
       timer_(timer),
       mutex_(NULL),
       serf_context_(NULL),
-      threaded_fetcher_(NULL),
+      connection_pool_(NULL),
       active_count_(NULL),
       request_count_(NULL),
       byte_count_(NULL),
@@ -1107,11 +1544,21 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
       timeout_count_(NULL),
       failure_count_(NULL),
       cert_errors_(NULL),
+      connection_count_(NULL),
+      connection_reuse_count_(NULL),
+      connection_wait_count_(NULL),
+      loop_fetch_count_(NULL),
+      loop_busy_us_(NULL),
+      statistics_(statistics),
+      proxy_((proxy == NULL) ? "" : proxy),
       timeout_ms_(timeout_ms),
       shutdown_(false),
       list_outstanding_urls_on_error_(false),
       track_original_content_length_(false),
       https_options_(0),
+      max_idle_connections_per_host_(0),
+      max_connections_per_host_(0),
+      idle_connection_timeout_ms_(kDefaultIdleConnectionTimeoutMs),
       message_handler_(message_handler) {
   CHECK(statistics != NULL);
   request_count_  =
@@ -1125,8 +1572,14 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
   timeout_count_ = statistics->GetVariable(SerfStats::kSerfFetchTimeoutCount);
   failure_count_ = statistics->GetVariable(SerfStats::kSerfFetchFailureCount);
   cert_errors_ = statistics->GetVariable(SerfStats::kSerfFetchCertErrors);
+  connection_count_ =
+      statistics->GetVariable(SerfStats::kSerfFetchConnectionCount);
+  connection_reuse_count_ =
+      statistics->GetVariable(SerfStats::kSerfFetchConnectionReuseCount);
+  connection_wait_count_ =
+      statistics->GetVariable(SerfStats::kSerfFetchConnectionWaitCount);
   Init(pool, proxy);
-  threaded_fetcher_ = new SerfThreadedFetcher(this, proxy);
+  threaded_fetchers_.push_back(new SerfThreadedFetcher(this, proxy, 0));
 }
 
 SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(SerfUrlAsyncFetcher* parent,
@@ -1136,7 +1589,7 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(SerfUrlAsyncFetcher* parent,
       timer_(parent->timer_),
       mutex_(NULL),
       serf_context_(NULL),
-      threaded_fetcher_(NULL),
+      connection_pool_(NULL),
       active_count_(parent->active_count_),
       request_count_(parent->request_count_),
       byte_count_(parent->byte_count_),
@@ -1145,12 +1598,24 @@ SerfUrlAsyncFetcher::SerfUrlAsyncFetcher(SerfUrlAsyncFetcher* parent,
       timeout_count_(parent->timeout_count_),
       failure_count_(parent->failure_count_),
       cert_errors_(parent->cert_errors_),
+      connection_count_(parent->connection_count_),
+      connection_reuse_count_(parent->connection_reuse_count_),
+      connection_wait_count_(parent->connection_wait_count_),
+      loop_fetch_count_(NULL),
+      loop_busy_us_(NULL),
+      statistics_(parent->statistics_),
+      proxy_((proxy == NULL) ? "" : proxy),
       timeout_ms_(parent->timeout_ms()),
       shutdown_(false),
       list_outstanding_urls_on_error_(parent->list_outstanding_urls_on_error_),
       track_original_content_length_(parent->track_original_content_length_),
       https_options_(parent->https_options_),
-      message_handler_(parent->message_handler_) {
+      max_idle_connections_per_host_(parent->max_idle_connections_per_host_),
+      max_connections_per_host_(parent->max_connections_per_host_),
+      idle_connection_timeout_ms_(parent->idle_connection_timeout_ms_),
+      message_handler_(parent->message_handler_),
+      ssl_certificates_dir_(parent->ssl_certificates_dir_),
+      ssl_certificates_file_(parent->ssl_certificates_file_) {
   Init(parent->pool(), proxy);
 }
 
@@ -1171,18 +1636,18 @@ SerfUrlAsyncFetcher::~SerfUrlAsyncFetcher() {
   }
 
   active_fetches_.DeleteAll();
-  if (threaded_fetcher_ != NULL) {
-    delete threaded_fetcher_;
-  }
+  // The fetches have released their connections, which are closed here.
+  delete connection_pool_;
+  STLDeleteElements(&threaded_fetchers_);
   delete mutex_;
   apr_pool_destroy(pool_);  // also calls apr_allocator_destroy on the allocator
 }
 
 void SerfUrlAsyncFetcher::ShutDown() {
-  // Note that we choose not to delete the threaded_fetcher_ to avoid worrying
-  // about races on its deletion.
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->ShutDown();
+  // Note that we choose not to delete the threaded_fetchers_ to avoid worrying
+  // about races on their deletion.
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->ShutDown();
   }
 
   ScopedMutex lock(mutex_);
@@ -1196,6 +1661,9 @@ void SerfUrlAsyncFetcher::Init(apr_pool_t* parent_pool, const char* proxy) {
   pool_ = AprCreateThreadCompatiblePool(parent_pool);
   mutex_ = thread_system_->NewMutex();
   serf_context_ = serf_context_create(pool_);
+  connection_pool_ = new SerfConnectionPool(
+      this, timer_, connection_count_, connection_reuse_count_,
+      connection_wait_count_);
 
   if (!SetupProxy(proxy)) {
     message_handler_->Message(kError, "Proxy failed: %s", proxy);
@@ -1228,6 +1696,10 @@ void SerfUrlAsyncFetcher::CancelActiveFetchesMutexHeld() {
 }
 
 bool SerfUrlAsyncFetcher::StartFetch(SerfFetch* fetch) {
+  // Release the connections of fetches that finished in the last Poll, so
+  // this fetch can reuse one of them.
+  completed_fetches_.DeleteAll();
+  StartReadyFetches();
   bool started = !shutdown_ && fetch->Start(this);
   if (started) {
     active_fetches_.Add(fetch);
@@ -1248,10 +1720,33 @@ void SerfUrlAsyncFetcher::Fetch(const GoogleString& url,
   SerfFetch* fetch = new SerfFetch(url, async_fetch, message_handler, timer_);
 
   request_count_->Add(1);
-  threaded_fetcher_->InitiateFetch(fetch);
+
+  // Send all the fetches to an origin to the same thread, so they can share
+  // its connections to the origin.
+  int index = 0;
+  int num_threads = threaded_fetchers_.size();
+  if (num_threads > 1) {
+    GoogleUrl gurl(url);
+    if (gurl.IsWebValid()) {
+      StringPiece origin = gurl.Origin();
+      index = HashString<CasePreserve, size_t>(origin.data(), origin.size()) %
+          num_threads;
+    }
+  }
+  threaded_fetchers_[index]->InitiateFetch(fetch);
 
   // TODO(morlovich): There is quite a bit of code related to doing work
-  // both on 'this' and threaded_fetcher_ that could use cleaning up.
+  // both on 'this' and threaded_fetchers_ that could use cleaning up.
+}
+
+void SerfUrlAsyncFetcher::set_num_fetch_threads(int x) {
+  x = std::max(1, std::min(x, kMaxFetchThreads));
+  DCHECK(!threaded_fetchers_.empty());
+  while (static_cast<int>(threaded_fetchers_.size()) < x) {
+    int loop_index = threaded_fetchers_.size();
+    threaded_fetchers_.push_back(
+        new SerfThreadedFetcher(this, proxy_.c_str(), loop_index));
+  }
 }
 
 void SerfUrlAsyncFetcher::PrintActiveFetches(
@@ -1272,7 +1767,10 @@ int SerfUrlAsyncFetcher::Poll(int64 max_wait_ms) {
   if (!active_fetches_.empty()) {
     apr_status_t status =
         serf_context_run(serf_context_, 1000*max_wait_ms, pool_);
+    // Deleting the completed fetches releases their connections, which may
+    // hand them to fetches waiting for them.
     completed_fetches_.DeleteAll();
+    StartReadyFetches();
     if (APR_STATUS_IS_TIMEUP(status)) {
       // Remove expired fetches from the front of the queue.
       // This relies on the insertion-ordering guarantee
@@ -1323,7 +1821,7 @@ int SerfUrlAsyncFetcher::Poll(int64 max_wait_ms) {
           "Serf status %d(%s) polling for %ld %s fetches for %g seconds",
           status, GetAprErrorString(status).c_str(),
           static_cast<long>(active_fetches_.size()),  // NOLINT
-          (threaded_fetcher_ == NULL) ? "threaded" : "non-blocking",
+          threaded_fetchers_.empty() ? "threaded" : "non-blocking",
           max_wait_ms/1.0e3);
       if (list_outstanding_urls_on_error_) {
         int64 now_ms = timer_->NowMs();
@@ -1339,9 +1837,20 @@ int SerfUrlAsyncFetcher::Poll(int64 max_wait_ms) {
       CleanupFetchesWithErrors();
     }
   }
+  connection_pool_->CloseIdleConnections();
   return active_fetches_.size();
 }
 
+void SerfUrlAsyncFetcher::StartReadyFetches() {
+  SerfFetch* fetch;
+  SerfConnection* connection;
+  while (connection_pool_->TakeReady(&fetch, &connection)) {
+    if ((connection == NULL) || !fetch->SendRequest(connection)) {
+      fetch->Cancel();
+    }
+  }
+}
+
 void SerfUrlAsyncFetcher::FetchComplete(SerfFetch* fetch) {
   // We do not have a ScopedMutex in FetchComplete, because it is only
   // called from Poll and CancelActiveFetches, which have ScopedMutexes.
@@ -1361,6 +1870,18 @@ void SerfUrlAsyncFetcher::ReportCompletedFetchStats(SerfFetch* fetch) {
   if (active_count_) {
     active_count_->Add(-1);
   }
+  if (loop_fetch_count_ != NULL) {
+    loop_fetch_count_->Add(1);
+    loop_busy_us_->Add(fetch->busy_us());
+  }
+}
+
+void SerfUrlAsyncFetcher::InitLoopStats(int loop_index) {
+  if (loop_index < kMaxFetchThreads) {
+    loop_fetch_count_ =
+        statistics_->GetVariable(SerfStats::LoopFetchCount(loop_index));
+    loop_busy_us_ = statistics_->GetVariable(SerfStats::LoopBusyUs(loop_index));
+  }
 }
 
 bool SerfUrlAsyncFetcher::AnyPendingFetches() {
@@ -1376,9 +1897,13 @@ int SerfUrlAsyncFetcher:: ApproximateNumActiveFetches() {
 bool SerfUrlAsyncFetcher::WaitForActiveFetches(
     int64 max_ms, MessageHandler* message_handler, WaitChoice wait_choice) {
   bool ret = true;
-  if ((threaded_fetcher_ != NULL) && (wait_choice != kMainlineOnly)) {
-    ret &= threaded_fetcher_->WaitForActiveFetchesHelper(
-        max_ms, message_handler);
+  int64 end_ms = timer_->NowMs() + max_ms;
+  if (wait_choice != kMainlineOnly) {
+    for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+      ret &= threaded_fetchers_[i]->WaitForActiveFetchesHelper(
+          std::max(static_cast<int64>(0), end_ms - timer_->NowMs()),
+          message_handler);
+    }
   }
   if (wait_choice != kThreadedOnly) {
     ret &= WaitForActiveFetchesHelper(max_ms, message_handler);
@@ -1439,19 +1964,47 @@ void SerfUrlAsyncFetcher::InitStats(Statistics* statistics) {
   statistics->AddVariable(SerfStats::kSerfFetchTimeoutCount);
   statistics->AddVariable(SerfStats::kSerfFetchFailureCount);
   statistics->AddVariable(SerfStats::kSerfFetchCertErrors);
+  statistics->AddVariable(SerfStats::kSerfFetchConnectionCount);
+  statistics->AddVariable(SerfStats::kSerfFetchConnectionReuseCount);
+  statistics->AddVariable(SerfStats::kSerfFetchConnectionWaitCount);
+  for (int i = 0; i < kMaxFetchThreads; ++i) {
+    statistics->AddVariable(SerfStats::LoopFetchCount(i));
+    statistics->AddVariable(SerfStats::LoopBusyUs(i));
+  }
 }
 
 void SerfUrlAsyncFetcher::set_list_outstanding_urls_on_error(bool x) {
   list_outstanding_urls_on_error_ = x;
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->set_list_outstanding_urls_on_error(x);
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_list_outstanding_urls_on_error(x);
   }
 }
 
 void SerfUrlAsyncFetcher::set_track_original_content_length(bool x) {
   track_original_content_length_ = x;
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->set_track_original_content_length(x);
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_track_original_content_length(x);
+  }
+}
+
+void SerfUrlAsyncFetcher::set_max_idle_connections_per_host(int x) {
+  max_idle_connections_per_host_ = x;
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_max_idle_connections_per_host(x);
+  }
+}
+
+void SerfUrlAsyncFetcher::set_max_connections_per_host(int x) {
+  max_connections_per_host_ = x;
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_max_connections_per_host(x);
+  }
+}
+
+void SerfUrlAsyncFetcher::set_idle_connection_timeout_ms(int64 x) {
+  idle_connection_timeout_ms_ = x;
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_idle_connection_timeout_ms(x);
   }
 }
 
@@ -1532,23 +2085,23 @@ bool SerfUrlAsyncFetcher::SetHttpsOptions(StringPiece directive) {
     https_options_ = 0;
   }
 #endif
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->set_https_options(https_options_);
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->set_https_options(https_options_);
   }
   return true;
 }
 
 void SerfUrlAsyncFetcher::SetSslCertificatesDir(StringPiece dir) {
   dir.CopyToString(&ssl_certificates_dir_);
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->SetSslCertificatesDir(dir);
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->SetSslCertificatesDir(dir);
   }
 }
 
 void SerfUrlAsyncFetcher::SetSslCertificatesFile(StringPiece file) {
   file.CopyToString(&ssl_certificates_file_);
-  if (threaded_fetcher_ != NULL) {
-    threaded_fetcher_->SetSslCertificatesFile(file);
+  for (int i = 0, n = threaded_fetchers_.size(); i < n; ++i) {
+    threaded_fetchers_[i]->SetSslCertificatesFile(file);
   }
 }
 
@@ -51,6 +51,8 @@ namespace net_instaweb {
 class AsyncFetch;
 class MessageHandler;
 class Statistics;
+class SerfConnection;
+class SerfConnectionPool;
 class SerfFetch;
 class SerfThreadedFetcher;
 class Timer;
@@ -66,6 +68,15 @@ struct SerfStats {
   static const char kSerfFetchTimeoutCount[];
   static const char kSerfFetchFailureCount[];
   static const char kSerfFetchCertErrors[];
+  static const char kSerfFetchConnectionCount[];
+  static const char kSerfFetchConnectionReuseCount[];
+  static const char kSerfFetchConnectionWaitCount[];
+
+  // Names of the stats kept for each fetch thread: the number of fetches
+  // it has completed, and the time it has spent reading their responses,
+  // which is time other fetches on the thread wait.
+  static GoogleString LoopFetchCount(int loop_index);
+  static GoogleString LoopBusyUs(int loop_index);
 };
 
 // Identifies the set of HTML keywords.  This is used in error messages emitted
@@ -90,6 +101,16 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
     kThreadedAndMainline
   };
 
+  // How long a kept-alive connection may sit idle before we close it.  This
+  // should be shorter than the origin's own keep-alive timeout (5 seconds
+  // by default in Apache) so we rarely send a request on a connection the
+  // origin is closing.
+  static const int64 kDefaultIdleConnectionTimeoutMs;
+
+  // The most fetch threads set_num_fetch_threads allows; stats are
+  // registered for each.
+  static const int kMaxFetchThreads = 8;
+
   SerfUrlAsyncFetcher(const char* proxy, apr_pool_t* pool,
                       ThreadSystem* thread_system,
                       Statistics* statistics, Timer* timer, int64 timeout_ms,
@@ -169,6 +190,36 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
     return ssl_certificates_file_;
   }
 
+  // Keeps up to x connections to each origin open once their fetches are
+  // done, so that later fetches to the origin can reuse them rather than
+  // paying for a new TCP (and TLS) handshake.  0, the default, closes each
+  // connection as its fetch finishes.
+  void set_max_idle_connections_per_host(int x);
+  int max_idle_connections_per_host() const {
+    return max_idle_connections_per_host_;
+  }
+
+  // Limits the connections open to each origin for fetches at any one time;
+  // further fetches to it wait for one to be released.  0, the default,
+  // means no limit.
+  void set_max_connections_per_host(int x);
+  int max_connections_per_host() const { return max_connections_per_host_; }
+
+  // Closes connections that have been idle for x ms.
+  void set_idle_connection_timeout_ms(int64 x);
+  int64 idle_connection_timeout_ms() const {
+    return idle_connection_timeout_ms_;
+  }
+
+  // Runs fetches on x threads, each with its own serf event loop and
+  // connections, rather than the default of one.  Each origin's fetches all
+  // go to the same thread, so they share its idle connections.  This must
+  // be called before the first fetch, and x is capped at kMaxFetchThreads.
+  void set_num_fetch_threads(int x);
+  int num_fetch_threads() const {
+    return static_cast<int>(threaded_fetchers_.size());
+  }
+
  protected:
   typedef Pool<SerfFetch> SerfFetchPool;
 
@@ -183,6 +234,11 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   }
 
   void Init(apr_pool_t* parent_pool, const char* proxy);
+
+  // Reports the fetches this fetcher completes in the stats for
+  // thread loop_index.
+  void InitLoopStats(int loop_index);
+
   bool SetupProxy(const char* proxy);
 
   // Start a SerfFetch. Takes ownership of fetch and makes sure callback is
@@ -210,6 +266,11 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   // Must be called with mutex_ held.
   void CleanupFetchesWithErrors();
 
+  // Sends the requests of fetches that were waiting for a connection to
+  // their origin and have now been handed one.  Must be called with mutex_
+  // held, outside the serf event loop.
+  void StartReadyFetches();
+
   // These must be accessed with mutex_ held.
   bool shutdown() const { return shutdown_; }
   void set_shutdown(bool s) { shutdown_ = s; }
@@ -222,10 +283,15 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   ThreadSystem::CondvarCapableMutex* mutex_;
   serf_context_t* serf_context_;
   SerfFetchPool active_fetches_;
+  // Connections not in use by a fetch, and fetches waiting for one.  This
+  // is also protected by mutex_.
+  SerfConnectionPool* connection_pool_;
 
   typedef std::vector<SerfFetch*> FetchVector;
   SerfFetchPool completed_fetches_;
-  SerfThreadedFetcher* threaded_fetcher_;
+  // The fetch threads, distributed to by origin.  Empty in the fetchers
+  // that run on them.
+  std::vector<SerfThreadedFetcher*> threaded_fetchers_;
 
   // This is protected because it's updated along with active_fetches_,
   // which happens in subclass SerfThreadedFetcher as well as this class.
@@ -254,11 +320,22 @@ class SerfUrlAsyncFetcher : public UrlAsyncFetcher {
   Variable* timeout_count_;
   Variable* failure_count_;
   Variable* cert_errors_;
+  Variable* connection_count_;
+  Variable* connection_reuse_count_;
+  Variable* connection_wait_count_;
+  // Stats for the fetch thread this runs on; NULL if it isn't one.
+  Variable* loop_fetch_count_;
+  Variable* loop_busy_us_;
+  Statistics* statistics_;
+  const GoogleString proxy_;
   const int64 timeout_ms_;
   bool shutdown_;
   bool list_outstanding_urls_on_error_;
   bool track_original_content_length_;
   uint32 https_options_;  // Composed of HttpsOptions ORed together.
+  int max_idle_connections_per_host_;
+  int max_connections_per_host_;
+  int64 idle_connection_timeout_ms_;
   MessageHandler* message_handler_;
   GoogleString ssl_certificates_dir_;
   GoogleString ssl_certificates_file_;
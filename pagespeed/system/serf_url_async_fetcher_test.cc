@@ -820,6 +820,87 @@ TEST_F(SerfUrlAsyncFetcherTest, TestPost) {
   EXPECT_EQ(HttpStatus::kOK, response_headers(index)->status_code());
 }
 
+TEST_F(SerfUrlAsyncFetcherTest, ClosesConnectionsByDefault) {
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  EXPECT_EQ(2 + flaky_retries_, statistics_->GetVariable(
+      SerfStats::kSerfFetchConnectionCount)->Get());
+  EXPECT_EQ(0, statistics_->GetVariable(
+      SerfStats::kSerfFetchConnectionReuseCount)->Get());
+}
+
+TEST_F(SerfUrlAsyncFetcherTest, ReusesIdleConnection) {
+  serf_url_async_fetcher_->set_max_idle_connections_per_host(1);
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  EXPECT_TRUE(TestFetch(kGoogleFavicon, kGoogleFavicon));
+  if (flaky_retries_ == 0) {
+    EXPECT_EQ(1, statistics_->GetVariable(
+        SerfStats::kSerfFetchConnectionCount)->Get());
+    EXPECT_EQ(2, statistics_->GetVariable(
+        SerfStats::kSerfFetchConnectionReuseCount)->Get());
+  }
+  EXPECT_EQ(0, ActiveFetches());
+}
+
+TEST_F(SerfUrlAsyncFetcherTest, IdleConnectionTimesOut) {
+  serf_url_async_fetcher_->set_max_idle_connections_per_host(1);
+  serf_url_async_fetcher_->set_idle_connection_timeout_ms(1);
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  usleep(10 * Timer::kMsUs);
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kModpagespeedSite));
+  EXPECT_EQ(0, statistics_->GetVariable(
+      SerfStats::kSerfFetchConnectionReuseCount)->Get());
+}
+
+TEST_F(SerfUrlAsyncFetcherTest, LimitsConnectionsPerHost) {
+  // The second fetch waits for the first fetch's connection, and reuses it.
+  serf_url_async_fetcher_->set_max_connections_per_host(1);
+  serf_url_async_fetcher_->set_max_idle_connections_per_host(1);
+  StartFetches(kGoogleFavicon, kGoogleLogo);
+  ASSERT_EQ(2, WaitTillDone(kGoogleFavicon, kGoogleLogo));
+  ValidateFetches(kGoogleFavicon, kGoogleLogo);
+  if (flaky_retries_ == 0) {
+    EXPECT_EQ(1, statistics_->GetVariable(
+        SerfStats::kSerfFetchConnectionWaitCount)->Get());
+    EXPECT_EQ(1, statistics_->GetVariable(
+        SerfStats::kSerfFetchConnectionCount)->Get());
+    EXPECT_EQ(1, statistics_->GetVariable(
+        SerfStats::kSerfFetchConnectionReuseCount)->Get());
+  }
+  EXPECT_EQ(0, ActiveFetches());
+}
+
+TEST_F(SerfUrlAsyncFetcherTest, FetchThreadsShareOrigin) {
+  // All the fetches are from the same origin, so they should all run on the
+  // same thread.
+  serf_url_async_fetcher_->set_num_fetch_threads(3);
+  EXPECT_EQ(3, serf_url_async_fetcher_->num_fetch_threads());
+  EXPECT_TRUE(TestFetch(kModpagespeedSite, kGoogleLogo));
+  int threads_used = 0;
+  int64 total_fetches = 0;
+  for (int i = 0; i < SerfUrlAsyncFetcher::kMaxFetchThreads; ++i) {
+    int64 fetches = statistics_->GetVariable(
+        SerfStats::LoopFetchCount(i))->Get();
+    if (fetches != 0) {
+      ++threads_used;
+      EXPECT_LT(i, 3);
+      EXPECT_LT(0, statistics_->GetVariable(SerfStats::LoopBusyUs(i))->Get());
+    }
+    total_fetches += fetches;
+  }
+  EXPECT_EQ(1, threads_used);
+  EXPECT_EQ(3 + flaky_retries_, total_fetches);
+  EXPECT_EQ(0, ActiveFetches());
+}
+
+TEST_F(SerfUrlAsyncFetcherTest, FetchThreadsAreCapped) {
+  serf_url_async_fetcher_->set_num_fetch_threads(
+      SerfUrlAsyncFetcher::kMaxFetchThreads + 1);
+  EXPECT_EQ(SerfUrlAsyncFetcher::kMaxFetchThreads,
+            serf_url_async_fetcher_->num_fetch_threads());
+}
+
 class SerfUrlAsyncFetcherTestWithProxy : public SerfUrlAsyncFetcherTest {
  protected:
   virtual void SetUp() {
@@ -16,6 +16,8 @@
 
 #include "pagespeed/system/system_cache_path.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "net/instaweb/rewriter/public/rewrite_driver_factory.h"
 #include "net/instaweb/rewriter/public/rewrite_options.h"
@@ -26,20 +28,44 @@
 #include "pagespeed/kernel/base/callback.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
+#include "pagespeed/kernel/cache/async_file_cache.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
 #include "pagespeed/kernel/cache/file_cache.h"
-#include "pagespeed/kernel/cache/lru_cache.h"
 #include "pagespeed/kernel/cache/purge_context.h"
-#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_lock_manager.h"
 #include "pagespeed/kernel/util/file_system_lock_manager.h"
+#include "pagespeed/kernel/util/io_uring_file_io.h"
+#include "pagespeed/kernel/util/threaded_file_io.h"
 
 namespace net_instaweb {
 
 const char SystemCachePath::kFileCache[] = "file_cache";
 const char SystemCachePath::kLruCache[] = "lru_cache";
 
+namespace {
+
+// Threads used for asynchronous file cache I/O, either on their own or as
+// the fallback for io_uring.
+const int kFileIoThreads = 4;
+
+// Maximum number of io_uring requests in flight at once.
+const int kIoUringQueueDepth = 256;
+
+// Threads that run the callbacks of finished io_uring requests, which may
+// decompress or parse what was read, so the ring thread can keep submitting.
+const int kIoUringCallbackThreads = 2;
+
+// Rough size of a per-process LRU cache entry, used to size the TinyLFU
+// admission sketch from the cache's byte budget.  Metadata entries, which
+// dominate the LRU cache, are typically a few hundred bytes.
+const int64 kAdmissionBytesPerEntry = 512;
+
+}  // namespace
+
 // The SystemCachePath encapsulates a cache-sharing model where a user specifies
 // a file-cache path per virtual-host.  With each file-cache object we keep
 // a locking mechanism and an optional per-process LRUCache.
@@ -52,8 +78,11 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
       shm_runtime_(shm_runtime),
       lock_manager_(NULL),
       file_cache_backend_(NULL),
+      async_file_cache_(NULL),
       lru_cache_(NULL),
       file_cache_(NULL),
+      blocking_file_cache_(NULL),
+      file_cache_async_io_(config->file_cache_async_io()),
       cache_flush_filename_(config->cache_flush_filename()),
       unplugged_(config->unplugged()),
       enable_cache_purge_(config->enable_cache_purge()),
@@ -109,6 +138,7 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
       config->file_cache_clean_interval_ms(),
       config->file_cache_clean_size_kb() * 1024,
       config->file_cache_clean_inode_limit());
+  policy->clean_with_index = config->file_cache_clean_with_index();
   file_cache_backend_ =
       new FileCache(config->file_cache_path(), factory->file_system(),
                     factory->thread_system(), NULL, policy,
@@ -117,30 +147,83 @@ SystemCachePath::SystemCachePath(const StringPiece& path,
   file_cache_ = new CacheStats(kFileCache, file_cache_backend_,
                                factory->timer(), factory->statistics());
   factory->TakeOwnership(file_cache_);
+  blocking_file_cache_ = file_cache_;
+
+  if (file_cache_async_io_ != "off") {
+    if ((file_cache_async_io_ != "threads") &&
+        (file_cache_async_io_ != "io_uring")) {
+      factory->message_handler()->Message(
+          kWarning, "Unknown FileCacheAsyncIo '%s' for file-cache %s, using "
+          "threads", file_cache_async_io_.c_str(), path_.c_str());
+      file_cache_async_io_ = "threads";
+    }
+
+    // The I/O threads can't be started until after we fork, so until
+    // ChildInit this passes everything through to the blocking FileCache.
+    // Both wrappers share the same statistics.
+    async_file_cache_ = new AsyncFileCache(file_cache_backend_, NULL);
+    factory->TakeOwnership(async_file_cache_);
+    file_cache_ = new CacheStats(kFileCache, async_file_cache_,
+                                 factory->timer(), factory->statistics());
+    factory->TakeOwnership(file_cache_);
+  }
 
   if (config->lru_cache_kb_per_process() != 0) {
-    LRUCache* lru_cache = new LRUCache(
-        config->lru_cache_kb_per_process() * 1024);
-    factory->TakeOwnership(lru_cache);
+    ShardedLRUCache::Policy policy = ShardedLRUCache::kLRU;
+    if (!ShardedLRUCache::ParsePolicy(config->lru_cache_policy(), &policy)) {
+      factory->message_handler()->Message(
+          kWarning, "Unknown LRUCachePolicy '%s' for file-cache %s, using lru",
+          config->lru_cache_policy().c_str(), path_.c_str());
+    }
+    int num_shards = std::max(1, config->lru_cache_shards());
 
-    // We only add the threadsafe-wrapper to the LRUCache.  The FileCache
+    // The sharded cache does its own per-shard locking, so unlike the
+    // LRUCache it does not need a ThreadsafeCache wrapper.  The FileCache
     // is naturally thread-safe because it's got no writable member variables.
-    // And surrounding that slower-running class with a mutex would likely
-    // cause contention.
-    ThreadsafeCache* ts_cache =
-        new ThreadsafeCache(lru_cache, factory->thread_system()->NewMutex());
-    factory->TakeOwnership(ts_cache);
+    ShardedLRUCache* lru_cache = new ShardedLRUCache(
+        config->lru_cache_kb_per_process() * 1024, num_shards, policy,
+        factory->thread_system(), factory->statistics());
+    factory->TakeOwnership(lru_cache);
+
+    // Each shard has its own byte budget, so values the LRUCacheByteLimit
+    // lets through may still be too big for the shard they hash to.
+    if (config->lru_cache_byte_limit() >=
+        static_cast<int64>(lru_cache->max_bytes_per_shard())) {
+      factory->message_handler()->Message(
+          kWarning, "LRUCacheByteLimit %s for file-cache %s is not less "
+          "than the %s bytes in each of its %d LRU cache shards; larger "
+          "values will not be cached in memory.  Raise LRUCacheKbPerProcess "
+          "or lower LRUCacheShards.",
+          Integer64ToString(config->lru_cache_byte_limit()).c_str(),
+          path_.c_str(),
+          Integer64ToString(
+              static_cast<int64>(lru_cache->max_bytes_per_shard())).c_str(),
+          num_shards);
+    }
 #if CACHE_STATISTICS
-    lru_cache_ = new CacheStats(kLruCache, ts_cache, factory->timer(),
+    lru_cache_ = new CacheStats(kLruCache, lru_cache, factory->timer(),
                                 factory->statistics());
     factory->TakeOwnership(lru_cache_);
 #else
-    lru_cache_ = ts_cache;
+    lru_cache_ = lru_cache;
 #endif
+
+    if (config->cache_admission_filter()) {
+      int64 expected_entries = std::min(
+          static_cast<int64>(kint32max),
+          config->lru_cache_kb_per_process() * 1024 / kAdmissionBytesPerEntry);
+      TinyLFU* tiny_lfu = new TinyLFU(static_cast<int>(expected_entries),
+                                      factory->thread_system());
+      factory->TakeOwnership(tiny_lfu);
+      lru_cache_ = new AdmissionFilteredCache(kLruCache, lru_cache_, tiny_lfu,
+                                              factory->statistics());
+      factory->TakeOwnership(lru_cache_);
+    }
   }
 }
 
 SystemCachePath::~SystemCachePath() {
+  ShutDown();
 }
 
 // static
@@ -178,6 +261,13 @@ void SystemCachePath::MergeConfig(const SystemRewriteOptions* config) {
                true, "InodeLimit",
                &policy->target_inode_count,
                &clean_inode_limit_explicitly_set_);
+
+  // The index is a property of the cache directory, not of any one vhost,
+  // so keep it up to date if anyone sharing the directory asks for it.
+  policy->clean_with_index |= config->file_cache_clean_with_index();
+
+  // Like the LRU cache settings, FileCacheAsyncIo is taken from whichever
+  // configuration created this object.
 }
 
 void SystemCachePath::MergeEntries(int64 config_value, bool config_was_set,
@@ -235,6 +325,9 @@ void SystemCachePath::ChildInit(SlowWorker* cache_clean_worker) {
   if (file_cache_backend_ != NULL) {
     file_cache_backend_->set_worker(cache_clean_worker);
   }
+  if (async_file_cache_ != NULL) {
+    StartFileCacheIo();
+  }
 
   purge_context_.reset(new PurgeContext(cache_flush_filename_,
                                         factory_->file_system(),
@@ -257,6 +350,42 @@ void SystemCachePath::GlobalCleanup(MessageHandler* handler) {
   }
 }
 
+void SystemCachePath::StartFileCacheIo() {
+  threaded_file_io_.reset(new ThreadedFileIo(
+      kFileIoThreads, factory_->file_system(), factory_->thread_system(),
+      factory_->message_handler()));
+  if (file_cache_async_io_ == "io_uring") {
+    // io_uring bypasses the FileSystem, and falls back to the threads for
+    // anything it can't handle itself.
+    io_uring_file_io_.reset(IoUringFileIo::Create(
+        kIoUringQueueDepth, kIoUringCallbackThreads, threaded_file_io_.get(),
+        factory_->thread_system(), factory_->message_handler()));
+    if (io_uring_file_io_.get() == NULL) {
+      factory_->message_handler()->Message(
+          kWarning, "io_uring is not available for file-cache %s, using "
+          "threads", path_.c_str());
+    }
+  }
+  if (io_uring_file_io_.get() != NULL) {
+    async_file_cache_->set_io(io_uring_file_io_.get());
+  } else {
+    async_file_cache_->set_io(threaded_file_io_.get());
+  }
+}
+
+void SystemCachePath::ShutDown() {
+  if (async_file_cache_ != NULL) {
+    async_file_cache_->ShutDown();
+  }
+  // io_uring may hand requests to the threads, so stop it first.
+  if (io_uring_file_io_.get() != NULL) {
+    io_uring_file_io_->ShutDown();
+  }
+  if (threaded_file_io_.get() != NULL) {
+    threaded_file_io_->ShutDown();
+  }
+}
+
 void SystemCachePath::FallBackToFileBasedLocking() {
   if ((shared_mem_lock_manager_.get() != NULL) || (lock_manager_ == NULL)) {
     shared_mem_lock_manager_.reset(NULL);
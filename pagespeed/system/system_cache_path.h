@@ -30,9 +30,11 @@ namespace net_instaweb {
 
 class AbstractMutex;
 class AbstractSharedMem;
+class AsyncFileCache;
 class CacheInterface;
 class FileCache;
 class FileSystemLockManager;
+class IoUringFileIo;
 class MessageHandler;
 class NamedLockManager;
 class PurgeContext;
@@ -42,6 +44,7 @@ class SharedMemLockManager;
 class SlowWorker;
 class SystemServerContext;
 class SystemRewriteOptions;
+class ThreadedFileIo;
 
 // The SystemCachePath encapsulates a cache-sharing model where a user specifies
 // a file-cache path per virtual-host.  With each file-cache object we keep
@@ -65,9 +68,15 @@ class SystemCachePath {
   // Per-process in-memory LRU, with any stats/thread safety wrappers, or NULL.
   CacheInterface* lru_cache() { return lru_cache_; }
 
-  // Per-machine file cache with any stats wrappers.
+  // Per-machine file cache with any stats wrappers.  This is non-blocking if
+  // FileCacheAsyncIo is enabled.
   CacheInterface* file_cache() { return file_cache_; }
 
+  // The same file cache, but always blocking, for users such as the property
+  // store that require that.  Equal to file_cache() unless FileCacheAsyncIo
+  // is enabled.
+  CacheInterface* blocking_file_cache() { return blocking_file_cache_; }
+
   // Access to backend for testing.  Do not use this directly in production
   // as it lacks statistics wrappers, etc.
   FileCache* file_cache_backend() { return file_cache_backend_; }
@@ -78,6 +87,10 @@ class SystemCachePath {
   void ChildInit(SlowWorker* cache_clean_worker);
   void GlobalCleanup(MessageHandler* handler);  // only called in root process
 
+  // Stops any asynchronous file I/O, waiting for operations in flight to
+  // complete.  Only needed in child processes.
+  void ShutDown();
+
   // When there are multiple configurations which specify the same cache
   // path, we must merge the other settings: the cleaning interval, size, and
   // inode count.
@@ -104,6 +117,9 @@ class SystemCachePath {
   void FallBackToFileBasedLocking();
   GoogleString LockManagerSegmentName() const;
 
+  // Starts the I/O backend selected by file_cache_async_io_.
+  void StartFileCacheIo();
+
   // Merge a value taken from a config file against the value already
   // initialized in a cache policy, reporting a Warning if they were
   // explicitly set and have conflicting values.  Whenever one of the
@@ -136,8 +152,13 @@ class SystemCachePath {
   scoped_ptr<FileSystemLockManager> file_system_lock_manager_;
   NamedLockManager* lock_manager_;
   FileCache* file_cache_backend_;  // owned by file_cache_
+  AsyncFileCache* async_file_cache_;  // NULL unless FileCacheAsyncIo is set.
   CacheInterface* lru_cache_;
   CacheInterface* file_cache_;
+  CacheInterface* blocking_file_cache_;
+  GoogleString file_cache_async_io_;
+  scoped_ptr<ThreadedFileIo> threaded_file_io_;
+  scoped_ptr<IoUringFileIo> io_uring_file_io_;
   GoogleString cache_flush_filename_;
   bool unplugged_;
   bool enable_cache_purge_;
@@ -33,21 +33,27 @@
 #include "pagespeed/system/system_server_context.h"
 #include "net/instaweb/util/public/property_cache.h"
 #include "pagespeed/kernel/base/abstract_shared_mem.h"
+#include "pagespeed/kernel/base/file_system.h"
 #include "pagespeed/kernel/base/md5_hasher.h"
 #include "pagespeed/kernel/base/message_handler.h"
 #include "pagespeed/kernel/base/statistics.h"
 #include "pagespeed/kernel/base/string.h"
 #include "pagespeed/kernel/base/string_writer.h"
 #include "pagespeed/kernel/base/thread_system.h"
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
 #include "pagespeed/kernel/cache/async_cache.h"
 #include "pagespeed/kernel/cache/cache_batcher.h"
+#include "pagespeed/kernel/cache/cache_codec.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
 #include "pagespeed/kernel/cache/compressed_cache.h"
 #include "pagespeed/kernel/cache/fallback_cache.h"
 #include "pagespeed/kernel/cache/file_cache.h"
 #include "pagespeed/kernel/cache/purge_context.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
+#include "pagespeed/kernel/cache/tiny_lfu.h"
 #include "pagespeed/kernel/cache/write_through_cache.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_tiny_lfu.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
 #include "pagespeed/kernel/thread/slow_worker.h"
 
@@ -87,6 +93,12 @@ void SystemCaches::ShutDown(MessageHandler* message_handler) {
   // to access FileCache and similar objects we're about to blow away.
   if (!is_root_process_) {
     slow_worker_->ShutDown();
+
+    // Likewise wait for any asynchronous file cache reads and writes.
+    for (PathCacheMap::iterator p = path_cache_map_.begin(),
+             e = path_cache_map_.end(); p != e; ++p) {
+      p->second->ShutDown();
+    }
   }
 
   // Take down any memcached threads.  Note that this may block
@@ -111,8 +123,15 @@ void SystemCaches::ShutDown(MessageHandler* message_handler) {
     for (MetadataShmCacheMap::iterator p = metadata_shm_caches_.begin(),
              e = metadata_shm_caches_.end(); p != e; ++p) {
       if (p->second->cache_backend != NULL && p->second->initialized) {
+        if (!p->second->snapshot_path.empty()) {
+          p->second->cache_backend->SaveSnapshotFile(
+              p->second->snapshot_path, factory_->file_system());
+        }
         MetadataShmCache::GlobalCleanup(shared_mem_runtime_, p->second->segment,
                                         message_handler);
+        if (p->second->tiny_lfu != NULL) {
+          p->second->tiny_lfu->GlobalCleanup(message_handler);
+        }
       }
     }
   }
@@ -243,6 +262,15 @@ bool SystemCaches::CreateShmMetadataCache(
       cache_info = new MetadataShmCacheInfo;
       factory_->TakeOwnership(cache_info);
       cache_info->segment = StrCat(name, "/metadata_cache");
+      if (name != kDefaultSharedMemoryPath) {
+        // Explicitly configured caches are named for their file cache path,
+        // and don't write through to it, so keep their contents across
+        // restarts there.
+        cache_info->snapshot_path = name.as_string();
+        EnsureEndsInSlash(&cache_info->snapshot_path);
+        StrAppend(&cache_info->snapshot_path, FileCache::kShmSnapshotName);
+      }
+      cache_info->num_entries = entries * kSectors;
       cache_info->cache_backend =
           new SharedMemCache<64>(
               shared_mem_runtime_,
@@ -344,10 +372,14 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   SystemCachePath* caches_for_path = GetCache(config);
   CacheInterface* lru_cache = caches_for_path->lru_cache();
   CacheInterface* file_cache = caches_for_path->file_cache();
+  CacheInterface* blocking_file_cache = caches_for_path->blocking_file_cache();
   MetadataShmCacheInfo* shm_metadata_cache_info =
       GetShmMetadataCacheOrDefault(config);
   CacheInterface* shm_metadata_cache = (shm_metadata_cache_info != NULL) ?
       shm_metadata_cache_info->cache_to_use : NULL;
+  if ((shm_metadata_cache != NULL) && config->cache_admission_filter()) {
+    shm_metadata_cache = AdmissionFilteredShmCache(shm_metadata_cache_info);
+  }
   MemcachedInterfaces memcached = GetMemcached(config);
   CacheInterface* property_store_cache = NULL;
   CacheInterface* http_l2 = file_cache;
@@ -369,7 +401,8 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
     http_l2 = memcached.async;
     server_context->DeleteCacheOnDestruction(memcached.async);
 
-    memcached.blocking = new FallbackCache(memcached.blocking, file_cache,
+    memcached.blocking = new FallbackCache(memcached.blocking,
+                                           blocking_file_cache,
                                            AprMemCache::kValueSizeThreshold,
                                            factory_->message_handler());
     server_context->DeleteCacheOnDestruction(memcached.blocking);
@@ -413,6 +446,11 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   // metadata_l2, with metadata_l1 set to NULL.
   CacheInterface* metadata_l1 = NULL;
   CacheInterface* metadata_l2 = NULL;
+
+  // The property store needs a blocking cache, so if the file cache is
+  // asynchronous, track an equivalent of metadata_l2 that uses the blocking
+  // view of it instead.
+  CacheInterface* blocking_metadata_l2 = NULL;
   size_t l1_size_limit = WriteThroughCache::kUnlimited;
   if (shm_metadata_cache != NULL) {
     if (memcached.async != NULL) {
@@ -450,12 +488,12 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
       // which would remove the need to write through to the file cache.
       MetadataShmCacheInfo* default_cache_info =
           LookupShmMetadataCache(kDefaultSharedMemoryPath);
-      if (default_cache_info != NULL &&
-          shm_metadata_cache == default_cache_info->cache_to_use) {
+      if (shm_metadata_cache_info == default_cache_info) {
         // They're running the SHM cache because it's the default.  Go L1/L2 to
         // be conservative.
         metadata_l1 = shm_metadata_cache;
         metadata_l2 = file_cache;
+        blocking_metadata_l2 = blocking_file_cache;
       } else {
         // They've explicitly configured an SHM cache; the file cache will only
         // be used as a fallback for very large objects.
@@ -469,6 +507,16 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
         metadata_fallback->set_account_for_key_size(false);
         server_context->DeleteCacheOnDestruction(metadata_fallback);
         metadata_l2 = metadata_fallback;
+        if (blocking_file_cache != file_cache) {
+          FallbackCache* blocking_fallback =
+              new FallbackCache(
+                  shm_metadata_cache, blocking_file_cache,
+                  shm_metadata_cache_info->cache_backend->MaxValueSize(),
+                  factory_->message_handler());
+          blocking_fallback->set_account_for_key_size(false);
+          server_context->DeleteCacheOnDestruction(blocking_fallback);
+          blocking_metadata_l2 = blocking_fallback;
+        }
 
         // TODO(jmarantz): do we really want to use the shm-cache as a
         // pcache?  The potential for inconsistent data across a
@@ -479,6 +527,9 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
     l1_size_limit = config->lru_cache_byte_limit();
     metadata_l1 = lru_cache;  // may be NULL
     metadata_l2 = http_l2;  // memcached.async or file.
+    if (metadata_l2 == file_cache) {
+      blocking_metadata_l2 = blocking_file_cache;
+    }
   }
 
   CacheInterface* metadata_cache;
@@ -498,12 +549,14 @@ void SystemCaches::SetupCaches(ServerContext* server_context,
   // only the content compressed and putting in content-encoding:gzip
   // so that mod_gzip doesn't have to recompress on every request.
   if (property_store_cache == NULL) {
-    property_store_cache = metadata_l2;
+    property_store_cache = (blocking_metadata_l2 != NULL) ?
+        blocking_metadata_l2 : metadata_l2;
   }
   if (config->compress_metadata_cache()) {
-    metadata_cache = new CompressedCache(metadata_cache, stats);
+    metadata_cache = NewCompressedCache(metadata_cache, config, stats);
     server_context->DeleteCacheOnDestruction(metadata_cache);
-    property_store_cache = new CompressedCache(property_store_cache, stats);
+    property_store_cache = NewCompressedCache(property_store_cache, config,
+                                              stats);
     server_context->DeleteCacheOnDestruction(property_store_cache);
   }
   DCHECK(property_store_cache->IsBlocking());
@@ -524,7 +577,55 @@ void SystemCaches::RegisterConfig(SystemRewriteOptions* config) {
 
   // GetShmMetadataCacheOrDefault will create a default cache if one is needed
   // and doesn't exist yet.
-  GetShmMetadataCacheOrDefault(config);
+  MetadataShmCacheInfo* cache_info = GetShmMetadataCacheOrDefault(config);
+
+  // The admission filter's sketch has to be in shared memory before we fork,
+  // so set it up here rather than in SetupCaches.
+  if ((cache_info != NULL) && config->cache_admission_filter() &&
+      (cache_info->tiny_lfu == NULL)) {
+    cache_info->tiny_lfu = new SharedMemTinyLFU(
+        shared_mem_runtime_, StrCat(cache_info->segment, "/"), "admission",
+        cache_info->num_entries);
+    factory_->TakeOwnership(cache_info->tiny_lfu);
+  }
+}
+
+CacheInterface* SystemCaches::AdmissionFilteredShmCache(
+    MetadataShmCacheInfo* cache_info) {
+  if (cache_info->admission_filtered == NULL) {
+    FrequencySketch* sketch = cache_info->tiny_lfu;
+    if (sketch == NULL) {
+      TinyLFU* tiny_lfu = new TinyLFU(cache_info->num_entries,
+                                      factory_->thread_system());
+      factory_->TakeOwnership(tiny_lfu);
+      sketch = tiny_lfu;
+    }
+    cache_info->admission_filtered = new AdmissionFilteredCache(
+        kShmCache, cache_info->cache_to_use, sketch, factory_->statistics());
+    factory_->TakeOwnership(cache_info->admission_filtered);
+  }
+  return cache_info->admission_filtered;
+}
+
+CacheInterface* SystemCaches::NewCompressedCache(
+    CacheInterface* cache, SystemRewriteOptions* config, Statistics* stats) {
+  CompressedCache* compressed_cache = new CompressedCache(cache, stats);
+  int level = config->compress_metadata_cache_level();
+  const GoogleString& dictionary_file =
+      config->compress_metadata_cache_dictionary();
+  GoogleString dictionary;
+  if (!dictionary_file.empty() &&
+      !factory_->file_system()->ReadFile(dictionary_file.c_str(), &dictionary,
+                                         factory_->message_handler())) {
+    factory_->message_handler()->Message(
+        kWarning, "Unable to read cache compression dictionary %s; "
+        "compressing without one", dictionary_file.c_str());
+  }
+  // Leave the CompressedCache's own default alone unless asked not to.
+  if ((level != -1) || !dictionary.empty()) {
+    compressed_cache->set_codec(new DeflateCacheCodec(level, dictionary));
+  }
+  return compressed_cache;
 }
 
 void SystemCaches::RootInit() {
@@ -533,16 +634,29 @@ void SystemCaches::RootInit() {
     MetadataShmCacheInfo* cache_info = p->second;
     if (cache_info->cache_backend->Initialize()) {
       cache_info->initialized = true;
+      if (!cache_info->snapshot_path.empty()) {
+        cache_info->cache_backend->RestoreSnapshotFile(
+            cache_info->snapshot_path, factory_->file_system());
+      }
       cache_info->cache_to_use =
           new CacheStats(kShmCache, cache_info->cache_backend,
                          factory_->timer(), factory_->statistics());
       factory_->TakeOwnership(cache_info->cache_to_use);
+      if ((cache_info->tiny_lfu != NULL) &&
+          !cache_info->tiny_lfu->InitSegment(true,
+                                             factory_->message_handler())) {
+        factory_->message_handler()->Message(
+            kWarning, "Unable to initialize shared admission filter for "
+            "shared memory cache: %s.", p->first.c_str());
+        cache_info->tiny_lfu = NULL;
+      }
     } else {
       factory_->message_handler()->Message(
           kWarning, "Unable to initialize shared memory cache: %s.",
           p->first.c_str());
       cache_info->cache_backend = NULL;
       cache_info->cache_to_use = NULL;
+      cache_info->tiny_lfu = NULL;
     }
   }
 
@@ -570,6 +684,14 @@ void SystemCaches::ChildInit() {
       cache_info->cache_backend = NULL;
       cache_info->cache_to_use = NULL;
     }
+    if ((cache_info->tiny_lfu != NULL) &&
+        !cache_info->tiny_lfu->InitSegment(false,
+                                           factory_->message_handler())) {
+      factory_->message_handler()->Message(
+          kWarning, "Unable to attach to shared admission filter for "
+          "shared memory cache: %s.", p->first.c_str());
+      cache_info->tiny_lfu = NULL;
+    }
   }
 
   for (PathCacheMap::iterator p = path_cache_map_.begin(),
@@ -614,7 +736,10 @@ void SystemCaches::InitStats(Statistics* statistics) {
   FileCache::InitStats(statistics);
   CacheStats::InitStats(SystemCachePath::kFileCache, statistics);
   CacheStats::InitStats(SystemCachePath::kLruCache, statistics);
+  ShardedLRUCache::InitStats(statistics);
   CacheStats::InitStats(kShmCache, statistics);
+  AdmissionFilteredCache::InitStats(SystemCachePath::kLruCache, statistics);
+  AdmissionFilteredCache::InitStats(kShmCache, statistics);
   CacheStats::InitStats(kMemcachedAsync, statistics);
   CacheStats::InitStats(kMemcachedBlocking, statistics);
   CompressedCache::InitStats(statistics);
@@ -38,6 +38,7 @@ class NamedLockManager;
 class QueuedWorkerPool;
 class RewriteDriverFactory;
 class ServerContext;
+class SharedMemTinyLFU;
 class SlowWorker;
 class Statistics;
 class SystemCachePath;
@@ -139,12 +140,26 @@ class SystemCaches {
   typedef SharedMemCache<64> MetadataShmCache;
   struct MetadataShmCacheInfo {
     MetadataShmCacheInfo()
-        : cache_to_use(NULL), cache_backend(NULL), initialized(false) {}
+        : cache_to_use(NULL), admission_filtered(NULL), tiny_lfu(NULL),
+          cache_backend(NULL), num_entries(0), initialized(false) {}
 
     // Note that the fields may be NULL if e.g. initialization failed.
     CacheInterface* cache_to_use;  // may be CacheStats or such.
+    // cache_to_use behind a TinyLFU admission filter, created on demand
+    // for the first server context that enables CacheAdmissionFilter.
+    CacheInterface* admission_filtered;
+    // The frequency sketch behind admission_filtered, in shared memory so
+    // that every process admits entries by the cache's whole history.
+    // Created by RegisterConfig when a config using this cache enables
+    // CacheAdmissionFilter; NULL otherwise, or if its segment couldn't be
+    // set up, in which case each process falls back to a TinyLFU of its own.
+    SharedMemTinyLFU* tiny_lfu;
     GoogleString segment;
+    // Where the cache is saved at shutdown and restored from at startup;
+    // empty for the default cache, which writes through to a file cache.
+    GoogleString snapshot_path;
     MetadataShmCache* cache_backend;
+    int num_entries;  // Across all sectors.
     bool initialized;  // This is needed since in some scenarios we may
                        // not end up as far as calling ->Initialize() before
                        // we get shutdown.
@@ -181,6 +196,19 @@ class SystemCaches {
   MetadataShmCacheInfo* GetShmMetadataCacheOrDefault(
       SystemRewriteOptions* config);
 
+  // Returns cache_info->cache_to_use wrapped in a TinyLFU admission
+  // filter, creating the wrapper if necessary.  All server contexts that
+  // use the same shared memory cache share one filter, whose frequency
+  // sketch is cache_info->tiny_lfu, shared by all processes, when that
+  // could be set up.
+  CacheInterface* AdmissionFilteredShmCache(MetadataShmCacheInfo* cache_info);
+
+  // Wraps cache in a CompressedCache using the codec configured by
+  // CompressMetadataCacheLevel and CompressMetadataCacheDictionary.
+  CacheInterface* NewCompressedCache(CacheInterface* cache,
+                                     SystemRewriteOptions* config,
+                                     Statistics* stats);
+
   // Establishes common cohorts for the property cache.
   void SetupPcacheCohorts(ServerContext* server_context,
                           bool enable_property_cache);
@@ -54,16 +54,17 @@
 #include "pagespeed/kernel/base/stl_util.h"
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/admission_filtered_cache.h"
 #include "pagespeed/kernel/cache/async_cache.h"
 #include "pagespeed/kernel/cache/cache_batcher.h"
+#include "pagespeed/kernel/cache/cache_codec.h"
 #include "pagespeed/kernel/cache/cache_interface.h"
 #include "pagespeed/kernel/cache/cache_spammer.h"
 #include "pagespeed/kernel/cache/cache_stats.h"
 #include "pagespeed/kernel/cache/compressed_cache.h"
 #include "pagespeed/kernel/cache/fallback_cache.h"
 #include "pagespeed/kernel/cache/file_cache.h"
-#include "pagespeed/kernel/cache/lru_cache.h"
-#include "pagespeed/kernel/cache/threadsafe_cache.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
 #include "pagespeed/kernel/cache/write_through_cache.h"
 #include "pagespeed/kernel/http/content_type.h"
 #include "pagespeed/kernel/http/request_headers.h"
@@ -392,12 +393,17 @@ class SystemCachesTest : public CustomRewriteTestBase<SystemRewriteOptions> {
     return CacheStats::FormatName(prefix, cache);
   }
 
-  GoogleString ThreadsafeLRU() {
-    return ThreadsafeCache::FormatName(LRUCache::FormatName());
+  GoogleString InProcessLRU() {
+    return ShardedLRUCache::FormatName(ShardedLRUCache::kLRU,
+                                       ShardedLRUCache::kDefaultNumShards);
   }
 
   GoogleString FileCacheName() { return FileCache::FormatName(); }
 
+  GoogleString Admission(StringPiece cache) {
+    return AdmissionFilteredCache::FormatName(cache);
+  }
+
   GoogleString AsyncMemCacheWithStats() {
     return Stats(SystemCaches::kMemcachedAsync,
                  AsyncCache::FormatName(AprMemCache::FormatName()));
@@ -476,18 +482,59 @@ TEST_F(SystemCachesTest, BasicFileAndLruCache) {
 
   scoped_ptr<ServerContext> server_context(
       SetupServerContext(options_.release()));
-  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", ThreadsafeLRU()),
+  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", InProcessLRU()),
                                        FileCacheWithStats())),
                server_context->metadata_cache()->Name());
   EXPECT_STREQ(
       HttpCache(
           WriteThrough(
-              Stats("lru_cache", ThreadsafeLRU()),
+              Stats("lru_cache", InProcessLRU()),
               FileCacheWithStats())),
       server_context->http_cache()->Name());
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
 }
 
+TEST_F(SystemCachesTest, AdmissionFilteredFileAndLruCache) {
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(100);
+  options_->set_default_shared_memory_cache_kb(0);
+  options_->set_cache_admission_filter(true);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  EXPECT_STREQ(
+      Compressed(WriteThrough(Admission(Stats("lru_cache", InProcessLRU())),
+                              FileCacheWithStats())),
+      server_context->metadata_cache()->Name());
+  EXPECT_STREQ(
+      HttpCache(
+          WriteThrough(
+              Admission(Stats("lru_cache", InProcessLRU())),
+              FileCacheWithStats())),
+      server_context->http_cache()->Name());
+}
+
+TEST_F(SystemCachesTest, AdmissionFilteredShmCache) {
+  GoogleString error_msg;
+  EXPECT_TRUE(system_caches_->CreateShmMetadataCache(
+      kCachePath, kUsableMetadataCacheSize, &error_msg));
+
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(0);
+  options_->set_cache_admission_filter(true);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  EXPECT_STREQ(
+      Compressed(Fallback(Admission(Stats("shm_cache", "SharedMemCache<64>")),
+                          FileCacheWithStats())),
+      server_context->metadata_cache()->Name());
+}
+
 TEST_F(SystemCachesTest, BasicFileOnlyCache) {
   options_->set_file_cache_path(kCachePath);
   options_->set_use_shared_mem_locking(false);
@@ -504,6 +551,39 @@ TEST_F(SystemCachesTest, BasicFileOnlyCache) {
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
 }
 
+TEST_F(SystemCachesTest, CompressWithDictionary) {
+  const char kDictionaryFile[] = "/mem/dictionary";
+  GoogleString value;
+  for (int i = 0; i < 10; ++i) {
+    StrAppend(&value, "http://example.com/", IntegerToString(i), ".css");
+  }
+  ASSERT_TRUE(file_system()->WriteFile(kDictionaryFile, value,
+                                       message_handler()));
+  options_->set_file_cache_path(kCachePath);
+  options_->set_use_shared_mem_locking(false);
+  options_->set_lru_cache_kb_per_process(0);
+  options_->set_default_shared_memory_cache_kb(0);
+  options_->set_compress_metadata_cache_level(9);
+  options_->set_compress_metadata_cache_dictionary(kDictionaryFile);
+  PrepareWithConfig(options_.get());
+
+  scoped_ptr<ServerContext> server_context(
+      SetupServerContext(options_.release()));
+  CacheInterface* cache = server_context->metadata_cache();
+  EXPECT_STREQ(Compressed(FileCacheWithStats()), cache->Name());
+  TestPut(cache, "key", value);
+  TestGet(cache, "key", CacheInterface::kAvailable, value);
+
+  // The file cache holds the value compressed with the dictionary.
+  BlockingCallback callback(thread_system_.get());
+  cache->Backend()->Get("key", &callback);
+  callback.Block();
+  ASSERT_EQ(CacheInterface::kAvailable, callback.result());
+  ASSERT_FALSE(callback.value().empty());
+  EXPECT_EQ(DeflateCacheCodec::kDictionaryId, callback.value()[0]);
+  EXPECT_GT(value.size(), callback.value().size());
+}
+
 TEST_F(SystemCachesTest, UnusableShmAndLru) {
   // Test that we properly fallback when we can't create the shm cache
   // due to too small a size given.
@@ -520,12 +600,12 @@ TEST_F(SystemCachesTest, UnusableShmAndLru) {
 
   scoped_ptr<ServerContext> server_context(
       SetupServerContext(options_.release()));
-  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", ThreadsafeLRU()),
+  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", InProcessLRU()),
                                        FileCacheWithStats())),
                server_context->metadata_cache()->Name());
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           FileCacheWithStats())),
       server_context->http_cache()->Name());
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
@@ -549,7 +629,7 @@ TEST_F(SystemCachesTest, BasicShmAndLru) {
                server_context->metadata_cache()->Name());
   // HTTP cache is unaffected.
   EXPECT_STREQ(
-      HttpCache(WriteThrough(Stats("lru_cache", ThreadsafeLRU()),
+      HttpCache(WriteThrough(Stats("lru_cache", InProcessLRU()),
                              FileCacheWithStats())),
       server_context->http_cache()->Name());
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
@@ -605,7 +685,7 @@ TEST_F(SystemCachesTest, DoubleShmCreate) {
   // HTTP cache is unaffected.
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           FileCacheWithStats())),
       server_context->http_cache()->Name());
   EXPECT_TRUE(server_context->filesystem_metadata_cache() == NULL);
@@ -626,13 +706,13 @@ TEST_F(SystemCachesTest, BasicMemCachedAndLru) {
   scoped_ptr<ServerContext> server_context(
       SetupServerContext(options_.release()));
   EXPECT_STREQ(Compressed(
-      WriteThrough(Stats("lru_cache", ThreadsafeLRU()),
+      WriteThrough(Stats("lru_cache", InProcessLRU()),
                    Fallback(Batcher(AsyncMemCacheWithStats(), 1, 1000),
                             FileCacheWithStats()))),
                server_context->metadata_cache()->Name());
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           Fallback(Batcher(AsyncMemCacheWithStats(), 1, 1000),
                            FileCacheWithStats()))),
       server_context->http_cache()->Name());
@@ -681,7 +761,7 @@ TEST_F(SystemCachesTest, BasicMemCachedLruShm) {
       server_context->metadata_cache()->Name());
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           Fallback(Batcher(AsyncMemCacheWithStats(), 1, 1000),
                              FileCacheWithStats()))),
       server_context->http_cache()->Name());
@@ -993,10 +1073,12 @@ TEST_F(SystemCachesTest, LruCacheSettings) {
   ASSERT_TRUE(write_through != NULL);
   EXPECT_EQ(500, write_through->cache1_limit());
 
-  LRUCache* lru_cache = dynamic_cast<LRUCache*>(
+  ShardedLRUCache* lru_cache = dynamic_cast<ShardedLRUCache*>(
       SkipWrappers(write_through->cache1()));
   ASSERT_TRUE(lru_cache != NULL);
   EXPECT_EQ(1024*1024, lru_cache->max_bytes_in_cache());
+  EXPECT_EQ(ShardedLRUCache::kDefaultNumShards, lru_cache->num_shards());
+  EXPECT_EQ(ShardedLRUCache::kLRU, lru_cache->policy());
 
   // Also on the HTTP cache
   WriteThroughCache* http_write_through =
@@ -1265,13 +1347,13 @@ TEST_F(BrokenShmSystemCachesTest, FallbackShmAndLru) {
   scoped_ptr<ServerContext> server_context(
       SetupServerContext(options_.release()));
   // We don't use the LRU when shm cache is on.
-  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", ThreadsafeLRU()),
+  EXPECT_STREQ(Compressed(WriteThrough(Stats("lru_cache", InProcessLRU()),
                                        FileCacheWithStats())),
                server_context->metadata_cache()->Name());
   // HTTP cache is unaffected.
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           FileCacheWithStats())),
       server_context->http_cache()->Name());
 }
@@ -1317,13 +1399,13 @@ TEST_F(BrokenShmSystemCachesTest, FallbackMemCachedLruShm) {
   EXPECT_STREQ(
       Compressed(
           WriteThrough(
-              Stats("lru_cache", ThreadsafeLRU()),
+              Stats("lru_cache", InProcessLRU()),
               Fallback(Batcher(AsyncMemCacheWithStats(), 1, 1000),
                        FileCacheWithStats()))),
       server_context->metadata_cache()->Name());
   EXPECT_STREQ(
       HttpCache(WriteThrough(
-          Stats("lru_cache", ThreadsafeLRU()),
+          Stats("lru_cache", InProcessLRU()),
           Fallback(Batcher(AsyncMemCacheWithStats(), 1, 1000),
                    FileCacheWithStats()))),
       server_context->http_cache()->Name());
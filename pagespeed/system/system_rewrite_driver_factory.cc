@@ -16,7 +16,7 @@
 
 #include "pagespeed/system/system_rewrite_driver_factory.h"
 
-#include <algorithm>  // for min
+#include <algorithm>  // for min, max
 #include <cstdlib>
 #include <map>
 #include <set>
@@ -55,6 +55,7 @@
 #include "pagespeed/kernel/base/thread_system.h"
 #include "pagespeed/kernel/base/timer.h"
 #include "pagespeed/kernel/sharedmem/shared_circular_buffer.h"
+#include "pagespeed/kernel/sharedmem/shared_mem_origin_health.h"
 #include "pagespeed/kernel/sharedmem/shared_mem_statistics.h"
 #include "pagespeed/kernel/thread/pthread_shared_mem.h"
 #include "pagespeed/kernel/thread/queued_worker_pool.h"
@@ -74,6 +75,10 @@ const char kUsePerVHostStatistics[] = "UsePerVHostStatistics";
 const char kInstallCrashHandler[] = "InstallCrashHandler";
 const char kNumRewriteThreads[] = "NumRewriteThreads";
 const char kNumExpensiveRewriteThreads[] = "NumExpensiveRewriteThreads";
+const char kWorkStealingRewriteThreads[] = "WorkStealingRewriteThreads";
+const char kExpensiveRewriteQueueDelayTargetMs[] =
+    "ExpensiveRewriteQueueDelayTargetMs";
+const char kMaxCustomRewriteDriverPools[] = "MaxCustomRewriteDriverPools";
 const char kForceCaching[] = "ForceCaching";
 const char kListOutstandingUrlsOnError[] = "ListOutstandingUrlsOnError";
 const char kMessageBufferSize[] = "MessageBufferSize";
@@ -251,6 +256,7 @@ void SystemRewriteDriverFactory::RootInit() {
   }
 
   caches_->RootInit();
+  OriginHealthInit(true);
 }
 
 void SystemRewriteDriverFactory::ChildInit() {
@@ -266,6 +272,7 @@ void SystemRewriteDriverFactory::ChildInit() {
   }
 
   caches_->ChildInit();
+  OriginHealthInit(false);
 
   // Static asset config is process-global.
   const SystemRewriteOptions* conf =
@@ -308,6 +315,31 @@ void SystemRewriteDriverFactory::SharedCircularBufferInit(bool is_root) {
   }
 }
 
+void SystemRewriteDriverFactory::OriginHealthInit(bool is_root) {
+  bool track_origin_health = false;
+  for (SystemServerContextSet::iterator
+           p = uninitialized_server_contexts_.begin(),
+           e = uninitialized_server_contexts_.end(); p != e; ++p) {
+    SystemServerContext* server_context = *p;
+    if (server_context->global_system_rewrite_options()->
+        track_origin_health()) {
+      track_origin_health = true;
+    }
+  }
+  // Without real shared memory, there are no other processes to share with.
+  if (!track_origin_health || shared_mem_runtime()->IsDummy()) {
+    return;
+  }
+  origin_health_.reset(new SharedMemOriginHealth(
+      shared_mem_runtime(), filename_prefix().as_string(),
+      hostname_identifier(), timer(), hasher()));
+  if (!origin_health_->InitSegment(is_root, message_handler())) {
+    message_handler()->Message(
+        kWarning, "Unable to set up shared origin health tracking");
+    origin_health_.reset(NULL);
+  }
+}
+
 RewriteOptions::OptionSettingResult
 SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
                                                StringPiece arg,
@@ -319,7 +351,10 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
       StringCaseEqual(option, kUsePerVHostStatistics) ||
       StringCaseEqual(option, kInstallCrashHandler) ||
       StringCaseEqual(option, kNumRewriteThreads) ||
-      StringCaseEqual(option, kNumExpensiveRewriteThreads)) {
+      StringCaseEqual(option, kNumExpensiveRewriteThreads) ||
+      StringCaseEqual(option, kWorkStealingRewriteThreads) ||
+      StringCaseEqual(option, kExpensiveRewriteQueueDelayTargetMs) ||
+      StringCaseEqual(option, kMaxCustomRewriteDriverPools)) {
     if (!process_scope) {
       *msg = StrCat("'", option, "' is global and can't be set at this scope.");
       return RewriteOptions::kOptionValueInvalid;
@@ -361,6 +396,9 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kInstallCrashHandler)) {
     set_install_crash_handler(is_on);
     return parsed_as_bool;
+  } else if (StringCaseEqual(option, kWorkStealingRewriteThreads)) {
+    set_work_stealing_rewrite_pools(is_on);
+    return parsed_as_bool;
   } else if (StringCaseEqual(option, kListOutstandingUrlsOnError)) {
     list_outstanding_urls_on_error(is_on);
     return parsed_as_bool;
@@ -380,6 +418,12 @@ SystemRewriteDriverFactory::ParseAndSetOption1(StringPiece option,
   } else if (StringCaseEqual(option, kNumExpensiveRewriteThreads)) {
     set_num_expensive_rewrite_threads(int_value);
     return parsed_as_int;
+  } else if (StringCaseEqual(option, kExpensiveRewriteQueueDelayTargetMs)) {
+    set_low_priority_queue_delay_target_ms(int_value);
+    return parsed_as_int;
+  } else if (StringCaseEqual(option, kMaxCustomRewriteDriverPools)) {
+    set_max_custom_driver_pools(int_value);
+    return parsed_as_int;
   } else if (StringCaseEqual(option, kMessageBufferSize)) {
     set_message_buffer_size(int_value);
     return parsed_as_int;
@@ -478,6 +522,7 @@ void SystemRewriteDriverFactory::ShutDown() {
     defer_cleanup(new Deleter<UrlAsyncFetcher>(fetcher));
   }
   fetcher_map_.clear();
+  rate_controller_map_.clear();
   ShutDownFetchers();
 
   RewriteDriverFactory::ShutDown();
@@ -501,6 +546,10 @@ void SystemRewriteDriverFactory::ShutDown() {
                                          message_handler());
     }
 
+    if (origin_health_.get() != NULL) {
+      origin_health_->GlobalCleanup(message_handler());
+    }
+
     // Cleanup SharedCircularBuffer.
     // Use GoogleMessageHandler instead of SystemMessageHandler.
     // As we are cleaning SharedCircularBuffer, we do not want to write to its
@@ -526,6 +575,20 @@ GoogleString SystemRewriteDriverFactory::GetFetcherKey(
         track_original_content_length_ ? "track_content_length\n" : "no_track\n"
         "timeout: ", Integer64ToString(config->blocking_fetch_timeout_ms()),
         "\n");
+    StrAppend(&key,
+              "idle_connections: ",
+              IntegerToString(config->fetcher_max_idle_connections_per_host()),
+              "\nconnections: ",
+              IntegerToString(config->fetcher_max_connections_per_host()),
+              "\nidle_timeout: ",
+              Integer64ToString(config->fetcher_idle_connection_timeout_ms()),
+              "\nthreads: ", IntegerToString(config->num_fetcher_threads()),
+              "\n");
+    StrAppend(&key,
+              "adaptive_fetches: ",
+              IntegerToString(config->max_adaptive_fetches_per_host()),
+              "\n",
+              config->track_origin_health() ? "origin_health\n" : "");
     if (config->slurping_enabled() && include_slurping_config) {
       if (config->slurp_read_only()) {
         StrAppend(&key, "R", config->slurp_directory(), "\n");
@@ -568,9 +631,23 @@ UrlAsyncFetcher* SystemRewriteDriverFactory::GetFetcher(
         // Unfortunately, we need stats for load-shedding.
         if (config->statistics_enabled()) {
           TakeOwnership(fetcher);
-          fetcher = new RateControllingUrlAsyncFetcher(
-              fetcher, max_queue_size(), requests_per_host(), queued_per_host(),
-              thread_system(), statistics());
+          RateControllingUrlAsyncFetcher* rate_controlling_fetcher =
+              new RateControllingUrlAsyncFetcher(
+                  fetcher, max_queue_size(), requests_per_host(),
+                  queued_per_host(), thread_system(), statistics());
+          RateController* rate_controller =
+              rate_controlling_fetcher->rate_controller();
+          if (config->max_adaptive_fetches_per_host() > 0) {
+            rate_controller->EnableAdaptiveLimits(
+                std::max(config->max_adaptive_fetches_per_host(),
+                         requests_per_host()),
+                timer());
+          }
+          if (config->track_origin_health() && (origin_health_.get() != NULL)) {
+            rate_controller->TrackOriginHealth(origin_health_.get(), timer());
+          }
+          rate_controller_map_[key] = rate_controller;
+          fetcher = rate_controlling_fetcher;
         } else {
           message_handler()->Message(
               kError, "Can't enable fetch rate-limiting without statistics");
@@ -582,6 +659,13 @@ UrlAsyncFetcher* SystemRewriteDriverFactory::GetFetcher(
   return iter->second;
 }
 
+RateController* SystemRewriteDriverFactory::GetRateController(
+    SystemRewriteOptions* config) {
+  RateControllerMap::iterator iter =
+      rate_controller_map_.find(GetFetcherKey(true, config));
+  return (iter == rate_controller_map_.end()) ? NULL : iter->second;
+}
+
 UrlAsyncFetcher* SystemRewriteDriverFactory::AllocateFetcher(
     SystemRewriteOptions* config) {
   SerfUrlAsyncFetcher* serf = new SerfUrlAsyncFetcher(
@@ -590,12 +674,19 @@ UrlAsyncFetcher* SystemRewriteDriverFactory::AllocateFetcher(
       thread_system(), statistics(), timer(),
       config->blocking_fetch_timeout_ms(),
       message_handler());
+  serf->set_num_fetch_threads(config->num_fetcher_threads());
   serf->set_list_outstanding_urls_on_error(list_outstanding_urls_on_error_);
   serf->set_fetch_with_gzip(config->fetch_with_gzip());
   serf->set_track_original_content_length(track_original_content_length_);
   serf->SetHttpsOptions(config->https_options());
   serf->SetSslCertificatesDir(config->ssl_cert_directory());
   serf->SetSslCertificatesFile(config->ssl_cert_file());
+  serf->set_max_idle_connections_per_host(
+      config->fetcher_max_idle_connections_per_host());
+  serf->set_max_connections_per_host(
+      config->fetcher_max_connections_per_host());
+  serf->set_idle_connection_timeout_ms(
+      config->fetcher_idle_connection_timeout_ms());
   return serf;
 }
 
@@ -38,8 +38,10 @@ class NamedLockManager;
 class NonceGenerator;
 class ProcessContext;
 class QueuedWorkerPool;
+class RateController;
 class ServerContext;
 class SharedCircularBuffer;
+class SharedMemOriginHealth;
 class SharedMemStatistics;
 class StaticAssetManager;
 class Statistics;
@@ -137,6 +139,11 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   // root (ie. parent) process.
   void SharedCircularBufferInit(bool is_root);
 
+  // Creates the SharedMemOriginHealth used by rate-limiting fetchers, if any
+  // server context asks for origin health to be tracked.  is_root is true if
+  // this is invoked from the root process.
+  void OriginHealthInit(bool is_root);
+
   // Most options are parsed by and applied to the RewriteOptions via
   // ParseAndSetOptionFromNameN, but process-scope options need to be set on the
   // rewrite driver factory.
@@ -189,6 +196,10 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   // its required thread).
   UrlAsyncFetcher* GetFetcher(SystemRewriteOptions* config);
 
+  // Returns the RateController limiting fetches by GetFetcher(config), or
+  // NULL if they are not rate-limited.  GetFetcher must be called first.
+  RateController* GetRateController(SystemRewriteOptions* config);
+
   // Tracks the size of resources fetched from origin and populates the
   // X-Original-Content-Length header for resources derived from them.
   void set_track_original_content_length(bool x) {
@@ -329,6 +340,7 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   StringVector local_shm_stats_segment_names_;
   scoped_ptr<AbstractSharedMem> shared_mem_runtime_;
   scoped_ptr<SharedCircularBuffer> shared_circular_buffer_;
+  scoped_ptr<SharedMemOriginHealth> origin_health_;
 
   bool statistics_frozen_;
   bool is_root_process_;
@@ -363,6 +375,10 @@ class SystemRewriteDriverFactory : public RewriteDriverFactory {
   typedef std::map<GoogleString, UrlAsyncFetcher*> FetcherMap;
   FetcherMap base_fetcher_map_;
   FetcherMap fetcher_map_;
+  // The RateControllers of the rate-limiting fetchers in fetcher_map_, under
+  // the same keys.
+  typedef std::map<GoogleString, RateController*> RateControllerMap;
+  RateControllerMap rate_controller_map_;
 
   // URL prefix for support files required by pagespeed.
   GoogleString static_asset_prefix_;
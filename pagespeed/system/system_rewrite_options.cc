@@ -20,6 +20,7 @@
 #include "pagespeed/system/serf_url_async_fetcher.h"
 #include "pagespeed/kernel/base/basictypes.h"
 #include "pagespeed/kernel/base/timer.h"
+#include "pagespeed/kernel/cache/sharded_lru_cache.h"
 
 namespace net_instaweb {
 
@@ -29,7 +30,15 @@ namespace {
 
 const int64 kDefaultCacheFlushIntervalSec = 5;
 
+const char kCacheAdmissionFilter[] = "CacheAdmissionFilter";
+const char kCompressMetadataCacheDictionary[] =
+    "CompressMetadataCacheDictionary";
+const char kCompressMetadataCacheLevel[] = "CompressMetadataCacheLevel";
 const char kFetchHttps[] = "FetchHttps";
+const char kFileCacheAsyncIo[] = "FileCacheAsyncIo";
+const char kFileCacheCleanWithIndex[] = "FileCacheCleanWithIndex";
+const char kLruCachePolicy[] = "LRUCachePolicy";
+const char kLruCacheShards[] = "LRUCacheShards";
 
 }  // namespace
 
@@ -138,6 +147,18 @@ void SystemRewriteOptions::AddProperties() {
                     "afcl", RewriteOptions::kFileCacheCleanInodeLimit,
                     "Set the target number of inodes for the file cache; 0 "
                         "means no limit", true);
+  AddSystemProperty(false, &SystemRewriteOptions::file_cache_clean_with_index_,
+                    "afcx", kFileCacheCleanWithIndex,
+                    "Clean the file cache using a journaled index of its "
+                        "files, rather than walking the whole directory tree "
+                        "on every cleaning pass", true);
+  AddSystemProperty("off", &SystemRewriteOptions::file_cache_async_io_,
+                    "afca", kFileCacheAsyncIo,
+                    "How HTTP and metadata cache reads and writes reach the "
+                        "file cache: 'off' to block the calling thread, "
+                        "'threads' for a small I/O thread pool, or "
+                        "'io_uring' to batch them through the kernel, falling "
+                        "back to threads where io_uring is unavailable", true);
   AddSystemProperty(0, &SystemRewriteOptions::lru_cache_byte_limit_, "alcb",
                     RewriteOptions::kLruCacheByteLimit,
                     "Set the maximum byte size entry to store in the "
@@ -146,6 +167,23 @@ void SystemRewriteOptions::AddProperties() {
                     RewriteOptions::kLruCacheKbPerProcess,
                     "Set the total size, in KB, of the per-process in-memory "
                         "LRU cache", true);
+  AddSystemProperty(ShardedLRUCache::kDefaultNumShards,
+                    &SystemRewriteOptions::lru_cache_shards_, "alcs",
+                    kLruCacheShards,
+                    "Number of independently locked shards the per-process "
+                        "in-memory LRU cache is split into.  Each shard gets "
+                        "an equal part of LRUCacheKbPerProcess, which also "
+                        "bounds the largest value it can hold", true);
+  AddSystemProperty("lru", &SystemRewriteOptions::lru_cache_policy_, "alcr",
+                    kLruCachePolicy,
+                    "Replacement policy for the per-process in-memory LRU "
+                        "cache: 'lru', or '2q' for scan resistance", true);
+  AddSystemProperty(false, &SystemRewriteOptions::cache_admission_filter_,
+                    "acaf", kCacheAdmissionFilter,
+                    "Only let a new entry into the per-process LRU cache or "
+                        "the shared memory metadata cache if its key has "
+                        "recently been used more often than the entry it "
+                        "would evict", true);
   AddSystemProperty("", &SystemRewriteOptions::cache_flush_filename_, "acff",
                     RewriteOptions::kCacheFlushFilename,
                     "Name of file to check for timestamp updates used to flush "
@@ -162,6 +200,19 @@ void SystemRewriteOptions::AddProperties() {
                     "cc", RewriteOptions::kCompressMetadataCache,
                     "Whether to compress cache entries before writing them to "
                     "memory or disk.", true);
+  AddSystemProperty(-1, &SystemRewriteOptions::compress_metadata_cache_level_,
+                    "ccl", kCompressMetadataCacheLevel,
+                    "zlib level, from 1 (fastest) to 9 (smallest), at which "
+                        "to compress metadata and property cache entries; -1 "
+                        "for zlib's default", true);
+  AddSystemProperty("",
+                    &SystemRewriteOptions::compress_metadata_cache_dictionary_,
+                    "ccd", kCompressMetadataCacheDictionary,
+                    "File holding a preset zlib dictionary for compressing "
+                        "metadata and property cache entries, which helps "
+                        "with small ones.  Entries written with a dictionary "
+                        "can only be read while the same one is configured",
+                    true);
   AddSystemProperty("enable", &SystemRewriteOptions::https_options_, "fhs",
                     kFetchHttps, "Controls direct fetching of HTTPS resources."
                     "  Value is comma-separated list of keywords: "
@@ -207,6 +258,39 @@ void SystemRewriteOptions::AddProperties() {
                     "FetchWithGzip", kProcessScope,
                     "Request http content from origin servers using gzip",
                     true);
+  AddSystemProperty(
+      0, &SystemRewriteOptions::fetcher_max_idle_connections_per_host_,
+      "fmic", "FetcherMaxIdleConnectionsPerHost", kProcessScope,
+      "Number of connections to each origin server to keep open for reuse "
+      "once their fetches are done. Set to 0 to close each connection after "
+      "its fetch.", true);
+  AddSystemProperty(0,
+                    &SystemRewriteOptions::fetcher_max_connections_per_host_,
+                    "fmc", "FetcherMaxConnectionsPerHost", kProcessScope,
+                    "Limit on the connections open to each origin server for "
+                    "fetches at once; further fetches wait for one. "
+                    "Set to 0 for unlimited.", true);
+  AddSystemProperty(SerfUrlAsyncFetcher::kDefaultIdleConnectionTimeoutMs,
+                    &SystemRewriteOptions::fetcher_idle_connection_timeout_ms_,
+                    "fict", "FetcherIdleConnectionTimeoutMs", kProcessScope,
+                    "Milliseconds after which to close a connection to an "
+                    "origin server that is kept open for reuse.", true);
+  AddSystemProperty(1, &SystemRewriteOptions::num_fetcher_threads_, "nfth",
+                    "NumFetcherThreads", kProcessScope,
+                    "Number of threads fetching resources from origin "
+                    "servers, each with its own event loop.  Fetches are "
+                    "divided among them by origin.", true);
+  AddSystemProperty(0,
+                    &SystemRewriteOptions::max_adaptive_fetches_per_host_,
+                    "mafh", "MaxAdaptiveFetchesPerHost", kProcessScope,
+                    "If positive, the limit on background fetches to each "
+                    "origin server at once adapts to its latency, up to this "
+                    "many.  Set to 0 for a fixed limit.", true);
+  AddSystemProperty(false, &SystemRewriteOptions::track_origin_health_,
+                    "toh", "TrackOriginHealth", kProcessScope,
+                    "Share the error rate of fetches from each origin server "
+                    "among all processes, and stop background fetches from "
+                    "origins that are failing until they recover.", true);
   AddSystemProperty(1024 * 1024 * 10,  /* 10 Megabytes */
                     &SystemRewriteOptions::ipro_max_response_bytes_,
                     "imrb", "IproMaxResponseBytes", kProcessScope,
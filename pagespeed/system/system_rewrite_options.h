@@ -73,6 +73,18 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_file_cache_clean_inode_limit(int64 x) {
     set_option(x, &file_cache_clean_inode_limit_);
   }
+  bool file_cache_clean_with_index() const {
+    return file_cache_clean_with_index_.value();
+  }
+  void set_file_cache_clean_with_index(bool x) {
+    set_option(x, &file_cache_clean_with_index_);
+  }
+  const GoogleString& file_cache_async_io() const {
+    return file_cache_async_io_.value();
+  }
+  void set_file_cache_async_io(const StringPiece& x) {
+    set_option(x.as_string(), &file_cache_async_io_);
+  }
   int64 lru_cache_byte_limit() const {
     return lru_cache_byte_limit_.value();
   }
@@ -85,6 +97,24 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_lru_cache_kb_per_process(int64 x) {
     set_option(x, &lru_cache_kb_per_process_);
   }
+  int lru_cache_shards() const {
+    return lru_cache_shards_.value();
+  }
+  void set_lru_cache_shards(int x) {
+    set_option(x, &lru_cache_shards_);
+  }
+  const GoogleString& lru_cache_policy() const {
+    return lru_cache_policy_.value();
+  }
+  void set_lru_cache_policy(const StringPiece& x) {
+    set_option(x.as_string(), &lru_cache_policy_);
+  }
+  bool cache_admission_filter() const {
+    return cache_admission_filter_.value();
+  }
+  void set_cache_admission_filter(bool x) {
+    set_option(x, &cache_admission_filter_);
+  }
   bool use_shared_mem_locking() const {
     return use_shared_mem_locking_.value();
   }
@@ -97,6 +127,18 @@ class SystemRewriteOptions : public RewriteOptions {
   void set_compress_metadata_cache(bool x) {
     set_option(x, &compress_metadata_cache_);
   }
+  int compress_metadata_cache_level() const {
+    return compress_metadata_cache_level_.value();
+  }
+  void set_compress_metadata_cache_level(int x) {
+    set_option(x, &compress_metadata_cache_level_);
+  }
+  const GoogleString& compress_metadata_cache_dictionary() const {
+    return compress_metadata_cache_dictionary_.value();
+  }
+  void set_compress_metadata_cache_dictionary(const StringPiece& x) {
+    set_option(x.as_string(), &compress_metadata_cache_dictionary_);
+  }
   bool statistics_enabled() const {
     return statistics_enabled_.value();
   }
@@ -211,6 +253,24 @@ class SystemRewriteOptions : public RewriteOptions {
   bool fetch_with_gzip() const {
     return fetch_with_gzip_.value();
   }
+  int fetcher_max_idle_connections_per_host() const {
+    return fetcher_max_idle_connections_per_host_.value();
+  }
+  int fetcher_max_connections_per_host() const {
+    return fetcher_max_connections_per_host_.value();
+  }
+  int64 fetcher_idle_connection_timeout_ms() const {
+    return fetcher_idle_connection_timeout_ms_.value();
+  }
+  int num_fetcher_threads() const {
+    return num_fetcher_threads_.value();
+  }
+  int max_adaptive_fetches_per_host() const {
+    return max_adaptive_fetches_per_host_.value();
+  }
+  bool track_origin_health() const {
+    return track_origin_health_.value();
+  }
   int64 ipro_max_response_bytes() const {
     return ipro_max_response_bytes_.value();
   }
@@ -388,10 +448,24 @@ class SystemRewriteOptions : public RewriteOptions {
   // accept-encoding:gzip, even when used in a context when we want
   // cleartext.  We'll decompress as we read the content if needed.
   Option<bool> fetch_with_gzip_;
+  Option<bool> file_cache_clean_with_index_;
+  Option<bool> cache_admission_filter_;
 
   Option<int> memcached_threads_;
+  Option<int> compress_metadata_cache_level_;
   Option<int> memcached_timeout_us_;
 
+  // Connection reuse in the serf fetcher; see SerfUrlAsyncFetcher.
+  Option<int> fetcher_max_idle_connections_per_host_;
+  Option<int> fetcher_max_connections_per_host_;
+  Option<int64> fetcher_idle_connection_timeout_ms_;
+  Option<int> num_fetcher_threads_;
+
+  // Adaptive per-host limit on background fetches; see RateController.
+  Option<int> max_adaptive_fetches_per_host_;
+  // Shared tracking of failing origins; see SharedMemOriginHealth.
+  Option<bool> track_origin_health_;
+
   Option<int64> file_cache_clean_inode_limit_;
   Option<int64> file_cache_clean_interval_ms_;
   Option<int64> file_cache_clean_size_kb_;
@@ -407,6 +481,10 @@ class SystemRewriteOptions : public RewriteOptions {
   Option<int64> ipro_max_concurrent_recordings_;
   Option<int64> default_shared_memory_cache_kb_;
   Option<GoogleString> purge_method_;
+  Option<GoogleString> lru_cache_policy_;
+  Option<GoogleString> file_cache_async_io_;
+  Option<GoogleString> compress_metadata_cache_dictionary_;
+  Option<int> lru_cache_shards_;
 
   StaticAssetCDNOptions static_assets_to_cdn_;
 
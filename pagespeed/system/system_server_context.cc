@@ -68,6 +68,7 @@ SystemServerContext::SystemServerContext(
       local_statistics_(NULL),
       hostname_identifier_(StrCat(hostname, ":", IntegerToString(port))),
       system_caches_(NULL),
+      rate_controller_(NULL),
       cache_path_(NULL) {
   global_system_rewrite_options()->set_description(hostname_identifier_);
 }
@@ -247,6 +248,8 @@ void SystemServerContext::ChildInit(SystemRewriteDriverFactory* factory) {
     UrlAsyncFetcher* fetcher =
         factory->GetFetcher(global_system_rewrite_options());
     set_default_system_fetcher(fetcher);
+    rate_controller_ =
+        factory->GetRateController(global_system_rewrite_options());
 
     if (split_statistics_.get() != NULL) {
       // Readjust the SHM stuff for the new process
@@ -426,7 +429,7 @@ void SystemServerContext::AdminPage(
                          filesystem_metadata_cache(), http_cache(),
                          metadata_cache(), page_property_cache(), this,
                          statistics(), stats,  global_system_rewrite_options(),
-                         spdy_config);
+                         spdy_config, rate_controller_);
 }
 
 void SystemServerContext::StatisticsPage(bool is_global,
@@ -440,7 +443,7 @@ void SystemServerContext::StatisticsPage(bool is_global,
       is_global, query_params, options, fetch,
       system_caches_, filesystem_metadata_cache(), http_cache(),
       metadata_cache(), page_property_cache(), this, statistics(), stats,
-      global_system_rewrite_options(), spdy_config);
+      global_system_rewrite_options(), spdy_config, rate_controller_);
 }
 
 }  // namespace net_instaweb
@@ -35,6 +35,7 @@ class GoogleUrl;
 class Histogram;
 class QueryParams;
 class PurgeSet;
+class RateController;
 class RewriteDriver;
 class RewriteDriverFactory;
 class RewriteOptions;
@@ -265,6 +266,9 @@ class SystemServerContext : public ServerContext {
 
   SystemCaches* system_caches_;
 
+  // Limits our fetches, or NULL if they are not rate-limited.
+  RateController* rate_controller_;
+
   SystemCachePath* cache_path_;
 
   DISALLOW_COPY_AND_ASSIGN(SystemServerContext);